@@ -1,9 +1,94 @@
 #include "devices/block.h"
+#include <counter.h>
 #include <list.h>
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Request queues.
+
+   A device whose driver starts a queue for it with
+   block_start_queue() does not transfer sectors in the thread
+   that asks for them.  block_submit() queues a request and
+   returns at once, and the device's dispatch thread later
+   transfers it and calls its completion function.  The other
+   transfer functions submit a request and wait for it.
+
+   Each request carries the effective priority, donations
+   included, of the thread that submitted it.  A thread waiting
+   for its own request also lends the request any priority
+   donated to it later, say by a thread that wants a lock it
+   holds, and a request gains a level for each 1/AGING_PER_SEC
+   second it waits.  The dispatch thread takes the pending
+   requests of the highest such priority first, in C-LOOK order:
+   the lowest-numbered one at or past the end of the last one
+   dispatched, or else the lowest-numbered of all, so that the
+   head sweeps upward through the disk and then jumps back.  A
+   request that has waited past its deadline goes first instead,
+   so that a stream of requests just ahead of the head cannot
+   starve one behind it.  While it transfers a batch, the
+   dispatch thread runs at the batch's priority, so that a
+   priority donated to a thread that waits for the disk reaches
+   the thread that does the work.  Requests in the same direction for
+   sectors adjacent to the chosen one, before or after it, are
+   merged with it into a single multi-sector command.
+
+   A request with BIO_PREFLUSH or BIO_FUA has the device's write
+   cache flushed before or after it, respectively.  Neither flag
+   orders the request against others still pending, since a
+   caller that needs one write to reach the disk before another
+   waits for the first to complete anyway; they only make the
+   writes durable.  So flagged requests are merged like any other,
+   the flags applying to the whole merged command.  A flush by
+   itself, from block_flush(), is a request for no sectors.
+
+   A discard, from block_discard(), is a write with BIO_DISCARD
+   and no buffers, which may cover any number of sectors.  It is
+   merged only with other discards, however many sectors they
+   cover together.
+
+   Partitions have no queue of their own: their requests go to
+   the queue of the device they are on. */
+
+/* Most sectors one dispatch transfers. */
+#define QUEUE_MERGE_MAX BIO_MAX
+
+/* Timer ticks a read or a write may wait before it goes ahead of
+   C-LOOK order. */
+#define READ_DEADLINE (TIMER_FREQ / 20)
+#define WRITE_DEADLINE (TIMER_FREQ / 4)
+
+/* Priority levels a pending request gains per second. */
+#define AGING_PER_SEC 100
+
+/* A device's request queue. */
+struct block_queue
+  {
+    struct lock lock;                   /* Protects the members below. */
+    struct condition queued;            /* Signaled when PENDING grows. */
+    struct list pending;                /* Requests in arrival order. */
+    size_t depth;                       /* Number of requests in PENDING. */
+    block_sector_t head;                /* Sector after last dispatched. */
+    void *buffers[QUEUE_MERGE_MAX];     /* The dispatch in progress. */
+    struct thread *dispatcher;          /* Dispatch thread, once running. */
+
+    /* Statistics. */
+    unsigned long long requests;        /* Requests queued. */
+    unsigned long long dispatches;      /* Commands issued. */
+    unsigned long long merges;          /* Requests merged into others. */
+    unsigned long long expired;         /* Dispatched past deadline. */
+    unsigned long long promoted;        /* Dispatched ahead of C-LOOK
+                                           order for priority. */
+    unsigned long long depth_sum;       /* DEPTH summed over dispatches. */
+    size_t max_depth;                   /* Greatest DEPTH. */
+    struct histogram depths;            /* DEPTH at each submission. */
+  };
 
 /* A block device. */
 struct block
@@ -17,8 +102,18 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
-    unsigned long long read_cnt;        /* Number of sectors read. */
-    unsigned long long write_cnt;       /* Number of sectors written. */
+    /* Statistics, updated with interrupts off, except for the
+       sectors read and written, which block_get_stats() copies
+       into STATS from counters of their own.  The request
+       statistics count requests submitted to this device, not
+       ones passed on to it by another. */
+    struct block_stats stats;
+    struct counter read_cnt;            /* Sectors read. */
+    struct counter write_cnt;           /* Sectors written. */
+    block_sector_t next_sector;         /* Sector after last request. */
+    int64_t first_tick;                 /* Tick of first request, or 0. */
+
+    struct block_queue *queue;          /* Request queue, or null. */
   };
 
 /* List of all block devices. */
@@ -28,6 +123,13 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void transfer (struct block *, block_sector_t, void *const buffers[],
+                      size_t cnt, bool write, unsigned flags);
+static void submit (struct block *, block_sector_t, void *const buffers[],
+                    size_t cnt, bool write, unsigned flags);
+static void wake_submitter (struct bio *);
+static void print_request_stats (struct block *);
+static thread_func dispatch_thread;
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -121,8 +223,7 @@ void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
   check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  submit (block, sector, &buffer, 1, false, 0);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -135,8 +236,109 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  submit (block, sector, (void *const *) &buffer, 1, true, 0);
+}
+
+/* Writes sector SECTOR to BLOCK from BUFFER, as block_write()
+   does, with FLAGS, a combination of BIO_* flags.  With
+   BIO_PREFLUSH, the writes to BLOCK that completed before the
+   call are durable before this one is, and with BIO_FUA, this
+   one is durable when the call returns, even if BLOCK caches
+   writes. */
+void
+block_write_flags (struct block *block, block_sector_t sector,
+                   const void *buffer, unsigned flags)
+{
+  check_sector (block, sector);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  submit (block, sector, (void *const *) &buffer, 1, true, flags);
+}
+
+/* Returns when the writes to BLOCK that completed before the call
+   are durable, flushing BLOCK's write cache if it has one. */
+void
+block_flush (struct block *block)
+{
+  struct semaphore done;
+  struct bio bio;
+
+  ASSERT (block->type != BLOCK_FOREIGN);
+  sema_init (&done, 0);
+  bio.sector = 0;
+  bio.cnt = 0;
+  bio.buffers = NULL;
+  bio.write = true;
+  bio.flags = BIO_PREFLUSH;
+  bio.done = wake_submitter;
+  bio.aux = &done;
+  block_submit (block, &bio);
+  sema_down (&done);
+}
+
+/* Tells BLOCK that the CNT sectors starting at SECTOR no longer
+   hold anything of use, so that a thin-provisioned device, such
+   as a sparse disk image, can give back the space they take, and
+   returns when BLOCK has been told.  Until the sectors are
+   written again, reading them may return anything.  Does nothing
+   if BLOCK's driver cannot discard. */
+void
+block_discard (struct block *block, block_sector_t sector,
+               block_sector_t cnt)
+{
+  struct semaphore done;
+  struct bio bio;
+
+  ASSERT (block->type != BLOCK_FOREIGN);
+  if (cnt == 0)
+    return;
+  sema_init (&done, 0);
+  bio.sector = sector;
+  bio.cnt = cnt;
+  bio.buffers = NULL;
+  bio.write = true;
+  bio.flags = BIO_DISCARD;
+  bio.done = wake_submitter;
+  bio.aux = &done;
+  block_submit (block, &bio);
+  sema_down (&done);
+}
+
+/* Verifies that the CNT sectors starting at SECTOR are all
+   within BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
+{
+  if (sector >= block->size || cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", cnt=%zu, "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt,
+           block->size);
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK into
+   BUFFERS[0] through BUFFERS[CNT - 1], each of which must have
+   room for BLOCK_SECTOR_SIZE bytes.  A driver that can do so
+   reads them with as few commands as possible.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multi (struct block *block, block_sector_t sector,
+                  void *const buffers[], size_t cnt)
+{
+  submit (block, sector, buffers, cnt, false, 0);
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from
+   BUFFERS[0] through BUFFERS[CNT - 1], each of which must
+   contain BLOCK_SECTOR_SIZE bytes, as block_read_multi() reads
+   them.  Returns after the block device has acknowledged
+   receiving the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multi (struct block *block, block_sector_t sector,
+                   const void *const buffers[], size_t cnt)
+{
+  submit (block, sector, (void *const *) buffers, cnt, true, 0);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -164,6 +366,8 @@ block_type (struct block *block)
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
+  char name[48];
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
@@ -173,7 +377,28 @@ block_print_stats (void)
         {
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  counter_read (&block->read_cnt),
+                  counter_read (&block->write_cnt));
+          print_request_stats (block);
+        }
+    }
+
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      struct block_queue *q = block->queue;
+      if (q != NULL && q->requests > 0)
+        {
+          unsigned long long avg = q->depth_sum * 100 / q->dispatches;
+          printf ("%s queue: %llu requests in %llu commands, "
+                  "%llu merged, %llu past deadline, %llu by priority, "
+                  "depth %llu.%02llu average, %zu max\n",
+                  block->name, q->requests, q->dispatches, q->merges,
+                  q->expired, q->promoted, avg / 100, avg % 100,
+                  q->max_depth);
+          snprintf (name, sizeof name, "%s queue: depth", block->name);
+          histogram_print (name, &q->depths);
         }
     }
 }
@@ -198,8 +423,14 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  memset (&block->stats, 0, sizeof block->stats);
+  histogram_init (&block->stats.read_latency);
+  histogram_init (&block->stats.write_latency);
+  counter_init (&block->read_cnt);
+  counter_init (&block->write_cnt);
+  block->next_sector = 0;
+  block->first_tick = 0;
+  block->queue = NULL;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -221,3 +452,499 @@ list_elem_to_block (struct list_elem *list_elem)
           : NULL);
 }
 
+
+/* Starts a request queue and a dispatch thread for BLOCK, which
+   must be a device registered by its driver, not a partition.
+   From then on, BLOCK's operations are only called by the
+   dispatch thread. */
+void
+block_start_queue (struct block *block)
+{
+  struct block_queue *q;
+  char name[16 + 8];
+
+  ASSERT (block->queue == NULL);
+
+  q = malloc (sizeof *q);
+  if (q == NULL)
+    PANIC ("Failed to allocate memory for block device queue");
+  lock_init (&q->lock);
+  cond_init (&q->queued);
+  list_init (&q->pending);
+  q->depth = 0;
+  q->head = 0;
+  q->dispatcher = NULL;
+  q->requests = q->dispatches = q->merges = q->expired = q->promoted = 0;
+  q->depth_sum = 0;
+  q->max_depth = 0;
+  histogram_init (&q->depths);
+  block->queue = q;
+
+  snprintf (name, sizeof name, "%s-queue", block->name);
+  thread_create_sized (name, PRI_DEFAULT, THREAD_STACK_SMALL, dispatch_thread,
+                       block);
+}
+
+/* Flushes BLOCK's write cache, if it has one. */
+static void
+flush (struct block *block)
+{
+  enum intr_level old_level;
+
+  if (block->ops->flush == NULL)
+    return;
+  block->ops->flush (block->aux);
+  old_level = intr_disable ();
+  block->stats.flushes++;
+  intr_set_level (old_level);
+}
+
+/* Transfers the CNT sectors starting at SECTOR between BLOCK and
+   BUFFERS[0] through BUFFERS[CNT - 1], writing them if WRITE is
+   true and reading them otherwise, with the driver's
+   multi-sector operation if it has one, or discarding them,
+   without touching BUFFERS, if FLAGS includes BIO_DISCARD.
+   Flushes BLOCK's write cache first if FLAGS includes
+   BIO_PREFLUSH, and afterward if it includes BIO_FUA. */
+static void
+transfer (struct block *block, block_sector_t sector, void *const buffers[],
+          size_t cnt, bool write, unsigned flags)
+{
+  const struct block_operations *ops = block->ops;
+  size_t i;
+
+  if (flags & BIO_PREFLUSH)
+    flush (block);
+  if (cnt == 0)
+    {
+      /* Only a flush. */
+    }
+  else if (flags & BIO_DISCARD)
+    {
+      if (ops->discard != NULL)
+        ops->discard (block->aux, sector, cnt);
+    }
+  else if (write && ops->write_multi != NULL)
+    ops->write_multi (block->aux, sector, (const void *const *) buffers, cnt);
+  else if (!write && ops->read_multi != NULL)
+    ops->read_multi (block->aux, sector, buffers, cnt);
+  else
+    for (i = 0; i < cnt; i++)
+      if (write)
+        ops->write (block->aux, sector + i, buffers[i]);
+      else
+        ops->read (block->aux, sector + i, buffers[i]);
+  if (flags & BIO_FUA)
+    flush (block);
+}
+
+/* Submits BIO, a request to transfer BIO->CNT sectors, at most
+   BIO_MAX, starting at BIO->SECTOR between BLOCK and
+   BIO->BUFFERS[0] through BIO->BUFFERS[BIO->CNT - 1], each of
+   which has room for BLOCK_SECTOR_SIZE bytes.  Writes the
+   sectors to BLOCK if BIO->WRITE is true, and reads them
+   otherwise, with the BIO_* flags in BIO->FLAGS.  BIO->CNT may
+   be 0 for a write with BIO_PREFLUSH that only flushes.  A
+   write with BIO_DISCARD has null BIO->BUFFERS and may exceed
+   BIO_MAX sectors.  If BLOCK has a queue, returns at once, leaving the
+   transfer to BLOCK's dispatch thread; otherwise, transfers the
+   sectors first, unless its driver passes BIO on to another
+   device, as a partition does.  Either way, calls BIO->DONE (BIO)
+   when they have been transferred, after which the block layer
+   no longer uses BIO or its buffers.  Until then, BIO belongs to
+   the block layer, which may change its members.
+
+   BIO->DONE runs in the dispatch thread, or in an interrupt
+   handler for a driver that completes requests there, and so
+   must not sleep, except that up'ing a semaphore is fine. */
+void
+block_submit (struct block *block, struct bio *bio)
+{
+  enum intr_level old_level;
+
+  bio->origin = block;
+  bio->start = rdtsc ();
+  bio->priority = intr_context () ? PRI_DEFAULT : thread_get_priority ();
+  /* submit()'s requests have their submitter waiting for them. */
+  bio->waiter = (bio->done == wake_submitter && !intr_context ()
+                 ? thread_current () : NULL);
+
+  if (bio->cnt > 0 && !(bio->flags & BIO_DISCARD))
+    {
+      old_level = intr_disable ();
+      if (block->stats.requests++ == 0)
+        block->first_tick = timer_ticks ();
+      if (bio->sector == block->next_sector)
+        block->stats.sequential++;
+      block->next_sector = bio->sector + bio->cnt;
+      intr_set_level (old_level);
+
+#ifdef USERPROG
+      /* Charged to the process that asked for the transfer. */
+      if (!intr_context ())
+        {
+          struct thread *t = thread_current ()->proceso;
+          if (bio->write)
+            t->sectores_escritos += bio->cnt;
+          else
+            t->sectores_leidos += bio->cnt;
+        }
+#endif
+    }
+
+  block_forward (block, bio);
+}
+
+/* Passes BIO, which a driver's submit operation received, on to
+   BLOCK, as block_submit() does, but counting its latency for
+   the device it was first submitted to. */
+void
+block_forward (struct block *block, struct bio *bio)
+{
+  struct block_queue *q = block->queue;
+  enum intr_level old_level;
+
+  ASSERT (bio->cnt <= BIO_MAX || (bio->flags & BIO_DISCARD));
+  ASSERT (bio->cnt > 0 || (bio->write && (bio->flags & BIO_PREFLUSH)));
+  ASSERT (!(bio->flags & BIO_DISCARD) || bio->write);
+  ASSERT (!bio->write || block->type != BLOCK_FOREIGN);
+  check_sectors (block, bio->sector, bio->cnt);
+  if (bio->flags & BIO_DISCARD)
+    {
+      old_level = intr_disable ();
+      block->stats.discard_cnt += bio->cnt;
+      intr_set_level (old_level);
+    }
+  else
+    counter_add (bio->write ? &block->write_cnt : &block->read_cnt, bio->cnt);
+
+  if (block->ops->submit != NULL)
+    {
+      block->ops->submit (block->aux, bio);
+      return;
+    }
+  if (q == NULL)
+    {
+      transfer (block, bio->sector, bio->buffers, bio->cnt, bio->write,
+                bio->flags);
+      block_complete (bio);
+      return;
+    }
+
+  bio->queued = timer_ticks ();
+  bio->deadline = bio->queued + (bio->write ? WRITE_DEADLINE : READ_DEADLINE);
+  lock_acquire (&q->lock);
+  list_push_back (&q->pending, &bio->elem);
+  if (++q->depth > q->max_depth)
+    q->max_depth = q->depth;
+  q->requests++;
+  histogram_add (&q->depths, q->depth);
+  cond_signal (&q->queued, &q->lock);
+
+  /* Don't leave a more important request behind a transfer in
+     progress at a lower priority. */
+  if (!thread_mlfqs && q->dispatcher != NULL
+      && bio->priority > q->dispatcher->priority)
+    thread_update_priority (q->dispatcher, bio->priority);
+  lock_release (&q->lock);
+}
+
+/* Records how long BIO took for the device it was submitted to,
+   unless it only flushed or discarded, and calls its completion
+   function.  A
+   driver whose submit operation does not pass BIO on calls this
+   when it has transferred BIO, possibly from an interrupt
+   handler. */
+void
+block_complete (struct bio *bio)
+{
+  struct block_stats *s = &bio->origin->stats;
+  uint64_t cycles = rdtsc () - bio->start;
+  enum intr_level old_level;
+
+  if (bio->cnt > 0 && !(bio->flags & BIO_DISCARD))
+    {
+      old_level = intr_disable ();
+      histogram_add (bio->write ? &s->write_latency : &s->read_latency,
+                     cycles);
+      intr_set_level (old_level);
+    }
+  bio->done (bio);
+}
+
+/* Copies BLOCK's statistics into *STATS. */
+void
+block_get_stats (struct block *block, struct block_stats *stats)
+{
+  enum intr_level old_level = intr_disable ();
+  *stats = block->stats;
+  intr_set_level (old_level);
+  stats->read_cnt = counter_read (&block->read_cnt);
+  stats->write_cnt = counter_read (&block->write_cnt);
+}
+
+/* Prints BLOCK's request statistics, if any requests were
+   submitted to it. */
+static void
+print_request_stats (struct block *block)
+{
+  struct block_stats s;
+  int64_t ticks;
+  char name[48];
+
+  block_get_stats (block, &s);
+  if (s.requests == 0)
+    return;
+
+  ticks = timer_elapsed (block->first_tick);
+  printf ("%s: %llu requests, %llu%% sequential, %llu kB/s over %lld ticks, "
+          "%llu flushes, %llu sectors discarded\n",
+          block->name, s.requests, s.sequential * 100 / s.requests,
+          ((s.read_cnt + s.write_cnt) * BLOCK_SECTOR_SIZE / 1024 * TIMER_FREQ
+           / (ticks > 0 ? ticks : 1)),
+          ticks, s.flushes, s.discard_cnt);
+  snprintf (name, sizeof name, "%s: read latency cycles", block->name);
+  histogram_print (name, &s.read_latency);
+  snprintf (name, sizeof name, "%s: write latency cycles", block->name);
+  histogram_print (name, &s.write_latency);
+}
+
+/* Completion function for the requests submit() waits for. */
+static void
+wake_submitter (struct bio *bio)
+{
+  sema_up (bio->aux);
+}
+
+/* Transfers sectors between BLOCK and BUFFERS as transfer()
+   does, through BLOCK's queue if it has one, and returns when
+   they have been transferred.  For a write, BUFFERS is only
+   read, despite its type.  BIO_PREFLUSH in FLAGS applies to the
+   first request, BIO_FUA to every one. */
+static void
+submit (struct block *block, block_sector_t sector, void *const buffers[],
+        size_t cnt, bool write, unsigned flags)
+{
+  struct semaphore done;
+
+  sema_init (&done, 0);
+  while (cnt > 0)
+    {
+      struct bio bio;
+
+      bio.sector = sector;
+      bio.cnt = cnt < BIO_MAX ? cnt : BIO_MAX;
+      bio.buffers = buffers;
+      bio.write = write;
+      bio.flags = flags;
+      bio.done = wake_submitter;
+      bio.aux = &done;
+      block_submit (block, &bio);
+      sema_down (&done);
+
+      sector += bio.cnt;
+      buffers += bio.cnt;
+      cnt -= bio.cnt;
+      flags &= ~BIO_PREFLUSH;
+    }
+}
+
+/* Returns the priority of request R at tick NOW: the greater of
+   its own and its waiter's, plus what it has gained by waiting,
+   at most PRI_MAX. */
+static int
+request_priority (const struct bio *r, int64_t now)
+{
+  int priority = r->priority;
+
+  if (r->waiter != NULL && r->waiter->priority > priority)
+    priority = r->waiter->priority;
+  priority += (now - r->queued) * AGING_PER_SEC / TIMER_FREQ;
+  return priority < PRI_MAX ? priority : PRI_MAX;
+}
+
+/* Returns the pending request in queue Q to dispatch next: the
+   oldest one if it has waited past its deadline, otherwise the
+   next one in C-LOOK order among those of the highest priority.
+   The caller must hold Q's lock, and Q must have a pending
+   request. */
+static struct bio *
+choose_request (struct block_queue *q)
+{
+  struct bio *oldest, *next = NULL, *lowest = NULL;
+  struct bio *any_next = NULL, *any_lowest = NULL;
+  int64_t now = timer_ticks ();
+  int top = PRI_MIN;
+  struct list_elem *e;
+
+  oldest = list_entry (list_front (&q->pending), struct bio, elem);
+  if (now >= oldest->deadline)
+    {
+      q->expired++;
+      return oldest;
+    }
+
+  for (e = list_begin (&q->pending); e != list_end (&q->pending);
+       e = list_next (e))
+    {
+      struct bio *r = list_entry (e, struct bio, elem);
+      int priority = request_priority (r, now);
+
+      /* C-LOOK among all requests, to count promotions. */
+      if (any_lowest == NULL || r->sector < any_lowest->sector)
+        any_lowest = r;
+      if (r->sector >= q->head
+          && (any_next == NULL || r->sector < any_next->sector))
+        any_next = r;
+
+      /* C-LOOK among the requests of priority TOP. */
+      if (priority > top)
+        {
+          top = priority;
+          next = lowest = NULL;
+        }
+      else if (priority < top)
+        continue;
+      if (lowest == NULL || r->sector < lowest->sector)
+        lowest = r;
+      if (r->sector >= q->head && (next == NULL || r->sector < next->sector))
+        next = r;
+    }
+  if (next == NULL)
+    next = lowest;
+  if (next != (any_next != NULL ? any_next : any_lowest))
+    q->promoted++;
+  return next;
+}
+
+/* Moves the pending requests in queue Q that are adjacent to the
+   sectors START through *END - 1, which BATCH's requests cover,
+   and go in the same direction, into BATCH, in sector order,
+   while they fit in QUEUE_MERGE_MAX sectors.  Updates *START and
+   *END to match, and adds the merged requests' flags to *FLAGS.
+   Requests that only flush are not merged, and discards, which
+   *FLAGS tells apart, are merged only with each other, with no
+   limit.  The caller must hold Q's lock. */
+static void
+merge_requests (struct block_queue *q, struct list *batch, bool write,
+                block_sector_t *start, block_sector_t *end, unsigned *flags)
+{
+  unsigned discard = *flags & BIO_DISCARD;
+  struct list_elem *e;
+
+  if (*start == *end)
+    return;
+  e = list_begin (&q->pending);
+  while (e != list_end (&q->pending))
+    {
+      struct bio *r = list_entry (e, struct bio, elem);
+
+      if (r->write == write && r->cnt > 0
+          && (r->flags & BIO_DISCARD) == discard
+          && (discard || *end - *start + r->cnt <= QUEUE_MERGE_MAX)
+          && (r->sector == *end || r->sector + r->cnt == *start))
+        {
+          list_remove (e);
+          q->depth--;
+          q->merges++;
+          *flags |= r->flags;
+          if (r->sector == *end)
+            {
+              list_push_back (batch, &r->elem);
+              *end += r->cnt;
+            }
+          else
+            {
+              list_push_front (batch, &r->elem);
+              *start = r->sector;
+            }
+
+          /* The batch grew, so an earlier request may fit now. */
+          e = list_begin (&q->pending);
+        }
+      else
+        e = list_next (e);
+    }
+}
+
+/* Dispatch thread for block device BLOCK_, which must have a
+   queue.  Transfers the queued requests, a batch of merged
+   requests at a time, and wakes up their callers. */
+static void
+dispatch_thread (void *block_)
+{
+  struct block *block = block_;
+  struct block_queue *q = block->queue;
+
+  lock_acquire (&q->lock);
+  q->dispatcher = thread_current ();
+  lock_release (&q->lock);
+
+  for (;;)
+    {
+      struct bio *first;
+      struct list batch;
+      struct list_elem *e;
+      block_sector_t start, end;
+      unsigned flags;
+      size_t cnt;
+      int priority;
+
+      lock_acquire (&q->lock);
+      while (list_empty (&q->pending))
+        cond_wait (&q->queued, &q->lock);
+      q->dispatches++;
+      q->depth_sum += q->depth;
+
+      first = choose_request (q);
+      list_remove (&first->elem);
+      q->depth--;
+      list_init (&batch);
+      list_push_back (&batch, &first->elem);
+      start = first->sector;
+      end = start + first->cnt;
+      flags = first->flags;
+      merge_requests (q, &batch, first->write, &start, &end, &flags);
+      if (start != end)
+        q->head = end;
+      priority = q->dispatcher->priorityOriginal;
+      for (e = list_begin (&batch); e != list_end (&batch); e = list_next (e))
+        {
+          int p = request_priority (list_entry (e, struct bio, elem),
+                                    timer_ticks ());
+          if (p > priority)
+            priority = p;
+        }
+      lock_release (&q->lock);
+
+      /* Now that we hold no lock, no donation can be lost by
+         setting our priority directly.  Under the MLFQS the
+         scheduler sets it. */
+      if (!thread_mlfqs)
+        thread_update_priority (q->dispatcher, priority);
+
+      /* Only this thread uses Q's buffers.  A discard has none. */
+      cnt = end - start;
+      if (!(flags & BIO_DISCARD))
+        {
+          cnt = 0;
+          for (e = list_begin (&batch); e != list_end (&batch);
+               e = list_next (e))
+            {
+              struct bio *r = list_entry (e, struct bio, elem);
+              memcpy (q->buffers + cnt, r->buffers,
+                      r->cnt * sizeof *r->buffers);
+              cnt += r->cnt;
+            }
+        }
+      transfer (block, start, q->buffers, cnt, first->write, flags);
+
+      /* A request may be gone as soon as it is done. */
+      for (e = list_begin (&batch); e != list_end (&batch); )
+        {
+          struct bio *r = list_entry (e, struct bio, elem);
+          e = list_next (e);
+          block_complete (r);
+        }
+    }
+}
@@ -1,6 +1,9 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <histogram.h>
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
 
@@ -53,22 +56,109 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multi (struct block *, block_sector_t,
+                       void *const buffers[], size_t cnt);
+void block_write_multi (struct block *, block_sector_t,
+                        const void *const buffers[], size_t cnt);
+void block_write_flags (struct block *, block_sector_t, const void *,
+                        unsigned flags);
+void block_flush (struct block *);
+void block_discard (struct block *, block_sector_t, block_sector_t cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
-/* Statistics. */
+/* Asynchronous requests. */
+
+/* Most sectors one request may transfer. */
+#define BIO_MAX 128
+
+/* Flags for struct bio.  A device that does not cache writes
+   ignores them. */
+#define BIO_PREFLUSH 0x1        /* First make the writes completed
+                                   before submission durable. */
+#define BIO_FUA 0x2             /* Done only when durable. */
+#define BIO_DISCARD 0x4         /* A write of no data that lets the
+                                   device forget the sectors. */
+
+/* A request for block_submit().  The submitter fills in the
+   members up to AUX. */
+struct bio
+  {
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    void *const *buffers;               /* One buffer per sector,
+                                           only read by a write. */
+    bool write;                         /* Write, not read? */
+    unsigned flags;                     /* BIO_* flags. */
+    void (*done) (struct bio *);        /* Called when transferred. */
+    void *aux;                          /* For DONE's use. */
+
+    /* Owned by the block layer. */
+    struct list_elem elem;              /* Element in a queue's list,
+                                           or a driver's. */
+    int64_t queued;                     /* Tick it was queued. */
+    int64_t deadline;                   /* Go first from this tick on. */
+    int priority;                       /* Submitter's priority then. */
+    struct thread *waiter;              /* Thread waiting for it, or null. */
+    struct block *origin;               /* Device submitted to. */
+    uint64_t start;                     /* Time-stamp counter then. */
+  };
+
+void block_submit (struct block *, struct bio *);
+void block_forward (struct block *, struct bio *);
+
+/* Statistics of a block device. */
+struct block_stats
+  {
+    unsigned long long read_cnt;        /* Number of sectors read. */
+    unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long discard_cnt;     /* Number of sectors discarded. */
+    unsigned long long requests;        /* Requests submitted. */
+    unsigned long long sequential;      /* Requests that began where the
+                                           previous one ended. */
+    unsigned long long flushes;         /* Write caches flushed. */
+    struct histogram read_latency;      /* Cycles from submission to */
+    struct histogram write_latency;     /* completion. */
+  };
+
+void block_get_stats (struct block *, struct block_stats *);
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
+struct bio;
+
+/* READ_MULTI and WRITE_MULTI, which transfer several adjacent
+   sectors at once, may be null pointers, in which case the
+   sectors are transferred one at a time.  SUBMIT, which passes a
+   request on to another device without waiting for it, may be a
+   null pointer too, as may FLUSH, which returns when the writes
+   completed so far are durable, for a device that does not
+   cache writes.  DISCARD, which tells the device that it need not
+   keep the contents of CNT sectors, may be a null pointer for a
+   device that cannot use that, in which case discards do
+   nothing.  A device with SUBMIT gets every request through it,
+   flushes and discards included, and needs neither READ, WRITE,
+   FLUSH nor DISCARD; unless it passes them on with
+   block_forward(), it calls block_complete() for each when it is
+   done. */
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read_multi) (void *aux, block_sector_t,
+                        void *const buffers[], size_t cnt);
+    void (*write_multi) (void *aux, block_sector_t,
+                         const void *const buffers[], size_t cnt);
+    void (*submit) (void *aux, struct bio *);
+    void (*flush) (void *aux);
+    void (*discard) (void *aux, block_sector_t, block_sector_t cnt);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_start_queue (struct block *);
+void block_complete (struct bio *);
 
 #endif /* devices/block.h */
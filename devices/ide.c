@@ -5,17 +5,38 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Sectors move between memory and the disk either by PIO, in
+   which the CPU copies each word through the data register, or,
+   if the controller is a PCI bus master, by DMA, in which the
+   controller copies the whole sector by itself and interrupts
+   when it is done.  DMA is used whenever both the controller and
+   the disk support it, unless the "-pio" option is given.  A
+   DMA transfer that fails is retried with PIO, which is then
+   used for that disk from then on.
+
+   A disk that supports the TRIM function of DATA SET MANAGEMENT,
+   which goes by DMA only, is told about discarded sectors with
+   it, a block of TRIM_RANGES ranges per command.  Other disks
+   ignore discards. */
+
+/* Transfer by DMA when the controller and disk support it? */
+bool ide_use_dma = true;
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
-#define reg_error(CHANNEL) ((CHANNEL)->reg_base + 1)    /* Error. */
+#define reg_error(CHANNEL) ((CHANNEL)->reg_base + 1)    /* Error (r/o). */
+#define reg_features(CHANNEL) reg_error (CHANNEL)       /* Features (w/o). */
 #define reg_nsect(CHANNEL) ((CHANNEL)->reg_base + 2)    /* Sector Count. */
 #define reg_lbal(CHANNEL) ((CHANNEL)->reg_base + 3)     /* LBA 0:7. */
 #define reg_lbam(CHANNEL) ((CHANNEL)->reg_base + 4)     /* LBA 15:8. */
@@ -33,7 +54,9 @@
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
+#define STA_DF 0x20             /* Device Fault. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +72,76 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+#define CMD_FLUSH_CACHE 0xe7            /* FLUSH CACHE. */
+#define CMD_FLUSH_CACHE_EXT 0xea        /* FLUSH CACHE EXT. */
+#define CMD_DATA_SET_MANAGEMENT 0x06    /* DATA SET MANAGEMENT. */
+
+/* Features register value for DATA SET MANAGEMENT. */
+#define DSM_TRIM 0x01                   /* TRIM. */
+
+/* Words of the IDENTIFY DEVICE response. */
+#define ID_CAPABILITIES 49      /* Capabilities. */
+#define ID_CAP_DMA 0x0100       /* DMA supported. */
+#define ID_COMMANDS 83          /* Command sets supported. */
+#define ID_COM_VALID_MASK 0xc000 /* Must be ID_COM_VALID... */
+#define ID_COM_VALID 0x4000     /* ...for the word to be valid. */
+#define ID_COM_FLUSH 0x1000     /* FLUSH CACHE supported. */
+#define ID_COM_FLUSH_EXT 0x2000 /* FLUSH CACHE EXT supported. */
+#define ID_ENABLED 85           /* Features enabled. */
+#define ID_EN_WRITE_CACHE 0x0020 /* Write cache enabled. */
+#define ID_DSM 169              /* DATA SET MANAGEMENT support. */
+#define ID_DSM_TRIM 0x0001      /* TRIM supported. */
+
+/* Bus master port addresses, relative to the channel's bus
+   master base.  See the "Programming Interface for Bus Master
+   IDE Controller" specification. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BMC_START 0x01          /* Start transfer. */
+#define BMC_READ 0x08           /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits.  BMS_ERR and BMS_IRQ are
+   cleared by writing 1s to them. */
+#define BMS_ERR 0x02            /* Transfer failed. */
+#define BMS_IRQ 0x04            /* Disk interrupted. */
+#define BMS_DMA0 0x20           /* Device 0 can do DMA. */
+#define BMS_DMA1 0x40           /* Device 1 can do DMA. */
+
+/* Prog IF bits of an IDE controller's PCI class register. */
+#define PROG_IF_NATIVE0 0x01    /* Channel 0 not at legacy ports. */
+#define PROG_IF_NATIVE1 0x04    /* Channel 1 not at legacy ports. */
+#define PROG_IF_MASTER 0x80     /* Bus master. */
+
+/* A Physical Region Descriptor, which tells the bus master where
+   in physical memory to transfer part of a sector.  A region may
+   not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address, must be even. */
+    uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT or 0. */
+  };
+
+#define PRD_EOT 0x8000          /* Last region of the transfer. */
+
+/* Most sectors one command transfers.  The sector count
+   register holds at most 256. */
+#define MULTI_MAX 128
+
+/* Each sector needs two regions at most, if it crosses a 64 kB
+   boundary. */
+#define PRD_CNT (2 * MULTI_MAX)
+
+/* A TRIM command's data is a sector of 8-byte ranges, each a
+   48-bit LBA and, in the top 16 bits, a count of at most
+   TRIM_RANGE_MAX sectors.  A count of 0 marks a range unused. */
+#define TRIM_RANGES (BLOCK_SECTOR_SIZE / sizeof (uint64_t))
+#define TRIM_RANGE_MAX 0xffff
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +150,10 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool use_dma;               /* Transfer data by DMA? */
+    uint8_t flush_command;      /* Command to flush the write cache,
+                                   or 0 if none is needed. */
+    bool use_trim;              /* Tell the disk of discards by TRIM? */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +169,14 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base I/O port, 0 if none. */
+
+    /* PRD table, aligned so that it cannot cross a 64 kB
+       boundary. */
+    struct prd prdt[PRD_CNT] __attribute__ ((aligned (8 * PRD_CNT)));
+
+    uint64_t trim_ranges[TRIM_RANGES];  /* Data for a TRIM command. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,14 +186,35 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+/* Channel probe threads register their disks in channel order,
+   channel I once it can down register_turn[I].  ide_init() waits
+   for register_turn[CHANNEL_CNT]. */
+static struct semaphore register_turn[CHANNEL_CNT + 1];
+
+static uint16_t find_bus_master (void);
+static thread_func probe_channel;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static uint8_t find_flush_command (const uint16_t id[]);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static void add_region (struct channel *, size_t *cnt, uint32_t addr,
+                        size_t size);
+static bool run_dma (struct ata_disk *, size_t prd_cnt, uint8_t command,
+                     bool write);
+static bool dma_transfer (struct ata_disk *, block_sector_t,
+                          const void *const buffers[], size_t cnt,
+                          bool write);
+static void ide_read_multi (void *, block_sector_t, void *const buffers[],
+                            size_t cnt);
+static void ide_flush (void *);
+static void ide_discard (void *, block_sector_t, block_sector_t cnt);
+static void ide_write_multi (void *, block_sector_t,
+                             const void *const buffers[], size_t cnt);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
@@ -97,10 +223,15 @@ static void select_device_wait (const struct ata_disk *);
 
 static void interrupt_handler (struct intr_frame *);
 
-/* Initialize the disk subsystem and detect disks. */
+/* Initialize the disk subsystem and detect disks.  Each channel
+   is reset and probed in a thread of its own, so that one
+   channel's reset delays overlap the other's, but the disks are
+   registered in the same order as if they were probed one after
+   another. */
 void
 ide_init (void) 
 {
+  uint16_t bm_base = ide_use_dma ? find_bus_master () : 0;
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -124,8 +255,10 @@ ide_init (void)
           NOT_REACHED ();
         }
       lock_init (&c->lock);
+      lock_set_name (&c->lock, c->name);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,31 +269,83 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->use_dma = false;
+          d->flush_command = 0;
+          d->use_trim = false;
         }
 
       /* Register interrupt handler. */
       intr_register_ext (c->irq, interrupt_handler, c->name);
+    }
 
-      /* Reset hardware. */
-      reset_channel (c);
+  for (chan_no = 0; chan_no <= CHANNEL_CNT; chan_no++)
+    sema_init (&register_turn[chan_no], chan_no == 0);
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    thread_create (channels[chan_no].name, PRI_DEFAULT, probe_channel,
+                   &channels[chan_no]);
+  sema_down (&register_turn[CHANNEL_CNT]);
+}
 
-      /* Distinguish ATA hard disks from other devices. */
-      if (check_device_type (&c->devices[0]))
-        check_device_type (&c->devices[1]);
+/* Probe thread for channel C_.  Resets the channel and finds its
+   ATA disks, and then, in its turn, identifies and registers
+   them. */
+static void
+probe_channel (void *c_)
+{
+  struct channel *c = c_;
+  size_t chan_no = c - channels;
+  int dev_no;
 
-      /* Read hard disk identity information. */
-      for (dev_no = 0; dev_no < 2; dev_no++)
-        if (c->devices[dev_no].is_ata)
-          identify_ata_device (&c->devices[dev_no]);
-    }
+  /* Reset hardware. */
+  reset_channel (c);
+
+  /* Distinguish ATA hard disks from other devices. */
+  if (check_device_type (&c->devices[0]))
+    check_device_type (&c->devices[1]);
+
+  /* Read hard disk identity information. */
+  sema_down (&register_turn[chan_no]);
+  for (dev_no = 0; dev_no < 2; dev_no++)
+    if (c->devices[dev_no].is_ata)
+      identify_ata_device (&c->devices[dev_no]);
+  sema_up (&register_turn[chan_no + 1]);
 }
 
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
 
+/* Looks for a PCI IDE controller that is a bus master and that
+   has both channels at their legacy ports, as we expect, and
+   enables it to master the bus.  Returns the base I/O port of
+   its bus master registers, or 0 if there is no such
+   controller. */
+static uint16_t
+find_bus_master (void)
+{
+  struct pci_address a;
+  uint8_t prog_if;
+  uint32_t bar;
+
+  if (!pci_find_class (PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &a))
+    return 0;
+  prog_if = pci_read_config (a, PCI_REG_CLASS) >> 8;
+  bar = pci_read_config (a, PCI_REG_BAR (4));
+  if (!(prog_if & PROG_IF_MASTER)
+      || (prog_if & (PROG_IF_NATIVE0 | PROG_IF_NATIVE1))
+      || !(bar & 1))
+    return 0;
+
+  pci_write_config16 (a, PCI_REG_COMMAND,
+                      (pci_read_config (a, PCI_REG_COMMAND)
+                       | PCI_CMD_IO | PCI_CMD_MASTER));
+  return bar & 0xfffc;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
-   to finish the reset. */
+   to finish the reset.  The devices get the 2 ms the ATA
+   standard asks for before their status is checked, after which
+   we only wait while they report they are busy. */
 static void
 reset_channel (struct channel *c) 
 {
@@ -196,7 +381,7 @@ reset_channel (struct channel *c)
   timer_usleep (10);
   outb (reg_ctl (c), 0);
 
-  timer_msleep (150);
+  timer_msleep (2);
 
   /* Wait for device 0 to clear BSY. */
   if (present[0]) 
@@ -284,10 +469,18 @@ identify_ata_device (struct ata_disk *d)
   /* Calculate capacity.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
+  d->use_dma = (c->bm_base != 0
+                && (*(uint16_t *) &id[ID_CAPABILITIES * 2] & ID_CAP_DMA));
+  d->flush_command = find_flush_command ((const uint16_t *) id);
+  d->use_trim = (d->use_dma
+                 && (*(uint16_t *) &id[ID_DSM * 2] & ID_DSM_TRIM));
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
-            "model \"%s\", serial \"%s\"", model, serial);
+            "model \"%s\", serial \"%s\"%s%s%s", model, serial,
+            d->use_dma ? ", DMA" : "",
+            d->flush_command != 0 ? ", write cache" : "",
+            d->use_trim ? ", TRIM" : "");
 
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
@@ -306,9 +499,31 @@ identify_ata_device (struct ata_disk *d)
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
+  block_start_queue (block);
   partition_scan (block);
 }
 
+/* Returns the command that flushes the write cache of the disk
+   whose IDENTIFY DEVICE response is ID, preferring FLUSH CACHE
+   EXT, or 0 if the disk reports no write cache enabled.  A disk
+   too old to report its command sets is assumed to need no
+   flush. */
+static uint8_t
+find_flush_command (const uint16_t id[])
+{
+  uint16_t commands = id[ID_COMMANDS];
+
+  if ((commands & ID_COM_VALID_MASK) != ID_COM_VALID
+      || !(id[ID_ENABLED] & ID_EN_WRITE_CACHE))
+    return 0;
+  else if (commands & ID_COM_FLUSH_EXT)
+    return CMD_FLUSH_CACHE_EXT;
+  else if (commands & ID_COM_FLUSH)
+    return CMD_FLUSH_CACHE;
+  else
+    return 0;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -344,16 +559,7 @@ descramble_ata_string (char *string, int size)
 static void
 ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  ide_read_multi (d_, sec_no, &buffer, 1);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -363,37 +569,195 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
    per-disk locking is unneeded. */
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multi (d_, sec_no, &buffer, 1);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFERS[0] through BUFFERS[CNT - 1], each of which must have
+   room for BLOCK_SECTOR_SIZE bytes, with one command for each
+   MULTI_MAX sectors.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multi (void *d_, block_sector_t sec_no, void *const buffers[],
+                size_t cnt)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MULTI_MAX ? cnt : MULTI_MAX;
+      size_t i;
+
+      if (!d->use_dma
+          || !dma_transfer (d, sec_no, (const void *const *) buffers, n,
+                            false))
+        {
+          select_sector (d, sec_no, n);
+          issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+          for (i = 0; i < n; i++)
+            {
+              sema_down (&c->completion_wait);
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                       d->name, sec_no + i);
+              input_sector (c, buffers[i]);
+            }
+        }
+      sec_no += n;
+      buffers += n;
+      cnt -= n;
+    }
+  lock_release (&c->lock);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFERS[0] through BUFFERS[CNT - 1], each of which must
+   contain BLOCK_SECTOR_SIZE bytes, with one command for each
+   MULTI_MAX sectors.  Returns after the disk has acknowledged
+   receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multi (void *d_, block_sector_t sec_no,
+                 const void *const buffers[], size_t cnt)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MULTI_MAX ? cnt : MULTI_MAX;
+      size_t i;
+
+      if (!d->use_dma || !dma_transfer (d, sec_no, buffers, n, true))
+        {
+          select_sector (d, sec_no, n);
+          issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+          for (i = 0; i < n; i++)
+            {
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                       d->name, sec_no + i);
+              output_sector (c, buffers[i]);
+              sema_down (&c->completion_wait);
+            }
+        }
+      sec_no += n;
+      buffers += n;
+      cnt -= n;
+    }
+  lock_release (&c->lock);
+}
+
+/* Flushes disk D's write cache, returning when the sectors
+   written so far are on the medium.  Does nothing if D has no
+   write cache enabled.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_flush (void *d_)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+
+  if (d->flush_command == 0)
+    return;
+
+  lock_acquire (&c->lock);
+  select_device_wait (d);
+  issue_pio_command (c, d->flush_command);
   sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if (inb (reg_alt_status (c)) & (STA_ERR | STA_DF))
+    PANIC ("%s: cache flush failed", d->name);
+  lock_release (&c->lock);
+}
+
+/* Tells disk D, if it supports TRIM, that the CNT sectors
+   starting at SEC_NO are discarded, with one command for each
+   TRIM_RANGES ranges of up to TRIM_RANGE_MAX sectors.  If a
+   command fails, stops using TRIM for D.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_discard (void *d_, block_sector_t sec_no, block_sector_t cnt)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+
+  lock_acquire (&c->lock);
+  while (cnt > 0 && d->use_trim && d->use_dma)
+    {
+      block_sector_t first = sec_no;
+      size_t prd_cnt = 0;
+      size_t i;
+      int j;
+
+      for (i = 0; i < TRIM_RANGES; i++)
+        {
+          block_sector_t n = cnt < TRIM_RANGE_MAX ? cnt : TRIM_RANGE_MAX;
+          c->trim_ranges[i] = (uint64_t) n << 48 | sec_no;
+          sec_no += n;
+          cnt -= n;
+        }
+      add_region (c, &prd_cnt, vtop (c->trim_ranges),
+                  sizeof c->trim_ranges);
+      c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+      /* A 48-bit command takes two bytes through each register,
+         the high one first. */
+      select_device_wait (d);
+      outb (reg_features (c), 0);
+      outb (reg_features (c), DSM_TRIM);
+      outb (reg_nsect (c), 0);
+      outb (reg_nsect (c), 1);
+      for (j = 0; j < 2; j++)
+        {
+          outb (reg_lbal (c), 0);
+          outb (reg_lbam (c), 0);
+          outb (reg_lbah (c), 0);
+        }
+      outb (reg_device (c),
+            DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0));
+      if (!run_dma (d, prd_cnt, CMD_DATA_SET_MANAGEMENT, true))
+        {
+          printf ("%s: TRIM failed, sector=%"PRDSNu"; not trimming\n",
+                  d->name, first);
+          d->use_trim = false;
+        }
+    }
   lock_release (&c->lock);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multi,
+    ide_write_multi,
+    NULL,
+    ide_flush,
+    ide_discard
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO to the disk's sector selection registers and CNT
+   to its sector count register.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MULTI_MAX);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -430,6 +794,104 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Adds the SIZE bytes at physical address ADDR to channel C's
+   PRD table, which has *CNT regions so far, extending the last
+   region if ADDR follows it and splitting at 64 kB boundaries. */
+static void
+add_region (struct channel *c, size_t *cnt, uint32_t addr, size_t size)
+{
+  while (size > 0)
+    {
+      size_t region = 0x10000 - (addr & 0xffff);
+      struct prd *p = *cnt > 0 ? &c->prdt[*cnt - 1] : NULL;
+
+      if (region > size)
+        region = size;
+      if (p != NULL && (addr & 0xffff) != 0 && p->addr + p->size == addr)
+        p->size += region;
+      else
+        {
+          ASSERT (*cnt < PRD_CNT);
+          p = &c->prdt[(*cnt)++];
+          p->addr = addr;
+          p->size = region;
+          p->flags = 0;
+        }
+      addr += region;
+      size -= region;
+    }
+}
+
+/* Runs COMMAND, a DMA command that the registers of disk D's
+   channel have been set up for, which transfers the PRD_CNT
+   regions of the channel's PRD table to the disk if WRITE is
+   true and from it otherwise, and waits for it to complete.  The
+   caller must hold D's channel's lock.  Returns true if
+   successful, false if the bus master or the disk reported an
+   error. */
+static bool
+run_dma (struct ata_disk *d, size_t prd_cnt, uint8_t command, bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t bm_status, status;
+
+  ASSERT (prd_cnt > 0 && (c->prdt[prd_cnt - 1].flags & PRD_EOT));
+
+  /* Program the bus master, then start the disk and it. */
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), write ? 0 : BMC_READ);
+  outb (reg_bm_status (c), inb (reg_bm_status (c)) | BMS_ERR | BMS_IRQ);
+  issue_pio_command (c, command);
+  outb (reg_bm_command (c), (write ? 0 : BMC_READ) | BMC_START);
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), 0);
+
+  bm_status = inb (reg_bm_status (c));
+  status = inb (reg_alt_status (c));
+  return !(bm_status & BMS_ERR) && !(status & (STA_ERR | STA_DF));
+}
+
+/* Transfers the CNT sectors starting at SEC_NO of disk D to or
+   from BUFFERS[0] through BUFFERS[CNT - 1] by DMA, writing to
+   the disk if WRITE is true and reading from it otherwise, and
+   waits for the transfer to complete.  CNT may be at most
+   MULTI_MAX.  The caller must hold D's channel's lock.  Returns
+   true if successful.  On failure, which includes a buffer that
+   the bus master cannot reach, stops using DMA for D if the disk
+   reported an error and returns false, so that the caller can
+   fall back to PIO. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no,
+              const void *const buffers[], size_t cnt, bool write)
+{
+  struct channel *c = d->channel;
+  size_t prd_cnt = 0;
+  size_t i;
+
+  ASSERT (cnt > 0 && cnt <= MULTI_MAX);
+
+  /* Describe the buffers, merging the ones that are adjacent in
+     memory. */
+  for (i = 0; i < cnt; i++)
+    {
+      uint32_t addr = vtop (buffers[i]);
+      if (addr & 1)
+        return false;
+      add_region (c, &prd_cnt, addr, BLOCK_SECTOR_SIZE);
+    }
+  c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+  select_sector (d, sec_no, cnt);
+  if (!run_dma (d, prd_cnt, write ? CMD_WRITE_DMA : CMD_READ_DMA, write))
+    {
+      printf ("%s: DMA %s failed, sector=%"PRDSNu"; using PIO\n",
+              d->name, write ? "write" : "read", sec_no);
+      d->use_dma = false;
+      return false;
+    }
+  return true;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -514,6 +976,10 @@ interrupt_handler (struct intr_frame *f)
         if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
+            if (c->bm_base != 0)                /* Clear bus master's copy. */
+              outb (reg_bm_status (c),
+                    ((inb (reg_bm_status (c)) & (BMS_DMA0 | BMS_DMA1))
+                     | BMS_IRQ));
             sema_up (&c->completion_wait);      /* Wake up waiter. */
           }
         else
@@ -1,6 +1,12 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+#include <stdbool.h>
+
 void ide_init (void);
 
+/* Use DMA when available?  Cleared by kernel command-line option
+   "-pio". */
+extern bool ide_use_dma;
+
 #endif /* devices/ide.h */
@@ -1,16 +1,56 @@
 #include "devices/input.h"
 #include <debug.h>
-#include "devices/intq.h"
+#include <spsc.h>
 #include "devices/serial.h"
+#include "threads/interrupt.h"
+#include "threads/poll.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
-/* Stores keys from the keyboard and serial port. */
-static struct intq buffer;
+/* Bytes of input that may arrive before a reader takes them.
+   Input that arrives with the buffer full is dropped, so this is
+   large enough to hold a pasted screenful. */
+#define INPUT_BUFSIZE 4096
+
+/* Stores keys from the keyboard and serial port.  The interrupt
+   handlers that add keys, which cannot interrupt one another,
+   are its producer, and the thread holding READ_LOCK is its
+   consumer, so neither side turns interrupts off to use it.
+   INPUT_BUFSIZE must be a power of 2. */
+static struct spsc buffer;
+static uint8_t keys[INPUT_BUFSIZE];
+
+/* Line discipline.  There are LINES_IN - LINES_OUT new-lines in
+   BUFFER, which is what a canonical reader waits for: the
+   producer counts those it adds in LINES_IN, and the consumer
+   those it takes in LINES_OUT, so that each side writes only its
+   own.  MODE is changed with interrupts off. */
+static enum input_mode mode;
+static size_t lines_in, lines_out;
+
+/* Thread waiting in input_read() or input_getc(), if any, woken
+   whenever a key arrives or the mode changes.  Only this wakeup
+   needs interrupts off.  READ_LOCK lets only one thread read at
+   a time. */
+static struct thread *reader;
+static struct lock read_lock;
+
+/* Woken when the buffer becomes readable, for poll(). */
+static struct poll_queue poll_queue;
+
+static bool readable (void);
+static bool nonempty (void);
+static void wait_for (bool (*ready) (void));
+static void drained (void);
 
 /* Initializes the input buffer. */
 void
 input_init (void) 
 {
-  intq_init (&buffer);
+  spsc_init (&buffer, keys, sizeof keys);
+  lock_init (&read_lock);
+  poll_queue_init (&poll_queue);
+  mode = INPUT_CANONICAL;
 }
 
 /* Adds a key to the input buffer.
@@ -19,9 +59,20 @@ void
 input_putc (uint8_t key) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  ASSERT (!intq_full (&buffer));
+  ASSERT (!spsc_full (&buffer));
 
-  intq_putc (&buffer, key);
+  if (mode == INPUT_CANONICAL && key == '\r')
+    key = '\n';
+  spsc_push (&buffer, &key, 1);
+  if (key == '\n')
+    lines_in++;
+  if (reader != NULL)
+    {
+      thread_unblock (reader);
+      reader = NULL;
+    }
+  if (readable ())
+    poll_wake (&poll_queue);
   serial_notify ();
 }
 
@@ -30,23 +81,143 @@ input_putc (uint8_t key)
 uint8_t
 input_getc (void) 
 {
-  enum intr_level old_level;
   uint8_t key;
 
-  old_level = intr_disable ();
-  key = intq_getc (&buffer);
-  serial_notify ();
-  intr_set_level (old_level);
-  
+  lock_acquire (&read_lock);
+  wait_for (nonempty);
+  spsc_pop (&buffer, &key, 1);
+  if (key == '\n')
+    lines_out++;
+  drained ();
+  lock_release (&read_lock);
+
   return key;
 }
 
+/* Reads up to SIZE bytes of input into BUFFER and returns the
+   number read.  In canonical mode, waits for a complete line,
+   or for the input buffer to fill, and reads no further than the
+   end of the line; in raw mode, waits for any input and reads
+   all of it that fits.  Either way, copies with interrupts on,
+   while more input may arrive. */
+size_t
+input_read (void *buffer_, size_t size)
+{
+  uint8_t *buffer_bytes = buffer_;
+  size_t cnt = 0;
+  size_t i;
+
+  if (size == 0)
+    return 0;
+
+  lock_acquire (&read_lock);
+  wait_for (readable);
+  if (mode == INPUT_CANONICAL)
+    {
+      while (cnt < size && spsc_pop (&buffer, &buffer_bytes[cnt], 1) > 0)
+        if (buffer_bytes[cnt++] == '\n')
+          break;
+    }
+  else
+    cnt = spsc_pop (&buffer, buffer_bytes, size);
+  for (i = 0; i < cnt; i++)
+    if (buffer_bytes[i] == '\n')
+      lines_out++;
+  drained ();
+  lock_release (&read_lock);
+
+  return cnt;
+}
+
+/* Sets the input mode to NEW_MODE and returns the old mode.
+   Input already received keeps the translation of the mode it
+   arrived in. */
+enum input_mode
+input_set_mode (enum input_mode new_mode)
+{
+  enum intr_level old_level = intr_disable ();
+  enum input_mode old_mode = mode;
+
+  mode = new_mode;
+  if (readable ())
+    {
+      if (reader != NULL)
+        {
+          thread_unblock (reader);
+          reader = NULL;
+        }
+      poll_wake (&poll_queue);
+    }
+  intr_set_level (old_level);
+
+  return old_mode;
+}
+
+/* Returns true if input_read() would find something to read
+   without waiting.  If W is not null, first adds E on behalf of W
+   to the queue that is woken when input becomes readable. */
+bool
+input_poll (struct poll_waiter *w, struct poll_entry *e)
+{
+  enum intr_level old_level = intr_disable ();
+  bool ready;
+
+  if (w != NULL)
+    poll_add (w, e, &poll_queue);
+  ready = readable ();
+  intr_set_level (old_level);
+
+  return ready;
+}
+
 /* Returns true if the input buffer is full,
-   false otherwise.
-   Interrupts must be off. */
+   false otherwise. */
 bool
 input_full (void) 
 {
-  ASSERT (intr_get_level () == INTR_OFF);
-  return intq_full (&buffer);
+  return spsc_full (&buffer);
+}
+
+/* Returns true if input_read() in the current mode would find
+   something to read. */
+static bool
+readable (void)
+{
+  if (mode == INPUT_CANONICAL)
+    return lines_in != lines_out || spsc_full (&buffer);
+  else
+    return !spsc_empty (&buffer);
+}
+
+/* Returns true if the input buffer holds any key. */
+static bool
+nonempty (void)
+{
+  return !spsc_empty (&buffer);
+}
+
+/* Waits until READY returns true, checking it with interrupts
+   off so that a key that arrives meanwhile cannot be missed.
+   The caller must hold READ_LOCK. */
+static void
+wait_for (bool (*ready) (void))
+{
+  enum intr_level old_level = intr_disable ();
+
+  while (!ready ())
+    {
+      reader = thread_current ();
+      thread_block ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Lets the serial port receive again, now that the input buffer
+   has room, after the consumer takes keys from it. */
+static void
+drained (void)
+{
+  enum intr_level old_level = intr_disable ();
+  serial_notify ();
+  intr_set_level (old_level);
 }
@@ -2,11 +2,24 @@
 #define DEVICES_INPUT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* How input_read() delivers input. */
+enum input_mode
+  {
+    INPUT_CANONICAL,            /* A line at a time, CR read as NL. */
+    INPUT_RAW                   /* Whatever has arrived, as is. */
+  };
+
 void input_init (void);
 void input_putc (uint8_t);
 uint8_t input_getc (void);
+size_t input_read (void *, size_t);
+enum input_mode input_set_mode (enum input_mode);
+struct poll_waiter;
+struct poll_entry;
+bool input_poll (struct poll_waiter *, struct poll_entry *);
 bool input_full (void);
 
 #endif /* devices/input.h */
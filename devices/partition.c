@@ -4,6 +4,7 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/block.h"
+#include "threads/init.h"
 #include "threads/malloc.h"
 
 /* A partition of a block device. */
@@ -27,10 +28,13 @@ static const char *partition_type_name (uint8_t);
 void
 partition_scan (struct block *block)
 {
+  enum boot_phase old_phase = boot_phase (BOOT_PARTITIONS);
   int part_nr = 0;
+
   read_partition_table (block, 0, 0, &part_nr);
   if (part_nr == 0)
     printf ("%s: Device contains no partitions\n", block_name (block));
+  boot_phase (old_phase);
 }
 
 /* Reads the partition table in the given SECTOR of BLOCK and
@@ -317,8 +321,46 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Reads the CNT sectors starting at SECTOR from partition P
+   into BUFFERS[0] through BUFFERS[CNT - 1], each of which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+static void
+partition_read_multi (void *p_, block_sector_t sector,
+                      void *const buffers[], size_t cnt)
+{
+  struct partition *p = p_;
+  block_read_multi (p->block, p->start + sector, buffers, cnt);
+}
+
+/* Writes the CNT sectors starting at SECTOR to partition P from
+   BUFFERS[0] through BUFFERS[CNT - 1], each of which must
+   contain BLOCK_SECTOR_SIZE bytes.  Returns after the block has
+   acknowledged receiving the data. */
+static void
+partition_write_multi (void *p_, block_sector_t sector,
+                       const void *const buffers[], size_t cnt)
+{
+  struct partition *p = p_;
+  block_write_multi (p->block, p->start + sector, buffers, cnt);
+}
+
+/* Passes BIO, a request for partition P, on to the block device
+   that P is on. */
+static void
+partition_submit (void *p_, struct bio *bio)
+{
+  struct partition *p = p_;
+  bio->sector += p->start;
+  block_forward (p->block, bio);
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    partition_read_multi,
+    partition_write_multi,
+    partition_submit,
+    NULL,
+    NULL
   };
@@ -0,0 +1,163 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/* This code enumerates PCI functions and accesses their
+   configuration space through configuration mechanism #1, the
+   pair of I/O ports that every PC chipset since the early PCI
+   days provides, as described by the PCI Local Bus
+   Specification. */
+
+/* Configuration mechanism #1 I/O ports. */
+#define CONFIG_ADDRESS 0xcf8    /* Selects a register. */
+#define CONFIG_DATA 0xcfc       /* Data of the selected register. */
+
+/* CONFIG_ADDRESS bits. */
+#define ADDR_ENABLE 0x80000000  /* Enables access to CONFIG_DATA. */
+
+/* Header Type bits. */
+#define HEADER_MULTI 0x80       /* Device has functions besides 0. */
+
+/* Selects register REG of function A in CONFIG_ADDRESS. */
+static void
+select_register (struct pci_address a, uint8_t reg)
+{
+  outl (CONFIG_ADDRESS, (ADDR_ENABLE | (a.bus << 16) | (a.dev << 11)
+                         | (a.func << 8) | (reg & 0xfc)));
+}
+
+/* Returns the 32-bit configuration register at offset REG, which
+   must be a multiple of 4, in function A. */
+uint32_t
+pci_read_config (struct pci_address a, uint8_t reg)
+{
+  select_register (a, reg);
+  return inl (CONFIG_DATA);
+}
+
+/* Writes VALUE to the 16-bit configuration register at offset
+   REG, which must be even, in function A.  Writing only part of
+   a 32-bit register leaves the rest alone, which matters for the
+   status bits that are cleared by writing 1s to them. */
+void
+pci_write_config16 (struct pci_address a, uint8_t reg, uint16_t value)
+{
+  select_register (a, reg);
+  outw (CONFIG_DATA + (reg & 2), value);
+}
+
+/* Calls MATCH (A, AUX) for each function A, on every bus, until
+   it returns true.  Returns true if it did, false if every
+   function was tried. */
+static bool
+find_function (bool (*match) (struct pci_address, void *aux), void *aux)
+{
+  int bus, dev, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (dev = 0; dev < 32; dev++)
+      for (func = 0; func < 8; func++)
+        {
+          struct pci_address try = {bus, dev, func};
+
+          if ((pci_read_config (try, PCI_REG_ID) & 0xffff) == 0xffff)
+            {
+              /* No such function.  Without function 0 there is
+                 no device at all. */
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          if (match (try, aux))
+            return true;
+
+          /* Only a multi-function device has functions past 0. */
+          if (func == 0
+              && !((pci_read_config (try, PCI_REG_HEADER) >> 16)
+                   & HEADER_MULTI))
+            break;
+        }
+  return false;
+}
+
+/* What pci_find_class() and pci_find_id() look for. */
+struct search
+  {
+    uint32_t key;               /* Class and subclass, or IDs. */
+    struct pci_address *found;  /* Functions found. */
+    size_t cnt, max;            /* Number found, room in FOUND. */
+  };
+
+/* Adds A to search AUX if its class and subclass match.  Stops
+   the search at the first match. */
+static bool
+match_class (struct pci_address a, void *aux)
+{
+  struct search *s = aux;
+
+  if (pci_read_config (a, PCI_REG_CLASS) >> 16 != s->key)
+    return false;
+  s->found[s->cnt++] = a;
+  return true;
+}
+
+/* Adds A to search AUX if its vendor and device IDs match.
+   Stops the search when there is no more room. */
+static bool
+match_id (struct pci_address a, void *aux)
+{
+  struct search *s = aux;
+
+  if (pci_read_config (a, PCI_REG_ID) != s->key)
+    return false;
+  s->found[s->cnt++] = a;
+  return s->cnt >= s->max;
+}
+
+/* Searches every bus for a function with the given CLASS and
+   SUBCLASS.  If one is found, stores its location in *A and
+   returns true; otherwise, returns false. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_address *a)
+{
+  struct search s = {(class << 8) | subclass, a, 0, 1};
+
+  return find_function (match_class, &s);
+}
+
+/* Searches every bus for functions with the given VENDOR and
+   DEVICE IDs, storing the locations of up to MAX of them in A[],
+   in bus order.  Returns the number found. */
+size_t
+pci_find_id (uint16_t vendor, uint16_t device, struct pci_address a[],
+             size_t max)
+{
+  struct search s = {((uint32_t) device << 16) | vendor, a, 0, max};
+
+  if (max > 0)
+    find_function (match_id, &s);
+  return s.cnt;
+}
+
+/* Turns off bus mastering in function A.  Never stops the
+   search. */
+static bool
+stop_master (struct pci_address a, void *aux UNUSED)
+{
+  uint16_t command = pci_read_config (a, PCI_REG_COMMAND);
+
+  if (command & PCI_CMD_MASTER)
+    pci_write_config16 (a, PCI_REG_COMMAND, command & ~PCI_CMD_MASTER);
+  return false;
+}
+
+/* Stops every function on every bus from starting DMA, so that
+   none writes into memory that a new kernel is about to be
+   copied over.  A driver turns bus mastering back on when it
+   sets up its device. */
+void
+pci_stop_masters (void)
+{
+  find_function (stop_master, NULL);
+}
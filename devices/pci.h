@@ -0,0 +1,42 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Location of a PCI function. */
+struct pci_address
+  {
+    uint8_t bus;                /* Bus number, 0...255. */
+    uint8_t dev;                /* Device number, 0...31. */
+    uint8_t func;               /* Function number, 0...7. */
+  };
+
+/* Offsets of configuration space registers common to all
+   functions. */
+#define PCI_REG_ID 0x00         /* Vendor ID 15:0, Device ID 31:16. */
+#define PCI_REG_COMMAND 0x04    /* Command 15:0, Status 31:16. */
+#define PCI_REG_CLASS 0x08      /* Revision 7:0, Prog IF 15:8,
+                                   Subclass 23:16, Class 31:24. */
+#define PCI_REG_HEADER 0x0c     /* Header Type 23:16. */
+#define PCI_REG_BAR(N) (0x10 + 4 * (N)) /* Base Address Register N. */
+#define PCI_REG_INTERRUPT 0x3c  /* Interrupt Line 7:0, Pin 15:8. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_MASTER 0x0004   /* May act as a bus master. */
+#define PCI_CMD_INTX_DISABLE 0x0400 /* Do not assert INTx#. */
+
+/* Classes and subclasses. */
+#define PCI_CLASS_STORAGE 0x01  /* Mass storage controller. */
+#define PCI_SUBCLASS_IDE 0x01   /* IDE controller. */
+
+uint32_t pci_read_config (struct pci_address, uint8_t reg);
+void pci_write_config16 (struct pci_address, uint8_t reg, uint16_t);
+bool pci_find_class (uint8_t class, uint8_t subclass, struct pci_address *);
+size_t pci_find_id (uint16_t vendor, uint16_t device, struct pci_address[],
+                    size_t max);
+void pci_stop_masters (void);
+
+#endif /* devices/pci.h */
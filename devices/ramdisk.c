@@ -0,0 +1,147 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A RAM disk is a block device whose sectors are kept in kernel
+   pages.  A page is only allocated when one of its sectors is
+   first written with something other than zeros; until then its
+   sectors read as zeros.  Discarding all of a page's sectors
+   frees it again.  Its contents are lost at shutdown, so
+   it suits scratch and swap, and a file system that is formatted
+   at each boot. */
+
+/* Sectors per page. */
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    struct lock lock;           /* Protects PAGES and the pages. */
+    uint8_t **pages;            /* Each page, or null if all zeros. */
+    size_t page_cnt;            /* Number of elements in PAGES. */
+    size_t used_cnt;            /* Number of pages allocated. */
+  };
+
+static struct block_operations ramdisk_operations;
+
+/* Creates and registers a RAM disk named NAME with SIZE sectors,
+   rounded up to a whole page.  Returns the new block device.
+   Allocates almost none of its memory yet. */
+struct block *
+ramdisk_create (const char *name, block_sector_t size)
+{
+  struct ramdisk *r = malloc (sizeof *r);
+  if (r == NULL)
+    PANIC ("Failed to allocate memory for RAM disk descriptor");
+
+  lock_init (&r->lock);
+  r->page_cnt = DIV_ROUND_UP (size, PAGE_SECTORS);
+  r->used_cnt = 0;
+  r->pages = calloc (r->page_cnt, sizeof *r->pages);
+  if (r->pages == NULL)
+    PANIC ("%s: not enough memory for RAM disk page map", name);
+
+  return block_register (name, BLOCK_RAW, "RAM disk",
+                         r->page_cnt * PAGE_SECTORS, &ramdisk_operations,
+                         r);
+}
+
+/* Returns true if the BLOCK_SECTOR_SIZE bytes in SECTOR are all
+   zeros. */
+static bool
+is_zero (const void *sector)
+{
+  const uint32_t *p = sector;
+  size_t i;
+
+  for (i = 0; i < BLOCK_SECTOR_SIZE / sizeof *p; i++)
+    if (p[i] != 0)
+      return false;
+  return true;
+}
+
+/* Reads sector SECTOR from RAM disk R into BUFFER, which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+static void
+ramdisk_read (void *r_, block_sector_t sector, void *buffer)
+{
+  struct ramdisk *r = r_;
+  uint8_t *page;
+
+  lock_acquire (&r->lock);
+  page = r->pages[sector / PAGE_SECTORS];
+  if (page != NULL)
+    memcpy (buffer, page + sector % PAGE_SECTORS * BLOCK_SECTOR_SIZE,
+            BLOCK_SECTOR_SIZE);
+  else
+    memset (buffer, 0, BLOCK_SECTOR_SIZE);
+  lock_release (&r->lock);
+}
+
+/* Writes sector SECTOR to RAM disk R from BUFFER, which must
+   contain BLOCK_SECTOR_SIZE bytes.  Panics if a page is needed
+   and none is left. */
+static void
+ramdisk_write (void *r_, block_sector_t sector, const void *buffer)
+{
+  struct ramdisk *r = r_;
+  uint8_t **pagep = &r->pages[sector / PAGE_SECTORS];
+
+  lock_acquire (&r->lock);
+  if (*pagep == NULL)
+    {
+      if (is_zero (buffer))
+        {
+          lock_release (&r->lock);
+          return;
+        }
+      *pagep = palloc_get_page_tagged (PAL_ZERO, MEM_RAMDISK);
+      if (*pagep == NULL)
+        PANIC ("RAM disk out of memory (%zu pages in use)", r->used_cnt);
+      r->used_cnt++;
+    }
+  memcpy (*pagep + sector % PAGE_SECTORS * BLOCK_SECTOR_SIZE, buffer,
+          BLOCK_SECTOR_SIZE);
+  lock_release (&r->lock);
+}
+
+/* Discards the CNT sectors starting at SECTOR of RAM disk R,
+   freeing the pages that they cover entirely, whose sectors then
+   read as zeros.  The sectors of a page they cover only in part
+   keep their contents. */
+static void
+ramdisk_discard (void *r_, block_sector_t sector, block_sector_t cnt)
+{
+  struct ramdisk *r = r_;
+  size_t page = DIV_ROUND_UP (sector, PAGE_SECTORS);
+  size_t end = (sector + cnt) / PAGE_SECTORS;
+
+  lock_acquire (&r->lock);
+  for (; page < end; page++)
+    if (r->pages[page] != NULL)
+      {
+        palloc_free_page (r->pages[page]);
+        r->pages[page] = NULL;
+        r->used_cnt--;
+      }
+  lock_release (&r->lock);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    ramdisk_discard
+  };
@@ -1,12 +1,14 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <spsc.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* Register definitions for the 16550A UART used in PCs.
    The 16550A has a lot more going on than shown here, but this
@@ -37,6 +39,17 @@
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
 
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* Both set if FIFOs are enabled. */
+
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR_RECV 0x02     /* Clear receive FIFO. */
+#define FCR_CLEAR_XMIT 0x04     /* Clear transmit FIFO. */
+
+/* Bytes the 16550A's transmit FIFO holds. */
+#define XMIT_FIFO_SIZE 16
+
 /* Line Control Register bits. */
 #define LCR_N81 0x03            /* No parity, 8 data bits, 1 stop bit. */
 #define LCR_DLAB 0x80           /* Divisor Latch Access Bit (DLAB). */
@@ -51,11 +64,42 @@
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Size of the transmit queue, in bytes.  Large enough that a
+   burst of output seldom fills it, since with interrupts off a
+   full queue can only be emptied by polling, and that a whole
+   console write() of a few pages goes in with one copy instead
+   of waiting on the transmitter for each queueful.  A multiple
+   of PGSIZE and a power of 2. */
+#define TXQ_SIZE 16384
+
+/* Data to be transmitted.  Polling mode never queues anything,
+   so until serial_init_queue() gives TXQ pages of its own it
+   only has a token buffer, which keeps the large one out of the
+   kernel image.
+
+   The transmitter, fed from the interrupt handler or by polling,
+   is TXQ's consumer, and needs no lock to take bytes from it.
+   Its producers are serial_write()'s callers, a thread holding
+   the console lock or an interrupt handler that prints, so a
+   push still turns interrupts off, to keep a handler's output
+   from landing in the middle of a thread's. */
+static struct spsc txq;
+static uint8_t txq_poll_buf[2];
+
+/* Thread waiting in serial_write() for room in TXQ, if any. */
+static struct thread *writer;
+
+/* Bytes to write to the transmitter each time it is empty: the
+   size of its FIFO, once enabled, or 1. */
+static size_t xmit_burst = 1;
+
+/* Last value written to IER_REG. */
+static uint8_t ier;
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
+static void xmit_poll (void);
+static void fill_xmit (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -68,16 +112,19 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
+  ier = 0;
   outb (FCR_REG, 0);                    /* Disable FIFO. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
+  spsc_init (&txq, txq_poll_buf, sizeof txq_poll_buf);
   mode = POLL;
 } 
 
 /* Initializes the serial port device for queued interrupt-driven
    I/O.  With interrupt-driven I/O we don't waste CPU time
-   waiting for the serial device to become ready. */
+   waiting for the serial device to become ready.  Enables the
+   FIFOs if the UART has them, so that each transmit interrupt
+   can send up to XMIT_FIFO_SIZE bytes. */
 void
 serial_init_queue (void) 
 {
@@ -87,6 +134,19 @@ serial_init_queue (void)
     init_poll ();
   ASSERT (mode == POLL);
 
+  spsc_init (&txq, palloc_get_multiple (PAL_ASSERT, TXQ_SIZE / PGSIZE),
+             TXQ_SIZE);
+
+  old_level = intr_disable ();
+  while ((inb (LSR_REG) & LSR_THRE) == 0)
+    continue;
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR_RECV | FCR_CLEAR_XMIT);
+  if ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO)
+    xmit_burst = XMIT_FIFO_SIZE;
+  else
+    outb (FCR_REG, 0);
+  intr_set_level (old_level);
+
   intr_register_ext (0x20 + 4, serial_interrupt, "serial");
   mode = QUEUE;
   old_level = intr_disable ();
@@ -98,31 +158,56 @@ serial_init_queue (void)
 void
 serial_putc (uint8_t byte) 
 {
+  serial_write (&byte, 1);
+}
+
+/* Sends the N bytes in BUFFER to the serial port, queuing as many
+   at a time as fit. */
+void
+serial_write (const void *buffer, size_t n)
+{
+  const uint8_t *p = buffer;
   enum intr_level old_level = intr_disable ();
 
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
-         use dumb polling to transmit a byte. */
+         use dumb polling to transmit. */
       if (mode == UNINIT)
         init_poll ();
-      putc_poll (byte); 
+      while (n-- > 0)
+        putc_poll (*p++);
     }
   else 
     {
-      /* Otherwise, queue a byte and update the interrupt enable
-         register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      /* Otherwise, queue the bytes and update the interrupt
+         enable register. */
+      for (;;)
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          size_t added = spsc_push (&txq, p, n);
+          p += added;
+          n -= added;
+          if (n == 0)
+            break;
+
+          if (old_level == INTR_OFF)
+            {
+              /* Interrupts are off and the transmit queue is full.
+                 If we wanted to wait for the queue to empty,
+                 we'd have to reenable interrupts.
+                 That's impolite, so we'll send what the
+                 transmitter takes via polling instead. */
+              xmit_poll ();
+            }
+          else
+            {
+              /* Wait for the interrupt handler to make room. */
+              ASSERT (writer == NULL);
+              write_ier ();
+              writer = thread_current ();
+              thread_block ();
+            }
         }
-
-      intq_putc (&txq, byte); 
       write_ier ();
     }
   
@@ -135,8 +220,8 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  while (!spsc_empty (&txq))
+    xmit_poll ();
   intr_set_level (old_level);
 }
 
@@ -176,21 +261,27 @@ set_serial (int bps)
 static void
 write_ier (void) 
 {
-  uint8_t ier = 0;
+  uint8_t new_ier = 0;
 
   ASSERT (intr_get_level () == INTR_OFF);
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
-    ier |= IER_XMIT;
+  if (!spsc_empty (&txq))
+    new_ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
      characters we receive. */
   if (!input_full ())
-    ier |= IER_RECV;
-  
-  outb (IER_REG, ier);
+    new_ier |= IER_RECV;
+
+  /* Each write costs an I/O access, so skip it if nothing
+     changed. */
+  if (new_ier != ier)
+    {
+      ier = new_ier;
+      outb (IER_REG, ier);
+    }
 }
 
 /* Polls the serial port until it's ready,
@@ -205,6 +296,37 @@ putc_poll (uint8_t byte)
   outb (THR_REG, byte);
 }
 
+/* Polls the serial port until its transmitter is empty, and
+   then fills it from the transmit queue. */
+static void
+xmit_poll (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while ((inb (LSR_REG) & LSR_THRE) == 0)
+    continue;
+  fill_xmit ();
+}
+
+/* Writes up to XMIT_BURST bytes from the transmit queue to the
+   transmitter, which must be empty, and wakes up the writer
+   waiting for room, if any. */
+static void
+fill_xmit (void)
+{
+  uint8_t bytes[XMIT_FIFO_SIZE];
+  size_t cnt = spsc_pop (&txq, bytes, xmit_burst);
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    outb (THR_REG, bytes[i]);
+  if (cnt > 0 && writer != NULL)
+    {
+      thread_unblock (writer);
+      writer = NULL;
+    }
+}
+
 /* Serial interrupt handler. */
 static void
 serial_interrupt (struct intr_frame *f UNUSED) 
@@ -218,10 +340,10 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* If we have bytes to transmit and the transmitter is empty,
+     fill it. */
+  if (!spsc_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
+    fill_xmit ();
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
@@ -4,14 +4,36 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "devices/virtio-balloon.h"
+#include "devices/virtio-console.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/kexec.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/syscall.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "devices/virtio-blk.h"
+#include "filesys/cache.h"
+#include "filesys/checksum.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
+#endif
+#ifdef VM
+#include "vm/share.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+#include "vm/zswap.h"
+#include "vm/ksm.h"
 #endif
 
 /* Keyboard control register port. */
@@ -20,6 +42,9 @@
 /* How to shut down when shutdown() is called. */
 static enum shutdown_type how = SHUTDOWN_NONE;
 
+/* Kernel image to restart into for SHUTDOWN_KEXEC. */
+static const char *kexec_file;
+
 static void print_stats (void);
 
 /* Shuts down the machine in the way configured by
@@ -38,6 +63,12 @@ shutdown (void)
       shutdown_reboot ();
       break;
 
+    case SHUTDOWN_KEXEC:
+      /* Falls back to a real reboot if FILE can't be run. */
+      kexec_restart (kexec_file);
+      shutdown_reboot ();
+      break;
+
     default:
       /* Nothing to do. */
       break;
@@ -52,6 +83,15 @@ shutdown_configure (enum shutdown_type type)
   how = type;
 }
 
+/* Makes the machine restart into the kernel image in FILE_NAME,
+   by kexec_restart(), when Pintos execution is complete. */
+void
+shutdown_configure_kexec (const char *file_name)
+{
+  how = SHUTDOWN_KEXEC;
+  kexec_file = file_name;
+}
+
 /* Reboots the machine via the keyboard controller. */
 void
 shutdown_reboot (void)
@@ -98,6 +138,7 @@ shutdown_power_off (void)
 
   printf ("Powering off...\n");
   serial_flush ();
+  virtio_console_flush ();
 
   /* ACPI power-off */
   outw (0xB004, 0x2000);
@@ -130,12 +171,35 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  intr_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  virtio_blk_print_stats ();
+  cache_print_stats ();
+  journal_print_stats ();
+  checksum_print_stats ();
 #endif
   console_print_stats ();
+  virtio_console_print_stats ();
   kbd_print_stats ();
+  trace_print_stats ();
+  profile_print_stats ();
+  lock_print_stats ();
+  palloc_print_stats ();
+  malloc_print_stats ();
+  malloc_print_heap_profile ();
+  kmem_print_stats ();
+  virtio_balloon_print_stats ();
+  memtag_print_leaks ();
 #ifdef USERPROG
   exception_print_stats ();
+  syscall_print_stats ();
+#endif
+#ifdef VM
+  frame_print_stats ();
+  swap_print_stats ();
+  zswap_print_stats ();
+  share_print_stats ();
+  ksm_print_stats ();
 #endif
 }
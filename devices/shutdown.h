@@ -9,10 +9,12 @@ enum shutdown_type
     SHUTDOWN_NONE,              /* Loop forever. */
     SHUTDOWN_POWER_OFF,         /* Power off the machine (if possible). */
     SHUTDOWN_REBOOT,            /* Reboot the machine (if possible). */
+    SHUTDOWN_KEXEC,             /* Restart into another kernel image. */
   };
 
 void shutdown (void);
 void shutdown_configure (enum shutdown_type);
+void shutdown_configure_kexec (const char *file_name);
 void shutdown_reboot (void) NO_RETURN;
 void shutdown_power_off (void) NO_RETURN;
 
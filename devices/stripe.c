@@ -0,0 +1,224 @@
+#include "devices/stripe.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* A stripe set is a virtual block device whose sectors are dealt
+   out in chunks of STRIPE_CHUNK sectors to the devices it spans,
+   in turn, as in RAID level 0.  A request that covers several
+   chunks is split into one request per chunk, and all of them
+   are submitted before waiting for any, so that devices on
+   different IDE channels, or with queues of their own, transfer
+   their parts at the same time.
+
+   There is no redundancy: losing any member loses the whole
+   set.  The members must not be used for anything else. */
+
+/* Sectors per chunk. */
+#define STRIPE_CHUNK 16
+
+/* Most requests to members in flight at once for one request to
+   a stripe set. */
+#define STRIPE_BIOS 8
+
+/* A stripe set. */
+struct stripe
+  {
+    struct block *members[STRIPE_MAX];  /* Devices, in chunk order. */
+    size_t cnt;                         /* Number of members. */
+  };
+
+static struct block_operations stripe_operations;
+
+/* Creates and registers a stripe set named NAME that spans the
+   CNT devices in MEMBERS, which must be between 2 and STRIPE_MAX.
+   Uses as many sectors of each member as the smallest one has,
+   in whole chunks.  Returns the new block device. */
+struct block *
+stripe_create (const char *name, struct block *members[], size_t cnt)
+{
+  struct stripe *s;
+  block_sector_t chunks = (block_sector_t) -1;
+  char extra_info[128];
+  size_t i, ofs;
+
+  if (cnt < 2 || cnt > STRIPE_MAX)
+    PANIC ("%s: stripe set needs 2 to %d devices", name, STRIPE_MAX);
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    PANIC ("Failed to allocate memory for stripe set descriptor");
+  s->cnt = cnt;
+
+  ofs = snprintf (extra_info, sizeof extra_info, "stripe of");
+  for (i = 0; i < cnt; i++)
+    {
+      block_sector_t member_chunks = block_size (members[i]) / STRIPE_CHUNK;
+      if (member_chunks < chunks)
+        chunks = member_chunks;
+      s->members[i] = members[i];
+      if (ofs < sizeof extra_info)
+        ofs += snprintf (extra_info + ofs, sizeof extra_info - ofs, " %s",
+                         block_name (members[i]));
+    }
+
+  return block_register (name, BLOCK_RAW, extra_info,
+                         chunks * cnt * STRIPE_CHUNK, &stripe_operations, s);
+}
+
+/* Returns the member of S that holds SECTOR of S, and stores the
+   corresponding sector of that member in *MEMBER_SECTOR. */
+static struct block *
+locate_sector (const struct stripe *s, block_sector_t sector,
+               block_sector_t *member_sector)
+{
+  block_sector_t chunk = sector / STRIPE_CHUNK;
+
+  *member_sector = chunk / s->cnt * STRIPE_CHUNK + sector % STRIPE_CHUNK;
+  return s->members[chunk % s->cnt];
+}
+
+/* Completion function for requests to members. */
+static void
+member_done (struct bio *bio)
+{
+  sema_up (bio->aux);
+}
+
+/* Transfers the CNT sectors starting at SECTOR of stripe set S
+   between its members and BUFFERS[0] through BUFFERS[CNT - 1],
+   writing them if WRITE is true and reading them otherwise, a
+   chunk per request, with up to STRIPE_BIOS requests in flight
+   at a time.  For a write, BUFFERS is only read. */
+static void
+transfer (struct stripe *s, block_sector_t sector, void *const buffers[],
+          size_t cnt, bool write)
+{
+  struct bio bios[STRIPE_BIOS];
+  struct semaphore done;
+
+  sema_init (&done, 0);
+  while (cnt > 0)
+    {
+      size_t bio_cnt, i;
+
+      for (bio_cnt = 0; bio_cnt < STRIPE_BIOS && cnt > 0; bio_cnt++)
+        {
+          struct bio *bio = &bios[bio_cnt];
+          struct block *member = locate_sector (s, sector, &bio->sector);
+          size_t run = STRIPE_CHUNK - sector % STRIPE_CHUNK;
+
+          if (run > cnt)
+            run = cnt;
+          bio->cnt = run;
+          bio->buffers = buffers;
+          bio->write = write;
+          bio->flags = 0;
+          bio->done = member_done;
+          bio->aux = &done;
+          block_submit (member, bio);
+
+          sector += run;
+          buffers += run;
+          cnt -= run;
+        }
+      for (i = 0; i < bio_cnt; i++)
+        sema_down (&done);
+    }
+}
+
+/* Reads sector SECTOR from stripe set S into BUFFER, which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+static void
+stripe_read (void *s_, block_sector_t sector, void *buffer)
+{
+  transfer (s_, sector, &buffer, 1, false);
+}
+
+/* Writes sector SECTOR to stripe set S from BUFFER, which must
+   contain BLOCK_SECTOR_SIZE bytes.  Returns after the member has
+   acknowledged receiving the data. */
+static void
+stripe_write (void *s_, block_sector_t sector, const void *buffer)
+{
+  transfer (s_, sector, (void *const *) &buffer, 1, true);
+}
+
+/* Reads the CNT sectors starting at SECTOR from stripe set S
+   into BUFFERS[0] through BUFFERS[CNT - 1], each of which must
+   have room for BLOCK_SECTOR_SIZE bytes. */
+static void
+stripe_read_multi (void *s_, block_sector_t sector, void *const buffers[],
+                   size_t cnt)
+{
+  transfer (s_, sector, buffers, cnt, false);
+}
+
+/* Writes the CNT sectors starting at SECTOR to stripe set S from
+   BUFFERS[0] through BUFFERS[CNT - 1], each of which must
+   contain BLOCK_SECTOR_SIZE bytes.  Returns after the members
+   have acknowledged receiving the data. */
+static void
+stripe_write_multi (void *s_, block_sector_t sector,
+                    const void *const buffers[], size_t cnt)
+{
+  transfer (s_, sector, (void *const *) buffers, cnt, true);
+}
+
+/* Flushes the write caches of stripe set S's members. */
+static void
+stripe_flush (void *s_)
+{
+  struct stripe *s = s_;
+  size_t i;
+
+  for (i = 0; i < s->cnt; i++)
+    block_flush (s->members[i]);
+}
+
+/* Discards the CNT sectors starting at SECTOR of stripe set S,
+   with one discard to each member for the run of its sectors
+   that the range covers, however many chunks that takes. */
+static void
+stripe_discard (void *s_, block_sector_t sector, block_sector_t cnt)
+{
+  struct stripe *s = s_;
+  block_sector_t start[STRIPE_MAX], end[STRIPE_MAX];
+  size_t i;
+
+  for (i = 0; i < s->cnt; i++)
+    start[i] = end[i] = 0;
+  while (cnt > 0)
+    {
+      block_sector_t member_sector;
+      struct block *member = locate_sector (s, sector, &member_sector);
+      block_sector_t run = STRIPE_CHUNK - sector % STRIPE_CHUNK;
+
+      i = (sector / STRIPE_CHUNK) % s->cnt;
+      if (run > cnt)
+        run = cnt;
+      if (member_sector != end[i])
+        {
+          block_discard (member, start[i], end[i] - start[i]);
+          start[i] = member_sector;
+        }
+      end[i] = member_sector + run;
+
+      sector += run;
+      cnt -= run;
+    }
+  for (i = 0; i < s->cnt; i++)
+    block_discard (s->members[i], start[i], end[i] - start[i]);
+}
+
+static struct block_operations stripe_operations =
+  {
+    stripe_read,
+    stripe_write,
+    stripe_read_multi,
+    stripe_write_multi,
+    NULL,
+    stripe_flush,
+    stripe_discard
+  };
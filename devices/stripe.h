@@ -0,0 +1,13 @@
+#ifndef DEVICES_STRIPE_H
+#define DEVICES_STRIPE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Most devices one stripe set may span. */
+#define STRIPE_MAX 4
+
+struct block *stripe_create (const char *name, struct block *members[],
+                             size_t cnt);
+
+#endif /* devices/stripe.h */
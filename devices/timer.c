@@ -2,11 +2,18 @@
 #include <debug.h>
 #include <inttypes.h>
 #include <round.h>
+#include <seqlock.h>
 #include <stdio.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/kexec.h"
+#include "threads/kinfo.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/workqueue.h"
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -17,62 +24,160 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Milliseconds over which timer_calibrate() counts TSC cycles. */
+#define TSC_CALIBRATE_MS 5
+
+/* Keyboard controller port B, which also gates PIT channel 2 and
+   connects it to the PC speaker (see devices/speaker.c). */
+#define PORT_B          0x61
+#define PORT_B_GATE2    0x01    /* Channel 2 counts while set. */
+#define PORT_B_SPEAKER  0x02    /* Channel 2 drives the speaker. */
+#define PORT_B_OUT2     0x20    /* Channel 2's output, read-only. */
+
+/* Number of timer ticks since OS booted.  Only the timer
+   interrupt changes it, under TICKS_LOCK, so that timer_ticks()
+   can read all 64 bits without turning interrupts off. */
 static int64_t ticks;
+static struct seqlock ticks_lock;
 
-/* Number of loops per timer tick.
+/* Time-stamp counter cycles per second.
    Initialized by timer_calibrate(). */
-static unsigned loops_per_tick;
+static uint64_t tsc_hz;
+
+/* Hashed timer wheel.  Pending timer events live in slot
+   DEADLINE % TIMER_WHEEL_SLOTS, each slot sorted by ascending
+   deadline.  Every tick looks only at the front of the slot for
+   the current tick, so the per-tick cost is O(1) when nothing
+   expires, and inserting costs O(n / TIMER_WHEEL_SLOTS) on
+   average. */
+#define TIMER_WHEEL_SLOTS 256   /* Must be a power of 2. */
+static struct list timer_wheel[TIMER_WHEEL_SLOTS];
+
+/* Deferred work.  The interrupt handler only moves expired
+   events from the wheel to EXPIRED; a worker thread runs their
+   callbacks through EXPIRED_WORK, and the once-a-second MLFQS
+   recompute of every thread through MLFQS_WORK. */
+static struct list expired;
+static struct work expired_work;
+static struct work mlfqs_work;
+
+/* Statistics. */
+static long long events_fired;  /* # of timer events expired. */
+static long long event_ticks;   /* # of ticks on which any expired. */
+static long long events_slack;  /* # of events delayed by slack. */
+
+/* Tickless idle.
+
+   If true, the idle thread stops the periodic tick by putting
+   PIT channel 0 in one-shot mode until the next timer event (or
+   the next MLFQS recompute) is due, and the skipped ticks are
+   added back when the CPU wakes up.  A 16-bit PIT count covers
+   at most TIMER_ONESHOT_MAX ticks, so longer idle periods are
+   a chain of one-shots. */
+bool timer_tickless;
+#define TIMER_PIT_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define TIMER_ONESHOT_MAX (65535 / TIMER_PIT_COUNT)
+static int oneshot_ticks;       /* Ticks covered by armed one-shot, or 0. */
+static uint16_t oneshot_count;  /* PIT count the one-shot started from. */
 
 static intr_handler_func timer_interrupt;
-static bool too_many_loops (unsigned loops);
-static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static uint64_t measure_tsc_hz (void);
+static void timer_collect_expired (void);
+static work_func timer_run_expired;
+static work_func recalcular_mlfqs;
+static int ticks_until_next_event (int max);
+static void timer_catch_up (int skipped);
+static bool deadline_less (const struct list_elem *,
+                           const struct list_elem *, void *aux);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void
 timer_init (void) 
 {
+  int i;
+
+  seqlock_init (&ticks_lock);
+  for (i = 0; i < TIMER_WHEEL_SLOTS; i++)
+    list_init (&timer_wheel[i]);
+  list_init (&expired);
+  work_init (&expired_work, timer_run_expired, NULL);
+  work_init (&mlfqs_work, recalcular_mlfqs, NULL);
+
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates tsc_hz, used to implement brief delays, and tells
+   user programs how fast the time-stamp counter runs, so that
+   they can tell the time between ticks.  A kernel started by
+   kexec_restart() runs on the CPU that its predecessor already
+   measured, so it takes the rate that was handed over. */
 void
 timer_calibrate (void) 
 {
-  unsigned high_bit, test_bit;
-
-  ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
+  tsc_hz = kexec_tsc_hz ();
+  if (tsc_hz == 0)
+    tsc_hz = measure_tsc_hz ();
+  kinfo_calibrate (tsc_hz / TIMER_FREQ);
+  printf ("%'"PRIu64" TSC cycles/s.\n", tsc_hz);
+}
 
-  /* Approximate loops_per_tick as the largest power-of-two
-     still less than one timer tick. */
-  loops_per_tick = 1u << 10;
-  while (!too_many_loops (loops_per_tick << 1)) 
-    {
-      loops_per_tick <<= 1;
-      ASSERT (loops_per_tick != 0);
-    }
+/* Returns the number of TSC cycles per second.
 
-  /* Refine the next 8 bits of loops_per_tick. */
-  high_bit = loops_per_tick;
-  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-    if (!too_many_loops (high_bit | test_bit))
-      loops_per_tick |= test_bit;
+   Counts TSC cycles while PIT channel 2, which is otherwise only
+   used for the speaker, counts down TSC_CALIBRATE_MS in one
+   shot.  Its output can be polled through port B, so this takes
+   no timer ticks at all. */
+static uint64_t
+measure_tsc_hz (void)
+{
+  uint16_t count = PIT_HZ * TSC_CALIBRATE_MS / 1000;
+  enum intr_level old_level;
+  uint64_t start, hz;
+  uint8_t port_b;
+
+  /* Open channel 2's gate with the speaker off and start the
+     count.  The output goes low until the count runs out. */
+  old_level = intr_disable ();
+  port_b = inb (PORT_B);
+  outb (PORT_B, (port_b & ~PORT_B_SPEAKER) | PORT_B_GATE2);
+  pit_start_oneshot (2, count);
+  start = rdtsc ();
+  while ((inb (PORT_B) & PORT_B_OUT2) == 0)
+    continue;
+  hz = (rdtsc () - start) * PIT_HZ / count;
+  outb (PORT_B, port_b);
+  intr_set_level (old_level);
+  return hz;
+}
 
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+/* Returns the number of TSC cycles per second, or 0 before
+   timer_calibrate() has run. */
+uint64_t
+timer_tsc_hz (void)
+{
+  return tsc_hz;
 }
 
-/* Returns the number of timer ticks since the OS booted. */
+/* Returns the number of timer ticks since the OS booted.  Reads
+   the count under TICKS_LOCK instead of turning interrupts off,
+   so it works the same from any CPU. */
 int64_t
 timer_ticks (void) 
 {
-  enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
-  intr_set_level (old_level);
+  uint32_t seq;
+  int64_t t;
+
+  do
+    {
+      seq = seqlock_read_begin (&ticks_lock);
+      t = ticks;
+    }
+  while (seqlock_read_retry (&ticks_lock, seq));
   return t;
 }
 
@@ -99,7 +204,21 @@ timer_sleep (int64_t ticks)
   /*while (timer_elapsed (start) < ticks) 
     thread_yield ();*/
   if(ticks > 0)
-    insertar_en_lista_espera(ticks);
+    insertar_en_lista_espera(start + ticks);
+}
+
+/* Sleeps until timer_ticks() reaches DEADLINE, or not at all if
+   it already has.  Unlike timer_sleep(), a thread that wakes up
+   late does not push its next deadline back, so a periodic task
+   that computes each deadline from the previous one does not
+   drift.  Interrupts must be turned on. */
+void
+timer_sleep_until (int64_t deadline) 
+{
+  ASSERT (intr_get_level () == INTR_ON);
+
+  if (deadline > timer_ticks ())
+    insertar_en_lista_espera (deadline);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -170,17 +289,275 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %lld events expired on %lld ticks, %lld delayed by slack\n",
+          events_fired, event_ticks, events_slack);
 }
 
+/* Schedules EVENT to call FUNC (AUX) from the timer interrupt
+   once timer_ticks() reaches DEADLINE.  A deadline that has
+   already passed fires on the next tick.  EVENT must not already
+   be pending.  May be called from an interrupt handler. */
+void
+timer_add (struct timer_event *event, int64_t deadline,
+           timer_event_func *func, void *aux)
+{
+  enum intr_level old_level;
+
+  ASSERT (event != NULL);
+  ASSERT (func != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (!event->pending);
+
+  /* Slot for the current tick has already been processed. */
+  if (deadline <= ticks)
+    deadline = ticks + 1;
+
+  event->deadline = deadline;
+  event->func = func;
+  event->aux = aux;
+  event->pending = true;
+  list_insert_ordered (&timer_wheel[deadline & (TIMER_WHEEL_SLOTS - 1)],
+                       &event->elem, deadline_less, NULL);
+  intr_set_level (old_level);
+}
+
+/* Like timer_add(), but lets EVENT fire up to SLACK ticks after
+   DEADLINE.  Picks the tick in that window that is the multiple
+   of the largest power of 2, so that events with overlapping
+   windows pick the same tick: they fire together, in one pass of
+   the expired worker, and the CPU can stay idle longer between
+   them. */
+void
+timer_add_slack (struct timer_event *event, int64_t deadline, int64_t slack,
+                 timer_event_func *func, void *aux)
+{
+  ASSERT (slack >= 0);
+
+  if (slack > 0 && deadline > 0)
+    {
+      /* Clearing the lowest 1-bit of the latest allowed tick
+         rounds it down to a multiple of the next power of 2. */
+      int64_t aligned = deadline + slack;
+      while ((aligned & (aligned - 1)) >= deadline)
+        aligned &= aligned - 1;
+      if (aligned != deadline)
+        events_slack++;
+      deadline = aligned;
+    }
+  timer_add (event, deadline, func, aux);
+}
+
+/* Removes EVENT from the timer wheel if it has not fired yet.
+   Returns true if EVENT was pending and is now cancelled, false
+   if its callback already ran (or it was never added). */
+bool
+timer_cancel (struct timer_event *event)
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (event != NULL);
+
+  old_level = intr_disable ();
+  was_pending = event->pending;
+  if (was_pending)
+    {
+      list_remove (&event->elem);
+      event->pending = false;
+    }
+  intr_set_level (old_level);
+
+  return was_pending;
+}
+
+/* Moves every timer event due at the current tick to the
+   expired list and, if there are any, schedules a worker to fire
+   them.  Called from the timer interrupt handler.  The events
+   stay pending, so timer_cancel() still works on them. */
+static void
+timer_collect_expired (void)
+{
+  struct list *slot = &timer_wheel[ticks & (TIMER_WHEEL_SLOTS - 1)];
+  bool any = false;
+
+  while (!list_empty (slot))
+    {
+      struct timer_event *e = list_entry (list_front (slot),
+                                          struct timer_event, elem);
+      if (e->deadline > ticks)
+        break;
+
+      list_push_back (&expired, list_pop_front (slot));
+      events_fired++;
+      any = true;
+    }
+  if (any)
+    {
+      event_ticks++;
+      work_schedule (&expired_work);
+    }
+}
+
+/* Fires the events on the expired list, in a worker thread.  The
+   callbacks still run with interrupts off, as they did from the
+   interrupt handler, but one at a time, so interrupts are taken
+   between them. */
+static void
+timer_run_expired (void *aux UNUSED)
+{
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      struct timer_event *e;
+
+      if (list_empty (&expired))
+        {
+          intr_set_level (old_level);
+          break;
+        }
+
+      /* Dequeue before calling, so the callback may re-arm EVENT. */
+      e = list_entry (list_pop_front (&expired), struct timer_event, elem);
+      e->pending = false;
+      e->func (e->aux);
+      intr_set_level (old_level);
+    }
+}
+
+/* Orders timer events by ascending deadline.  Equal deadlines
+   keep insertion order. */
+static bool
+deadline_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+  const struct timer_event *a = list_entry (a_, struct timer_event, elem);
+  const struct timer_event *b = list_entry (b_, struct timer_event, elem);
+
+  return a->deadline < b->deadline;
+}
+
+/* Called by the idle thread, with interrupts off, just before
+   it halts.  In tickless mode, if nothing is due on the next
+   tick, switches the PIT to a one-shot that fires when the next
+   event is due instead of on every tick. */
+void
+timer_idle_enter (void)
+{
+  int n;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+
+  n = ticks_until_next_event (TIMER_ONESHOT_MAX);
+  if (n <= 1)
+    return;
+
+  oneshot_ticks = n;
+  oneshot_count = n * TIMER_PIT_COUNT;
+  pit_start_oneshot (0, oneshot_count);
+}
+
+/* Called by the idle thread, with interrupts off, after it has
+   been woken up.  If an interrupt other than the one-shot woke
+   the CPU, accounts for the whole ticks that have elapsed since
+   timer_idle_enter() and restores the periodic tick. */
+void
+timer_idle_exit (void)
+{
+  uint16_t left;
+  int elapsed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks == 0)
+    return;
+
+  left = pit_read_counter (0);
+  pit_configure_channel (0, 2, TIMER_FREQ);
+
+  /* If the counter already wrapped past 0, the one-shot's
+     interrupt is pending and will supply the final tick. */
+  elapsed = left <= oneshot_count
+            ? (oneshot_count - left) / TIMER_PIT_COUNT : oneshot_ticks;
+  if (elapsed > oneshot_ticks - 1)
+    elapsed = oneshot_ticks - 1;
+
+  oneshot_ticks = 0;
+  timer_catch_up (elapsed);
+}
+
+/* Returns the number of ticks, between 1 and MAX, until the
+   next tick that has work to do: a timer event falls due, or
+   the MLFQS scheduler recomputes priorities. */
+static int
+ticks_until_next_event (int max)
+{
+  int n;
+
+  for (n = 1; n < max; n++)
+    {
+      int64_t t = ticks + n;
+      struct list *slot = &timer_wheel[t & (TIMER_WHEEL_SLOTS - 1)];
+
+      if (thread_mlfqs && t % 4 == 0)
+        break;
+      if (!list_empty (slot)
+          && list_entry (list_front (slot), struct timer_event,
+                         elem)->deadline <= t)
+        break;
+    }
+  return n;
+}
+
+/* Advances the tick counter over SKIPPED ticks during which the
+   CPU was idle and the periodic interrupt was stopped, firing
+   any timer event that became due along the way. */
+static void
+timer_catch_up (int skipped)
+{
+  int i;
+
+  for (i = 0; i < skipped; i++)
+    {
+      seqlock_write_begin (&ticks_lock);
+      ticks++;
+      seqlock_write_end (&ticks_lock);
+      timer_collect_expired ();
+    }
+  kinfo_tick (ticks);
+  thread_account_idle_ticks (skipped);
+}
+
 /* Timer interrupt handler. */
 //Es el reloj de Pintos. Cuando esta función sea llamada, la variable global ticks se incrementará en uno.
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
+  /* Un one-shot de tickless idle expiro: sumar los ticks que se
+     saltaron y regresar al tick periodico. */
+  if (oneshot_ticks != 0)
+    {
+      int skipped = oneshot_ticks - 1;
+
+      oneshot_ticks = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+      timer_catch_up (skipped);
+    }
+
+  seqlock_write_begin (&ticks_lock);
   ticks++;
-  thread_tick ();
+  seqlock_write_end (&ticks_lock);
+  kinfo_tick (ticks);
+  if (profile_enabled)
+    profile_sample (args);
+  // los 2 bits bajos de CS son el nivel de privilegio interrumpido, 3 en modo usuario
+  thread_tick ((args->cs & 3) == 3);
 
-  remover_thread_durmiente(ticks);
+  // los threads (y demas eventos) cuyo tiempo ya expiro se despiertan en un worker
+  timer_collect_expired ();
 
   /* 
     Aqui debemos actualizar load_avg y recent_cpu 
@@ -199,55 +576,31 @@ timer_interrupt (struct intr_frame *args UNUSED)
     actualizar_current_recent_cpu();
 
     if(ticks%TIMER_FREQ == 0){
-      //actualizar load_avg, load_avg = (59/60) * load_avg + (1/60) * ready_threads
-      actualizar_load_avg();
-      //actualizar recent_cpu de todos los threads, !vamos a usar thread_foreach
-      enum intr_level old_level = intr_disable();
-      thread_foreach(actualizar_thread_recent_cpu, NULL);
-      intr_set_level(old_level); 
-      
-    } 
-    if(ticks%4 == 0){
-      //actualizar prioridades de todos los threads
+      // el recalculo de todos los threads es O(n), se hace en un worker
+      work_schedule (&mlfqs_work);
+    } else if(ticks%4 == 0){
+      //entre segundos solo cambia el recent_cpu de los threads que corrieron
       enum intr_level old_level = intr_disable ();
-      thread_foreach(actualizar_thread_priority, NULL);
+      actualizar_prioridades_sucias();
       intr_set_level (old_level);
-      ordernar_ready_list();
     }
   }
 }
 
-/* Returns true if LOOPS iterations waits for more than one timer
-   tick, otherwise false. */
-static bool
-too_many_loops (unsigned loops) 
+/* Recalculo de MLFQS de cada segundo, en un worker.  Se encola
+   despues de los threads que despertaron en el mismo tick, asi
+   que ya cuentan en ready_threads; el thread interrumpido esta
+   en la run queue porque el worker le quito el procesador. */
+static void
+recalcular_mlfqs (void *aux UNUSED)
 {
-  /* Wait for a timer tick. */
-  int64_t start = ticks;
-  while (ticks == start)
-    barrier ();
-
-  /* Run LOOPS loops. */
-  start = ticks;
-  busy_wait (loops);
-
-  /* If the tick count changed, we iterated too long. */
-  barrier ();
-  return start != ticks;
-}
-
-/* Iterates through a simple loop LOOPS times, for implementing
-   brief delays.
+  enum intr_level old_level = intr_disable ();
 
-   Marked NO_INLINE because code alignment can significantly
-   affect timings, so that if this function was inlined
-   differently in different places the results would be difficult
-   to predict. */
-static void NO_INLINE
-busy_wait (int64_t loops) 
-{
-  while (loops-- > 0)
-    barrier ();
+  //actualizar load_avg, load_avg = (59/60) * load_avg + (1/60) * ready_threads
+  actualizar_load_avg();
+  //actualizar recent_cpu y prioridad de todos los threads en una sola pasada
+  thread_foreach(actualizar_thread_recent_cpu, NULL);
+  intr_set_level(old_level);
 }
 
 /* Sleep for approximately NUM/DENOM seconds. */
@@ -278,12 +631,21 @@ real_time_sleep (int64_t num, int32_t denom)
     }
 }
 
-/* Busy-wait for approximately NUM/DENOM seconds. */
+/* Busy-wait for approximately NUM/DENOM seconds, by watching the
+   time-stamp counter, which unlike a loop count is not thrown off
+   by how the loop is compiled or by interrupts taken meanwhile. */
 static void
 real_time_delay (int64_t num, int32_t denom)
 {
+  uint64_t start = rdtsc ();
+  uint64_t cycles;
+
   /* Scale the numerator and denominator down by 1000 to avoid
      the possibility of overflow. */
   ASSERT (denom % 1000 == 0);
-  busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000)); 
+  if (num <= 0)
+    return;
+  cycles = num * (tsc_hz / 1000) / (denom / 1000);
+  while (rdtsc () - start < cycles)
+    asm volatile ("pause");
 }
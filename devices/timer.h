@@ -1,7 +1,9 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -9,12 +11,14 @@
 
 void timer_init (void);
 void timer_calibrate (void);
+uint64_t timer_tsc_hz (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
 
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
+void timer_sleep_until (int64_t deadline);
 void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
@@ -26,4 +30,35 @@ void timer_ndelay (int64_t nanoseconds);
 
 void timer_print_stats (void);
 
+/* Tickless idle.  Controlled by kernel command-line option
+   "-tickless". */
+extern bool timer_tickless;
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
+/* Kernel timers.
+
+   A timer event calls FUNC (AUX) from the timer interrupt
+   handler once the tick counter reaches its deadline.  Because
+   the callback runs in interrupt context it must not sleep; it
+   may call thread_unblock(), sema_up(), and the like.  The
+   caller owns the storage for the event, which must remain valid
+   until the callback has run or timer_cancel() has returned. */
+typedef void timer_event_func (void *aux);
+
+struct timer_event
+  {
+    struct list_elem elem;      /* Element in a timer wheel slot. */
+    int64_t deadline;           /* Tick at which to fire. */
+    timer_event_func *func;     /* Callback. */
+    void *aux;                  /* Callback argument. */
+    bool pending;               /* True while queued in the wheel. */
+  };
+
+void timer_add (struct timer_event *, int64_t deadline,
+                timer_event_func *, void *aux);
+void timer_add_slack (struct timer_event *, int64_t deadline, int64_t slack,
+                      timer_event_func *, void *aux);
+bool timer_cancel (struct timer_event *);
+
 #endif /* devices/timer.h */
@@ -1,4 +1,5 @@
 #include "devices/vga.h"
+#include <debug.h>
 #include <round.h>
 #include <stdint.h>
 #include <stddef.h>
@@ -21,16 +22,36 @@ static size_t cx, cy;
 /* Attribute value for gray text on a black background. */
 #define GRAY_ON_BLACK 0x07
 
-/* Framebuffer.  See [FREEVGA] under "VGA Text Mode Operation".
+/* Rows of text memory.  The 32 kB of VGA text memory hold
+   RING_ROWS rows, of which the display shows the ROW_CNT
+   starting at the CRTC's start address.  Scrolling moves the
+   start address down a row instead of copying the screen, and
+   copies the screen back to the start of text memory only when
+   it reaches the end. */
+#define RING_ROWS (0x8000 / (COL_CNT * 2))
+static uint8_t (*mem)[COL_CNT][2];
+
+/* Framebuffer, the rows of MEM on display.  See [FREEVGA] under
+   "VGA Text Mode Operation".
    The character at (x,y) is fb[y][x][0].
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+/* Rows the CRTC was last told to display.  move_cursor() brings
+   it up to date with FB, so that a burst of scrolling writes the
+   start address only once.  Null until the first update. */
+static uint8_t (*shown)[COL_CNT][2];
+
+static void put_char (int c, enum intr_level old_level);
+static void put_run (const char *s, size_t n);
+static bool is_control (int c);
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
 static void move_cursor (void);
 static void find_cursor (size_t *x, size_t *y);
+static uint16_t read_crtc (uint8_t reg);
+static void write_crtc (uint8_t reg, uint16_t value);
 
 /* Initializes the VGA text display. */
 static void
@@ -40,7 +61,9 @@ init (void)
   static bool inited;
   if (!inited)
     {
-      fb = ptov (0xb8000);
+      size_t top = read_crtc (0x0c) / COL_CNT;
+      mem = ptov (0xb8000);
+      fb = mem + (top <= RING_ROWS - ROW_CNT ? top : 0);
       find_cursor (&cx, &cy);
       inited = true; 
     }
@@ -56,7 +79,79 @@ vga_putc (int c)
   enum intr_level old_level = intr_disable ();
 
   init ();
-  
+  put_char (c, old_level);
+
+  /* Update cursor position. */
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes the N characters in BUF to the VGA text display, as if
+   by calling vga_putc() for each one, but copies runs of
+   ordinary characters into the framebuffer a row at a time and
+   moves the hardware cursor only once, at the end.  Moving the
+   cursor takes two port writes per call, which are much slower
+   than the framebuffer writes under a virtual machine. */
+void
+vga_write (const char *buf, size_t n)
+{
+  enum intr_level old_level = intr_disable ();
+
+  init ();
+  while (n > 0)
+    {
+      size_t run = 0;
+      while (run < n && run < COL_CNT - cx && !is_control (buf[run]))
+        run++;
+
+      if (run > 0)
+        put_run (buf, run);
+      else
+        put_char (buf[run++], old_level);
+      buf += run;
+      n -= run;
+    }
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Returns true if C is one of the characters that vga_putc()
+   interprets instead of displaying. */
+static bool
+is_control (int c)
+{
+  return c == '\n' || c == '\f' || c == '\b' || c == '\r'
+         || c == '\t' || c == '\a';
+}
+
+/* Writes the N ordinary characters in S at the cursor, which
+   must leave room for them in the current row, and advances the
+   cursor past them. */
+static void
+put_run (const char *s, size_t n)
+{
+  uint8_t (*p)[2] = &fb[cy][cx];
+  size_t i;
+
+  ASSERT (cx + n <= COL_CNT);
+  for (i = 0; i < n; i++)
+    {
+      p[i][0] = s[i];
+      p[i][1] = GRAY_ON_BLACK;
+    }
+  cx += n;
+  if (cx >= COL_CNT)
+    newline ();
+}
+
+/* Writes C at the cursor, interpreting control characters, but
+   does not move the hardware cursor.  Interrupts must be off;
+   OLD_LEVEL is the level to restore while beeping. */
+static void
+put_char (int c, enum intr_level old_level)
+{
   switch (c) 
     {
     case '\n':
@@ -95,11 +190,6 @@ vga_putc (int c)
         newline ();
       break;
     }
-
-  /* Update cursor position. */
-  move_cursor ();
-
-  intr_set_level (old_level);
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
@@ -130,7 +220,9 @@ clear_row (size_t y)
 
 /* Advances the cursor to the first column in the next line on
    the screen.  If the cursor is already on the last line on the
-   screen, scrolls the screen upward one line. */
+   screen, scrolls the screen upward one line, by moving FB down
+   a row of text memory or, at the end of text memory, by copying
+   all but its first row back to the start. */
 static void
 newline (void)
 {
@@ -139,34 +231,66 @@ newline (void)
   if (cy >= ROW_CNT)
     {
       cy = ROW_CNT - 1;
-      memmove (&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
+      if (fb + ROW_CNT < mem + RING_ROWS)
+        fb++;
+      else
+        {
+          memmove (&mem[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
+          fb = mem;
+        }
       clear_row (ROW_CNT - 1);
     }
 }
 
-/* Moves the hardware cursor to (cx,cy). */
+/* Moves the hardware cursor to (cx,cy), first making the display
+   start at FB if it does not already. */
 static void
 move_cursor (void) 
 {
   /* See [FREEVGA] under "Manipulating the Text-mode Cursor". */
-  uint16_t cp = cx + COL_CNT * cy;
-  outw (0x3d4, 0x0e | (cp & 0xff00));
-  outw (0x3d4, 0x0f | (cp << 8));
+  uint16_t top = COL_CNT * (fb - mem);
+  if (shown != fb)
+    {
+      write_crtc (0x0c, top);
+      shown = fb;
+    }
+  write_crtc (0x0e, top + cx + COL_CNT * cy);
 }
 
-/* Reads the current hardware cursor position into (*X,*Y). */
+/* Reads the current hardware cursor position, relative to the
+   start of the display, into (*X,*Y). */
 static void
 find_cursor (size_t *x, size_t *y) 
 {
   /* See [FREEVGA] under "Manipulating the Text-mode Cursor". */
-  uint16_t cp;
+  uint16_t cp = read_crtc (0x0e) - COL_CNT * (fb - mem);
 
-  outb (0x3d4, 0x0e);
-  cp = inb (0x3d5) << 8;
+  *x = cp % COL_CNT;
+  *y = cp / COL_CNT % ROW_CNT;
+}
 
-  outb (0x3d4, 0x0f);
-  cp |= inb (0x3d5);
+/* Returns the 16-bit value of the pair of CRTC registers that
+   starts with REG, whose high byte is in REG and low byte in
+   REG + 1, as for the start address and cursor location. */
+static uint16_t
+read_crtc (uint8_t reg) 
+{
+  uint16_t value;
 
-  *x = cp % COL_CNT;
-  *y = cp / COL_CNT;
+  outb (0x3d4, reg);
+  value = inb (0x3d5) << 8;
+
+  outb (0x3d4, reg + 1);
+  value |= inb (0x3d5);
+
+  return value;
+}
+
+/* Sets the pair of CRTC registers that starts with REG to
+   VALUE. */
+static void
+write_crtc (uint8_t reg, uint16_t value) 
+{
+  outw (0x3d4, reg | (value & 0xff00));
+  outw (0x3d4, (reg + 1) | (value << 8));
 }
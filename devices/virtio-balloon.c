@@ -0,0 +1,424 @@
+#include "devices/virtio-balloon.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/pci.h"
+#include "devices/timer.h"
+#include "devices/virtio.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Driver for the virtio memory balloon of QEMU and KVM, through
+   the legacy PCI interface.
+
+   A host that runs many guests promises each more memory than it
+   has for all of them at once.  It asks a guest to give some back
+   by raising the target size of the guest's balloon, in the
+   device's configuration space.  The driver then inflates the
+   balloon: it takes free pages from the user pool and passes
+   their frame numbers to the host on the inflate virtqueue,
+   after which the host drops their contents and uses the memory
+   elsewhere.  When the host lowers the target, the driver
+   deflates the balloon, passing the frames it takes back on the
+   deflate virtqueue, and frees them.
+
+   The guest cannot use memory that is in the balloon, so when
+   memory runs short here the driver gives pages back without
+   waiting for the host: frame_alloc() calls
+   virtio_balloon_shrink() when the user pool is exhausted, before
+   it evicts a page, and the driver is one of the kernel pool's
+   shrinkers, since the kernel pool borrows the pages it frees.
+   We do not accept the "must tell host" feature, so these pages
+   may be used at once and are reported to the host afterward.
+   Then the driver stops inflating for BACKOFF_TICKS, so as not to
+   take straight back what it just gave up.
+
+   The balloon is in no hurry, so rather than share an interrupt
+   line with the disks, it keeps the device's interrupts off.  A
+   kernel thread rereads the target every POLL_TICKS and polls
+   the used ring while a transfer is in flight. */
+
+/* PCI device ID of a legacy or transitional virtio balloon. */
+#define VIRTIO_BALLOON_DEVICE 0x1002
+
+/* Device-specific configuration, relative to BAR 0. */
+#define reg_num_pages(B) ((B)->io_base + 0x14)         /* 32 bits, r/o. */
+#define reg_actual(B) ((B)->io_base + 0x18)            /* 32 bits. */
+
+/* Virtqueues. */
+#define QUEUE_INFLATE 0         /* Frames given to the host. */
+#define QUEUE_DEFLATE 1         /* Frames taken back. */
+
+/* Most frame numbers in one transfer, a page of them. */
+#define PFN_MAX (PGSIZE / sizeof (uint32_t))
+
+/* How often to reread the target, and how long to stop inflating
+   after giving pages back under memory pressure. */
+#define POLL_TICKS TIMER_FREQ
+#define BACKOFF_TICKS (5 * TIMER_FREQ)
+
+/* User pool pages that inflating leaves free. */
+#define RESERVE_PAGES 32
+
+/* A virtqueue, used for one transfer at a time. */
+struct queue
+  {
+    uint16_t size;                      /* Entries in each ring. */
+    struct vring_desc *desc;            /* Descriptors. */
+    volatile struct vring_avail *avail; /* Posted transfers. */
+    volatile struct vring_used *used;   /* Completed transfers. */
+    uint16_t last_used;                 /* USED->IDX last handled. */
+    uint32_t *pfns;                     /* PFN_MAX frame numbers. */
+  };
+
+/* The balloon. */
+struct balloon
+  {
+    uint16_t io_base;           /* Base I/O port. */
+    struct queue inflate;       /* QUEUE_INFLATE. */
+    struct queue deflate;       /* QUEUE_DEFLATE. */
+
+    /* Pages in the balloon, by index in the user pool's range.
+       Only touched with interrupts off. */
+    struct bitmap *pages;       /* Set for each page in the balloon. */
+    uint8_t *base;              /* First page of the range. */
+    size_t held;                /* Number of bits set in PAGES. */
+
+    /* Frames given back by virtio_balloon_shrink() that the host
+       has not been told about yet.  Only touched with interrupts
+       off. */
+    uint32_t *released;         /* PFN_MAX frame numbers. */
+    size_t released_cnt;        /* Number in RELEASED. */
+    int64_t inflate_after;      /* No inflating before this tick. */
+
+    /* Statistics. */
+    unsigned long long inflated;        /* Pages given to the host. */
+    unsigned long long deflated;        /* Pages it asked back. */
+    unsigned long long shrunk;          /* Pages taken back here. */
+    unsigned long long transfers;       /* Buffers posted. */
+    size_t held_max;                    /* Largest value of HELD. */
+  };
+
+static struct balloon balloon;
+static bool present;
+
+static struct shrinker balloon_shrinker;
+
+static bool init_balloon (struct balloon *, struct pci_address);
+static bool init_queue (struct balloon *, struct queue *, uint16_t idx);
+static void balloon_thread (void *aux);
+static void inflate (struct balloon *, size_t page_cnt);
+static void deflate (struct balloon *, size_t page_cnt);
+static void report_released (struct balloon *);
+static void transfer (struct balloon *, struct queue *, uint16_t idx,
+                      size_t pfn_cnt);
+static void update_actual (struct balloon *);
+
+/* Finds the virtio balloon on the PCI bus, if there is one, and
+   starts the thread that inflates and deflates it. */
+void
+virtio_balloon_init (void)
+{
+  struct pci_address a;
+
+  if (pci_find_id (VIRTIO_VENDOR, VIRTIO_BALLOON_DEVICE, &a, 1) == 0
+      || !init_balloon (&balloon, a))
+    return;
+  present = true;
+  palloc_register_shrinker (&balloon_shrinker, "balloon",
+                            virtio_balloon_shrink, SHRINK_EMPTY);
+  thread_create ("balloon", PRI_MIN, balloon_thread, NULL);
+}
+
+/* Takes up to PAGE_CNT pages back from the balloon because memory
+   is short, frees them, and returns the number freed.  The host
+   is told later.  May be called by a thread holding any lock. */
+size_t
+virtio_balloon_shrink (size_t page_cnt)
+{
+  struct balloon *b = &balloon;
+  size_t freed = 0, idx = 0;
+
+  if (!present)
+    return 0;
+
+  while (freed < page_cnt)
+    {
+      enum intr_level old_level = intr_disable ();
+      void *kpage = NULL;
+
+      if (b->released_cnt < PFN_MAX
+          && (idx = bitmap_next_set (b->pages, idx)) != BITMAP_ERROR)
+        {
+          kpage = b->base + idx * PGSIZE;
+          bitmap_reset (b->pages, idx);
+          b->held--;
+          b->released[b->released_cnt++] = vtop (kpage) / PGSIZE;
+          b->shrunk++;
+          b->inflate_after = timer_ticks () + BACKOFF_TICKS;
+        }
+      intr_set_level (old_level);
+      if (kpage == NULL)
+        break;
+
+      palloc_free_page (kpage);
+      freed++;
+    }
+  return freed;
+}
+
+/* Prints the balloon's statistics, if there is one. */
+void
+virtio_balloon_print_stats (void)
+{
+  struct balloon *b = &balloon;
+
+  if (!present)
+    return;
+  printf ("Balloon: %zu pages held, %zu at most, %llu inflated, "
+          "%llu deflated, %llu given back under pressure, "
+          "%llu transfers\n",
+          b->held, b->held_max, b->inflated, b->deflated, b->shrunk,
+          b->transfers);
+}
+
+/* Initializes balloon B, the virtio balloon at A, and its
+   virtqueues.  Returns true if successful, false if B cannot be
+   used. */
+static bool
+init_balloon (struct balloon *b, struct pci_address a)
+{
+  uint32_t bar = pci_read_config (a, PCI_REG_BAR (0));
+  void *user_base;
+  size_t user_pages;
+
+  if (!(bar & 1))
+    {
+      printf ("balloon: no I/O ports; ignoring\n");
+      return false;
+    }
+  b->io_base = bar & 0xfffc;
+  pci_write_config16 (a, PCI_REG_COMMAND,
+                      (pci_read_config (a, PCI_REG_COMMAND)
+                       | PCI_CMD_IO | PCI_CMD_MASTER
+                       | PCI_CMD_INTX_DISABLE));
+
+  /* Reset the device, tell it we are here, and take none of its
+     features. */
+  outb (reg_status (b), 0);
+  outb (reg_status (b), STATUS_ACKNOWLEDGE);
+  outb (reg_status (b), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  outl (reg_guest_features (b), 0);
+
+  palloc_get_user_range (&user_base, &user_pages);
+  b->base = user_base;
+  b->pages = bitmap_create (user_pages);
+  b->released = palloc_get_page (0);
+  if (b->pages == NULL || b->released == NULL
+      || !init_queue (b, &b->inflate, QUEUE_INFLATE)
+      || !init_queue (b, &b->deflate, QUEUE_DEFLATE))
+    {
+      printf ("balloon: cannot set up virtqueues; ignoring\n");
+      outb (reg_status (b), STATUS_FAILED);
+      return false;
+    }
+  b->held = b->released_cnt = 0;
+  b->inflate_after = 0;
+
+  outb (reg_status (b),
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+  update_actual (b);
+  return true;
+}
+
+/* Allocates virtqueue IDX of balloon B as Q, with its buffer of
+   frame numbers, and gives it to the device.  Returns true if
+   successful, false if the device has no such queue. */
+static bool
+init_queue (struct balloon *b, struct queue *q, uint16_t idx)
+{
+  size_t avail_size, used_size;
+  uint8_t *ring;
+
+  outw (reg_queue_select (b), idx);
+  q->size = inw (reg_queue_size (b));
+  if (q->size == 0)
+    return false;
+
+  /* The legacy layout, as for the disks. */
+  avail_size = (sizeof *q->desc * q->size + sizeof *q->avail
+                + sizeof q->avail->ring[0] * (q->size + 1));
+  used_size = (sizeof *q->used + sizeof q->used->ring[0] * q->size
+               + sizeof (uint16_t));
+  ring = palloc_get_multiple (PAL_ZERO, (DIV_ROUND_UP (avail_size, PGSIZE)
+                                         + DIV_ROUND_UP (used_size, PGSIZE)));
+  q->pfns = palloc_get_page (0);
+  if (ring == NULL || q->pfns == NULL)
+    return false;
+  q->desc = (struct vring_desc *) ring;
+  q->avail = (struct vring_avail *) (ring + sizeof *q->desc * q->size);
+  q->used = (struct vring_used *) (ring + ROUND_UP (avail_size, PGSIZE));
+  q->avail->flags = AVAIL_NO_INTERRUPT;
+  q->last_used = 0;
+
+  /* Every transfer is descriptor 0, pointing to the buffer. */
+  q->desc[0].addr = vtop (q->pfns);
+
+  outl (reg_queue_address (b), vtop (ring) / PGSIZE);
+  return true;
+}
+
+/* Moves the balloon toward the host's target, a batch at a time,
+   and reports the pages given back under pressure. */
+static void
+balloon_thread (void *aux UNUSED)
+{
+  struct balloon *b = &balloon;
+
+  /* Keep MLFQS from raising our priority. */
+  thread_set_worker ();
+  for (;;)
+    {
+      size_t target = inl (reg_num_pages (b));
+      size_t held;
+
+      report_released (b);
+      held = b->held;
+      if (held < target && timer_ticks () >= b->inflate_after)
+        inflate (b, target - held);
+      else if (held > target)
+        deflate (b, held - target);
+      else
+        timer_sleep (POLL_TICKS);
+    }
+}
+
+/* Gives up to PAGE_CNT free user pages, at most PFN_MAX, to the
+   host.  If there are not enough, stops inflating for a while. */
+static void
+inflate (struct balloon *b, size_t page_cnt)
+{
+  struct queue *q = &b->inflate;
+  enum intr_level old_level;
+  size_t free_pages, cnt, i;
+  int largest;
+
+  if (page_cnt > PFN_MAX)
+    page_cnt = PFN_MAX;
+  palloc_get_stats (PAL_USER, &free_pages, &largest);
+  free_pages = free_pages > RESERVE_PAGES ? free_pages - RESERVE_PAGES : 0;
+  for (cnt = 0; cnt < page_cnt && cnt < free_pages; cnt++)
+    {
+      void *kpage = palloc_get_page_tagged (PAL_USER, MEM_BALLOON);
+      if (kpage == NULL)
+        break;
+      q->pfns[cnt] = vtop (kpage) / PGSIZE;
+    }
+  if (cnt < page_cnt)
+    b->inflate_after = timer_ticks () + BACKOFF_TICKS;
+  if (cnt == 0)
+    return;
+
+  /* The pages join the balloon, where virtio_balloon_shrink() may
+     take them, only once the host has them. */
+  transfer (b, q, QUEUE_INFLATE, cnt);
+  old_level = intr_disable ();
+  for (i = 0; i < cnt; i++)
+    {
+      uint8_t *kpage = ptov (q->pfns[i] * PGSIZE);
+      bitmap_mark (b->pages, (kpage - b->base) / PGSIZE);
+    }
+  b->held += cnt;
+  if (b->held > b->held_max)
+    b->held_max = b->held;
+  b->inflated += cnt;
+  intr_set_level (old_level);
+  update_actual (b);
+}
+
+/* Takes up to PAGE_CNT pages, at most PFN_MAX, back from the host
+   and frees them. */
+static void
+deflate (struct balloon *b, size_t page_cnt)
+{
+  struct queue *q = &b->deflate;
+  enum intr_level old_level;
+  size_t cnt = 0, idx = 0, i;
+
+  if (page_cnt > PFN_MAX)
+    page_cnt = PFN_MAX;
+  old_level = intr_disable ();
+  while (cnt < page_cnt
+         && (idx = bitmap_next_set (b->pages, idx)) != BITMAP_ERROR)
+    {
+      q->pfns[cnt++] = vtop (b->base + idx * PGSIZE) / PGSIZE;
+      bitmap_reset (b->pages, idx);
+    }
+  b->held -= cnt;
+  b->deflated += cnt;
+  intr_set_level (old_level);
+  if (cnt == 0)
+    return;
+
+  transfer (b, q, QUEUE_DEFLATE, cnt);
+  for (i = 0; i < cnt; i++)
+    palloc_free_page (ptov (q->pfns[i] * PGSIZE));
+  update_actual (b);
+}
+
+/* Tells the host about the pages that virtio_balloon_shrink()
+   gave back. */
+static void
+report_released (struct balloon *b)
+{
+  struct queue *q = &b->deflate;
+  enum intr_level old_level;
+  size_t cnt;
+
+  old_level = intr_disable ();
+  cnt = b->released_cnt;
+  memcpy (q->pfns, b->released, cnt * sizeof *q->pfns);
+  b->released_cnt = 0;
+  intr_set_level (old_level);
+  if (cnt == 0)
+    return;
+
+  transfer (b, q, QUEUE_DEFLATE, cnt);
+  update_actual (b);
+}
+
+/* Posts the first PFN_CNT frame numbers in Q's buffer to
+   virtqueue IDX of balloon B and waits for the host to take
+   them. */
+static void
+transfer (struct balloon *b, struct queue *q, uint16_t idx, size_t pfn_cnt)
+{
+  ASSERT (pfn_cnt > 0 && pfn_cnt <= PFN_MAX);
+
+  q->desc[0].len = pfn_cnt * sizeof *q->pfns;
+  q->desc[0].flags = 0;
+  q->avail->ring[q->avail->idx % q->size] = 0;
+  barrier ();
+  q->avail->idx++;
+  memory_barrier ();
+  outw (reg_queue_notify (b), idx);
+  b->transfers++;
+
+  while (q->used->idx == q->last_used)
+    timer_sleep (1);
+  q->last_used++;
+}
+
+/* Tells the host how many pages the balloon holds. */
+static void
+update_actual (struct balloon *b)
+{
+  outl (reg_actual (b), b->held);
+}
@@ -0,0 +1,10 @@
+#ifndef DEVICES_VIRTIO_BALLOON_H
+#define DEVICES_VIRTIO_BALLOON_H
+
+#include <stddef.h>
+
+void virtio_balloon_init (void);
+size_t virtio_balloon_shrink (size_t page_cnt);
+void virtio_balloon_print_stats (void);
+
+#endif /* devices/virtio-balloon.h */
@@ -0,0 +1,595 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "devices/virtio.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Driver for virtio block devices, the paravirtualized disks of
+   QEMU and KVM, through the legacy PCI interface described in
+   the "Virtio PCI Card Specification" v0.9.5.
+
+   Instead of a register access per word of data, as IDE PIO
+   takes, a request to a virtio disk is a chain of descriptors in
+   memory that the host reads and writes directly: a header
+   giving the operation and sector, the data buffers, and a
+   status byte.  A request is posted by adding it to a ring that
+   the host shares with us, its one virtqueue, and the host puts
+   it in another ring when it is done and interrupts us.
+
+   Requests are submitted with the block layer's submit
+   operation, which returns as soon as the request is posted, so
+   that as many as SLOT_CNT are in the host's hands at once.  The
+   host does its own scheduling, so the device has no queue in
+   the block layer.  Each request is one descriptor in the ring,
+   pointing to an indirect table of its own, so that a request
+   for BIO_MAX scattered sectors never runs out of descriptors.
+
+   Exits to the host are what cost the most, so the driver
+   negotiates the "event index" feature where the host offers it
+   and then notifies the host of a new request only when it says
+   it has gone idle, and asks to be interrupted only once for
+   several requests in flight, up to COALESCE_MAX.  Every request
+   that has completed is handled by each interrupt.
+
+   Where the host offers DISCARD requests, a discard is passed on
+   as one, or as several in turn if it covers more sectors than
+   the host takes at once.  Otherwise discards do nothing.
+
+   The ring is only touched with interrupts off. */
+
+/* PCI device ID of a legacy or transitional virtio block device. */
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Most virtio disks supported. */
+#define VIRTIO_MAX 4
+
+/* Most requests in flight per disk. */
+#define SLOT_CNT 16
+
+/* Most completions one interrupt stands for. */
+#define COALESCE_MAX 8
+
+/* Device-specific configuration, relative to BAR 0. */
+#define reg_capacity(D) ((D)->io_base + 0x14)        /* 64 bits, r/o. */
+#define reg_max_discard(D) ((D)->io_base + 0x38)     /* Sectors, r/o. */
+
+/* Feature bits of block devices. */
+#define F_FLUSH (1u << 9)       /* FLUSH requests, for a write cache. */
+#define F_DISCARD (1u << 13)    /* DISCARD requests. */
+
+/* Header of a block request. */
+struct virtio_blk_header
+  {
+    uint32_t type;              /* One of the types below. */
+    uint32_t reserved;
+    uint64_t sector;            /* First sector. */
+  };
+
+/* Request types. */
+#define TYPE_IN 0               /* Read. */
+#define TYPE_OUT 1              /* Write. */
+#define TYPE_FLUSH 4            /* Flush the write cache. */
+#define TYPE_DISCARD 11         /* Discard sectors. */
+
+/* Data of a DISCARD request: one range of sectors. */
+struct virtio_blk_discard
+  {
+    uint64_t sector;            /* First sector. */
+    uint32_t cnt;               /* Number of sectors. */
+    uint32_t flags;             /* 0. */
+  };
+
+/* Request status. */
+#define STATUS_OK 0
+
+/* Steps of a request, in order.  A request takes those that
+   apply to it. */
+enum phase
+  {
+    PHASE_START,                /* Not started. */
+    PHASE_PREFLUSH,             /* Flush for BIO_PREFLUSH. */
+    PHASE_DATA,                 /* Transfer the sectors. */
+    PHASE_POSTFLUSH,            /* Flush for BIO_FUA. */
+    PHASE_DONE                  /* Finished. */
+  };
+
+/* A request slot.  Slot I's table is pointed to by descriptor I
+   of the ring.  Aligned as descriptor tables must be. */
+struct slot
+  {
+    struct vring_desc table[2 + BIO_MAX]; /* Header, data, status. */
+    struct virtio_blk_header header;    /* Request header. */
+    struct virtio_blk_discard discard;  /* Range, for a DISCARD. */
+    uint8_t status;                     /* Written by the host. */
+    enum phase phase;                   /* Step in progress. */
+    block_sector_t discarded;           /* Sectors of a discard posted
+                                           so far. */
+    struct bio *bio;                    /* Request, if in use. */
+    struct slot *next_free;             /* Next in free list. */
+  }
+__attribute__ ((aligned (16)));
+
+/* A virtio disk. */
+struct virtio_disk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* Base I/O port. */
+    uint8_t irq;                /* Interrupt vector. */
+    uint32_t features;          /* Features negotiated. */
+    block_sector_t discard_max; /* Most sectors one DISCARD takes. */
+
+    /* The virtqueue. */
+    uint16_t size;                      /* Entries in each ring. */
+    struct vring_desc *desc;            /* Descriptors. */
+    volatile struct vring_avail *avail; /* Posted requests. */
+    volatile struct vring_used *used;   /* Completed requests. */
+    uint16_t last_used;                 /* USED->IDX last handled. */
+    size_t posted;                      /* Requests in the host's hands. */
+
+    struct slot *slots;                 /* SLOT_CNT slots. */
+    struct slot *free_slots;            /* Slots not in use. */
+    struct list waiting;                /* Bios waiting for a slot. */
+
+    /* Statistics. */
+    unsigned long long requests;        /* Requests posted. */
+    unsigned long long notifications;   /* Exits to tell the host. */
+    unsigned long long interrupts;      /* Interrupts handled. */
+  };
+
+static struct virtio_disk disks[VIRTIO_MAX];
+static size_t disk_cnt;
+
+static struct block_operations virtio_operations;
+
+static bool init_disk (struct virtio_disk *, struct pci_address);
+static bool init_queue (struct virtio_disk *);
+static void start_bio (struct virtio_disk *, struct slot *, struct bio *);
+static bool next_phase (struct virtio_disk *, struct slot *);
+static void post (struct virtio_disk *, struct slot *);
+static void handle_used (struct virtio_disk *);
+static void interrupt_handler (struct intr_frame *);
+
+/* Finds the virtio disks on the PCI bus and registers them with
+   the block layer, scanning each for partitions. */
+void
+virtio_blk_init (void)
+{
+  struct pci_address found[VIRTIO_MAX];
+  size_t found_cnt, i;
+
+  found_cnt = pci_find_id (VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, found,
+                           VIRTIO_MAX);
+  for (i = 0; i < found_cnt; i++)
+    {
+      struct virtio_disk *d = &disks[disk_cnt];
+      char extra_info[64];
+      struct block *block;
+      block_sector_t capacity;
+      uint32_t high;
+
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) disk_cnt);
+      if (!init_disk (d, found[i]))
+        continue;
+      disk_cnt++;
+
+      /* Disks past 2 TB are cut short. */
+      capacity = inl (reg_capacity (d));
+      high = inl (reg_capacity (d) + 4);
+      if (high != 0)
+        capacity = UINT32_MAX;
+
+      snprintf (extra_info, sizeof extra_info, "virtio, %u-entry ring%s%s",
+                (unsigned) d->size,
+                d->features & F_FLUSH ? ", write cache" : "",
+                d->features & F_DISCARD ? ", discard" : "");
+      block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+                              &virtio_operations, d);
+      partition_scan (block);
+    }
+}
+
+/* Prints statistics for each virtio disk. */
+void
+virtio_blk_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < disk_cnt; i++)
+    {
+      struct virtio_disk *d = &disks[i];
+      printf ("%s: %llu requests, %llu notifications, %llu interrupts\n",
+              d->name, d->requests, d->notifications, d->interrupts);
+    }
+}
+
+/* Initializes disk D, the virtio block device at A, and its
+   virtqueue, and hooks up its interrupt.  Returns true if
+   successful, false if D cannot be used. */
+static bool
+init_disk (struct virtio_disk *d, struct pci_address a)
+{
+  uint32_t bar = pci_read_config (a, PCI_REG_BAR (0));
+  uint8_t line = pci_read_config (a, PCI_REG_INTERRUPT) & 0xff;
+  uint32_t offered;
+  size_t i;
+
+  if (!(bar & 1) || line >= 16)
+    {
+      printf ("%s: no I/O ports or interrupt; ignoring\n", d->name);
+      return false;
+    }
+  d->io_base = bar & 0xfffc;
+  d->irq = line + 0x20;
+  pci_write_config16 (a, PCI_REG_COMMAND,
+                      (pci_read_config (a, PCI_REG_COMMAND)
+                       | PCI_CMD_IO | PCI_CMD_MASTER));
+
+  /* Reset the device, and then tell it we are here. */
+  outb (reg_status (d), 0);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+
+  offered = inl (reg_device_features (d));
+  if (!(offered & F_INDIRECT))
+    {
+      printf ("%s: no indirect descriptors; ignoring\n", d->name);
+      outb (reg_status (d), STATUS_FAILED);
+      return false;
+    }
+  d->features = offered & (F_FLUSH | F_DISCARD | F_INDIRECT | F_EVENT_IDX);
+  outl (reg_guest_features (d), d->features);
+  if (d->features & F_DISCARD)
+    {
+      d->discard_max = inl (reg_max_discard (d));
+      if (d->discard_max == 0)
+        d->discard_max = UINT32_MAX;
+    }
+
+  if (!init_queue (d))
+    {
+      printf ("%s: cannot set up virtqueue; ignoring\n", d->name);
+      outb (reg_status (d), STATUS_FAILED);
+      return false;
+    }
+
+  /* The disks may share an interrupt line, with each other and
+     with other PCI devices. */
+  for (i = 0; i < disk_cnt; i++)
+    if (disks[i].irq == d->irq)
+      break;
+  if (i == disk_cnt)
+    intr_register_ext_shared (d->irq, interrupt_handler, "virtio-blk");
+
+  outb (reg_status (d),
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+  return true;
+}
+
+/* Allocates disk D's virtqueue and request slots, and gives the
+   queue to the device.  Returns true if successful, false if the
+   device has no queue. */
+static bool
+init_queue (struct virtio_disk *d)
+{
+  size_t avail_size, used_size;
+  uint8_t *ring;
+  size_t i;
+
+  outw (reg_queue_select (d), 0);
+  d->size = inw (reg_queue_size (d));
+  if (d->size < SLOT_CNT)
+    return false;
+
+  /* The legacy layout: descriptors, then the available ring, then
+     the used ring at the next page boundary, each ring with room
+     for its event index after it. */
+  avail_size = (sizeof *d->desc * d->size + sizeof *d->avail
+                + sizeof d->avail->ring[0] * (d->size + 1));
+  used_size = (sizeof *d->used + sizeof d->used->ring[0] * d->size
+               + sizeof (uint16_t));
+  ring = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                              DIV_ROUND_UP (avail_size, PGSIZE)
+                              + DIV_ROUND_UP (used_size, PGSIZE));
+  d->desc = (struct vring_desc *) ring;
+  d->avail = (struct vring_avail *) (ring + sizeof *d->desc * d->size);
+  d->used = (struct vring_used *) (ring + ROUND_UP (avail_size, PGSIZE));
+  d->last_used = 0;
+  d->posted = 0;
+
+  d->slots = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                  DIV_ROUND_UP (sizeof *d->slots * SLOT_CNT,
+                                                PGSIZE));
+  d->free_slots = NULL;
+  for (i = SLOT_CNT; i-- > 0; )
+    {
+      struct slot *s = &d->slots[i];
+      d->desc[i].addr = vtop (s->table);
+      d->desc[i].flags = DESC_INDIRECT;
+      s->next_free = d->free_slots;
+      d->free_slots = s;
+    }
+  list_init (&d->waiting);
+  d->requests = d->notifications = d->interrupts = 0;
+
+  outl (reg_queue_address (d), vtop (ring) / PGSIZE);
+  return true;
+}
+
+/* Submits BIO to disk D_, posting it at once if a slot is free
+   and otherwise when one is. */
+static void
+virtio_submit (void *d_, struct bio *bio)
+{
+  struct virtio_disk *d = d_;
+  enum intr_level old_level = intr_disable ();
+
+  if (d->free_slots != NULL)
+    {
+      struct slot *s = d->free_slots;
+      d->free_slots = s->next_free;
+      start_bio (d, s, bio);
+    }
+  else
+    list_push_back (&d->waiting, &bio->elem);
+  intr_set_level (old_level);
+}
+
+static struct block_operations virtio_operations =
+  {
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    virtio_submit,
+    NULL,
+    NULL
+  };
+
+/* Puts BIO in slot S of disk D and posts its first step.  If it
+   has none, as a flush for a disk that has no write cache,
+   completes it and frees S at once.  Interrupts must be off. */
+static void
+start_bio (struct virtio_disk *d, struct slot *s, struct bio *bio)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  s->bio = bio;
+  s->phase = PHASE_START;
+  s->discarded = 0;
+  if (next_phase (d, s))
+    post (d, s);
+  else
+    {
+      s->next_free = d->free_slots;
+      d->free_slots = s;
+      block_complete (bio);
+    }
+}
+
+/* Advances slot S of disk D to the next step that its request
+   takes, and returns true, or returns false if it has taken them
+   all. */
+static bool
+next_phase (struct virtio_disk *d, struct slot *s)
+{
+  struct bio *bio = s->bio;
+  bool flush = (d->features & F_FLUSH) != 0;
+
+  while (++s->phase < PHASE_DONE)
+    switch (s->phase)
+      {
+      case PHASE_PREFLUSH:
+        if (flush && (bio->flags & BIO_PREFLUSH))
+          return true;
+        break;
+      case PHASE_DATA:
+        if (bio->cnt > 0
+            && (!(bio->flags & BIO_DISCARD) || (d->features & F_DISCARD)))
+          return true;
+        break;
+      case PHASE_POSTFLUSH:
+        if (flush && bio->write && (bio->flags & BIO_FUA))
+          return true;
+        break;
+      default:
+        NOT_REACHED ();
+      }
+  return false;
+}
+
+/* Builds the descriptor table for the step that slot S of disk D
+   is on, and adds S to D's available ring, notifying the host if
+   it wants to be told.  Interrupts must be off. */
+static void
+post (struct virtio_disk *d, struct slot *s)
+{
+  struct bio *bio = s->bio;
+  size_t slot_idx = s - d->slots;
+  uint16_t old_idx, new_idx;
+  size_t n = 0;
+  size_t i;
+  bool notify;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Header. */
+  s->header.reserved = 0;
+  s->header.sector = bio->sector;
+  if (s->phase != PHASE_DATA)
+    s->header.type = TYPE_FLUSH;
+  else if (bio->flags & BIO_DISCARD)
+    s->header.type = TYPE_DISCARD;
+  else
+    s->header.type = bio->write ? TYPE_OUT : TYPE_IN;
+  s->table[n].addr = vtop (&s->header);
+  s->table[n].len = sizeof s->header;
+  s->table[n].flags = 0;
+  n++;
+
+  /* Data: the next range of a discard, or else the buffers,
+     merging those that are adjacent in memory. */
+  if (s->phase == PHASE_DATA && (bio->flags & BIO_DISCARD))
+    {
+      block_sector_t left = bio->cnt - s->discarded;
+
+      s->discard.sector = bio->sector + s->discarded;
+      s->discard.cnt = left < d->discard_max ? left : d->discard_max;
+      s->discard.flags = 0;
+      s->discarded += s->discard.cnt;
+      s->table[n].addr = vtop (&s->discard);
+      s->table[n].len = sizeof s->discard;
+      s->table[n].flags = 0;
+      n++;
+    }
+  else if (s->phase == PHASE_DATA)
+    {
+      uint16_t flags = bio->write ? 0 : DESC_WRITE;
+
+      for (i = 0; i < bio->cnt; i++)
+        {
+          uint32_t addr = vtop (bio->buffers[i]);
+          struct vring_desc *prev = &s->table[n - 1];
+
+          if (n > 1 && prev->addr + prev->len == addr)
+            prev->len += BLOCK_SECTOR_SIZE;
+          else
+            {
+              s->table[n].addr = addr;
+              s->table[n].len = BLOCK_SECTOR_SIZE;
+              s->table[n].flags = flags;
+              n++;
+            }
+        }
+    }
+
+  /* Status. */
+  s->status = 0xff;
+  s->table[n].addr = vtop (&s->status);
+  s->table[n].len = sizeof s->status;
+  s->table[n].flags = DESC_WRITE;
+  n++;
+
+  /* Chain the descriptors. */
+  for (i = 0; i + 1 < n; i++)
+    {
+      s->table[i].flags |= DESC_NEXT;
+      s->table[i].next = i + 1;
+    }
+  d->desc[slot_idx].len = n * sizeof *s->table;
+
+  /* Post. */
+  old_idx = d->avail->idx;
+  new_idx = old_idx + 1;
+  d->avail->ring[old_idx % d->size] = slot_idx;
+  barrier ();
+  d->avail->idx = new_idx;
+  d->posted++;
+  d->requests++;
+  memory_barrier ();
+
+  if (d->features & F_EVENT_IDX)
+    {
+      uint16_t event = *(volatile uint16_t *) &d->used->ring[d->size];
+      notify = (uint16_t) (new_idx - event - 1) < (uint16_t) (new_idx
+                                                              - old_idx);
+    }
+  else
+    notify = !(d->used->flags & USED_NO_NOTIFY);
+  if (notify)
+    {
+      outw (reg_queue_notify (d), 0);
+      d->notifications++;
+    }
+}
+
+/* Handles the requests that disk D has completed: posts the next
+   step of each that has one, and otherwise completes it and gives
+   its slot to a waiting request.  Then asks the host, if it
+   supports that, to interrupt again only once the next
+   COALESCE_MAX requests in flight, or all of them if fewer, have
+   completed.  Interrupts must be off. */
+static void
+handle_used (struct virtio_disk *d)
+{
+  for (;;)
+    {
+      while (d->last_used != d->used->idx)
+        {
+          volatile struct vring_used_elem *e;
+          struct slot *s;
+          struct bio *bio;
+
+          barrier ();
+          e = &d->used->ring[d->last_used % d->size];
+          ASSERT (e->id < SLOT_CNT);
+          s = &d->slots[e->id];
+          d->last_used++;
+          d->posted--;
+
+          if (s->status != STATUS_OK)
+            PANIC ("%s: %s failed, sector=%"PRDSNu, d->name,
+                   (s->phase != PHASE_DATA ? "flush"
+                    : s->bio->flags & BIO_DISCARD ? "discard"
+                    : s->bio->write ? "write" : "read"),
+                   s->bio->sector);
+          if ((s->phase == PHASE_DATA && (s->bio->flags & BIO_DISCARD)
+               && s->discarded < s->bio->cnt)
+              || next_phase (d, s))
+            {
+              post (d, s);
+              continue;
+            }
+
+          bio = s->bio;
+          if (!list_empty (&d->waiting))
+            start_bio (d, s, list_entry (list_pop_front (&d->waiting),
+                                         struct bio, elem));
+          else
+            {
+              s->next_free = d->free_slots;
+              d->free_slots = s;
+            }
+          block_complete (bio);
+        }
+
+      if (!(d->features & F_EVENT_IDX))
+        return;
+
+      /* Set used_event, and then check that nothing completed
+         meanwhile that it would not interrupt for. */
+      d->avail->ring[d->size] = (d->last_used
+                                 + (d->posted < COALESCE_MAX
+                                    ? (d->posted > 0 ? d->posted : 1)
+                                    : COALESCE_MAX)
+                                 - 1);
+      memory_barrier ();
+      if (d->last_used == d->used->idx)
+        return;
+    }
+}
+
+/* Virtio interrupt handler, shared by the disks on a line. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < disk_cnt; i++)
+    {
+      struct virtio_disk *d = &disks[i];
+      if (d->irq == f->vec_no && (inb (reg_isr (d)) & ISR_QUEUE))
+        {
+          d->interrupts++;
+          handle_used (d);
+        }
+    }
+}
@@ -0,0 +1,373 @@
+#include "devices/virtio-console.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/input.h"
+#include "devices/pci.h"
+#include "devices/virtio.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Driver for the virtio console of QEMU and KVM, through the
+   legacy PCI interface.
+
+   Each byte written to the serial port is an exit to the host,
+   or more than one, since the UART is polled for room first, so
+   a test that logs a lot runs only as fast as the console
+   does.  This driver carries console output instead in buffers
+   of up to SLOT_SIZE bytes on the device's transmit virtqueue,
+   one exit for each putbuf() or printf() however long.  Once the
+   device is found, console output goes to it and not to the
+   serial port, unless virtio_console_mirror is set, and the
+   "pintos" utility's --vconsole option copies it to standard
+   output along with the serial port.
+
+   Input typed at the virtio console arrives in buffers on the
+   receive virtqueue and goes to the input layer, as the serial
+   port's does.
+
+   Only port 0 is used, so we do not accept the "multiport"
+   feature.  The transmit ring is only touched with interrupts
+   off, and its used ring is polled, not interrupted for.  If the
+   host falls behind, writers wait with interrupts off for a
+   free slot, as serial output does in polling mode. */
+
+/* PCI device ID of a legacy or transitional virtio console. */
+#define VIRTIO_CONSOLE_DEVICE 0x1003
+
+/* Virtqueues of port 0. */
+#define QUEUE_RX 0              /* Input from the host. */
+#define QUEUE_TX 1              /* Output to the host. */
+
+/* Transmit slots, and the bytes in each. */
+#define TX_SLOTS 16
+#define SLOT_SIZE 512
+
+/* Receive slots, and the bytes in each. */
+#define RX_SLOTS 4
+#define RX_SIZE 64
+
+/* A virtqueue.  Descriptor I is slot I, and points to the slot's
+   buffer. */
+struct queue
+  {
+    uint16_t size;                      /* Entries in each ring. */
+    struct vring_desc *desc;            /* Descriptors. */
+    volatile struct vring_avail *avail; /* Posted buffers. */
+    volatile struct vring_used *used;   /* Buffers handed back. */
+    uint16_t last_used;                 /* USED->IDX last handled. */
+  };
+
+/* The console. */
+struct vconsole
+  {
+    uint16_t io_base;           /* Base I/O port. */
+    uint8_t irq;                /* Interrupt vector. */
+    struct queue rx;            /* QUEUE_RX. */
+    struct queue tx;            /* QUEUE_TX. */
+    uint8_t *rx_buf;            /* RX_SLOTS buffers of RX_SIZE bytes. */
+    uint8_t *tx_buf;            /* TX_SLOTS buffers of SLOT_SIZE bytes. */
+    uint32_t tx_free;           /* Bit I set if transmit slot I is free. */
+    bool writing;               /* In virtio_console_write()? */
+
+    /* Statistics. */
+    unsigned long long bytes;           /* Bytes written. */
+    unsigned long long buffers;         /* Transmit buffers posted. */
+    unsigned long long notifications;   /* Exits to tell the host. */
+    unsigned long long waits;           /* Times no slot was free. */
+    unsigned long long input;           /* Bytes read. */
+    unsigned long long dropped;         /* Bytes read with input full. */
+  };
+
+static struct vconsole vcon;
+static bool present;
+
+/* Also write console output to the serial port? */
+bool virtio_console_mirror;
+
+static bool init_console (struct vconsole *, struct pci_address);
+static bool init_queue (struct vconsole *, struct queue *, uint16_t idx,
+                        uint8_t *buf, size_t slot_cnt, size_t slot_size,
+                        uint16_t flags);
+static void post (struct queue *, size_t slot);
+static void notify (struct vconsole *, struct queue *, uint16_t idx);
+static void reclaim_tx (struct vconsole *);
+static void interrupt_handler (struct intr_frame *);
+
+/* Finds the virtio console on the PCI bus, if there is one, and
+   sends console output to it from now on. */
+void
+virtio_console_init (void)
+{
+  struct pci_address a;
+
+  if (pci_find_id (VIRTIO_VENDOR, VIRTIO_CONSOLE_DEVICE, &a, 1) == 0
+      || !init_console (&vcon, a))
+    return;
+  present = true;
+  printf ("vconsole: %u-byte buffers%s\n", (unsigned) SLOT_SIZE,
+          virtio_console_mirror ? ", mirrored to serial" : "");
+}
+
+/* Writes the N bytes in BUFFER to the virtio console and returns
+   true, or returns false if there is no virtio console, in which
+   case the caller should write them elsewhere.  May be called
+   from any context; the console layer serializes callers. */
+bool
+virtio_console_write (const char *buffer, size_t n)
+{
+  struct vconsole *c = &vcon;
+  enum intr_level old_level;
+
+  /* Output from a panic inside the driver goes elsewhere. */
+  if (!present || c->writing)
+    return false;
+
+  old_level = intr_disable ();
+  c->writing = true;
+  while (n > 0)
+    {
+      size_t chunk = n < SLOT_SIZE ? n : SLOT_SIZE;
+      size_t slot;
+
+      reclaim_tx (c);
+      if (c->tx_free == 0)
+        {
+          /* Let the host catch up. */
+          notify (c, &c->tx, QUEUE_TX);
+          c->waits++;
+          while (c->tx_free == 0)
+            {
+              asm volatile ("pause");
+              reclaim_tx (c);
+            }
+        }
+
+      slot = __builtin_ctz (c->tx_free);
+      c->tx_free &= ~(1u << slot);
+      memcpy (c->tx_buf + slot * SLOT_SIZE, buffer, chunk);
+      c->tx.desc[slot].len = chunk;
+      post (&c->tx, slot);
+      c->bytes += chunk;
+      c->buffers++;
+      buffer += chunk;
+      n -= chunk;
+    }
+  notify (c, &c->tx, QUEUE_TX);
+  c->writing = false;
+  intr_set_level (old_level);
+
+  return true;
+}
+
+/* Waits for the host to take all the output written so far. */
+void
+virtio_console_flush (void)
+{
+  struct vconsole *c = &vcon;
+  enum intr_level old_level;
+
+  if (!present || c->writing)
+    return;
+
+  old_level = intr_disable ();
+  for (reclaim_tx (c); c->tx_free != (1u << TX_SLOTS) - 1; reclaim_tx (c))
+    asm volatile ("pause");
+  intr_set_level (old_level);
+}
+
+/* Prints the virtio console's statistics, if there is one. */
+void
+virtio_console_print_stats (void)
+{
+  struct vconsole *c = &vcon;
+
+  if (!present)
+    return;
+  printf ("vconsole: %llu bytes in %llu buffers, %llu notifications, "
+          "%llu waits, %llu bytes input, %llu dropped\n",
+          c->bytes, c->buffers, c->notifications, c->waits, c->input,
+          c->dropped);
+}
+
+/* Initializes console C, the virtio console at A, and its
+   virtqueues, and hooks up its interrupt.  Returns true if
+   successful, false if C cannot be used. */
+static bool
+init_console (struct vconsole *c, struct pci_address a)
+{
+  uint32_t bar = pci_read_config (a, PCI_REG_BAR (0));
+  uint8_t line = pci_read_config (a, PCI_REG_INTERRUPT) & 0xff;
+  size_t i;
+
+  if (!(bar & 1) || line >= 16)
+    {
+      printf ("vconsole: no I/O ports or interrupt; ignoring\n");
+      return false;
+    }
+  c->io_base = bar & 0xfffc;
+  c->irq = line + 0x20;
+  pci_write_config16 (a, PCI_REG_COMMAND,
+                      (pci_read_config (a, PCI_REG_COMMAND)
+                       | PCI_CMD_IO | PCI_CMD_MASTER));
+
+  /* Reset the device, tell it we are here, and take none of its
+     features. */
+  outb (reg_status (c), 0);
+  outb (reg_status (c), STATUS_ACKNOWLEDGE);
+  outb (reg_status (c), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  outl (reg_guest_features (c), 0);
+
+  c->rx_buf = palloc_get_page (0);
+  c->tx_buf = palloc_get_multiple (0, DIV_ROUND_UP (TX_SLOTS * SLOT_SIZE,
+                                                    PGSIZE));
+  if (c->rx_buf == NULL || c->tx_buf == NULL
+      || !init_queue (c, &c->rx, QUEUE_RX, c->rx_buf, RX_SLOTS, RX_SIZE,
+                      DESC_WRITE)
+      || !init_queue (c, &c->tx, QUEUE_TX, c->tx_buf, TX_SLOTS, SLOT_SIZE,
+                      0))
+    {
+      printf ("vconsole: cannot set up virtqueues; ignoring\n");
+      outb (reg_status (c), STATUS_FAILED);
+      return false;
+    }
+  c->tx.avail->flags = AVAIL_NO_INTERRUPT;
+  c->tx_free = (1u << TX_SLOTS) - 1;
+
+  intr_register_ext_shared (c->irq, interrupt_handler, "virtio-console");
+  outb (reg_status (c),
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+  /* Give the host every receive buffer. */
+  for (i = 0; i < RX_SLOTS; i++)
+    post (&c->rx, i);
+  notify (c, &c->rx, QUEUE_RX);
+  return true;
+}
+
+/* Allocates virtqueue IDX of console C as Q and gives it to the
+   device, pointing its first SLOT_CNT descriptors to the
+   SLOT_SIZE-byte slots of BUF, with descriptor FLAGS.  Returns
+   true if successful, false if the device's queue is too small
+   or memory is short. */
+static bool
+init_queue (struct vconsole *c, struct queue *q, uint16_t idx,
+            uint8_t *buf, size_t slot_cnt, size_t slot_size, uint16_t flags)
+{
+  size_t avail_size, used_size;
+  uint8_t *ring;
+  size_t i;
+
+  outw (reg_queue_select (c), idx);
+  q->size = inw (reg_queue_size (c));
+  if (q->size < slot_cnt)
+    return false;
+
+  /* The legacy layout, as for the disks. */
+  avail_size = (sizeof *q->desc * q->size + sizeof *q->avail
+                + sizeof q->avail->ring[0] * (q->size + 1));
+  used_size = (sizeof *q->used + sizeof q->used->ring[0] * q->size
+               + sizeof (uint16_t));
+  ring = palloc_get_multiple (PAL_ZERO, (DIV_ROUND_UP (avail_size, PGSIZE)
+                                         + DIV_ROUND_UP (used_size, PGSIZE)));
+  if (ring == NULL)
+    return false;
+  q->desc = (struct vring_desc *) ring;
+  q->avail = (struct vring_avail *) (ring + sizeof *q->desc * q->size);
+  q->used = (struct vring_used *) (ring + ROUND_UP (avail_size, PGSIZE));
+  q->last_used = 0;
+  for (i = 0; i < slot_cnt; i++)
+    {
+      q->desc[i].addr = vtop (buf + i * slot_size);
+      q->desc[i].len = slot_size;
+      q->desc[i].flags = flags;
+    }
+
+  outl (reg_queue_address (c), vtop (ring) / PGSIZE);
+  return true;
+}
+
+/* Adds SLOT to Q's available ring.  Interrupts must be off. */
+static void
+post (struct queue *q, size_t slot)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  q->avail->ring[q->avail->idx % q->size] = slot;
+  barrier ();
+  q->avail->idx++;
+}
+
+/* Tells the host about the buffers posted to Q, virtqueue IDX of
+   console C, if it wants to be told. */
+static void
+notify (struct vconsole *c, struct queue *q, uint16_t idx)
+{
+  memory_barrier ();
+  if (!(q->used->flags & USED_NO_NOTIFY))
+    {
+      outw (reg_queue_notify (c), idx);
+      c->notifications++;
+    }
+}
+
+/* Frees the transmit slots that the host has handed back.
+   Interrupts must be off. */
+static void
+reclaim_tx (struct vconsole *c)
+{
+  struct queue *q = &c->tx;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (q->last_used != q->used->idx)
+    {
+      barrier ();
+      c->tx_free |= 1u << q->used->ring[q->last_used % q->size].id;
+      q->last_used++;
+    }
+}
+
+/* Virtio console interrupt handler: passes input to the input
+   layer and gives its buffers back to the host. */
+static void
+interrupt_handler (struct intr_frame *f UNUSED)
+{
+  struct vconsole *c = &vcon;
+  struct queue *q = &c->rx;
+  bool reposted = false;
+
+  if (!(inb (reg_isr (c)) & ISR_QUEUE))
+    return;
+
+  while (q->last_used != q->used->idx)
+    {
+      volatile struct vring_used_elem *e;
+      const uint8_t *p;
+      size_t len, i;
+
+      barrier ();
+      e = &q->used->ring[q->last_used % q->size];
+      ASSERT (e->id < RX_SLOTS);
+      p = c->rx_buf + e->id * RX_SIZE;
+      len = e->len < RX_SIZE ? e->len : RX_SIZE;
+      for (i = 0; i < len; i++)
+        if (!input_full ())
+          {
+            input_putc (p[i]);
+            c->input++;
+          }
+        else
+          c->dropped++;
+      post (q, e->id);
+      q->last_used++;
+      reposted = true;
+    }
+  if (reposted)
+    notify (c, q, QUEUE_RX);
+}
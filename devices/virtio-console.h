@@ -0,0 +1,15 @@
+#ifndef DEVICES_VIRTIO_CONSOLE_H
+#define DEVICES_VIRTIO_CONSOLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Also write console output to the serial port? */
+extern bool virtio_console_mirror;
+
+void virtio_console_init (void);
+bool virtio_console_write (const char *, size_t);
+void virtio_console_flush (void);
+void virtio_console_print_stats (void);
+
+#endif /* devices/virtio-console.h */
@@ -0,0 +1,93 @@
+#ifndef DEVICES_VIRTIO_H
+#define DEVICES_VIRTIO_H
+
+#include <stdint.h>
+
+/* Definitions shared by the drivers for virtio devices, through
+   the legacy PCI interface described in the "Virtio PCI Card
+   Specification" v0.9.5. */
+
+/* PCI vendor ID of every virtio device. */
+#define VIRTIO_VENDOR 0x1af4
+
+/* Legacy virtio I/O port addresses, relative to BAR 0, whose
+   base is the IO_BASE member of device D.  Device-specific
+   configuration starts at offset 0x14. */
+#define reg_device_features(D) ((D)->io_base + 0x00) /* 32 bits, r/o. */
+#define reg_guest_features(D) ((D)->io_base + 0x04)  /* 32 bits. */
+#define reg_queue_address(D) ((D)->io_base + 0x08)   /* 32 bits, PFN. */
+#define reg_queue_size(D) ((D)->io_base + 0x0c)      /* 16 bits, r/o. */
+#define reg_queue_select(D) ((D)->io_base + 0x0e)    /* 16 bits. */
+#define reg_queue_notify(D) ((D)->io_base + 0x10)    /* 16 bits. */
+#define reg_status(D) ((D)->io_base + 0x12)          /* 8 bits. */
+#define reg_isr(D) ((D)->io_base + 0x13)             /* 8 bits, r/o. */
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* Guest has noticed the device. */
+#define STATUS_DRIVER 0x02      /* Guest knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+#define STATUS_FAILED 0x80      /* Driver gave up on the device. */
+
+/* ISR status bits.  Reading the register clears them and
+   deasserts the interrupt. */
+#define ISR_QUEUE 0x01          /* A virtqueue has used buffers. */
+#define ISR_CONFIG 0x02         /* Device configuration changed. */
+
+/* Feature bits that any device may offer. */
+#define F_INDIRECT (1u << 28)   /* Indirect descriptor tables. */
+#define F_EVENT_IDX (1u << 29)  /* used_event and avail_event. */
+
+/* Descriptor flags. */
+#define DESC_NEXT 0x1           /* NEXT is valid. */
+#define DESC_WRITE 0x2          /* Device writes, not reads, buffer. */
+#define DESC_INDIRECT 0x4       /* Buffer is a descriptor table. */
+
+/* Ring flags. */
+#define AVAIL_NO_INTERRUPT 0x1  /* Guest does not want interrupts. */
+#define USED_NO_NOTIFY 0x1      /* Host does not want notifications. */
+
+/* A descriptor: a buffer in guest physical memory. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address. */
+    uint32_t len;               /* Length in bytes. */
+    uint16_t flags;             /* DESC_* flags. */
+    uint16_t next;              /* Next descriptor, with DESC_NEXT. */
+  };
+
+/* The ring of posted requests, written by us.  The RING is
+   followed by used_event, the value of the used ring's IDX past
+   which we want an interrupt. */
+struct vring_avail
+  {
+    uint16_t flags;             /* AVAIL_* flags. */
+    uint16_t idx;               /* Where the next request goes. */
+    uint16_t ring[];            /* First descriptor of each request. */
+  };
+
+/* A completed request. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* First descriptor of the request. */
+    uint32_t len;               /* Bytes written by the device. */
+  };
+
+/* The ring of completed requests, written by the host.  The RING
+   is followed by avail_event, the value of the available ring's
+   IDX past which the host wants a notification. */
+struct vring_used
+  {
+    uint16_t flags;             /* USED_* flags. */
+    uint16_t idx;               /* Where the next completion goes. */
+    struct vring_used_elem ring[];
+  };
+
+/* Full memory barrier: keeps the CPU from reading a ring index
+   before its own writes to the other ring are visible. */
+static inline void
+memory_barrier (void)
+{
+  asm volatile ("lock; addl $0, 0(%%esp)" : : : "memory", "cc");
+}
+
+#endif /* devices/virtio.h */
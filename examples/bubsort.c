@@ -5,27 +5,39 @@
    Intention is to stress virtual memory system.
  
    Ideally, we could read the unsorted array off of the file
-   system, and store the result back to the file system! */
+   system, and store the result back to the file system!
+
+   The array comes from malloc(), so its size, given as the
+   first argument, may be far larger than would fit in the
+   program's data segment. */
+#include <malloc.h>
 #include <stdio.h>
+#include <stdlib.h>
 
-/* Size of array to sort. */
+/* Default size of array to sort. */
 #define SORT_SIZE 128
 
 int
-main (void)
+main (int argc, char *argv[])
 {
-  /* Array to sort.  Static to reduce stack usage. */
-  static int array[SORT_SIZE];
-
+  int size = argc > 1 ? atoi (argv[1]) : SORT_SIZE;
+  int *array;
   int i, j, tmp;
 
+  array = malloc (size * sizeof *array);
+  if (size <= 0 || array == NULL)
+    {
+      printf ("sort: cannot sort %d integers\n", size);
+      return -1;
+    }
+
   /* First initialize the array in descending order. */
-  for (i = 0; i < SORT_SIZE; i++)
-    array[i] = SORT_SIZE - i - 1;
+  for (i = 0; i < size; i++)
+    array[i] = size - i - 1;
 
   /* Then sort in ascending order. */
-  for (i = 0; i < SORT_SIZE - 1; i++)
-    for (j = 0; j < SORT_SIZE - 1 - i; j++)
+  for (i = 0; i < size - 1; i++)
+    for (j = 0; j < size - 1 - i; j++)
       if (array[j] > array[j + 1])
 	{
 	  tmp = array[j];
@@ -33,6 +45,8 @@ main (void)
 	  array[j + 1] = tmp;
 	}
 
-  printf ("sort exiting with code %d\n", array[0]);
-  return array[0];
+  tmp = array[0];
+  free (array);
+  printf ("sort exiting with code %d\n", tmp);
+  return tmp;
 }
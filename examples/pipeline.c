@@ -0,0 +1,154 @@
+/* pipeline.c
+
+   Pushes KB kilobytes through a pipeline of N processes that
+   copy their input pipe to their output pipe, like a shell
+   pipeline of "cat"s, into a last process that checks every byte.
+   Prints the time taken and the bytes per second that made it
+   through.
+
+   Usage: pipeline [N [KB]] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+/* Most copying stages allowed. */
+#define MAX_STAGES 14
+
+/* Bytes per read() and write(). */
+#define BUF_SIZE 4096
+
+/* Pipes between the stages: PIPES[0] from this process to the
+   first stage, PIPES[N] from the last to the checker. */
+static int pipes[MAX_STAGES + 1][2];
+
+static char buf[BUF_SIZE];
+
+/* Returns the time since boot in microseconds. */
+static int64_t
+now_us (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Closes every pipe descriptor except IN and OUT. */
+static void
+close_pipes (int pipe_cnt, int in, int out)
+{
+  int i, j;
+
+  for (i = 0; i < pipe_cnt; i++)
+    for (j = 0; j < 2; j++)
+      if (pipes[i][j] != in && pipes[i][j] != out)
+        close (pipes[i][j]);
+}
+
+/* Copies IN to OUT until end of file, then exits. */
+static void
+copy_stage (int in, int out)
+{
+  int n;
+
+  while ((n = read (in, buf, sizeof buf)) > 0)
+    if (write (out, buf, n) != n)
+      exit (EXIT_FAILURE);
+  exit (n == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/* Reads IN until end of file and checks that it is SIZE bytes of
+   the pattern that main() writes.  Exits with status 0 if so. */
+static void
+check_stage (int in, long size)
+{
+  long ofs = 0;
+  int n, i;
+
+  while ((n = read (in, buf, sizeof buf)) > 0)
+    for (i = 0; i < n; i++, ofs++)
+      if (buf[i] != (char) (ofs % 251))
+        exit (EXIT_FAILURE);
+  exit (n == 0 && ofs == size ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t pids[MAX_STAGES + 1];
+  int stages = argc > 1 ? atoi (argv[1]) : 3;
+  long size = (argc > 2 ? atoi (argv[2]) : 1024) * 1024L;
+  long ofs;
+  int64_t start, us;
+  bool ok = true;
+  int i;
+
+  if (stages < 0 || stages > MAX_STAGES || size < 1)
+    {
+      printf ("pipeline: need 0 to %d stages and 1 or more kB\n",
+              MAX_STAGES);
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i <= stages; i++)
+    if (pipe (pipes[i]) < 0)
+      {
+        printf ("pipeline: pipe failed\n");
+        return EXIT_FAILURE;
+      }
+
+  /* Stage I reads PIPES[I] and writes PIPES[I + 1], and the
+     checker reads the last pipe. */
+  start = now_us ();
+  for (i = 0; i <= stages; i++)
+    {
+      pids[i] = fork ();
+      if (pids[i] == 0)
+        {
+          if (i < stages)
+            {
+              close_pipes (stages + 1, pipes[i][0], pipes[i + 1][1]);
+              copy_stage (pipes[i][0], pipes[i + 1][1]);
+            }
+          close_pipes (stages + 1, pipes[i][0], -1);
+          check_stage (pipes[i][0], size);
+        }
+      if (pids[i] == PID_ERROR)
+        {
+          printf ("pipeline: starting stage %d failed\n", i);
+          return EXIT_FAILURE;
+        }
+    }
+  close_pipes (stages + 1, pipes[0][1], -1);
+
+  for (ofs = 0; ofs < size; )
+    {
+      int n = size - ofs < BUF_SIZE ? size - ofs : BUF_SIZE;
+
+      for (i = 0; i < n; i++)
+        buf[i] = (ofs + i) % 251;
+      if (write (pipes[0][1], buf, n) != n)
+        {
+          printf ("pipeline: write failed\n");
+          return EXIT_FAILURE;
+        }
+      ofs += n;
+    }
+  close (pipes[0][1]);
+
+  for (i = 0; i <= stages; i++)
+    if (wait (pids[i]) != EXIT_SUCCESS)
+      ok = false;
+  us = now_us () - start;
+  if (!ok)
+    {
+      printf ("pipeline: data did not come through intact\n");
+      return EXIT_FAILURE;
+    }
+
+  printf ("pipeline: %d stages, %'ld bytes: %'lld us, %'lld bytes/s\n",
+          stages, size, (long long) us,
+          (long long) size * 1000000 / (us + 1));
+  return EXIT_SUCCESS;
+}
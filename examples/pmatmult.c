@@ -0,0 +1,139 @@
+/* pmatmult.c
+
+   Multiplies two DIM x DIM matrices, like matmult, with the rows
+   of the result divided among N workers.  The workers are
+   processes made by fork(), or with -t, threads of one process.
+   Prints the time taken and the multiply-adds per second, and
+   exits with a checksum of the result, which is the same for
+   any N.
+
+   Usage: pmatmult [-t] [N]
+
+   Forked workers each get a copy-on-write copy of the matrices
+   and write only their own rows of the result, so they exercise
+   fork() and the VM system as well as the scheduler.  Threads
+   share one copy. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Matrix size; see matmult.c for the memory each takes. */
+#define DIM 128
+
+/* Most workers allowed. */
+#define MAX_WORKERS 16
+
+int A[DIM][DIM];
+int B[DIM][DIM];
+int C[DIM][DIM];
+
+/* Rows of C that a worker computes. */
+struct rows
+  {
+    int first, last;            /* First row, one past the last. */
+    int sum;                    /* Their sum, once a thread is done. */
+  };
+
+/* Returns the time since boot in microseconds. */
+static int64_t
+now_us (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Computes the rows R of C and returns their sum. */
+static int
+multiply (const struct rows *r)
+{
+  int sum = 0;
+  int i, j, k;
+
+  for (i = r->first; i < r->last; i++)
+    for (j = 0; j < DIM; j++)
+      {
+        for (k = 0; k < DIM; k++)
+          C[i][j] += A[i][k] * B[k][j];
+        sum += C[i][j];
+      }
+  return sum;
+}
+
+/* Thread worker for the rows in R_. */
+static void
+multiply_thread (void *r_)
+{
+  struct rows *r = r_;
+
+  r->sum = multiply (r);
+}
+
+int
+main (int argc, char *argv[])
+{
+  struct rows rows[MAX_WORKERS];
+  pid_t ids[MAX_WORKERS];
+  bool threads = false;
+  int workers = 4;
+  int64_t start, us;
+  int sum = 0;
+  int i, j;
+
+  if (argc > 1 && !strcmp (argv[1], "-t"))
+    {
+      threads = true;
+      argv++;
+      argc--;
+    }
+  if (argc > 1)
+    workers = atoi (argv[1]);
+  if (workers < 1 || workers > MAX_WORKERS)
+    {
+      printf ("pmatmult: worker count must be 1 to %d\n", MAX_WORKERS);
+      return EXIT_FAILURE;
+    }
+
+  for (i = 0; i < DIM; i++)
+    for (j = 0; j < DIM; j++)
+      {
+        A[i][j] = i;
+        B[i][j] = j;
+        C[i][j] = 0;
+      }
+
+  start = now_us ();
+  for (i = 0; i < workers; i++)
+    {
+      rows[i].first = DIM * i / workers;
+      rows[i].last = DIM * (i + 1) / workers;
+      if (threads)
+        ids[i] = thread_spawn (multiply_thread, &rows[i]);
+      else if ((ids[i] = fork ()) == 0)
+        exit (multiply (&rows[i]));
+      if (ids[i] == PID_ERROR)
+        {
+          printf ("pmatmult: starting worker %d failed\n", i);
+          return EXIT_FAILURE;
+        }
+    }
+  for (i = 0; i < workers; i++)
+    if (threads)
+      {
+        thread_join (ids[i]);
+        sum += rows[i].sum;
+      }
+    else
+      sum += wait (ids[i]);
+  us = now_us () - start;
+
+  if (us < 1)
+    us = 1;
+  printf ("pmatmult: %d %s, %dx%d: %'lld us, %'lld multiply-adds/s\n",
+          workers, threads ? "threads" : "processes", DIM, DIM,
+          (long long) us, (long long) DIM * DIM * DIM * 1000000 / us);
+  return sum;
+}
@@ -0,0 +1,236 @@
+/* psort.c
+
+   Sorts COUNT pseudo-random integers as an external sort, with
+   the work of the first pass divided among N processes.
+
+   The input is cut into runs of RUN integers.  Each worker makes
+   up its share of the runs, sorts each one in memory, and spills
+   it to a file of its own.  Then the parent merges all of the run
+   files into "psort.out", checking the order as it goes, and
+   removes them.  Each run is seeded by its number, so the output
+   is the same for any N.  Prints the time taken by each pass and
+   the integers sorted per second.
+
+   Usage: psort [N [COUNT]] */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+/* Integers per run, and most runs. */
+#define RUN 4096
+#define MAX_RUNS 64
+
+/* Most workers allowed. */
+#define MAX_WORKERS 16
+
+/* Integers buffered per run file while merging, and for the
+   output. */
+#define MERGE_BUF 256
+
+/* A run file being merged. */
+struct run
+  {
+    int fd;                     /* File descriptor. */
+    unsigned buf[MERGE_BUF];    /* Buffered integers. */
+    int pos, cnt;               /* Next in BUF, number in BUF. */
+  };
+
+static struct run runs[MAX_RUNS];
+
+/* Returns the time since boot in microseconds. */
+static int64_t
+now_us (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Stores the name of run file R in NAME. */
+static void
+run_name (char name[16], int r)
+{
+  snprintf (name, 16, "psort.%d", r);
+}
+
+/* Orders unsigned integers in ascending order. */
+static int
+compare_unsigned (const void *a_, const void *b_)
+{
+  const unsigned *a = a_;
+  const unsigned *b = b_;
+
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Makes up runs FIRST up to LAST of COUNT integers in all,
+   sorts each one, and writes it to its run file.  Exits with
+   status 0 if successful, 1 on failure. */
+static void
+sort_runs (int first, int last, int count)
+{
+  static unsigned buf[RUN];
+  int r;
+
+  for (r = first; r < last; r++)
+    {
+      int n = count - r * RUN < RUN ? count - r * RUN : RUN;
+      char name[16];
+      int fd, i;
+
+      random_init (r + 1);
+      for (i = 0; i < n; i++)
+        buf[i] = random_ulong ();
+      qsort (buf, n, sizeof *buf, compare_unsigned);
+
+      run_name (name, r);
+      remove (name);
+      if (!create (name, 0) || (fd = open (name)) < 0)
+        {
+          printf ("psort: creating %s failed\n", name);
+          exit (EXIT_FAILURE);
+        }
+      if (write (fd, buf, n * sizeof *buf) != (int) (n * sizeof *buf))
+        {
+          printf ("psort: writing %s failed\n", name);
+          exit (EXIT_FAILURE);
+        }
+      close (fd);
+    }
+  exit (EXIT_SUCCESS);
+}
+
+/* Refills R's buffer if it is empty.  Returns false if R has
+   nothing left. */
+static bool
+fill_run (struct run *r)
+{
+  if (r->pos < r->cnt)
+    return true;
+  r->cnt = read (r->fd, r->buf, sizeof r->buf);
+  r->cnt = r->cnt > 0 ? r->cnt / (int) sizeof *r->buf : 0;
+  r->pos = 0;
+  return r->cnt > 0;
+}
+
+/* Merges the RUN_CNT run files into "psort.out".  Returns the
+   number of integers merged, or -1 if they were out of order or
+   a file could not be opened or written. */
+static int
+merge_runs (int run_cnt)
+{
+  unsigned out[MERGE_BUF];
+  int out_cnt = 0, total = 0;
+  unsigned last = 0;
+  int out_fd, i;
+
+  remove ("psort.out");
+  if (!create ("psort.out", 0) || (out_fd = open ("psort.out")) < 0)
+    return -1;
+  for (i = 0; i < run_cnt; i++)
+    {
+      char name[16];
+
+      run_name (name, i);
+      runs[i].fd = open (name);
+      runs[i].pos = runs[i].cnt = 0;
+      if (runs[i].fd < 0)
+        return -1;
+    }
+
+  for (;;)
+    {
+      struct run *min = NULL;
+
+      for (i = 0; i < run_cnt; i++)
+        if (fill_run (&runs[i])
+            && (min == NULL
+                || runs[i].buf[runs[i].pos] < min->buf[min->pos]))
+          min = &runs[i];
+      if (min == NULL)
+        break;
+
+      if (min->buf[min->pos] < last)
+        return -1;
+      last = out[out_cnt++] = min->buf[min->pos++];
+      total++;
+      if (out_cnt == MERGE_BUF)
+        {
+          if (write (out_fd, out, sizeof out) != sizeof out)
+            return -1;
+          out_cnt = 0;
+        }
+    }
+  if (write (out_fd, out, out_cnt * sizeof *out)
+      != (int) (out_cnt * sizeof *out))
+    return -1;
+  close (out_fd);
+
+  for (i = 0; i < run_cnt; i++)
+    {
+      char name[16];
+
+      close (runs[i].fd);
+      run_name (name, i);
+      remove (name);
+    }
+  return total;
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t pids[MAX_WORKERS];
+  int workers = argc > 1 ? atoi (argv[1]) : 4;
+  int count = argc > 2 ? atoi (argv[2]) : 16 * RUN;
+  int run_cnt = (count + RUN - 1) / RUN;
+  int64_t start, sort_us, merge_us;
+  bool ok = true;
+  int merged, i;
+
+  if (workers < 1 || workers > MAX_WORKERS
+      || count < 1 || run_cnt > MAX_RUNS)
+    {
+      printf ("psort: need 1 to %d workers and 1 to %d integers\n",
+              MAX_WORKERS, MAX_RUNS * RUN);
+      return EXIT_FAILURE;
+    }
+
+  start = now_us ();
+  for (i = 0; i < workers; i++)
+    {
+      pids[i] = fork ();
+      if (pids[i] == 0)
+        sort_runs (run_cnt * i / workers, run_cnt * (i + 1) / workers,
+                   count);
+      if (pids[i] == PID_ERROR)
+        {
+          printf ("psort: starting worker %d failed\n", i);
+          return EXIT_FAILURE;
+        }
+    }
+  for (i = 0; i < workers; i++)
+    if (wait (pids[i]) != EXIT_SUCCESS)
+      ok = false;
+  sort_us = now_us () - start;
+  if (!ok)
+    return EXIT_FAILURE;
+
+  start = now_us ();
+  merged = merge_runs (run_cnt);
+  merge_us = now_us () - start;
+  if (merged != count)
+    {
+      printf ("psort: merge failed\n");
+      return EXIT_FAILURE;
+    }
+
+  printf ("psort: %d processes, %'d integers in %d runs: "
+          "sort %'lld us, merge %'lld us, %'lld integers/s\n",
+          workers, count, run_cnt, (long long) sort_us, (long long) merge_us,
+          (long long) count * 1000000 / (sort_us + merge_us + 1));
+  return EXIT_SUCCESS;
+}
@@ -3,8 +3,12 @@
 #include <string.h>
 #include <syscall.h>
 
+/* Most programs in one pipeline. */
+#define PIPELINE_MAX 8
+
 static void read_line (char line[], size_t);
 static bool backspace (char **pos, char line[]);
+static int run_pipeline (char *command);
 
 int
 main (void)
@@ -30,6 +34,8 @@ main (void)
         {
           /* Empty command. */
         }
+      else if (strchr (command, '|') != NULL)
+        printf ("pipeline: exit code %d\n", run_pipeline (command));
       else
         {
           pid_t pid = exec (command);
@@ -44,6 +50,80 @@ main (void)
   return EXIT_SUCCESS;
 }
 
+/* Runs the programs of COMMAND, separated by "|", each with its
+   standard output connected through a pipe to the next one's
+   standard input, and waits for all of them.  Returns the exit
+   code of the last one, or -1 if any could not be started.
+
+   Each program inherits the pipes that the shell has open when it
+   starts, so the shell points its own fds 0 and 1 at the
+   program's ends, and closes them again, which gives them back to
+   the console, before it prints anything else. */
+static int
+run_pipeline (char *command)
+{
+  char *stages[PIPELINE_MAX];
+  pid_t pids[PIPELINE_MAX];
+  int stage_cnt = 0, started, status = -1;
+  int in = STDIN_FILENO;
+  char *stage, *save_ptr;
+
+  for (stage = strtok_r (command, "|", &save_ptr); stage != NULL;
+       stage = strtok_r (NULL, "|", &save_ptr))
+    {
+      if (stage_cnt == PIPELINE_MAX)
+        {
+          printf ("pipeline: more than %d programs\n", PIPELINE_MAX);
+          return -1;
+        }
+      stages[stage_cnt++] = stage;
+    }
+
+  for (started = 0; started < stage_cnt; started++)
+    {
+      int fds[2] = { STDIN_FILENO, STDOUT_FILENO };
+      bool last = started == stage_cnt - 1;
+
+      if (!last && pipe (fds) < 0)
+        {
+          printf ("pipeline: pipe failed\n");
+          break;
+        }
+
+      fflush (stdout);
+      if (in != STDIN_FILENO)
+        {
+          dup2 (in, STDIN_FILENO);
+          close (in);
+        }
+      if (!last)
+        {
+          dup2 (fds[1], STDOUT_FILENO);
+          close (fds[1]);
+        }
+      pids[started] = spawn (stages[started]);
+      close (STDIN_FILENO);
+      close (STDOUT_FILENO);
+      in = fds[0];
+
+      if (pids[started] == PID_ERROR)
+        {
+          printf ("\"%s\": exec failed\n", stages[started]);
+          break;
+        }
+    }
+  if (in != STDIN_FILENO)
+    close (in);
+
+  while (started-- > 0)
+    {
+      int code = wait (pids[started]);
+      if (started == stage_cnt - 1)
+        status = code;
+    }
+  return status;
+}
+
 /* Reads a line of input from the user into LINE, which has room
    for SIZE bytes.  Handles backspace and Ctrl+U in the ways
    expected by Unix users.  On return, LINE will always be
@@ -0,0 +1,157 @@
+/* smallfiles.c
+
+   Has N processes at once each create FILES files of SIZE bytes
+   in a directory of their own, then read them all back and check
+   them, then remove them.  All the workers finish each phase
+   before the next one starts.  Prints the files per second for
+   each phase.
+
+   Usage: smallfiles [N [FILES [SIZE]]]
+
+   Needs subdirectories, so it works only in project 4. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Most workers and largest file allowed. */
+#define MAX_WORKERS 16
+#define MAX_SIZE 4096
+
+/* Phases run by each worker. */
+enum phase
+  {
+    WRITE,                      /* Create and write the files. */
+    READ,                       /* Read them back and check them. */
+    REMOVE,                     /* Remove them and the directory. */
+    PHASE_CNT
+  };
+
+static const char *phase_names[PHASE_CNT] = {"write", "read", "remove"};
+
+/* Returns the time since boot in microseconds. */
+static int64_t
+now_us (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Fills the SIZE bytes of BUF with the contents of file F of worker
+   W. */
+static void
+fill (char *buf, int size, int w, int f)
+{
+  int i;
+
+  for (i = 0; i < size; i++)
+    buf[i] = w * 31 + f * 7 + i;
+}
+
+/* Runs PHASE for worker W's FILES files of SIZE bytes.  Exits
+   with status 0 if successful, 1 on failure. */
+static void
+run_phase (enum phase phase, int w, int files, int size)
+{
+  static char buf[MAX_SIZE], expected[MAX_SIZE];
+  char dir[16], name[32];
+  int f, fd;
+
+  snprintf (dir, sizeof dir, "sf.%d", w);
+  if (phase == WRITE && !mkdir (dir))
+    {
+      printf ("smallfiles: mkdir %s failed\n", dir);
+      exit (EXIT_FAILURE);
+    }
+  for (f = 0; f < files; f++)
+    {
+      bool ok;
+
+      snprintf (name, sizeof name, "%s/%d", dir, f);
+      fill (expected, size, w, f);
+      fd = -1;
+      switch (phase)
+        {
+        case WRITE:
+          ok = create (name, 0) && (fd = open (name)) >= 0;
+          ok = ok && write (fd, expected, size) == size;
+          close (fd);
+          break;
+
+        case READ:
+          ok = (fd = open (name)) >= 0;
+          ok = (ok && read (fd, buf, size) == size
+                && !memcmp (buf, expected, size));
+          close (fd);
+          break;
+
+        default:
+          ok = remove (name);
+          break;
+        }
+      if (!ok)
+        {
+          printf ("smallfiles: %s of %s failed\n", phase_names[phase], name);
+          exit (EXIT_FAILURE);
+        }
+    }
+  if (phase == REMOVE && !remove (dir))
+    {
+      printf ("smallfiles: remove %s failed\n", dir);
+      exit (EXIT_FAILURE);
+    }
+  exit (EXIT_SUCCESS);
+}
+
+int
+main (int argc, char *argv[])
+{
+  pid_t pids[MAX_WORKERS];
+  int workers = argc > 1 ? atoi (argv[1]) : 4;
+  int files = argc > 2 ? atoi (argv[2]) : 64;
+  int size = argc > 3 ? atoi (argv[3]) : 512;
+  enum phase phase;
+  int i;
+
+  if (workers < 1 || workers > MAX_WORKERS || files < 1
+      || size < 1 || size > MAX_SIZE)
+    {
+      printf ("smallfiles: need 1 to %d workers, 1 or more files, "
+              "and 1 to %d bytes each\n", MAX_WORKERS, MAX_SIZE);
+      return EXIT_FAILURE;
+    }
+
+  printf ("smallfiles: %d processes, %d files of %d bytes each:",
+          workers, files, size);
+  for (phase = 0; phase < PHASE_CNT; phase++)
+    {
+      int64_t start = now_us (), us;
+      bool ok = true;
+
+      for (i = 0; i < workers; i++)
+        {
+          pids[i] = fork ();
+          if (pids[i] == 0)
+            run_phase (phase, i, files, size);
+          if (pids[i] == PID_ERROR)
+            {
+              printf ("\nsmallfiles: starting worker %d failed\n", i);
+              return EXIT_FAILURE;
+            }
+        }
+      for (i = 0; i < workers; i++)
+        if (wait (pids[i]) != EXIT_SUCCESS)
+          ok = false;
+      if (!ok)
+        return EXIT_FAILURE;
+
+      us = now_us () - start;
+      printf (" %s %'lld files/s", phase_names[phase],
+              (long long) workers * files * 1000000 / (us + 1));
+    }
+  printf ("\n");
+  return EXIT_SUCCESS;
+}
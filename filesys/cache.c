@@ -0,0 +1,772 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/checksum.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Buffer cache.
+
+   All file system I/O goes through a cache of CACHE_CNT sectors
+   of FS_DEVICE.  Writes only dirty the cached copy, which goes
+   to disk when its entry is reused for another sector, when the
+   flusher thread wakes up every FLUSH_TICKS, when fsync() asks
+   for a file's sectors, or when cache_flush() is called at
+   shutdown.  A flush writes its sectors in ascending order, and
+   each run of adjacent dirty sectors with a single request, so
+   that they reach the disk together instead of one at a time in
+   whatever order the entries are in.
+   Entries are replaced by the clock algorithm, which gives each
+   entry used since the hand last passed a second chance.
+
+   CACHE_LOCK protects which sector each entry holds and the
+   clock hand, and is never held during I/O.  Each entry has its
+   own lock, held while its data is read, written back or copied,
+   so a slow transfer on one entry does not hold up others.  The
+   sector an entry gave up stays in FLUSHING until it is back on
+   disk, so that nobody reads the stale copy from disk meanwhile.
+
+   Sequential readers also queue the sectors they will want next
+   with cache_read_ahead(), and a kernel thread reads them in,
+   submitting a batch of them to the disk at once so that the
+   disk's queue can sort and merge them.
+   Read-ahead only takes entries that are free, or clean and not
+   used since the clock hand passed, and leaves its entries
+   unused, so it never pushes out anything hotter than itself and
+   its sectors are the first to go if nobody reads them.  When
+   the queue is full or no such entry is left, requests are
+   dropped, since a reader must never wait for read-ahead.
+
+   A large read that will not be repeated soon, such as loading a
+   program, may bypass the cache with cache_read_direct(), which
+   reads the sectors not cached straight into the caller's
+   buffers instead of pushing out the cache's whole contents.
+   cache_write_direct() likewise writes them straight from the
+   caller's buffers, and a reader that is done with some sectors
+   can give their entries up first with cache_drop().
+
+   A sector written by cache_write_logged() belongs to the running
+   journal transaction, so its entry is marked logged and is not
+   flushed until the journal commits it.  If such an entry is
+   reused, the sector goes to its slot in the log instead of its
+   own place, and is read back from there. */
+
+/* Number of sectors cached. */
+#define CACHE_CNT 64
+
+/* Identifies no sector. */
+#define SECTOR_NONE ((block_sector_t) -1)
+
+/* A cached sector. */
+struct cache_entry
+  {
+    struct lock lock;           /* Held while in use or doing I/O. */
+    block_sector_t sector;      /* Sector held, or SECTOR_NONE. */
+    block_sector_t flushing;    /* Old sector being written back. */
+    bool dirty;                 /* Modified since read in? */
+    bool logged;                /* In the running transaction? */
+    bool accessed;              /* Used since the clock hand passed? */
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes. */
+  };
+
+static struct cache_entry cache[CACHE_CNT];
+static struct lock cache_lock;
+static size_t hand;
+
+/* Timer ticks between write-behind flushes. */
+#define FLUSH_TICKS (5 * TIMER_FREQ)
+
+/* Sectors waiting for the read-ahead thread, a ring protected by
+   RA_LOCK, and signaled by RA_QUEUED. */
+#define RA_QUEUE 64
+#define RA_BATCH 16             /* Most sectors read in at once. */
+static block_sector_t ra_queue[RA_QUEUE];
+static size_t ra_head, ra_cnt;
+static struct lock ra_lock;
+static struct condition ra_queued;
+
+/* Statistics. */
+static unsigned long long hits, misses, write_backs;
+static unsigned long long read_aheads, ra_dropped, direct_reads;
+static unsigned long long direct_writes, drops;
+
+static struct cache_entry *lock_entry (block_sector_t, bool read);
+static struct cache_entry *find_entry (block_sector_t);
+static struct cache_entry *next_victim (void);
+static struct cache_entry *cold_entry (void);
+static void read_sector (struct cache_entry *, block_sector_t, bool read);
+static block_sector_t source_sector (struct cache_entry *, block_sector_t);
+static bool is_pinned (struct cache_entry *);
+static void invalidate (block_sector_t);
+static thread_func read_ahead_thread;
+static thread_func flush_thread;
+
+/* Initializes the buffer cache. */
+void
+cache_init (void)
+{
+  size_t per_page = PGSIZE / BLOCK_SECTOR_SIZE;
+  uint8_t *data = palloc_get_multiple_tagged (PAL_ASSERT,
+                                              CACHE_CNT / per_page,
+                                              MEM_FILESYS);
+  size_t i;
+
+  for (i = 0; i < CACHE_CNT; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      lock_init (&e->lock);
+      e->sector = e->flushing = SECTOR_NONE;
+      e->dirty = e->accessed = e->logged = false;
+      e->data = data + i * BLOCK_SECTOR_SIZE;
+    }
+  lock_init (&cache_lock);
+  lock_init (&ra_lock);
+  cond_init (&ra_queued);
+  thread_create ("readahead", PRI_DEFAULT, read_ahead_thread, NULL);
+  thread_create_sized ("flusher", PRI_DEFAULT, THREAD_STACK_LARGE,
+                       flush_thread, NULL);
+}
+
+/* Reads SIZE bytes starting at offset OFS within SECTOR of
+   FS_DEVICE into BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = lock_entry (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&e->lock);
+}
+
+/* Reads the CNT adjacent sectors starting at START into
+   BUFFERS[0] through BUFFERS[CNT - 1] without caching them, for a
+   large read whose data will not be wanted again soon.  A sector
+   that is cached, being written back or in the running journal
+   transaction is copied as by cache_read(), and each run of the
+   others is read straight from disk with a single request. */
+void
+cache_read_direct (block_sector_t start, void *const buffers[], size_t cnt)
+{
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      block_sector_t slot;
+      size_t run = 0;
+      size_t j;
+
+      lock_acquire (&cache_lock);
+      while (i + run < cnt && find_entry (start + i + run) == NULL)
+        run++;
+      lock_release (&cache_lock);
+      for (j = 0; j < run; j++)
+        if (journal_locate (start + i + j, &slot))
+          run = j;
+
+      if (run > 0)
+        {
+          block_read_multi (fs_device, start + i, buffers + i, run);
+          for (j = 0; j < run; j++)
+            checksum_verify (start + i + j, buffers[i + j]);
+          direct_reads += run;
+          i += run;
+        }
+      else
+        {
+          cache_read (start + i, buffers[i], 0, BLOCK_SECTOR_SIZE);
+          i++;
+        }
+    }
+}
+
+/* Writes BUFFERS[0] through BUFFERS[CNT - 1] to the CNT adjacent
+   sectors starting at START without caching them, for a large
+   write whose data will not be wanted again soon.  A sector that
+   is cached, being written back or in the running journal
+   transaction is written as by cache_write(), and each run of
+   the others straight to disk with a single request.  The caller
+   must keep anyone else from writing these sectors meanwhile;
+   read-ahead may still read one in while it goes to disk, so
+   such a copy is thrown away afterward. */
+void
+cache_write_direct (block_sector_t start, const void *const buffers[],
+                    size_t cnt)
+{
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      block_sector_t slot;
+      size_t run = 0;
+      size_t j;
+
+      lock_acquire (&cache_lock);
+      while (i + run < cnt && find_entry (start + i + run) == NULL)
+        run++;
+      lock_release (&cache_lock);
+      for (j = 0; j < run; j++)
+        if (journal_locate (start + i + j, &slot))
+          run = j;
+
+      if (run > 0)
+        {
+          block_write_multi (fs_device, start + i, buffers + i, run);
+          for (j = 0; j < run; j++)
+            {
+              checksum_update (start + i + j, buffers[i + j]);
+              invalidate (start + i + j);
+            }
+          direct_writes += run;
+          i += run;
+        }
+      else
+        {
+          cache_write (start + i, buffers[i], 0, BLOCK_SECTOR_SIZE);
+          i++;
+        }
+    }
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR of
+   FS_DEVICE.  The sector is only read in first if the write
+   does not cover all of it. */
+void
+cache_write (block_sector_t sector, const void *buffer, size_t ofs,
+             size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = lock_entry (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  lock_release (&e->lock);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR of
+   FS_DEVICE, like cache_write(), as part of the current thread's
+   journal transaction.  SECTOR then stays in the cache or the log
+   until the transaction commits. */
+void
+cache_write_logged (block_sector_t sector, const void *buffer, size_t ofs,
+                    size_t size)
+{
+  struct cache_entry *e;
+  block_sector_t slot;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = lock_entry (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  if (journal_add (sector, &slot))
+    e->logged = true;
+  lock_release (&e->lock);
+}
+
+/* Writes SECTOR, which is in the journal transaction being
+   committed, to log sector SLOT, unless it is not cached, in
+   which case it was written there when its entry was reused. */
+void
+cache_log (block_sector_t sector, block_sector_t slot)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = find_entry (sector);
+  lock_release (&cache_lock);
+  if (e == NULL)
+    return;
+
+  lock_acquire (&e->lock);
+  if (e->sector == sector && e->logged)
+    block_write (fs_device, slot, e->data);
+  lock_release (&e->lock);
+}
+
+/* Writes SECTOR, which is in the journal transaction just
+   committed, to its own place, if need be reading it back from
+   the log first, and lets it be flushed as usual again. */
+void
+cache_checkpoint (block_sector_t sector)
+{
+  struct cache_entry *e = lock_entry (sector, true);
+
+  if (e->dirty)
+    {
+      block_write (fs_device, sector, e->data);
+      checksum_update (sector, e->data);
+      e->dirty = false;
+      write_backs++;
+    }
+  e->logged = false;
+  lock_release (&e->lock);
+}
+
+/* Asks for SECTOR of FS_DEVICE to be read into the cache in the
+   background.  Returns without waiting, and drops the request if
+   too many are already waiting. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&ra_lock);
+  if (ra_cnt < RA_QUEUE)
+    {
+      ra_queue[(ra_head + ra_cnt++) % RA_QUEUE] = sector;
+      cond_signal (&ra_queued, &ra_lock);
+    }
+  else
+    ra_dropped++;
+  lock_release (&ra_lock);
+}
+
+/* Tells the cache that SECTOR will not be wanted again soon, so
+   that its entry is the first to be reused: at once if it is
+   clean, or else once it is written back.  Does nothing if
+   SECTOR is not cached or its entry is busy. */
+void
+cache_drop (block_sector_t sector)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = find_entry (sector);
+  if (e != NULL && e->sector == sector && lock_try_acquire (&e->lock))
+    {
+      e->accessed = false;
+      if (!e->dirty)
+        e->sector = SECTOR_NONE;
+      drops++;
+      lock_release (&e->lock);
+    }
+  lock_release (&cache_lock);
+}
+
+/* A dirty sector found by cache_flush_range(). */
+struct dirty_sector
+  {
+    block_sector_t sector;      /* Sector to write back. */
+    struct cache_entry *e;      /* Entry that held it. */
+  };
+
+/* Orders dirty sectors by ascending sector number. */
+static int
+compare_sectors (const void *a_, const void *b_)
+{
+  const struct dirty_sector *a = a_;
+  const struct dirty_sector *b = b_;
+
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Writes every dirty sector in the cache to disk. */
+void
+cache_flush (void)
+{
+  cache_flush_range (0, SECTOR_NONE);
+}
+
+/* Writes the dirty cached sectors among the CNT sectors starting
+   at START to disk, in ascending order, a run of adjacent
+   sectors at a time. */
+void
+cache_flush_range (block_sector_t start, block_sector_t cnt)
+{
+  struct dirty_sector dirty[CACHE_CNT];
+  struct cache_entry *run[CACHE_CNT];
+  const void *buffers[CACHE_CNT];
+  size_t dirty_cnt = 0;
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_CNT; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      if (e->dirty && e->sector - start < cnt)
+        {
+          dirty[dirty_cnt].sector = e->sector;
+          dirty[dirty_cnt].e = e;
+          dirty_cnt++;
+        }
+    }
+  lock_release (&cache_lock);
+  qsort (dirty, dirty_cnt, sizeof *dirty, compare_sectors);
+
+  i = 0;
+  while (i < dirty_cnt)
+    {
+      size_t run_cnt = 0;
+      size_t j;
+
+      /* Lock the entries of a run.  Entries are locked in
+         ascending sector order, so concurrent flushes cannot
+         deadlock, and nothing else waits for one entry while
+         holding another.  An entry may have been written back or
+         given to another sector since we looked, which ends the
+         run. */
+      for (; i < dirty_cnt; i++)
+        {
+          struct cache_entry *e = dirty[i].e;
+
+          if (run_cnt > 0 && dirty[i].sector != dirty[i - 1].sector + 1)
+            break;
+          lock_acquire (&e->lock);
+          if (e->dirty && e->sector == dirty[i].sector && !is_pinned (e))
+            {
+              run[run_cnt] = e;
+              buffers[run_cnt++] = e->data;
+            }
+          else
+            {
+              lock_release (&e->lock);
+              if (run_cnt > 0)
+                {
+                  i++;
+                  break;
+                }
+            }
+        }
+      if (run_cnt == 0)
+        continue;
+
+      block_write_multi (fs_device, run[0]->sector, buffers, run_cnt);
+      for (j = 0; j < run_cnt; j++)
+        {
+          checksum_update (run[j]->sector, run[j]->data);
+          run[j]->dirty = false;
+          write_backs++;
+          lock_release (&run[j]->lock);
+        }
+    }
+  checksum_flush ();
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Cache: %llu hits, %llu misses, %llu write-backs, "
+          "%llu sectors read ahead, %llu dropped, %llu read directly, "
+          "%llu written directly, %llu given up\n",
+          hits, misses, write_backs, read_aheads, ra_dropped, direct_reads,
+          direct_writes, drops);
+}
+
+/* Returns the entry that holds SECTOR, locked, first reading
+   SECTOR in from disk if READ is true and it is not cached.  If
+   READ is false, an entry newly given to SECTOR holds garbage
+   that the caller must overwrite entirely. */
+static struct cache_entry *
+lock_entry (block_sector_t sector, bool read)
+{
+  ASSERT (sector != SECTOR_NONE);
+
+  for (;;)
+    {
+      struct cache_entry *e;
+      block_sector_t old, slot;
+      bool dirty, logged;
+
+      lock_acquire (&cache_lock);
+      e = find_entry (sector);
+      if (e != NULL)
+        {
+          bool hit = e->sector == sector;
+
+          if (hit)
+            hits++;
+          lock_release (&cache_lock);
+
+          /* Wait for the entry's holder.  If the entry was only
+             writing SECTOR back, or has been given to another
+             sector meanwhile, start over. */
+          lock_acquire (&e->lock);
+          if (hit && e->sector == sector)
+            {
+              e->accessed = true;
+              return e;
+            }
+          lock_release (&e->lock);
+          continue;
+        }
+
+      e = next_victim ();
+      if (e == NULL)
+        {
+          /* Every entry is in use. */
+          lock_release (&cache_lock);
+          thread_yield ();
+          continue;
+        }
+      old = e->sector;
+      dirty = e->dirty;
+      logged = e->logged;
+      e->sector = sector;
+      e->flushing = dirty ? old : SECTOR_NONE;
+      e->dirty = e->logged = false;
+      misses++;
+      lock_release (&cache_lock);
+
+      /* A logged sector goes to the log, not its own place. */
+      if (dirty)
+        {
+          if (logged && journal_locate (old, &slot))
+            block_write (fs_device, slot, e->data);
+          else
+            {
+              block_write (fs_device, old, e->data);
+              checksum_update (old, e->data);
+            }
+          write_backs++;
+          e->flushing = SECTOR_NONE;
+        }
+      read_sector (e, sector, read);
+      e->accessed = true;
+      return e;
+    }
+}
+
+/* Gives entry E, newly taken for SECTOR, SECTOR's data, if READ
+   is true: from its slot in the log if it is in the running
+   journal transaction, or from its own place.  A logged sector
+   keeps its entry logged, whether or not it is read. */
+static void
+read_sector (struct cache_entry *e, block_sector_t sector, bool read)
+{
+  block_sector_t source = source_sector (e, sector);
+
+  if (read)
+    {
+      block_read (fs_device, source, e->data);
+      if (source == sector)
+        checksum_verify (sector, e->data);
+    }
+}
+
+/* Marks entry E, newly taken for SECTOR, as read_sector() does,
+   and returns the sector to read SECTOR's data from. */
+static block_sector_t
+source_sector (struct cache_entry *e, block_sector_t sector)
+{
+  block_sector_t slot;
+  bool logged = journal_locate (sector, &slot);
+
+  e->dirty = e->logged = logged;
+  return logged ? slot : sector;
+}
+
+/* Returns true if entry E holds a sector of the running journal
+   transaction, which must not be written back to its own place.
+   An entry read in from the log while its commit was finishing
+   may still be marked logged afterward, so this asks the
+   journal.  The caller must hold E's lock. */
+static bool
+is_pinned (struct cache_entry *e)
+{
+  block_sector_t slot;
+
+  if (e->logged && !journal_locate (e->sector, &slot))
+    e->logged = false;
+  return e->logged;
+}
+
+/* Throws away the cached copy of SECTOR, which is clean, if
+   there is one, waiting for its entry if it is busy. */
+static void
+invalidate (block_sector_t sector)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = find_entry (sector);
+  lock_release (&cache_lock);
+  if (e == NULL)
+    return;
+
+  lock_acquire (&e->lock);
+  lock_acquire (&cache_lock);
+  if (e->sector == sector && !e->dirty)
+    {
+      e->sector = SECTOR_NONE;
+      e->accessed = false;
+    }
+  lock_release (&cache_lock);
+  lock_release (&e->lock);
+}
+
+/* Returns the entry that holds SECTOR, or that is still writing
+   it back, or a null pointer if there is none.  The caller must
+   hold CACHE_LOCK. */
+static struct cache_entry *
+find_entry (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_CNT; i++)
+    if (cache[i].sector == sector || cache[i].flushing == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Advances the clock hand to the next entry that is not in use
+   and has not been used since the hand last passed, clearing the
+   accessed flags it passes, and returns it locked.  Returns a
+   null pointer if two full sweeps find none, meaning every entry
+   is in use.  The caller must hold CACHE_LOCK. */
+static struct cache_entry *
+next_victim (void)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * CACHE_CNT; i++)
+    {
+      struct cache_entry *e = &cache[hand];
+      hand = (hand + 1) % CACHE_CNT;
+
+      if (!lock_try_acquire (&e->lock))
+        continue;
+      if (!e->accessed)
+        return e;
+      e->accessed = false;
+      lock_release (&e->lock);
+    }
+  return NULL;
+}
+
+/* Returns an entry that read-ahead may take, locked: one that is
+   free, or clean and not used since the clock hand last passed.
+   Neither moves the clock hand nor clears accessed flags.
+   Returns a null pointer if there is none.  The caller must hold
+   CACHE_LOCK. */
+static struct cache_entry *
+cold_entry (void)
+{
+  struct cache_entry *cold = NULL;
+  size_t i;
+
+  for (i = 0; i < CACHE_CNT; i++)
+    {
+      struct cache_entry *e = &cache[(hand + i) % CACHE_CNT];
+
+      if (e->accessed || e->dirty || lock_held_by_current_thread (&e->lock)
+          || !lock_try_acquire (&e->lock))
+        continue;
+      if (e->sector == SECTOR_NONE)
+        {
+          if (cold != NULL)
+            lock_release (&cold->lock);
+          return e;
+        }
+      if (cold == NULL)
+        cold = e;
+      else
+        lock_release (&e->lock);
+    }
+  return cold;
+}
+
+/* Completion function for read-ahead requests. */
+static void
+read_ahead_done (struct bio *bio)
+{
+  sema_up (bio->aux);
+}
+
+/* Read-ahead thread.  Reads in the queued sectors that are not
+   cached yet, as far as cold entries allow, up to RA_BATCH at a
+   time.  It submits all the sectors of a batch before waiting
+   for any of them, holding their entries' locks until they are
+   in. */
+static void
+read_ahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sectors[RA_BATCH];
+      struct cache_entry *entries[RA_BATCH];
+      void *buffers[RA_BATCH];
+      struct bio bios[RA_BATCH];
+      struct semaphore done;
+      size_t sector_cnt, cnt, i;
+
+      lock_acquire (&ra_lock);
+      while (ra_cnt == 0)
+        cond_wait (&ra_queued, &ra_lock);
+      for (sector_cnt = 0; sector_cnt < RA_BATCH && ra_cnt > 0; sector_cnt++)
+        {
+          sectors[sector_cnt] = ra_queue[ra_head];
+          ra_head = (ra_head + 1) % RA_QUEUE;
+          ra_cnt--;
+        }
+      lock_release (&ra_lock);
+
+      cnt = 0;
+      for (i = 0; i < sector_cnt; i++)
+        {
+          struct cache_entry *e;
+
+          lock_acquire (&cache_lock);
+          if (find_entry (sectors[i]) != NULL || (e = cold_entry ()) == NULL)
+            {
+              lock_release (&cache_lock);
+              continue;
+            }
+          e->sector = sectors[i];
+          read_aheads++;
+          lock_release (&cache_lock);
+          entries[cnt++] = e;
+        }
+
+      sema_init (&done, 0);
+      for (i = 0; i < cnt; i++)
+        {
+          struct bio *bio = &bios[i];
+
+          buffers[i] = entries[i]->data;
+          bio->sector = source_sector (entries[i], entries[i]->sector);
+          bio->cnt = 1;
+          bio->buffers = &buffers[i];
+          bio->write = false;
+          bio->flags = 0;
+          bio->done = read_ahead_done;
+          bio->aux = &done;
+          block_submit (fs_device, bio);
+        }
+      for (i = 0; i < cnt; i++)
+        sema_down (&done);
+
+      for (i = 0; i < cnt; i++)
+        {
+          if (!entries[i]->logged)
+            checksum_verify (entries[i]->sector, entries[i]->data);
+          entries[i]->accessed = false;
+          lock_release (&entries[i]->lock);
+        }
+    }
+}
+
+/* Write-behind thread.  Writes the dirty sectors back every
+   FLUSH_TICKS. */
+static void
+flush_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_TICKS);
+      cache_flush ();
+    }
+}
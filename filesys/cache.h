@@ -0,0 +1,24 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+void cache_init (void);
+void cache_read (block_sector_t, void *, size_t ofs, size_t size);
+void cache_read_direct (block_sector_t start, void *const buffers[],
+                        size_t cnt);
+void cache_write (block_sector_t, const void *, size_t ofs, size_t size);
+void cache_write_direct (block_sector_t start, const void *const buffers[],
+                         size_t cnt);
+void cache_write_logged (block_sector_t, const void *, size_t ofs,
+                         size_t size);
+void cache_log (block_sector_t, block_sector_t slot);
+void cache_checkpoint (block_sector_t);
+void cache_read_ahead (block_sector_t);
+void cache_drop (block_sector_t);
+void cache_flush (void);
+void cache_flush_range (block_sector_t start, block_sector_t cnt);
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,236 @@
+#include "filesys/checksum.h"
+#include <bitmap.h>
+#include <crc32c.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Block checksums.
+
+   A file system formatted with -checksums keeps a CRC-32C of
+   every sector of its metadata and data in a table that follows
+   the journal on disk, one 32-bit checksum per sector, and all
+   of it in memory while mounted.  The buffer cache computes a
+   sector's checksum when it writes the sector back to its own
+   place, and checks it when it reads the sector in, so the cost
+   falls on write-back and on cache misses, both of which wait
+   for the disk anyway, never on a read or write that hits.  A
+   mismatch is reported and counted; the data is still used,
+   since the callers have no way to handle an error.
+
+   A checksum of 0 means that the sector's contents are unknown,
+   as for a sector never written back since formatting, or
+   released since, whose old contents may still be read in
+   before they are overwritten.  Such a sector is not checked.
+   A sector whose checksum is really 0 is stored as 1 instead.
+
+   Changed parts of the table go to disk after the data, when
+   the cache is flushed.  After a crash, a sector written back
+   since the last flush may therefore be reported as corrupt
+   once.  The journal's own sectors and the table are written
+   outside the cache and have no checksums. */
+
+/* Identifies a checksum header. */
+#define CHECKSUM_MAGIC 0x4353554d
+
+/* Checksums per sector of the table. */
+#define SUMS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (uint32_t))
+
+/* On-disk checksum header, in CHECKSUM_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct checksum_header
+  {
+    uint32_t magic;                     /* CHECKSUM_MAGIC. */
+    uint32_t table_cnt;                 /* Table sectors, or 0 if none. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 8]; /* Not used. */
+  };
+
+bool checksum_format;
+
+static uint32_t *sums;          /* Checksum of each sector, or 0. */
+static size_t table_cnt;        /* Sectors in the table; 0 if off. */
+static struct bitmap *dirty;    /* Table sectors changed since flushed. */
+static struct lock checksum_lock; /* Protects SUMS and DIRTY. */
+static struct lock flush_lock;  /* Held while flushing. */
+
+/* Statistics. */
+static unsigned long long computed, verified, mismatches;
+
+/* Returns the checksum to store for the BLOCK_SECTOR_SIZE bytes
+   of DATA. */
+static uint32_t
+sector_sum (const void *data)
+{
+  uint32_t sum = crc32c (0, data, BLOCK_SECTOR_SIZE);
+  return sum != 0 ? sum : 1;
+}
+
+/* Returns true if SECTOR has a checksum in the table. */
+static bool
+has_sum (block_sector_t sector)
+{
+  return (table_cnt > 0
+          && sector >= CHECKSUM_SECTOR + checksum_sectors ()
+          && sector < block_size (fs_device));
+}
+
+/* Initializes checksums.  If FORMAT is true, writes an empty
+   table, or none unless checksum_format; otherwise reads in the
+   table of the file system, if it has one.  Must be called
+   before anything reads the file system through the cache or
+   the journal writes to it. */
+void
+checksum_init (bool format)
+{
+  static struct checksum_header header;
+  size_t pages, i;
+
+  ASSERT (sizeof header == BLOCK_SECTOR_SIZE);
+
+  lock_init (&checksum_lock);
+  lock_init (&flush_lock);
+  table_cnt = DIV_ROUND_UP (block_size (fs_device), SUMS_PER_SECTOR);
+  if (format)
+    {
+      memset (&header, 0, sizeof header);
+      header.magic = CHECKSUM_MAGIC;
+      header.table_cnt = checksum_format ? table_cnt : 0;
+      block_write (fs_device, CHECKSUM_SECTOR, &header);
+    }
+  else
+    block_read (fs_device, CHECKSUM_SECTOR, &header);
+  if (header.magic != CHECKSUM_MAGIC || header.table_cnt != table_cnt)
+    {
+      table_cnt = 0;
+      return;
+    }
+
+  pages = DIV_ROUND_UP (table_cnt * BLOCK_SECTOR_SIZE, PGSIZE);
+  sums = palloc_get_multiple_tagged (PAL_ZERO, pages, MEM_FILESYS);
+  dirty = bitmap_create (table_cnt);
+  if (sums == NULL || dirty == NULL)
+    PANIC ("Not enough memory for the checksum table.");
+  for (i = 0; i < table_cnt; i++)
+    if (format)
+      block_write (fs_device, CHECKSUM_SECTOR + 1 + i,
+                   sums + i * SUMS_PER_SECTOR);
+    else
+      block_read (fs_device, CHECKSUM_SECTOR + 1 + i,
+                  sums + i * SUMS_PER_SECTOR);
+}
+
+/* Returns the number of sectors, starting at CHECKSUM_SECTOR,
+   that the checksum header and table take. */
+size_t
+checksum_sectors (void)
+{
+  return 1 + table_cnt;
+}
+
+/* Records the checksum of DATA, the BLOCK_SECTOR_SIZE bytes just
+   written to SECTOR. */
+void
+checksum_update (block_sector_t sector, const void *data)
+{
+  uint32_t sum;
+
+  if (!has_sum (sector))
+    return;
+
+  sum = sector_sum (data);
+  lock_acquire (&checksum_lock);
+  computed++;
+  if (sums[sector] != sum)
+    {
+      sums[sector] = sum;
+      bitmap_mark (dirty, sector / SUMS_PER_SECTOR);
+    }
+  lock_release (&checksum_lock);
+}
+
+/* Checks DATA, the BLOCK_SECTOR_SIZE bytes just read from
+   SECTOR, against SECTOR's checksum, and reports a mismatch. */
+void
+checksum_verify (block_sector_t sector, const void *data)
+{
+  uint32_t expected, sum;
+
+  if (!has_sum (sector))
+    return;
+
+  lock_acquire (&checksum_lock);
+  expected = sums[sector];
+  lock_release (&checksum_lock);
+  if (expected == 0)
+    return;
+
+  sum = sector_sum (data);
+  lock_acquire (&checksum_lock);
+  verified++;
+  if (sum != expected)
+    mismatches++;
+  lock_release (&checksum_lock);
+  if (sum != expected)
+    printf ("checksum: sector %"PRDSNu" is corrupt: checksum %08"PRIx32
+            ", expected %08"PRIx32"\n", sector, sum, expected);
+}
+
+/* Forgets the checksums of the CNT sectors starting at SECTOR,
+   which have been released, so that reading their old contents
+   is not reported. */
+void
+checksum_forget (block_sector_t sector, size_t cnt)
+{
+  if (table_cnt == 0)
+    return;
+
+  lock_acquire (&checksum_lock);
+  for (; cnt > 0; sector++, cnt--)
+    if (has_sum (sector) && sums[sector] != 0)
+      {
+        sums[sector] = 0;
+        bitmap_mark (dirty, sector / SUMS_PER_SECTOR);
+      }
+  lock_release (&checksum_lock);
+}
+
+/* Writes the parts of the checksum table that changed to
+   disk. */
+void
+checksum_flush (void)
+{
+  static uint32_t buffer[SUMS_PER_SECTOR];
+  size_t i = 0;
+
+  if (table_cnt == 0)
+    return;
+
+  lock_acquire (&flush_lock);
+  for (;;)
+    {
+      lock_acquire (&checksum_lock);
+      i = bitmap_scan_and_flip (dirty, i, 1, true);
+      if (i != BITMAP_ERROR)
+        memcpy (buffer, sums + i * SUMS_PER_SECTOR, sizeof buffer);
+      lock_release (&checksum_lock);
+      if (i == BITMAP_ERROR)
+        break;
+      block_write (fs_device, CHECKSUM_SECTOR + 1 + i, buffer);
+    }
+  lock_release (&flush_lock);
+}
+
+/* Prints checksum statistics. */
+void
+checksum_print_stats (void)
+{
+  printf ("Checksum: %llu computed, %llu verified, %llu mismatches, "
+          "using %s\n",
+          computed, verified, mismatches,
+          crc32c_hw () ? "the crc32 instruction" : "slice-by-8 tables");
+}
@@ -0,0 +1,26 @@
+#ifndef FILESYS_CHECKSUM_H
+#define FILESYS_CHECKSUM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+
+/* First sector of the checksum table, right after the journal:
+   a header, and in a file system that has checksums, the table
+   itself. */
+#define CHECKSUM_SECTOR (JOURNAL_SECTOR + JOURNAL_SECTORS)
+
+/* -checksums: Give a newly formatted file system checksums? */
+extern bool checksum_format;
+
+void checksum_init (bool format);
+size_t checksum_sectors (void);
+void checksum_update (block_sector_t, const void *);
+void checksum_verify (block_sector_t, const void *);
+void checksum_forget (block_sector_t, size_t cnt);
+void checksum_flush (void);
+void checksum_print_stats (void);
+
+#endif /* filesys/checksum.h */
@@ -0,0 +1,215 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Directory entry cache.
+
+   Maps a directory's inode sector and a name in it to the inode
+   sector the name refers to, or to DCACHE_NONE if the directory
+   was searched for the name and it was not there, so that
+   resolving a path does not search every directory along it
+   again each time.  The directory code keeps the cache in step
+   with the disk: it fills in what lookups find while holding
+   the directory shared, and updates the entries for names it
+   adds or removes while holding it exclusive.
+
+   At most DCACHE_MAX entries are kept, dropping the least
+   recently used one to make room.  Names longer than
+   DCACHE_NAME_MAX, which are rare, are not cached, so that
+   every entry need not have room for the longest name. */
+#define DCACHE_MAX 512
+#define DCACHE_NAME_MAX 30
+
+/* A cached directory entry. */
+struct dentry
+  {
+    struct hash_elem elem;              /* Element in dentries. */
+    struct list_elem lru_elem;          /* Element in lru. */
+    block_sector_t dir;                 /* Directory inode sector. */
+    char name[DCACHE_NAME_MAX + 1];     /* Name in DIR. */
+    block_sector_t sector;              /* NAME's inode, or DCACHE_NONE. */
+  };
+
+static struct hash dentries;            /* All cached entries. */
+static struct list lru;                 /* Least recently used first. */
+static size_t dentry_cnt;               /* Number of cached entries. */
+static struct lock dcache_lock;         /* Protects all of the above. */
+static struct kmem_cache *dentry_cache; /* Allocates struct dentry. */
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+static struct dentry *find_dentry (block_sector_t dir, const char *name);
+
+/* Drops entries when the kernel pool runs low. */
+static shrink_func dcache_shrink;
+static struct shrinker dcache_shrinker;
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  if (!hash_init_size (&dentries, DCACHE_MAX, dentry_hash, dentry_less, NULL))
+    PANIC ("Not enough memory for the directory entry cache.");
+  list_init (&lru);
+  lock_init (&dcache_lock);
+  dentry_cache = kmem_cache_create ("dentry", sizeof (struct dentry), NULL);
+  palloc_register_shrinker (&dcache_shrinker, "dentries", dcache_shrink,
+                            SHRINK_CACHE);
+}
+
+/* Drops the least recently used entries, a slab's worth for each
+   of the PAGE_CNT pages wanted, and returns the number of
+   dentry slabs that leaves empty to the page allocator.  Entries
+   are only hints, so dropping any of them is safe. */
+static size_t
+dcache_shrink (size_t page_cnt)
+{
+  size_t drop = page_cnt * (PGSIZE / sizeof (struct dentry));
+
+  if (lock_held_by_current_thread (&dcache_lock)
+      || !lock_try_acquire (&dcache_lock))
+    return 0;
+  for (; drop > 0 && !list_empty (&lru); drop--)
+    {
+      struct dentry *d = list_entry (list_pop_front (&lru),
+                                     struct dentry, lru_elem);
+      hash_delete (&dentries, &d->elem);
+      kmem_cache_free (dentry_cache, d);
+      dentry_cnt--;
+    }
+  lock_release (&dcache_lock);
+  return kmem_cache_shrink (dentry_cache);
+}
+
+/* Returns a hash value for dentry E. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, elem);
+
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Returns the cached entry for NAME in DIR, or a null pointer if
+   there is none.  The caller must hold DCACHE_LOCK. */
+static struct dentry *
+find_dentry (block_sector_t dir, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.elem);
+  return e != NULL ? hash_entry (e, struct dentry, elem) : NULL;
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   If the cache knows, returns true and sets *SECTORP to the
+   sector of NAME's inode, or to DCACHE_NONE if DIR has no file
+   named NAME.  Returns false if the directory must be searched. */
+bool
+dcache_lookup (block_sector_t dir, const char *name, block_sector_t *sectorp)
+{
+  struct dentry *d;
+
+  if (strlen (name) > DCACHE_NAME_MAX)
+    return false;
+
+  lock_acquire (&dcache_lock);
+  d = find_dentry (dir, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_back (&lru, &d->lru_elem);
+      *sectorp = d->sector;
+    }
+  lock_release (&dcache_lock);
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   DIR refers to the inode in SECTOR, or to no file if SECTOR is
+   DCACHE_NONE.  The caller must hold DIR's inode, shared if this
+   is what a search found, exclusive if it is a change. */
+void
+dcache_insert (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (strlen (name) > DCACHE_NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find_dentry (dir, name);
+  if (d != NULL)
+    list_remove (&d->lru_elem);
+  else
+    {
+      if (dentry_cnt >= DCACHE_MAX)
+        {
+          d = list_entry (list_pop_front (&lru), struct dentry, lru_elem);
+          hash_delete (&dentries, &d->elem);
+        }
+      else
+        {
+          d = kmem_cache_alloc (dentry_cache);
+          if (d == NULL)
+            {
+              lock_release (&dcache_lock);
+              return;
+            }
+          dentry_cnt++;
+        }
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentries, &d->elem);
+    }
+  d->sector = sector;
+  list_push_back (&lru, &d->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Drops every entry for a name in the directory whose inode is
+   in sector DIR, which is being removed, so that none is found
+   if the sector is used for another directory. */
+void
+dcache_purge (block_sector_t dir)
+{
+  struct list_elem *e;
+
+  lock_acquire (&dcache_lock);
+  for (e = list_begin (&lru); e != list_end (&lru); )
+    {
+      struct dentry *d = list_entry (e, struct dentry, lru_elem);
+
+      e = list_next (e);
+      if (d->dir == dir)
+        {
+          list_remove (&d->lru_elem);
+          hash_delete (&dentries, &d->elem);
+          kmem_cache_free (dentry_cache, d);
+          dentry_cnt--;
+        }
+    }
+  lock_release (&dcache_lock);
+}
@@ -1,9 +1,17 @@
 #include "filesys/directory.h"
+#include <stddef.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <round.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 
 /* A directory. */
@@ -13,20 +21,138 @@ struct dir
     off_t pos;                          /* Current position. */
   };
 
-/* A single directory entry. */
+/* A directory entry on disk.
+
+   Entries vary in length.  Each is followed by its NAME_LEN
+   bytes of name, not null terminated, and padding to a multiple
+   of 4 bytes, then by any free space up to the next entry, to
+   which REC_LEN covers the distance.  Entries are packed into
+   blocks, as in the Berkeley fast file system, and never cross
+   from one block into the next: a block is a chain of entries
+   whose REC_LENs add up to its size.  Removing an entry gives its
+   space to the one before it in its block, or, for the first one
+   in a block, marks it free by setting NAME_LEN to 0.  Adding one
+   takes a free entry or the free space after one in use that is
+   big enough. */
 struct dir_entry 
   {
     block_sector_t inode_sector;        /* Sector number of header. */
-    char name[NAME_MAX + 1];            /* Null terminated file name. */
-    bool in_use;                        /* In use or free? */
+    uint16_t rec_len;                   /* Bytes to the next entry. */
+    uint8_t name_len;                   /* Name length, 0 if free. */
+    uint8_t pad;                        /* Unused. */
+    char name[];                        /* Name, NAME_LEN bytes. */
+  };
+
+/* Directory formats.
+
+   A small directory is a plain sequence of sectors, each a block
+   of entries, searched from the start.  Once it has LINEAR_MAX
+   sectors and needs room for one more entry, it is rewritten in
+   the hashed format: a dir_header in the first sector, followed
+   by BUCKET_CNT buckets of one sector each, each holding a block
+   of entries and an overflow flag.  A name goes in the bucket
+   its hash selects, or if that is full in the next bucket with
+   room, marking each full bucket it passes as overflowed, so
+   that a lookup reads one bucket and only goes on while the
+   buckets it reads have overflowed.  When more than 3/4 of the
+   buckets' space is in use, their number is doubled and every
+   entry is inserted again.
+
+   A hashed directory is told apart by DIR_MAGIC in the first
+   word, where a linear directory has the inode sector of its
+   first entry, ".", which is always much smaller. */
+#define LINEAR_MAX 2
+#define DIR_MAGIC 0x48534844
+#define BUCKET_MIN 4
+#define BUCKET_BYTES (BLOCK_SECTOR_SIZE - sizeof (uint32_t))
+
+/* First sector of a hashed directory. */
+struct dir_header
+  {
+    uint32_t magic;                     /* DIR_MAGIC. */
+    uint32_t bucket_cnt;                /* Number of buckets. */
+    uint32_t entry_cnt;                 /* Entries in use. */
+    uint32_t bytes_used;                /* Bucket bytes they take. */
+  };
+
+/* A bucket of a hashed directory.
+   Must be no bigger than BLOCK_SECTOR_SIZE bytes. */
+struct dir_bucket
+  {
+    uint8_t entries[BUCKET_BYTES];      /* Block of entries. */
+    uint32_t overflow;                  /* Has an insert passed it? */
   };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+static bool read_header (const struct dir *, struct dir_header *);
+static bool read_block (const struct dir *, off_t ofs, void *, size_t size);
+static struct dir_entry *block_entry (void *block, size_t size, size_t rec);
+static struct dir_entry *block_find (void *block, size_t size,
+                                     const char *name, size_t len);
+static bool block_insert (void *block, size_t size, const char *name,
+                          size_t len, block_sector_t inode_sector);
+static bool block_remove (void *block, size_t size, const char *name,
+                          size_t len);
+static void block_init (void *block, size_t size);
+static bool hashed_insert (struct dir *, struct dir_header *,
+                           const char *name, size_t len,
+                           block_sector_t inode_sector);
+static bool rehash (struct dir *, size_t bucket_cnt);
+static bool is_empty (const struct dir *);
+static void stat_ahead (const struct dir *, void *block, size_t size,
+                        off_t block_ofs);
+
+/* Returns the number of bytes that an entry for a name of
+   NAME_LEN bytes takes. */
+static inline size_t
+entry_size (size_t name_len)
+{
+  return ROUND_UP (sizeof (struct dir_entry) + name_len, 4);
+}
+
+/* Returns the byte offset of bucket BUCKET. */
+static inline off_t
+bucket_ofs (size_t bucket)
+{
+  return (bucket + 1) * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns true if entry E is in use and is "." or "..". */
+static inline bool
+is_dot (const struct dir_entry *e)
+{
+  return ((e->name_len == 1 && e->name[0] == '.')
+          || (e->name_len == 2 && e->name[0] == '.' && e->name[1] == '.'));
+}
+
+/* Creates a directory with space for ENTRY_CNT entries with
+   names of up to 8 bytes in the given SECTOR, whose parent
+   directory is in sector PARENT.  Its first entries are "." for
+   itself and ".." for PARENT, which dir_readdir() does not
+   return.  Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, size_t entry_cnt, block_sector_t parent)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  size_t sector_cnt = DIV_ROUND_UP (entry_size (1) + entry_size (2)
+                                    + entry_cnt * entry_size (8),
+                                    BLOCK_SECTOR_SIZE);
+  uint8_t block[BLOCK_SECTOR_SIZE];
+  struct dir *dir;
+  bool success;
+  size_t i;
+
+  if (!inode_create (sector, 0, true))
+    return false;
+  dir = dir_open (inode_open (sector));
+  success = dir != NULL;
+  block_init (block, sizeof block);
+  for (i = 0; i < sector_cnt && success; i++)
+    success = (inode_write_at (dir->inode, block, sizeof block,
+                               i * BLOCK_SECTOR_SIZE) == sizeof block);
+  success = (success
+             && dir_add (dir, ".", sector)
+             && dir_add (dir, "..", parent));
+  dir_close (dir);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -76,6 +202,25 @@ dir_close (struct dir *dir)
     }
 }
 
+/* Sets the next entry dir_readdir() reads from DIR to the one at
+   byte offset POS, as returned by dir_tell(). */
+void
+dir_seek (struct dir *dir, off_t pos)
+{
+  ASSERT (dir != NULL);
+  ASSERT (pos >= 0);
+  dir->pos = pos;
+}
+
+/* Returns the offset of the next entry dir_readdir() reads from
+   DIR. */
+off_t
+dir_tell (struct dir *dir)
+{
+  ASSERT (dir != NULL);
+  return dir->pos;
+}
+
 /* Returns the inode encapsulated by DIR. */
 struct inode *
 dir_get_inode (struct dir *dir) 
@@ -84,50 +229,366 @@ dir_get_inode (struct dir *dir)
 }
 
 /* Searches DIR for a file with the given NAME.
-   If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   If successful, returns true, sets *SECTORP to the sector of
+   its inode if SECTORP is non-null, and sets *OFSP to the byte
+   offset of the block that holds its entry if OFSP is non-null.
+   otherwise, returns false and ignores SECTORP and OFSP. */
 static bool
 lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+        block_sector_t *sectorp, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  struct dir_header h;
+  uint8_t block[BLOCK_SECTOR_SIZE];
+  size_t len;
+  struct dir_entry *e;
+  off_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
+  len = strlen (name);
+  if (read_header (dir, &h))
+    {
+      size_t bucket = hash_bytes (name, len) % h.bucket_cnt;
+      struct dir_bucket *b = (struct dir_bucket *) block;
+      size_t probes;
+
+      for (probes = 0; probes < h.bucket_cnt; probes++)
+        {
+          ofs = bucket_ofs (bucket);
+          if (!read_block (dir, ofs, b, sizeof *b))
+            break;
+          e = block_find (b->entries, BUCKET_BYTES, name, len);
+          if (e != NULL)
+            goto found;
+          if (!b->overflow)
+            break;
+          bucket = (bucket + 1) % h.bucket_cnt;
+        }
+      return false;
+    }
+
+  for (ofs = 0; read_block (dir, ofs, block, sizeof block);
+       ofs += sizeof block)
+    {
+      e = block_find (block, sizeof block, name, len);
+      if (e != NULL)
+        goto found;
+    }
+  return false;
+
+ found:
+  if (sectorp != NULL)
+    *sectorp = e->inode_sector;
+  if (ofsp != NULL)
+    *ofsp = ofs;
+  return true;
+}
+
+/* Reads the header of DIR into *H.  Returns true if DIR is in
+   the hashed format, false if it is linear. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h)
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_MAGIC);
+}
+
+/* Reads SIZE bytes of DIR, starting at byte offset OFS, into
+   BLOCK, with a single read.  Returns true if successful, false
+   if DIR is too short to hold them.
+
+   inode_read_at() will only return a short read at end of file.
+   Otherwise, we'd need to verify that we didn't get a short
+   read due to something intermittent such as low memory. */
+static bool
+read_block (const struct dir *dir, off_t ofs, void *block, size_t size)
+{
+  return inode_read_at (dir->inode, block, size, ofs) == (off_t) size;
+}
+
+/* Returns the entry that starts REC bytes into BLOCK, which is
+   SIZE bytes long, or a null pointer if REC is the end of BLOCK
+   or the entry there runs past it. */
+static struct dir_entry *
+block_entry (void *block, size_t size, size_t rec)
+{
+  struct dir_entry *e = (struct dir_entry *) ((uint8_t *) block + rec);
+
+  if (rec + sizeof *e > size
+      || e->rec_len < entry_size (e->name_len)
+      || rec + e->rec_len > size)
+    return NULL;
+  return e;
+}
+
+/* Returns the entry in BLOCK, which is SIZE bytes long, for
+   NAME, which is LEN bytes long, or a null pointer if there is
+   none. */
+static struct dir_entry *
+block_find (void *block, size_t size, const char *name, size_t len)
+{
+  struct dir_entry *e;
+  size_t rec;
+
+  for (rec = 0; (e = block_entry (block, size, rec)) != NULL;
+       rec += e->rec_len)
+    if (e->name_len != 0 && e->name_len == len
+        && !memcmp (e->name, name, len))
+      return e;
+  return NULL;
+}
+
+/* Adds an entry for NAME, which is LEN bytes long, with the
+   given INODE_SECTOR to BLOCK, which is SIZE bytes long, in the
+   first free space big enough for it.  Returns true if
+   successful, false if BLOCK has no such space. */
+static bool
+block_insert (void *block, size_t size, const char *name, size_t len,
+              block_sector_t inode_sector)
+{
+  size_t need = entry_size (len);
+  struct dir_entry *e;
+  size_t rec;
+
+  for (rec = 0; (e = block_entry (block, size, rec)) != NULL;
+       rec += e->rec_len)
+    {
+      size_t used = e->name_len != 0 ? entry_size (e->name_len) : 0;
+
+      if (e->rec_len - used >= need)
+        {
+          /* Split the free space off an entry in use. */
+          if (used != 0)
+            {
+              struct dir_entry *next;
+
+              next = (struct dir_entry *) ((uint8_t *) e + used);
+              next->rec_len = e->rec_len - used;
+              e->rec_len = used;
+              e = next;
+            }
+          e->inode_sector = inode_sector;
+          e->name_len = len;
+          e->pad = 0;
+          memcpy (e->name, name, len);
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Removes the entry for NAME, which is LEN bytes long, from
+   BLOCK, which is SIZE bytes long, giving its space to the entry
+   before it.  Returns true if successful, false if BLOCK has no
+   entry for NAME. */
+static bool
+block_remove (void *block, size_t size, const char *name, size_t len)
+{
+  struct dir_entry *e, *prev = NULL;
+  size_t rec;
+
+  for (rec = 0; (e = block_entry (block, size, rec)) != NULL;
+       prev = e, rec += e->rec_len)
+    if (e->name_len != 0 && e->name_len == len
+        && !memcmp (e->name, name, len))
       {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
+        if (prev != NULL)
+          prev->rec_len += e->rec_len;
+        else
+          {
+            e->inode_sector = 0;
+            e->name_len = 0;
+          }
         return true;
       }
   return false;
 }
 
+/* Initializes BLOCK, which is SIZE bytes long, as a block with
+   no entries in use. */
+static void
+block_init (void *block, size_t size)
+{
+  struct dir_entry *e = block;
+
+  memset (block, 0, size);
+  e->rec_len = size;
+}
+
+/* Inserts an entry for NAME, which is LEN bytes long, with the
+   given INODE_SECTOR into hashed directory DIR, whose header is
+   *H, and writes back the header.  Returns true if successful,
+   false if every bucket is full or a disk error occurs. */
+static bool
+hashed_insert (struct dir *dir, struct dir_header *h,
+               const char *name, size_t len, block_sector_t inode_sector)
+{
+  size_t bucket = hash_bytes (name, len) % h->bucket_cnt;
+  size_t probes;
+
+  for (probes = 0; probes < h->bucket_cnt; probes++)
+    {
+      off_t ofs = bucket_ofs (bucket);
+      struct dir_bucket b;
+
+      if (!read_block (dir, ofs, &b, sizeof b))
+        return false;
+      if (block_insert (b.entries, BUCKET_BYTES, name, len, inode_sector))
+        {
+          if (inode_write_at (dir->inode, b.entries, BUCKET_BYTES, ofs)
+              != BUCKET_BYTES)
+            return false;
+          h->entry_cnt++;
+          h->bytes_used += entry_size (len);
+          return (inode_write_at (dir->inode, h, sizeof *h, 0)
+                  == sizeof *h);
+        }
+      if (!b.overflow)
+        {
+          b.overflow = 1;
+          if (inode_write_at (dir->inode, &b.overflow, sizeof b.overflow,
+                              ofs + offsetof (struct dir_bucket, overflow))
+              != sizeof b.overflow)
+            return false;
+        }
+      bucket = (bucket + 1) % h->bucket_cnt;
+    }
+  return false;
+}
+
+/* Rewrites DIR in the hashed format with BUCKET_CNT buckets,
+   inserting again every entry it holds, whichever format it is
+   in.  Returns true if successful, false if memory or disk
+   allocation fails, or if the journal has no room to make the
+   change atomic, in which case DIR is left unchanged. */
+static bool
+rehash (struct dir *dir, size_t bucket_cnt)
+{
+  struct dir_header h;
+  struct dir_bucket *b;
+  struct dir_entry *e;
+  uint8_t *entries;
+  size_t used = 0, size, rec, i;
+  bool hashed;
+  bool success = true;
+  off_t ofs;
+
+  /* Every bucket is written, along with the header, the inode,
+     an index block and the free map. */
+  if (!journal_room (bucket_cnt + 4))
+    return false;
+  hashed = read_header (dir, &h);
+  size = hashed ? BUCKET_BYTES : BLOCK_SECTOR_SIZE;
+
+  /* Gather the entries in use, reading a bucket or a sector at a
+     time and packing them tightly, which takes no more room than
+     the directory does. */
+  entries = malloc (inode_length (dir->inode));
+  b = malloc (sizeof *b);
+  if (entries == NULL || b == NULL)
+    {
+      free (entries);
+      free (b);
+      return false;
+    }
+  for (ofs = hashed ? bucket_ofs (0) : 0;
+       read_block (dir, ofs, b, sizeof *b); ofs += sizeof *b)
+    for (rec = 0; (e = block_entry (b, size, rec)) != NULL;
+         rec += e->rec_len)
+      if (e->name_len != 0)
+        {
+          struct dir_entry *copy = (struct dir_entry *) (entries + used);
+
+          memcpy (copy, e, entry_size (e->name_len));
+          copy->rec_len = entry_size (e->name_len);
+          used += copy->rec_len;
+        }
+
+  /* Grow the file to its new size first, so that running out of
+     space cannot leave it half rewritten. */
+  block_init (b->entries, BUCKET_BYTES);
+  b->overflow = 0;
+  if (inode_write_at (dir->inode, b, sizeof *b, bucket_ofs (bucket_cnt - 1))
+      != sizeof *b)
+    {
+      free (entries);
+      free (b);
+      return false;
+    }
+
+  /* Write empty buckets and the header, then insert. */
+  for (i = 0; i + 1 < bucket_cnt; i++)
+    inode_write_at (dir->inode, b, sizeof *b, bucket_ofs (i));
+  h.magic = DIR_MAGIC;
+  h.bucket_cnt = bucket_cnt;
+  h.entry_cnt = 0;
+  h.bytes_used = 0;
+  inode_write_at (dir->inode, &h, sizeof h, 0);
+  for (rec = 0; rec < used && success; rec += e->rec_len)
+    {
+      e = (struct dir_entry *) (entries + rec);
+      success = hashed_insert (dir, &h, e->name, e->name_len,
+                               e->inode_sector);
+    }
+  free (entries);
+  free (b);
+  return success;
+}
+
+/* Returns true if DIR has no entries besides "." and "..".  The
+   caller must hold DIR's inode. */
+static bool
+is_empty (const struct dir *dir)
+{
+  struct dir_header h;
+  uint8_t block[BLOCK_SECTOR_SIZE];
+  struct dir_entry *e;
+  size_t rec;
+  off_t ofs;
+
+  if (read_header (dir, &h))
+    return h.entry_cnt <= 2;
+
+  for (ofs = 0; read_block (dir, ofs, block, sizeof block);
+       ofs += sizeof block)
+    for (rec = 0; (e = block_entry (block, sizeof block, rec)) != NULL;
+         rec += e->rec_len)
+      if (e->name_len != 0 && !is_dot (e))
+        return false;
+  return true;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   DIR is only taken shared, so parallel lookups do not
+   serialize.  The result comes from the directory entry cache
+   if it is there, and is added to it if not, whether or not
+   NAME was found.  A removed directory contains nothing, not
+   even "." and "..". */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
+  block_sector_t dir_sector, sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  dir_sector = inode_get_inumber (dir->inode);
+  inode_lock (dir->inode, false);
+  if (inode_is_removed (dir->inode))
+    sector = DCACHE_NONE;
+  else if (!dcache_lookup (dir_sector, name, &sector))
+    {
+      if (!lookup (dir, name, &sector, NULL))
+        sector = DCACHE_NONE;
+      dcache_insert (dir_sector, name, sector);
+    }
+  *inode = sector != DCACHE_NONE ? inode_open (sector) : NULL;
+  inode_unlock (dir->inode, false);
 
   return *inode != NULL;
 }
@@ -136,12 +597,14 @@ dir_lookup (const struct dir *dir, const char *name,
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long), DIR has been
+   removed, or a disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
-  struct dir_entry e;
+  struct dir_header h;
+  uint8_t block[BLOCK_SECTOR_SIZE];
+  size_t len;
   off_t ofs;
   bool success = false;
 
@@ -149,88 +612,248 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   ASSERT (name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  len = strlen (name);
+  if (len == 0 || len > NAME_MAX)
     return false;
 
   /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  inode_lock (dir->inode, true);
+  if (inode_is_removed (dir->inode) || lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  /* Hashed directory, growing it first if it is getting full. */
+  if (read_header (dir, &h))
+    {
+      if (h.bytes_used + entry_size (len)
+          > h.bucket_cnt * BUCKET_BYTES * 3 / 4
+          && rehash (dir, h.bucket_cnt * 2))
+        read_header (dir, &h);
+      success = hashed_insert (dir, &h, name, len, inode_sector);
+      goto done;
+    }
+
+  /* Find a sector with room, or the end of the directory. */
+  for (ofs = 0; read_block (dir, ofs, block, sizeof block);
+       ofs += sizeof block)
+    if (block_insert (block, sizeof block, name, len, inode_sector))
+      goto write;
+
+  /* A linear directory that is full switches to the hashed
+     format instead of growing past LINEAR_MAX sectors. */
+  if (ofs >= LINEAR_MAX * BLOCK_SECTOR_SIZE
+      && rehash (dir, BUCKET_MIN) && read_header (dir, &h))
+    {
+      success = hashed_insert (dir, &h, name, len, inode_sector);
+      goto done;
+    }
+  block_init (block, sizeof block);
+  block_insert (block, sizeof block, name, len, inode_sector);
+
+ write:
+  success = (inode_write_at (dir->inode, block, sizeof block, ofs)
+             == sizeof block);
 
  done:
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+  inode_unlock (dir->inode, true);
   return success;
 }
 
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs if
+   there is no file with the given NAME, if NAME is "." or "..",
+   or if it is a directory that is not empty.
+   A directory being removed is also held exclusive, from before
+   it is checked to be empty until it is marked removed, so that
+   nothing is added to it or put in the cache for it meanwhile.
+   It may still be open, but then it stays empty. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
-  struct dir_entry e;
+  struct dir_header h;
+  uint8_t block[BLOCK_SECTOR_SIZE];
+  struct dir child;
   struct inode *inode = NULL;
+  block_sector_t sector;
+  bool is_dir = false;
   bool success = false;
+  bool hashed;
+  size_t len, size;
   off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (!strcmp (name, ".") || !strcmp (name, ".."))
+    return false;
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  inode_lock (dir->inode, true);
+  if (!lookup (dir, name, &sector, &ofs))
     goto done;
 
   /* Open inode. */
-  inode = inode_open (e.inode_sector);
+  inode = inode_open (sector);
   if (inode == NULL)
     goto done;
 
+  /* Only an empty directory may be removed. */
+  if (inode_is_dir (inode))
+    {
+      is_dir = true;
+      child.inode = inode;
+      inode_lock (inode, true);
+      if (!is_empty (&child))
+        goto done;
+    }
+
   /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  len = strlen (name);
+  hashed = read_header (dir, &h);
+  size = hashed ? BUCKET_BYTES : BLOCK_SECTOR_SIZE;
+  if (!read_block (dir, ofs, block, size)
+      || !block_remove (block, size, name, len)
+      || inode_write_at (dir->inode, block, size, ofs) != (off_t) size)
     goto done;
+  if (hashed)
+    {
+      h.entry_cnt--;
+      h.bytes_used -= entry_size (len);
+      inode_write_at (dir->inode, &h, sizeof h, 0);
+    }
 
   /* Remove inode. */
   inode_remove (inode);
+  dcache_insert (inode_get_inumber (dir->inode), name, DCACHE_NONE);
+  if (is_dir)
+    dcache_purge (sector);
   success = true;
 
  done:
+  if (is_dir)
+    inode_unlock (inode, true);
+  inode_unlock (dir->inode, true);
   inode_close (inode);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
-   NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   NAME, skipping "." and "..".  Returns true if successful,
+   false if the directory contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
-  struct dir_entry e;
+  struct dir_info info;
+
+  if (dir_readdir_many (dir, &info, 1) == 0)
+    return false;
+  strlcpy (name, info.name, NAME_MAX + 1);
+  return true;
+}
+
+/* Reads up to CNT of the next directory entries in DIR into
+   INFOS, skipping "." and "..", in one pass over the entries
+   with DIR held shared.  The length and type of each entry are
+   read while the entry cannot be removed, so callers need not
+   open each one to stat it.  Returns the number of entries read,
+   which is less than CNT only if the directory contains no more
+   entries.
+
+   The position is the offset of the next entry to look at.  An
+   entry may have been removed, and its space given to the one
+   before it, since the position was taken, so each block is
+   looked through from its start, for the first entry at or past
+   the position.  On reaching a block, the inodes of all of its
+   entries start being read ahead; see stat_ahead(). */
+size_t
+dir_readdir_many (struct dir *dir, struct dir_info *infos, size_t cnt)
+{
+  struct dir_header h;
+  uint8_t block[BLOCK_SECTOR_SIZE];
+  struct dir_entry *e;
+  size_t size = BLOCK_SECTOR_SIZE, rec;
+  size_t found = 0;
+  bool hashed;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  inode_lock (dir->inode, false);
+  hashed = read_header (dir, &h);
+  while (found < cnt)
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
+      off_t block_ofs;
+
+      /* In a hashed directory, skip the header and the end of
+         each bucket. */
+      if (hashed)
         {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
+          if (dir->pos < BLOCK_SECTOR_SIZE)
+            dir->pos = BLOCK_SECTOR_SIZE;
+          size = BUCKET_BYTES;
+        }
+      block_ofs = ROUND_DOWN (dir->pos, BLOCK_SECTOR_SIZE);
+      if (!read_block (dir, block_ofs, block, size))
+        break;
+      if (dir->pos == block_ofs)
+        stat_ahead (dir, block, size, block_ofs);
+      for (rec = 0;
+           found < cnt && (e = block_entry (block, size, rec)) != NULL;
+           rec += e->rec_len)
+        if (block_ofs + (off_t) rec >= dir->pos)
+          {
+            dir->pos = block_ofs + rec + e->rec_len;
+            if (e->name_len != 0 && !is_dot (e))
+              {
+                struct dir_info *info = &infos[found++];
+                struct inode *inode = inode_open (e->inode_sector);
+
+                info->inode_sector = e->inode_sector;
+                info->length = inode != NULL ? inode_length (inode) : 0;
+                info->is_dir = inode != NULL && inode_is_dir (inode);
+                memcpy (info->name, e->name, e->name_len);
+                info->name[e->name_len] = '\0';
+                inode_close (inode);
+              }
+          }
+      if (found < cnt)
+        dir->pos = block_ofs + BLOCK_SECTOR_SIZE;
     }
-  return false;
+  inode_unlock (dir->inode, false);
+  return found;
+}
+
+/* Orders sector numbers in ascending order. */
+static int
+compare_sectors (const void *a_, const void *b_)
+{
+  const block_sector_t *a = a_;
+  const block_sector_t *b = b_;
+
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Stat-ahead.  Called when an enumeration of DIR reaches BLOCK,
+   which is SIZE bytes read from BLOCK_OFS, before the first of
+   its entries is opened.  Every entry that follows is about to
+   be opened too, one synchronous inode read at a time, so ask for
+   all of their inodes to be read into the buffer cache in the
+   background, in ascending sector order for the elevator, along
+   with the next block of DIR.  The reads usually finish while
+   the entries before them are being opened. */
+static void
+stat_ahead (const struct dir *dir, void *block, size_t size,
+            off_t block_ofs)
+{
+  block_sector_t sectors[BLOCK_SECTOR_SIZE / sizeof (struct dir_entry)];
+  struct dir_entry *e;
+  size_t cnt = 0, rec, i;
+
+  inode_read_ahead (dir->inode, block_ofs + BLOCK_SECTOR_SIZE,
+                    BLOCK_SECTOR_SIZE);
+  for (rec = 0; (e = block_entry (block, size, rec)) != NULL;
+       rec += e->rec_len)
+    if (e->name_len != 0 && !is_dot (e))
+      sectors[cnt++] = e->inode_sector;
+  qsort (sectors, cnt, sizeof *sectors, compare_sectors);
+  for (i = 0; i < cnt; i++)
+    cache_read_ahead (sectors[i]);
 }
@@ -1,34 +1,71 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include <round.h>
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
 
-/* An open file. */
+/* An open file.
+
+   POS is only ever loaded or stored whole, as one aligned word,
+   so file_tell() and file_seek() need no lock and never wait for
+   the disk.  IO_LOCK only orders file_read() and file_write()
+   against each other, so that two of them on the same file do
+   not use the same position.
+
+   ADVICE and DIRECT are hints from the file's user, which change
+   how much of the buffer cache it takes, never what it reads. */
 struct file 
   {
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
+    struct lock io_lock;        /* Serializes reads and writes. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t ra_next;              /* Where a sequential read goes next. */
+    off_t ra_end;               /* End of what was read ahead. */
+    off_t ra_window;            /* Sectors to keep read ahead. */
+    enum file_advice advice;    /* How the file is read. */
+    bool direct;                /* Bypass the buffer cache? */
   };
 
+/* Read-ahead window, in sectors, when a sequential run starts
+   and at most. */
+#define RA_MIN 2
+#define RA_MAX 32
+
+static void drop_behind (struct file *, off_t pos, off_t size);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
+/* Cache of struct file. */
+static struct kmem_cache *file_cache;
+
+/* Initializes the file module. */
+void
+file_init (void) 
+{
+  file_cache = kmem_cache_create ("file", sizeof (struct file), NULL);
+}
+
 struct file *
 file_open (struct inode *inode) 
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file = kmem_cache_zalloc (file_cache);
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
       file->pos = 0;
+      lock_init (&file->io_lock);
       file->deny_write = false;
       return file;
     }
   else
     {
       inode_close (inode);
-      free (file);
+      kmem_cache_free (file_cache, file);
       return NULL; 
     }
 }
@@ -49,7 +86,7 @@ file_close (struct file *file)
     {
       file_allow_write (file);
       inode_close (file->inode);
-      free (file); 
+      kmem_cache_free (file_cache, file); 
     }
 }
 
@@ -60,6 +97,19 @@ file_get_inode (struct file *file)
   return file->inode;
 }
 
+/* If FILE is used sequentially, gives up the cache entries of the
+   sectors that the SIZE bytes just read or written at POS are
+   done with. */
+static void
+drop_behind (struct file *file, off_t pos, off_t size)
+{
+  if (file->advice == FILE_ADV_SEQUENTIAL && size > 0)
+    {
+      off_t start = ROUND_DOWN (pos, BLOCK_SECTOR_SIZE);
+      inode_drop_cache (file->inode, start, pos + size - start);
+    }
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
@@ -68,8 +118,51 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
-  file->pos += bytes_read;
+  off_t bytes_read, pos;
+
+  lock_acquire (&file->io_lock);
+  pos = file->pos;
+
+  /* A read that starts where the last one ended continues a
+     sequential run, which doubles the read-ahead window.  Any
+     other read starts over. */
+  if (pos != file->ra_next)
+    {
+      file->ra_window = 0;
+      file->ra_end = pos;
+    }
+  else if (file->ra_window == 0)
+    file->ra_window = RA_MIN;
+  else if (file->ra_window < RA_MAX)
+    file->ra_window *= 2;
+
+  /* A file read sequentially is read ahead all the way from the
+     start, and one read at random never is. */
+  if (file->advice == FILE_ADV_SEQUENTIAL)
+    file->ra_window = RA_MAX;
+  else if (file->advice == FILE_ADV_RANDOM)
+    file->ra_window = 0;
+
+  bytes_read = inode_read_at (file->inode, buffer, size, pos);
+  drop_behind (file, pos, bytes_read);
+  pos += bytes_read;
+  file->pos = pos;
+  file->ra_next = pos;
+
+  /* Ask for whatever part of the window is not asked for yet. */
+  if (file->ra_window > 0 && bytes_read > 0)
+    {
+      off_t end = pos + file->ra_window * BLOCK_SECTOR_SIZE;
+
+      if (file->ra_end < pos)
+        file->ra_end = pos;
+      if (end > file->ra_end)
+        {
+          inode_read_ahead (file->inode, file->ra_end, end - file->ra_end);
+          file->ra_end = end;
+        }
+    }
+  lock_release (&file->io_lock);
   return bytes_read;
 }
 
@@ -84,27 +177,44 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
   return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads SIZE bytes from FILE into PAGES, PGSIZE bytes into each,
+   starting at offset FILE_OFS in the file, which must be a
+   multiple of BLOCK_SECTOR_SIZE, as inode_read_pages() does.
+   Returns the number of bytes actually read,
+   which may be less than SIZE if end of file is reached.
+   The file's current position is unaffected. */
+off_t
+file_read_pages (struct file *file, void *const pages[], off_t size,
+                 off_t file_ofs)
+{
+  return inode_read_pages (file->inode, pages, size, file_ofs);
+}
+
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.
+   A write past end of file grows the file.
    Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
-  file->pos += bytes_written;
+  off_t bytes_written, pos;
+
+  lock_acquire (&file->io_lock);
+  pos = file->pos;
+  bytes_written = inode_write_at (file->inode, buffer, size, pos);
+  drop_behind (file, pos, bytes_written);
+  file->pos = pos + bytes_written;
+  lock_release (&file->io_lock);
   return bytes_written;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.
+   A write past end of file grows the file.
    The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
@@ -113,6 +223,194 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads SIZE bytes from FILE into BUFFER, starting at the file's
+   current position, as file_read() does, except that whole
+   sectors go straight from disk into BUFFER instead of through
+   the buffer cache, and nothing is read ahead.  BUFFER must be in
+   kernel memory that the disk can reach, contiguous in physical
+   memory.  If the position is not a multiple of
+   BLOCK_SECTOR_SIZE, reads through the cache instead. */
+off_t
+file_read_direct (struct file *file, void *buffer_, off_t size)
+{
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0, pos;
+
+  lock_acquire (&file->io_lock);
+  pos = file->pos;
+  if (pos % BLOCK_SECTOR_SIZE != 0)
+    bytes_read = inode_read_at (file->inode, buffer, size, pos);
+  else
+    while (bytes_read < size)
+      {
+        void *page = buffer + bytes_read;
+        off_t chunk = size - bytes_read < PGSIZE ? size - bytes_read : PGSIZE;
+        off_t chunk_read = inode_read_pages (file->inode, &page, chunk,
+                                             pos + bytes_read);
+
+        bytes_read += chunk_read;
+        if (chunk_read < chunk)
+          break;
+      }
+  file->pos = pos + bytes_read;
+  file->ra_next = -1;
+  lock_release (&file->io_lock);
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into FILE, starting at the file's
+   current position, as file_write() does, except that whole
+   sectors go straight from BUFFER to disk instead of through the
+   buffer cache.  BUFFER must be as for file_read_direct(). */
+off_t
+file_write_direct (struct file *file, const void *buffer, off_t size)
+{
+  off_t bytes_written, pos;
+
+  lock_acquire (&file->io_lock);
+  pos = file->pos;
+  bytes_written = inode_write_direct (file->inode, buffer, size, pos);
+  file->pos = pos + bytes_written;
+  lock_release (&file->io_lock);
+  return bytes_written;
+}
+
+/* Copies up to SIZE bytes from SRC, starting at its current
+   position, to DST, starting at its current position, and
+   advances both positions by the number of bytes copied.  The
+   data goes through one kernel page at a time, so it never
+   leaves the kernel.
+   Returns the number of bytes copied, which may be less than
+   SIZE if SRC ends first or the disk is full, or -1 if no
+   buffer page is available. */
+off_t
+file_copy (struct file *dst, struct file *src, off_t size)
+{
+  uint8_t *buffer;
+  off_t copied = 0;
+
+  ASSERT (size >= 0);
+
+  buffer = palloc_get_page_tagged (0, MEM_FILESYS);
+  if (buffer == NULL)
+    return -1;
+  while (copied < size)
+    {
+      off_t chunk = size - copied < PGSIZE ? size - copied : PGSIZE;
+      off_t bytes_read = file_read (src, buffer, chunk);
+      off_t bytes_written = file_write (dst, buffer, bytes_read);
+
+      copied += bytes_written;
+      if (bytes_written < chunk)
+        {
+          /* Give back what was read but not written. */
+          file_seek (src, file_tell (src) - (bytes_read - bytes_written));
+          break;
+        }
+    }
+  palloc_free_page (buffer);
+  return copied;
+}
+
+/* Writes FILE's data, as far as it is still only in the buffer
+   cache, to disk. */
+void
+file_sync (struct file *file)
+{
+  ASSERT (file != NULL);
+  inode_flush (file->inode);
+}
+
+/* Allocates the disk space for the SIZE bytes of FILE starting at
+   OFFSET, so that writing them later does not allocate, and
+   extends FILE to cover them.  Returns true if successful, false
+   if the disk is full or writes to FILE are denied. */
+bool
+file_allocate (struct file *file, off_t offset, off_t size)
+{
+  ASSERT (file != NULL);
+  return inode_allocate (file->inode, offset, size);
+}
+
+/* Sets the length of FILE to LENGTH bytes, dropping the data
+   past LENGTH or extending FILE with zeros.  The file position
+   does not change.  Returns true if successful, false otherwise. */
+bool
+file_truncate (struct file *file, off_t length)
+{
+  ASSERT (file != NULL);
+  return inode_truncate (file->inode, length);
+}
+
+/* Returns the number of extents of FILE, the runs of its data
+   that are adjacent on disk: 1 if it is not fragmented at all,
+   or 0 if it has no data on disk of its own. */
+size_t
+file_extents (struct file *file)
+{
+  ASSERT (file != NULL);
+  return inode_extents (file->inode);
+}
+
+/* Moves FILE's data on disk into as few extents as the free space
+   allows, while it stays readable.  Returns the number of
+   sectors moved. */
+size_t
+file_defrag (struct file *file)
+{
+  ASSERT (file != NULL);
+  return inode_defrag (file->inode);
+}
+
+/* Makes DST a copy of SRC that shares SRC's data on disk until
+   either is written, in a few journal transactions however big
+   SRC is.  The file positions do not change.  Returns true if
+   successful, false otherwise. */
+bool
+file_clone (struct file *dst, struct file *src)
+{
+  ASSERT (dst != NULL);
+  ASSERT (src != NULL);
+  return inode_clone (dst->inode, src->inode);
+}
+
+/* Tells the file system how FILE is going to be used, so that
+   it takes only as much of the buffer cache as that needs.
+   FILE_ADV_DONTNEED gives up the cache entries of FILE's data
+   now, without changing the advice in effect. */
+void
+file_advise (struct file *file, enum file_advice advice)
+{
+  ASSERT (file != NULL);
+  if (advice == FILE_ADV_DONTNEED)
+    inode_drop_cache (file->inode, 0, inode_length (file->inode));
+  else
+    {
+      lock_acquire (&file->io_lock);
+      file->advice = advice;
+      file->ra_window = 0;
+      lock_release (&file->io_lock);
+    }
+}
+
+/* Sets whether reads and writes of FILE through
+   file_read_direct() and file_write_direct() are wanted, which
+   is up to the caller to honor. */
+void
+file_set_direct (struct file *file, bool direct)
+{
+  ASSERT (file != NULL);
+  file->direct = direct;
+}
+
+/* Returns true if FILE is to be read and written directly. */
+bool
+file_is_direct (const struct file *file)
+{
+  ASSERT (file != NULL);
+  return file->direct;
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -1,10 +1,23 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 
 struct inode;
 
+/* How a file is going to be used, for file_advise(). */
+enum file_advice
+  {
+    FILE_ADV_NORMAL,            /* Read ahead once reads are sequential. */
+    FILE_ADV_SEQUENTIAL,        /* Read ahead all the way, drop behind. */
+    FILE_ADV_RANDOM,            /* Never read ahead. */
+    FILE_ADV_DONTNEED           /* Cached data will not be wanted soon. */
+  };
+
+void file_init (void);
+
 /* Opening and closing files. */
 struct file *file_open (struct inode *);
 struct file *file_reopen (struct file *);
@@ -14,8 +27,24 @@ struct inode *file_get_inode (struct file *);
 /* Reading and writing. */
 off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
+off_t file_read_pages (struct file *, void *const pages[], off_t size,
+                       off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_read_direct (struct file *, void *, off_t);
+off_t file_write_direct (struct file *, const void *, off_t);
+off_t file_copy (struct file *dst, struct file *src, off_t size);
+void file_sync (struct file *);
+bool file_allocate (struct file *, off_t offset, off_t size);
+bool file_truncate (struct file *, off_t length);
+size_t file_extents (struct file *);
+size_t file_defrag (struct file *);
+bool file_clone (struct file *dst, struct file *src);
+
+/* Hints. */
+void file_advise (struct file *, enum file_advice);
+void file_set_direct (struct file *, bool);
+bool file_is_direct (const struct file *);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
@@ -2,10 +2,18 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/checksum.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
+#include "filesys/initramfs.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
+#ifdef USERPROG
+#include "threads/thread.h"
+#endif
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -21,7 +29,12 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  checksum_init (format);
+  journal_init (format);
   inode_init ();
+  file_init ();
+  dcache_init ();
   free_map_init ();
 
   if (format) 
@@ -36,29 +49,192 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  filesys_sync ();
+}
+
+/* Writes everything the file system has changed so far to disk:
+   commits the journal, writes back the buffer cache and flushes
+   the disk's write cache. */
+void
+filesys_sync (void)
+{
+  journal_commit ();
+  cache_flush ();
+  block_flush (fs_device);
 }
 
-/* Creates a file named NAME with the given INITIAL_SIZE.
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX character from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0')
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++;
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Opens the directory that relative file names start from: the
+   current process's working directory, or the root directory
+   if it has none. */
+static struct dir *
+open_cwd (void)
+{
+#ifdef USERPROG
+  struct thread *proceso = thread_current ()->proceso;
+  struct dir *dir = NULL;
+
+  lock_acquire (&proceso->lock_descriptores);
+  if (proceso->directorio != NULL)
+    dir = dir_reopen (proceso->directorio);
+  lock_release (&proceso->lock_descriptores);
+  if (dir != NULL)
+    return dir;
+#endif
+  return dir_open_root ();
+}
+
+/* Resolves all but the last part of PATH, which is absolute if
+   it starts with "/" and relative to the working directory
+   otherwise, and copies the last part into NAME.  A PATH that
+   has no parts, such as "/", names its starting directory, as
+   ".".  Returns the directory that holds NAME, which the caller
+   must close, or a null pointer if PATH is empty, a part is too
+   long, or a part other than the last is not a directory.
+
+   Each part is found by dir_lookup(), which goes through the
+   directory entry cache, so resolving the same deep path again
+   does not search the directories along it. */
+static struct dir *
+resolve (const char *path, char name[NAME_MAX + 1])
+{
+  struct dir *dir;
+  char next[NAME_MAX + 1];
+  int status;
+
+  if (*path == '\0')
+    return NULL;
+  dir = *path == '/' ? dir_open_root () : open_cwd ();
+  if (dir == NULL)
+    return NULL;
+
+  status = get_next_part (name, &path);
+  if (status == 0)
+    strlcpy (name, ".", NAME_MAX + 1);
+  while (status > 0 && (status = get_next_part (next, &path)) > 0)
+    {
+      struct inode *inode;
+
+      if (!dir_lookup (dir, name, &inode) || !inode_is_dir (inode))
+        {
+          inode_close (inode);
+          status = -1;
+          break;
+        }
+      dir_close (dir);
+      dir = dir_open (inode);
+      if (dir == NULL)
+        return NULL;
+      strlcpy (name, next, NAME_MAX + 1);
+    }
+  if (status < 0)
+    {
+      dir_close (dir);
+      return NULL;
+    }
+  return dir;
+}
+
+/* Creates a file named NAME with the given INITIAL_SIZE, or a
+   directory if IS_DIR is true, in one journal transaction, which
+   starts only once NAME is resolved, since resolving it may take
+   the process's locks.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
    or if internal memory allocation fails. */
-bool
-filesys_create (const char *name, off_t initial_size) 
+static bool
+create (const char *name, off_t initial_size, bool is_dir)
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
+  bool success;
+
+  journal_begin ();
+  success = (dir != NULL
+             && free_map_allocate (1, &inode_sector)
+             && (is_dir
+                 ? dir_create (inode_sector, 0,
+                               inode_get_inumber (dir_get_inode (dir)))
+                 : inode_create (inode_sector, initial_size, false)));
+
+  /* If NAME cannot be added, a new directory already has data
+     sectors, so remove the inode to free them along with it. */
+  if (success && !dir_add (dir, part, inode_sector))
+    {
+      struct inode *inode = inode_open (inode_sector);
+
+      success = false;
+      if (inode != NULL)
+        {
+          inode_remove (inode);
+          inode_close (inode);
+          inode_sector = 0;
+        }
+    }
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
+  journal_end ();
   dir_close (dir);
 
   return success;
 }
 
-/* Opens the file with the given NAME.
+/* Creates a file named NAME with the given INITIAL_SIZE.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_create (const char *name, off_t initial_size) 
+{
+  return create (name, initial_size, false);
+}
+
+/* Creates an empty directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name)
+{
+  return create (name, 0, true);
+}
+
+/* Opens the file with the given NAME, which may also be a
+   directory.  A file of the initial RAM file system hides one of
+   the same name in the root directory.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -66,37 +242,72 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
   struct inode *inode = NULL;
 
   if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+    {
+      if (inode_get_inumber (dir_get_inode (dir)) == ROOT_DIR_SECTOR)
+        inode = initramfs_open (part);
+      if (inode == NULL)
+        dir_lookup (dir, part, &inode);
+    }
   dir_close (dir);
 
   return file_open (inode);
 }
 
-/* Deletes the file named NAME.
-   Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
+/* Opens the directory with the given NAME.
+   Returns the new directory if successful or a null pointer
+   otherwise.
+   Fails if no directory named NAME exists,
    or if an internal memory allocation fails. */
+struct dir *
+filesys_open_dir (const char *name)
+{
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
+  struct inode *inode = NULL;
+
+  if (dir != NULL)
+    dir_lookup (dir, part, &inode);
+  dir_close (dir);
+  if (inode != NULL && !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return NULL;
+    }
+
+  return dir_open (inode);
+}
+
+/* Deletes the file or empty directory named NAME.
+   Returns true if successful, false on failure.
+   Fails if no file named NAME exists, if it is a directory that
+   is not empty, or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve (name, part);
+  bool success;
+
+  journal_begin ();
+  success = dir != NULL && dir_remove (dir, part);
+  journal_end ();
   dir_close (dir); 
 
   return success;
 }
-
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
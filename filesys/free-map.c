@@ -1,22 +1,239 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <limits.h>
+#include <round.h>
+#include <stdint.h>
+#include "devices/timer.h"
+#include "filesys/checksum.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Protects all of these. */
+
+/* The free map is split into regions of REGION_BITS sectors,
+   each of which has its bits in one sector of the free map file,
+   and counts how many of its sectors are free, so that searches
+   skip full regions without looking at their bits.  Searches
+   also start where the last allocation ended, wrapping around
+   to the start of the disk for whatever they did not find.
+   Each change writes back only the bytes of the free map it
+   touched, into the buffer cache, which puts them on disk in its
+   own time. */
+#define REGION_BITS (BLOCK_SECTOR_SIZE * CHAR_BIT)
+static uint16_t *region_free;        /* Free sectors per region. */
+static size_t region_cnt;            /* Number of regions. */
+static size_t cursor;                /* Where the next search starts. */
+
+/* So that formatting and mounting take about the same time
+   however big the disk is, the free map file starts with a
+   summary, the free count of each region, in SUMMARY_SIZE bytes,
+   and only the summary is read at mount.  A region's bits are
+   read the first time it is searched or changed; those of an
+   entirely free region need no reading at all.  Formatting
+   reserves the file's sectors without writing them and writes
+   only the summary and the regions with sectors in use, so a
+   region's sector of bits is set up on disk, zeroed by the inode
+   layer, only when a sector in it is first allocated.
+
+   A free map file that has no summary, from before there was
+   one, is read all at once as it used to be. */
+static struct bitmap *region_loaded; /* Regions whose bits are read. */
+static off_t summary_size;           /* Bytes before the bits. */
+static off_t bits_ofs;               /* SUMMARY_SIZE, or 0 if none. */
+
+/* A thin-provisioned disk, such as a sparse disk image, gives
+   back the space of the sectors the file system releases only
+   when it is told that they are discarded.  Released sectors are
+   marked in RELEASED, and every DISCARD_TICKS the discard thread
+   takes them, waits for the journal to commit, since recovery
+   would undo a release that has not, and then discards the
+   sectors among them that are still free, a run of adjacent ones
+   at a time.  It holds FREE_MAP_LOCK while discarding, so that
+   none of them can be allocated and written before the disk has
+   forgotten them. */
+#define DISCARD_TICKS (5 * TIMER_FREQ)
+static struct bitmap *released;      /* Released since last taken. */
+static struct bitmap *to_discard;    /* Taken, not yet discarded. */
+static size_t released_lo;           /* Bits set in RELEASED are all */
+static size_t released_hi;           /* in [RELEASED_LO, RELEASED_HI). */
+static struct lock discard_lock;     /* Held while discarding. */
+
+/* A data sector that inode_clone() shares among several inodes
+   is released only when the last of them lets go of it.  The
+   free map file ends with a byte for each sector, starting at
+   REFS_OFS, that counts the inodes sharing it beyond the first,
+   so a sector nobody shares has 0 there, and since the file's
+   sectors are reserved without being written, a disk nobody has
+   cloned a file on reads as zeros there without any disk I/O.
+   A free map file that has no room for the counts, from before
+   there were any, cannot share sectors. */
+#define REFS_MAX UINT8_MAX
+static off_t refs_ofs;               /* Offset of the counts, or 0. */
+static size_t region_sectors (size_t region);
+static void count_regions (void);
+static void load_regions (size_t start, size_t cnt);
+static size_t find_free (size_t start, size_t end, size_t cnt);
+static bool set_sectors (size_t start, size_t cnt, bool value);
+static bool write_regions (size_t first, size_t last);
+static void release_sectors (size_t start, size_t cnt);
+static uint8_t get_refs (block_sector_t);
+static void discard_released (void);
+static thread_func discard_thread;
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
+  size_t i;
+
+  lock_init (&free_map_lock);
+  lock_init (&discard_lock);
   free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  region_cnt = DIV_ROUND_UP (block_size (fs_device), REGION_BITS);
+  region_free = malloc (region_cnt * sizeof *region_free);
+  region_loaded = bitmap_create (region_cnt);
+  released = bitmap_create (block_size (fs_device));
+  to_discard = bitmap_create (block_size (fs_device));
+  if (free_map == NULL || region_free == NULL || region_loaded == NULL
+      || released == NULL || to_discard == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
-  bitmap_mark (free_map, FREE_MAP_SECTOR);
-  bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  released_lo = bitmap_size (released);
+  released_hi = 0;
+  summary_size = ROUND_UP (region_cnt * sizeof *region_free,
+                           BLOCK_SECTOR_SIZE);
+
+  /* Every region starts out free and read, as for formatting. */
+  for (i = 0; i < region_cnt; i++)
+    region_free[i] = region_sectors (i);
+  bitmap_set_all (region_loaded, true);
+  set_sectors (FREE_MAP_SECTOR, 1, true);
+  set_sectors (ROOT_DIR_SECTOR, 1, true);
+  set_sectors (JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  set_sectors (CHECKSUM_SECTOR, checksum_sectors (), true);
+}
+
+/* Returns the number of sectors in REGION. */
+static size_t
+region_sectors (size_t region)
+{
+  size_t start = region * REGION_BITS;
+  size_t size = bitmap_size (free_map);
+
+  return size - start < REGION_BITS ? size - start : REGION_BITS;
+}
+
+/* Counts the free sectors in each region. */
+static void
+count_regions (void)
+{
+  size_t i;
+
+  for (i = 0; i < region_cnt; i++)
+    region_free[i] = bitmap_count (free_map, i * REGION_BITS,
+                                   region_sectors (i), false);
+}
+
+/* Reads the bits of the regions that hold the CNT sectors
+   starting at START, unless they have been read already.  The
+   caller must hold FREE_MAP_LOCK. */
+static void
+load_regions (size_t start, size_t cnt)
+{
+  size_t region;
+
+  for (region = start / REGION_BITS;
+       region * REGION_BITS < start + cnt; region++)
+    if (!bitmap_test (region_loaded, region))
+      {
+        size_t first = region * REGION_BITS;
+        size_t n = region_sectors (region);
+
+        if (region_free[region] == n)
+          bitmap_set_multiple (free_map, first, n, false);
+        else if (!bitmap_read_range (free_map, free_map_file, bits_ofs,
+                                     first, n))
+          PANIC ("can't read free map");
+        bitmap_mark (region_loaded, region);
+      }
+}
+
+/* Returns the first sector in [START, END) that begins CNT free
+   sectors, or BITMAP_ERROR if there is none.  The caller must
+   hold FREE_MAP_LOCK. */
+static size_t
+find_free (size_t start, size_t end, size_t cnt)
+{
+  size_t size = bitmap_size (free_map);
+  size_t sector = start;
+
+  while (sector < end && sector + cnt <= size)
+    {
+      if (region_free[sector / REGION_BITS] == 0)
+        sector = ROUND_DOWN (sector, REGION_BITS) + REGION_BITS;
+      else
+        {
+          load_regions (sector, cnt);
+          if (bitmap_none (free_map, sector, cnt))
+            return sector;
+          sector++;
+        }
+    }
+  return BITMAP_ERROR;
+}
+
+/* Sets the CNT bits starting at START, which must all be the
+   opposite of VALUE, to VALUE, updates the region counts, and
+   writes the changed bytes and counts to the free map file if it
+   is open.  Returns false if that write fails.  The caller must
+   hold FREE_MAP_LOCK. */
+static bool
+set_sectors (size_t start, size_t cnt, bool value)
+{
+  size_t sector = start;
+
+  load_regions (start, cnt);
+  ASSERT (value ? bitmap_none (free_map, start, cnt)
+                : bitmap_all (free_map, start, cnt));
+
+  bitmap_set_multiple (free_map, start, cnt, value);
+  while (sector < start + cnt)
+    {
+      size_t region = sector / REGION_BITS;
+      size_t region_end = (region + 1) * REGION_BITS;
+      size_t n = (start + cnt < region_end ? start + cnt : region_end) - sector;
+
+      if (value)
+        region_free[region] -= n;
+      else
+        region_free[region] += n;
+      sector += n;
+    }
+  return (free_map_file == NULL
+          || (bitmap_write_range (free_map, free_map_file, bits_ofs,
+                                  start, cnt)
+              && write_regions (start / REGION_BITS,
+                                (start + cnt - 1) / REGION_BITS)));
+}
+
+/* Writes the free counts of regions FIRST through LAST to the
+   summary in the free map file, if it has one.  Returns false if
+   the write fails.  The caller must hold FREE_MAP_LOCK. */
+static bool
+write_regions (size_t first, size_t last)
+{
+  off_t size = (last - first + 1) * sizeof *region_free;
+
+  return (bits_ofs == 0
+          || file_write_at (free_map_file, region_free + first, size,
+                            first * sizeof *region_free) == size);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -27,43 +244,272 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  size_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = find_free (cursor, bitmap_size (free_map), cnt);
+  if (sector == BITMAP_ERROR)
+    sector = find_free (0, cursor, cnt);
+  if (sector != BITMAP_ERROR && !set_sectors (sector, cnt, true))
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
+      set_sectors (sector, cnt, false);
       sector = BITMAP_ERROR;
     }
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      cursor = sector + cnt;
+      *sectorp = sector;
+    }
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Allocates a run of up to CNT consecutive sectors from the free
+   map, starting at the first free sector at or after HINT, or
+   failing that the first free sector after the last allocation,
+   and stores the first into *SECTORP.  Placing a file's new
+   sectors just after its last ones keeps it sequential on disk.
+   Returns the number of sectors allocated, which is 0 if the
+   disk is full or the free map file could not be written. */
+size_t
+free_map_allocate_near (block_sector_t hint, size_t cnt,
+                        block_sector_t *sectorp)
+{
+  size_t size = bitmap_size (free_map);
+  size_t sector, run;
+
+  ASSERT (cnt > 0);
+
+  lock_acquire (&free_map_lock);
+  sector = hint < size ? find_free (hint, size, 1) : BITMAP_ERROR;
+  if (sector == BITMAP_ERROR)
+    sector = find_free (cursor, size, 1);
+  if (sector == BITMAP_ERROR)
+    sector = find_free (0, cursor, 1);
+  if (sector == BITMAP_ERROR)
+    {
+      lock_release (&free_map_lock);
+      return 0;
+    }
+
+  load_regions (sector, size - sector < cnt ? size - sector : cnt);
+  for (run = 1; run < cnt && sector + run < size; run++)
+    if (bitmap_test (free_map, sector + run))
+      break;
+  if (set_sectors (sector, run, true))
+    {
+      cursor = sector + run;
+      *sectorp = sector;
+    }
+  else
+    {
+      set_sectors (sector, run, false);
+      run = 0;
+    }
+  lock_release (&free_map_lock);
+  return run;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use, and
+   marks them to be discarded. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
-  ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  lock_acquire (&free_map_lock);
+  release_sectors (sector, cnt);
+  lock_release (&free_map_lock);
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Releases CNT sectors starting at START for free_map_release().
+   The caller must hold FREE_MAP_LOCK. */
+static void
+release_sectors (size_t start, size_t cnt)
+{
+  set_sectors (start, cnt, false);
+  checksum_forget (start, cnt);
+  bitmap_set_multiple (released, start, cnt, true);
+  if (start < released_lo)
+    released_lo = start;
+  if (start + cnt > released_hi)
+    released_hi = start + cnt;
+}
+
+/* Returns the number of inodes that share SECTOR beyond the
+   first.  The caller must hold FREE_MAP_LOCK. */
+static uint8_t
+get_refs (block_sector_t sector)
+{
+  uint8_t refs;
+
+  if (refs_ofs == 0
+      || file_read_at (free_map_file, &refs, 1, refs_ofs + sector) != 1)
+    return 0;
+  return refs;
+}
+
+/* Adds a reference to SECTOR, an allocated data sector that
+   another inode is going to share.  Returns true if successful,
+   false if the free map cannot count any more references to it
+   or its file could not be written. */
+bool
+free_map_share (block_sector_t sector)
+{
+  uint8_t refs;
+  bool success = false;
+
+  lock_acquire (&free_map_lock);
+  ASSERT (bitmap_test (free_map, sector));
+  refs = get_refs (sector);
+  if (refs_ofs != 0 && refs < REFS_MAX)
+    {
+      refs++;
+      success = file_write_at (free_map_file, &refs, 1,
+                               refs_ofs + sector) == 1;
+    }
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Returns true if more than one inode shares SECTOR, so that
+   writing it must give the writer a copy of its own first. */
+bool
+free_map_shared (block_sector_t sector)
+{
+  bool shared;
+
+  lock_acquire (&free_map_lock);
+  shared = get_refs (sector) > 0;
+  lock_release (&free_map_lock);
+  return shared;
+}
+
+/* Drops a reference to SECTOR, releasing it as
+   free_map_release() does if that was the last one. */
+void
+free_map_unshare (block_sector_t sector)
+{
+  uint8_t refs;
+
+  lock_acquire (&free_map_lock);
+  refs = get_refs (sector);
+  if (refs > 0)
+    {
+      refs--;
+      file_write_at (free_map_file, &refs, 1, refs_ofs + sector);
+    }
+  else
+    release_sectors (sector, 1);
+  lock_release (&free_map_lock);
+}
+
+/* Discards the sectors released since the last call that are
+   still free, once the journal has committed their release. */
+static void
+discard_released (void)
+{
+  struct bitmap *taken;
+  size_t lo, hi, sector;
+
+  lock_acquire (&discard_lock);
+  lock_acquire (&free_map_lock);
+  taken = released;
+  released = to_discard;
+  to_discard = taken;
+  lo = released_lo;
+  hi = released_hi;
+  released_lo = bitmap_size (released);
+  released_hi = 0;
+  lock_release (&free_map_lock);
+
+  if (lo < hi)
+    {
+      journal_commit ();
+
+      lock_acquire (&free_map_lock);
+      sector = lo;
+      while (sector < hi)
+        {
+          size_t end;
+
+          sector = bitmap_scan (to_discard, sector, 1, true);
+          if (sector == BITMAP_ERROR || sector >= hi)
+            break;
+          for (end = sector; end < hi; end++)
+            if (!bitmap_test (to_discard, end) || bitmap_test (free_map, end))
+              break;
+
+          /* A sector allocated again since its release is skipped. */
+          if (end > sector)
+            block_discard (fs_device, sector, end - sector);
+          else
+            end++;
+          sector = end;
+        }
+      bitmap_set_multiple (to_discard, lo, hi - lo, false);
+      lock_release (&free_map_lock);
+    }
+  lock_release (&discard_lock);
+}
+
+/* Discard thread.  Discards released sectors every
+   DISCARD_TICKS. */
+static void
+discard_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (DISCARD_TICKS);
+      discard_released ();
+    }
+}
+
+/* Returns the offset of the reference counts in a free map file
+   whose bits start at BITS. */
+static off_t
+refs_offset (off_t bits)
+{
+  return ROUND_UP (bits + bitmap_file_size (free_map), BLOCK_SECTOR_SIZE);
+}
+
+/* Opens the free map file and reads its summary from disk, or
+   all of it if it has no summary. */
 void
 free_map_open (void) 
 {
+  off_t size = region_cnt * sizeof *region_free;
+  off_t refs_end;
+
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
-    PANIC ("can't read free map");
+  if (file_length (free_map_file) == (off_t) bitmap_file_size (free_map))
+    {
+      bits_ofs = 0;
+      if (!bitmap_read (free_map, free_map_file))
+        PANIC ("can't read free map");
+      count_regions ();
+      bitmap_set_all (region_loaded, true);
+    }
+  else
+    {
+      bits_ofs = summary_size;
+      if (file_read_at (free_map_file, region_free, size, 0) != size)
+        PANIC ("can't read free map");
+      bitmap_set_all (region_loaded, false);
+    }
+  refs_end = refs_offset (bits_ofs) + block_size (fs_device);
+  refs_ofs = 0;
+  if (file_length (free_map_file) >= refs_end)
+    refs_ofs = refs_offset (bits_ofs);
+  thread_create ("discard", PRI_DEFAULT, discard_thread, NULL);
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Discards the sectors released so far, writes the free map to
+   disk and closes the free map file. */
 void
 free_map_close (void) 
 {
+  discard_released ();
   file_close (free_map_file);
 }
 
@@ -72,14 +518,34 @@ free_map_close (void)
 void
 free_map_create (void) 
 {
+  off_t length = refs_offset (summary_size) + block_size (fs_device);
+  struct file *file;
+  size_t i;
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, length, false))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
-    PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  /* Reserve all the file's sectors, marking them in the bitmap,
+     so that writing the file never allocates from inside a write
+     to it.  Reserving writes none of them.  FREE_MAP_FILE stays
+     null until then, so that allocating does not write the
+     file. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL || !inode_allocate (file_get_inode (file), 0, length))
+    PANIC ("can't allocate free map");
+
+  /* Write the summary and the regions that are not all free. */
+  free_map_file = file;
+  bits_ofs = summary_size;
+  refs_ofs = refs_offset (bits_ofs);
+  lock_acquire (&free_map_lock);
+  for (i = 0; i < region_cnt; i++)
+    if (region_free[i] != region_sectors (i)
+        && !bitmap_write_range (free_map, file, bits_ofs, i * REGION_BITS,
+                                region_sectors (i)))
+      PANIC ("can't write free map");
+  if (!write_regions (0, region_cnt - 1))
     PANIC ("can't write free map");
+  lock_release (&free_map_lock);
 }
@@ -12,6 +12,11 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+size_t free_map_allocate_near (block_sector_t hint, size_t cnt,
+                               block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+bool free_map_share (block_sector_t);
+bool free_map_shared (block_sector_t);
+void free_map_unshare (block_sector_t);
 
 #endif /* filesys/free-map.h */
@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,8 +8,11 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 
 /* List files in the root directory. */
@@ -67,26 +71,237 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Longest path `defrag' prints; longer ones are truncated. */
+#define DEFRAG_PATH_MAX 511
+
+/* Totals for `defrag'. */
+struct defrag_stats
+  {
+    size_t files;               /* Files looked at. */
+    size_t fragmented;          /* Files with more than one extent. */
+    size_t sectors;             /* Sectors moved. */
+  };
+
+/* Defragments each file in DIR, whose path is PATH, and in the
+   directories below it, printing the extents of each fragmented
+   file before and after.  PATH has room for DEFRAG_PATH_MAX + 1 bytes,
+   of which the directory's path takes LEN. */
+static void
+defrag_dir (struct dir *dir, char *path, size_t len,
+            struct defrag_stats *stats)
+{
+  char *name = malloc (NAME_MAX + 1);
+
+  if (name == NULL)
+    PANIC ("couldn't allocate name buffer");
+  while (dir_readdir (dir, name))
+    {
+      struct inode *inode;
+
+      snprintf (path + len, DEFRAG_PATH_MAX + 1 - len, "/%s", name);
+      if (!dir_lookup (dir, name, &inode))
+        continue;
+      if (inode_is_dir (inode))
+        {
+          struct dir *subdir = dir_open (inode);
+          if (subdir != NULL)
+            {
+              defrag_dir (subdir, path, strlen (path), stats);
+              dir_close (subdir);
+            }
+        }
+      else
+        {
+          struct file *file = file_open (inode);
+          size_t before;
+
+          if (file == NULL)
+            continue;
+          stats->files++;
+          before = file_extents (file);
+          if (before > 1)
+            {
+              size_t moved = file_defrag (file);
+
+              stats->fragmented++;
+              stats->sectors += moved;
+              printf ("%s: %zu extents, %zu after moving %zu sectors\n",
+                      path, before, file_extents (file), moved);
+            }
+          file_close (file);
+        }
+      path[len] = '\0';
+    }
+  free (name);
+}
+
+/* Defragments every file in the file system that has its data
+   in more than one extent, moving it into as few runs of
+   adjacent sectors as the free space allows. */
+void
+fsutil_defrag (char **argv UNUSED)
+{
+  static char path[DEFRAG_PATH_MAX + 1];
+  struct defrag_stats stats = {0, 0, 0};
+  struct dir *dir;
+
+  printf ("Defragmenting files...\n");
+  dir = dir_open_root ();
+  if (dir == NULL)
+    PANIC ("root dir open failed");
+  path[0] = '\0';
+  defrag_dir (dir, path, 0, &stats);
+  dir_close (dir);
+  printf ("%zu files, %zu fragmented, %zu sectors moved.\n",
+          stats.files, stats.fragmented, stats.sectors);
+}
+
+/* Saves the event trace ring to new file ARGV[1], in the binary
+   format described in threads/trace.h.  Use `append' afterward to
+   copy it out to the host. */
+void
+fsutil_trace (char **argv) 
+{
+  const char *file_name = argv[1];
+  size_t size = trace_dump_size ();
+  struct file *dst;
+  void *buffer;
+
+  printf ("Saving trace to '%s'...\n", file_name);
+
+  /* Snapshot the rings first, so that the file system's own
+     events do not change them while we write. */
+  buffer = malloc (size);
+  if (buffer == NULL)
+    PANIC ("couldn't allocate buffer");
+  size = trace_dump (buffer, size);
+
+  if (!filesys_create (file_name, size))
+    PANIC ("%s: create failed", file_name);
+  dst = filesys_open (file_name);
+  if (dst == NULL)
+    PANIC ("%s: open failed", file_name);
+  if (file_write (dst, buffer, size) != (off_t) size)
+    PANIC ("%s: write failed", file_name);
+
+  file_close (dst);
+  free (buffer);
+}
+
+/* Sectors moved between the scratch device and memory by each
+   request of `extract' and `append'. */
+#define COPY_SECTORS 64
+#define COPY_PAGES (COPY_SECTORS * BLOCK_SECTOR_SIZE / PGSIZE)
+
+/* A buffer of up to COPY_SECTORS consecutive sectors of the
+   scratch device, starting at sector START.  SECTORS[] points to
+   each sector of DATA, as block_read_multi() and
+   block_write_multi() want them. */
+struct copy_buffer
+  {
+    struct block *block;        /* Scratch device. */
+    block_sector_t start;       /* Device sector held in DATA[0]. */
+    size_t cnt;                 /* Number of sectors held. */
+    size_t pos;                 /* Sectors of them already used. */
+    uint8_t *data;              /* COPY_SECTORS sectors. */
+    void *sectors[COPY_SECTORS];
+  };
+
+/* Initializes B to transfer sectors of BLOCK starting at
+   sector START. */
+static void
+copy_buffer_init (struct copy_buffer *b, struct block *block,
+                  block_sector_t start)
+{
+  size_t i;
+
+  b->block = block;
+  b->start = start;
+  b->cnt = b->pos = 0;
+  b->data = palloc_get_multiple (PAL_ASSERT, COPY_PAGES);
+  for (i = 0; i < COPY_SECTORS; i++)
+    b->sectors[i] = b->data + i * BLOCK_SECTOR_SIZE;
+}
+
+/* Frees B's memory. */
+static void
+copy_buffer_destroy (struct copy_buffer *b)
+{
+  palloc_free_multiple (b->data, COPY_PAGES);
+}
+
+/* Returns the next sectors of B's device, MAX_CNT of them or
+   fewer, and stores how many in *CNT.  When the buffer has been
+   used up, refills it with the following COPY_SECTORS sectors in
+   a single request.  Panics at the end of the device. */
+static uint8_t *
+copy_buffer_read (struct copy_buffer *b, size_t max_cnt, size_t *cnt)
+{
+  uint8_t *data;
+
+  if (b->pos == b->cnt)
+    {
+      block_sector_t left;
+
+      b->start += b->cnt;
+      left = block_size (b->block) - b->start;
+      if (left == 0)
+        PANIC ("unexpected end of scratch device");
+      b->cnt = left < COPY_SECTORS ? left : COPY_SECTORS;
+      b->pos = 0;
+      block_read_multi (b->block, b->start, b->sectors, b->cnt);
+    }
+
+  *cnt = b->cnt - b->pos < max_cnt ? b->cnt - b->pos : max_cnt;
+  data = b->data + b->pos * BLOCK_SECTOR_SIZE;
+  b->pos += *cnt;
+  return data;
+}
+
+/* Writes the CNT sectors that B holds to its device in a single
+   request, and advances past them if ADVANCE is true.  Panics if
+   they do not fit. */
+static void
+copy_buffer_write (struct copy_buffer *b, bool advance)
+{
+  if (b->cnt > block_size (b->block) - b->start)
+    PANIC ("out of space on scratch device");
+  if (b->cnt > 0)
+    block_write_multi (b->block, b->start, (const void *const *) b->sectors,
+                       b->cnt);
+  if (advance)
+    {
+      b->start += b->cnt;
+      b->cnt = 0;
+    }
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+   device into the Pintos file system.
+
+   The archive is read COPY_SECTORS at a time.  Each file's space
+   is allocated up front, so that it can be placed in one run,
+   and its data is written into the buffer cache as large as the
+   buffer allows, leaving a single flush to disk at the end. */
 void
 fsutil_extract (char **argv UNUSED) 
 {
   static block_sector_t sector = 0;
 
   struct block *src;
-  void *header, *data;
+  struct copy_buffer b;
+  void *header;
 
-  /* Allocate buffers. */
+  /* Allocate buffer. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
-    PANIC ("couldn't allocate buffers");
+  if (header == NULL)
+    PANIC ("couldn't allocate buffer");
 
   /* Open source block device. */
   src = block_get_role (BLOCK_SCRATCH);
   if (src == NULL)
     PANIC ("couldn't open scratch device");
+  copy_buffer_init (&b, src, sector);
 
   printf ("Extracting ustar archive from scratch device "
           "into file system...\n");
@@ -96,13 +311,16 @@ fsutil_extract (char **argv UNUSED)
       const char *file_name;
       const char *error;
       enum ustar_type type;
+      size_t cnt;
       int size;
 
-      /* Read and parse ustar header. */
-      block_read (src, sector++, header);
+      /* Read and parse ustar header.  It is copied out of the
+         buffer, which reading the file's data reuses. */
+      sector = b.start + b.pos;
+      memcpy (header, copy_buffer_read (&b, 1, &cnt), BLOCK_SECTOR_SIZE);
       error = ustar_parse_header (header, &file_name, &type, &size);
       if (error != NULL)
-        PANIC ("bad ustar header in sector %"PRDSNu" (%s)", sector - 1, error);
+        PANIC ("bad ustar header in sector %"PRDSNu" (%s)", sector, error);
 
       if (type == USTAR_EOF)
         {
@@ -123,24 +341,33 @@ fsutil_extract (char **argv UNUSED)
           dst = filesys_open (file_name);
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
+          if (!file_allocate (dst, 0, size))
+            PANIC ("%s: out of space for %d bytes", file_name, size);
 
           /* Do copy. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
+              size_t want = DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+              uint8_t *data = copy_buffer_read (&b, want, &cnt);
+              int chunk_size = (size > (int) (cnt * BLOCK_SECTOR_SIZE)
+                                ? (int) (cnt * BLOCK_SECTOR_SIZE)
                                 : size);
-              block_read (src, sector++, data);
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
               size -= chunk_size;
+              thread_cond_resched ();
             }
 
           /* Finish up. */
           file_close (dst);
         }
     }
+  sector = b.start + b.pos;
+  copy_buffer_destroy (&b);
+
+  /* Write everything extracted to disk. */
+  filesys_sync ();
 
   /* Erase the ustar header from the start of the block device,
      so that the extraction operation is idempotent.  We erase
@@ -151,12 +378,11 @@ fsutil_extract (char **argv UNUSED)
   block_write (src, 0, header);
   block_write (src, 1, header);
 
-  free (data);
   free (header);
 }
 
 /* Copies file FILE_NAME from the file system to the scratch
-   device, in ustar format.
+   device, in ustar format, writing COPY_SECTORS at a time.
 
    The first call to this function will write starting at the
    beginning of the scratch device.  Later calls advance across
@@ -169,18 +395,13 @@ fsutil_append (char **argv)
   static block_sector_t sector = 0;
 
   const char *file_name = argv[1];
-  void *buffer;
+  struct copy_buffer b;
   struct file *src;
   struct block *dst;
   off_t size;
 
   printf ("Appending '%s' to ustar archive on scratch device...\n", file_name);
 
-  /* Allocate buffer. */
-  buffer = malloc (BLOCK_SECTOR_SIZE);
-  if (buffer == NULL)
-    PANIC ("couldn't allocate buffer");
-
   /* Open source file. */
   src = filesys_open (file_name);
   if (src == NULL)
@@ -191,33 +412,40 @@ fsutil_append (char **argv)
   dst = block_get_role (BLOCK_SCRATCH);
   if (dst == NULL)
     PANIC ("couldn't open scratch device");
+  copy_buffer_init (&b, dst, sector);
   
   /* Write ustar header to first sector. */
-  if (!ustar_make_header (file_name, USTAR_REGULAR, size, buffer))
+  if (!ustar_make_header (file_name, USTAR_REGULAR, size, b.sectors[0]))
     PANIC ("%s: name too long for ustar format", file_name);
-  block_write (dst, sector++, buffer);
+  b.cnt = 1;
 
-  /* Do copy. */
+  /* Do copy.  The last sector is padded with zeros. */
   while (size > 0) 
     {
-      int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-      if (sector >= block_size (dst))
-        PANIC ("%s: out of space on scratch device", file_name);
-      if (file_read (src, buffer, chunk_size) != chunk_size)
+      off_t room = (COPY_SECTORS - b.cnt) * BLOCK_SECTOR_SIZE;
+      off_t chunk_size = size > room ? room : size;
+      uint8_t *data = b.sectors[b.cnt];
+      size_t cnt = DIV_ROUND_UP (chunk_size, BLOCK_SECTOR_SIZE);
+
+      if (file_read (src, data, chunk_size) != chunk_size)
         PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
-      memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-      block_write (dst, sector++, buffer);
+      memset (data + chunk_size, 0, cnt * BLOCK_SECTOR_SIZE - chunk_size);
+      b.cnt += cnt;
       size -= chunk_size;
+      if (b.cnt == COPY_SECTORS)
+        copy_buffer_write (&b, true);
     }
+  copy_buffer_write (&b, true);
 
   /* Write ustar end-of-archive marker, which is two consecutive
      sectors full of zeros.  Don't advance our position past
      them, though, in case we have more files to append. */
-  memset (buffer, 0, BLOCK_SECTOR_SIZE);
-  block_write (dst, sector, buffer);
-  block_write (dst, sector, buffer + 1);
+  memset (b.data, 0, 2 * BLOCK_SECTOR_SIZE);
+  b.cnt = 2;
+  copy_buffer_write (&b, false);
+  sector = b.start;
 
   /* Finish up. */
+  copy_buffer_destroy (&b);
   file_close (src);
-  free (buffer);
 }
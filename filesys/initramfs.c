@@ -0,0 +1,164 @@
+#include "filesys/initramfs.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include <ustar.h>
+#include "devices/block.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A regular file in the archive. */
+struct initramfs_file
+  {
+    char *name;                 /* File name, from malloc(). */
+    const uint8_t *data;        /* Contents. */
+    off_t size;                 /* Length of DATA in bytes. */
+  };
+
+/* Files in the archive, in archive order.  Set up at boot, before
+   anything can open them, and never changed afterward, so
+   looking one up needs no lock. */
+static struct initramfs_file *files;
+static size_t file_cnt;
+
+/* Inode number of FILES[0], and FILES[1] has the next one, and so
+   on.  No file system device is big enough to have sectors this
+   high, so these never clash with the inode numbers of files on
+   disk. */
+#define INUMBER_BASE 0xff000000
+
+/* Sectors read from the device by each request. */
+#define LOAD_SECTORS 64
+
+/* Contents of every empty file. */
+static const uint8_t empty_data[1];
+
+static bool add_file (struct block *, block_sector_t, const char *name,
+                      off_t size);
+
+/* Reads the ustar archive at the start of BLOCK into memory as
+   the initial RAM file system.  Directories, and files in them,
+   are skipped.  Panics if BLOCK is null or the archive is bad,
+   and if there is not enough memory for a file, since running
+   without it could only fail later and more confusingly. */
+void
+initramfs_load (struct block *block)
+{
+  block_sector_t sector = 0;
+  size_t byte_cnt = 0;
+  char *header;
+
+  if (block == NULL)
+    PANIC ("initramfs: no scratch device");
+  header = malloc (USTAR_HEADER_SIZE);
+  if (header == NULL)
+    PANIC ("initramfs: couldn't allocate buffer");
+
+  for (;;)
+    {
+      const char *file_name;
+      const char *error;
+      enum ustar_type type;
+      int size;
+
+      if (sector >= block_size (block))
+        PANIC ("initramfs: unexpected end of %s", block_name (block));
+      block_read (block, sector, header);
+      error = ustar_parse_header (header, &file_name, &type, &size);
+      if (error != NULL)
+        PANIC ("initramfs: bad ustar header in sector %"PRDSNu" (%s)",
+               sector, error);
+      sector++;
+      if (type == USTAR_EOF)
+        break;
+
+      if (type == USTAR_REGULAR && strchr (file_name, '/') == NULL)
+        {
+          if (!add_file (block, sector, file_name, size))
+            PANIC ("initramfs: out of memory for %s (%d bytes)",
+                   file_name, size);
+          byte_cnt += size;
+        }
+      else
+        printf ("initramfs: ignoring %s\n", file_name);
+      sector += DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+    }
+  free (header);
+
+  printf ("initramfs: %zu files, %zu bytes, from %s\n",
+          file_cnt, byte_cnt, block_name (block));
+}
+
+/* Reads the SIZE bytes of file NAME, which start at SECTOR of
+   BLOCK, into pages of their own, LOAD_SECTORS at a time, and
+   adds it to FILES.  Returns true if successful, false if memory
+   allocation fails. */
+static bool
+add_file (struct block *block, block_sector_t sector, const char *name,
+          off_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  size_t sector_cnt = DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+  struct initramfs_file *f, *new_files;
+  uint8_t *data = NULL;
+  char *name_copy;
+  size_t done;
+
+  new_files = realloc (files, (file_cnt + 1) * sizeof *files);
+  if (new_files == NULL)
+    return false;
+  files = new_files;
+
+  name_copy = malloc (strlen (name) + 1);
+  if (page_cnt > 0)
+    data = palloc_get_multiple_tagged (0, page_cnt, MEM_RAMDISK);
+  if (name_copy == NULL || (page_cnt > 0 && data == NULL))
+    {
+      free (name_copy);
+      if (data != NULL)
+        palloc_free_multiple (data, page_cnt);
+      return false;
+    }
+  strlcpy (name_copy, name, strlen (name) + 1);
+
+  /* A page holds a whole number of sectors, so the last sector
+     read fits in the last page even if SIZE ends before it. */
+  for (done = 0; done < sector_cnt; )
+    {
+      void *buffers[LOAD_SECTORS];
+      size_t cnt = sector_cnt - done;
+      size_t i;
+
+      if (cnt > LOAD_SECTORS)
+        cnt = LOAD_SECTORS;
+      for (i = 0; i < cnt; i++)
+        buffers[i] = data + (done + i) * BLOCK_SECTOR_SIZE;
+      block_read_multi (block, sector + done, buffers, cnt);
+      done += cnt;
+    }
+
+  f = &files[file_cnt++];
+  f->name = name_copy;
+  f->data = data != NULL ? data : empty_data;
+  f->size = size;
+  return true;
+}
+
+/* Opens the file named NAME in the initial RAM file system.
+   Returns its inode, which the caller must close, or a null
+   pointer if there is no such file or memory allocation
+   fails. */
+struct inode *
+initramfs_open (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < file_cnt; i++)
+    if (!strcmp (files[i].name, name))
+      return inode_open_memory (INUMBER_BASE + i, files[i].data,
+                                files[i].size);
+  return NULL;
+}
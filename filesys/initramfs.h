@@ -0,0 +1,19 @@
+#ifndef FILESYS_INITRAMFS_H
+#define FILESYS_INITRAMFS_H
+
+struct block;
+struct inode;
+
+/* Initial RAM file system.
+
+   A ustar archive of files to run, such as the programs that the
+   `pintos' utility puts on the scratch device, read into memory
+   once at boot instead of extracted into the file system.  Its
+   regular files appear in the root directory, read-only, ahead
+   of any file there with the same name, so running a program
+   from it reads nothing from disk and writes nothing at all. */
+
+void initramfs_load (struct block *);
+struct inode *initramfs_open (const char *name);
+
+#endif /* filesys/initramfs.h */
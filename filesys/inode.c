@@ -1,27 +1,100 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
+#include <limits.h>
 #include <round.h>
+#include <stdint.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/share.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Sector pointers in an index block. */
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Data sectors mapped by the inode itself, by its indirect
+   block, and by its doubly indirect block. */
+#define DIRECT_CNT 122
+#define INDIRECT_CNT PTRS_PER_SECTOR
+#define DOUBLY_CNT (PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
+/* Largest number of data sectors in a file. */
+#define MAX_SECTORS (DIRECT_CNT + INDIRECT_CNT + DOUBLY_CNT)
+
+/* A hole: a data or index sector that has not been allocated.
+   Sector 0 always holds the free map inode, so it is never used
+   as a data or index sector. */
+#define NO_SECTOR 0
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   The data sectors of a file are found through a multi-level
+   index: the first DIRECT_CNT through DIRECT, the next
+   INDIRECT_CNT through the index block INDIRECT, and the rest
+   through the index blocks listed in the doubly indirect block
+   DOUBLY_INDIRECT.  Any data or index sector may be a hole,
+   which reads as zeros.  Sectors are allocated when they are
+   first written, or earlier by inode_allocate().
+
+   The first VALID_CNT data sectors have been zeroed or written.
+   Data sectors at or past VALID_CNT were reserved by
+   inode_allocate() without being zeroed, so they read as zeros
+   like holes, and a write there zeroes what it skips first.
+   This way a preallocated file costs no disk writes until its
+   data is written.
+
+   A file of at most INLINE_MAX bytes instead keeps its data in
+   the inode sector itself, in the space of DIRECT, and has no
+   data or index sectors, which INODE_INLINE in FLAGS tells.  It
+   moves to a data sector the first time a write goes past
+   INLINE_MAX.
+
+   A file made by inode_clone(), and the file it was cloned from,
+   have INODE_SHARED in FLAGS: some of their data sectors may be
+   shared with other inodes, which the free map counts.  Such a
+   file releases its data sectors through free_map_unshare(), and
+   writing a data sector that is still shared first gives the
+   file a copy of its own.  Index blocks are never shared. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t flags;                     /* INODE_* flags. */
+    uint32_t valid_cnt;                 /* Data sectors initialized. */
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Indirect index block. */
+    block_sector_t doubly_indirect;     /* Doubly indirect block. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
+/* Inode flags. */
+#define INODE_DIR 0x1                   /* Directory. */
+#define INODE_INLINE 0x2                /* Data is in DIRECT. */
+#define INODE_SHARED 0x4                /* Data may be shared. */
+
+/* Largest file whose data fits in the inode sector. */
+#define INLINE_MAX (DIRECT_CNT * sizeof (block_sector_t))
+
+/* Bytes that one journal transaction writes or allocates at
+   most, so that a large write or allocation does not need more
+   index blocks and free map sectors than a transaction may log. */
+#define WRITE_CHUNK (64 * BLOCK_SECTOR_SIZE)
+
+/* Returns the number of data sectors in an inode SIZE bytes
+   long, counting holes. */
 static inline size_t
 bytes_to_sectors (off_t size)
 {
@@ -31,48 +104,497 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
+    struct list_elem closed_elem;       /* Element in closed_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock rw;                   /* Shared by readers of data. */
+    struct rwlock dir_rw;               /* See inode_lock(). */
+    bool dirty;                         /* DATA changed since written? */
+    unsigned long change_cnt;           /* Changes finished so far. */
     struct inode_disk data;             /* Inode content. */
+    const uint8_t *mem;                 /* In-memory data, or null. */
+    void *aux;                          /* See inode_set_aux(). */
+
+    /* The index block used last, so that sequential access does
+       not repeat the indirect lookups for every sector. */
+    struct lock index_lock;             /* Protects the members below. */
+    block_sector_t index_sector;        /* Its sector, or NO_SECTOR. */
+    size_t index_first;                 /* First data sector it maps. */
+    block_sector_t index[PTRS_PER_SECTOR]; /* Its contents. */
+
+    /* Sector allocation, done only while holding INODE for
+       writing.  New sectors are taken from a run of free sectors
+       reserved for the current write, which starts as close
+       after the sector allocated last as the free map allows. */
+    block_sector_t next_sector;         /* Where to look for a run. */
+    block_sector_t run_sector;          /* Next sector of the run. */
+    size_t run_cnt;                     /* Sectors left in the run. */
+    size_t run_want;                    /* Sectors left to write. */
   };
 
+static bool allocate_sector (struct inode *, block_sector_t *, bool zero);
+static bool allocate_index (struct inode *, block_sector_t *);
+static void write_data (struct inode *, block_sector_t, const void *,
+                        size_t ofs, size_t size);
+static bool uninline (struct inode *);
+static bool load_index (struct inode *, size_t idx, bool allocate);
+static void release_index (block_sector_t, int level, bool shared);
+static bool remap_sector (struct inode *, size_t idx, block_sector_t);
+static void finish_change (struct inode *);
+static off_t write_at (struct inode *, const uint8_t *, off_t size,
+                       off_t offset, bool direct);
+static off_t write_chunk (struct inode *, const uint8_t *, off_t size,
+                          off_t offset, bool direct);
+static bool allocate_chunk (struct inode *, off_t offset, off_t size);
+
+/* A sector's worth of zeros. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   within INODE, or NO_SECTOR if it falls in a hole.
+   If ALLOCATE is true, fills a hole with a new sector first,
+   zeroed unless it is past valid_cnt, and returns NO_SECTOR only
+   if POS is beyond the largest file size or the disk is full;
+   the caller must then hold INODE for writing. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos, bool allocate)
 {
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+  bool zero = idx < inode->data.valid_cnt;
+  block_sector_t sector;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+
+  if (idx < DIRECT_CNT)
+    {
+      block_sector_t *direct = &inode->data.direct[idx];
+
+      if (*direct == NO_SECTOR && allocate
+          && allocate_sector (inode, direct, zero))
+        inode->dirty = true;
+      return *direct;
+    }
+
+  lock_acquire (&inode->index_lock);
+  if ((inode->index_sector == NO_SECTOR
+       || idx - inode->index_first >= PTRS_PER_SECTOR)
+      && !load_index (inode, idx, allocate))
+    sector = NO_SECTOR;
+  else
+    {
+      size_t i = idx - inode->index_first;
+
+      if (inode->index[i] == NO_SECTOR && allocate
+          && allocate_sector (inode, &inode->index[i], zero))
+        cache_write_logged (inode->index_sector, &inode->index[i],
+                     i * sizeof inode->index[i], sizeof inode->index[i]);
+      sector = inode->index[i];
+    }
+  lock_release (&inode->index_lock);
+  return sector;
+}
+
+/* Makes INODE's cached index block the one that maps data
+   sector IDX, which must not be a direct sector.  If that index
+   block, or the doubly indirect block above it, is a hole,
+   allocates it if ALLOCATE is true and fails otherwise.  Returns
+   true if successful.  The caller must hold INODE's index_lock,
+   and hold INODE for writing if ALLOCATE is true. */
+static bool
+load_index (struct inode *inode, size_t idx, bool allocate)
+{
+  struct inode_disk *data = &inode->data;
+  block_sector_t sector;
+  size_t first;
+
+  ASSERT (idx >= DIRECT_CNT);
+
+  if (idx < DIRECT_CNT + INDIRECT_CNT)
+    {
+      if (data->indirect == NO_SECTOR)
+        {
+          if (!allocate || !allocate_index (inode, &data->indirect))
+            return false;
+          inode->dirty = true;
+        }
+      sector = data->indirect;
+      first = DIRECT_CNT;
+    }
+  else if (idx < MAX_SECTORS)
+    {
+      size_t i = (idx - DIRECT_CNT - INDIRECT_CNT) / PTRS_PER_SECTOR;
+
+      if (data->doubly_indirect == NO_SECTOR)
+        {
+          if (!allocate || !allocate_index (inode, &data->doubly_indirect))
+            return false;
+          inode->dirty = true;
+        }
+      cache_read (data->doubly_indirect, &sector, i * sizeof sector,
+                  sizeof sector);
+      if (sector == NO_SECTOR)
+        {
+          if (!allocate || !allocate_index (inode, &sector))
+            return false;
+          cache_write_logged (data->doubly_indirect, &sector,
+                              i * sizeof sector, sizeof sector);
+        }
+      first = DIRECT_CNT + INDIRECT_CNT + i * PTRS_PER_SECTOR;
+    }
+  else
+    return false;
+
+  cache_read (sector, inode->index, 0, BLOCK_SECTOR_SIZE);
+  inode->index_sector = sector;
+  inode->index_first = first;
+  return true;
+}
+
+/* Allocates a data sector for INODE, zeroes it if ZERO is true,
+   and stores it into *SECTORP.  The sector comes from INODE's
+   reserved run, which is first refilled with up to run_want
+   sectors if it is empty.
+   Returns true if successful, false if the disk is full. */
+static bool
+allocate_sector (struct inode *inode, block_sector_t *sectorp, bool zero)
+{
+  if (inode->run_cnt == 0)
+    {
+      size_t want = inode->run_want > 0 ? inode->run_want : 1;
+
+      inode->run_cnt = free_map_allocate_near (inode->next_sector, want,
+                                               &inode->run_sector);
+      if (inode->run_cnt == 0)
+        return false;
+    }
+  *sectorp = inode->run_sector++;
+  inode->run_cnt--;
+  inode->next_sector = inode->run_sector;
+  if (zero)
+    write_data (inode, *sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Allocates an index block for INODE like allocate_sector(), and
+   zeroes it as part of the journal transaction. */
+static bool
+allocate_index (struct inode *inode, block_sector_t *sectorp)
+{
+  if (!allocate_sector (inode, sectorp, false))
+    return false;
+  cache_write_logged (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Returns true if INODE's data is file system metadata, whose
+   writes are journaled: a directory, or the free map. */
+static inline bool
+is_metadata (const struct inode *inode)
+{
+  return inode_is_dir (inode) || inode->sector == FREE_MAP_SECTOR;
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS within SECTOR, a
+   data sector of INODE, through the buffer cache, as part of the
+   journal transaction if INODE's data is metadata. */
+static void
+write_data (struct inode *inode, block_sector_t sector, const void *buffer,
+            size_t ofs, size_t size)
+{
+  if (is_metadata (inode))
+    cache_write_logged (sector, buffer, ofs, size);
   else
-    return -1;
+    cache_write (sector, buffer, ofs, size);
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns true if INODE keeps its data in the inode sector. */
+static inline bool
+is_inline (const struct inode *inode)
+{
+  return (inode->data.flags & INODE_INLINE) != 0;
+}
+
+/* Returns true if INODE was opened by inode_open_memory(), so
+   that its data is in MEM and it has nothing on disk. */
+static inline bool
+is_in_memory (const struct inode *inode)
+{
+  return inode->mem != NULL;
+}
+
+/* Returns true if INODE's data is all in memory already, inline
+   or in MEM, so that reading it needs no disk access. */
+static inline bool
+is_resident (const struct inode *inode)
+{
+  return is_inline (inode) || is_in_memory (inode);
+}
+
+/* Returns the data of resident INODE. */
+static inline const uint8_t *
+resident_data (const struct inode *inode)
+{
+  return (is_in_memory (inode) ? inode->mem
+          : (const uint8_t *) inode->data.direct);
+}
+
+/* Returns true if writes to INODE must fail: they are denied, or
+   INODE is in memory, which is read-only. */
+static inline bool
+is_read_only (const struct inode *inode)
+{
+  return inode->deny_write_cnt > 0 || is_in_memory (inode);
+}
+
+/* Returns true if INODE's data sectors may be shared with other
+   inodes. */
+static inline bool
+is_shared (const struct inode *inode)
+{
+  return (inode->data.flags & INODE_SHARED) != 0;
+}
+
+/* Makes sure that data sector IDX of INODE, at SECTOR, is not
+   shared with another inode before it is written, by giving
+   INODE a copy of its own if it is, with the same contents if
+   COPY is true, as part of the journal transaction.  Returns the
+   sector to write, or NO_SECTOR if the disk is full.  The caller
+   must hold INODE for writing. */
+static block_sector_t
+unshare_sector (struct inode *inode, size_t idx, block_sector_t sector,
+                bool copy)
+{
+  uint8_t buffer[BLOCK_SECTOR_SIZE];
+  block_sector_t own;
+
+  if (!is_shared (inode) || sector == NO_SECTOR || !free_map_shared (sector))
+    return sector;
+  if (!allocate_sector (inode, &own, false))
+    return NO_SECTOR;
+  if (copy)
+    {
+      cache_read (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+      cache_write (own, buffer, 0, BLOCK_SECTOR_SIZE);
+    }
+  remap_sector (inode, idx, own);
+  free_map_unshare (sector);
+  return own;
+}
+
+/* Returns the data of inline INODE. */
+static inline uint8_t *
+inline_data (struct inode *inode)
+{
+  return (uint8_t *) inode->data.direct;
+}
+
+/* Moves the data of inline INODE to a data sector of its own
+   and makes it an ordinary indexed inode, which the caller then
+   writes back.  The caller must hold INODE for writing and set
+   run_want.  Returns true if successful, false if the disk is
+   full. */
+static bool
+uninline (struct inode *inode)
+{
+  block_sector_t sector = NO_SECTOR;
+
+  ASSERT (is_inline (inode));
+
+  if (inode->data.length > 0)
+    {
+      if (!allocate_sector (inode, &sector, true))
+        return false;
+      write_data (inode, sector, inline_data (inode), 0, inode->data.length);
+    }
+  memset (inode->data.direct, 0, sizeof inode->data.direct);
+  inode->data.direct[0] = sector;
+  inode->data.valid_cnt = sector != NO_SECTOR;
+  inode->data.flags &= ~INODE_INLINE;
+  inode->dirty = true;
+  return true;
+}
+
+/* Zeroes the data sectors of INODE that were reserved past
+   valid_cnt and come before data sector IDX, and moves valid_cnt
+   up to IDX, ahead of a write to IDX.  The caller must hold INODE
+   for writing. */
+static void
+validate_before (struct inode *inode, size_t idx)
+{
+  while (inode->data.valid_cnt < idx)
+    {
+      block_sector_t sector
+        = byte_to_sector (inode, inode->data.valid_cnt * BLOCK_SECTOR_SIZE,
+                          false);
+      if (sector != NO_SECTOR)
+        write_data (inode, sector, zeros, 0, BLOCK_SECTOR_SIZE);
+      inode->data.valid_cnt++;
+      inode->dirty = true;
+    }
+}
+
+/* Releases SECTOR, which is a data sector if LEVEL is 0, or an
+   index block LEVEL levels above the data sectors, along with
+   every sector it maps.  Data sectors of an inode whose data may
+   be SHARED are released only if nobody else shares them. */
+static void
+release_index (block_sector_t sector, int level, bool shared)
+{
+  if (sector == NO_SECTOR)
+    return;
+  if (level == 0 && shared)
+    {
+      free_map_unshare (sector);
+      return;
+    }
+  if (level > 0)
+    {
+      size_t i;
+
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        {
+          block_sector_t child;
+
+          cache_read (sector, &child, i * sizeof child, sizeof child);
+          release_index (child, level - 1, shared);
+        }
+    }
+  free_map_release (sector, 1);
+}
+
+/* Releases the data sectors numbered KEEP and up that *SECTORP
+   maps, where *SECTORP is a data sector if LEVEL is 0, or an
+   index block LEVEL levels above the data sectors, and FIRST is
+   the first data sector it maps.  If that leaves *SECTORP
+   mapping nothing, releases it too and sets it to NO_SECTOR.
+   SHARED is as for release_index().  Returns true if *SECTORP
+   changed. */
+static bool
+release_from (block_sector_t *sectorp, int level, size_t first, size_t keep,
+              bool shared)
+{
+  size_t span = level == 0 ? 1 : level == 1 ? INDIRECT_CNT : DOUBLY_CNT;
+  size_t i;
+
+  if (*sectorp == NO_SECTOR || first + span <= keep)
+    return false;
+  if (first >= keep)
+    {
+      release_index (*sectorp, level, shared);
+      *sectorp = NO_SECTOR;
+      return true;
+    }
+  for (i = 0; i < PTRS_PER_SECTOR; i++)
+    {
+      block_sector_t child;
+
+      cache_read (*sectorp, &child, i * sizeof child, sizeof child);
+      if (release_from (&child, level - 1, first + i * (span / PTRS_PER_SECTOR),
+                        keep, shared))
+        cache_write_logged (*sectorp, &child, i * sizeof child,
+                            sizeof child);
+    }
+  return false;
+}
+
+/* Open inodes, keyed by sector, so that opening a single inode
+   twice returns the same `struct inode'.  Up to CLOSED_MAX
+   inodes that nobody has open any more also stay in the table,
+   on CLOSED_INODES from least to most recently closed, so that
+   opening them again does not read their sector again.
+   OPEN_LOCK protects both, every inode's OPEN_CNT and REMOVED,
+   and KEY, which is only used to look up a sector in the
+   table. */
+#define CLOSED_MAX 32
+static struct hash open_inodes;
+static struct list closed_inodes;
+static size_t closed_cnt;
+static struct lock open_lock;
+static struct inode key;
+
+/* Cache of in-memory inodes. */
+static struct kmem_cache *inode_cache;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+static struct inode *find_inode (block_sector_t);
+static struct inode *new_inode (block_sector_t);
+static void evict_closed (struct inode *);
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("Not enough memory for the open inode table.");
+  list_init (&closed_inodes);
+  lock_init (&open_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode), NULL);
+}
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, elem);
+  return hash_int (inode->sector);
+}
+
+/* Returns true if inode A precedes inode B. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
+
+/* Returns the inode in the table for SECTOR, open or recently
+   closed, or a null pointer if there is none.  The caller must
+   hold OPEN_LOCK. */
+static struct inode *
+find_inode (block_sector_t sector)
+{
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  return e != NULL ? hash_entry (e, struct inode, elem) : NULL;
+}
+
+/* Drops closed INODE from the table and frees it.  The caller
+   must hold OPEN_LOCK. */
+static void
+evict_closed (struct inode *inode)
+{
+  ASSERT (inode->open_cnt == 0);
+
+  list_remove (&inode->closed_elem);
+  closed_cnt--;
+  hash_delete (&open_inodes, &inode->elem);
+  free (inode->aux);
+#ifdef VM
+  share_drop (inode);
+#endif
+  kmem_cache_free (inode_cache, inode);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode is a directory if IS_DIR is true, an
+   ordinary file otherwise.  The data starts out as a hole, so no
+   data sectors are allocated until they are written, or inline
+   and zeroed if LENGTH is at most INLINE_MAX.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
+  struct inode *stale;
   bool success = false;
 
   ASSERT (length >= 0);
@@ -81,25 +603,22 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  /* Forget any closed inode that used to be in SECTOR. */
+  lock_acquire (&open_lock);
+  stale = find_inode (sector);
+  if (stale != NULL && stale->open_cnt == 0)
+    evict_closed (stale);
+  lock_release (&open_lock);
+
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      disk_inode->flags = ((is_dir ? INODE_DIR : 0)
+                           | ((size_t) length <= INLINE_MAX ? INODE_INLINE : 0));
+      cache_write_logged (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+      success = true; 
       free (disk_inode);
     }
   return success;
@@ -111,33 +630,96 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  /* Check whether this inode is already open, or was closed
+     recently. */
+  lock_acquire (&open_lock);
+  inode = find_inode (sector);
+  if (inode != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      if (inode->open_cnt++ == 0)
         {
-          inode_reopen (inode);
-          return inode; 
+          list_remove (&inode->closed_elem);
+          closed_cnt--;
         }
+      lock_release (&open_lock);
+      return inode; 
     }
 
-  /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  /* OPEN_LOCK stays held until the inode is read in, so that
+     nobody else finds it before then. */
+  inode = new_inode (sector);
+  if (inode != NULL)
+    cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  lock_release (&open_lock);
+  return inode;
+}
+
+/* Returns an inode, open once, whose data is the LENGTH bytes at
+   DATA, with INUMBER as its inode number, which must not be a
+   sector of the file system device.  Opening the same INUMBER
+   again returns the same inode until it is closed for the last
+   time, which frees it.  The inode has nothing on disk, and it
+   cannot be written, so DATA must stay in place for as long as
+   it may be opened.  Returns a null pointer if memory allocation
+   fails. */
+struct inode *
+inode_open_memory (block_sector_t inumber, const void *data, off_t length)
+{
+  struct inode *inode;
+
+  ASSERT (data != NULL);
+  ASSERT (length >= 0);
+
+  lock_acquire (&open_lock);
+  inode = find_inode (inumber);
+  if (inode != NULL)
+    {
+      ASSERT (is_in_memory (inode) && inode->open_cnt > 0);
+      inode->open_cnt++;
+    }
+  else
+    {
+      inode = new_inode (inumber);
+      if (inode != NULL)
+        {
+          memset (&inode->data, 0, sizeof inode->data);
+          inode->data.length = length;
+          inode->data.magic = INODE_MAGIC;
+          inode->mem = data;
+        }
+    }
+  lock_release (&open_lock);
+  return inode;
+}
+
+/* Allocates and initializes an inode for SECTOR, open once, and
+   adds it to the table, leaving its on-disk inode to the caller.
+   Returns a null pointer if memory allocation fails.  The caller
+   must hold OPEN_LOCK. */
+static struct inode *
+new_inode (block_sector_t sector)
+{
+  struct inode *inode = kmem_cache_alloc (inode_cache);
   if (inode == NULL)
     return NULL;
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
+  hash_insert (&open_inodes, &inode->elem);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->dirty = false;
+  inode->change_cnt = 0;
+  inode->mem = NULL;
+  inode->aux = NULL;
+  rw_init (&inode->rw, true);
+  rw_init (&inode->dir_rw, true);
+  lock_init (&inode->index_lock);
+  inode->index_sector = NO_SECTOR;
+  inode->next_sector = sector + 1;
+  inode->run_cnt = inode->run_want = 0;
   return inode;
 }
 
@@ -146,7 +728,12 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_lock);
+      ASSERT (inode->open_cnt > 0);
+      inode->open_cnt++;
+      lock_release (&open_lock);
+    }
   return inode;
 }
 
@@ -158,8 +745,11 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, keeps it among the
+   recently closed inodes, freeing the least recently closed one
+   if there are too many.
+   If INODE was also a removed inode, frees its memory and its
+   blocks instead. */
 void
 inode_close (struct inode *inode) 
 {
@@ -167,22 +757,74 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_lock);
+  if (--inode->open_cnt > 0)
+    {
+      lock_release (&open_lock);
+      return;
+    }
+
+  /* An in-memory inode is cheap to open again, so it is not kept
+     among the closed inodes. */
+  if (is_in_memory (inode))
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
+      hash_delete (&open_inodes, &inode->elem);
+      lock_release (&open_lock);
+      free (inode->aux);
+#ifdef VM
+      share_drop (inode);
+#endif
+      kmem_cache_free (inode_cache, inode);
+      return;
+    }
+
+  /* Deallocate blocks if removed. */
+  if (inode->removed) 
+    {
+      size_t i;
+
+      hash_delete (&open_inodes, &inode->elem);
+      lock_release (&open_lock);
+
+      journal_begin ();
+      if (!is_inline (inode))
         {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
-        }
+          bool shared = is_shared (inode);
 
-      free (inode); 
+          for (i = 0; i < DIRECT_CNT; i++)
+            release_index (inode->data.direct[i], 0, shared);
+          release_index (inode->data.indirect, 1, shared);
+          release_index (inode->data.doubly_indirect, 2, shared);
+        }
+      free_map_release (inode->sector, 1);
+      journal_end ();
+      free (inode->aux);
+#ifdef VM
+      share_drop (inode);
+#endif
+      kmem_cache_free (inode_cache, inode); 
+      return;
     }
+
+  list_push_back (&closed_inodes, &inode->closed_elem);
+  if (++closed_cnt > CLOSED_MAX)
+    evict_closed (list_entry (list_front (&closed_inodes),
+                              struct inode, closed_elem));
+  lock_release (&open_lock);
+}
+
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return (inode->data.flags & INODE_DIR) != 0;
+}
+
+/* Returns true if INODE has been removed. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,23 +833,41 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&open_lock);
   inode->removed = true;
+  lock_release (&open_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   Takes INODE for reading, so concurrent readers do not block
+   each other.  Bytes of a page that an executable maps, or has
+   mapped, come from its shared copy (see vm/share.h) instead of
+   the buffer cache. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
+  rw_read_acquire (&inode->rw);
+  if (is_resident (inode))
+    {
+      /* Resident data is already in memory. */
+      if (offset < inode_length (inode))
+        {
+          bytes_read = inode_length (inode) - offset;
+          if (size < bytes_read)
+            bytes_read = size;
+          memcpy (buffer, resident_data (inode) + offset, bytes_read);
+        }
+      size = 0;
+    }
   while (size > 0) 
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Starting byte offset within sector. */
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -220,110 +880,1028 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+#ifdef VM
+      {
+        off_t shared = share_read (inode, buffer + bytes_read, offset,
+                                   size < inode_left ? size : inode_left);
+        if (shared > 0)
+          {
+            size -= shared;
+            offset += shared;
+            bytes_read += shared;
+            continue;
+          }
+      }
+#endif
+
+      /* A hole reads as zeros, and so does a sector reserved but
+         not yet written. */
+      sector_idx = byte_to_sector (inode, offset, false);
+      if (sector_idx != NO_SECTOR
+          && (size_t) offset / BLOCK_SECTOR_SIZE < inode->data.valid_cnt)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+                    chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
+
+      /* Readers share INODE, so letting a more important thread
+         run in the middle of a big read holds up only writers. */
+      thread_cond_resched ();
     }
-  free (bounce);
+  rw_read_release (&inode->rw);
 
   return bytes_read;
 }
 
+/* Sectors inode_read_pages() reads, and inode_write_direct()
+   writes, with one request at most. */
+#define DIRECT_RUN_MAX 64
+
+/* Reads SIZE bytes from INODE, starting at OFFSET, which must be
+   a multiple of BLOCK_SECTOR_SIZE, into PAGES[0], PAGES[1] and so
+   on, PGSIZE bytes into each.  Returns the number of bytes
+   actually read, which may be less than SIZE if end of file is
+   reached.  Unlike inode_read_at(), reads whole sectors with
+   cache_read_direct(), so that each run of them adjacent on disk
+   lands in the pages with a single request without going through
+   the buffer cache.  Meant for loading a program. */
+off_t
+inode_read_pages (struct inode *inode, void *const pages[], off_t size,
+                  off_t offset)
+{
+  void *buffers[DIRECT_RUN_MAX];
+  block_sector_t run_start = NO_SECTOR;
+  size_t run_cnt = 0;
+  off_t bytes_read = 0;
+
+  ASSERT (offset % BLOCK_SECTOR_SIZE == 0);
+
+  rw_read_acquire (&inode->rw);
+  if (offset >= inode_length (inode))
+    size = 0;
+  else if (size > inode_length (inode) - offset)
+    size = inode_length (inode) - offset;
+  if (is_resident (inode))
+    {
+      /* Resident data is copied straight into the pages. */
+      for (; bytes_read < size; bytes_read += PGSIZE)
+        memcpy (pages[bytes_read / PGSIZE],
+                resident_data (inode) + offset + bytes_read,
+                size - bytes_read < PGSIZE ? size - bytes_read : PGSIZE);
+      bytes_read = size;
+    }
+  while (bytes_read < size)
+    {
+      uint8_t *dst = (uint8_t *) pages[bytes_read / PGSIZE]
+                     + bytes_read % PGSIZE;
+      off_t chunk_size = size - bytes_read;
+      size_t idx = (offset + bytes_read) / BLOCK_SECTOR_SIZE;
+      block_sector_t sector = NO_SECTOR;
+
+      if (chunk_size > BLOCK_SECTOR_SIZE)
+        chunk_size = BLOCK_SECTOR_SIZE;
+      if (idx < inode->data.valid_cnt)
+        sector = byte_to_sector (inode, offset + bytes_read, false);
+
+      /* Read the run so far unless this sector extends it. */
+      if (run_cnt > 0
+          && (sector == NO_SECTOR || sector != run_start + run_cnt
+              || chunk_size < BLOCK_SECTOR_SIZE
+              || run_cnt == DIRECT_RUN_MAX))
+        {
+          cache_read_direct (run_start, buffers, run_cnt);
+          run_cnt = 0;
+        }
+
+      /* Holes read as zeros, and a partial last sector through
+         the cache. */
+      if (sector == NO_SECTOR)
+        memset (dst, 0, chunk_size);
+      else if (chunk_size < BLOCK_SECTOR_SIZE)
+        cache_read (sector, dst, 0, chunk_size);
+      else
+        {
+          if (run_cnt == 0)
+            run_start = sector;
+          buffers[run_cnt++] = dst;
+        }
+      bytes_read += chunk_size;
+    }
+  if (run_cnt > 0)
+    cache_read_direct (run_start, buffers, run_cnt);
+  rw_read_release (&inode->rw);
+
+  return bytes_read;
+}
+
+/* Asks for the sectors of INODE that hold the SIZE bytes
+   starting at OFFSET to be read into the buffer cache in the
+   background, without waiting for them. */
+void
+inode_read_ahead (struct inode *inode, off_t offset, off_t size)
+{
+  off_t end = offset + size;
+
+  rw_read_acquire (&inode->rw);
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  if (is_resident (inode))
+    end = 0;
+  else if (end > (off_t) (inode->data.valid_cnt * BLOCK_SECTOR_SIZE))
+    end = inode->data.valid_cnt * BLOCK_SECTOR_SIZE;
+  for (offset -= offset % BLOCK_SECTOR_SIZE; offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, offset, false);
+      if (sector != NO_SECTOR)
+        cache_read_ahead (sector);
+    }
+  rw_read_release (&inode->rw);
+}
+
+/* Tells the buffer cache that the sectors of INODE that lie
+   wholly within the SIZE bytes starting at OFFSET will not be
+   wanted again soon, so that their entries are reused first. */
+void
+inode_drop_cache (struct inode *inode, off_t offset, off_t size)
+{
+  off_t end = offset + size;
+
+  rw_read_acquire (&inode->rw);
+  if (end > inode_length (inode))
+    end = ROUND_UP (inode_length (inode), BLOCK_SECTOR_SIZE);
+  if (is_resident (inode))
+    end = 0;
+  else if (end > (off_t) (inode->data.valid_cnt * BLOCK_SECTOR_SIZE))
+    end = inode->data.valid_cnt * BLOCK_SECTOR_SIZE;
+  for (offset = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+       offset + BLOCK_SECTOR_SIZE <= end; offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, offset, false);
+      if (sector != NO_SECTOR)
+        cache_drop (sector);
+    }
+  rw_read_release (&inode->rw);
+}
+
+/* Writes INODE's data, its index blocks and its on-disk inode
+   from the buffer cache to disk, committing the journal first so
+   that the metadata is there too, and then flushes the disk's
+   write cache, so that all of it is durable on return.  Runs of
+   data sectors that are adjacent on disk are flushed together. */
+void
+inode_flush (struct inode *inode)
+{
+  size_t cnt = bytes_to_sectors (inode_length (inode));
+  block_sector_t run_start = NO_SECTOR;
+  size_t run_cnt = 0;
+  size_t idx;
+
+  if (is_in_memory (inode))
+    return;
+  journal_commit ();
+  rw_read_acquire (&inode->rw);
+  if (is_inline (inode))
+    cnt = 0;
+  for (idx = 0; idx < cnt; idx++)
+    {
+      block_sector_t sector = byte_to_sector (inode,
+                                              idx * BLOCK_SECTOR_SIZE,
+                                              false);
+      if (sector == NO_SECTOR)
+        continue;
+      if (run_cnt > 0 && sector == run_start + run_cnt)
+        run_cnt++;
+      else
+        {
+          if (run_cnt > 0)
+            cache_flush_range (run_start, run_cnt);
+          run_start = sector;
+          run_cnt = 1;
+        }
+    }
+  if (run_cnt > 0)
+    cache_flush_range (run_start, run_cnt);
+
+  if (inode->data.indirect != NO_SECTOR)
+    cache_flush_range (inode->data.indirect, 1);
+  if (inode->data.doubly_indirect != NO_SECTOR)
+    {
+      for (idx = 0; idx < PTRS_PER_SECTOR; idx++)
+        {
+          block_sector_t sector;
+
+          cache_read (inode->data.doubly_indirect, &sector,
+                      idx * sizeof sector, sizeof sector);
+          if (sector != NO_SECTOR)
+            cache_flush_range (sector, 1);
+        }
+      cache_flush_range (inode->data.doubly_indirect, 1);
+    }
+  cache_flush_range (inode->sector, 1);
+  rw_read_release (&inode->rw);
+  block_flush (fs_device);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or the largest file size
+   is reached.  A write past end of file extends the inode,
+   leaving a hole between the old end and OFFSET.
+   Each WRITE_CHUNK bytes are written in a journal transaction
+   of their own, taking INODE for writing, excluding readers and
+   other writers. */
 off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
                 off_t offset) 
 {
-  const uint8_t *buffer = buffer_;
+  return write_at (inode, buffer, size, offset, false);
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   as inode_write_at() does, except that whole sectors of data go
+   straight to disk with cache_write_direct(), a run of them
+   adjacent on disk with a single request, instead of through
+   the buffer cache.  BUFFER must be in kernel memory that the
+   disk can reach, contiguous in physical memory.  Meant for
+   large writes that will not be read back soon. */
+off_t
+inode_write_direct (struct inode *inode, const void *buffer, off_t size,
+                    off_t offset)
+{
+  return write_at (inode, buffer, size, offset, true);
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   for inode_write_at() and, if DIRECT, inode_write_direct(). */
+static off_t
+write_at (struct inode *inode, const uint8_t *buffer, off_t size,
+          off_t offset, bool direct)
+{
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
-  if (inode->deny_write_cnt)
-    return 0;
+  while (bytes_written < size)
+    {
+      off_t chunk = size - bytes_written;
+      off_t chunk_written;
+
+      if (chunk > WRITE_CHUNK)
+        chunk = WRITE_CHUNK;
+      journal_begin ();
+      chunk_written = write_chunk (inode, buffer + bytes_written, chunk,
+                                   offset + bytes_written, direct);
+      journal_end ();
+      bytes_written += chunk_written;
+      if (chunk_written < chunk)
+        break;
 
+      /* Between chunks INODE and the journal are free. */
+      thread_cond_resched ();
+    }
+  return bytes_written;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   for write_at(), as part of the current journal transaction.
+   If DIRECT, whole sectors of data bypass the buffer cache. */
+static off_t
+write_chunk (struct inode *inode, const uint8_t *buffer, off_t size,
+             off_t offset, bool direct)
+{
+  const void *run[DIRECT_RUN_MAX];
+  block_sector_t run_start = NO_SECTOR;
+  size_t run_cnt = 0;
+  off_t bytes_written = 0;
+
+  rw_write_acquire (&inode->rw);
+  if (is_read_only (inode))
+    {
+      rw_write_release (&inode->rw);
+      return 0;
+    }
+#ifdef VM
+  share_invalidate (inode, offset, size);
+#endif
+
+  /* A write that fits stays inline.  One that does not moves the
+     data out first. */
+  if (is_inline (inode) && size > 0)
+    {
+      if (offset + size <= (off_t) INLINE_MAX)
+        {
+          memcpy (inline_data (inode) + offset, buffer, size);
+          bytes_written = size;
+          if (offset + size > inode->data.length)
+            inode->data.length = offset + size;
+          inode->dirty = true;
+          size = 0;
+        }
+      else
+        {
+          inode->run_want = DIV_ROUND_UP (offset + size, BLOCK_SECTOR_SIZE);
+          if (!uninline (inode))
+            size = 0;
+        }
+    }
   while (size > 0) 
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Sector to write, allocated if it was a hole, and
+         starting byte offset within sector.  A new run is
+         reserved big enough for the rest of the write.  A sector
+         past valid_cnt is written as if it were new. */
+      size_t idx = offset / BLOCK_SECTOR_SIZE;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      bool fresh = idx >= inode->data.valid_cnt;
+      block_sector_t sector_idx;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      if (fresh)
+        validate_before (inode, idx);
+      inode->run_want = DIV_ROUND_UP (sector_ofs + size, BLOCK_SECTOR_SIZE);
+      sector_idx = byte_to_sector (inode, offset, true);
 
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int chunk_size = size < sector_left ? size : sector_left;
+      if (!fresh)
+        sector_idx = unshare_sector (inode, idx, sector_idx,
+                                     chunk_size < BLOCK_SECTOR_SIZE);
+      if (sector_idx == NO_SECTOR)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* The cache reads in the sector first unless the chunk
+         covers all of it, so a fresh sector is zeroed first
+         instead. */
+      if (fresh)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          if (chunk_size < BLOCK_SECTOR_SIZE)
+            write_data (inode, sector_idx, zeros, 0, BLOCK_SECTOR_SIZE);
+          inode->data.valid_cnt = idx + 1;
+          inode->dirty = true;
         }
-      else 
+
+      /* A whole sector written directly extends the run so far,
+         or else ends it and starts another. */
+      if (direct && chunk_size == BLOCK_SECTOR_SIZE && !is_metadata (inode))
         {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
+          if (run_cnt > 0 && (sector_idx != run_start + run_cnt
+                              || run_cnt == DIRECT_RUN_MAX))
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              cache_write_direct (run_start, run, run_cnt);
+              run_cnt = 0;
             }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          if (run_cnt == 0)
+            run_start = sector_idx;
+          run[run_cnt++] = buffer + bytes_written;
         }
+      else
+        write_data (inode, sector_idx, buffer + bytes_written, sector_ofs,
+                    chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
+      if (offset > inode->data.length)
+        {
+          inode->data.length = offset;
+          inode->dirty = true;
+        }
     }
-  free (bounce);
+  if (run_cnt > 0)
+    cache_write_direct (run_start, run, run_cnt);
+  finish_change (inode);
+  rw_write_release (&inode->rw);
 
   return bytes_written;
 }
 
-/* Disables writes to INODE.
+/* Writes back INODE's on-disk inode if it changed and gives back
+   what is left of its reserved run, at the end of a change made
+   while holding INODE for writing.  Drops INODE's auxiliary data,
+   which may no longer match its contents, and counts the change
+   in change_cnt. */
+static void
+finish_change (struct inode *inode)
+{
+  inode->change_cnt++;
+  if (inode->aux != NULL)
+    {
+      free (inode->aux);
+      inode->aux = NULL;
+    }
+  if (inode->dirty)
+    {
+      cache_write_logged (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+      inode->dirty = false;
+    }
+  if (inode->run_cnt > 0)
+    {
+      free_map_release (inode->run_sector, inode->run_cnt);
+      inode->run_cnt = 0;
+    }
+}
+
+/* Allocates the data sectors of INODE that hold the SIZE bytes
+   starting at OFFSET, as one run if the free map allows, and
+   extends INODE to OFFSET + SIZE bytes if it is shorter.  Sectors
+   past the data written so far are only reserved, not zeroed.
+   Returns true if successful, false if the disk fills up, the
+   range is beyond the largest file size, or writes are denied;
+   sectors already allocated then stay allocated.
+   Like inode_write_at(), allocates WRITE_CHUNK bytes per journal
+   transaction. */
+bool
+inode_allocate (struct inode *inode, off_t offset, off_t size)
+{
+  off_t end = offset + size;
+  bool success = true;
+
+  ASSERT (offset >= 0 && size >= 0);
+
+  if (end < offset || end > (off_t) (MAX_SECTORS * BLOCK_SECTOR_SIZE))
+    return false;
+
+  do
+    {
+      off_t chunk = size < WRITE_CHUNK ? size : WRITE_CHUNK;
+
+      journal_begin ();
+      success = allocate_chunk (inode, offset, chunk);
+      journal_end ();
+      offset += chunk;
+      size -= chunk;
+    }
+  while (success && size > 0);
+  return success;
+}
+
+/* Allocates the SIZE bytes of INODE starting at OFFSET for
+   inode_allocate(), as part of the current journal
+   transaction. */
+static bool
+allocate_chunk (struct inode *inode, off_t offset, off_t size)
+{
+  off_t end = offset + size;
+  size_t idx, cnt;
+  bool success = true;
+
+  rw_write_acquire (&inode->rw);
+  if (is_read_only (inode))
+    {
+      rw_write_release (&inode->rw);
+      return false;
+    }
+
+  /* Inline data has room up to INLINE_MAX already. */
+  cnt = bytes_to_sectors (end);
+  if (is_inline (inode) && (size_t) end > INLINE_MAX)
+    {
+      inode->run_want = cnt;
+      success = uninline (inode);
+    }
+  if (success && !is_inline (inode))
+    for (idx = offset / BLOCK_SECTOR_SIZE; idx < cnt; idx++)
+      {
+        inode->run_want = cnt - idx;
+        if (byte_to_sector (inode, idx * BLOCK_SECTOR_SIZE, true) == NO_SECTOR)
+          {
+            success = false;
+            break;
+          }
+      }
+  if (success && end > inode->data.length)
+    {
+      inode->data.length = end;
+      inode->dirty = true;
+    }
+  finish_change (inode);
+  rw_write_release (&inode->rw);
+  return success;
+}
+
+/* Sets the length of INODE to LENGTH bytes.  Shrinking it
+   releases the data sectors past the new end; growing it leaves
+   a hole.  Returns true if successful, false if LENGTH is beyond
+   the largest file size, the disk is full, or writes are
+   denied. */
+bool
+inode_truncate (struct inode *inode, off_t length)
+{
+  struct inode_disk *data = &inode->data;
+  bool success = true;
+
+  ASSERT (length >= 0);
+
+  if (length > (off_t) (MAX_SECTORS * BLOCK_SECTOR_SIZE))
+    return false;
+
+  journal_begin ();
+  rw_write_acquire (&inode->rw);
+  if (is_read_only (inode))
+    {
+      rw_write_release (&inode->rw);
+      journal_end ();
+      return false;
+    }
+#ifdef VM
+  share_invalidate (inode, length, data->length - length);
+#endif
+
+  if (is_inline (inode))
+    {
+      /* Bytes past the end of inline data must stay zero. */
+      if (length < data->length)
+        memset (inline_data (inode) + length, 0, data->length - length);
+      else if ((size_t) length > INLINE_MAX)
+        {
+          inode->run_want = 1;
+          success = uninline (inode);
+        }
+    }
+  else if (length < data->length)
+    {
+      size_t keep = bytes_to_sectors (length);
+      bool shared = is_shared (inode);
+      size_t i;
+
+      for (i = keep; i < DIRECT_CNT; i++)
+        release_from (&data->direct[i], 0, i, keep, shared);
+      release_from (&data->indirect, 1, DIRECT_CNT, keep, shared);
+      release_from (&data->doubly_indirect, 2, DIRECT_CNT + INDIRECT_CNT,
+                    keep, shared);
+      if (data->valid_cnt > keep)
+        data->valid_cnt = keep;
+
+      /* A later write past the new end must find zeros in the
+         rest of the last sector. */
+      if (length % BLOCK_SECTOR_SIZE != 0 && keep <= data->valid_cnt)
+        {
+          int ofs = length % BLOCK_SECTOR_SIZE;
+          block_sector_t sector = byte_to_sector (inode, length, false);
+
+          inode->run_want = 1;
+          sector = unshare_sector (inode, keep - 1, sector, true);
+          if (sector != NO_SECTOR)
+            write_data (inode, sector, zeros, ofs, BLOCK_SECTOR_SIZE - ofs);
+        }
+
+      lock_acquire (&inode->index_lock);
+      inode->index_sector = NO_SECTOR;
+      lock_release (&inode->index_lock);
+    }
+  if (success && length != data->length)
+    {
+      data->length = length;
+      inode->dirty = true;
+    }
+  finish_change (inode);
+  rw_write_release (&inode->rw);
+  journal_end ();
+  return success;
+}
+
+/* Returns the number of extents of INODE, the runs of data
+   sectors that are adjacent on disk, in file order, and stores
+   the number of data sectors allocated into *SECTORS.  The
+   caller must hold INODE. */
+static size_t
+count_extents (struct inode *inode, size_t *sectors)
+{
+  size_t cnt = (is_resident (inode) ? 0
+                : bytes_to_sectors (inode_length (inode)));
+  block_sector_t next = NO_SECTOR;
+  size_t extents = 0;
+  size_t idx;
+
+  *sectors = 0;
+  for (idx = 0; idx < cnt; idx++)
+    {
+      block_sector_t sector = byte_to_sector (inode, idx * BLOCK_SECTOR_SIZE,
+                                              false);
+      if (sector == NO_SECTOR)
+        continue;
+      if (sector != next)
+        extents++;
+      next = sector + 1;
+      (*sectors)++;
+    }
+  return extents;
+}
+
+/* Returns the number of extents of INODE: 1 for a file whose
+   data sectors are all adjacent on disk, in order, and more the
+   more fragmented it is.  Holes and inline data take none. */
+size_t
+inode_extents (struct inode *inode)
+{
+  size_t extents, sectors;
+
+  rw_read_acquire (&inode->rw);
+  extents = count_extents (inode, &sectors);
+  rw_read_release (&inode->rw);
+  return extents;
+}
+
+/* Data sectors that inode_defrag() moves in one journal
+   transaction. */
+#define DEFRAG_CHUNK (WRITE_CHUNK / BLOCK_SECTOR_SIZE)
+
+/* Points data sector IDX of INODE at SECTOR, as part of the
+   journal transaction, allocating the index blocks that map it
+   first if they are holes.  Returns true if successful, false if
+   the disk is full.  The caller must hold INODE for writing. */
+static bool
+remap_sector (struct inode *inode, size_t idx, block_sector_t sector)
+{
+  size_t i;
+
+  if (idx < DIRECT_CNT)
+    {
+      inode->data.direct[idx] = sector;
+      inode->dirty = true;
+      return true;
+    }
+
+  lock_acquire (&inode->index_lock);
+  if ((inode->index_sector == NO_SECTOR
+       || idx - inode->index_first >= PTRS_PER_SECTOR)
+      && !load_index (inode, idx, true))
+    {
+      lock_release (&inode->index_lock);
+      return false;
+    }
+  i = idx - inode->index_first;
+  inode->index[i] = sector;
+  cache_write_logged (inode->index_sector, &inode->index[i],
+                      i * sizeof inode->index[i], sizeof inode->index[i]);
+  lock_release (&inode->index_lock);
+  return true;
+}
+
+/* Allocates a run of CNT free sectors to move CNT data sectors
+   to, preferably starting at HINT, where the data just before
+   them ends, if that is not NO_SECTOR, and stores the first into
+   *SECTORP.  Failing that, unless IN_ORDER, which means the data
+   sectors are adjacent already and only worth moving to HINT,
+   looks for a run big enough for REST sectors, the rest of the
+   file, so that the runs allocated next can follow this one
+   there, and keeps only CNT of it; failing that too, for any run
+   of CNT.  Returns true if successful. */
+static bool
+allocate_target (size_t cnt, size_t rest, block_sector_t hint,
+                 bool in_order, block_sector_t *sectorp)
+{
+  block_sector_t sector;
+  size_t got;
+
+  if (hint != NO_SECTOR)
+    {
+      got = free_map_allocate_near (hint, cnt, &sector);
+      if (got == cnt && (sector == hint || !in_order))
+        {
+          *sectorp = sector;
+          return true;
+        }
+      if (got > 0)
+        free_map_release (sector, got);
+    }
+  if (in_order)
+    return false;
+  if (rest > cnt && free_map_allocate (rest, &sector))
+    {
+      free_map_release (sector + cnt, rest - cnt);
+      *sectorp = sector;
+      return true;
+    }
+  return free_map_allocate (cnt, sectorp);
+}
+
+/* Moves the data sectors numbered FIRST through FIRST + CNT - 1
+   of INODE, at most DEFRAG_CHUNK, to a run of adjacent free
+   sectors that begins at *HINT if it can, unless they are there
+   already, and sets *HINT to the sector after them.  The data is
+   copied through the buffer cache while INODE is held for
+   reading, so that readers go on meanwhile, and then the new
+   sectors are swapped in, and the old ones released, in one
+   journal transaction while INODE is held for writing, unless
+   INODE changed in between.  *REST is the number of data sectors
+   of the file from FIRST on, and goes down by those seen.
+   Returns the number of sectors moved. */
+static size_t
+defrag_chunk (struct inode *inode, size_t first, size_t cnt, size_t *rest,
+              block_sector_t *hint)
+{
+  block_sector_t old[DEFRAG_CHUNK];
+  uint8_t buffer[BLOCK_SECTOR_SIZE];
+  block_sector_t start, prev = NO_SECTOR;
+  unsigned long change_cnt;
+  bool in_order = true, in_place;
+  size_t groups = 0;
+  size_t i, n = 0, moved = 0;
+
+  ASSERT (cnt <= DEFRAG_CHUNK);
+
+  journal_begin ();
+  rw_read_acquire (&inode->rw);
+  change_cnt = inode->change_cnt;
+  for (i = 0; i < cnt; i++)
+    {
+      old[i] = NO_SECTOR;
+      if ((first + i) * BLOCK_SECTOR_SIZE < (size_t) inode_length (inode))
+        old[i] = byte_to_sector (inode, (first + i) * BLOCK_SECTOR_SIZE,
+                                 false);
+      if (old[i] == NO_SECTOR)
+        continue;
+
+      /* The free map has a sector of bits for each
+         BLOCK_SECTOR_SIZE * CHAR_BIT sectors, each of which
+         releasing the old sectors may log. */
+      if (n == 0 || old[i] / (BLOCK_SECTOR_SIZE * CHAR_BIT)
+                    != prev / (BLOCK_SECTOR_SIZE * CHAR_BIT))
+        groups++;
+      if (n > 0 && old[i] != prev + 1)
+        in_order = false;
+      prev = old[i];
+      n++;
+    }
+  *rest = *rest > n ? *rest - n : 0;
+  in_place = (in_order && n > 0
+              && (*hint == NO_SECTOR || prev + 1 - n == *hint));
+  if (n == 0 || in_place
+      || !allocate_target (n, *rest + n, *hint, in_order, &start))
+    {
+      rw_read_release (&inode->rw);
+      journal_end ();
+      *hint = n > 0 && in_order ? prev + 1 : NO_SECTOR;
+      return 0;
+    }
+
+  /* Copy.  Sectors reserved past valid_cnt hold nothing yet. */
+  for (i = 0, n = 0; i < cnt; i++)
+    if (old[i] != NO_SECTOR)
+      {
+        if (first + i < inode->data.valid_cnt)
+          {
+            cache_read (old[i], buffer, 0, BLOCK_SECTOR_SIZE);
+            cache_write (start + n, buffer, 0, BLOCK_SECTOR_SIZE);
+          }
+        n++;
+      }
+  rw_read_release (&inode->rw);
+
+  /* Swap, unless a writer got in first, a clone now shares the
+     data, or the swap might not fit in the log. */
+  rw_write_acquire (&inode->rw);
+  if (inode->change_cnt == change_cnt && !is_shared (inode)
+      && journal_room (groups))
+    {
+      for (i = 0, n = 0; i < cnt; i++)
+        if (old[i] != NO_SECTOR)
+          {
+            remap_sector (inode, first + i, start + n++);
+            free_map_release (old[i], 1);
+            cache_drop (old[i]);
+          }
+      finish_change (inode);
+      moved = n;
+      *hint = start + n;
+    }
+  else
+    {
+      free_map_release (start, n);
+      *hint = NO_SECTOR;
+    }
+  rw_write_release (&inode->rw);
+  journal_end ();
+  return moved;
+}
+
+/* Moves the data sectors of INODE so that they are adjacent on
+   disk, in file order, as far as the free space allows, to make
+   reading it sequentially take fewer and longer requests.  The
+   data is moved DEFRAG_CHUNK sectors at a time, each in a journal
+   transaction of its own, and stays readable throughout.
+   Directories and the free map, whose data is journaled, are
+   left as they are, and so are files whose data may be shared,
+   since moving it would give them copies of their own.  Returns
+   the number of sectors moved. */
+size_t
+inode_defrag (struct inode *inode)
+{
+  block_sector_t hint = NO_SECTOR;
+  size_t cnt, rest, first;
+  size_t moved = 0;
+
+  if (is_metadata (inode) || is_shared (inode))
+    return 0;
+  rw_read_acquire (&inode->rw);
+  cnt = 0;
+  if (count_extents (inode, &rest) > 1)
+    cnt = bytes_to_sectors (inode_length (inode));
+  rw_read_release (&inode->rw);
+
+  for (first = 0; first < cnt; first += DEFRAG_CHUNK)
+    {
+      size_t n = cnt - first < DEFRAG_CHUNK ? cnt - first : DEFRAG_CHUNK;
+
+      moved += defrag_chunk (inode, first, n, &rest, &hint);
+
+      /* Between chunks INODE and the journal are free. */
+      thread_cond_resched ();
+    }
+  return moved;
+}
+
+/* Data sectors that inode_clone() maps in one journal
+   transaction: those of one index block. */
+#define CLONE_CHUNK PTRS_PER_SECTOR
+
+/* Takes inodes A and B for writing, in the order of their
+   sectors, so that two clones between them cannot deadlock. */
+static void
+lock_pair (struct inode *a, struct inode *b)
+{
+  if (a->sector > b->sector)
+    {
+      struct inode *t = a;
+      a = b;
+      b = t;
+    }
+  rw_write_acquire (&a->rw);
+  rw_write_acquire (&b->rw);
+}
+
+/* Makes the data sectors of DST numbered FIRST through
+   FIRST + CLONE_CHUNK - 1 those of SRC, for inode_clone(), in a
+   journal transaction, and sets *DONE to true if that was the
+   last of them.  SRC must not have changed since *CHANGE_CNT,
+   unless FIRST is 0; *CHANGE_CNT is updated.  Returns true if
+   successful, false if SRC changed, writes to DST are denied, or
+   the disk or the sharing counts are full. */
+static bool
+clone_chunk (struct inode *dst, struct inode *src, size_t first,
+             unsigned long *change_cnt, bool *done)
+{
+  size_t cnt, end, idx;
+  bool success = true;
+
+  journal_begin ();
+  lock_pair (dst, src);
+  cnt = bytes_to_sectors (inode_length (src));
+  if (src->data.valid_cnt < cnt)
+    cnt = src->data.valid_cnt;
+  end = cnt - first < CLONE_CHUNK ? cnt : first + CLONE_CHUNK;
+  if (is_read_only (dst) || (first > 0 && src->change_cnt != *change_cnt))
+    success = false;
+  else if (is_inline (src))
+    {
+      /* The data is in the inode, so copying it is enough. */
+      memcpy (dst->data.direct, src->data.direct, sizeof dst->data.direct);
+      dst->data.flags |= INODE_INLINE;
+      dst->data.length = src->data.length;
+      dst->dirty = true;
+      *done = true;
+    }
+  else
+    {
+      if (is_inline (dst))
+        uninline (dst);
+      dst->data.flags |= INODE_SHARED;
+      dst->dirty = true;
+      if (!is_shared (src))
+        {
+          src->data.flags |= INODE_SHARED;
+          src->dirty = true;
+        }
+
+      /* Sectors past valid_cnt are only reserved, so DST gets
+         holes there instead of sharing them. */
+      for (idx = first; idx < end; idx++)
+        {
+          block_sector_t sector = byte_to_sector (src, idx * BLOCK_SECTOR_SIZE,
+                                                  false);
+          if (sector == NO_SECTOR)
+            continue;
+          dst->run_want = 1;
+          if (!free_map_share (sector))
+            {
+              success = false;
+              break;
+            }
+          if (!remap_sector (dst, idx, sector))
+            {
+              free_map_unshare (sector);
+              success = false;
+              break;
+            }
+        }
+      dst->data.valid_cnt = idx;
+      *done = idx == cnt;
+      dst->data.length = (*done ? src->data.length
+                          : (off_t) idx * BLOCK_SECTOR_SIZE);
+    }
+#ifdef VM
+  share_invalidate (dst, 0, dst->data.length);
+#endif
+  finish_change (dst);
+  if (src->dirty)
+    finish_change (src);
+  *change_cnt = src->change_cnt;
+  rw_write_release (&src->rw);
+  rw_write_release (&dst->rw);
+  journal_end ();
+  return success;
+}
+
+/* Makes DST, an ordinary file, a copy of SRC, another one, by
+   pointing DST at SRC's data sectors instead of copying them, so
+   that a clone of a file of any size writes only index blocks
+   and reference counts.  From then on both files release their
+   data sectors through the free map's reference counts, and the
+   first write to a sector that is still shared gives the writer
+   a copy of its own.  The sectors are mapped CLONE_CHUNK at a
+   time, each in a journal transaction of its own, with both
+   inodes held for writing.  Returns true if successful, false
+   if DST is SRC or a directory, writes to DST are denied, SRC
+   is in memory or was written meanwhile, or the disk or the reference counts are
+   full, in which case DST is left empty. */
+bool
+inode_clone (struct inode *dst, struct inode *src)
+{
+  unsigned long change_cnt = 0;
+  bool done = false;
+  size_t first;
+
+  if (dst == src || is_metadata (dst) || is_metadata (src)
+      || is_in_memory (src) || !inode_truncate (dst, 0))
+    return false;
+
+  for (first = 0; !done; first += CLONE_CHUNK)
+    {
+      if (!clone_chunk (dst, src, first, &change_cnt, &done))
+        {
+          inode_truncate (dst, 0);
+          return false;
+        }
+
+      /* Between chunks the inodes and the journal are free. */
+      thread_cond_resched ();
+    }
+  return true;
+}
+
+/* Disables writes to INODE, after waiting for any write in
+   progress to finish.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rw_write_acquire (&inode->rw);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rw_write_release (&inode->rw);
+}
+
+/* Returns the auxiliary data attached to INODE with
+   inode_set_aux(), or a null pointer if there is none.  The
+   caller must have denied writes to INODE, which keeps the data
+   from being dropped while it is in use. */
+void *
+inode_get_aux (struct inode *inode)
+{
+  void *aux;
+
+  ASSERT (inode->deny_write_cnt > 0);
+  rw_read_acquire (&inode->rw);
+  aux = inode->aux;
+  rw_read_release (&inode->rw);
+  return aux;
+}
+
+/* Attaches AUX, a block from malloc() holding data derived from
+   INODE's contents, such as an executable's parsed headers, to
+   INODE.  INODE frees AUX when its contents next change or when
+   INODE itself is freed, which may be long after it is last
+   closed.  Returns false, and does not take AUX, if INODE
+   already has auxiliary data.  The caller must have denied
+   writes to INODE. */
+bool
+inode_set_aux (struct inode *inode, void *aux)
+{
+  bool success;
+
+  ASSERT (inode->deny_write_cnt > 0);
+  rw_write_acquire (&inode->rw);
+  success = inode->aux == NULL;
+  if (success)
+    inode->aux = aux;
+  rw_write_release (&inode->rw);
+  return success;
 }
 
 /* Re-enables writes to INODE.
@@ -332,12 +1910,43 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rw_write_acquire (&inode->rw);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rw_write_release (&inode->rw);
+}
+
+/* Takes INODE as a directory, shared if EXCLUSIVE is false.
+   Directories hold it across the several reads and writes of
+   the directory's data that one lookup, addition or removal
+   takes, so that lookups run in parallel but each change runs
+   alone.  No inode function takes it, so the holder may still
+   read and write INODE. */
+void
+inode_lock (struct inode *inode, bool exclusive)
+{
+  if (exclusive)
+    rw_write_acquire (&inode->dir_rw);
+  else
+    rw_read_acquire (&inode->dir_rw);
+}
+
+/* Releases INODE as a directory, as taken by inode_lock() with
+   the same EXCLUSIVE. */
+void
+inode_unlock (struct inode *inode, bool exclusive)
+{
+  if (exclusive)
+    rw_write_release (&inode->dir_rw);
+  else
+    rw_read_release (&inode->dir_rw);
 }
 
-/* Returns the length, in bytes, of INODE's data. */
+/* Returns the length, in bytes, of INODE's data.
+   The length is a single aligned word that only a writer holding
+   INODE changes, so reading it needs no lock and file_length()
+   never waits on other readers. */
 off_t
 inode_length (const struct inode *inode)
 {
@@ -8,16 +8,35 @@
 struct bitmap;
 
 void inode_init (void);
-bool inode_create (block_sector_t, off_t);
+bool inode_create (block_sector_t, off_t, bool is_dir);
 struct inode *inode_open (block_sector_t);
+struct inode *inode_open_memory (block_sector_t, const void *, off_t length);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+bool inode_is_dir (const struct inode *);
+bool inode_is_removed (const struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+off_t inode_read_pages (struct inode *, void *const pages[], off_t size,
+                        off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_write_direct (struct inode *, const void *, off_t size,
+                          off_t offset);
+bool inode_allocate (struct inode *, off_t offset, off_t size);
+bool inode_truncate (struct inode *, off_t length);
+size_t inode_extents (struct inode *);
+size_t inode_defrag (struct inode *);
+bool inode_clone (struct inode *dst, struct inode *src);
+void inode_read_ahead (struct inode *, off_t offset, off_t size);
+void inode_drop_cache (struct inode *, off_t offset, off_t size);
+void inode_flush (struct inode *);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+void *inode_get_aux (struct inode *);
+bool inode_set_aux (struct inode *, void *aux);
 off_t inode_length (const struct inode *);
+void inode_lock (struct inode *, bool exclusive);
+void inode_unlock (struct inode *, bool exclusive);
 
 #endif /* filesys/inode.h */
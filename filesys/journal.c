@@ -0,0 +1,393 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/checksum.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Metadata journal.
+
+   Each change to the file system's metadata, such as creating or
+   removing a file or allocating the sectors of a write, runs as
+   a transaction between journal_begin() and journal_end().  The
+   inode sectors, index blocks, directory data and free map
+   sectors it writes through cache_write_logged() join the
+   running transaction instead of going to disk on their own:
+   their cache entries are not written back to their own sectors
+   until the transaction commits, and an entry that must be
+   reused meanwhile is written to its sector's slot in the log
+   instead, and read back from there.
+
+   Transactions are committed in groups.  A commit waits for the
+   transactions in progress to end, writes every logged sector
+   to the log, and then writes the header that lists them, which
+   is the point at which they all take effect.  Only then are the
+   sectors written to their own places, after which the header is
+   cleared.  If the system stops in between, journal_init() finds
+   the header and writes the logged sectors to their places again
+   when the file system is next mounted.  The header is written
+   with BIO_PREFLUSH and BIO_FUA, and cleared with BIO_PREFLUSH,
+   so that a disk with a write cache keeps these steps in order
+   at the cost of a few cache flushes per commit, not one per
+   sector written.  Writing the same sector
+   in many transactions, as a loop that creates and removes files
+   does with its directory and the free map, logs it only once
+   per commit.
+
+   A commit happens when a transaction starts and the log might
+   not have room for it, every COMMIT_TICKS, and when
+   journal_commit() is called, as by fsync() and at shutdown.
+   Each transaction reserves room for OP_MAX sectors when it
+   starts, so that one in progress never finds the log full.  The
+   rare transaction that writes more than it reserved and finds
+   the log full writes the rest unlogged, losing only its
+   atomicity.
+
+   File data is not journaled, and metadata written outside any
+   transaction, as while formatting, is not logged either.
+
+   A transaction may not start while holding a file system lock,
+   since it may wait for a commit, which waits for the other
+   transactions in progress.  Transactions begun inside one that
+   is in progress just join it. */
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Sectors one transaction may log. */
+#define OP_MAX 16
+
+/* Timer ticks between commits. */
+#define COMMIT_TICKS (5 * TIMER_FREQ)
+
+/* On-disk journal header, in JOURNAL_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    uint32_t magic;                     /* JOURNAL_MAGIC. */
+    uint32_t cnt;                       /* Sectors committed, or 0. */
+    block_sector_t sectors[JOURNAL_CNT]; /* Where each log sector goes. */
+  };
+
+/* A sector in the running transaction.  Its slot in the log is
+   its index in LOGGED. */
+struct logged_sector
+  {
+    struct hash_elem elem;              /* Element in logged_map. */
+    block_sector_t sector;              /* Sector logged. */
+  };
+
+/* The running transaction, protected by JOURNAL_LOCK.  LOGGED
+   and LOGGED_MAP do not change while a commit is in progress. */
+static struct logged_sector logged[JOURNAL_CNT];
+static size_t logged_cnt;
+static struct hash logged_map;
+static size_t outstanding;              /* Transactions in progress. */
+static bool committing;                 /* Commit in progress? */
+static struct lock journal_lock;
+static struct condition journal_changed; /* OUTSTANDING or COMMITTING. */
+
+/* Header buffer, used only by recovery and by the commit in
+   progress. */
+static struct journal_header header;
+
+/* Statistics. */
+static unsigned long long transactions, commits, sectors_logged;
+
+static hash_hash_func logged_hash;
+static hash_less_func logged_less;
+static struct logged_sector *find_logged (block_sector_t);
+static void commit_locked (void);
+static void write_log (void);
+static void recover (void);
+static thread_func commit_thread;
+
+/* Returns the log sector that holds slot SLOT. */
+static inline block_sector_t
+slot_sector (size_t slot)
+{
+  return JOURNAL_SECTOR + 1 + slot;
+}
+
+/* Initializes the journal.  If FORMAT is true, starts an empty
+   log; otherwise first completes the commit that was in progress
+   when the file system was last used, if any.  Must be called
+   after cache_init() and before anything else reads the file
+   system. */
+void
+journal_init (bool format)
+{
+  ASSERT (sizeof header == BLOCK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  cond_init (&journal_changed);
+  if (!hash_init_size (&logged_map, JOURNAL_CNT, logged_hash, logged_less,
+                       NULL))
+    PANIC ("Not enough memory for the journal.");
+
+  if (format)
+    {
+      memset (&header, 0, sizeof header);
+      header.magic = JOURNAL_MAGIC;
+      block_write (fs_device, JOURNAL_SECTOR, &header);
+    }
+  else
+    recover ();
+  thread_create_sized ("journal", PRI_DEFAULT, THREAD_STACK_LARGE,
+                       commit_thread, NULL);
+}
+
+/* Writes the sectors of a commit that completed but was not
+   written to its sectors' places, and then clears the header. */
+static void
+recover (void)
+{
+  static uint8_t buffer[BLOCK_SECTOR_SIZE];
+  size_t i;
+
+  block_read (fs_device, JOURNAL_SECTOR, &header);
+  if (header.magic != JOURNAL_MAGIC)
+    PANIC ("file system has no journal; reformat it.");
+  if (header.cnt == 0)
+    return;
+  if (header.cnt > JOURNAL_CNT)
+    PANIC ("journal header is corrupt");
+
+  printf ("journal: replaying %u sectors\n", (unsigned) header.cnt);
+  for (i = 0; i < header.cnt; i++)
+    {
+      block_read (fs_device, slot_sector (i), buffer);
+      block_write (fs_device, header.sectors[i], buffer);
+      checksum_update (header.sectors[i], buffer);
+    }
+  header.cnt = 0;
+  block_write_flags (fs_device, JOURNAL_SECTOR, &header, BIO_PREFLUSH);
+}
+
+/* Starts a transaction, or joins the one this thread already has
+   in progress.  Waits first, if the log might not have room for
+   it, for a commit to make room. */
+void
+journal_begin (void)
+{
+  if (thread_current ()->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  for (;;)
+    {
+      if (committing)
+        cond_wait (&journal_changed, &journal_lock);
+      else if (logged_cnt + (outstanding + 1) * OP_MAX > JOURNAL_CNT)
+        commit_locked ();
+      else
+        break;
+    }
+  outstanding++;
+  transactions++;
+  lock_release (&journal_lock);
+}
+
+/* Ends the transaction begun by the matching journal_begin().
+   Its changes are committed with the next group. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  if (--outstanding == 0)
+    cond_broadcast (&journal_changed, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Returns true if the current thread's transaction can log CNT
+   sectors more than it has reserved without filling the log, or
+   if it has no transaction in progress.  Lets an unusually large
+   change be avoided when it could not be atomic. */
+bool
+journal_room (size_t cnt)
+{
+  bool room;
+
+  if (thread_current ()->journal_depth == 0)
+    return true;
+  lock_acquire (&journal_lock);
+  room = logged_cnt + outstanding * OP_MAX + cnt <= JOURNAL_CNT;
+  lock_release (&journal_lock);
+  return room;
+}
+
+/* Commits the running transaction, waiting for the transactions
+   in progress to end, and returns when its sectors are on disk.
+   Does nothing if the current thread has a transaction in
+   progress itself, since that would never end. */
+void
+journal_commit (void)
+{
+  if (thread_current ()->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&journal_changed, &journal_lock);
+  commit_locked ();
+  lock_release (&journal_lock);
+}
+
+/* Commits the running transaction.  The caller must hold
+   JOURNAL_LOCK, which is released while writing. */
+static void
+commit_locked (void)
+{
+  ASSERT (!committing);
+
+  committing = true;
+  while (outstanding > 0)
+    cond_wait (&journal_changed, &journal_lock);
+  if (logged_cnt > 0)
+    {
+      lock_release (&journal_lock);
+      write_log ();
+      lock_acquire (&journal_lock);
+      hash_clear (&logged_map, NULL);
+      sectors_logged += logged_cnt;
+      logged_cnt = 0;
+      commits++;
+    }
+  committing = false;
+  cond_broadcast (&journal_changed, &journal_lock);
+}
+
+/* Writes the logged sectors to the log, commits them by writing
+   the header once they are durable, writes them to their own
+   places, and clears the header once those are durable.  No
+   transaction is in progress meanwhile, so LOGGED does not
+   change. */
+static void
+write_log (void)
+{
+  size_t i;
+
+  for (i = 0; i < logged_cnt; i++)
+    cache_log (logged[i].sector, slot_sector (i));
+
+  header.magic = JOURNAL_MAGIC;
+  header.cnt = logged_cnt;
+  for (i = 0; i < logged_cnt; i++)
+    header.sectors[i] = logged[i].sector;
+  block_write_flags (fs_device, JOURNAL_SECTOR, &header,
+                     BIO_PREFLUSH | BIO_FUA);
+
+  for (i = 0; i < logged_cnt; i++)
+    cache_checkpoint (logged[i].sector);
+  header.cnt = 0;
+  block_write_flags (fs_device, JOURNAL_SECTOR, &header, BIO_PREFLUSH);
+}
+
+/* Adds SECTOR, which the caller has just written in the cache, to
+   the running transaction, and sets *SLOTP to its log sector.
+   Returns true if successful, false if SECTOR is not already in
+   the transaction and the current thread has no transaction in
+   progress or the log is full, in which case SECTOR must be
+   written back as usual. */
+bool
+journal_add (block_sector_t sector, block_sector_t *slotp)
+{
+  struct logged_sector *l;
+  bool success = true;
+
+  lock_acquire (&journal_lock);
+  l = find_logged (sector);
+  if (l == NULL)
+    {
+      if (thread_current ()->journal_depth > 0 && logged_cnt < JOURNAL_CNT)
+        {
+          l = &logged[logged_cnt++];
+          l->sector = sector;
+          hash_insert (&logged_map, &l->elem);
+        }
+      else
+        success = false;
+    }
+  if (l != NULL)
+    *slotp = slot_sector (l - logged);
+  lock_release (&journal_lock);
+  return success;
+}
+
+/* Returns true if SECTOR is in the running transaction, and then
+   sets *SLOTP to its log sector, which holds its latest data
+   whenever it is not in the cache. */
+bool
+journal_locate (block_sector_t sector, block_sector_t *slotp)
+{
+  struct logged_sector *l;
+
+  lock_acquire (&journal_lock);
+  l = find_logged (sector);
+  if (l != NULL)
+    *slotp = slot_sector (l - logged);
+  lock_release (&journal_lock);
+  return l != NULL;
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void)
+{
+  printf ("Journal: %llu transactions, %llu commits, %llu sectors logged\n",
+          transactions, commits, sectors_logged);
+}
+
+/* Returns the logged sector for SECTOR, or a null pointer if it
+   is not in the running transaction.  The caller must hold
+   JOURNAL_LOCK. */
+static struct logged_sector *
+find_logged (block_sector_t sector)
+{
+  struct logged_sector key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&logged_map, &key.elem);
+  return e != NULL ? hash_entry (e, struct logged_sector, elem) : NULL;
+}
+
+/* Returns a hash value for logged sector E. */
+static unsigned
+logged_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct logged_sector, elem)->sector);
+}
+
+/* Returns true if logged sector A precedes logged sector B. */
+static bool
+logged_less (const struct hash_elem *a, const struct hash_elem *b,
+             void *aux UNUSED)
+{
+  return (hash_entry (a, struct logged_sector, elem)->sector
+          < hash_entry (b, struct logged_sector, elem)->sector);
+}
+
+/* Commit thread.  Commits the running transaction every
+   COMMIT_TICKS. */
+static void
+commit_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (COMMIT_TICKS);
+      journal_commit ();
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Most sectors one commit writes to the log. */
+#define JOURNAL_CNT 126
+
+/* Sectors the journal takes on disk, starting at JOURNAL_SECTOR:
+   a header and one log sector for each logged sector. */
+#define JOURNAL_SECTORS (1 + JOURNAL_CNT)
+
+void journal_init (bool format);
+void journal_begin (void);
+void journal_end (void);
+bool journal_room (size_t cnt);
+void journal_commit (void);
+bool journal_add (block_sector_t, block_sector_t *slotp);
+bool journal_locate (block_sector_t, block_sector_t *slotp);
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
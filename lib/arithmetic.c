@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stddef.h>
 
 /* On x86, division of one 64-bit integer by another cannot be
    done with a single instruction or a short sequence.  Thus, GCC
@@ -19,63 +20,37 @@
    much less mysterious. */
 
 /* Uses x86 DIVL instruction to divide 64-bit N by 32-bit D to
-   yield a 32-bit quotient.  Returns the quotient.
+   yield a 32-bit quotient.  Returns the quotient and stores the
+   remainder in *R.
    Traps with a divide error (#DE) if the quotient does not fit
    in 32 bits. */
 static inline uint32_t
-divl (uint64_t n, uint32_t d)
+divl (uint64_t n, uint32_t d, uint32_t *r)
 {
   uint32_t n1 = n >> 32;
   uint32_t n0 = n;
-  uint32_t q, r;
+  uint32_t q;
 
   asm ("divl %4"
-       : "=d" (r), "=a" (q)
+       : "=d" (*r), "=a" (q)
        : "0" (n1), "1" (n0), "rm" (d));
 
   return q;
 }
 
 /* Returns the number of leading zero bits in X,
-   which must be nonzero. */
-static int
+   which must be nonzero.  GCC compiles this to a single BSR
+   instruction, not a call into libgcc. */
+static inline int
 nlz (uint32_t x) 
 {
-  /* This technique is portable, but there are better ways to do
-     it on particular systems.  With sufficiently new enough GCC,
-     you can use __builtin_clz() to take advantage of GCC's
-     knowledge of how to do it.  Or you can use the x86 BSR
-     instruction directly. */
-  int n = 0;
-  if (x <= 0x0000FFFF)
-    {
-      n += 16;
-      x <<= 16; 
-    }
-  if (x <= 0x00FFFFFF)
-    {
-      n += 8;
-      x <<= 8; 
-    }
-  if (x <= 0x0FFFFFFF)
-    {
-      n += 4;
-      x <<= 4;
-    }
-  if (x <= 0x3FFFFFFF)
-    {
-      n += 2;
-      x <<= 2; 
-    }
-  if (x <= 0x7FFFFFFF)
-    n++;
-  return n;
+  return __builtin_clz (x);
 }
 
-/* Divides unsigned 64-bit N by unsigned 64-bit D and returns the
-   quotient. */
+/* Divides unsigned 64-bit N by unsigned 64-bit D.  Returns the
+   quotient and stores the remainder in *R. */
 static uint64_t
-udiv64 (uint64_t n, uint64_t d)
+udivmod64 (uint64_t n, uint64_t d, uint64_t *r)
 {
   if ((d >> 32) == 0) 
     {
@@ -102,36 +77,83 @@ udiv64 (uint64_t n, uint64_t d)
              <=> [b - 1/d] < b
          which is a tautology.
 
-         Therefore, this code is correct and will not trap. */
-      uint64_t b = 1ULL << 32;
+         Therefore, this code is correct and will not trap.
+
+         The common cases need less: a 32-bit N is a single
+         32-bit division, and when n1 < d the high quotient word
+         T is 0, so one divl() gives both quotient and
+         remainder. */
       uint32_t n1 = n >> 32;
       uint32_t n0 = n; 
       uint32_t d0 = d;
+      uint32_t q1 = 0, q0, r0;
 
-      return divl (b * (n1 % d0) + n0, d0) + b * (n1 / d0); 
+      if (n1 == 0)
+        {
+          *r = n0 % d0;
+          return n0 / d0;
+        }
+      if (n1 >= d0)
+        {
+          q1 = divl (n1, d0, &r0);
+          n1 = r0;
+        }
+      q0 = divl ((uint64_t) n1 << 32 | n0, d0, &r0);
+      *r = r0;
+      return (uint64_t) q1 << 32 | q0;
     }
   else 
     {
       /* Based on the algorithm and proof available from
-         http://www.hackersdelight.org/revisions.pdf. */
+         http://www.hackersdelight.org/revisions.pdf.  D is at
+         least 2**32, so the quotient fits in 32 bits: shift D
+         left until its top bit is set, divide by its high word
+         to get an estimate that is correct or one too big, and
+         correct it with the remainder. */
       if (n < d)
-        return 0;
+        {
+          *r = n;
+          return 0;
+        }
       else 
         {
           uint32_t d1 = d >> 32;
           int s = nlz (d1);
-          uint64_t q = divl (n >> 1, (d << s) >> 32) >> (31 - s);
-          return n - (q - 1) * d < d ? q - 1 : q; 
+          uint32_t r1;
+          uint64_t q = divl (n >> 1, (d << s) >> 32, &r1) >> (31 - s);
+          uint64_t rem;
+
+          if (q != 0)
+            q--;
+          rem = n - q * d;
+          if (rem >= d)
+            {
+              q++;
+              rem -= d;
+            }
+          *r = rem;
+          return q;
         }
     }
 }
 
+/* Divides unsigned 64-bit N by unsigned 64-bit D and returns the
+   quotient. */
+static uint64_t
+udiv64 (uint64_t n, uint64_t d)
+{
+  uint64_t r;
+  return udivmod64 (n, d, &r);
+}
+
 /* Divides unsigned 64-bit N by unsigned 64-bit D and returns the
    remainder. */
-static uint32_t
+static uint64_t
 umod64 (uint64_t n, uint64_t d)
 {
-  return n - d * udiv64 (n, d);
+  uint64_t r;
+  udivmod64 (n, d, &r);
+  return r;
 }
 
 /* Divides signed 64-bit N by signed 64-bit D and returns the
@@ -146,19 +168,24 @@ sdiv64 (int64_t n, int64_t d)
 }
 
 /* Divides signed 64-bit N by signed 64-bit D and returns the
-   remainder. */
-static int32_t
+   remainder, which has the sign of N. */
+static int64_t
 smod64 (int64_t n, int64_t d)
 {
-  return n - d * sdiv64 (n, d);
+  uint64_t n_abs = n >= 0 ? (uint64_t) n : -(uint64_t) n;
+  uint64_t d_abs = d >= 0 ? (uint64_t) d : -(uint64_t) d;
+  uint64_t r_abs = umod64 (n_abs, d_abs);
+  return n < 0 ? -(int64_t) r_abs : (int64_t) r_abs;
 }
-
+
 /* These are the routines that GCC calls. */
 
 long long __divdi3 (long long n, long long d);
 long long __moddi3 (long long n, long long d);
 unsigned long long __udivdi3 (unsigned long long n, unsigned long long d);
 unsigned long long __umoddi3 (unsigned long long n, unsigned long long d);
+unsigned long long __udivmoddi4 (unsigned long long n, unsigned long long d,
+                                 unsigned long long *r);
 
 /* Signed 64-bit division. */
 long long
@@ -187,3 +214,17 @@ __umoddi3 (unsigned long long n, unsigned long long d)
 {
   return umod64 (n, d);
 }
+
+/* Unsigned 64-bit division and remainder at once, which GCC
+   calls when optimizing code that needs both.  Stores the
+   remainder in *R, if R is nonnull. */
+unsigned long long
+__udivmoddi4 (unsigned long long n, unsigned long long d,
+              unsigned long long *r)
+{
+  uint64_t rem;
+  uint64_t q = udivmod64 (n, d, &rem);
+  if (r != NULL)
+    *r = rem;
+  return q;
+}
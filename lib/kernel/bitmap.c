@@ -4,6 +4,7 @@
 #include <round.h>
 #include <stdio.h>
 #include "threads/malloc.h"
+#include "threads/thread.h"
 #ifdef FILESYS
 #include "filesys/file.h"
 #endif
@@ -68,6 +69,78 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns a mask of the bits of an element that represent bits
+   START through END of the bitmap, exclusive, which must both
+   fall in the same element, except that END may be the first bit
+   of the next one. */
+static inline elem_type
+range_mask (size_t start, size_t end)
+{
+  elem_type mask = (elem_type) -1 << (start % ELEM_BITS);
+  if (end % ELEM_BITS != 0)
+    mask &= ((elem_type) 1 << (end % ELEM_BITS)) - 1;
+  return mask;
+}
+
+/* Returns element ELEM_IDX of B, inverted if VALUE is false, so
+   that the bits set in the result are those equal to VALUE. */
+static inline elem_type
+elem_matching (const struct bitmap *b, size_t elem_idx, bool value)
+{
+  return value ? b->bits[elem_idx] : ~b->bits[elem_idx];
+}
+
+/* Returns the number of bits set in ELEM, adding up pairs, then
+   nibbles, then bytes.  GCC's builtin would call into libgcc,
+   which the kernel does not link. */
+static inline unsigned
+elem_popcount (elem_type elem)
+{
+  const elem_type ones = (elem_type) -1;
+
+  elem -= (elem >> 1) & ones / 3;
+  elem = (elem & ones / 15 * 3) + ((elem >> 2) & ones / 15 * 3);
+  elem = (elem + (elem >> 4)) & ones / 255 * 15;
+  return (elem_type) (elem * (ones / 255)) >> (sizeof elem - 1) * CHAR_BIT;
+}
+
+/* Atomically sets the bits of MASK in element ELEM_IDX of B to
+   VALUE.  See bitmap_mark(). */
+static inline void
+elem_set (struct bitmap *b, size_t elem_idx, elem_type mask, bool value)
+{
+  if (value)
+    asm ("orl %1, %0" : "=m" (b->bits[elem_idx]) : "r" (mask) : "cc");
+  else
+    asm ("andl %1, %0" : "=m" (b->bits[elem_idx]) : "r" (~mask) : "cc");
+}
+
+/* Returns the index of the first bit in B between START and END,
+   exclusive, that is set to VALUE, or END if there is none.
+   Elements in which no bit is set to VALUE are skipped whole, and
+   the bit is found within its element with BSF. */
+static size_t
+find (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  size_t idx, last, result;
+  elem_type elem;
+
+  if (start >= end)
+    return end;
+
+  idx = elem_idx (start);
+  last = elem_idx (end - 1);
+  elem = elem_matching (b, idx, value) & ((elem_type) -1 << start % ELEM_BITS);
+  while (elem == 0)
+    {
+      if (idx == last)
+        return end;
+      elem = elem_matching (b, ++idx, value);
+    }
+  result = idx * ELEM_BITS + __builtin_ctzl (elem);
+  return result < end ? result : end;
+}
 
 /* Creation and destruction. */
 
@@ -213,35 +286,49 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE, an element
+   at a time.  Each element is set atomically. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
+  size_t end = start + cnt;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end)
+    {
+      size_t next = ROUND_DOWN (start, ELEM_BITS) + ELEM_BITS;
+      if (next > end)
+        next = end;
+      elem_set (b, elem_idx (start), range_mask (start, next), value);
+      start = next;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
-   exclusive, that are set to VALUE. */
+   exclusive, that are set to VALUE, counting an element at a
+   time. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t value_cnt = 0;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (start < end)
+    {
+      size_t next = ROUND_DOWN (start, ELEM_BITS) + ELEM_BITS;
+      if (next > end)
+        next = end;
+      value_cnt += elem_popcount (elem_matching (b, elem_idx (start), value)
+                                  & range_mask (start, next));
+      start = next;
+    }
   return value_cnt;
 }
 
@@ -250,16 +337,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -291,24 +373,89 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   Jumps from one group of bits set to VALUE to the next, so each
+   element of B is looked at about once, however long CNT is. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt == 0)
+    return start;
+  while (start + cnt <= b->bit_cnt)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t first = find (b, start, b->bit_cnt - cnt + 1, value);
+      size_t end;
+
+      if (first + cnt > b->bit_cnt)
+        break;
+      end = find (b, first, first + cnt, !value);
+      if (end == first + cnt)
+        return first;
+      start = end;
+
+      /* A fragmented bitmap can take many tries. */
+      thread_cond_resched ();
     }
   return BITMAP_ERROR;
 }
 
+/* Finds the longest group of consecutive bits in B at or after
+   START that are all set to VALUE, but no longer than *CNT, which
+   must be nonzero, and returns the index of its first bit, storing
+   its length in *CNT.  Of groups equally long, finds the first,
+   so a group of *CNT bits is found just as bitmap_scan() would.
+   If no bit at or after START is set to VALUE, returns
+   BITMAP_ERROR and stores 0 in *CNT. */
+size_t
+bitmap_scan_longest (const struct bitmap *b, size_t start, bool value,
+                     size_t *cnt)
+{
+  size_t best = BITMAP_ERROR, best_cnt = 0;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (*cnt > 0);
+
+  while (start < b->bit_cnt && best_cnt < *cnt)
+    {
+      size_t first = find (b, start, b->bit_cnt, value);
+      size_t limit = b->bit_cnt - first < *cnt ? b->bit_cnt : first + *cnt;
+      size_t end = find (b, first, limit, !value);
+
+      if (end - first > best_cnt)
+        {
+          best = first;
+          best_cnt = end - first;
+        }
+      start = end;
+    }
+  *cnt = best_cnt;
+  return best;
+}
+
+/* Returns the index of the first bit in B at or after START that
+   is set to true, or BITMAP_ERROR if there is none.  Iterates over
+   the bits set in B as:
+
+     for (i = bitmap_next_set (b, 0); i != BITMAP_ERROR;
+          i = bitmap_next_set (b, i + 1))
+*/
+size_t
+bitmap_next_set (const struct bitmap *b, size_t start)
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+
+  idx = find (b, start, b->bit_cnt, true);
+  return idx < b->bit_cnt ? idx : BITMAP_ERROR;
+}
+
 /* Finds the first group of CNT consecutive bits in B at or after
    START that are all set to VALUE, flips them all to !VALUE,
    and returns the index of the first bit in the group.
@@ -358,6 +505,55 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Reads the part of B that holds the CNT bits starting at START
+   from FILE, in which B is stored as bitmap_write() would store
+   it but starting at byte offset OFS.  Whole bytes are read, so
+   other bits in the same bytes as the range are read too.
+   Returns true if successful, false otherwise. */
+bool
+bitmap_read_range (struct bitmap *b, struct file *file, off_t ofs,
+                   size_t start, size_t cnt)
+{
+  off_t first, size;
+  bool success;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return true;
+  first = start / CHAR_BIT;
+  size = byte_cnt (start + cnt) - first;
+  success = file_read_at (file, (uint8_t *) b->bits + first, size,
+                          ofs + first) == size;
+  if (start + cnt == b->bit_cnt)
+    b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+  return success;
+}
+
+/* Writes the part of B that holds the CNT bits starting at START
+   to FILE, where bitmap_write() would put it if B started at
+   byte offset OFS.  Return true if successful, false
+   otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file, off_t ofs,
+                    size_t start, size_t cnt)
+{
+  off_t first, size;
+
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return true;
+  first = start / CHAR_BIT;
+  size = byte_cnt (start + cnt) - first;
+  return file_write_at (file, (uint8_t *) b->bits + first, size,
+                        ofs + first) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -36,13 +36,21 @@ bool bitmap_all (const struct bitmap *, size_t start, size_t cnt);
 #define BITMAP_ERROR SIZE_MAX
 size_t bitmap_scan (const struct bitmap *, size_t start, size_t cnt, bool);
 size_t bitmap_scan_and_flip (struct bitmap *, size_t start, size_t cnt, bool);
+size_t bitmap_scan_longest (const struct bitmap *, size_t start, bool,
+                            size_t *cnt);
+size_t bitmap_next_set (const struct bitmap *, size_t start);
 
 /* File input and output. */
 #ifdef FILESYS
+#include "filesys/off_t.h"
 struct file;
 size_t bitmap_file_size (const struct bitmap *);
 bool bitmap_read (struct bitmap *, struct file *);
 bool bitmap_write (const struct bitmap *, struct file *);
+bool bitmap_read_range (struct bitmap *, struct file *, off_t ofs,
+                        size_t start, size_t cnt);
+bool bitmap_write_range (const struct bitmap *, struct file *, off_t ofs,
+                         size_t start, size_t cnt);
 #endif
 
 /* Debugging. */
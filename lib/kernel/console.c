@@ -1,14 +1,27 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
 #include "devices/vga.h"
+#include "devices/virtio-console.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 
-static void vprintf_helper (char, void *);
+static void vprintf_helper (const char *, size_t, void *);
 static void putchar_have_lock (uint8_t c);
+static void putbuf_have_lock (const char *, size_t n);
+
+/* Output of vprintf(), gathered so that it reaches the serial
+   port or virtio console a buffer at a time. */
+struct vprintf_output
+  {
+    int char_cnt;               /* Characters output so far. */
+    size_t buf_cnt;             /* Characters in BUF. */
+    char buf[64];               /* Characters not yet written. */
+  };
 
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
@@ -59,11 +72,25 @@ static int console_lock_depth;
 /* Number of characters written to console. */
 static int64_t write_cnt;
 
+/* Console output being captured into a buffer instead of being
+   written out.  Only output from CAPTURE_THREAD, outside
+   interrupt context, is captured, and only one thread captures
+   at a time, which CAPTURE_LOCK ensures. */
+static struct lock capture_lock;
+static struct thread *capture_thread;
+static char *capture_buf;       /* Buffer, null-terminated. */
+static size_t capture_size;     /* Bytes in CAPTURE_BUF. */
+static size_t capture_len;      /* Bytes of output so far. */
+
+static bool capture (const char *, size_t n);
+
 /* Enable console locking. */
 void
 console_init (void) 
 {
   lock_init (&console_lock);
+  lock_set_name (&console_lock, "console");
+  lock_init (&capture_lock);
   use_console_lock = true;
 }
 
@@ -74,6 +101,7 @@ void
 console_panic (void) 
 {
   use_console_lock = false;
+  capture_thread = NULL;
 }
 
 /* Prints console statistics. */
@@ -83,6 +111,60 @@ console_print_stats (void)
   printf ("Console: %lld characters output\n", write_cnt);
 }
 
+/* Sends the running thread's console output into BUF, which
+   has room for SIZE bytes, until console_capture_end().  Output
+   beyond SIZE - 1 bytes is counted but dropped.  Other threads
+   that try to capture wait until then. */
+void
+console_capture_begin (char *buf, size_t size) 
+{
+  ASSERT (size > 0);
+
+  lock_acquire (&capture_lock);
+  capture_buf = buf;
+  capture_size = size;
+  capture_len = 0;
+  capture_buf[0] = '\0';
+  capture_thread = thread_current ();
+}
+
+/* Ends the capture begun by console_capture_begin() and returns
+   the length of the output, which may exceed what fit in the
+   buffer. */
+size_t
+console_capture_end (void) 
+{
+  ASSERT (capture_thread == thread_current ());
+
+  capture_thread = NULL;
+  lock_release (&capture_lock);
+  return capture_len;
+}
+
+/* If the running thread is capturing console output, appends the
+   N bytes in BUFFER to the capture buffer and returns true.
+   Otherwise, returns false. */
+static bool
+capture (const char *buffer, size_t n) 
+{
+  size_t copy;
+
+  if (capture_thread == NULL || intr_context ()
+      || capture_thread != thread_current ())
+    return false;
+
+  if (capture_len < capture_size - 1)
+    {
+      copy = capture_size - 1 - capture_len;
+      if (copy > n)
+        copy = n;
+      memcpy (capture_buf + capture_len, buffer, copy);
+      capture_buf[capture_len + copy] = '\0';
+    }
+  capture_len += n;
+  return true;
+}
+
 /* Acquires the console lock. */
 static void
 acquire_console (void) 
@@ -125,13 +207,16 @@ console_locked_by_current_thread (void)
 int
 vprintf (const char *format, va_list args) 
 {
-  int char_cnt = 0;
+  struct vprintf_output out;
 
+  out.char_cnt = 0;
+  out.buf_cnt = 0;
   acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
+  __vprintf (format, args, vprintf_helper, &out);
+  putbuf_have_lock (out.buf, out.buf_cnt);
   release_console ();
 
-  return char_cnt;
+  return out.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -140,8 +225,7 @@ int
 puts (const char *s) 
 {
   acquire_console ();
-  while (*s != '\0')
-    putchar_have_lock (*s++);
+  putbuf_have_lock (s, strlen (s));
   putchar_have_lock ('\n');
   release_console ();
 
@@ -153,8 +237,7 @@ void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
@@ -169,23 +252,57 @@ putchar (int c)
   return c;
 }
 
-/* Helper function for vprintf(). */
+/* Helper function for vprintf().  Gathers short runs in OUT's
+   buffer and writes a run that would not fit in it directly. */
 static void
-vprintf_helper (char c, void *char_cnt_) 
+vprintf_helper (const char *s, size_t n, void *out_) 
 {
-  int *char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock (c);
+  struct vprintf_output *out = out_;
+
+  out->char_cnt += n;
+  if (out->buf_cnt + n > sizeof out->buf)
+    {
+      putbuf_have_lock (out->buf, out->buf_cnt);
+      out->buf_cnt = 0;
+    }
+  if (n >= sizeof out->buf)
+    putbuf_have_lock (s, n);
+  else
+    {
+      memcpy (out->buf + out->buf_cnt, s, n);
+      out->buf_cnt += n;
+    }
 }
 
-/* Writes C to the vga display and serial port.
+/* Writes C to the vga display and to the virtio console, if
+   there is one, or the serial port.
    The caller has already acquired the console lock if
    appropriate. */
 static void
 putchar_have_lock (uint8_t c) 
 {
   ASSERT (console_locked_by_current_thread ());
+  if (capture ((const char *) &c, 1))
+    return;
   write_cnt++;
-  serial_putc (c);
+  if (!virtio_console_write ((const char *) &c, 1) || virtio_console_mirror)
+    serial_putc (c);
   vga_putc (c);
 }
+
+/* Writes the N characters in BUFFER to the vga display and to
+   the virtio console, if there is one, or the serial port,
+   handing them to each all at once.
+   The caller has already acquired the console lock if
+   appropriate. */
+static void
+putbuf_have_lock (const char *buffer, size_t n) 
+{
+  ASSERT (console_locked_by_current_thread ());
+  if (capture (buffer, n))
+    return;
+  write_cnt += n;
+  if (!virtio_console_write (buffer, n) || virtio_console_mirror)
+    serial_write (buffer, n);
+  vga_write (buffer, n);
+}
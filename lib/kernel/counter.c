@@ -0,0 +1,37 @@
+#include "counter.h"
+#include <string.h>
+
+/* Initializes counter C to 0. */
+void
+counter_init (struct counter *c)
+{
+  memset (c, 0, sizeof *c);
+}
+
+/* Returns the value of counter C, the sum of its slots.  Other
+   CPUs may be adding to C while it is read, and so may interrupt
+   handlers, so the result may miss the most recent increments,
+   but a slot read while its low word carries into its high word
+   is read again rather than counted wrong by 2**32. */
+uint64_t
+counter_read (const struct counter *c)
+{
+  uint64_t sum = 0;
+  int i;
+
+  for (i = 0; i < NCPU; i++)
+    {
+      const volatile uint32_t *w
+        = (const volatile uint32_t *) &c->slots[i].value;
+      uint32_t lo, hi;
+
+      do
+        {
+          hi = w[1];
+          lo = w[0];
+        }
+      while (w[1] != hi);
+      sum += ((uint64_t) hi << 32) | lo;
+    }
+  return sum;
+}
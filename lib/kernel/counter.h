@@ -0,0 +1,84 @@
+#ifndef __LIB_KERNEL_COUNTER_H
+#define __LIB_KERNEL_COUNTER_H
+
+/* Statistic counter.
+
+   Counts events on hot paths, such as timer ticks, page faults
+   and sectors transferred, without making the count itself a
+   point of contention.  A counter has a slot for each CPU, on a
+   cache line of its own, and each CPU adds only to its own
+   slot, so an increment needs no lock, no atomic instruction and
+   no interrupt disabling, and never moves a cache line between
+   CPUs.  Reading a counter sums the slots, which is slower, but
+   reads are rare: statistics are printed at shutdown and by
+   kstat_read().
+
+   counter_add() adds to the low and then the high word of the
+   slot with one instruction each, which an interrupt cannot
+   split.  An interrupt handler that adds to the same slot in
+   between loses nothing, because the carry from the low word
+   waits in EFLAGS, which the interrupt saves and restores.
+
+   Building with "make NO_COUNTERS=1" compiles the increments
+   out, for measuring what they cost, and every counter then
+   reads as 0. */
+
+#include <stdint.h>
+#include "threads/thread.h"
+
+/* Size of a cache line, so that no two CPUs' slots share one. */
+#define COUNTER_ALIGN 64
+
+/* A counter.  Zero-initialized storage, such as a static
+   variable, is a counter at 0, so only others need
+   counter_init(). */
+struct counter
+  {
+    struct
+      {
+        uint64_t value;
+      }
+    slots[NCPU] __attribute__ ((aligned (COUNTER_ALIGN)));
+  };
+
+void counter_init (struct counter *);
+uint64_t counter_read (const struct counter *);
+
+/* Returns the index of the running CPU's slot.  Only the boot
+   CPU runs for now.  Once others do, a thread must not move to
+   another CPU between picking its slot and adding to it, so
+   this will have to become part of the add itself, by way of a
+   per-CPU segment. */
+static inline unsigned
+counter_cpu (void)
+{
+  return 0;
+}
+
+/* Adds N to counter C.  May be called from an interrupt
+   handler. */
+static inline void
+counter_add (struct counter *c, uint64_t n)
+{
+#ifndef NO_COUNTERS
+  uint32_t *w = (uint32_t *) &c->slots[counter_cpu ()].value;
+
+  asm volatile ("addl %2, %0; adcl %3, %1"
+                : "+m" (w[0]), "+m" (w[1])
+                : "ri" ((uint32_t) n), "ri" ((uint32_t) (n >> 32))
+                : "cc");
+#else
+  (void) c;
+  (void) n;
+#endif
+}
+
+/* Adds 1 to counter C.  May be called from an interrupt
+   handler. */
+static inline void
+counter_inc (struct counter *c)
+{
+  counter_add (c, 1);
+}
+
+#endif /* lib/kernel/counter.h */
@@ -0,0 +1,118 @@
+#include "crc32c.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+
+/* The CRC-32C polynomial, bit-reversed. */
+#define POLY 0x82f63b78
+
+/* CPUID leaf 1 feature bit in ECX.  See [IA32-v2a] "CPUID". */
+#define CPUID_SSE42 0x100000
+
+/* TABLE[0][B] is the CRC of byte B, and TABLE[K][B] that of byte
+   B followed by K zero bytes.  Its 8 kB are allocated the first
+   time it is needed, which is never on a CPU that has the crc32
+   instruction unless crc32c_sw() is called directly. */
+static uint32_t (*table)[256];
+
+/* Whether the CPU has the crc32 instruction: 1 if so, 0 if not,
+   -1 until looked up. */
+static int hw = -1;
+
+/* Builds TABLE.  If another thread builds it at the same time,
+   the copy that is finished first is kept. */
+static void
+build_table (void)
+{
+  uint32_t (*t)[256] = malloc (8 * sizeof *t);
+  enum intr_level old_level;
+  unsigned b, k;
+
+  if (t == NULL)
+    PANIC ("no memory for CRC-32C tables");
+  for (b = 0; b < 256; b++)
+    {
+      uint32_t crc = b;
+
+      for (k = 0; k < 8; k++)
+        crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+      t[0][b] = crc;
+    }
+  for (b = 0; b < 256; b++)
+    for (k = 1; k < 8; k++)
+      t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xff];
+
+  old_level = intr_disable ();
+  if (table == NULL)
+    {
+      table = t;
+      t = NULL;
+    }
+  intr_set_level (old_level);
+  free (t);
+}
+
+/* Returns true if crc32c() uses the SSE4.2 crc32 instruction. */
+bool
+crc32c_hw (void)
+{
+  if (hw < 0)
+    {
+      uint32_t eax, ebx, ecx, edx;
+
+      asm ("cpuid"
+           : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+      hw = (ecx & CPUID_SSE42) != 0;
+    }
+  return hw;
+}
+
+/* Returns the CRC-32C of the SIZE bytes at BUF_, following data
+   whose CRC-32C is CRC, computed with lookup tables. */
+uint32_t
+crc32c_sw (uint32_t crc, const void *buf_, size_t size)
+{
+  const uint8_t *buf = buf_;
+
+  if (table == NULL)
+    build_table ();
+
+  crc = ~crc;
+  for (; size >= 8; buf += 8, size -= 8)
+    {
+      uint32_t lo, hi;
+
+      memcpy (&lo, buf, 4);
+      memcpy (&hi, buf + 4, 4);
+      lo ^= crc;
+      crc = (table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff]
+             ^ table[5][(lo >> 16) & 0xff] ^ table[4][lo >> 24]
+             ^ table[3][hi & 0xff] ^ table[2][(hi >> 8) & 0xff]
+             ^ table[1][(hi >> 16) & 0xff] ^ table[0][hi >> 24]);
+    }
+  for (; size > 0; buf++, size--)
+    crc = table[0][(crc ^ *buf) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+/* Returns the CRC-32C of the SIZE bytes at BUF_, following data
+   whose CRC-32C is CRC. */
+uint32_t
+crc32c (uint32_t crc, const void *buf_, size_t size)
+{
+  const uint8_t *buf = buf_;
+
+  if (!crc32c_hw ())
+    return crc32c_sw (crc, buf, size);
+
+  /* Byte at a time up to a word boundary, then a word at a time. */
+  crc = ~crc;
+  for (; size > 0 && (uintptr_t) buf % 4 != 0; buf++, size--)
+    asm ("crc32b %1, %0" : "+r" (crc) : "rm" (*buf));
+  for (; size >= 4; buf += 4, size -= 4)
+    asm ("crc32l %1, %0" : "+r" (crc) : "rm" (*(const uint32_t *) buf));
+  for (; size > 0; buf++, size--)
+    asm ("crc32b %1, %0" : "+r" (crc) : "rm" (*buf));
+  return ~crc;
+}
@@ -0,0 +1,24 @@
+#ifndef __LIB_KERNEL_CRC32C_H
+#define __LIB_KERNEL_CRC32C_H
+
+/* CRC-32C (Castagnoli), the checksum used by iSCSI, ext4 and
+   btrfs.
+
+   crc32c() uses the SSE4.2 `crc32' instruction, which handles
+   four bytes per instruction, if CPUID reports it, and otherwise
+   the slice-by-8 method of crc32c_sw(), which looks up eight
+   bytes at a time in eight 256-entry tables built on first use.
+   Both give the same results.
+
+   CRC is the checksum of the data that comes before, or 0 at
+   the start, so a buffer may be checksummed in pieces. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t crc32c (uint32_t crc, const void *, size_t);
+uint32_t crc32c_sw (uint32_t crc, const void *, size_t);
+bool crc32c_hw (void);
+
+#endif /* lib/kernel/crc32c.h */
@@ -12,6 +12,7 @@
 #include "threads/vaddr.h"
 #include "devices/serial.h"
 #include "devices/shutdown.h"
+#include "devices/virtio-console.h"
 
 /* Halts the OS, printing the source file name, line number, and
    function name, plus a user-specific message. */
@@ -46,6 +47,7 @@ debug_panic (const char *file, int line, const char *function,
     }
 
   serial_flush ();
+  virtio_console_flush ();
   shutdown ();
   for (;;);
 }
@@ -93,10 +95,11 @@ print_stacktrace(struct thread *t, void *aux UNUSED)
       /* Skip threads if they have been added to the all threads
          list, but have never been scheduled.
          We can identify because their `stack' member either points 
-         at the top of their kernel stack page, or the 
+         at the top of their kernel stack, or the 
          switch_threads_frame's 'eip' member points at switch_entry.
          See also threads.c. */
-      if (t->stack == (uint8_t *)t + PGSIZE || saved_frame->eip == switch_entry)
+      if (t->stack == t->kstack + t->kstack_size
+          || saved_frame->eip == switch_entry)
         {
           printf (" thread was never scheduled.\n");
           return;
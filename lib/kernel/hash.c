@@ -17,6 +17,8 @@ static struct hash_elem *find_elem (struct hash *, struct list *,
                                     struct hash_elem *);
 static void insert_elem (struct hash *, struct list *, struct hash_elem *);
 static void remove_elem (struct hash *, struct hash_elem *);
+static size_t bucket_cnt_for (size_t elem_cnt, size_t min_bucket_cnt);
+static struct list *next_bucket (struct hash *, struct list *);
 static void rehash (struct hash *);
 
 /* Initializes hash table H to compute hash values using HASH and
@@ -24,10 +26,25 @@ static void rehash (struct hash *);
 bool
 hash_init (struct hash *h,
            hash_hash_func *hash, hash_less_func *less, void *aux) 
+{
+  return hash_init_size (h, 0, hash, less, aux);
+}
+
+/* Initializes hash table H like hash_init(), but with enough
+   buckets from the start for ELEM_CNT elements, so that it need
+   not grow until it holds more than that.  H also never shrinks
+   below that many buckets.  Suits a table whose size is known
+   ahead of time or bounded, such as a cache. */
+bool
+hash_init_size (struct hash *h, size_t elem_cnt,
+                hash_hash_func *hash, hash_less_func *less, void *aux) 
 {
   h->elem_cnt = 0;
-  h->bucket_cnt = 4;
+  h->bucket_cnt = h->min_bucket_cnt = bucket_cnt_for (elem_cnt, 4);
   h->buckets = malloc (sizeof *h->buckets * h->bucket_cnt);
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->moved_cnt = 0;
   h->hash = hash;
   h->less = less;
   h->aux = aux;
@@ -53,22 +70,26 @@ hash_init (struct hash *h,
 void
 hash_clear (struct hash *h, hash_action_func *destructor) 
 {
+  struct list *bucket;
   size_t i;
 
-  for (i = 0; i < h->bucket_cnt; i++) 
-    {
-      struct list *bucket = &h->buckets[i];
+  if (destructor != NULL)
+    for (bucket = h->buckets; bucket != NULL; bucket = next_bucket (h, bucket))
+      while (!list_empty (bucket)) 
+        {
+          struct list_elem *list_elem = list_pop_front (bucket);
+          struct hash_elem *hash_elem = list_elem_to_hash_elem (list_elem);
+          destructor (hash_elem, h->aux);
+        }
 
-      if (destructor != NULL) 
-        while (!list_empty (bucket)) 
-          {
-            struct list_elem *list_elem = list_pop_front (bucket);
-            struct hash_elem *hash_elem = list_elem_to_hash_elem (list_elem);
-            destructor (hash_elem, h->aux);
-          }
+  for (i = 0; i < h->bucket_cnt; i++) 
+    list_init (&h->buckets[i]);
 
-      list_init (bucket); 
-    }    
+  /* Nothing is left to move. */
+  free (h->old_buckets);
+  h->old_buckets = NULL;
+  h->old_bucket_cnt = 0;
+  h->moved_cnt = 0;
 
   h->elem_cnt = 0;
 }
@@ -89,6 +110,7 @@ hash_destroy (struct hash *h, hash_action_func *destructor)
   if (destructor != NULL)
     hash_clear (h, destructor);
   free (h->buckets);
+  free (h->old_buckets);
 }
 
 /* Inserts NEW into hash table H and returns a null pointer, if
@@ -162,13 +184,12 @@ hash_delete (struct hash *h, struct hash_elem *e)
 void
 hash_apply (struct hash *h, hash_action_func *action) 
 {
-  size_t i;
+  struct list *bucket;
   
   ASSERT (action != NULL);
 
-  for (i = 0; i < h->bucket_cnt; i++) 
+  for (bucket = h->buckets; bucket != NULL; bucket = next_bucket (h, bucket))
     {
-      struct list *bucket = &h->buckets[i];
       struct list_elem *elem, *next;
 
       for (elem = list_begin (bucket); elem != list_end (bucket); elem = next) 
@@ -223,7 +244,8 @@ hash_next (struct hash_iterator *i)
   i->elem = list_elem_to_hash_elem (list_next (&i->elem->list_elem));
   while (i->elem == list_elem_to_hash_elem (list_end (i->bucket)))
     {
-      if (++i->bucket >= i->hash->buckets + i->hash->bucket_cnt)
+      i->bucket = next_bucket (i->hash, i->bucket);
+      if (i->bucket == NULL)
         {
           i->elem = NULL;
           break;
@@ -300,13 +322,72 @@ hash_int (int i)
 {
   return hash_bytes (&i, sizeof i);
 }
+
+/* Returns a hash of X, computed a word at a time rather than a
+   byte at a time like hash_int(), and so several times faster.
+   Every bit of X affects every bit of the result, so it is
+   suitable for masking down to a power of 2.  This is the final
+   mixing step of MurmurHash3. */
+unsigned
+hash_mix (unsigned x)
+{
+  x ^= x >> 16;
+  x *= 0x85ebca6bu;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35u;
+  x ^= x >> 16;
+  return x;
+}
 
-/* Returns the bucket in H that E belongs in. */
+/* Returns a hash of the CNT 32-bit words in BUF.  Like
+   hash_bytes(), but it takes a word per step, so it hashes a
+   page several times faster, for when the contents only need to
+   be told apart cheaply, as before comparing them in full. */
+unsigned
+hash_words (const uint32_t *buf, size_t cnt)
+{
+  unsigned hash;
+
+  ASSERT (buf != NULL);
+
+  hash = FNV_32_BASIS;
+  while (cnt-- > 0)
+    hash = (hash ^ *buf++) * FNV_32_PRIME;
+
+  return hash_mix (hash);
+}
+
+/* Returns the bucket in H that E belongs in.  While H is being
+   resized, that is in the old array if E's old bucket has not
+   been moved yet. */
 static struct list *
 find_bucket (struct hash *h, struct hash_elem *e) 
 {
-  size_t bucket_idx = h->hash (e, h->aux) & (h->bucket_cnt - 1);
-  return &h->buckets[bucket_idx];
+  unsigned hash = h->hash (e, h->aux);
+
+  if (h->old_buckets != NULL)
+    {
+      size_t old_idx = hash & (h->old_bucket_cnt - 1);
+      if (old_idx >= h->moved_cnt)
+        return &h->old_buckets[old_idx];
+    }
+  return &h->buckets[hash & (h->bucket_cnt - 1)];
+}
+
+/* Returns the bucket that follows BUCKET in H, taking the buckets
+   of the current array in order and then those of the old array
+   that have not been moved yet, or a null pointer if BUCKET is
+   the last. */
+static struct list *
+next_bucket (struct hash *h, struct list *bucket)
+{
+  if (bucket >= h->buckets && bucket < h->buckets + h->bucket_cnt)
+    {
+      if (++bucket < h->buckets + h->bucket_cnt)
+        return bucket;
+      return h->old_buckets != NULL ? h->old_buckets + h->moved_cnt : NULL;
+    }
+  return ++bucket < h->old_buckets + h->old_bucket_cnt ? bucket : NULL;
 }
 
 /* Searches BUCKET in H for a hash element equal to E.  Returns
@@ -325,54 +406,88 @@ find_elem (struct hash *h, struct list *bucket, struct hash_elem *e)
   return NULL;
 }
 
-/* Returns X with its lowest-order bit set to 1 turned off. */
-static inline size_t
-turn_off_least_1bit (size_t x) 
+/* Element per bucket ratios. */
+#define MIN_ELEMS_PER_BUCKET  1 /* Elems/bucket < 1: reduce # of buckets. */
+#define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
+#define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
+
+/* Old buckets moved to the new array each time a table being
+   resized is modified.  A resize leaves the table at about
+   BEST_ELEMS_PER_BUCKET, so this finishes moving well before
+   enough elements can come or go to call for another. */
+#define MOVE_PER_OP 2
+
+/* Returns the number of buckets to use for ELEM_CNT elements:
+   about one for every BEST_ELEMS_PER_BUCKET, a power of 2, and
+   at least MIN_BUCKET_CNT, which must be a power of 2. */
+static size_t
+bucket_cnt_for (size_t elem_cnt, size_t min_bucket_cnt) 
 {
-  return x & (x - 1);
+  size_t bucket_cnt = min_bucket_cnt;
+
+  while (bucket_cnt < elem_cnt / BEST_ELEMS_PER_BUCKET)
+    bucket_cnt *= 2;
+  return bucket_cnt;
 }
 
-/* Returns true if X is a power of 2, otherwise false. */
-static inline size_t
-is_power_of_2 (size_t x) 
+/* Moves up to CNT of the old buckets of hash table H, which
+   must be being resized, into the current array, and frees the
+   old array once they are all moved. */
+static void
+move_buckets (struct hash *h, size_t cnt) 
 {
-  return x != 0 && turn_off_least_1bit (x) == 0;
-}
+  for (; cnt > 0 && h->moved_cnt < h->old_bucket_cnt; cnt--)
+    {
+      struct list *old_bucket = &h->old_buckets[h->moved_cnt++];
 
-/* Element per bucket ratios. */
-#define MIN_ELEMS_PER_BUCKET  1 /* Elems/bucket < 1: reduce # of buckets. */
-#define BEST_ELEMS_PER_BUCKET 2 /* Ideal elems/bucket. */
-#define MAX_ELEMS_PER_BUCKET  4 /* Elems/bucket > 4: increase # of buckets. */
+      while (!list_empty (old_bucket)) 
+        {
+          struct list_elem *elem = list_pop_front (old_bucket);
+          size_t bucket_idx = (h->hash (list_elem_to_hash_elem (elem), h->aux)
+                               & (h->bucket_cnt - 1));
+          list_push_front (&h->buckets[bucket_idx], elem);
+        }
+    }
+
+  if (h->moved_cnt == h->old_bucket_cnt) 
+    {
+      free (h->old_buckets);
+      h->old_buckets = NULL;
+      h->old_bucket_cnt = 0;
+      h->moved_cnt = 0;
+    }
+}
 
-/* Changes the number of buckets in hash table H to match the
-   ideal.  This function can fail because of an out-of-memory
-   condition, but that'll just make hash accesses less efficient;
-   we can still continue. */
+/* Keeps the number of buckets in hash table H near the ideal.
+   If H is being resized, moves a few more of its old buckets.
+   Otherwise, if H now has too many or too few elements per
+   bucket, starts resizing it by installing a new, empty array of
+   buckets, keeping the old one for the elements not yet moved.
+   This function can fail because of an out-of-memory condition,
+   but that'll just make hash accesses less efficient; we can
+   still continue. */
 static void
 rehash (struct hash *h) 
 {
-  size_t old_bucket_cnt, new_bucket_cnt;
-  struct list *new_buckets, *old_buckets;
+  size_t new_bucket_cnt;
+  struct list *new_buckets;
   size_t i;
 
   ASSERT (h != NULL);
 
-  /* Save old bucket info for later use. */
-  old_buckets = h->buckets;
-  old_bucket_cnt = h->bucket_cnt;
-
-  /* Calculate the number of buckets to use now.
-     We want one bucket for about every BEST_ELEMS_PER_BUCKET.
-     We must have at least four buckets, and the number of
-     buckets must be a power of 2. */
-  new_bucket_cnt = h->elem_cnt / BEST_ELEMS_PER_BUCKET;
-  if (new_bucket_cnt < 4)
-    new_bucket_cnt = 4;
-  while (!is_power_of_2 (new_bucket_cnt))
-    new_bucket_cnt = turn_off_least_1bit (new_bucket_cnt);
-
-  /* Don't do anything if the bucket count wouldn't change. */
-  if (new_bucket_cnt == old_bucket_cnt)
+  if (h->old_buckets != NULL)
+    {
+      move_buckets (h, MOVE_PER_OP);
+      return;
+    }
+
+  /* Don't do anything unless the load is out of bounds. */
+  if (h->elem_cnt <= h->bucket_cnt * MAX_ELEMS_PER_BUCKET
+      && (h->elem_cnt >= h->bucket_cnt * MIN_ELEMS_PER_BUCKET
+          || h->bucket_cnt <= h->min_bucket_cnt))
+    return;
+  new_bucket_cnt = bucket_cnt_for (h->elem_cnt, h->min_bucket_cnt);
+  if (new_bucket_cnt == h->bucket_cnt)
     return;
 
   /* Allocate new buckets and initialize them as empty. */
@@ -387,29 +502,13 @@ rehash (struct hash *h)
   for (i = 0; i < new_bucket_cnt; i++) 
     list_init (&new_buckets[i]);
 
-  /* Install new bucket info. */
+  /* Install new bucket info, keeping the old for now. */
+  h->old_buckets = h->buckets;
+  h->old_bucket_cnt = h->bucket_cnt;
+  h->moved_cnt = 0;
   h->buckets = new_buckets;
   h->bucket_cnt = new_bucket_cnt;
-
-  /* Move each old element into the appropriate new bucket. */
-  for (i = 0; i < old_bucket_cnt; i++) 
-    {
-      struct list *old_bucket;
-      struct list_elem *elem, *next;
-
-      old_bucket = &old_buckets[i];
-      for (elem = list_begin (old_bucket);
-           elem != list_end (old_bucket); elem = next) 
-        {
-          struct list *new_bucket
-            = find_bucket (h, list_elem_to_hash_elem (elem));
-          next = list_next (elem);
-          list_remove (elem);
-          list_push_front (new_bucket, elem);
-        }
-    }
-
-  free (old_buckets);
+  move_buckets (h, MOVE_PER_OP);
 }
 
 /* Inserts E into BUCKET (in hash table H). */
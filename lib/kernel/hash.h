@@ -18,7 +18,14 @@
    conversion from a struct hash_elem back to a structure object
    that contains it.  This is the same technique used in the
    linked list implementation.  Refer to lib/kernel/list.h for a
-   detailed explanation. */
+   detailed explanation.
+
+   The table grows and shrinks as elements come and go, but never
+   all at once: a resize allocates the new bucket array and then
+   moves a few buckets' worth of elements from the old array each
+   time the table is modified, so that no single operation takes
+   time proportional to the size of the table.  Meanwhile each
+   element is in whichever array its bucket has reached. */
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -61,6 +68,10 @@ struct hash
     size_t elem_cnt;            /* Number of elements in table. */
     size_t bucket_cnt;          /* Number of buckets, a power of 2. */
     struct list *buckets;       /* Array of `bucket_cnt' lists. */
+    size_t min_bucket_cnt;      /* Never shrink below this many buckets. */
+    struct list *old_buckets;   /* Array being resized from, or null. */
+    size_t old_bucket_cnt;      /* Number of buckets in `old_buckets'. */
+    size_t moved_cnt;           /* Old buckets moved so far. */
     hash_hash_func *hash;       /* Hash function. */
     hash_less_func *less;       /* Comparison function. */
     void *aux;                  /* Auxiliary data for `hash' and `less'. */
@@ -76,6 +87,8 @@ struct hash_iterator
 
 /* Basic life cycle. */
 bool hash_init (struct hash *, hash_hash_func *, hash_less_func *, void *aux);
+bool hash_init_size (struct hash *, size_t elem_cnt,
+                     hash_hash_func *, hash_less_func *, void *aux);
 void hash_clear (struct hash *, hash_action_func *);
 void hash_destroy (struct hash *, hash_action_func *);
 
@@ -99,5 +112,7 @@ bool hash_empty (struct hash *);
 unsigned hash_bytes (const void *, size_t);
 unsigned hash_string (const char *);
 unsigned hash_int (int);
+unsigned hash_mix (unsigned);
+unsigned hash_words (const uint32_t *, size_t cnt);
 
 #endif /* lib/kernel/hash.h */
@@ -0,0 +1,85 @@
+#include "histogram.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Initializes H as an empty histogram. */
+void
+histogram_init (struct histogram *h) 
+{
+  memset (h, 0, sizeof *h);
+}
+
+/* Returns the bucket that VALUE falls in.  Uses bsr on each
+   32-bit half, so that it does not depend on libgcc's 64-bit
+   routines. */
+static unsigned
+bucket_of (uint64_t value) 
+{
+  uint32_t high = value >> 32;
+  uint32_t low = value;
+  unsigned b;
+
+  if (high != 0)
+    b = 64 - __builtin_clz (high);
+  else if (low != 0)
+    b = 32 - __builtin_clz (low);
+  else
+    b = 0;
+  return b < HISTOGRAM_BUCKETS ? b : HISTOGRAM_BUCKETS - 1;
+}
+
+/* Adds VALUE to H. */
+void
+histogram_add (struct histogram *h, uint64_t value) 
+{
+  h->buckets[bucket_of (value)]++;
+}
+
+/* Returns the number of samples in H. */
+uint64_t
+histogram_count (const struct histogram *h) 
+{
+  uint64_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    cnt += h->buckets[i];
+  return cnt;
+}
+
+/* Returns an upper bound on the PERMILLE/1000 quantile of H, for
+   example 990 for the 99th percentile: at least that share of
+   the samples is below the value returned.  Returns 0 if H is
+   empty. */
+uint64_t
+histogram_percentile (const struct histogram *h, unsigned permille) 
+{
+  uint64_t cnt = histogram_count (h);
+  uint64_t cum = 0;
+  size_t i;
+
+  ASSERT (permille <= 1000);
+
+  if (cnt == 0)
+    return 0;
+  for (i = 0; i < HISTOGRAM_BUCKETS - 1; i++)
+    {
+      cum += h->buckets[i];
+      if (cum * 1000 >= cnt * permille)
+        return (uint64_t) 1 << i;
+    }
+  return UINT64_MAX;
+}
+
+/* Prints a summary of H, labeled NAME, if it has any samples. */
+void
+histogram_print (const char *name, const struct histogram *h) 
+{
+  uint64_t cnt = histogram_count (h);
+
+  if (cnt > 0)
+    printf ("%s: %llu samples, p50 < %llu, p99 < %llu, p99.9 < %llu\n",
+            name, cnt, histogram_percentile (h, 500),
+            histogram_percentile (h, 990), histogram_percentile (h, 999));
+}
@@ -0,0 +1,30 @@
+#ifndef __LIB_KERNEL_HISTOGRAM_H
+#define __LIB_KERNEL_HISTOGRAM_H
+
+/* Log-scale histogram.
+
+   Counts unsigned 64-bit samples in power-of-2 buckets: bucket 0
+   holds zeros and bucket B holds values in [2**(B-1), 2**B).
+   The last bucket also takes everything larger.  Adding a
+   sample is a bit scan and an increment, which is cheap enough
+   for the scheduler's fast paths.
+
+   Percentiles are reported as the upper bound of the bucket
+   they fall in, so they are accurate to within a factor of 2. */
+
+#include <stdint.h>
+
+#define HISTOGRAM_BUCKETS 48
+
+struct histogram
+  {
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+  };
+
+void histogram_init (struct histogram *);
+void histogram_add (struct histogram *, uint64_t value);
+uint64_t histogram_count (const struct histogram *);
+uint64_t histogram_percentile (const struct histogram *, unsigned permille);
+void histogram_print (const char *name, const struct histogram *);
+
+#endif /* lib/kernel/histogram.h */
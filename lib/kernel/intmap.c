@@ -0,0 +1,191 @@
+#include "intmap.h"
+#include "../debug.h"
+#include "hash.h"
+#include "threads/malloc.h"
+
+static bool resize (struct intmap *, size_t slot_cnt);
+static void place (struct intmap *, uint32_t key, void *value);
+
+/* Returns the slot where KEY's probe sequence starts in M. */
+static inline size_t
+home (const struct intmap *m, uint32_t key)
+{
+  return hash_mix (key) & m->mask;
+}
+
+/* Returns how far slot IDX in M, which must be in use, is past
+   its entry's home slot. */
+static inline size_t
+distance (const struct intmap *m, size_t idx)
+{
+  return (idx - home (m, m->slots[idx].key)) & m->mask;
+}
+
+/* Initializes M as an empty map with room for CNT entries before
+   it has to grow.  Returns true if successful, false if memory
+   runs out. */
+bool
+intmap_init (struct intmap *m, size_t cnt)
+{
+  size_t slot_cnt = 8;
+
+  while (slot_cnt / 4 * 3 < cnt)
+    slot_cnt *= 2;
+
+  m->cnt = 0;
+  m->mask = 0;
+  m->slots = NULL;
+  return resize (m, slot_cnt);
+}
+
+/* Frees the memory used by M, which must not be used afterward
+   unless reinitialized.  Does not do anything with the values
+   M held. */
+void
+intmap_destroy (struct intmap *m)
+{
+  free (m->slots);
+  m->slots = NULL;
+}
+
+/* Returns the value for KEY in M, or a null pointer if KEY is not
+   in M. */
+void *
+intmap_find (const struct intmap *m, uint32_t key)
+{
+  size_t idx, dist;
+
+  for (idx = home (m, key), dist = 0; ; idx = (idx + 1) & m->mask, dist++)
+    {
+      const struct intmap_slot *s = &m->slots[idx];
+
+      /* KEY would have displaced an entry closer to home. */
+      if (s->value == NULL || distance (m, idx) < dist)
+        return NULL;
+      if (s->key == key)
+        return s->value;
+    }
+}
+
+/* Adds KEY to M with VALUE, which must be nonnull.  KEY must not
+   already be in M.  Returns true if successful, false if M has
+   to grow and memory runs out. */
+bool
+intmap_insert (struct intmap *m, uint32_t key, void *value)
+{
+  size_t slot_cnt = m->mask + 1;
+
+  ASSERT (value != NULL);
+  ASSERT (intmap_find (m, key) == NULL);
+
+  /* Growing can fail, but a table too full for our liking still
+     works as long as one slot stays empty to end searches. */
+  if (m->cnt + 1 > slot_cnt / 4 * 3
+      && !resize (m, slot_cnt * 2) && m->cnt + 1 >= slot_cnt)
+    return false;
+
+  place (m, key, value);
+  m->cnt++;
+  return true;
+}
+
+/* Removes KEY from M and returns its value, or returns a null
+   pointer if KEY is not in M. */
+void *
+intmap_remove (struct intmap *m, uint32_t key)
+{
+  size_t idx, next, dist;
+  void *value;
+
+  for (idx = home (m, key), dist = 0; ; idx = (idx + 1) & m->mask, dist++)
+    {
+      struct intmap_slot *s = &m->slots[idx];
+
+      if (s->value == NULL || distance (m, idx) < dist)
+        return NULL;
+      if (s->key == key)
+        break;
+    }
+  value = m->slots[idx].value;
+
+  /* Shift back the entries after IDX that are past home. */
+  for (next = (idx + 1) & m->mask;
+       m->slots[next].value != NULL && distance (m, next) > 0;
+       next = (next + 1) & m->mask)
+    {
+      m->slots[idx] = m->slots[next];
+      idx = next;
+    }
+  m->slots[idx].value = NULL;
+  m->cnt--;
+  return value;
+}
+
+/* Returns the number of entries in M. */
+size_t
+intmap_size (const struct intmap *m)
+{
+  return m->cnt;
+}
+
+/* Puts KEY and VALUE into the first slot in M where they are
+   further from home than the slot's entry, if any, and likewise
+   moves the entry displaced along, until one lands in an empty
+   slot.  M must have an empty slot and KEY must not be in M. */
+static void
+place (struct intmap *m, uint32_t key, void *value)
+{
+  size_t idx, dist;
+
+  for (idx = home (m, key), dist = 0; ; idx = (idx + 1) & m->mask, dist++)
+    {
+      struct intmap_slot *s = &m->slots[idx];
+      size_t s_dist;
+
+      if (s->value == NULL)
+        {
+          s->key = key;
+          s->value = value;
+          return;
+        }
+
+      s_dist = distance (m, idx);
+      if (s_dist < dist)
+        {
+          struct intmap_slot displaced = *s;
+
+          s->key = key;
+          s->value = value;
+          key = displaced.key;
+          value = displaced.value;
+          dist = s_dist;
+        }
+    }
+}
+
+/* Moves M's entries into a new array of SLOT_CNT slots, a power
+   of 2 with room for all of them.  Returns true if successful,
+   false if memory runs out, in which case M is unchanged. */
+static bool
+resize (struct intmap *m, size_t slot_cnt)
+{
+  struct intmap_slot *old_slots = m->slots;
+  size_t old_cnt = m->slots != NULL ? m->mask + 1 : 0;
+  size_t i;
+
+  ASSERT (slot_cnt > m->cnt);
+
+  m->slots = calloc (slot_cnt, sizeof *m->slots);
+  if (m->slots == NULL)
+    {
+      m->slots = old_slots;
+      return false;
+    }
+  m->mask = slot_cnt - 1;
+
+  for (i = 0; i < old_cnt; i++)
+    if (old_slots[i].value != NULL)
+      place (m, old_slots[i].key, old_slots[i].value);
+  free (old_slots);
+  return true;
+}
@@ -0,0 +1,51 @@
+#ifndef __LIB_KERNEL_INTMAP_H
+#define __LIB_KERNEL_INTMAP_H
+
+/* Integer-keyed map.
+
+   Maps 32-bit integer keys to nonnull pointers.  Unlike hash.h,
+   entries are stored in the table itself, a single array of
+   key-value slots searched by open addressing with linear
+   probing, so that a lookup reads a few consecutive slots
+   instead of following a list through scattered elements.  This
+   suits small, hot tables indexed by an integer or an address.
+
+   Slots are kept in Robin Hood order: an entry that has probed
+   further from its home slot displaces one that has probed
+   less.  This keeps probe sequences short and lets a failed
+   lookup stop early.  Removal shifts the entries after the
+   removed one back, so no tombstones are left behind.
+
+   The table doubles whenever it would become more than 3/4
+   full and never shrinks.  It allocates memory only then, so
+   intmap_insert() is the only operation that can fail. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A slot.  Empty if VALUE is null. */
+struct intmap_slot
+  {
+    uint32_t key;
+    void *value;
+  };
+
+/* Integer-keyed map. */
+struct intmap
+  {
+    size_t cnt;                 /* Number of entries. */
+    size_t mask;                /* Number of slots minus 1. */
+    struct intmap_slot *slots;  /* Array of `mask + 1' slots. */
+  };
+
+bool intmap_init (struct intmap *, size_t cnt);
+void intmap_destroy (struct intmap *);
+
+void *intmap_find (const struct intmap *, uint32_t key);
+bool intmap_insert (struct intmap *, uint32_t key, void *value);
+void *intmap_remove (struct intmap *, uint32_t key);
+
+size_t intmap_size (const struct intmap *);
+
+#endif /* lib/kernel/intmap.h */
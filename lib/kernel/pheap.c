@@ -0,0 +1,207 @@
+#include "pheap.h"
+#include "../debug.h"
+
+static struct pheap_elem *meld (struct pheap *,
+                                struct pheap_elem *, struct pheap_elem *);
+static struct pheap_elem *merge_pairs (struct pheap *,
+                                       struct pheap_elem *first);
+static void detach (struct pheap_elem *);
+
+/* Initializes heap H as an empty heap ordered by LESS, given
+   auxiliary data AUX. */
+void
+pheap_init (struct pheap *h, pheap_less_func *less, void *aux)
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->elem_cnt = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into heap H. */
+void
+pheap_push (struct pheap *h, struct pheap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  e->child = e->next = e->prev = NULL;
+  h->root = h->root != NULL ? meld (h, h->root, e) : e;
+  h->elem_cnt++;
+}
+
+/* Returns the maximum element in H.  Undefined behavior if H is
+   empty. */
+struct pheap_elem *
+pheap_top (const struct pheap *h)
+{
+  ASSERT (h != NULL);
+  ASSERT (h->root != NULL);
+
+  return h->root;
+}
+
+/* Removes and returns the maximum element in H.  Undefined
+   behavior if H is empty. */
+struct pheap_elem *
+pheap_pop (struct pheap *h)
+{
+  struct pheap_elem *top;
+
+  ASSERT (h != NULL);
+  ASSERT (h->root != NULL);
+
+  top = h->root;
+  h->root = merge_pairs (h, top->child);
+  h->elem_cnt--;
+  top->child = NULL;
+  return top;
+}
+
+/* Removes E, which must be in heap H, from H. */
+void
+pheap_remove (struct pheap *h, struct pheap_elem *e)
+{
+  struct pheap_elem *sub;
+
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  if (e == h->root)
+    {
+      pheap_pop (h);
+      return;
+    }
+
+  detach (e);
+  sub = merge_pairs (h, e->child);
+  if (sub != NULL)
+    h->root = meld (h, h->root, sub);
+  h->elem_cnt--;
+  e->child = NULL;
+}
+
+/* Restores the heap ordering of H after E, which must be in H,
+   has come to compare greater than it did before. */
+void
+pheap_increase (struct pheap *h, struct pheap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  if (e == h->root)
+    return;
+
+  /* Cut E's subtree out and meld it back in at the top.  E's
+     children are still no greater than E, so the subtree
+     remains a valid heap. */
+  detach (e);
+  h->root = meld (h, h->root, e);
+}
+
+/* Returns the number of elements in H. */
+size_t
+pheap_size (const struct pheap *h)
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+pheap_empty (const struct pheap *h)
+{
+  return h->root == NULL;
+}
+
+/* Melds root elements A and B into a single tree and returns its
+   root.  The lesser of the two becomes the first child of the
+   other. */
+static struct pheap_elem *
+meld (struct pheap *h, struct pheap_elem *a, struct pheap_elem *b)
+{
+  struct pheap_elem *t;
+
+  if (h->less (a, b, h->aux))
+    {
+      t = a;
+      a = b;
+      b = t;
+    }
+
+  /* B becomes A's first child. */
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+
+  a->next = a->prev = NULL;
+  return a;
+}
+
+/* Combines the sibling list starting at FIRST into a single tree
+   using the standard two-pass scheme and returns its root, or a
+   null pointer if FIRST is null.  Iterative, so that a long
+   sibling list cannot overflow a kernel stack. */
+static struct pheap_elem *
+merge_pairs (struct pheap *h, struct pheap_elem *first)
+{
+  struct pheap_elem *pairs = NULL;
+  struct pheap_elem *result = NULL;
+
+  /* First pass: meld siblings left to right in pairs, pushing
+     each result onto PAIRS, which ends up in reverse order. */
+  while (first != NULL)
+    {
+      struct pheap_elem *a = first;
+      struct pheap_elem *b = a->next;
+      struct pheap_elem *m;
+
+      if (b == NULL)
+        {
+          first = NULL;
+          a->prev = NULL;
+          m = a;
+        }
+      else
+        {
+          first = b->next;
+          a->next = a->prev = NULL;
+          b->next = b->prev = NULL;
+          m = meld (h, a, b);
+        }
+      m->next = pairs;
+      pairs = m;
+    }
+
+  /* Second pass: meld the pairs right to left. */
+  while (pairs != NULL)
+    {
+      struct pheap_elem *next = pairs->next;
+
+      pairs->next = NULL;
+      result = result != NULL ? meld (h, result, pairs) : pairs;
+      pairs = next;
+    }
+
+  return result;
+}
+
+/* Unlinks non-root element E, together with its subtree, from
+   its parent and siblings. */
+static void
+detach (struct pheap_elem *e)
+{
+  ASSERT (e->prev != NULL);
+
+  if (e->prev->child == e)
+    e->prev->child = e->next;
+  else
+    e->prev->next = e->next;
+  if (e->next != NULL)
+    e->next->prev = e->prev;
+  e->next = e->prev = NULL;
+}
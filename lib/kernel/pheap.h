@@ -0,0 +1,75 @@
+#ifndef __LIB_KERNEL_PHEAP_H
+#define __LIB_KERNEL_PHEAP_H
+
+/* Pairing heap.
+
+   An intrusive priority queue in the style of list.h and
+   hash.h: each structure that can be in a heap embeds a struct
+   pheap_elem, and pheap_entry() converts a struct pheap_elem
+   back to the enclosing structure.  No memory is allocated.
+
+   The heap is ordered by a caller-supplied "less" function and
+   pheap_top() returns the maximum element, the same convention
+   as list_max().  Costs, amortized:
+
+     - pheap_push(), pheap_top(), pheap_increase(): O(1).
+     - pheap_pop(), pheap_remove(): O(log n).
+
+   pheap_increase() must be called whenever an element's key
+   changes so that it compares greater than before (for example,
+   when a thread's priority rises).  To make an element compare
+   less than before, pheap_remove() it, update it, and
+   pheap_push() it again. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct pheap_elem
+  {
+    /* First child.  Children are linked through NEXT/PREV. */
+    struct pheap_elem *child;
+    /* Next sibling. */
+    struct pheap_elem *next;
+    /* Previous sibling, or parent if this is the first child,
+       or null if this is the root. */
+    struct pheap_elem *prev;
+  };
+
+/* Converts pointer to heap element PHEAP_ELEM into a pointer to
+   the structure that PHEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define pheap_entry(PHEAP_ELEM, STRUCT, MEMBER)         \
+        ((STRUCT *) ((uint8_t *) &(PHEAP_ELEM)->child   \
+                     - offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool pheap_less_func (const struct pheap_elem *a,
+                              const struct pheap_elem *b,
+                              void *aux);
+
+/* Pairing heap. */
+struct pheap
+  {
+    struct pheap_elem *root;    /* Maximum element, or null. */
+    size_t elem_cnt;            /* Number of elements in heap. */
+    pheap_less_func *less;      /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void pheap_init (struct pheap *, pheap_less_func *, void *aux);
+
+void pheap_push (struct pheap *, struct pheap_elem *);
+struct pheap_elem *pheap_top (const struct pheap *);
+struct pheap_elem *pheap_pop (struct pheap *);
+void pheap_remove (struct pheap *, struct pheap_elem *);
+void pheap_increase (struct pheap *, struct pheap_elem *);
+
+size_t pheap_size (const struct pheap *);
+bool pheap_empty (const struct pheap *);
+
+#endif /* lib/kernel/pheap.h */
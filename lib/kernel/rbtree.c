@@ -0,0 +1,417 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+static void rotate_left (struct rbtree *, struct rb_node *);
+static void rotate_right (struct rbtree *, struct rb_node *);
+static void insert_fixup (struct rbtree *, struct rb_node *);
+static void remove_fixup (struct rbtree *, struct rb_node *,
+                          struct rb_node *parent);
+
+/* Returns true if N is red.  Null leaves are black. */
+static inline bool
+is_red (const struct rb_node *n)
+{
+  return n != NULL && n->red;
+}
+
+/* Initializes tree T as an empty tree ordered by LESS, given
+   auxiliary data AUX. */
+void
+rb_init (struct rbtree *t, rb_less_func *less, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (less != NULL);
+
+  t->root = NULL;
+  t->elem_cnt = 0;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Inserts N into tree T, after any elements equal to it. */
+void
+rb_insert (struct rbtree *t, struct rb_node *n)
+{
+  struct rb_node *parent = NULL;
+  struct rb_node **link = &t->root;
+
+  ASSERT (t != NULL);
+  ASSERT (n != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      link = t->less (n, parent, t->aux) ? &parent->left : &parent->right;
+    }
+  n->parent = parent;
+  n->left = n->right = NULL;
+  n->red = true;
+  *link = n;
+
+  insert_fixup (t, n);
+  t->elem_cnt++;
+}
+
+/* Makes NEW take OLD's place as a child of PARENT, or as the root
+   of T if PARENT is null. */
+static void
+replace_child (struct rbtree *t, struct rb_node *parent,
+               struct rb_node *old, struct rb_node *new)
+{
+  if (parent == NULL)
+    t->root = new;
+  else if (parent->left == old)
+    parent->left = new;
+  else
+    parent->right = new;
+}
+
+/* Removes N, which must be in tree T, from T. */
+void
+rb_remove (struct rbtree *t, struct rb_node *n)
+{
+  struct rb_node *child, *parent;
+  bool removed_red;
+
+  ASSERT (t != NULL);
+  ASSERT (n != NULL);
+
+  if (n->left == NULL || n->right == NULL)
+    {
+      /* N has at most one child, which takes its place. */
+      child = n->left != NULL ? n->left : n->right;
+      parent = n->parent;
+      removed_red = n->red;
+      if (child != NULL)
+        child->parent = parent;
+      replace_child (t, parent, n, child);
+    }
+  else
+    {
+      /* N's successor S, which has no left child, takes its
+         place, and S's right child takes S's. */
+      struct rb_node *s = n->right;
+
+      while (s->left != NULL)
+        s = s->left;
+      child = s->right;
+      removed_red = s->red;
+      if (s->parent == n)
+        parent = s;
+      else
+        {
+          parent = s->parent;
+          parent->left = child;
+          if (child != NULL)
+            child->parent = parent;
+          s->right = n->right;
+          s->right->parent = s;
+        }
+      s->left = n->left;
+      s->left->parent = s;
+      s->parent = n->parent;
+      s->red = n->red;
+      replace_child (t, n->parent, n, s);
+    }
+
+  if (!removed_red)
+    remove_fixup (t, child, parent);
+  t->elem_cnt--;
+}
+
+/* Returns the first element in tree T equal to KEY, or a null
+   pointer if there is none. */
+struct rb_node *
+rb_find (const struct rbtree *t, const struct rb_node *key)
+{
+  struct rb_node *n = rb_lower_bound (t, key);
+
+  return n != NULL && !t->less (key, n, t->aux) ? n : NULL;
+}
+
+/* Returns the first element in tree T that is not less than KEY,
+   or a null pointer if there is none. */
+struct rb_node *
+rb_lower_bound (const struct rbtree *t, const struct rb_node *key)
+{
+  struct rb_node *n = t->root, *bound = NULL;
+
+  while (n != NULL)
+    if (t->less (n, key, t->aux))
+      n = n->right;
+    else
+      {
+        bound = n;
+        n = n->left;
+      }
+  return bound;
+}
+
+/* Returns the first element in tree T that is greater than KEY,
+   or a null pointer if there is none. */
+struct rb_node *
+rb_upper_bound (const struct rbtree *t, const struct rb_node *key)
+{
+  struct rb_node *n = t->root, *bound = NULL;
+
+  while (n != NULL)
+    if (t->less (key, n, t->aux))
+      {
+        bound = n;
+        n = n->left;
+      }
+    else
+      n = n->right;
+  return bound;
+}
+
+/* Returns the least element in tree T, or a null pointer if T is
+   empty. */
+struct rb_node *
+rb_first (const struct rbtree *t)
+{
+  struct rb_node *n = t->root;
+
+  if (n != NULL)
+    while (n->left != NULL)
+      n = n->left;
+  return n;
+}
+
+/* Returns the greatest element in tree T, or a null pointer if T
+   is empty. */
+struct rb_node *
+rb_last (const struct rbtree *t)
+{
+  struct rb_node *n = t->root;
+
+  if (n != NULL)
+    while (n->right != NULL)
+      n = n->right;
+  return n;
+}
+
+/* Returns the element that follows N in its tree, or a null
+   pointer if N is the last. */
+struct rb_node *
+rb_next (struct rb_node *n)
+{
+  ASSERT (n != NULL);
+
+  if (n->right != NULL)
+    {
+      n = n->right;
+      while (n->left != NULL)
+        n = n->left;
+      return n;
+    }
+  while (n->parent != NULL && n == n->parent->right)
+    n = n->parent;
+  return n->parent;
+}
+
+/* Returns the element that precedes N in its tree, or a null
+   pointer if N is the first. */
+struct rb_node *
+rb_prev (struct rb_node *n)
+{
+  ASSERT (n != NULL);
+
+  if (n->left != NULL)
+    {
+      n = n->left;
+      while (n->right != NULL)
+        n = n->right;
+      return n;
+    }
+  while (n->parent != NULL && n == n->parent->left)
+    n = n->parent;
+  return n->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rb_size (const struct rbtree *t)
+{
+  return t->elem_cnt;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rb_empty (const struct rbtree *t)
+{
+  return t->root == NULL;
+}
+
+/* Rotates N's right child up into N's place in tree T. */
+static void
+rotate_left (struct rbtree *t, struct rb_node *n)
+{
+  struct rb_node *r = n->right;
+
+  n->right = r->left;
+  if (r->left != NULL)
+    r->left->parent = n;
+  r->parent = n->parent;
+  replace_child (t, n->parent, n, r);
+  r->left = n;
+  n->parent = r;
+}
+
+/* Rotates N's left child up into N's place in tree T. */
+static void
+rotate_right (struct rbtree *t, struct rb_node *n)
+{
+  struct rb_node *l = n->left;
+
+  n->left = l->right;
+  if (l->right != NULL)
+    l->right->parent = n;
+  l->parent = n->parent;
+  replace_child (t, n->parent, n, l);
+  l->right = n;
+  n->parent = l;
+}
+
+/* Restores the red-black properties of tree T after red node N
+   has been added as a leaf. */
+static void
+insert_fixup (struct rbtree *t, struct rb_node *n)
+{
+  struct rb_node *p;
+
+  /* The root is black, so a red parent always has a parent. */
+  while (is_red (p = n->parent))
+    {
+      struct rb_node *g = p->parent;
+
+      if (p == g->left)
+        {
+          struct rb_node *u = g->right;
+
+          if (is_red (u))
+            {
+              /* Push the grandparent's blackness down and go on
+                 from there. */
+              p->red = u->red = false;
+              g->red = true;
+              n = g;
+              continue;
+            }
+          if (n == p->right)
+            {
+              rotate_left (t, p);
+              n = p;
+              p = n->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_right (t, g);
+        }
+      else
+        {
+          struct rb_node *u = g->left;
+
+          if (is_red (u))
+            {
+              p->red = u->red = false;
+              g->red = true;
+              n = g;
+              continue;
+            }
+          if (n == p->left)
+            {
+              rotate_right (t, p);
+              n = p;
+              p = n->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_left (t, g);
+        }
+    }
+  t->root->red = false;
+}
+
+/* Restores the red-black properties of tree T after a black node
+   has been removed from between PARENT and N, its former child,
+   which may be null.  The path through N is then one black node
+   short. */
+static void
+remove_fixup (struct rbtree *t, struct rb_node *n, struct rb_node *parent)
+{
+  while (n != t->root && !is_red (n))
+    {
+      if (n == parent->left)
+        {
+          /* The sibling's side has a black node to spare, so the
+             sibling exists. */
+          struct rb_node *s = parent->right;
+
+          if (s->red)
+            {
+              s->red = false;
+              parent->red = true;
+              rotate_left (t, parent);
+              s = parent->right;
+            }
+          if (!is_red (s->left) && !is_red (s->right))
+            {
+              /* Make both sides short and go on from the parent. */
+              s->red = true;
+              n = parent;
+              parent = n->parent;
+            }
+          else
+            {
+              if (!is_red (s->right))
+                {
+                  s->left->red = false;
+                  s->red = true;
+                  rotate_right (t, s);
+                  s = parent->right;
+                }
+              s->red = parent->red;
+              parent->red = false;
+              s->right->red = false;
+              rotate_left (t, parent);
+              n = t->root;
+            }
+        }
+      else
+        {
+          struct rb_node *s = parent->left;
+
+          if (s->red)
+            {
+              s->red = false;
+              parent->red = true;
+              rotate_right (t, parent);
+              s = parent->left;
+            }
+          if (!is_red (s->left) && !is_red (s->right))
+            {
+              s->red = true;
+              n = parent;
+              parent = n->parent;
+            }
+          else
+            {
+              if (!is_red (s->left))
+                {
+                  s->right->red = false;
+                  s->red = true;
+                  rotate_left (t, s);
+                  s = parent->left;
+                }
+              s->red = parent->red;
+              parent->red = false;
+              s->left->red = false;
+              rotate_right (t, parent);
+              n = t->root;
+            }
+        }
+    }
+  if (n != NULL)
+    n->red = false;
+}
@@ -0,0 +1,98 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   An intrusive balanced binary search tree in the style of
+   list.h and pheap.h: each structure that can be in a tree
+   embeds a struct rb_node, and rb_entry() converts a struct
+   rb_node back to the enclosing structure.  No memory is
+   allocated.
+
+   The tree is ordered by a caller-supplied "less" function.
+   Equal elements are allowed, and rb_insert() puts a new one
+   after those already in the tree, so that elements that compare
+   equal come out in the order they went in.  Costs:
+
+     - rb_insert(), rb_remove(): O(log n).
+     - rb_find(), rb_lower_bound(), rb_upper_bound(): O(log n).
+     - rb_first(), rb_last(): O(log n).
+     - rb_next(), rb_prev(): O(1) amortized over a whole walk.
+
+   An element's key must not change while it is in a tree.  To
+   change it, rb_remove() the element, update it, and
+   rb_insert() it again.
+
+   Walking the elements from LO up to, but not including, HI,
+   where LO and HI are elements used only as keys:
+
+      struct rb_node *n;
+
+      for (n = rb_lower_bound (&tree, &lo.node);
+           n != NULL && tree.less (n, &hi.node, tree.aux);
+           n = rb_next (n))
+        {
+          struct foo *f = rb_entry (n, struct foo, node);
+          ...do something with f...
+        }
+
+   Removing the current element from the tree during such a walk
+   is allowed if rb_next() is called on it first. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree node. */
+struct rb_node
+  {
+    struct rb_node *parent;     /* Parent, or null for the root. */
+    struct rb_node *left;       /* Lesser children, or null. */
+    struct rb_node *right;      /* Greater or equal children, or null. */
+    bool red;                   /* Red, or black? */
+  };
+
+/* Converts pointer to tree node RB_NODE into a pointer to the
+   structure that RB_NODE is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   tree node. */
+#define rb_entry(RB_NODE, STRUCT, MEMBER)                       \
+        ((STRUCT *) ((uint8_t *) &(RB_NODE)->parent             \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree nodes A and B, given auxiliary
+   data AUX.  Returns true if A is less than B, or false if A is
+   greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_node *a,
+                           const struct rb_node *b,
+                           void *aux);
+
+/* Red-black tree. */
+struct rbtree
+  {
+    struct rb_node *root;       /* Root, or null if empty. */
+    size_t elem_cnt;            /* Number of elements in tree. */
+    rb_less_func *less;         /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void rb_init (struct rbtree *, rb_less_func *, void *aux);
+
+void rb_insert (struct rbtree *, struct rb_node *);
+void rb_remove (struct rbtree *, struct rb_node *);
+
+struct rb_node *rb_find (const struct rbtree *, const struct rb_node *);
+struct rb_node *rb_lower_bound (const struct rbtree *,
+                                const struct rb_node *);
+struct rb_node *rb_upper_bound (const struct rbtree *,
+                                const struct rb_node *);
+
+struct rb_node *rb_first (const struct rbtree *);
+struct rb_node *rb_last (const struct rbtree *);
+struct rb_node *rb_next (struct rb_node *);
+struct rb_node *rb_prev (struct rb_node *);
+
+size_t rb_size (const struct rbtree *);
+bool rb_empty (const struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
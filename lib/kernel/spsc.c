@@ -0,0 +1,109 @@
+#include "spsc.h"
+#include <debug.h>
+#include <string.h>
+
+/* Keeps the compiler from moving memory accesses across it. */
+#define barrier() asm volatile ("" : : : "memory")
+
+/* Returns *P, read exactly once, since the other side of the
+   ring may change it at any time. */
+static inline size_t
+load (const size_t *p)
+{
+  return *(const volatile size_t *) p;
+}
+
+/* Sets *P to VALUE with a single write. */
+static inline void
+store (size_t *p, size_t value)
+{
+  *(volatile size_t *) p = value;
+}
+
+/* Initializes R to use the CAPACITY bytes in BUF, all of which
+   it may fill.  CAPACITY must be a power of 2. */
+void
+spsc_init (struct spsc *r, void *buf, size_t capacity)
+{
+  ASSERT (r != NULL);
+  ASSERT (buf != NULL);
+  ASSERT (capacity > 0 && (capacity & (capacity - 1)) == 0);
+
+  r->buf = buf;
+  r->capacity = capacity;
+  r->head = r->tail = 0;
+}
+
+/* Returns the number of bytes in R.  The other side may change
+   it at any time: the producer can only see it too large, and
+   the consumer too small. */
+size_t
+spsc_count (const struct spsc *r)
+{
+  return load (&r->head) - load (&r->tail);
+}
+
+/* Returns true if R holds no bytes. */
+bool
+spsc_empty (const struct spsc *r)
+{
+  return spsc_count (r) == 0;
+}
+
+/* Returns true if R has no room for another byte. */
+bool
+spsc_full (const struct spsc *r)
+{
+  return spsc_count (r) == r->capacity;
+}
+
+/* Copies as many of the CNT bytes at BUF_ into R as fit and
+   returns the number copied.  Only the producer may call it. */
+size_t
+spsc_push (struct spsc *r, const void *buf_, size_t cnt)
+{
+  const uint8_t *buf = buf_;
+  size_t head = r->head;
+  size_t room = r->capacity - (head - load (&r->tail));
+  size_t ofs = head & (r->capacity - 1);
+  size_t first;
+
+  if (cnt > room)
+    cnt = room;
+
+  /* Read TAIL before overwriting the bytes it frees.  The bytes
+     may wrap around the end of the buffer. */
+  barrier ();
+  first = r->capacity - ofs < cnt ? r->capacity - ofs : cnt;
+  memcpy (r->buf + ofs, buf, first);
+  memcpy (r->buf, buf + first, cnt - first);
+
+  barrier ();
+  store (&r->head, head + cnt);
+  return cnt;
+}
+
+/* Copies up to CNT bytes out of R into BUF_ and returns the
+   number copied.  Only the consumer may call it. */
+size_t
+spsc_pop (struct spsc *r, void *buf_, size_t cnt)
+{
+  uint8_t *buf = buf_;
+  size_t tail = r->tail;
+  size_t avail = load (&r->head) - tail;
+  size_t ofs = tail & (r->capacity - 1);
+  size_t first;
+
+  if (cnt > avail)
+    cnt = avail;
+
+  /* Read HEAD before the bytes it covers. */
+  barrier ();
+  first = r->capacity - ofs < cnt ? r->capacity - ofs : cnt;
+  memcpy (buf, r->buf + ofs, first);
+  memcpy (buf + first, r->buf, cnt - first);
+
+  barrier ();
+  store (&r->tail, tail + cnt);
+  return cnt;
+}
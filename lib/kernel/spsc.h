@@ -0,0 +1,46 @@
+#ifndef __LIB_KERNEL_SPSC_H
+#define __LIB_KERNEL_SPSC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Single-producer, single-consumer ring of bytes.
+
+   One side pushes bytes and the other pops them, each without
+   any lock or interrupt disabling, so that a device's interrupt
+   handler and a kernel thread can pass data through it while
+   both run freely.  HEAD counts the bytes ever pushed and is
+   written only by the producer; TAIL counts those ever popped
+   and is written only by the consumer.  Both run on, wrapping
+   around at SIZE_MAX + 1, which a power-of-2 capacity divides,
+   so HEAD - TAIL is always the number of bytes in the ring and
+   the whole buffer can be used.
+
+   The producer copies bytes in before it advances HEAD, and the
+   consumer copies them out before it advances TAIL, so neither
+   side ever sees a byte that is not there yet or overwrites one
+   that is still to be read.  x86 does not reorder stores with
+   other stores, or loads with other loads, so compiler barriers
+   are enough to keep these in order.  See [IA32-v3a] 8.2.2
+   "Memory Ordering in P6 and More Recent Processor Families".
+
+   Several producers, or several consumers, must be serialized
+   by some other means, and a side that wants to sleep until
+   there is data or room must arrange its own wakeup. */
+struct spsc
+  {
+    uint8_t *buf;               /* Buffer of CAPACITY bytes. */
+    size_t capacity;            /* Size of BUF, a power of 2. */
+    size_t head;                /* Bytes pushed so far. */
+    size_t tail;                /* Bytes popped so far. */
+  };
+
+void spsc_init (struct spsc *, void *buf, size_t capacity);
+size_t spsc_count (const struct spsc *);
+bool spsc_empty (const struct spsc *);
+bool spsc_full (const struct spsc *);
+size_t spsc_push (struct spsc *, const void *, size_t cnt);
+size_t spsc_pop (struct spsc *, void *, size_t cnt);
+
+#endif /* lib/kernel/spsc.h */
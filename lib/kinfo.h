@@ -0,0 +1,36 @@
+#ifndef __LIB_KINFO_H
+#define __LIB_KINFO_H
+
+#include <seqlock.h>
+#include <stdint.h>
+
+/* Kernel information page.
+
+   The kernel maps one page read-only at KINFO_ADDR in every
+   user address space, so that user programs can read the time
+   and their own process and thread IDs without a system call.  The page is
+   above PHYS_BASE, in the part of the page directory that every
+   process shares with the kernel, so no process maps, copies, or
+   frees it.
+
+   The timer interrupt rewrites the time fields every tick under
+   LOCK, a seqlock, so readers follow the protocol in
+   lib/seqlock.h to get a consistent copy.  The kernel changes PID and TID whenever
+   it switches to another user thread. */
+#define KINFO_ADDR 0xffffe000
+
+struct kinfo
+  {
+    struct seqlock lock;        /* Protects the time fields. */
+    int32_t pid;                /* Process running. */
+    int64_t ticks;              /* Timer ticks since boot. */
+    uint64_t tick_tsc;          /* Time-stamp counter at TICKS. */
+    uint64_t tsc_mult;          /* Nanoseconds per TSC cycle, 32.32. */
+    uint32_t tick_cycles;       /* TSC cycles per tick, 0 if unknown. */
+    uint32_t tick_ns;           /* Nanoseconds per tick. */
+    uint32_t boot_time;         /* Seconds since the epoch at boot. */
+    int32_t load_avg;           /* System load average, times 100. */
+    int32_t tid;                /* Thread running, within PID. */
+  };
+
+#endif /* lib/kinfo.h */
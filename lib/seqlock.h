@@ -0,0 +1,80 @@
+#ifndef __LIB_SEQLOCK_H
+#define __LIB_SEQLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Sequence lock.
+
+   Protects data that is written rarely, by one writer at a time,
+   and read often, such as the time.  The writer makes SEQ odd
+   while it changes the data and changes it again when done, so
+   a reader that sees the same even value of SEQ before and after
+   reading has a consistent copy, and otherwise reads again.
+   Readers never write to the lock, so they need no interrupt
+   disabling or atomic operations, and can even be user programs
+   reading a page that the kernel maps read-only for them.
+
+   Writers must be serialized by some other means, such as
+   running only in an interrupt handler or with interrupts off.
+   A reader must not interrupt the writer on the same CPU, or it
+   will spin forever.
+
+   x86 does not reorder stores with other stores, or loads with
+   other loads, so compiler barriers are enough to order the
+   accesses to SEQ with the accesses to the data.  See
+   [IA32-v3a] 8.2.2 "Memory Ordering in P6 and More Recent
+   Processor Families". */
+struct seqlock
+  {
+    uint32_t seq;               /* Odd while the data is updated. */
+  };
+
+/* Initializes LOCK. */
+static inline void
+seqlock_init (struct seqlock *lock)
+{
+  lock->seq = 0;
+}
+
+/* Starts changing the data protected by LOCK. */
+static inline void
+seqlock_write_begin (volatile struct seqlock *lock)
+{
+  lock->seq++;
+  asm volatile ("" : : : "memory");
+}
+
+/* Finishes changing the data protected by LOCK. */
+static inline void
+seqlock_write_end (volatile struct seqlock *lock)
+{
+  asm volatile ("" : : : "memory");
+  lock->seq++;
+}
+
+/* Starts reading the data protected by LOCK, waiting for any
+   writer to finish.  Returns a value to pass to
+   seqlock_read_retry(). */
+static inline uint32_t
+seqlock_read_begin (const volatile struct seqlock *lock)
+{
+  uint32_t seq;
+
+  while (((seq = lock->seq) & 1) != 0)
+    asm volatile ("pause");
+  asm volatile ("" : : : "memory");
+  return seq;
+}
+
+/* Finishes reading the data protected by LOCK.  Returns true if
+   a writer changed it since the seqlock_read_begin() call that
+   returned SEQ, in which case the caller must read it again. */
+static inline bool
+seqlock_read_retry (const volatile struct seqlock *lock, uint32_t seq)
+{
+  asm volatile ("" : : : "memory");
+  return lock->seq != seq;
+}
+
+#endif /* lib/seqlock.h */
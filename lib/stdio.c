@@ -13,7 +13,7 @@ struct vsnprintf_aux
     int max_length;     /* Max length of output string. */
   };
 
-static void vsnprintf_helper (char, void *);
+static void vsnprintf_helper (const char *, size_t, void *);
 
 /* Like vprintf(), except that output is stored into BUFFER,
    which must have space for BUF_SIZE characters.  Writes at most
@@ -43,12 +43,18 @@ vsnprintf (char *buffer, size_t buf_size, const char *format, va_list args)
 
 /* Helper function for vsnprintf(). */
 static void
-vsnprintf_helper (char ch, void *aux_)
+vsnprintf_helper (const char *s, size_t n, void *aux_)
 {
   struct vsnprintf_aux *aux = aux_;
 
-  if (aux->length++ < aux->max_length)
-    *aux->p++ = ch;
+  if (aux->length < aux->max_length)
+    {
+      size_t room = aux->max_length - aux->length;
+      size_t cnt = n < room ? n : room;
+      memcpy (aux->p, s, cnt);
+      aux->p += cnt;
+    }
+  aux->length += n;
 }
 
 /* Like printf(), except that output is stored into BUFFER,
@@ -140,31 +146,53 @@ static const struct integer_base base_o = {8, "01234567", 0, 3};
 static const struct integer_base base_x = {16, "0123456789abcdef", 'x', 4};
 static const struct integer_base base_X = {16, "0123456789ABCDEF", 'X', 4};
 
+/* "00" through "99", for converting decimal numbers two digits
+   at a time. */
+static const char digit_pairs[] =
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
 static const char *parse_conversion (const char *format,
                                      struct printf_conversion *,
                                      va_list *);
 static void format_integer (uintmax_t value, bool is_signed, bool negative, 
                             const struct integer_base *,
                             const struct printf_conversion *,
-                            void (*output) (char, void *), void *aux);
+                            void (*output) (const char *, size_t, void *),
+                            void *aux);
+static char *format_decimal (uintmax_t value, char *end);
+static char *format_decimal32 (uint32_t value, char *end);
 static void output_dup (char ch, size_t cnt,
-                        void (*output) (char, void *), void *aux);
+                        void (*output) (const char *, size_t, void *),
+                        void *aux);
 static void format_string (const char *string, int length,
                            struct printf_conversion *,
-                           void (*output) (char, void *), void *aux);
+                           void (*output) (const char *, size_t, void *),
+                           void *aux);
 
+/* Formats FORMAT with ARGS, passing the output to OUTPUT along
+   with AUX.  OUTPUT receives a run of characters at a time, such
+   as all of the literal text up to the next conversion or all of
+   a converted number, and may receive runs of length 0. */
 void
 __vprintf (const char *format, va_list args,
-           void (*output) (char, void *), void *aux)
+           void (*output) (const char *, size_t, void *), void *aux)
 {
   for (; *format != '\0'; format++)
     {
       struct printf_conversion c;
 
-      /* Literally copy non-conversions to output. */
+      /* Literally copy non-conversions to output, up to the next
+         conversion all at once. */
       if (*format != '%') 
         {
-          output (*format, aux);
+          const char *run = format;
+          while (format[1] != '\0' && format[1] != '%')
+            format++;
+          output (run, format - run + 1, aux);
           continue;
         }
       format++;
@@ -172,7 +200,7 @@ __vprintf (const char *format, va_list args,
       /* %% => %. */
       if (*format == '%') 
         {
-          output ('%', aux);
+          output ("%", 1, aux);
           continue;
         }
 
@@ -470,9 +498,12 @@ static void
 format_integer (uintmax_t value, bool is_signed, bool negative, 
                 const struct integer_base *b,
                 const struct printf_conversion *c,
-                void (*output) (char, void *), void *aux)
+                void (*output) (const char *, size_t, void *), void *aux)
 {
-  char buf[64], *cp;            /* Buffer and current position. */
+  char buf[64];                 /* Buffer, filled from the end. */
+  char *end = buf + sizeof buf; /* End of buffer. */
+  char *cp;                     /* First character in buffer. */
+  char *digits;                 /* First digit in buffer. */
   int x;                        /* `x' character to use or 0 if none. */
   int sign;                     /* Sign character or 0 if none. */
   int precision;                /* Rendered precision. */
@@ -498,60 +529,133 @@ format_integer (uintmax_t value, bool is_signed, bool negative,
      nonzero value with the # flag. */
   x = (c->flags & POUND) && value ? b->x : 0;
 
-  /* Accumulate digits into buffer.
-     This algorithm produces digits in reverse order, so later we
-     will output the buffer's content in reverse. */
-  cp = buf;
-  digit_cnt = 0;
-  while (value > 0) 
+  /* Accumulate digits into buffer, from the least significant
+     digit at its end toward its start.  Decimal numbers without
+     grouping, by far the most common, take a faster path. */
+  if (b->base == 10 && (c->flags & GROUP) == 0)
+    cp = format_decimal (value, end);
+  else
     {
-      if ((c->flags & GROUP) && digit_cnt > 0 && digit_cnt % b->group == 0)
-        *cp++ = ',';
-      *cp++ = b->digits[value % b->base];
-      value /= b->base;
-      digit_cnt++;
+      cp = end;
+      digit_cnt = 0;
+      while (value > 0) 
+        {
+          if ((c->flags & GROUP) && digit_cnt > 0
+              && digit_cnt % b->group == 0)
+            *--cp = ',';
+          *--cp = b->digits[value % b->base];
+          value /= b->base;
+          digit_cnt++;
+        }
     }
 
-  /* Append enough zeros to match precision.
+  /* Prepend enough zeros to match precision, leaving room for
+     the sign and `0x'.
      If requested precision is 0, then a value of zero is
      rendered as a null string, otherwise as "0".
      If the # flag is used with base 8, the result must always
      begin with a zero. */
   precision = c->precision < 0 ? 1 : c->precision;
-  while (cp - buf < precision && cp < buf + sizeof buf - 1)
-    *cp++ = '0';
-  if ((c->flags & POUND) && b->base == 8 && (cp == buf || cp[-1] != '0'))
-    *cp++ = '0';
+  while (end - cp < precision && cp > buf + 4)
+    *--cp = '0';
+  if ((c->flags & POUND) && b->base == 8 && (cp == end || *cp != '0'))
+    *--cp = '0';
 
   /* Calculate number of pad characters to fill field width. */
-  pad_cnt = c->width - (cp - buf) - (x ? 2 : 0) - (sign != 0);
+  pad_cnt = c->width - (end - cp) - (x ? 2 : 0) - (sign != 0);
   if (pad_cnt < 0)
     pad_cnt = 0;
 
+  /* Put the sign and `0x' in front of the digits. */
+  digits = cp;
+  if (x) 
+    {
+      *--cp = x;
+      *--cp = '0';
+    }
+  if (sign)
+    *--cp = sign;
+
   /* Do output. */
   if ((c->flags & (MINUS | ZERO)) == 0)
     output_dup (' ', pad_cnt, output, aux);
-  if (sign)
-    output (sign, aux);
-  if (x) 
+  if (c->flags & ZERO)
     {
-      output ('0', aux);
-      output (x, aux); 
+      output (cp, digits - cp, aux);
+      output_dup ('0', pad_cnt, output, aux);
+      cp = digits;
     }
-  if (c->flags & ZERO)
-    output_dup ('0', pad_cnt, output, aux);
-  while (cp > buf)
-    output (*--cp, aux);
+  output (cp, end - cp, aux);
   if (c->flags & MINUS)
     output_dup (' ', pad_cnt, output, aux);
 }
 
+/* Writes the decimal digits of VALUE, or nothing if VALUE is 0,
+   into the bytes just before END.  Returns the first digit.
+
+   Most values fit in 32 bits, and converting those needs no
+   64-bit division, which costs a call to __udivdi3().  A larger
+   value takes one 64-bit division for each 9 digits until the
+   rest of it fits. */
+static char *
+format_decimal (uintmax_t value, char *end)
+{
+  char *cp = end;
+
+  while (value > UINT32_MAX)
+    {
+      uintmax_t high = value / 1000000000;
+      char *chunk = cp;
+
+      cp = format_decimal32 (value - high * 1000000000, cp);
+      while (chunk - cp < 9)
+        *--cp = '0';
+      value = high;
+    }
+  return format_decimal32 (value, cp);
+}
+
+/* Writes the decimal digits of VALUE, or nothing if VALUE is 0,
+   into the bytes just before END, two digits per division.
+   Returns the first digit. */
+static char *
+format_decimal32 (uint32_t value, char *end)
+{
+  char *cp = end;
+
+  while (value >= 100)
+    {
+      const char *pair = digit_pairs + value % 100 * 2;
+      value /= 100;
+      cp -= 2;
+      cp[0] = pair[0];
+      cp[1] = pair[1];
+    }
+  if (value >= 10)
+    {
+      cp -= 2;
+      cp[0] = digit_pairs[value * 2];
+      cp[1] = digit_pairs[value * 2 + 1];
+    }
+  else if (value > 0)
+    *--cp = '0' + value;
+  return cp;
+}
+
 /* Writes CH to OUTPUT with auxiliary data AUX, CNT times. */
 static void
-output_dup (char ch, size_t cnt, void (*output) (char, void *), void *aux) 
+output_dup (char ch, size_t cnt,
+            void (*output) (const char *, size_t, void *), void *aux) 
 {
-  while (cnt-- > 0)
-    output (ch, aux);
+  char buf[16];
+
+  memset (buf, ch, cnt < sizeof buf ? cnt : sizeof buf);
+  while (cnt > 0)
+    {
+      size_t n = cnt < sizeof buf ? cnt : sizeof buf;
+      output (buf, n, aux);
+      cnt -= n;
+    }
 }
 
 /* Formats the LENGTH characters starting at STRING according to
@@ -560,13 +664,11 @@ output_dup (char ch, size_t cnt, void (*output) (char, void *), void *aux)
 static void
 format_string (const char *string, int length,
                struct printf_conversion *c,
-               void (*output) (char, void *), void *aux) 
+               void (*output) (const char *, size_t, void *), void *aux) 
 {
-  int i;
   if (c->width > length && (c->flags & MINUS) == 0)
     output_dup (' ', c->width - length, output, aux);
-  for (i = 0; i < length; i++)
-    output (string[i], aux);
+  output (string, length, aux);
   if (c->width > length && (c->flags & MINUS) != 0)
     output_dup (' ', c->width - length, output, aux);
 }
@@ -575,7 +677,7 @@ format_string (const char *string, int length,
    va_list. */
 void
 __printf (const char *format,
-          void (*output) (char, void *), void *aux, ...) 
+          void (*output) (const char *, size_t, void *), void *aux, ...) 
 {
   va_list args;
 
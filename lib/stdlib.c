@@ -3,6 +3,8 @@
 #include <random.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
 /* Converts a string representation of a signed decimal integer
    in S into an `int', which is returned. */
@@ -52,7 +54,7 @@ compare_thunk (const void *a, const void *b, void *aux)
    using COMPARE.  When COMPARE is passed a pair of elements A
    and B, respectively, it must return a strcmp()-type result,
    i.e. less than zero if A < B, zero if A == B, greater than
-   zero if A > B.  Runs in O(n lg n) time and O(1) space in
+   zero if A > B.  Runs in O(n lg n) time and O(lg n) space in
    CNT. */
 void
 qsort (void *array, size_t cnt, size_t size,
@@ -61,33 +63,45 @@ qsort (void *array, size_t cnt, size_t size,
   sort (array, cnt, size, compare_thunk, &compare);
 }
 
-/* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
-   with elements of SIZE bytes each. */
+/* Partitions of at most this many elements are left to
+   insertion sort, which beats quicksort on so few. */
+#define INSERTION_SORT_MAX 12
+
+/* Swaps the SIZE-byte elements at A and B.  Moves a word at a
+   time when both are word-aligned and SIZE is a multiple of the
+   word size, as for arrays of ints, pointers or most structs. */
 static void
-do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
+do_swap (unsigned char *a, unsigned char *b, size_t size)
 {
-  unsigned char *a = array + (a_idx - 1) * size;
-  unsigned char *b = array + (b_idx - 1) * size;
   size_t i;
 
-  for (i = 0; i < size; i++)
+  if (((uintptr_t) a | (uintptr_t) b | size) % sizeof (uint32_t) == 0)
     {
-      unsigned char t = a[i];
-      a[i] = b[i];
-      b[i] = t;
+      uint32_t *wa = (uint32_t *) a;
+      uint32_t *wb = (uint32_t *) b;
+
+      for (i = 0; i < size / sizeof (uint32_t); i++)
+        {
+          uint32_t t = wa[i];
+          wa[i] = wb[i];
+          wb[i] = t;
+        }
     }
+  else
+    for (i = 0; i < size; i++)
+      {
+        unsigned char t = a[i];
+        a[i] = b[i];
+        b[i] = t;
+      }
 }
 
-/* Compares elements with 1-based indexes A_IDX and B_IDX in
-   ARRAY with elements of SIZE bytes each, using COMPARE to
-   compare elements, passing AUX as auxiliary data, and returns a
-   strcmp()-type result. */
-static int
-do_compare (unsigned char *array, size_t a_idx, size_t b_idx, size_t size,
-            int (*compare) (const void *, const void *, void *aux),
-            void *aux) 
+/* Returns the element with 1-based index IDX in ARRAY with
+   elements of SIZE bytes each. */
+static unsigned char *
+heap_elem (unsigned char *array, size_t idx, size_t size)
 {
-  return compare (array + (a_idx - 1) * size, array + (b_idx - 1) * size, aux);
+  return array + (idx - 1) * size;
 }
 
 /* "Float down" the element with 1-based index I in ARRAY of CNT
@@ -105,10 +119,13 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
       size_t left = 2 * i;
       size_t right = 2 * i + 1;
       size_t max = i;
-      if (left <= cnt && do_compare (array, left, max, size, compare, aux) > 0)
+      if (left <= cnt
+          && compare (heap_elem (array, left, size),
+                      heap_elem (array, max, size), aux) > 0)
         max = left;
       if (right <= cnt
-          && do_compare (array, right, max, size, compare, aux) > 0) 
+          && compare (heap_elem (array, right, size),
+                      heap_elem (array, max, size), aux) > 0) 
         max = right;
 
       /* If the maximum value is already in element I, we're
@@ -117,38 +134,217 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
         break;
 
       /* Swap and continue down the heap. */
-      do_swap (array, i, max, size);
+      do_swap (heap_elem (array, i, size), heap_elem (array, max, size),
+               size);
       i = max;
     }
 }
 
+/* Heapsorts ARRAY, which contains CNT elements of SIZE bytes
+   each, using COMPARE and AUX. */
+static void
+heap_sort (unsigned char *array, size_t cnt, size_t size,
+           int (*compare) (const void *, const void *, void *aux),
+           void *aux) 
+{
+  size_t i;
+
+  /* Build a heap. */
+  for (i = cnt / 2; i > 0; i--)
+    heapify (array, i, cnt, size, compare, aux);
+
+  /* Sort the heap. */
+  for (i = cnt; i > 1; i--) 
+    {
+      do_swap (heap_elem (array, 1, size), heap_elem (array, i, size), size);
+      heapify (array, 1, i - 1, size, compare, aux); 
+    }
+}
+
+/* Insertion-sorts ARRAY, which contains CNT elements of SIZE
+   bytes each, using COMPARE and AUX. */
+static void
+insertion_sort (unsigned char *array, size_t cnt, size_t size,
+                int (*compare) (const void *, const void *, void *aux),
+                void *aux) 
+{
+  unsigned char *end = array + cnt * size;
+  unsigned char *p, *q;
+
+  for (p = array + size; p < end; p += size)
+    for (q = p; q > array && compare (q - size, q, aux) > 0; q -= size)
+      do_swap (q - size, q, size);
+}
+
+/* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
+   using COMPARE and AUX, by quicksort with the median of the
+   first, middle and last elements as pivot.  Falls back to
+   heapsort once DEPTH partitions deep, so that inputs that
+   defeat the pivot choice still take O(n lg n) time, and leaves
+   small partitions to insertion sort.  Recurses only into the
+   smaller side of each partition, so the stack stays O(lg n). */
+static void
+introsort (unsigned char *array, size_t cnt, size_t size,
+           int (*compare) (const void *, const void *, void *aux),
+           void *aux, int depth) 
+{
+  while (cnt > INSERTION_SORT_MAX)
+    {
+      unsigned char *last = array + (cnt - 1) * size;
+      unsigned char *mid = array + cnt / 2 * size;
+      unsigned char *pivot = array + size;
+      unsigned char *lo, *hi;
+      size_t left_cnt, right_cnt;
+
+      if (depth-- == 0)
+        {
+          heap_sort (array, cnt, size, compare, aux);
+          return;
+        }
+
+      /* Order the first, middle and last elements and move the
+         median next to the first.  The first and last then stop
+         the scans below without bounds checks. */
+      if (compare (mid, array, aux) < 0)
+        do_swap (mid, array, size);
+      if (compare (last, mid, aux) < 0)
+        {
+          do_swap (last, mid, size);
+          if (compare (mid, array, aux) < 0)
+            do_swap (mid, array, size);
+        }
+      do_swap (mid, pivot, size);
+
+      /* Partition around the pivot.  Both scans stop at elements
+         equal to it, which splits runs of equal elements evenly
+         instead of degrading to quadratic time. */
+      lo = pivot;
+      hi = last;
+      for (;;)
+        {
+          do
+            lo += size;
+          while (compare (lo, pivot, aux) < 0);
+          do
+            hi -= size;
+          while (compare (hi, pivot, aux) > 0);
+          if (lo >= hi)
+            break;
+          do_swap (lo, hi, size);
+        }
+      do_swap (pivot, hi, size);
+
+      /* Now everything before HI is no greater than it and
+         everything after no less.  Sort the smaller side, then
+         loop on the larger. */
+      left_cnt = (hi - array) / size;
+      right_cnt = cnt - left_cnt - 1;
+      if (left_cnt < right_cnt)
+        {
+          introsort (array, left_cnt, size, compare, aux, depth);
+          array = hi + size;
+          cnt = right_cnt;
+        }
+      else
+        {
+          introsort (hi + size, right_cnt, size, compare, aux, depth);
+          cnt = left_cnt;
+        }
+    }
+  insertion_sort (array, cnt, size, compare, aux);
+}
+
 /* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
    using COMPARE to compare elements, passing AUX as auxiliary
    data.  When COMPARE is passed a pair of elements A and B,
    respectively, it must return a strcmp()-type result, i.e. less
    than zero if A < B, zero if A == B, greater than zero if A >
-   B.  Runs in O(n lg n) time and O(1) space in CNT. */
+   B.  Runs in O(n lg n) time and O(lg n) space in CNT. */
 void
 sort (void *array, size_t cnt, size_t size,
       int (*compare) (const void *, const void *, void *aux),
       void *aux) 
 {
+  int depth = 0;
   size_t i;
 
   ASSERT (array != NULL || cnt == 0);
   ASSERT (compare != NULL);
   ASSERT (size > 0);
 
-  /* Build a heap. */
-  for (i = cnt / 2; i > 0; i--)
-    heapify (array, i, cnt, size, compare, aux);
+  for (i = cnt; i > 1; i /= 2)
+    depth += 2;
+  introsort (array, cnt, size, compare, aux, depth);
+}
 
-  /* Sort the heap. */
-  for (i = cnt; i > 1; i--) 
+/* Returns the byte of the key KEY_OFS bytes into element E that
+   is SHIFT bits from its least significant end. */
+static unsigned
+key_byte (const unsigned char *e, size_t key_ofs, int shift)
+{
+  uint32_t key;
+
+  memcpy (&key, e + key_ofs, sizeof key);
+  return (key >> shift) & 0xff;
+}
+
+/* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
+   into ascending order of the unsigned 32-bit integer that each
+   element holds KEY_OFS bytes from its start.  Elements with
+   equal keys keep their order.  SCRATCH must point to CNT * SIZE
+   bytes that do not overlap ARRAY.
+
+   Moves the elements by least-significant-digit radix sort, a
+   byte of the key per pass, in O(n) time and without calling a
+   comparison function.  Passes in which every key has the same
+   byte, such as the high bytes of small keys, are skipped. */
+void
+radix_sort (void *array, size_t cnt, size_t size, size_t key_ofs,
+            void *scratch) 
+{
+  unsigned char *src = array;
+  unsigned char *dst = scratch;
+  int shift;
+
+  ASSERT (array != NULL || cnt == 0);
+  ASSERT (scratch != NULL || cnt == 0);
+  ASSERT (key_ofs + sizeof (uint32_t) <= size);
+
+  if (cnt < 2)
+    return;
+
+  for (shift = 0; shift < 32; shift += 8)
     {
-      do_swap (array, 1, i, size);
-      heapify (array, 1, i - 1, size, compare, aux); 
+      size_t count[256];
+      size_t i, sum;
+      unsigned char *tmp;
+
+      memset (count, 0, sizeof count);
+      for (i = 0; i < cnt; i++)
+        count[key_byte (src + i * size, key_ofs, shift)]++;
+      if (count[key_byte (src, key_ofs, shift)] == cnt)
+        continue;
+
+      /* Turn the counts into starting positions. */
+      for (i = sum = 0; i < 256; i++)
+        {
+          size_t c = count[i];
+          count[i] = sum;
+          sum += c;
+        }
+
+      for (i = 0; i < cnt; i++)
+        {
+          const unsigned char *e = src + i * size;
+          memcpy (dst + count[key_byte (e, key_ofs, shift)]++ * size, e,
+                  size);
+        }
+      tmp = src;
+      src = dst;
+      dst = tmp;
     }
+  if (src != array)
+    memcpy (array, src, cnt * size);
 }
 
 /* Searches ARRAY, which contains CNT elements of SIZE bytes
@@ -14,6 +14,8 @@ void *bsearch (const void *key, const void *array, size_t cnt,
 void sort (void *array, size_t cnt, size_t size,
            int (*compare) (const void *, const void *, void *aux),
            void *aux);
+void radix_sort (void *array, size_t cnt, size_t size, size_t key_ofs,
+                 void *scratch);
 void *binary_search (const void *key, const void *array, size_t cnt,
                      size_t size,
                      int (*compare) (const void *, const void *, void *aux),
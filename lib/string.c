@@ -1,20 +1,77 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* Bytes in a page, for memzero_page() and copy_page(). */
+#define PAGE_SIZE 4096
+
+/* Blocks shorter than this are copied or set a byte at a time,
+   since aligning them would cost more than it saves. */
+#define WORD_MIN 16
+
+/* The string instructions below copy and store with REP MOVS and
+   REP STOS, four bytes at a time once the destination is aligned,
+   which even at -O0 is many times faster than a loop in C.  The
+   kernel and user programs both run with the direction flag
+   clear (see threads/intr-stubs.S), and code that sets it clears
+   it again before anything else can run. */
+
+/* Copies SIZE bytes upward from SRC to DST. */
+static inline void
+copy_up (void *dst, const void *src, size_t size)
+{
+  size_t cnt;
+
+  if (size >= WORD_MIN)
+    {
+      cnt = -(uintptr_t) dst & 3;
+      size -= cnt;
+      asm volatile ("rep movsb"
+                    : "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+      cnt = size / 4;
+      size %= 4;
+      asm volatile ("rep movsl"
+                    : "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+    }
+  asm volatile ("rep movsb"
+                : "+D" (dst), "+S" (src), "+c" (size) : : "memory");
+}
+
+/* Copies SIZE bytes downward from SRC to DST, starting from their
+   ends, for overlapping blocks with DST above SRC. */
+static inline void
+copy_down (void *dst, const void *src, size_t size)
+{
+  uint8_t *d = (uint8_t *) dst + size - 1;
+  const uint8_t *s = (const uint8_t *) src + size - 1;
+  size_t cnt = size >= WORD_MIN ? size % 4 : size;
+
+  if (size == 0)
+    return;
+
+  /* The last bytes, then, moving back to the start of the last
+     word left, the words. */
+  asm volatile ("std; rep movsb; cld"
+                : "+D" (d), "+S" (s), "+c" (cnt) : : "memory", "cc");
+  if (size >= WORD_MIN)
+    {
+      d -= 3;
+      s -= 3;
+      cnt = size / 4;
+      asm volatile ("std; rep movsl; cld"
+                    : "+D" (d), "+S" (s), "+c" (cnt) : : "memory", "cc");
+    }
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
 void *
 memcpy (void *dst_, const void *src_, size_t size) 
 {
-  unsigned char *dst = dst_;
-  const unsigned char *src = src_;
-
-  ASSERT (dst != NULL || size == 0);
-  ASSERT (src != NULL || size == 0);
-
-  while (size-- > 0)
-    *dst++ = *src++;
+  ASSERT (dst_ != NULL || size == 0);
+  ASSERT (src_ != NULL || size == 0);
 
+  copy_up (dst_, src_, size);
   return dst_;
 }
 
@@ -23,26 +80,16 @@ memcpy (void *dst_, const void *src_, size_t size)
 void *
 memmove (void *dst_, const void *src_, size_t size) 
 {
-  unsigned char *dst = dst_;
-  const unsigned char *src = src_;
+  ASSERT (dst_ != NULL || size == 0);
+  ASSERT (src_ != NULL || size == 0);
 
-  ASSERT (dst != NULL || size == 0);
-  ASSERT (src != NULL || size == 0);
+  /* Copying upward is safe unless DST starts inside SRC. */
+  if ((uintptr_t) dst_ - (uintptr_t) src_ >= size)
+    copy_up (dst_, src_, size);
+  else
+    copy_down (dst_, src_, size);
 
-  if (dst < src) 
-    {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
-  else 
-    {
-      dst += size;
-      src += size;
-      while (size-- > 0)
-        *--dst = *--src;
-    }
-
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -274,20 +321,60 @@ strtok_r (char *s, const char *delimiters, char **save_ptr)
   return token;
 }
 
-/* Sets the SIZE bytes in DST to VALUE. */
+/* Sets the SIZE bytes in DST to VALUE.  Stores a byte at a time
+   until DST is aligned, then four copies of VALUE at a time with
+   REP STOSL, then the rest. */
 void *
 memset (void *dst_, int value, size_t size) 
 {
-  unsigned char *dst = dst_;
+  void *dst = dst_;
+  uint32_t word = (uint8_t) value * 0x01010101u;
+  size_t cnt;
 
   ASSERT (dst != NULL || size == 0);
-  
-  while (size-- > 0)
-    *dst++ = value;
+
+  if (size >= WORD_MIN)
+    {
+      cnt = -(uintptr_t) dst & 3;
+      size -= cnt;
+      asm volatile ("rep stosb" : "+D" (dst), "+c" (cnt) : "a" (word)
+                    : "memory");
+      cnt = size / 4;
+      size %= 4;
+      asm volatile ("rep stosl" : "+D" (dst), "+c" (cnt) : "a" (word)
+                    : "memory");
+    }
+  asm volatile ("rep stosb" : "+D" (dst), "+c" (size) : "a" (word)
+                : "memory");
 
   return dst_;
 }
 
+/* Sets the PAGE_SIZE bytes of PAGE, which must be page-aligned,
+   to zero, with no alignment to handle. */
+void
+memzero_page (void *page)
+{
+  size_t cnt = PAGE_SIZE / 4;
+
+  ASSERT (((uintptr_t) page & (PAGE_SIZE - 1)) == 0);
+  asm volatile ("rep stosl" : "+D" (page), "+c" (cnt) : "a" (0)
+                : "memory");
+}
+
+/* Copies the PAGE_SIZE bytes of page SRC to page DST, which must
+   both be page-aligned and not overlap, with no alignment to
+   handle. */
+void
+copy_page (void *dst, const void *src)
+{
+  size_t cnt = PAGE_SIZE / 4;
+
+  ASSERT (((uintptr_t) dst & (PAGE_SIZE - 1)) == 0);
+  ASSERT (((uintptr_t) src & (PAGE_SIZE - 1)) == 0);
+  asm volatile ("rep movsl" : "+D" (dst), "+S" (src), "+c" (cnt) : : "memory");
+}
+
 /* Returns the length of STRING. */
 size_t
 strlen (const char *string) 
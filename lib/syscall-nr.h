@@ -28,7 +28,61 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_CPUTIME,                /* Reports this process's CPU cycles. */
+    SYS_FUTEX_WAIT,             /* Sleep while a word has a given value. */
+    SYS_FUTEX_WAKE,             /* Wake threads sleeping on a word. */
+    SYS_THREAD_SPAWN,           /* Start a thread in this process. */
+    SYS_THREAD_JOIN,            /* Wait for a thread of this process. */
+    SYS_THREAD_EXIT,            /* Terminate the calling thread. */
+    SYS_SCHED_LATENCY,          /* Read scheduler latency histograms. */
+    SYS_FORK,                   /* Duplicate the calling process. */
+    SYS_GETRUSAGE,              /* Reports this process's memory use. */
+    SYS_FSYNC,                  /* Writes a file's cached data to disk. */
+    SYS_PREAD,                  /* Read from a file at a given offset. */
+    SYS_PWRITE,                 /* Write to a file at a given offset. */
+    SYS_READV,                  /* Read from a file into several buffers. */
+    SYS_WRITEV,                 /* Write to a file from several buffers. */
+    SYS_COPY_FILE_RANGE,        /* Copy data from one file to another. */
+    SYS_GETDENTS,               /* Reads several directory entries. */
+    SYS_FALLOCATE,              /* Allocates disk space for a file. */
+    SYS_FTRUNCATE,              /* Changes the length of a file. */
+    SYS_BLOCKSTAT,              /* Reads a block device's statistics. */
+    SYS_TTYMODE,                /* Sets how the console delivers input. */
+    SYS_DUP,                    /* Duplicates a file descriptor. */
+    SYS_DUP2,                   /* Duplicates onto a given descriptor. */
+    SYS_RING_ENTER,             /* Runs operations queued in a ring. */
+    SYS_SPAWN,                  /* Starts a process without waiting for its load. */
+    SYS_WAIT_ANY,               /* Waits for whichever child exits first. */
+    SYS_SBRK,                   /* Moves the end of the heap. */
+    SYS_PIPE,                   /* Creates a pipe. */
+    SYS_SHM_OPEN,               /* Opens a named shared memory segment. */
+    SYS_SHM_MAP,                /* Maps a shared memory segment. */
+    SYS_SHM_UNMAP,              /* Unmaps a shared memory segment. */
+    SYS_WAIT_RUSAGE,            /* Waits for a child and reads its usage. */
+    SYS_NULL,                   /* Does nothing, to time a system call. */
+    SYS_PMU_READ,               /* Reads the thread's performance counts. */
+    SYS_STAT_READ,              /* Reads kernel statistics by name. */
+    SYS_CHECKPOINT,             /* Saves the process to an image file. */
+    SYS_RESTORE,                /* Starts a process from an image file. */
+    SYS_SCHED_SETAFFINITY,      /* Sets the CPUs a thread may run on. */
+    SYS_SCHED_GETAFFINITY,      /* Reads the CPUs a thread may run on. */
+    SYS_SCHED_SETSCHEDULER,     /* Sets the process's scheduling class. */
+    SYS_SCHED_GETSCHEDULER,     /* Reads the process's scheduling class. */
+    SYS_SLEEP_UNTIL,            /* Sleeps until an absolute time. */
+    SYS_TIMER_SLACK,            /* Sets how late a sleeper may wake. */
+    SYS_SETPRIORITY,            /* Lowers a process's priority. */
+    SYS_GETPRIORITY,            /* Reads a process's priority. */
+    SYS_NICE,                   /* Raises the process's nice value. */
+    SYS_YIELD_TO,               /* Gives the rest of a slice to a thread. */
+    SYS_POLL,                   /* Waits for any of several objects. */
+    SYS_SPAWN_ACTIONS,          /* Starts a process with chosen descriptors. */
+    SYS_OPEN_FLAGS,             /* Opens a file with hints. */
+    SYS_FADVISE,                /* Says how an open file will be used. */
+    SYS_DEFRAG,                 /* Moves a file's data into few extents. */
+    SYS_CLONE_FILE              /* Makes a file share another's data. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -1,14 +1,45 @@
 #include <stdio.h>
+#include <malloc.h>
 #include <string.h>
 #include <syscall.h>
 #include <syscall-nr.h>
+#include "mutex.h"
+
+/* Buffered output stream. */
+struct FILE
+  {
+    int fd;                     /* File descriptor written. */
+    bool line_buffered;         /* Write at each new-line? */
+    bool error;                 /* Has a write failed? */
+    int lock;                   /* Protects the members below. */
+    char *buf;                  /* Buffered output. */
+    size_t size;                /* Size of BUF. */
+    size_t used;                /* Bytes in BUF. */
+    struct FILE *next;          /* Next stream in STREAMS. */
+  };
+
+/* Size of a file stream's buffer, and of stdout's. */
+#define FILE_BUFSIZE 4096
+#define CONSOLE_BUFSIZE 1024
+
+static char stdout_buf[CONSOLE_BUFSIZE];
+static struct FILE stdout_file =
+  {STDOUT_FILENO, true, false, 0, stdout_buf, sizeof stdout_buf, 0, NULL};
+FILE *stdout = &stdout_file;
+
+/* All open streams, protected by STREAMS_LOCK. */
+static struct FILE *streams = &stdout_file;
+static int streams_lock;
+
+static int flush_locked (FILE *);
+static void put_locked (FILE *, const void *, size_t);
 
 /* The standard vprintf() function,
    which is like printf() but uses a va_list. */
 int
 vprintf (const char *format, va_list args) 
 {
-  return vhprintf (STDOUT_FILENO, format, args);
+  return vfprintf (stdout, format, args);
 }
 
 /* Like printf(), but writes output to the given HANDLE. */
@@ -30,8 +61,10 @@ hprintf (int handle, const char *format, ...)
 int
 puts (const char *s) 
 {
-  write (STDOUT_FILENO, s, strlen (s));
-  putchar ('\n');
+  mutex_lock (&stdout->lock);
+  put_locked (stdout, s, strlen (s));
+  put_locked (stdout, "\n", 1);
+  mutex_unlock (&stdout->lock);
 
   return 0;
 }
@@ -39,12 +72,217 @@ puts (const char *s)
 /* Writes C to the console. */
 int
 putchar (int c) 
+{
+  return fputc (c, stdout);
+}
+
+/* Returns a stream that writes to file descriptor FD, or a null
+   pointer if memory is not available.  Output streams are the
+   only kind, so MODE must begin with "w" or "a". */
+FILE *
+fdopen (int fd, const char *mode)
+{
+  FILE *f;
+
+  if (mode[0] != 'w' && mode[0] != 'a')
+    return NULL;
+  f = malloc (sizeof *f + FILE_BUFSIZE);
+  if (f == NULL)
+    return NULL;
+  f->fd = fd;
+  f->line_buffered = fd == STDOUT_FILENO;
+  f->error = false;
+  f->lock = 0;
+  f->buf = (char *) (f + 1);
+  f->size = FILE_BUFSIZE;
+  f->used = 0;
+
+  mutex_lock (&streams_lock);
+  f->next = streams;
+  streams = f;
+  mutex_unlock (&streams_lock);
+  return f;
+}
+
+/* Writes out F's buffer, closes its file descriptor, and frees
+   F.  Returns 0 if successful, EOF if any write to F failed. */
+int
+fclose (FILE *f)
+{
+  FILE **fp;
+  int retval;
+
+  retval = fflush (f);
+  if (f == stdout)
+    return retval;
+
+  mutex_lock (&streams_lock);
+  for (fp = &streams; *fp != f; fp = &(*fp)->next)
+    continue;
+  *fp = f->next;
+  mutex_unlock (&streams_lock);
+
+  close (f->fd);
+  free (f);
+  return retval;
+}
+
+/* Writes out F's buffer, or that of every stream if F is a null
+   pointer.  Returns 0 if successful, EOF if a write failed. */
+int
+fflush (FILE *f)
+{
+  int retval = 0;
+
+  if (f == NULL)
+    {
+      mutex_lock (&streams_lock);
+      for (f = streams; f != NULL; f = f->next)
+        if (fflush (f) != 0)
+          retval = EOF;
+      mutex_unlock (&streams_lock);
+      return retval;
+    }
+
+  mutex_lock (&f->lock);
+  retval = flush_locked (f);
+  mutex_unlock (&f->lock);
+  return retval;
+}
+
+/* Writes C to F.  Returns C. */
+int
+fputc (int c, FILE *f)
 {
   char c2 = c;
-  write (STDOUT_FILENO, &c2, 1);
+
+  mutex_lock (&f->lock);
+  put_locked (f, &c2, 1);
+  mutex_unlock (&f->lock);
   return c;
 }
-
+
+/* Writes string S to F. */
+int
+fputs (const char *s, FILE *f)
+{
+  fwrite (s, 1, strlen (s), f);
+  return 0;
+}
+
+/* Writes CNT elements of SIZE bytes from BUFFER to F and returns
+   CNT. */
+size_t
+fwrite (const void *buffer, size_t size, size_t cnt, FILE *f)
+{
+  mutex_lock (&f->lock);
+  put_locked (f, buffer, size * cnt);
+  mutex_unlock (&f->lock);
+  return cnt;
+}
+
+/* Like printf(), but writes output to F. */
+int
+fprintf (FILE *f, const char *format, ...)
+{
+  va_list args;
+  int retval;
+
+  va_start (args, format);
+  retval = vfprintf (f, format, args);
+  va_end (args);
+
+  return retval;
+}
+
+/* Auxiliary data for vfprintf_helper(). */
+struct vfprintf_aux
+  {
+    FILE *f;                    /* Stream written. */
+    int char_cnt;               /* Total characters written so far. */
+    bool newline;               /* Was a new-line written? */
+  };
+
+/* Adds the N characters in S to the buffer of AUX's stream,
+   writing the buffer out each time it fills up. */
+static void
+vfprintf_helper (const char *s, size_t n, void *aux_)
+{
+  struct vfprintf_aux *aux = aux_;
+  FILE *f = aux->f;
+
+  if (!aux->newline && memchr (s, '\n', n) != NULL)
+    aux->newline = true;
+  aux->char_cnt += n;
+  while (n > 0)
+    {
+      size_t cnt = f->size - f->used;
+      if (cnt > n)
+        cnt = n;
+      memcpy (f->buf + f->used, s, cnt);
+      f->used += cnt;
+      if (f->used >= f->size)
+        flush_locked (f);
+      s += cnt;
+      n -= cnt;
+    }
+}
+
+/* Like vprintf(), but writes output to F.  A line-buffered
+   stream is written out once, at the end, however many lines the
+   call prints. */
+int
+vfprintf (FILE *f, const char *format, va_list args)
+{
+  struct vfprintf_aux aux;
+
+  aux.f = f;
+  aux.char_cnt = 0;
+  aux.newline = false;
+  mutex_lock (&f->lock);
+  __vprintf (format, args, vfprintf_helper, &aux);
+  if (aux.newline && f->line_buffered)
+    flush_locked (f);
+  mutex_unlock (&f->lock);
+  return aux.char_cnt;
+}
+
+/* Adds the SIZE bytes at DATA to F's buffer, writing the buffer
+   out when it fills or, for a line-buffered stream, when DATA has
+   a new-line.  A write as big as the buffer bypasses it.  The
+   caller must hold F's lock. */
+static void
+put_locked (FILE *f, const void *data, size_t size)
+{
+  if (f->used + size > f->size)
+    flush_locked (f);
+  if (size >= f->size)
+    {
+      if (write (f->fd, data, size) != (int) size)
+        f->error = true;
+      return;
+    }
+  memcpy (f->buf + f->used, data, size);
+  f->used += size;
+  if (f->line_buffered && memchr (data, '\n', size) != NULL)
+    flush_locked (f);
+}
+
+/* Writes out F's buffer.  Returns 0 if successful, EOF if this
+   or an earlier write to F failed.  The caller must hold F's
+   lock. */
+static int
+flush_locked (FILE *f)
+{
+  if (f->used > 0)
+    {
+      if (write (f->fd, f->buf, f->used) != (int) f->used)
+        f->error = true;
+      f->used = 0;
+    }
+  return f->error ? EOF : 0;
+}
+
 /* Auxiliary data for vhprintf_helper(). */
 struct vhprintf_aux 
   {
@@ -54,34 +292,48 @@ struct vhprintf_aux
     int handle;         /* Output file handle. */
   };
 
-static void add_char (char, void *);
+static void add_chars (const char *, size_t, void *);
 static void flush (struct vhprintf_aux *);
 
 /* Formats the printf() format specification FORMAT with
    arguments given in ARGS and writes the output to the given
-   HANDLE. */
+   HANDLE.  Output to the console goes through stdout, so that it
+   stays in order with printf()'s. */
 int
 vhprintf (int handle, const char *format, va_list args) 
 {
   struct vhprintf_aux aux;
+
+  if (handle == STDOUT_FILENO)
+    return vfprintf (stdout, format, args);
   aux.p = aux.buf;
   aux.char_cnt = 0;
   aux.handle = handle;
-  __vprintf (format, args, add_char, &aux);
+  __vprintf (format, args, add_chars, &aux);
   flush (&aux);
   return aux.char_cnt;
 }
 
-/* Adds C to the buffer in AUX, flushing it if the buffer fills
-   up. */
+/* Adds the N characters in S to the buffer in AUX, flushing it
+   each time the buffer fills up. */
 static void
-add_char (char c, void *aux_) 
+add_chars (const char *s, size_t n, void *aux_) 
 {
   struct vhprintf_aux *aux = aux_;
-  *aux->p++ = c;
-  if (aux->p >= aux->buf + sizeof aux->buf)
-    flush (aux);
-  aux->char_cnt++;
+
+  aux->char_cnt += n;
+  while (n > 0)
+    {
+      size_t cnt = aux->buf + sizeof aux->buf - aux->p;
+      if (cnt > n)
+        cnt = n;
+      memcpy (aux->p, s, cnt);
+      aux->p += cnt;
+      if (aux->p >= aux->buf + sizeof aux->buf)
+        flush (aux);
+      s += cnt;
+      n -= cnt;
+    }
 }
 
 /* Flushes the buffer in AUX. */
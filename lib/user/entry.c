@@ -2,9 +2,11 @@
 
 int main (int, char *[]);
 void _start (int argc, char *argv[]);
+void syscall_init (void);
 
 void
 _start (int argc, char *argv[]) 
 {
+  syscall_init ();
   exit (main (argc, argv));
 }
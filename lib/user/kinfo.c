@@ -0,0 +1,84 @@
+#include <kinfo.h>
+#include <syscall.h>
+
+/* The kernel information page, which the kernel maps into every
+   process. */
+static const volatile struct kinfo *const kinfo
+  = (const volatile struct kinfo *) KINFO_ADDR;
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Returns the nanoseconds since boot, from the time of the last
+   timer tick plus the time-stamp cycles since, which never add
+   up to a full tick, so that the time never goes backward. */
+static uint64_t
+uptime_ns (void)
+{
+  uint32_t seq, tick_ns;
+  uint64_t ns, cycles;
+
+  do
+    {
+      seq = seqlock_read_begin (&kinfo->lock);
+      tick_ns = kinfo->tick_ns;
+      ns = (uint64_t) kinfo->ticks * tick_ns;
+      if (kinfo->tick_cycles != 0)
+        {
+          cycles = rdtsc () - kinfo->tick_tsc;
+          if (cycles < kinfo->tick_cycles)
+            ns += (cycles * kinfo->tsc_mult) >> 32;
+          else
+            ns += tick_ns - 1;
+        }
+    }
+  while (seqlock_read_retry (&kinfo->lock, seq));
+  return ns;
+}
+
+/* Returns the process ID of the calling process. */
+pid_t
+getpid (void)
+{
+  return kinfo->pid;
+}
+
+/* Returns the thread ID of the calling thread, the one that
+   thread_spawn() returned for it, or its process ID in the
+   process's first thread. */
+tid_t
+gettid (void)
+{
+  return kinfo->tid;
+}
+
+/* Stores the time of CLOCK in *TS.  Returns 0 if successful, -1
+   if CLOCK is not a known clock. */
+int
+clock_gettime (clockid_t clock, struct timespec *ts)
+{
+  uint64_t ns;
+
+  if (clock == CLOCK_MONOTONIC)
+    ns = uptime_ns ();
+  else if (clock == CLOCK_REALTIME)
+    ns = uptime_ns () + (uint64_t) kinfo->boot_time * 1000000000;
+  else
+    return -1;
+  ts->tv_sec = ns / 1000000000;
+  ts->tv_nsec = ns % 1000000000;
+  return 0;
+}
+
+/* Returns 100 times the system load average. */
+int
+getloadavg (void)
+{
+  return kinfo->load_avg;
+}
@@ -0,0 +1,522 @@
+#include <malloc.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "mutex.h"
+
+/* User-space malloc().
+
+   The heap grows and shrinks with sbrk(), a page at a time.
+   Pages not in use are kept in a list of free "runs" of
+   contiguous pages, sorted by address and merged with their
+   neighbors when freed, so that a free run at the top of the
+   heap, once it reaches TRIM_PAGES, can be given back to the
+   kernel by moving the break down.
+
+   As in the kernel's malloc(), a request is rounded up to the
+   next size class and served by that class's "descriptor".  The
+   classes are the powers of 2 from 16 bytes to 1 kB with a class
+   halfway between each pair, plus the largest sizes that fit 3
+   and 2 blocks in a page.  Each page of blocks, an "arena", has
+   its own list of free blocks, and the descriptor keeps a list
+   of the arenas that have any.  An arena whose blocks are all
+   free is kept, up to DESC_EMPTY_MAX per descriptor, and beyond
+   that its page goes back to the free runs.  A request too big
+   for any class gets a run of pages of its own, headed by an
+   arena that records its length.
+
+   The descriptors and the free runs are protected by a single
+   lock.  In front of them, each thread has a cache of up to
+   MAGAZINE_MAX free blocks per class, which malloc() and free()
+   use without taking that lock; a cache that runs dry or
+   overflows moves MAGAZINE_BATCH blocks at a time.  Caches are
+   picked by thread ID from a fixed set, each with its own lock,
+   so threads that share a cache still work, just with some
+   contention. */
+
+/* Size of a page of heap. */
+#define PAGE_SIZE 4096
+
+/* Free run at the top of the heap that is given back to the
+   kernel, in pages. */
+#define TRIM_PAGES 16
+
+/* Empty arenas a descriptor keeps instead of freeing. */
+#define DESC_EMPTY_MAX 2
+
+/* Number of size classes. */
+#define CLASS_CNT 15
+
+/* Blocks moved between a cache and its descriptor at a time,
+   and the most a cache holds per class. */
+#define MAGAZINE_BATCH 8
+#define MAGAZINE_MAX (2 * MAGAZINE_BATCH)
+
+/* Number of thread caches. */
+#define CACHE_CNT 16
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x9a548eed
+
+/* Descriptor. */
+struct desc
+  {
+    size_t block_size;          /* Size of each block in bytes. */
+    size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    size_t blocks_ofs;          /* Offset of the first block in an arena. */
+    struct arena *partial;      /* Arenas with free blocks. */
+    size_t empty_cnt;           /* Arenas with no blocks in use. */
+  };
+
+/* Arena. */
+struct arena
+  {
+    unsigned magic;             /* Always set to ARENA_MAGIC. */
+    struct desc *desc;          /* Owning descriptor, null for big block. */
+    size_t free_cnt;            /* Free blocks; pages in big block. */
+    void *free;                 /* Free blocks, linked through their first word. */
+    struct arena *prev, *next;  /* Element in desc's partial list. */
+  };
+
+/* Free run of pages. */
+struct run
+  {
+    size_t page_cnt;            /* Number of pages. */
+    struct run *next;           /* Next run, at a higher address. */
+  };
+
+/* Free blocks of one class in a thread cache. */
+struct magazine
+  {
+    void *head;                 /* Linked through their first word. */
+    size_t cnt;                 /* Number of blocks. */
+  };
+
+/* Thread cache. */
+struct cache
+  {
+    int lock;                   /* Protects MAGAZINES. */
+    struct magazine magazines[CLASS_CNT];
+  };
+
+/* Protects everything below but the caches. */
+static int heap_lock;
+static volatile bool initialized;
+
+static struct desc descs[CLASS_CNT];
+static size_t desc_cnt;
+
+/* Smallest descriptor for a request, indexed by the size in
+   bytes divided by 8, rounded up. */
+#define CLASS_GRAIN 8
+static uint8_t size_class[PAGE_SIZE / 2 / CLASS_GRAIN + 1];
+
+static struct run *runs;
+
+static struct cache caches[CACHE_CNT];
+
+static void init (void);
+static void desc_init (size_t block_size);
+static void *desc_get (struct desc *);
+static void desc_put (struct desc *, void *);
+static void *pages_get (size_t page_cnt);
+static void pages_put (void *, size_t page_cnt);
+static struct arena *block_to_arena (void *);
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size)
+{
+  struct magazine *m;
+  struct cache *c;
+  struct desc *d;
+  void *b;
+
+  /* A null pointer satisfies a request for 0 bytes. */
+  if (size == 0)
+    return NULL;
+  if (!initialized)
+    init ();
+
+  d = descs + desc_cnt;
+  if (size <= (sizeof size_class - 1) * CLASS_GRAIN)
+    d = descs + size_class[DIV_ROUND_UP (size, CLASS_GRAIN)];
+  if (d == descs + desc_cnt)
+    {
+      /* SIZE is too big for any descriptor.
+         Allocate enough pages to hold SIZE plus an arena. */
+      size_t page_cnt;
+      struct arena *a;
+
+      if (size > SIZE_MAX - sizeof *a - PAGE_SIZE)
+        return NULL;
+      page_cnt = DIV_ROUND_UP (size + sizeof *a, PAGE_SIZE);
+      mutex_lock (&heap_lock);
+      a = pages_get (page_cnt);
+      mutex_unlock (&heap_lock);
+      if (a == NULL)
+        return NULL;
+      a->magic = ARENA_MAGIC;
+      a->desc = NULL;
+      a->free_cnt = page_cnt;
+      return a + 1;
+    }
+
+  c = &caches[(unsigned) gettid () % CACHE_CNT];
+  m = &c->magazines[d - descs];
+  mutex_lock (&c->lock);
+  if (m->cnt == 0)
+    {
+      mutex_lock (&heap_lock);
+      while (m->cnt < MAGAZINE_BATCH && (b = desc_get (d)) != NULL)
+        {
+          *(void **) b = m->head;
+          m->head = b;
+          m->cnt++;
+        }
+      mutex_unlock (&heap_lock);
+    }
+  b = m->head;
+  if (b != NULL)
+    {
+      m->head = *(void **) b;
+      m->cnt--;
+    }
+  mutex_unlock (&c->lock);
+  return b;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b)
+{
+  void *p;
+  size_t size;
+
+  /* Calculate block size and make sure it fits in size_t. */
+  size = a * b;
+  if (b != 0 && size / b != a)
+    return NULL;
+
+  /* Allocate and zero memory. */
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+
+  return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size (void *block)
+{
+  struct arena *a = block_to_arena (block);
+
+  if (a->desc != NULL)
+    return a->desc->block_size;
+  else
+    return a->free_cnt * PAGE_SIZE - sizeof *a;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size)
+{
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  else if (old_block != NULL && new_size <= block_size (old_block))
+    return old_block;
+  else
+    {
+      void *new_block = malloc (new_size);
+      if (old_block != NULL && new_block != NULL)
+        {
+          memcpy (new_block, old_block, block_size (old_block));
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p)
+{
+  struct magazine *m;
+  struct arena *a;
+  struct cache *c;
+  struct desc *d;
+
+  if (p == NULL)
+    return;
+
+  a = block_to_arena (p);
+  d = a->desc;
+  if (d == NULL)
+    {
+      mutex_lock (&heap_lock);
+      pages_put (a, a->free_cnt);
+      mutex_unlock (&heap_lock);
+      return;
+    }
+
+  c = &caches[(unsigned) gettid () % CACHE_CNT];
+  m = &c->magazines[d - descs];
+  mutex_lock (&c->lock);
+  *(void **) p = m->head;
+  m->head = p;
+  if (++m->cnt > MAGAZINE_MAX)
+    {
+      mutex_lock (&heap_lock);
+      while (m->cnt > MAGAZINE_MAX - MAGAZINE_BATCH)
+        {
+          void *b = m->head;
+          m->head = *(void **) b;
+          m->cnt--;
+          desc_put (d, b);
+        }
+      mutex_unlock (&heap_lock);
+    }
+  mutex_unlock (&c->lock);
+}
+
+/* Sets up the descriptors, the first time any thread calls
+   malloc(). */
+static void
+init (void)
+{
+  size_t arena_space = PAGE_SIZE - sizeof (struct arena);
+  size_t block_size, size, i;
+
+  mutex_lock (&heap_lock);
+  if (!initialized)
+    {
+      for (block_size = 16; block_size < PAGE_SIZE / 2; block_size *= 2)
+        {
+          desc_init (block_size);
+          if (block_size < PAGE_SIZE / 4)
+            desc_init (block_size + block_size / 2);
+          else if (block_size == PAGE_SIZE / 4)
+            {
+              desc_init (ROUND_DOWN (arena_space / 3, CLASS_GRAIN));
+              desc_init (ROUND_DOWN (arena_space / 2, CLASS_GRAIN));
+            }
+        }
+      ASSERT (desc_cnt == CLASS_CNT);
+
+      for (i = 0, size = 0; size < sizeof size_class; size++)
+        {
+          while (i < desc_cnt && descs[i].block_size < size * CLASS_GRAIN)
+            i++;
+          size_class[size] = i;
+        }
+      initialized = true;
+    }
+  mutex_unlock (&heap_lock);
+}
+
+/* Adds a descriptor for blocks of BLOCK_SIZE bytes, which must be
+   larger than those of the previous descriptor. */
+static void
+desc_init (size_t block_size)
+{
+  struct desc *d = &descs[desc_cnt++];
+
+  ASSERT (desc_cnt <= CLASS_CNT);
+  ASSERT (d == descs || block_size > d[-1].block_size);
+
+  d->block_size = block_size;
+  d->blocks_per_arena = (PAGE_SIZE - sizeof (struct arena)) / block_size;
+  d->blocks_ofs = PAGE_SIZE - d->blocks_per_arena * block_size;
+  d->partial = NULL;
+  d->empty_cnt = 0;
+}
+
+/* Adds arena A to D's list of arenas with free blocks. */
+static void
+partial_push (struct desc *d, struct arena *a)
+{
+  a->prev = NULL;
+  a->next = d->partial;
+  if (a->next != NULL)
+    a->next->prev = a;
+  d->partial = a;
+}
+
+/* Removes arena A from D's list of arenas with free blocks. */
+static void
+partial_remove (struct desc *d, struct arena *a)
+{
+  if (a->prev != NULL)
+    a->prev->next = a->next;
+  else
+    d->partial = a->next;
+  if (a->next != NULL)
+    a->next->prev = a->prev;
+}
+
+/* Takes a free block from D, making a new arena if D has none.
+   Returns a null pointer if memory is not available.  The caller
+   must hold HEAP_LOCK. */
+static void *
+desc_get (struct desc *d)
+{
+  struct arena *a = d->partial;
+  void *b;
+
+  if (a == NULL)
+    {
+      size_t i;
+
+      a = pages_get (1);
+      if (a == NULL)
+        return NULL;
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      a->free = NULL;
+      for (i = d->blocks_per_arena; i-- > 0; )
+        {
+          b = (uint8_t *) a + d->blocks_ofs + i * d->block_size;
+          *(void **) b = a->free;
+          a->free = b;
+        }
+      partial_push (d, a);
+      d->empty_cnt++;
+    }
+
+  if (a->free_cnt == d->blocks_per_arena)
+    d->empty_cnt--;
+  b = a->free;
+  a->free = *(void **) b;
+  if (--a->free_cnt == 0)
+    partial_remove (d, a);
+  return b;
+}
+
+/* Returns block B to D.  If that leaves its arena with no blocks
+   in use, and D already keeps DESC_EMPTY_MAX such arenas, frees
+   the arena's page.  The caller must hold HEAP_LOCK. */
+static void
+desc_put (struct desc *d, void *b)
+{
+  struct arena *a = block_to_arena (b);
+
+  if (a->free_cnt == 0)
+    partial_push (d, a);
+  *(void **) b = a->free;
+  a->free = b;
+  if (++a->free_cnt == d->blocks_per_arena)
+    {
+      if (d->empty_cnt < DESC_EMPTY_MAX)
+        d->empty_cnt++;
+      else
+        {
+          partial_remove (d, a);
+          a->magic = 0;
+          pages_put (a, 1);
+        }
+    }
+}
+
+/* Returns PAGE_CNT contiguous free pages, taken from the first
+   free run that is big enough or else from the kernel, or a null
+   pointer if memory is not available.  The caller must hold
+   HEAP_LOCK. */
+static void *
+pages_get (size_t page_cnt)
+{
+  struct run **rp, *r;
+  uint8_t *brk_;
+  size_t pad;
+
+  for (rp = &runs; (r = *rp) != NULL; rp = &r->next)
+    if (r->page_cnt >= page_cnt)
+      {
+        /* Take the pages from the end of the run, so that its
+           header stays where it is. */
+        if (r->page_cnt == page_cnt)
+          {
+            *rp = r->next;
+            return r;
+          }
+        r->page_cnt -= page_cnt;
+        return (uint8_t *) r + r->page_cnt * PAGE_SIZE;
+      }
+
+  /* The break starts page-aligned, but make sure. */
+  brk_ = sbrk (0);
+  pad = ROUND_UP ((uintptr_t) brk_, PAGE_SIZE) - (uintptr_t) brk_;
+  if (page_cnt > (SIZE_MAX - pad) / PAGE_SIZE
+      || sbrk (pad + page_cnt * PAGE_SIZE) == (void *) -1)
+    return NULL;
+  return brk_ + pad;
+}
+
+/* Returns the PAGE_CNT pages at P to the free runs, and gives the
+   top of the heap back to the kernel if enough of it is free.
+   The caller must hold HEAP_LOCK. */
+static void
+pages_put (void *p, size_t page_cnt)
+{
+  struct run **rp, *r = p, *prev = NULL;
+  uint8_t *end;
+
+  for (rp = &runs; *rp != NULL && *rp < r; rp = &(*rp)->next)
+    prev = *rp;
+
+  /* Insert, then merge with the following and preceding runs. */
+  r->page_cnt = page_cnt;
+  r->next = *rp;
+  *rp = r;
+  if (r->next != NULL
+      && (uint8_t *) r + r->page_cnt * PAGE_SIZE == (uint8_t *) r->next)
+    {
+      r->page_cnt += r->next->page_cnt;
+      r->next = r->next->next;
+    }
+  if (prev != NULL
+      && (uint8_t *) prev + prev->page_cnt * PAGE_SIZE == (uint8_t *) r)
+    {
+      prev->page_cnt += r->page_cnt;
+      prev->next = r->next;
+      r = prev;
+      rp = &runs;
+      while (*rp != r)
+        rp = &(*rp)->next;
+    }
+
+  end = (uint8_t *) r + r->page_cnt * PAGE_SIZE;
+  if (r->next == NULL && r->page_cnt >= TRIM_PAGES && end == sbrk (0))
+    {
+      *rp = NULL;
+      sbrk (-(intptr_t) (r->page_cnt * PAGE_SIZE));
+    }
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (void *b)
+{
+  struct arena *a = (struct arena *) ROUND_DOWN ((uintptr_t) b, PAGE_SIZE);
+
+  ASSERT (a->magic == ARENA_MAGIC);
+  ASSERT (a->desc != NULL
+          ? ((uintptr_t) b - (uintptr_t) a - a->desc->blocks_ofs)
+            % a->desc->block_size == 0
+          : (void *) (a + 1) == b);
+  return a;
+}
@@ -0,0 +1,39 @@
+#ifndef __LIB_USER_MUTEX_H
+#define __LIB_USER_MUTEX_H
+
+#include <syscall.h>
+
+/* Futex-based lock for the user library's own data, which the
+   threads of a process share.  A lock is an int: 0 if free, 1 if
+   held, 2 if held and another thread may be waiting for it.
+   Acquiring or releasing one without contention costs a single
+   atomic exchange and no system call. */
+
+/* Atomically stores NEW in *WORD and returns its old value. */
+static inline int
+mutex_exchange (int *word, int new)
+{
+  asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*word) : : "memory");
+  return new;
+}
+
+/* Acquires the lock in *M. */
+static inline void
+mutex_lock (int *m)
+{
+  if (mutex_exchange (m, 1) == 0)
+    return;
+  while (mutex_exchange (m, 2) != 0)
+    futex_wait (m, 2);
+}
+
+/* Releases the lock in *M, waking one waiter if there may be
+   any. */
+static inline void
+mutex_unlock (int *m)
+{
+  if (mutex_exchange (m, 0) == 2)
+    futex_wake (m, 1);
+}
+
+#endif /* lib/user/mutex.h */
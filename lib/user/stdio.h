@@ -4,4 +4,22 @@
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
+/* Buffered output streams.  The console's stream, stdout, is
+   written whenever it receives a new-line, fills, or the program
+   reads the console; other streams whenever they fill.  All are
+   written at exit(), fork(), and exec(). */
+typedef struct FILE FILE;
+extern FILE *stdout;
+
+#define EOF (-1)
+
+FILE *fdopen (int fd, const char *mode);
+int fclose (FILE *);
+int fflush (FILE *);
+int fputc (int, FILE *);
+int fputs (const char *, FILE *);
+size_t fwrite (const void *, size_t size, size_t cnt, FILE *);
+int fprintf (FILE *, const char *, ...) PRINTF_FORMAT (2, 3);
+int vfprintf (FILE *, const char *, va_list) PRINTF_FORMAT (2, 0);
+
 #endif /* lib/user/stdio.h */
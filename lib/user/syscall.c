@@ -1,4 +1,5 @@
 #include <syscall.h>
+#include <stdio.h>
 #include "../syscall-nr.h"
 
 /* Invokes syscall NUMBER, passing no arguments, and returns the
@@ -7,10 +8,11 @@
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
+            ("pushl %[number]; call syscall_entry; "            \
+             "addl $4, %%esp"                                   \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -20,11 +22,12 @@
         ({                                                               \
           int retval;                                                    \
           asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
+            ("pushl %[arg0]; pushl %[number]; "                          \
+             "call syscall_entry; addl $8, %%esp"                        \
                : "=a" (retval)                                           \
                : [number] "i" (NUMBER),                                  \
                  [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
+               : "ecx", "edx", "memory");                                \
           retval;                                                        \
         })
 
@@ -35,12 +38,13 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
+             "pushl %[number]; call syscall_entry; "            \
+             "addl $12, %%esp"                                  \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1)                              \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -51,16 +55,64 @@
           int retval;                                           \
           asm volatile                                          \
             ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
+             "pushl %[number]; call syscall_entry; "            \
+             "addl $16, %%esp"                                  \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1),                             \
                  [arg2] "r" (ARG2)                              \
-               : "memory");                                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; pushl %[number]; "                 \
+             "call syscall_entry; "                             \
+             "addl $20, %%esp"                                  \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "r" (ARG3)                              \
+               : "ecx", "edx", "memory");                       \
+          retval;                                               \
+        })
+
+/* CPUID function 1 EDX bit for SYSENTER and SYSEXIT. */
+#define CPUID_SEP 0x800
+
+/* Nonzero if syscall_entry should enter the kernel with SYSENTER
+   instead of "int $0x30". */
+int syscall_sysenter;
+
+void syscall_init (void);
+
+/* Chooses how to enter the kernel.  The kernel accepts SYSENTER
+   whenever the CPU supports it, by the same test as
+   sysenter_supported() in userprog/tss.c.  Called by _start()
+   before anything else. */
+void
+syscall_init (void)
+{
+  unsigned eax, ebx, ecx, edx;
+  unsigned family, model, stepping;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  family = (eax >> 8) & 0xf;
+  model = (eax >> 4) & 0xf;
+  stepping = eax & 0xf;
+  syscall_sysenter = ((edx & CPUID_SEP) != 0
+                      && !(family == 6 && model < 3 && stepping < 3));
+}
+
 void
 halt (void) 
 {
@@ -71,6 +123,7 @@ halt (void)
 void
 exit (int status)
 {
+  fflush (NULL);
   syscall1 (SYS_EXIT, status);
   NOT_REACHED ();
 }
@@ -78,6 +131,7 @@ exit (int status)
 pid_t
 exec (const char *file)
 {
+  fflush (NULL);
   return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
@@ -114,6 +168,9 @@ filesize (int fd)
 int
 read (int fd, void *buffer, unsigned size)
 {
+  /* Show a prompt before waiting for the answer. */
+  if (fd == STDIN_FILENO)
+    fflush (stdout);
   return syscall3 (SYS_READ, fd, buffer, size);
 }
 
@@ -182,3 +239,340 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+void
+cputime (struct cputime *t)
+{
+  syscall1 (SYS_CPUTIME, t);
+}
+
+int
+futex_wait (int *addr, int expected)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, expected);
+}
+
+int
+futex_wake (int *addr, int n)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, n);
+}
+
+/* Where threads started by thread_spawn() begin: runs FUNC and
+   ends the thread if it returns. */
+static void
+thread_entry (void (*func) (void *), void *aux)
+{
+  func (aux);
+  thread_exit ();
+}
+
+tid_t
+thread_spawn (void (*func) (void *), void *aux)
+{
+  return syscall3 (SYS_THREAD_SPAWN, thread_entry, func, aux);
+}
+
+int
+thread_join (tid_t tid)
+{
+  return syscall1 (SYS_THREAD_JOIN, tid);
+}
+
+void
+thread_exit (void)
+{
+  fflush (NULL);
+  syscall0 (SYS_THREAD_EXIT);
+  NOT_REACHED ();
+}
+
+int
+sched_latency (int priority, struct sched_latency *l)
+{
+  return syscall2 (SYS_SCHED_LATENCY, priority, l);
+}
+
+pid_t
+fork (void)
+{
+  /* Otherwise the child would write the parent's output too. */
+  fflush (NULL);
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+int
+getrusage (int who, struct rusage *u)
+{
+  return syscall2 (SYS_GETRUSAGE, who, u);
+}
+
+int
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+int
+pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+copy_file_range (int in_fd, int out_fd, unsigned length)
+{
+  return syscall3 (SYS_COPY_FILE_RANGE, in_fd, out_fd, length);
+}
+
+int
+getdents (int fd, struct dirent *buf, unsigned size)
+{
+  return syscall3 (SYS_GETDENTS, fd, buf, size);
+}
+
+int
+fallocate (int fd, unsigned offset, unsigned length)
+{
+  return syscall3 (SYS_FALLOCATE, fd, offset, length);
+}
+
+int
+ftruncate (int fd, unsigned length)
+{
+  return syscall2 (SYS_FTRUNCATE, fd, length);
+}
+
+int
+blockstat (int role, struct blockstat *s)
+{
+  return syscall2 (SYS_BLOCKSTAT, role, s);
+}
+
+int
+ttymode (int mode)
+{
+  return syscall1 (SYS_TTYMODE, mode);
+}
+
+int
+dup (int fd)
+{
+  return syscall1 (SYS_DUP, fd);
+}
+
+int
+dup2 (int oldfd, int newfd)
+{
+  return syscall2 (SYS_DUP2, oldfd, newfd);
+}
+
+int
+ring_enter (struct ring *ring, unsigned to_submit)
+{
+  return syscall2 (SYS_RING_ENTER, ring, to_submit);
+}
+
+pid_t
+spawn (const char *file)
+{
+  fflush (NULL);
+  return (pid_t) syscall1 (SYS_SPAWN, file);
+}
+
+pid_t
+wait_any (int *status)
+{
+  return (pid_t) syscall1 (SYS_WAIT_ANY, status);
+}
+
+int
+wait_rusage (pid_t pid, struct rusage *u)
+{
+  return syscall2 (SYS_WAIT_RUSAGE, pid, u);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+int
+brk (void *end)
+{
+  uint8_t *cur = sbrk (0);
+
+  return sbrk ((uint8_t *) end - cur) != (void *) -1 ? 0 : -1;
+}
+
+int
+pipe (int fds[2])
+{
+  return syscall1 (SYS_PIPE, fds);
+}
+
+int
+shm_open (const char *name, unsigned size)
+{
+  return syscall2 (SYS_SHM_OPEN, name, size);
+}
+
+void *
+shm_map (int shmid, void *addr)
+{
+  return (void *) syscall2 (SYS_SHM_MAP, shmid, addr);
+}
+
+int
+shm_unmap (void *addr)
+{
+  return syscall1 (SYS_SHM_UNMAP, addr);
+}
+
+int
+null_syscall (void)
+{
+  return syscall0 (SYS_NULL);
+}
+
+int
+pmu_read (uint64_t *counts, int cnt)
+{
+  return syscall2 (SYS_PMU_READ, counts, cnt);
+}
+
+int
+stat_read (const char *name, char *buf, unsigned size)
+{
+  return syscall3 (SYS_STAT_READ, name, buf, size);
+}
+
+int
+checkpoint (const char *file)
+{
+  /* Otherwise the restored process would write our output too. */
+  fflush (NULL);
+  return syscall1 (SYS_CHECKPOINT, file);
+}
+
+pid_t
+restore (const char *file)
+{
+  return (pid_t) syscall1 (SYS_RESTORE, file);
+}
+
+int
+sched_setaffinity (tid_t tid, unsigned mask)
+{
+  return syscall2 (SYS_SCHED_SETAFFINITY, tid, mask);
+}
+
+int
+sched_getaffinity (tid_t tid)
+{
+  return syscall1 (SYS_SCHED_GETAFFINITY, tid);
+}
+
+int
+sched_setscheduler (int policy)
+{
+  return syscall1 (SYS_SCHED_SETSCHEDULER, policy);
+}
+
+int
+sched_getscheduler (void)
+{
+  return syscall0 (SYS_SCHED_GETSCHEDULER);
+}
+
+int
+sleep_until (const struct timespec *ts)
+{
+  return syscall1 (SYS_SLEEP_UNTIL, ts);
+}
+
+int
+timer_slack (int ms)
+{
+  return syscall1 (SYS_TIMER_SLACK, ms);
+}
+
+int
+setpriority (pid_t pid, int priority)
+{
+  return syscall2 (SYS_SETPRIORITY, pid, priority);
+}
+
+int
+getpriority (pid_t pid)
+{
+  return syscall1 (SYS_GETPRIORITY, pid);
+}
+
+int
+nice (int increment)
+{
+  return syscall1 (SYS_NICE, increment);
+}
+
+int
+yield_to (tid_t tid)
+{
+  return syscall1 (SYS_YIELD_TO, tid);
+}
+
+int
+poll (struct pollfd *fds, unsigned cnt, int timeout_ms)
+{
+  return syscall3 (SYS_POLL, fds, cnt, timeout_ms);
+}
+
+pid_t
+spawn_actions (const char *file, const struct spawn_action *actions, int cnt)
+{
+  fflush (NULL);
+  return (pid_t) syscall3 (SYS_SPAWN_ACTIONS, file, actions, cnt);
+}
+
+int
+open_flags (const char *file, int flags)
+{
+  return syscall2 (SYS_OPEN_FLAGS, file, flags);
+}
+
+int
+fadvise (int fd, int advice)
+{
+  return syscall2 (SYS_FADVISE, fd, advice);
+}
+
+int
+defrag (int fd)
+{
+  return syscall1 (SYS_DEFRAG, fd);
+}
+
+bool
+clone_file (int src_fd, int dst_fd)
+{
+  return syscall2 (SYS_CLONE_FILE, src_fd, dst_fd);
+}
@@ -2,23 +2,226 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
+#include <stdint.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
+/* Thread identifier, for threads within a process. */
+typedef int tid_t;
+#define TID_ERROR ((tid_t) -1)
+
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
 /* Maximum characters in a filename written by readdir(). */
-#define READDIR_MAX_LEN 14
+#define READDIR_MAX_LEN 255
+
+/* CPU time used by a process, in time-stamp counter cycles. */
+struct cputime
+  {
+    uint64_t user_cycles;       /* Cycles spent in user mode. */
+    uint64_t kernel_cycles;     /* Cycles spent in the kernel. */
+  };
+
+/* Scheduler latency histograms, in time-stamp counter cycles.
+   Bucket 0 counts zeros and bucket B values in [2**(B-1), 2**B);
+   the last bucket also counts everything larger. */
+#define SCHED_LATENCY_BUCKETS 48
+struct sched_latency
+  {
+    unsigned wakeup[SCHED_LATENCY_BUCKETS]; /* Unblock to run. */
+    unsigned slice[SCHED_LATENCY_BUCKETS];  /* Time run per turn. */
+  };
+
+/* Resource use of a process.  For children, RESIDENT is 0 and
+   PEAK_RESIDENT the largest of theirs, while the rest are sums. */
+struct rusage
+  {
+    unsigned minor_faults;      /* Faults served without disk reads. */
+    unsigned major_faults;      /* Faults that read a file or swap. */
+    unsigned cow_faults;        /* Writes that copied a page of fork(). */
+    unsigned stack_faults;      /* Faults that grew the stack. */
+    unsigned evictions;         /* Pages evicted to give it frames. */
+    unsigned resident;          /* Frames it holds now. */
+    unsigned peak_resident;     /* Most frames it held at once. */
+    unsigned user_ticks;        /* Timer ticks that found it in user mode. */
+    unsigned kernel_ticks;      /* Timer ticks in the kernel on its behalf. */
+    unsigned syscalls;          /* System calls made. */
+    unsigned sectors_read;      /* Disk sectors it had read. */
+    unsigned sectors_written;   /* Disk sectors it had written. */
+    unsigned huge_pages;        /* 4 MB regions mapped by one huge page. */
+  };
+
+/* Whose use getrusage() reports. */
+#define RUSAGE_SELF 0           /* The calling process. */
+#define RUSAGE_CHILDREN (-1)    /* Its children that wait() collected. */
+
+/* One buffer of a readv() or writev(). */
+struct iovec
+  {
+    void *iov_base;             /* Start of the buffer. */
+    size_t iov_len;             /* Its length in bytes. */
+  };
+
+/* Most buffers readv() and writev() take at once. */
+#define IOV_MAX 16
+
+/* One object that poll() waits on. */
+struct pollfd
+  {
+    int fd;                     /* File descriptor, or pid with POLLEXIT. */
+    short events;               /* Events of interest. */
+    short revents;              /* Events that happened, set by poll(). */
+  };
+
+/* Events for poll(). */
+#define POLLIN 0x01             /* read() would not wait. */
+#define POLLOUT 0x02            /* write() would not wait. */
+#define POLLHUP 0x04            /* The other end of a pipe is closed. */
+#define POLLNVAL 0x08           /* FD is not open, or not such a child. */
+#define POLLEXIT 0x10           /* FD is a child's pid, or -1 for any
+                                   child; wait() would not wait. */
+
+/* Most objects poll() takes at once. */
+#define POLL_MAX 16
+
+/* Flags for open_flags(). */
+#define O_DIRECT 0x01           /* read() and write() of whole sectors,
+                                   from sector-aligned buffers, bypass
+                                   the buffer cache. */
+#define O_SEQUENTIAL 0x02       /* As fadvise (FADV_SEQUENTIAL). */
+#define O_RANDOM 0x04           /* As fadvise (FADV_RANDOM). */
+
+/* Hints for fadvise(). */
+#define FADV_NORMAL 0           /* Read ahead once reads are sequential. */
+#define FADV_SEQUENTIAL 1       /* Read ahead all the way, drop behind. */
+#define FADV_RANDOM 2           /* Never read ahead. */
+#define FADV_DONTNEED 3         /* Cached data will not be wanted soon. */
+
+/* One change spawn_actions() makes to the descriptors a child
+   starts with, besides the pipes that every child inherits. */
+struct spawn_action
+  {
+    int type;                   /* SPAWN_DUP2 or SPAWN_CLOSE. */
+    int fd;                     /* Descriptor of the caller, or of the child. */
+    int newfd;                  /* Where SPAWN_DUP2 puts FD in the child. */
+  };
+
+/* Actions for spawn_actions(). */
+#define SPAWN_DUP2 0            /* The child gets the caller's FD at NEWFD. */
+#define SPAWN_CLOSE 1           /* The child does not get FD. */
+
+/* Most actions spawn_actions() takes at once. */
+#define SPAWN_ACTIONS_MAX 16
+
+/* One directory entry written by getdents(). */
+struct dirent
+  {
+    int d_ino;                          /* Inode number. */
+    unsigned d_size;                    /* File size in bytes. */
+    uint8_t d_type;                     /* DT_REG or DT_DIR. */
+    char d_name[READDIR_MAX_LEN + 1];   /* Null terminated name. */
+  };
+
+/* Values of d_type. */
+#define DT_REG 1                /* Ordinary file. */
+#define DT_DIR 2                /* Directory. */
+
+/* Statistics of the block device in a role, from blockstat().
+   The latency histograms, in time-stamp counter cycles from
+   submission to completion, have buckets as in struct
+   sched_latency. */
+#define BLOCKSTAT_BUCKETS 48
+struct blockstat
+  {
+    unsigned read_sectors;      /* Sectors read. */
+    unsigned write_sectors;     /* Sectors written. */
+    unsigned requests;          /* Requests submitted. */
+    unsigned sequential;        /* Requests that began where the previous
+                                   one ended. */
+    unsigned read_latency[BLOCKSTAT_BUCKETS];
+    unsigned write_latency[BLOCKSTAT_BUCKETS];
+  };
+
+/* Roles for blockstat(). */
+#define BLOCKSTAT_FILESYS 1     /* File system. */
+#define BLOCKSTAT_SCRATCH 2     /* Scratch. */
+#define BLOCKSTAT_SWAP 3        /* Swap. */
+
+/* Operations of a ring_enter() submission. */
+#define RING_OP_READ 0          /* read (FD, BUF, LEN). */
+#define RING_OP_WRITE 1         /* write (FD, BUF, LEN). */
+#define RING_OP_OPEN 2          /* open (BUF), BUF a file name. */
+#define RING_OP_CLOSE 3         /* close (FD). */
+
+/* One operation submitted through a ring. */
+struct ring_sqe
+  {
+    unsigned op;                /* RING_OP_*. */
+    int fd;                     /* File descriptor. */
+    void *buf;                  /* Buffer or file name. */
+    unsigned len;               /* Bytes to transfer. */
+    unsigned user_data;         /* Copied to the completion. */
+  };
+
+/* The result of one operation. */
+struct ring_cqe
+  {
+    unsigned user_data;         /* From the submission. */
+    int res;                    /* What the system call returned. */
+  };
+
+/* Submission and completion rings, in the program's memory.  The
+   program puts operations in SQES[SQ_TAIL % ENTRIES] and advances
+   SQ_TAIL.  ring_enter() runs them from SQ_HEAD on, advancing
+   SQ_HEAD, and posts each result in CQES[CQ_TAIL % ENTRIES],
+   advancing CQ_TAIL, which the program reads up to without
+   another system call, advancing CQ_HEAD.  ENTRIES must be a
+   power of 2. */
+struct ring
+  {
+    unsigned entries;           /* Entries in each ring. */
+    unsigned sq_head;           /* Next submission, set by the kernel. */
+    unsigned sq_tail;           /* End of the submissions. */
+    unsigned cq_head;           /* Next completion to read. */
+    unsigned cq_tail;           /* End of the completions, set by the kernel. */
+    struct ring_sqe *sqes;      /* Submission ring. */
+    struct ring_cqe *cqes;      /* Completion ring. */
+  };
+
+/* Console input modes for ttymode(). */
+#define TTY_CANONICAL 0         /* read() returns a line at a time. */
+#define TTY_RAW 1               /* read() returns whatever has arrived. */
+
+/* Scheduling classes for sched_setscheduler(). */
+#define SCHED_NORMAL 0          /* Time-shared by priority. */
+#define SCHED_BATCH 1           /* Long slices, runs when nothing else can. */
+
+/* Clocks for clock_gettime(). */
+typedef int clockid_t;
+#define CLOCK_REALTIME 0        /* Time since the epoch. */
+#define CLOCK_MONOTONIC 1       /* Time since boot. */
+
+/* A time, in seconds and nanoseconds. */
+struct timespec
+  {
+    int64_t tv_sec;             /* Seconds. */
+    long tv_nsec;               /* Nanoseconds, less than a second. */
+  };
 
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
 
+/* Exit status of a process started by spawn() whose program
+   could not be loaded. */
+#define EXIT_LOAD_FAILED 127
+
 /* Projects 2 and later. */
 void halt (void) NO_RETURN;
 void exit (int status) NO_RETURN;
@@ -45,4 +248,65 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+void cputime (struct cputime *);
+int futex_wait (int *addr, int expected);
+int futex_wake (int *addr, int n);
+tid_t thread_spawn (void (*func) (void *), void *aux);
+int thread_join (tid_t);
+void thread_exit (void) NO_RETURN;
+int sched_latency (int priority, struct sched_latency *);
+pid_t fork (void);
+int getrusage (int who, struct rusage *);
+int fsync (int fd);
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+int readv (int fd, const struct iovec *, int iovcnt);
+int writev (int fd, const struct iovec *, int iovcnt);
+int copy_file_range (int in_fd, int out_fd, unsigned length);
+int getdents (int fd, struct dirent *, unsigned size);
+int fallocate (int fd, unsigned offset, unsigned length);
+int ftruncate (int fd, unsigned length);
+int blockstat (int role, struct blockstat *);
+int ttymode (int mode);
+int dup (int fd);
+int dup2 (int oldfd, int newfd);
+int ring_enter (struct ring *, unsigned to_submit);
+pid_t spawn (const char *file);
+pid_t wait_any (int *status);
+int wait_rusage (pid_t, struct rusage *);
+void *sbrk (intptr_t increment);
+int brk (void *end);
+int pipe (int fds[2]);
+int shm_open (const char *name, unsigned size);
+void *shm_map (int shmid, void *addr);
+int shm_unmap (void *addr);
+int null_syscall (void);
+int pmu_read (uint64_t *counts, int cnt);
+int stat_read (const char *name, char *buf, unsigned size);
+int checkpoint (const char *file);
+pid_t restore (const char *file);
+int sched_setaffinity (tid_t, unsigned mask);
+int sched_getaffinity (tid_t);
+int sched_setscheduler (int policy);
+int sched_getscheduler (void);
+int sleep_until (const struct timespec *);
+int timer_slack (int ms);
+int setpriority (pid_t, int priority);
+int getpriority (pid_t);
+int nice (int increment);
+int yield_to (tid_t);
+int poll (struct pollfd *, unsigned cnt, int timeout_ms);
+pid_t spawn_actions (const char *file, const struct spawn_action *, int cnt);
+int open_flags (const char *file, int flags);
+int fadvise (int fd, int advice);
+int defrag (int fd);
+bool clone_file (int src_fd, int dst_fd);
+
+/* Read from the kernel information page, without a system call. */
+pid_t getpid (void);
+tid_t gettid (void);
+int clock_gettime (clockid_t, struct timespec *);
+int getloadavg (void);
+
 #endif /* lib/user/syscall.h */
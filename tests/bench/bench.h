@@ -0,0 +1,15 @@
+#ifndef TESTS_BENCH_BENCH_H
+#define TESTS_BENCH_BENCH_H
+
+#include <inttypes.h>
+#include <stdint.h>
+
+/* Benchmarks report each result with msg() as a line
+   "bench KEY=VALUE", which `make bench' collects into
+   bench.results.  Keys are "BENCHMARK.MEASURE", with the unit at
+   the end of MEASURE, e.g. "sema.round_trip_cycles".  Works in
+   kernel tests and user programs alike, since both have msg(). */
+#define BENCH_REPORT(KEY, VALUE) \
+        msg ("bench %s=%"PRIu64, KEY, (uint64_t) (VALUE))
+
+#endif /* tests/bench/bench.h */
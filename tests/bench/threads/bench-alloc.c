@@ -0,0 +1,76 @@
+/* Measures malloc() and free() for small, medium and large
+   blocks, and palloc_get_page() and palloc_free_page(), by
+   allocating a batch and then freeing it, many times over.
+   Reports the average cycles per allocation and free, for each
+   size. */
+
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/tsc.h"
+
+/* Blocks allocated before freeing them. */
+#define BATCH 64
+
+/* Batches allocated and freed. */
+#define ROUNDS 64
+
+static uint64_t time_malloc (size_t size);
+static uint64_t time_palloc (void);
+
+void
+test_bench_alloc (void) 
+{
+  BENCH_REPORT ("alloc.malloc_16_cycles", time_malloc (16));
+  BENCH_REPORT ("alloc.malloc_256_cycles", time_malloc (256));
+  BENCH_REPORT ("alloc.malloc_1024_cycles", time_malloc (1024));
+  BENCH_REPORT ("alloc.malloc_8192_cycles", time_malloc (8192));
+  BENCH_REPORT ("alloc.palloc_cycles", time_palloc ());
+  msg ("PASS");
+}
+
+/* Returns the average cycles for malloc (SIZE) and the
+   corresponding free(). */
+static uint64_t
+time_malloc (size_t size) 
+{
+  void *blocks[BATCH];
+  uint64_t start;
+  int i, j;
+
+  start = rdtsc ();
+  for (i = 0; i < ROUNDS; i++)
+    {
+      for (j = 0; j < BATCH; j++)
+        {
+          blocks[j] = malloc (size);
+          if (blocks[j] == NULL)
+            fail ("malloc (%zu) failed", size);
+        }
+      for (j = 0; j < BATCH; j++)
+        free (blocks[j]);
+    }
+  return (rdtsc () - start) / (ROUNDS * BATCH);
+}
+
+/* Returns the average cycles for palloc_get_page() and the
+   corresponding palloc_free_page(). */
+static uint64_t
+time_palloc (void) 
+{
+  void *pages[BATCH];
+  uint64_t start;
+  int i, j;
+
+  start = rdtsc ();
+  for (i = 0; i < ROUNDS; i++)
+    {
+      for (j = 0; j < BATCH; j++)
+        pages[j] = palloc_get_page (PAL_ASSERT);
+      for (j = 0; j < BATCH; j++)
+        palloc_free_page (pages[j]);
+    }
+  return (rdtsc () - start) / (ROUNDS * BATCH);
+}
@@ -0,0 +1,65 @@
+/* Measures handing a lock from a low-priority holder to a
+   high-priority waiter.  Each round, the holder takes the lock
+   and the main thread then waits for it, donating its priority,
+   so that the holder runs to release it.  Times lock_acquire()
+   from the donation to getting the lock, which includes two
+   context switches, and reports the average cycles. */
+
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Log2 of the number of handoffs. */
+#define ROUND_LOG 10
+
+static thread_func holder_thread;
+static struct lock lock;
+static struct semaphore held, done;
+
+void
+test_bench_lock_donate (void) 
+{
+  uint64_t total = 0;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  lock_init (&lock);
+  sema_init (&held, 0);
+  sema_init (&done, 0);
+  thread_create ("holder", thread_get_priority () - 1, holder_thread, NULL);
+
+  for (i = 0; i < 1 << ROUND_LOG; i++)
+    {
+      uint64_t start;
+
+      sema_down (&held);
+      start = rdtsc ();
+      lock_acquire (&lock);
+      total += rdtsc () - start;
+      lock_release (&lock);
+    }
+  sema_down (&done);
+  BENCH_REPORT ("lock_donate.handoff_cycles", total >> ROUND_LOG);
+  msg ("PASS");
+}
+
+/* Takes the lock, lets the main thread wait for it, and gives it
+   up as soon as it runs again with the main thread's priority. */
+static void
+holder_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < 1 << ROUND_LOG; i++)
+    {
+      lock_acquire (&lock);
+      sema_up (&held);
+      lock_release (&lock);
+    }
+  sema_up (&done);
+}
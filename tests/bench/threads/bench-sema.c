@@ -0,0 +1,54 @@
+/* Measures a semaphore ping-pong: two threads hand a turn back
+   and forth through a pair of semaphores, so that each round
+   trip is two sema_up() calls, two sema_down() calls and two
+   context switches.  Reports the average cycles per round
+   trip. */
+
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Log2 of the number of round trips. */
+#define ROUND_LOG 12
+
+static thread_func pong_thread;
+static struct semaphore ping, pong, done;
+
+void
+test_bench_sema (void) 
+{
+  uint64_t start;
+  int i;
+
+  sema_init (&ping, 0);
+  sema_init (&pong, 0);
+  sema_init (&done, 0);
+  thread_create ("pong", thread_get_priority (), pong_thread, NULL);
+
+  start = rdtsc ();
+  for (i = 0; i < 1 << ROUND_LOG; i++)
+    {
+      sema_up (&ping);
+      sema_down (&pong);
+    }
+  BENCH_REPORT ("sema.round_trip_cycles", (rdtsc () - start) >> ROUND_LOG);
+  sema_down (&done);
+  msg ("PASS");
+}
+
+/* Returns each turn. */
+static void
+pong_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < 1 << ROUND_LOG; i++)
+    {
+      sema_down (&ping);
+      sema_up (&pong);
+    }
+  sema_up (&done);
+}
@@ -0,0 +1,51 @@
+/* Measures how precisely timer_sleep() wakes a thread.  Sleeps
+   for 1, 2 and 3 ticks in turn, starting just after a tick, and
+   compares the time asleep with the time the ticks should take.
+   Reports the average and worst lateness in microseconds, and
+   how many sleeps lasted more ticks than asked for. */
+
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "tests/threads/tests.h"
+#include "devices/timer.h"
+#include "threads/tsc.h"
+
+/* Number of sleeps. */
+#define SLEEP_CNT 60
+
+void
+test_bench_sleep (void) 
+{
+  uint64_t hz = timer_tsc_hz ();
+  uint64_t tick_cycles = hz / TIMER_FREQ;
+  uint64_t total_late = 0, worst_late = 0;
+  int overslept = 0;
+  int i;
+
+  ASSERT (hz != 0);
+
+  /* Start just after a tick. */
+  timer_sleep (1);
+  for (i = 0; i < SLEEP_CNT; i++)
+    {
+      int64_t ticks = 1 + i % 3;
+      int64_t start_tick = timer_ticks ();
+      uint64_t start = rdtsc ();
+      uint64_t cycles, late;
+
+      timer_sleep (ticks);
+      cycles = rdtsc () - start;
+      if (timer_elapsed (start_tick) > ticks)
+        overslept++;
+
+      late = cycles > ticks * tick_cycles ? cycles - ticks * tick_cycles : 0;
+      total_late += late;
+      if (late > worst_late)
+        worst_late = late;
+    }
+
+  BENCH_REPORT ("sleep.late_avg_us", total_late / SLEEP_CNT * 1000000 / hz);
+  BENCH_REPORT ("sleep.late_max_us", worst_late * 1000000 / hz);
+  BENCH_REPORT ("sleep.overslept_cnt", overslept);
+  msg ("PASS");
+}
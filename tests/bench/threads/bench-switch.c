@@ -0,0 +1,45 @@
+/* Measures the cost of thread_yield() switching between two
+   threads of the same priority, which take turns on the CPU for
+   a fixed number of yields each.  Reports the average cycles per
+   switch. */
+
+#include <stdio.h>
+#include "tests/bench/bench.h"
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Log2 of the number of yields by each thread. */
+#define YIELD_LOG 12
+
+static thread_func yield_thread;
+static struct semaphore done;
+
+void
+test_bench_switch (void) 
+{
+  uint64_t start;
+
+  sema_init (&done, 0);
+  thread_create ("yielder", thread_get_priority (), yield_thread, NULL);
+
+  start = rdtsc ();
+  yield_thread (NULL);
+  sema_down (&done);
+  sema_down (&done);
+  BENCH_REPORT ("switch.yield_cycles",
+                (rdtsc () - start) >> (YIELD_LOG + 1));
+  msg ("PASS");
+}
+
+/* Yields 2**YIELD_LOG times. */
+static void
+yield_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < 1 << YIELD_LOG; i++)
+    thread_yield ();
+  sema_up (&done);
+}
@@ -0,0 +1,36 @@
+/* Measures starting a process and reaping it: each round is an
+   exec() of a child that exits at once and a wait() for it.
+   Reports the average cycles for a whole round and for exec()
+   alone. */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "threads/tsc.h"
+
+/* Log2 of the number of children. */
+#define CHILD_LOG 5
+
+void
+test_main (void) 
+{
+  uint64_t exec_cycles = 0, start;
+  int i;
+
+  start = rdtsc ();
+  for (i = 0; i < 1 << CHILD_LOG; i++)
+    {
+      uint64_t exec_start = rdtsc ();
+      pid_t pid = exec ("child-simple");
+
+      exec_cycles += rdtsc () - exec_start;
+      if (pid == PID_ERROR)
+        fail ("exec #%d failed", i);
+      if (wait (pid) != 81)
+        fail ("child #%d returned the wrong status", i);
+    }
+  BENCH_REPORT ("exec_wait.round_cycles", (rdtsc () - start) >> CHILD_LOG);
+  BENCH_REPORT ("exec_wait.exec_cycles", exec_cycles >> CHILD_LOG);
+  msg ("PASS");
+}
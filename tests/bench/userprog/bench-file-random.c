@@ -0,0 +1,53 @@
+/* Measures random file I/O: in a 256 kB file, reads and then
+   writes 512-byte records at random record-aligned offsets with
+   pread() and pwrite().  Reports the average cycles per record
+   for each direction. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "threads/tsc.h"
+
+/* File size, record size, and log2 of the number of accesses. */
+#define FILE_SIZE (256 * 1024)
+#define RECORD_SIZE 512
+#define ACCESS_LOG 10
+
+static char buf[RECORD_SIZE];
+
+/* Returns a random record offset in the file. */
+static unsigned
+random_offset (void) 
+{
+  return random_ulong () % (FILE_SIZE / RECORD_SIZE) * RECORD_SIZE;
+}
+
+void
+test_main (void) 
+{
+  uint64_t start;
+  int fd, i;
+
+  random_init (0);
+  CHECK (create ("random", FILE_SIZE), "create \"random\"");
+  CHECK ((fd = open ("random")) > 1, "open \"random\"");
+
+  start = rdtsc ();
+  for (i = 0; i < 1 << ACCESS_LOG; i++)
+    if (pread (fd, buf, RECORD_SIZE, random_offset ()) != RECORD_SIZE)
+      fail ("read #%d failed", i);
+  BENCH_REPORT ("file_random.read_record_cycles",
+                (rdtsc () - start) >> ACCESS_LOG);
+
+  start = rdtsc ();
+  for (i = 0; i < 1 << ACCESS_LOG; i++)
+    if (pwrite (fd, buf, RECORD_SIZE, random_offset ()) != RECORD_SIZE)
+      fail ("write #%d failed", i);
+  BENCH_REPORT ("file_random.write_record_cycles",
+                (rdtsc () - start) >> ACCESS_LOG);
+
+  close (fd);
+  msg ("PASS");
+}
@@ -0,0 +1,44 @@
+/* Measures sequential file I/O: writes a 256 kB file in 4 kB
+   blocks, then reads it back the same way, with the data already
+   in the buffer cache.  Reports the average cycles per block for
+   each direction. */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "threads/tsc.h"
+
+/* Block size and log2 of the number of blocks. */
+#define BLOCK_SIZE 4096
+#define BLOCK_LOG 6
+
+static char buf[BLOCK_SIZE];
+
+void
+test_main (void) 
+{
+  uint64_t start;
+  int fd, i;
+
+  CHECK (create ("seq", 0), "create \"seq\"");
+  CHECK ((fd = open ("seq")) > 1, "open \"seq\"");
+
+  start = rdtsc ();
+  for (i = 0; i < 1 << BLOCK_LOG; i++)
+    if (write (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+      fail ("write of block %d failed", i);
+  BENCH_REPORT ("file_seq.write_block_cycles",
+                (rdtsc () - start) >> BLOCK_LOG);
+
+  seek (fd, 0);
+  start = rdtsc ();
+  for (i = 0; i < 1 << BLOCK_LOG; i++)
+    if (read (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+      fail ("read of block %d failed", i);
+  BENCH_REPORT ("file_seq.read_block_cycles",
+                (rdtsc () - start) >> BLOCK_LOG);
+
+  close (fd);
+  msg ("PASS");
+}
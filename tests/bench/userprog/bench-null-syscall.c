@@ -0,0 +1,25 @@
+/* Measures the cost of entering and leaving the kernel, with a
+   system call that does nothing.  Reports the average cycles per
+   call. */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "threads/tsc.h"
+
+/* Log2 of the number of calls. */
+#define CALL_LOG 16
+
+void
+test_main (void) 
+{
+  uint64_t start;
+  int i;
+
+  start = rdtsc ();
+  for (i = 0; i < 1 << CALL_LOG; i++)
+    null_syscall ();
+  BENCH_REPORT ("null_syscall.call_cycles", (rdtsc () - start) >> CALL_LOG);
+  msg ("PASS");
+}
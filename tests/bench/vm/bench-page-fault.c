@@ -0,0 +1,33 @@
+/* Measures page faults on fresh anonymous memory: grows the heap
+   with sbrk() and then touches each new page once, so that every
+   first touch takes a fault that maps a zeroed frame.  Reports
+   the average cycles per first touch. */
+
+#include <syscall.h>
+#include "tests/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "threads/tsc.h"
+
+#define PAGE_SIZE 4096
+
+/* Log2 of the number of pages touched. */
+#define PAGE_LOG 7
+
+void
+test_main (void) 
+{
+  uint64_t start;
+  char *heap;
+  int i;
+
+  heap = sbrk ((1 << PAGE_LOG) * PAGE_SIZE);
+  CHECK (heap != (void *) -1, "sbrk %d pages", 1 << PAGE_LOG);
+
+  start = rdtsc ();
+  for (i = 0; i < 1 << PAGE_LOG; i++)
+    heap[i * PAGE_SIZE] = i;
+  BENCH_REPORT ("page_fault.first_touch_cycles",
+                (rdtsc () - start) >> PAGE_LOG);
+  msg ("PASS");
+}
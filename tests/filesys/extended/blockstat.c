@@ -0,0 +1,57 @@
+/* Writes a file, flushes it to disk with fsync(), and checks that
+   blockstat() counts the sectors written to the file system
+   device and the time they took. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[8192];
+
+/* Returns the number of requests counted in latency histogram H. */
+static unsigned
+histogram_total (const unsigned h[BLOCKSTAT_BUCKETS])
+{
+  unsigned total = 0;
+  size_t i;
+
+  for (i = 0; i < BLOCKSTAT_BUCKETS; i++)
+    total += h[i];
+  return total;
+}
+
+void
+test_main (void) 
+{
+  struct blockstat before, after;
+  int fd;
+
+  CHECK (blockstat (BLOCKSTAT_FILESYS, &before) == 0,
+         "blockstat file system device");
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  memset (buf, 'b', sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write %zu bytes to \"data\"", sizeof buf);
+  CHECK (fsync (fd) == 0, "fsync \"data\"");
+  CHECK (blockstat (BLOCKSTAT_FILESYS, &after) == 0,
+         "blockstat file system device again");
+
+  if (after.write_sectors < before.write_sectors + sizeof buf / 512)
+    fail ("%u sectors written, expected at least %zu more than %u",
+          after.write_sectors, sizeof buf / 512, before.write_sectors);
+  if (after.requests <= before.requests)
+    fail ("request count did not grow past %u", before.requests);
+  if (after.sequential > after.requests)
+    fail ("%u sequential requests out of %u",
+          after.sequential, after.requests);
+  if (histogram_total (after.write_latency)
+      <= histogram_total (before.write_latency))
+    fail ("write latency histogram did not grow");
+  msg ("statistics grew");
+
+  CHECK (blockstat (99, &after) == -1, "blockstat bad role");
+  msg ("close \"data\"");
+  close (fd);
+}
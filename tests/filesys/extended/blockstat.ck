@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(blockstat) begin
+(blockstat) blockstat file system device
+(blockstat) create "data"
+(blockstat) open "data"
+(blockstat) write 8192 bytes to "data"
+(blockstat) fsync "data"
+(blockstat) blockstat file system device again
+(blockstat) statistics grew
+(blockstat) blockstat bad role
+(blockstat) close "data"
+(blockstat) end
+EOF
+pass;
@@ -0,0 +1,60 @@
+/* Child process for syn-stress.
+   Creates, writes, reads back and removes a file of its own
+   ITER_CNT times, reading the file our parent shares with all
+   its children in between. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-stress.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-syn-stress";
+
+static char shared[BUF_SIZE];
+static char data[BUF_SIZE];
+static char buf[BUF_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  char file_name[16];
+  int child_idx;
+  int i;
+
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  random_init (0);
+  random_bytes (shared, sizeof shared);
+  random_init (child_idx + 1);
+  random_bytes (data, sizeof data);
+  snprintf (file_name, sizeof file_name, "file%d", child_idx);
+
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      int fd;
+
+      CHECK (create (file_name, 0), "create \"%s\"", file_name);
+      CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+      CHECK (write (fd, data, sizeof data) == sizeof data,
+             "write \"%s\"", file_name);
+      seek (fd, 0);
+      CHECK (read (fd, buf, sizeof buf) == sizeof buf,
+             "read \"%s\"", file_name);
+      compare_bytes (buf, data, sizeof data, 0, file_name);
+      close (fd);
+      CHECK (remove (file_name), "remove \"%s\"", file_name);
+
+      CHECK ((fd = open (shared_name)) > 1, "open \"%s\"", shared_name);
+      CHECK (read (fd, buf, sizeof buf) == sizeof buf,
+             "read \"%s\"", shared_name);
+      compare_bytes (buf, shared, sizeof shared, 0, shared_name);
+      close (fd);
+    }
+
+  return child_idx;
+}
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({'d' => {'a' => ["\0" x 100], 'b' => [''], 'c' => {}}});
+pass;
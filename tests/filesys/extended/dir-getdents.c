@@ -0,0 +1,65 @@
+/* Lists a directory with getdents(), two entries at a time, and
+   checks the type, size, and inumber reported for each entry. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct dirent entries[2];
+  bool seen[3] = {false, false, false};
+  int dir_fd, fd, size, i;
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (create ("d/a", 100), "create \"d/a\"");
+  CHECK (create ("d/b", 0), "create \"d/b\"");
+  CHECK (mkdir ("d/c"), "mkdir \"d/c\"");
+  CHECK ((dir_fd = open ("d")) > 1, "open \"d\"");
+
+  msg ("getdents \"d\"...");
+  while ((size = getdents (dir_fd, entries, sizeof entries)) > 0)
+    {
+      if (size % sizeof *entries != 0 || size > (int) sizeof entries)
+        fail ("getdents returned %d bytes", size);
+      for (i = 0; i < size / (int) sizeof *entries; i++)
+        {
+          struct dirent *d = &entries[i];
+          char name[16];
+          int idx;
+
+          if (strlen (d->d_name) != 1 || d->d_name[0] < 'a'
+              || d->d_name[0] > 'c')
+            fail ("unexpected entry \"%s\"", d->d_name);
+          idx = d->d_name[0] - 'a';
+          if (seen[idx])
+            fail ("entry \"%s\" returned twice", d->d_name);
+          seen[idx] = true;
+
+          if (d->d_type != (idx == 2 ? DT_DIR : DT_REG))
+            fail ("entry \"%s\" has type %d", d->d_name, d->d_type);
+          if (idx == 0 && d->d_size != 100)
+            fail ("entry \"a\" has size %u", d->d_size);
+
+          snprintf (name, sizeof name, "d/%s", d->d_name);
+          fd = open (name);
+          if (fd < 2 || inumber (fd) != d->d_ino)
+            fail ("entry \"%s\" has wrong inumber", d->d_name);
+          close (fd);
+        }
+    }
+  if (size != 0)
+    fail ("getdents returned %d at end of directory", size);
+  for (i = 0; i < 3; i++)
+    if (!seen[i])
+      fail ("entry \"%c\" missing", 'a' + i);
+
+  CHECK (getdents (dir_fd, entries, sizeof entries) == 0,
+         "getdents at end of \"d\"");
+  CHECK ((fd = open ("d/a")) > 1, "open \"d/a\"");
+  CHECK (getdents (fd, entries, sizeof entries) == -1,
+         "getdents \"d/a\" (must return -1)");
+}
@@ -0,0 +1,52 @@
+/* Creates files with long names, up to READDIR_MAX_LEN
+   characters, checks that readdir() and getdents() return the
+   names whole, and that a longer name is refused. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Stores in NAME a name of LENGTH copies of CH. */
+static void
+make_name (char *name, char ch, size_t length)
+{
+  memset (name, ch, length);
+  name[length] = '\0';
+}
+
+void
+test_main (void) 
+{
+  static char longest[READDIR_MAX_LEN + 2], name[READDIR_MAX_LEN + 1];
+  static char medium[64];
+  struct dirent d;
+  int dir_fd, fd;
+
+  make_name (medium, 'm', sizeof medium - 1);
+  make_name (longest, 'l', READDIR_MAX_LEN);
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK (chdir ("d"), "chdir \"d\"");
+  CHECK (create (medium, 0), "create %zu-character name", strlen (medium));
+  CHECK (create (longest, 0), "create %zu-character name", strlen (longest));
+  CHECK ((fd = open (longest)) > 1, "open %zu-character name",
+         strlen (longest));
+  close (fd);
+
+  CHECK ((dir_fd = open (".")) > 1, "open \".\"");
+  CHECK (getdents (dir_fd, &d, sizeof d) == sizeof d, "getdents \".\"");
+  if (strcmp (d.d_name, medium) && strcmp (d.d_name, longest))
+    fail ("getdents returned \"%s\"", d.d_name);
+  CHECK (readdir (dir_fd, name), "readdir \".\"");
+  if (!strcmp (name, d.d_name)
+      || (strcmp (name, medium) && strcmp (name, longest)))
+    fail ("readdir returned \"%s\"", name);
+  CHECK (!readdir (dir_fd, name), "readdir at end of \".\"");
+  close (dir_fd);
+
+  CHECK (remove (longest), "remove %zu-character name", strlen (longest));
+  make_name (longest, 'l', READDIR_MAX_LEN + 1);
+  CHECK (!create (longest, 0),
+         "create %zu-character name (must return false)", strlen (longest));
+  CHECK (chdir ("/"), "chdir \"/\"");
+}
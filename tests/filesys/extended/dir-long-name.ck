@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-long-name) begin
+(dir-long-name) mkdir "d"
+(dir-long-name) chdir "d"
+(dir-long-name) create 63-character name
+(dir-long-name) create 255-character name
+(dir-long-name) open 255-character name
+(dir-long-name) open "."
+(dir-long-name) getdents "."
+(dir-long-name) readdir "."
+(dir-long-name) readdir at end of "."
+(dir-long-name) remove 255-character name
+(dir-long-name) create 256-character name (must return false)
+(dir-long-name) chdir "/"
+(dir-long-name) end
+EOF
+pass;
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($clone) = 'a' x 10 . 'b' x 100 . 'a' x (130 * 512 - 110) . 'b' x 512
+  . 'a' x (70000 - 131 * 512);
+check_archive ({'a' => ['a' x 70000], 'b' => [$clone]});
+pass;
@@ -0,0 +1,70 @@
+/* Clones a file that reaches into the indirect block, checks
+   that the clone reads the same, then writes parts of the clone
+   and checks that only the clone changes. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 70000
+
+static char buf[FILE_SIZE];
+
+/* Checks that the file open as FD, named NAME, holds C, except
+   for SIZE bytes of D at offset OFS. */
+static void
+check_clone (int fd, const char *name, char c, char d, size_t ofs,
+             size_t size)
+{
+  size_t i;
+
+  seek (fd, 0);
+  memset (buf, 0, sizeof buf);
+  CHECK (read (fd, buf, sizeof buf) == sizeof buf, "read \"%s\"", name);
+  for (i = 0; i < sizeof buf; i++)
+    {
+      char want = i >= ofs && i < ofs + size ? d : c;
+      if (buf[i] != want)
+        fail ("byte %zu of \"%s\" is %d, not %d", i, name, buf[i], want);
+    }
+}
+
+void
+test_main (void) 
+{
+  int fd_a, fd_b;
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd_a = open ("a")) > 1, "open \"a\"");
+  memset (buf, 'a', sizeof buf);
+  CHECK (write (fd_a, buf, sizeof buf) == sizeof buf, "write \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+  CHECK ((fd_b = open ("b")) > 1, "open \"b\"");
+
+  CHECK (clone_file (fd_a, fd_b), "clone \"a\" to \"b\"");
+  CHECK (filesize (fd_b) == FILE_SIZE, "size of \"b\"");
+  check_clone (fd_b, "b", 'a', 'a', 0, 0);
+
+  msg ("write \"b\"");
+  memset (buf, 'b', sizeof buf);
+  seek (fd_b, 10);
+  if (write (fd_b, buf, 100) != 100)
+    fail ("write to \"b\" at offset 10 failed");
+  seek (fd_b, 130 * 512);
+  if (write (fd_b, buf, 512) != 512)
+    fail ("write to \"b\" at offset %d failed", 130 * 512);
+  check_clone (fd_a, "a", 'a', 'a', 0, 0);
+  seek (fd_b, 130 * 512);
+  CHECK (read (fd_b, buf, 512) == 512, "read back \"b\"");
+  if (buf[0] != 'b' || buf[511] != 'b')
+    fail ("sector written to \"b\" did not stick");
+
+  msg ("close \"a\"");
+  close (fd_a);
+  msg ("close \"b\"");
+  close (fd_b);
+
+  CHECK (!clone_file (0x20101234, 0x20101235),
+         "clone bad fds (must return false)");
+}
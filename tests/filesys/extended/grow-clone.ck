@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-clone) begin
+(grow-clone) create "a"
+(grow-clone) open "a"
+(grow-clone) write "a"
+(grow-clone) create "b"
+(grow-clone) open "b"
+(grow-clone) clone "a" to "b"
+(grow-clone) size of "b"
+(grow-clone) read "b"
+(grow-clone) write "b"
+(grow-clone) read "a"
+(grow-clone) read back "b"
+(grow-clone) close "a"
+(grow-clone) close "b"
+(grow-clone) clone bad fds (must return false)
+(grow-clone) end
+EOF
+pass;
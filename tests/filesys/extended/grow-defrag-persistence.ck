@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({'a' => ['a' x 16384], 'b' => ['b' x 16384]});
+pass;
@@ -0,0 +1,61 @@
+/* Grows two files a sector at a time, in turns, so that their
+   data ends up interleaved on disk, then defragments both and
+   checks that their contents survive the move. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 16384
+#define CHUNK_SIZE 512
+
+static char buf[FILE_SIZE];
+
+/* Defragments the file open as FD, named NAME and filled with
+   C, and checks its contents afterward. */
+static void
+defrag_and_check (int fd, const char *name, char c)
+{
+  size_t i;
+
+  CHECK (defrag (fd) >= 1, "defrag \"%s\"", name);
+  seek (fd, 0);
+  memset (buf, 0, sizeof buf);
+  CHECK (read (fd, buf, sizeof buf) == sizeof buf, "read \"%s\"", name);
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != c)
+      fail ("byte %zu of \"%s\" is %d after defrag", i, name, buf[i]);
+}
+
+void
+test_main (void) 
+{
+  int fd_a, fd_b;
+  size_t ofs;
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+  CHECK ((fd_a = open ("a")) > 1, "open \"a\"");
+  CHECK ((fd_b = open ("b")) > 1, "open \"b\"");
+
+  msg ("write \"a\" and \"b\" in turns");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+    {
+      memset (buf, 'a', CHUNK_SIZE);
+      if (write (fd_a, buf, CHUNK_SIZE) != CHUNK_SIZE)
+        fail ("write to \"a\" at offset %zu failed", ofs);
+      memset (buf, 'b', CHUNK_SIZE);
+      if (write (fd_b, buf, CHUNK_SIZE) != CHUNK_SIZE)
+        fail ("write to \"b\" at offset %zu failed", ofs);
+    }
+
+  defrag_and_check (fd_a, "a", 'a');
+  defrag_and_check (fd_b, "b", 'b');
+  msg ("close \"a\"");
+  close (fd_a);
+  msg ("close \"b\"");
+  close (fd_b);
+
+  CHECK (defrag (0x20101234) == -1, "defrag bad fd (must return -1)");
+}
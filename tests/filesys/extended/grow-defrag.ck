@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-defrag) begin
+(grow-defrag) create "a"
+(grow-defrag) create "b"
+(grow-defrag) open "a"
+(grow-defrag) open "b"
+(grow-defrag) write "a" and "b" in turns
+(grow-defrag) defrag "a"
+(grow-defrag) read "a"
+(grow-defrag) defrag "b"
+(grow-defrag) read "b"
+(grow-defrag) close "a"
+(grow-defrag) close "b"
+(grow-defrag) defrag bad fd (must return -1)
+(grow-defrag) end
+EOF
+pass;
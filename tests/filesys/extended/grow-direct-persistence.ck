@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({'big' => ['d' x 16384 . 'n' x 100]});
+pass;
@@ -0,0 +1,69 @@
+/* Writes a file with O_DIRECT, first whole sectors from a
+   sector-aligned buffer and then a few bytes that have to go
+   through the buffer cache, reads it back with and without
+   O_DIRECT, and checks that fadvise() takes each hint. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DIRECT_SIZE 16384
+#define TAIL_SIZE 100
+
+static char buf[DIRECT_SIZE + TAIL_SIZE] __attribute__ ((aligned (512)));
+
+/* Checks that the first SIZE bytes of BUF hold 'd' in the part
+   written directly and 'n' in the tail. */
+static void
+check_buf (const char *what, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (buf[i] != (i < DIRECT_SIZE ? 'd' : 'n'))
+      fail ("byte %zu of \"big\" is %d after %s", i, buf[i], what);
+}
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (create ("big", 0), "create \"big\"");
+  CHECK ((fd = open_flags ("big", O_DIRECT | O_SEQUENTIAL)) > 1,
+         "open \"big\" with O_DIRECT");
+  memset (buf, 'd', DIRECT_SIZE);
+  CHECK (write (fd, buf, DIRECT_SIZE) == DIRECT_SIZE,
+         "write %d bytes directly", DIRECT_SIZE);
+  memset (buf + 1, 'n', TAIL_SIZE);
+  CHECK (write (fd, buf + 1, TAIL_SIZE) == TAIL_SIZE,
+         "write %d unaligned bytes", TAIL_SIZE);
+  msg ("close \"big\"");
+  close (fd);
+
+  CHECK ((fd = open ("big")) > 1, "open \"big\"");
+  memset (buf, 0, sizeof buf);
+  CHECK (read (fd, buf, sizeof buf) == sizeof buf, "read \"big\"");
+  check_buf ("read", sizeof buf);
+  CHECK (fadvise (fd, FADV_RANDOM) == 0, "fadvise FADV_RANDOM");
+  CHECK (fadvise (fd, FADV_DONTNEED) == 0, "fadvise FADV_DONTNEED");
+  CHECK (fadvise (fd, FADV_NORMAL) == 0, "fadvise FADV_NORMAL");
+  CHECK (fadvise (fd, 42) == -1, "fadvise bad hint (must return -1)");
+  msg ("close \"big\"");
+  close (fd);
+
+  CHECK ((fd = open_flags ("big", O_DIRECT)) > 1,
+         "open \"big\" with O_DIRECT");
+  memset (buf, 0, sizeof buf);
+  CHECK (read (fd, buf, DIRECT_SIZE) == DIRECT_SIZE,
+         "read %d bytes directly", DIRECT_SIZE);
+  check_buf ("direct read", DIRECT_SIZE);
+  msg ("close \"big\"");
+  close (fd);
+
+  CHECK (open_flags ("big", 0x1000) == -1,
+         "open_flags bad flag (must return -1)");
+  CHECK (fadvise (0x20101234, FADV_NORMAL) == -1,
+         "fadvise bad fd (must return -1)");
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-direct) begin
+(grow-direct) create "big"
+(grow-direct) open "big" with O_DIRECT
+(grow-direct) write 16384 bytes directly
+(grow-direct) write 100 unaligned bytes
+(grow-direct) close "big"
+(grow-direct) open "big"
+(grow-direct) read "big"
+(grow-direct) fadvise FADV_RANDOM
+(grow-direct) fadvise FADV_DONTNEED
+(grow-direct) fadvise FADV_NORMAL
+(grow-direct) fadvise bad hint (must return -1)
+(grow-direct) close "big"
+(grow-direct) open "big" with O_DIRECT
+(grow-direct) read 16384 bytes directly
+(grow-direct) close "big"
+(grow-direct) open_flags bad flag (must return -1)
+(grow-direct) fadvise bad fd (must return -1)
+(grow-direct) end
+EOF
+pass;
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({'log' => ["\0" x 5000 . 'x' x 500 . "\0" x 2500]});
+pass;
@@ -0,0 +1,51 @@
+/* Preallocates a file with fallocate(), writes into the middle
+   of it, and shrinks and regrows it with ftruncate(), checking
+   that everything not written reads as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[20000];
+
+/* Checks that the first SIZE bytes of the file open as FD are
+   zeros except for 'x' in [X_OFS, X_END). */
+static void
+check_contents (int fd, size_t size, size_t x_ofs, size_t x_end)
+{
+  size_t i;
+
+  seek (fd, 0);
+  if ((size_t) read (fd, buf, sizeof buf) != size)
+    fail ("read of \"log\" did not return %zu bytes", size);
+  for (i = 0; i < size; i++)
+    if (buf[i] != (i >= x_ofs && i < x_end ? 'x' : 0))
+      fail ("byte %zu of \"log\" is %d", i, buf[i]);
+}
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (create ("log", 0), "create \"log\"");
+  CHECK ((fd = open ("log")) > 1, "open \"log\"");
+  CHECK (fallocate (fd, 0, sizeof buf) == 0, "fallocate \"log\"");
+  CHECK (filesize (fd) == sizeof buf, "filesize \"log\" is %zu", sizeof buf);
+  check_contents (fd, sizeof buf, 0, 0);
+
+  memset (buf, 'x', 1000);
+  seek (fd, 5000);
+  CHECK (write (fd, buf, 1000) == 1000, "write 1000 bytes at 5000");
+  check_contents (fd, sizeof buf, 5000, 6000);
+
+  CHECK (ftruncate (fd, 5500) == 0, "ftruncate \"log\" to 5500");
+  CHECK (filesize (fd) == 5500, "filesize \"log\" is 5500");
+  CHECK (ftruncate (fd, 8000) == 0, "ftruncate \"log\" to 8000");
+  check_contents (fd, 8000, 5000, 5500);
+
+  CHECK (fallocate (0x20101234, 0, 1) == -1, "fallocate bad fd");
+  msg ("close \"log\"");
+  close (fd);
+}
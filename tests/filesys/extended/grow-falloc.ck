@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-falloc) begin
+(grow-falloc) create "log"
+(grow-falloc) open "log"
+(grow-falloc) fallocate "log"
+(grow-falloc) filesize "log" is 20000
+(grow-falloc) write 1000 bytes at 5000
+(grow-falloc) ftruncate "log" to 5500
+(grow-falloc) filesize "log" is 5500
+(grow-falloc) ftruncate "log" to 8000
+(grow-falloc) fallocate bad fd
+(grow-falloc) close "log"
+(grow-falloc) end
+EOF
+pass;
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_archive ({"child-syn-stress" => "tests/filesys/extended/child-syn-stress",
+		"shared" => [random_bytes (4096)]});
+pass;
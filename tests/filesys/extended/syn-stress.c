@@ -0,0 +1,31 @@
+/* Has several processes at once create, write, read back and
+   remove files of their own in the root directory, while they
+   all also read one file they share. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-stress.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+char buf[BUF_SIZE];
+
+#define CHILD_CNT 4
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  int fd;
+
+  CHECK (create (shared_name, 0), "create \"%s\"", shared_name);
+  CHECK ((fd = open (shared_name)) > 1, "open \"%s\"", shared_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", shared_name);
+  msg ("close \"%s\"", shared_name);
+  close (fd);
+
+  exec_children ("child-syn-stress", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-stress) begin
+(syn-stress) create "shared"
+(syn-stress) open "shared"
+(syn-stress) write "shared"
+(syn-stress) close "shared"
+(syn-stress) exec child 1 of 4: "child-syn-stress 0"
+(syn-stress) exec child 2 of 4: "child-syn-stress 1"
+(syn-stress) exec child 3 of 4: "child-syn-stress 2"
+(syn-stress) exec child 4 of 4: "child-syn-stress 3"
+(syn-stress) wait for child 1 of 4 returned 0 (expected 0)
+(syn-stress) wait for child 2 of 4 returned 1 (expected 1)
+(syn-stress) wait for child 3 of 4 returned 2 (expected 2)
+(syn-stress) wait for child 4 of 4 returned 3 (expected 3)
+(syn-stress) end
+EOF
+pass;
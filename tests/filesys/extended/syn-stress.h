@@ -0,0 +1,8 @@
+#ifndef TESTS_FILESYS_EXTENDED_SYN_STRESS_H
+#define TESTS_FILESYS_EXTENDED_SYN_STRESS_H
+
+#define BUF_SIZE 4096
+#define ITER_CNT 8
+static const char shared_name[] = "shared";
+
+#endif /* tests/filesys/extended/syn-stress.h */
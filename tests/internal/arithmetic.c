@@ -0,0 +1,161 @@
+/* Test program and benchmark for lib/arithmetic.c.
+
+   Divides random and edge-case 64-bit values, signed and
+   unsigned, with divisors that do and do not fit in 32 bits, and
+   checks every quotient and remainder against a slow bit-at-a-
+   time long division.  Then times both.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/test.h"
+#include "threads/tsc.h"
+
+/* Random divisions checked. */
+#define OP_CNT 65536
+
+/* Divisions timed. */
+#define BENCH_DIVS 4096
+
+static uint64_t random_u64 (void);
+static uint64_t slow_udiv (uint64_t n, uint64_t d, uint64_t *r);
+static void check (uint64_t n, uint64_t d);
+static void bench (void);
+
+/* Values around the places where the division changes method. */
+static const uint64_t edges[] =
+  {
+    0, 1, 2, 3, 10,
+    0x7fffffff, 0x80000000, 0xffffffff,
+    0x100000000ULL, 0x100000001ULL, 0x1ffffffffULL,
+    0xffffffff00000000ULL, 0x7fffffffffffffffULL,
+    0x8000000000000000ULL, 0xfffffffffffffffeULL, 0xffffffffffffffffULL,
+  };
+
+/* Test the 64-bit division routines. */
+void
+test (void)
+{
+  size_t i, j;
+  int op;
+
+  printf ("testing edge cases...");
+  for (i = 0; i < sizeof edges / sizeof *edges; i++)
+    for (j = 0; j < sizeof edges / sizeof *edges; j++)
+      if (edges[j] != 0)
+        check (edges[i], edges[j]);
+  printf (" done\n");
+
+  printf ("testing random values...");
+  for (op = 0; op < OP_CNT; op++)
+    {
+      uint64_t n = random_u64 ();
+      uint64_t d = random_u64 ();
+
+      /* Half the divisors fit in 32 bits, the common case. */
+      if (op % 2)
+        d = (uint32_t) d;
+      if (d != 0)
+        check (n, d);
+    }
+  printf (" done\n");
+
+  bench ();
+  printf ("arithmetic: PASS\n");
+}
+
+/* Returns a random 64-bit value with a random number of
+   significant bits, so that small and large values are about
+   equally likely. */
+static uint64_t
+random_u64 (void)
+{
+  uint64_t x = (uint64_t) random_ulong () << 32 | random_ulong ();
+  return x >> random_ulong () % 64;
+}
+
+/* Divides N by D one bit at a time, the reference the routines
+   under test are checked against.  Returns the quotient and
+   stores the remainder in *R. */
+static uint64_t
+slow_udiv (uint64_t n, uint64_t d, uint64_t *r)
+{
+  uint64_t q = 0, rem = 0;
+  int bit;
+
+  for (bit = 63; bit >= 0; bit--)
+    {
+      /* REM < D, so a carry out of the shift means REM >= D. */
+      bool carry = rem >> 63;
+      rem = rem << 1 | ((n >> bit) & 1);
+      if (carry || rem >= d)
+        {
+          rem -= d;
+          q |= (uint64_t) 1 << bit;
+        }
+    }
+  *r = rem;
+  return q;
+}
+
+/* Checks unsigned and signed division and remainder of N by D
+   against slow_udiv(). */
+static void
+check (uint64_t n, uint64_t d)
+{
+  int64_t sn = n, sd = d;
+  uint64_t q, r, n_abs, d_abs;
+
+  q = slow_udiv (n, d, &r);
+  ASSERT (n / d == q);
+  ASSERT (n % d == r);
+
+  /* INT64_MIN / -1 overflows. */
+  if (sn == INT64_MIN && sd == -1)
+    return;
+  n_abs = sn < 0 ? -n : n;
+  d_abs = sd < 0 ? -d : d;
+  q = slow_udiv (n_abs, d_abs, &r);
+  ASSERT ((uint64_t) (sn / sd) == ((sn < 0) != (sd < 0) ? -q : q));
+  ASSERT ((uint64_t) (sn % sd) == (sn < 0 ? -r : r));
+}
+
+/* Prints the average cycles for unsigned division by 32-bit and
+   64-bit divisors, and for the bit-at-a-time reference. */
+static void
+bench (void)
+{
+  static uint64_t n[BENCH_DIVS], d[BENCH_DIVS];
+  uint64_t start, sum = 0, r;
+  int i;
+
+  for (i = 0; i < BENCH_DIVS; i++)
+    {
+      n[i] = (uint64_t) random_ulong () << 32 | random_ulong ();
+      d[i] = random_ulong () | 1;
+    }
+  start = rdtsc ();
+  for (i = 0; i < BENCH_DIVS; i++)
+    sum += n[i] / d[i];
+  printf ("32-bit divisors %llu", (rdtsc () - start) / BENCH_DIVS);
+
+  for (i = 0; i < BENCH_DIVS; i++)
+    d[i] |= (uint64_t) (random_ulong () % 0xffff + 1) << 32;
+  start = rdtsc ();
+  for (i = 0; i < BENCH_DIVS; i++)
+    sum += n[i] / d[i];
+  printf (", 64-bit divisors %llu", (rdtsc () - start) / BENCH_DIVS);
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_DIVS; i++)
+    sum += slow_udiv (n[i], d[i], &r);
+  printf (", bit at a time %llu cycles (%u)\n",
+          (rdtsc () - start) / BENCH_DIVS, (unsigned) sum & 1);
+}
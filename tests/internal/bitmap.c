@@ -0,0 +1,158 @@
+/* Test program and benchmark for lib/kernel/bitmap.c.
+
+   Checks bitmap_count(), bitmap_contains(), bitmap_scan(),
+   bitmap_scan_longest() and bitmap_next_set() against a bit at a
+   time over random bitmaps, then times scans of a 1M-bit bitmap
+   at various fill levels.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+#include "threads/tsc.h"
+
+/* Largest bitmap checked bit by bit. */
+#define MAX_BITS 300
+
+/* Bits in the benchmark's bitmap. */
+#define BENCH_BITS (1024 * 1024)
+
+/* Scans timed at each fill level. */
+#define BENCH_SCANS 64
+
+static void fill (struct bitmap *, unsigned percent);
+static void verify (const struct bitmap *, size_t start, size_t cnt,
+                    bool value);
+static void bench (struct bitmap *, unsigned percent);
+
+/* Test and time the bitmap implementation. */
+void
+test (void) 
+{
+  static const unsigned percents[] = {0, 50, 90, 99, 100};
+  struct bitmap *b;
+  size_t bit_cnt;
+  size_t i;
+
+  printf ("testing various size bitmaps:");
+  for (bit_cnt = 1; bit_cnt <= MAX_BITS; bit_cnt = bit_cnt * 5 / 4 + 1)
+    {
+      int repeat;
+
+      printf (" %zu", bit_cnt);
+      b = bitmap_create (bit_cnt);
+      ASSERT (b != NULL);
+      for (repeat = 0; repeat < 50; repeat++)
+        {
+          size_t start = random_ulong () % (bit_cnt + 1);
+          size_t cnt = random_ulong () % (bit_cnt - start + 1);
+
+          fill (b, random_ulong () % 101);
+          if (repeat % 5 == 0)
+            bitmap_set_multiple (b, start, cnt, repeat % 2);
+          verify (b, start, cnt, repeat % 3 != 0);
+        }
+      bitmap_destroy (b);
+    }
+  printf (" done\n");
+
+  b = bitmap_create (BENCH_BITS);
+  ASSERT (b != NULL);
+  for (i = 0; i < sizeof percents / sizeof *percents; i++)
+    bench (b, percents[i]);
+  bitmap_destroy (b);
+  printf ("bitmap: PASS\n");
+}
+
+/* Sets each bit of B to true with probability PERCENT / 100. */
+static void
+fill (struct bitmap *b, unsigned percent)
+{
+  size_t i;
+
+  for (i = 0; i < bitmap_size (b); i++)
+    bitmap_set (b, i, random_ulong () % 100 < percent);
+}
+
+/* Checks the bitmap functions on the CNT bits of B starting at
+   START against a bit at a time. */
+static void
+verify (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t bit_cnt = bitmap_size (b);
+  size_t value_cnt = 0, first = BITMAP_ERROR, best = BITMAP_ERROR;
+  size_t best_cnt = 0, want = cnt > 0 ? cnt : 1, got;
+  size_t i, j;
+
+  for (i = start; i < start + cnt; i++)
+    if (bitmap_test (b, i) == value)
+      value_cnt++;
+  ASSERT (bitmap_count (b, start, cnt, value) == value_cnt);
+  ASSERT (bitmap_contains (b, start, cnt, value) == (value_cnt > 0));
+
+  for (i = start; i + cnt <= bit_cnt && first == BITMAP_ERROR; i++)
+    {
+      for (j = i; j < i + cnt && bitmap_test (b, j) == value; j++)
+        continue;
+      if (j == i + cnt)
+        first = i;
+    }
+  ASSERT (bitmap_scan (b, start, cnt, value) == first);
+
+  for (i = start; i < bit_cnt && best_cnt < want; i = j > i ? j : i + 1)
+    {
+      for (j = i; j < bit_cnt && j - i < want && bitmap_test (b, j) == value;
+           j++)
+        continue;
+      if (j - i > best_cnt)
+        {
+          best = i;
+          best_cnt = j - i;
+        }
+    }
+  got = want;
+  ASSERT (bitmap_scan_longest (b, start, value, &got) == best);
+  ASSERT (got == best_cnt);
+
+  for (i = start; i < bit_cnt && !bitmap_test (b, i); i++)
+    continue;
+  ASSERT (bitmap_next_set (b, start) == (i < bit_cnt ? i : BITMAP_ERROR));
+}
+
+/* Fills B to PERCENT and prints the cycles an average scan takes
+   for free runs of a few lengths, counting, and iterating over
+   the bits set. */
+static void
+bench (struct bitmap *b, unsigned percent)
+{
+  static const size_t cnts[] = {1, 8, 64};
+  uint64_t start;
+  size_t i, k;
+
+  fill (b, percent);
+  printf ("%3u%% full:", percent);
+  for (k = 0; k < sizeof cnts / sizeof *cnts; k++)
+    {
+      start = rdtsc ();
+      for (i = 0; i < BENCH_SCANS; i++)
+        bitmap_scan (b, random_ulong () % BENCH_BITS, cnts[k], false);
+      printf (" scan(%zu) %llu", cnts[k],
+              (rdtsc () - start) / BENCH_SCANS);
+    }
+
+  start = rdtsc ();
+  bitmap_count (b, 0, BENCH_BITS, true);
+  printf (", count %llu", rdtsc () - start);
+
+  start = rdtsc ();
+  for (i = bitmap_next_set (b, 0); i != BITMAP_ERROR;
+       i = bitmap_next_set (b, i + 1))
+    continue;
+  printf (", iterate %llu cycles\n", rdtsc () - start);
+}
@@ -0,0 +1,88 @@
+/* Test program and benchmark for lib/kernel/crc32c.c.
+
+   Checks the standard check value, then checksums random buffers
+   of random lengths and alignments, whole and in two pieces, with
+   crc32c() and crc32c_sw() and checks that they agree.  Then
+   times both.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <crc32c.h>
+#include <debug.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/test.h"
+#include "threads/tsc.h"
+
+/* Size of the random buffer. */
+#define BUF_SIZE 4096
+
+/* Random checksums compared. */
+#define OP_CNT 4096
+
+/* Times each sector-sized checksum is timed. */
+#define BENCH_CNT 1024
+
+static uint8_t buf[BUF_SIZE];
+
+static void bench (void);
+
+/* Test the CRC-32C routines. */
+void
+test (void)
+{
+  int op;
+  size_t i;
+
+  ASSERT (crc32c (0, "123456789", 9) == 0xe3069283);
+  ASSERT (crc32c_sw (0, "123456789", 9) == 0xe3069283);
+  ASSERT (crc32c (0, "", 0) == 0);
+
+  for (i = 0; i < BUF_SIZE; i++)
+    buf[i] = random_ulong ();
+
+  printf ("testing random buffers...");
+  for (op = 0; op < OP_CNT; op++)
+    {
+      size_t ofs = random_ulong () % BUF_SIZE;
+      size_t size = random_ulong () % (BUF_SIZE - ofs + 1);
+      size_t split = size > 0 ? random_ulong () % size : 0;
+      uint32_t crc = crc32c_sw (0, buf + ofs, size);
+
+      ASSERT (crc32c (0, buf + ofs, size) == crc);
+      ASSERT (crc32c (crc32c (0, buf + ofs, split),
+                      buf + ofs + split, size - split) == crc);
+      ASSERT (crc32c_sw (crc32c_sw (0, buf + ofs, split),
+                         buf + ofs + split, size - split) == crc);
+    }
+  printf (" done\n");
+
+  bench ();
+  printf ("crc32c: PASS\n");
+}
+
+/* Prints the average cycles to checksum a 512-byte sector with
+   crc32c() and with crc32c_sw(). */
+static void
+bench (void)
+{
+  uint64_t start;
+  uint32_t sum = 0;
+  int i;
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    sum += crc32c (sum, buf, 512);
+  printf ("crc32c%s %llu", crc32c_hw () ? " (crc32 instruction)" : "",
+          (rdtsc () - start) / BENCH_CNT);
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_CNT; i++)
+    sum += crc32c_sw (sum, buf, 512);
+  printf (", slice-by-8 %llu cycles per sector (%u)\n",
+          (rdtsc () - start) / BENCH_CNT, (unsigned) sum & 1);
+}
@@ -0,0 +1,164 @@
+/* Test program and benchmark for lib/kernel/hash.c.
+
+   Inserts, deletes and finds random keys, growing the table to
+   thousands of elements and shrinking it again, and checks
+   every result, the size, iteration and hash_apply() against an
+   array that records which keys are in the table, including
+   while the table is part way through a resize.  Then prints the
+   slowest single insertion into a growing table, which resizing
+   a few buckets at a time keeps short.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <hash.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+#include "threads/tsc.h"
+
+/* Number of distinct keys. */
+#define KEY_CNT 8192
+
+/* Random operations performed. */
+#define OP_CNT (KEY_CNT * 64)
+
+/* A hash table element. */
+struct value
+  {
+    struct hash_elem elem;      /* Hash element. */
+    int key;                    /* Key. */
+    bool present;               /* In the table? */
+  };
+
+static struct value values[KEY_CNT];
+static size_t applied;
+
+static hash_hash_func value_hash;
+static hash_less_func value_less;
+static void verify (struct hash *, size_t cnt);
+static void bench (size_t presize);
+
+/* Test and time the hash table implementation. */
+void
+test (void)
+{
+  struct hash h;
+  size_t cnt = 0;
+  int op;
+
+  printf ("testing random operations...");
+  ASSERT (hash_init (&h, value_hash, value_less, NULL));
+  for (op = 0; op < KEY_CNT; op++)
+    values[op].key = op;
+  for (op = 0; op < OP_CNT; op++)
+    {
+      /* Mostly insert for a while, then mostly delete. */
+      bool growing = op / (KEY_CNT * 4) % 2 == 0;
+      struct value *v = &values[random_ulong () % KEY_CNT];
+      struct value key;
+      unsigned r = random_ulong () % 10;
+
+      key.key = v->key;
+      if (r < (growing ? 6 : 2))
+        {
+          ASSERT ((hash_insert (&h, &v->elem) == NULL) == !v->present);
+          if (!v->present)
+            cnt++;
+          v->present = true;
+        }
+      else if (r < 8)
+        {
+          ASSERT (hash_delete (&h, &key.elem)
+                  == (v->present ? &v->elem : NULL));
+          if (v->present)
+            cnt--;
+          v->present = false;
+        }
+      else
+        ASSERT (hash_find (&h, &key.elem) == (v->present ? &v->elem : NULL));
+      ASSERT (hash_size (&h) == cnt);
+      if (op % 251 == 0)
+        verify (&h, cnt);
+    }
+  hash_destroy (&h, NULL);
+  printf (" done\n");
+
+  bench (0);
+  bench (KEY_CNT);
+  printf ("hash: PASS\n");
+}
+
+/* Returns a hash of value E's key. */
+static unsigned
+value_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct value, elem)->key);
+}
+
+/* Returns true if value A's key is less than value B's. */
+static bool
+value_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct value, elem)->key
+          < hash_entry (b, struct value, elem)->key);
+}
+
+/* Checks that E is a value in the table, and counts it. */
+static void
+count_present (struct hash_elem *e, void *aux UNUSED)
+{
+  ASSERT (hash_entry (e, struct value, elem)->present);
+  applied++;
+}
+
+/* Checks that iterating over H and hash_apply() each visit the
+   CNT values present exactly. */
+static void
+verify (struct hash *h, size_t cnt)
+{
+  struct hash_iterator i;
+  size_t visited = 0;
+
+  hash_first (&i, h);
+  while (hash_next (&i))
+    {
+      ASSERT (hash_entry (hash_cur (&i), struct value, elem)->present);
+      visited++;
+    }
+  ASSERT (visited == cnt);
+
+  applied = 0;
+  hash_apply (h, count_present);
+  ASSERT (applied == cnt);
+}
+
+/* Inserts every key into a table pre-sized for PRESIZE elements
+   and prints the average and slowest insertion, in cycles. */
+static void
+bench (size_t presize)
+{
+  uint64_t total, worst = 0;
+  struct hash h;
+  int k;
+
+  ASSERT (hash_init_size (&h, presize, value_hash, value_less, NULL));
+  total = rdtsc ();
+  for (k = 0; k < KEY_CNT; k++)
+    {
+      uint64_t start = rdtsc (), cycles;
+
+      hash_insert (&h, &values[k].elem);
+      cycles = rdtsc () - start;
+      if (cycles > worst)
+        worst = cycles;
+    }
+  total = rdtsc () - total;
+  printf ("%d inserts, pre-sized for %zu: average %llu, worst %llu cycles\n",
+          KEY_CNT, presize, total / KEY_CNT, worst);
+  hash_destroy (&h, NULL);
+}
@@ -0,0 +1,175 @@
+/* Test program and benchmark for lib/kernel/intmap.c.
+
+   Inserts, removes and finds random keys, growing the map to
+   thousands of entries and shrinking it again, and checks every
+   result against an array that records which keys are in it.
+   Then times hash_int() against hash_mix(), and lookups that hit
+   and miss in struct hash and struct intmap tables of the same
+   integer keys.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <hash.h>
+#include <intmap.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+#include "threads/tsc.h"
+
+/* Number of distinct keys. */
+#define KEY_CNT 8192
+
+/* Random operations performed. */
+#define OP_CNT (KEY_CNT * 64)
+
+/* Lookups timed. */
+#define BENCH_LOOKUPS 65536
+
+/* A value, in a struct hash by KEY and in a struct intmap. */
+struct value
+  {
+    struct hash_elem elem;      /* Hash element. */
+    uint32_t key;               /* Key. */
+    bool present;               /* In the map? */
+  };
+
+static struct value values[KEY_CNT];
+
+static hash_hash_func value_hash;
+static hash_less_func value_less;
+static void bench (void);
+
+/* Keys look like page addresses, a common kind of integer key
+   with all the low bits clear. */
+static uint32_t
+key_of (int i)
+{
+  return (uint32_t) i << 12;
+}
+
+/* Test and time the integer map implementation. */
+void
+test (void)
+{
+  struct intmap m;
+  size_t cnt = 0;
+  int op;
+
+  printf ("testing random operations...");
+  ASSERT (intmap_init (&m, 0));
+  for (op = 0; op < KEY_CNT; op++)
+    values[op].key = key_of (op);
+  for (op = 0; op < OP_CNT; op++)
+    {
+      /* Mostly insert for a while, then mostly remove. */
+      bool growing = op / (KEY_CNT * 4) % 2 == 0;
+      struct value *v = &values[random_ulong () % KEY_CNT];
+      unsigned r = random_ulong () % 10;
+
+      if (r < (growing ? 6 : 2))
+        {
+          if (!v->present)
+            {
+              ASSERT (intmap_insert (&m, v->key, v));
+              v->present = true;
+              cnt++;
+            }
+        }
+      else if (r < 8)
+        {
+          ASSERT (intmap_remove (&m, v->key) == (v->present ? v : NULL));
+          if (v->present)
+            cnt--;
+          v->present = false;
+        }
+      else
+        ASSERT (intmap_find (&m, v->key) == (v->present ? v : NULL));
+      ASSERT (intmap_size (&m) == cnt);
+    }
+  intmap_destroy (&m);
+  printf (" done\n");
+
+  bench ();
+  printf ("intmap: PASS\n");
+}
+
+/* Returns a hash of value E's key. */
+static unsigned
+value_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct value, elem)->key);
+}
+
+/* Returns true if value A's key is less than value B's. */
+static bool
+value_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct value, elem)->key
+          < hash_entry (b, struct value, elem)->key);
+}
+
+/* Puts every value in a struct hash and a struct intmap and
+   prints the average cycles for hashing a key and for lookups
+   that hit and miss in each. */
+static void
+bench (void)
+{
+  struct hash h;
+  struct intmap m;
+  struct value key;
+  uint64_t start;
+  unsigned sum = 0;
+  int i;
+
+  ASSERT (hash_init (&h, value_hash, value_less, NULL));
+  ASSERT (intmap_init (&m, KEY_CNT));
+  for (i = 0; i < KEY_CNT; i++)
+    {
+      hash_insert (&h, &values[i].elem);
+      ASSERT (intmap_insert (&m, values[i].key, &values[i]));
+    }
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_LOOKUPS; i++)
+    sum += hash_int (i);
+  printf ("hash_int %llu", (rdtsc () - start) / BENCH_LOOKUPS);
+  start = rdtsc ();
+  for (i = 0; i < BENCH_LOOKUPS; i++)
+    sum += hash_mix (i);
+  printf (", hash_mix %llu cycles\n", (rdtsc () - start) / BENCH_LOOKUPS);
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+      key.key = key_of (random_ulong () % KEY_CNT);
+      ASSERT (hash_find (&h, &key.elem) != NULL);
+    }
+  printf ("%d keys: hash hit %llu", KEY_CNT,
+          (rdtsc () - start) / BENCH_LOOKUPS);
+  start = rdtsc ();
+  for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+      key.key = key_of (KEY_CNT + random_ulong () % KEY_CNT);
+      ASSERT (hash_find (&h, &key.elem) == NULL);
+    }
+  printf (", miss %llu", (rdtsc () - start) / BENCH_LOOKUPS);
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_LOOKUPS; i++)
+    ASSERT (intmap_find (&m, key_of (random_ulong () % KEY_CNT)) != NULL);
+  printf ("; intmap hit %llu", (rdtsc () - start) / BENCH_LOOKUPS);
+  start = rdtsc ();
+  for (i = 0; i < BENCH_LOOKUPS; i++)
+    ASSERT (intmap_find (&m, key_of (KEY_CNT + random_ulong () % KEY_CNT))
+            == NULL);
+  printf (", miss %llu cycles (%u)\n", (rdtsc () - start) / BENCH_LOOKUPS,
+          sum & 1);
+
+  hash_destroy (&h, NULL);
+  intmap_destroy (&m);
+}
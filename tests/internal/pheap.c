@@ -0,0 +1,137 @@
+/* Test program for lib/kernel/pheap.c.
+
+   Pushes, pops, removes and increases random values in heaps of
+   various sizes, and checks the size and that the top is always
+   the maximum of an array holding the same values.  Then pops
+   everything left, checking that it comes out in order.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <limits.h>
+#include <pheap.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a heap that we will test. */
+#define MAX_SIZE 256
+
+/* A heap element. */
+struct value
+  {
+    struct pheap_elem elem;     /* Heap element. */
+    int value;                  /* Item value. */
+  };
+
+static bool value_less (const struct pheap_elem *,
+                        const struct pheap_elem *, void *);
+static size_t max_of (struct value *in[], size_t cnt);
+
+/* Test the pairing heap implementation. */
+void
+test (void)
+{
+  int size;
+
+  printf ("testing various size heaps:");
+  for (size = 1; size <= MAX_SIZE; size *= 2)
+    {
+      static struct value values[MAX_SIZE];
+      struct value *in[MAX_SIZE];
+      struct pheap heap;
+      size_t cnt = 0, i;
+      int op, last;
+
+      printf (" %d", size);
+      pheap_init (&heap, value_less, NULL);
+      for (i = 0; i < (size_t) size; i++)
+        in[i] = &values[i];
+      for (op = 0; op < size * 8; op++)
+        {
+          unsigned r = random_ulong () % 4;
+
+          if (cnt == 0 || (cnt < (size_t) size && r == 0))
+            {
+              /* IN[CNT...] are the values not in the heap. */
+              in[cnt]->value = random_ulong () % size;
+              pheap_push (&heap, &in[cnt]->elem);
+              cnt++;
+            }
+          else if (r == 1)
+            {
+              struct value *v;
+
+              i = max_of (in, cnt);
+              v = pheap_entry (pheap_pop (&heap), struct value, elem);
+              ASSERT (v->value == in[i]->value);
+              i = 0;
+              while (in[i] != v)
+                i++;
+              in[i] = in[cnt - 1];
+              in[--cnt] = v;
+            }
+          else if (r == 2)
+            {
+              struct value *v;
+
+              i = random_ulong () % cnt;
+              v = in[i];
+              pheap_remove (&heap, &v->elem);
+              in[i] = in[cnt - 1];
+              in[--cnt] = v;
+            }
+          else
+            {
+              i = random_ulong () % cnt;
+              in[i]->value += random_ulong () % size;
+              pheap_increase (&heap, &in[i]->elem);
+            }
+
+          ASSERT (pheap_size (&heap) == cnt);
+          ASSERT (pheap_empty (&heap) == (cnt == 0));
+          ASSERT (cnt == 0
+                  || (pheap_entry (pheap_top (&heap), struct value, elem)->value
+                      == in[max_of (in, cnt)]->value));
+        }
+
+      for (last = INT_MAX; cnt > 0; cnt--)
+        {
+          struct value *v = pheap_entry (pheap_pop (&heap), struct value,
+                                         elem);
+          ASSERT (v->value <= last);
+          last = v->value;
+        }
+      ASSERT (pheap_empty (&heap));
+    }
+  printf (" done\n");
+  printf ("pheap: PASS\n");
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct pheap_elem *a_, const struct pheap_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = pheap_entry (a_, struct value, elem);
+  const struct value *b = pheap_entry (b_, struct value, elem);
+
+  return a->value < b->value;
+}
+
+/* Returns the index of the greatest of the CNT values in IN,
+   which must not be empty. */
+static size_t
+max_of (struct value *in[], size_t cnt)
+{
+  size_t max = 0, i;
+
+  for (i = 1; i < cnt; i++)
+    if (in[i]->value > in[max]->value)
+      max = i;
+  return max;
+}
@@ -0,0 +1,172 @@
+/* Test program for lib/kernel/rbtree.c.
+
+   Inserts and removes random values, with many duplicates, in
+   trees of various sizes, and after each change checks the
+   red-black properties, the parent links and the order of the
+   elements, lower and upper bounds, and walks in both
+   directions against a sorted array.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <rbtree.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a tree that we will test. */
+#define MAX_SIZE 256
+
+/* A tree element. */
+struct value
+  {
+    struct rb_node node;        /* Tree node. */
+    int value;                  /* Item value. */
+    int seq;                    /* Order of insertion. */
+  };
+
+static bool value_less (const struct rb_node *, const struct rb_node *,
+                        void *);
+static int check_node (const struct rb_node *);
+static void verify (struct rbtree *, struct value *in[], size_t cnt);
+
+/* Test the red-black tree implementation. */
+void
+test (void)
+{
+  int size;
+
+  printf ("testing various size trees:");
+  for (size = 1; size <= MAX_SIZE; size *= 2)
+    {
+      static struct value values[MAX_SIZE];
+      struct value *in[MAX_SIZE];
+      struct rbtree tree;
+      size_t cnt = 0;
+      int seq = 0;
+      int op;
+
+      printf (" %d", size);
+      rb_init (&tree, value_less, NULL);
+      for (op = 0; op < size * 8; op++)
+        {
+          /* Insert until full, then mostly alternate. */
+          if (cnt == 0 || (cnt < (size_t) size && random_ulong () % 3 != 0))
+            {
+              struct value *v;
+              size_t i, j;
+
+              /* Find a free value, fill it with a value that is
+                 likely to be a duplicate, and insert it. */
+              for (i = 0; ; i++)
+                {
+                  for (j = 0; j < cnt; j++)
+                    if (in[j] == &values[i])
+                      break;
+                  if (j == cnt)
+                    break;
+                }
+              v = &values[i];
+              v->value = random_ulong () % (size / 2 + 1);
+              v->seq = seq++;
+              rb_insert (&tree, &v->node);
+
+              /* Keep IN sorted by value, then by insertion. */
+              for (j = cnt; j > 0 && in[j - 1]->value > v->value; j--)
+                in[j] = in[j - 1];
+              in[j] = v;
+              cnt++;
+            }
+          else
+            {
+              size_t i = random_ulong () % cnt;
+
+              rb_remove (&tree, &in[i]->node);
+              for (; i + 1 < cnt; i++)
+                in[i] = in[i + 1];
+              cnt--;
+            }
+          verify (&tree, in, cnt);
+        }
+    }
+  printf (" done\n");
+  printf ("rbtree: PASS\n");
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct rb_node *a_, const struct rb_node *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = rb_entry (a_, struct value, node);
+  const struct value *b = rb_entry (b_, struct value, node);
+
+  return a->value < b->value;
+}
+
+/* Checks the red-black properties and parent links of the
+   subtree rooted at N, and returns its black height. */
+static int
+check_node (const struct rb_node *n)
+{
+  int left, right;
+
+  if (n == NULL)
+    return 1;
+  ASSERT (n->left == NULL || n->left->parent == n);
+  ASSERT (n->right == NULL || n->right->parent == n);
+  ASSERT (!n->red || ((n->left == NULL || !n->left->red)
+                      && (n->right == NULL || !n->right->red)));
+
+  left = check_node (n->left);
+  right = check_node (n->right);
+  ASSERT (left == right);
+  return left + !n->red;
+}
+
+/* Checks that TREE is a valid red-black tree holding the CNT
+   values in IN, in the same order. */
+static void
+verify (struct rbtree *tree, struct value *in[], size_t cnt)
+{
+  struct rb_node *n;
+  struct value key;
+  size_t i, j;
+
+  ASSERT (tree->root == NULL || (!tree->root->red
+                                 && tree->root->parent == NULL));
+  check_node (tree->root);
+  ASSERT (rb_size (tree) == cnt);
+  ASSERT (rb_empty (tree) == (cnt == 0));
+
+  /* Forward and backward, equal values in insertion order. */
+  for (i = 0, n = rb_first (tree); i < cnt; i++, n = rb_next (n))
+    {
+      ASSERT (n == &in[i]->node);
+      ASSERT (i == 0 || in[i - 1]->value < in[i]->value
+              || in[i - 1]->seq < in[i]->seq);
+    }
+  ASSERT (n == NULL);
+  for (i = cnt, n = rb_last (tree); i > 0; i--, n = rb_prev (n))
+    ASSERT (n == &in[i - 1]->node);
+  ASSERT (n == NULL);
+
+  /* Bounds and lookups, for every value that could be in the
+     tree and one past each end. */
+  for (key.value = -1; key.value <= MAX_SIZE / 2 + 1; key.value++)
+    {
+      for (i = 0; i < cnt && in[i]->value < key.value; i++)
+        continue;
+      for (j = i; j < cnt && in[j]->value == key.value; j++)
+        continue;
+      ASSERT (rb_lower_bound (tree, &key.node)
+              == (i < cnt ? &in[i]->node : NULL));
+      ASSERT (rb_upper_bound (tree, &key.node)
+              == (j < cnt ? &in[j]->node : NULL));
+      ASSERT (rb_find (tree, &key.node) == (j > i ? &in[i]->node : NULL));
+    }
+}
@@ -0,0 +1,69 @@
+/* Test program for lib/kernel/spsc.c.
+
+   Pushes and pops random amounts through a small ring, so that
+   the bytes wrap around its end in every way, and checks that
+   they come out in order, that the ring takes exactly as much as
+   it has room for, and that its count is right throughout.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <spsc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Ring capacity. */
+#define CAPACITY 64
+
+/* Pushes and pops done. */
+#define OP_CNT 65536
+
+/* Test the ring. */
+void
+test (void)
+{
+  static uint8_t ring_buf[CAPACITY];
+  uint8_t buf[CAPACITY * 2];
+  struct spsc r;
+  uint8_t next_in = 0, next_out = 0;
+  size_t count = 0;
+  int op;
+
+  spsc_init (&r, ring_buf, sizeof ring_buf);
+  ASSERT (spsc_empty (&r));
+
+  printf ("testing random pushes and pops...");
+  for (op = 0; op < OP_CNT; op++)
+    {
+      size_t cnt = random_ulong () % (sizeof buf + 1);
+      size_t i, n;
+
+      if (random_ulong () % 2)
+        {
+          for (i = 0; i < cnt; i++)
+            buf[i] = next_in + i;
+          n = spsc_push (&r, buf, cnt);
+          ASSERT (n == (cnt < CAPACITY - count ? cnt : CAPACITY - count));
+          next_in += n;
+          count += n;
+        }
+      else
+        {
+          n = spsc_pop (&r, buf, cnt);
+          ASSERT (n == (cnt < count ? cnt : count));
+          for (i = 0; i < n; i++)
+            ASSERT (buf[i] == next_out++);
+          count -= n;
+        }
+      ASSERT (spsc_count (&r) == count);
+      ASSERT (spsc_empty (&r) == (count == 0));
+      ASSERT (spsc_full (&r) == (count == CAPACITY));
+    }
+  printf (" done\n");
+  printf ("spsc: PASS\n");
+}
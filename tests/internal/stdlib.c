@@ -1,7 +1,12 @@
-/* Test program for sorting and searching in lib/stdlib.c.
+/* Test program and benchmark for sorting and searching in
+   lib/stdlib.c.
 
    Attempts to test the sorting and searching functionality that
-   is not sufficiently tested elsewhere in Pintos.
+   is not sufficiently tested elsewhere in Pintos: random,
+   sorted, reversed and mostly equal arrays, elements that are
+   not a multiple of the word size, and radix_sort() order and
+   stability.  Then times qsort() and radix_sort() on ints and on
+   larger records.
 
    This is not a test we will run on your submitted projects.
    It is here for completeness.
@@ -11,17 +16,36 @@
 #include <debug.h>
 #include <limits.h>
 #include <random.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include "threads/test.h"
+#include "threads/tsc.h"
 
 /* Maximum number of elements in an array that we will test. */
 #define MAX_CNT 4096
 
+/* A record sorted by KEY. */
+struct record
+  {
+    uint32_t key;               /* Sort key. */
+    uint32_t seq;               /* Original position. */
+    char data[24];              /* Payload. */
+  };
+
+/* Elements of an odd size, sorted by their first byte. */
+#define ODD_SIZE 7
+
 static void shuffle (int[], size_t);
 static int compare_ints (const void *, const void *);
+static int compare_records (const void *, const void *);
+static int compare_bytes (const void *, const void *);
 static void verify_order (const int[], size_t);
 static void verify_bsearch (const int[], size_t);
+static void test_patterns (void);
+static void test_radix (void);
+static void bench (void);
 
 /* Test sorting and searching implementations. */
 void
@@ -53,9 +77,109 @@ test (void)
     }
   
   printf (" done\n");
+
+  test_patterns ();
+  test_radix ();
+  bench ();
   printf ("stdlib: PASS\n");
 }
 
+/* Sorts arrays that quicksort handles badly if done naively:
+   already sorted, reversed, a few distinct values, and
+   "organ pipe" order, plus elements whose size is not a multiple
+   of the word size. */
+static void
+test_patterns (void) 
+{
+  static int values[MAX_CNT];
+  static unsigned char bytes[MAX_CNT * ODD_SIZE];
+  int pattern, i;
+
+  printf ("testing sorted, reversed and repeated arrays...");
+  for (pattern = 0; pattern < 4; pattern++)
+    {
+      for (i = 0; i < MAX_CNT; i++)
+        values[i] = (pattern == 0 ? i
+                     : pattern == 1 ? MAX_CNT - i
+                     : pattern == 2 ? (int) (random_ulong () % 3)
+                     : i % 2 ? i : MAX_CNT - i);
+      qsort (values, MAX_CNT, sizeof *values, compare_ints);
+      for (i = 1; i < MAX_CNT; i++)
+        ASSERT (values[i - 1] <= values[i]);
+    }
+
+  for (i = 0; i < MAX_CNT; i++)
+    bytes[i * ODD_SIZE] = random_ulong () % 64;
+  qsort (bytes, MAX_CNT, ODD_SIZE, compare_bytes);
+  for (i = 1; i < MAX_CNT; i++)
+    ASSERT (bytes[(i - 1) * ODD_SIZE] <= bytes[i * ODD_SIZE]);
+  printf (" done\n");
+}
+
+/* Radix-sorts records with small and large keys, many of them
+   equal, and checks that equal keys kept their order. */
+static void
+test_radix (void) 
+{
+  static struct record records[MAX_CNT], scratch[MAX_CNT];
+  int cnt;
+
+  printf ("testing radix sort:");
+  for (cnt = 0; cnt < MAX_CNT; cnt = cnt * 4 / 3 + 1)
+    {
+      int i;
+
+      printf (" %d", cnt);
+      for (i = 0; i < cnt; i++)
+        {
+          records[i].key = random_ulong () % (i % 2 ? 256 : 1u << 30);
+          records[i].seq = i;
+        }
+      radix_sort (records, cnt, sizeof *records,
+                  offsetof (struct record, key), scratch);
+      for (i = 1; i < cnt; i++)
+        ASSERT (records[i - 1].key < records[i].key
+                || (records[i - 1].key == records[i].key
+                    && records[i - 1].seq < records[i].seq));
+    }
+  printf (" done\n");
+}
+
+/* Prints the average cycles per element for sorting random ints
+   and records with qsort() and radix_sort(). */
+static void
+bench (void) 
+{
+  static int values[MAX_CNT];
+  static struct record records[MAX_CNT], scratch[MAX_CNT];
+  uint64_t start;
+  int i;
+
+  for (i = 0; i < MAX_CNT; i++)
+    values[i] = random_ulong ();
+  start = rdtsc ();
+  qsort (values, MAX_CNT, sizeof *values, compare_ints);
+  printf ("%d ints: qsort %llu", MAX_CNT, (rdtsc () - start) / MAX_CNT);
+  for (i = 0; i < MAX_CNT; i++)
+    values[i] = random_ulong ();
+  start = rdtsc ();
+  radix_sort (values, MAX_CNT, sizeof *values, 0, scratch);
+  printf (", radix_sort %llu cycles each\n", (rdtsc () - start) / MAX_CNT);
+
+  for (i = 0; i < MAX_CNT; i++)
+    records[i].key = random_ulong ();
+  start = rdtsc ();
+  qsort (records, MAX_CNT, sizeof *records, compare_records);
+  printf ("%d %zu-byte records: qsort %llu", MAX_CNT, sizeof *records,
+          (rdtsc () - start) / MAX_CNT);
+  for (i = 0; i < MAX_CNT; i++)
+    records[i].key = random_ulong ();
+  start = rdtsc ();
+  radix_sort (records, MAX_CNT, sizeof *records,
+              offsetof (struct record, key), scratch);
+  printf (", radix_sort %llu cycles each\n", (rdtsc () - start) / MAX_CNT);
+}
+
 /* Shuffles the CNT elements in ARRAY into random order. */
 static void
 shuffle (int *array, size_t cnt) 
@@ -83,6 +207,26 @@ compare_ints (const void *a_, const void *b_)
   return *a < *b ? -1 : *a > *b;
 }
 
+/* Compares records *A and *B by key. */
+static int
+compare_records (const void *a_, const void *b_) 
+{
+  const struct record *a = a_;
+  const struct record *b = b_;
+
+  return a->key < b->key ? -1 : a->key > b->key;
+}
+
+/* Compares the first bytes of A and B. */
+static int
+compare_bytes (const void *a_, const void *b_) 
+{
+  const unsigned char *a = a_;
+  const unsigned char *b = b_;
+
+  return *a < *b ? -1 : *a > *b;
+}
+
 /* Verifies that ARRAY contains the CNT ints 0...CNT-1. */
 static void
 verify_order (const int *array, size_t cnt) 
@@ -0,0 +1,159 @@
+/* Test program and benchmark for memcpy(), memmove(), memset(),
+   memzero_page() and copy_page() in lib/string.c.
+
+   Checks each against a byte at a time for every small size and
+   alignment, including overlapping moves in both directions,
+   then times copies and sets of 8 bytes to 4 kB.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/test.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+/* Largest block checked byte by byte. */
+#define MAX_SIZE 80
+
+/* Bytes on either side of each block checked for overruns. */
+#define GUARD 8
+
+/* Copies timed at each size. */
+#define BENCH_REPS 256
+
+static uint8_t buf[GUARD + 2 * MAX_SIZE + 8 + GUARD];
+static uint8_t want[sizeof buf];
+
+static void randomize (void);
+static void check (void);
+static void bench (size_t size, uint8_t *dst, const uint8_t *src);
+
+/* Test and time the memory functions. */
+void
+test (void)
+{
+  uint8_t *dst, *src;
+  size_t size, i;
+  int s, d;
+
+  printf ("testing sizes up to %d in every alignment...", MAX_SIZE);
+  for (size = 0; size <= MAX_SIZE; size++)
+    for (s = 0; s < 4; s++)
+      for (d = 0; d < 4; d++)
+        {
+          /* memcpy() between disjoint blocks, and memset(). */
+          src = buf + GUARD + s;
+          dst = buf + GUARD + MAX_SIZE + 4 + d;
+          randomize ();
+          for (i = 0; i < size; i++)
+            want[dst - buf + i] = want[src - buf + i];
+          ASSERT (memcpy (dst, src, size) == dst);
+          check ();
+
+          randomize ();
+          for (i = 0; i < size; i++)
+            want[dst - buf + i] = 0xa5;
+          ASSERT (memset (dst, 0xa5, size) == dst);
+          check ();
+
+          /* memmove() between overlapping blocks, upward and
+             downward, by D + 1 bytes. */
+          src = buf + GUARD + s;
+          dst = src + d + 1;
+          randomize ();
+          for (i = size; i-- > 0; )
+            want[dst - buf + i] = want[src - buf + i];
+          ASSERT (memmove (dst, src, size) == dst);
+          check ();
+
+          randomize ();
+          for (i = 0; i < size; i++)
+            want[src - buf + i] = want[dst - buf + i];
+          ASSERT (memmove (src, dst, size) == src);
+          check ();
+        }
+  printf (" done\n");
+
+  dst = palloc_get_page (PAL_ASSERT);
+  src = palloc_get_page (PAL_ASSERT);
+  for (i = 0; i < PGSIZE; i++)
+    src[i] = random_ulong ();
+  copy_page (dst, src);
+  ASSERT (!memcmp (dst, src, PGSIZE));
+  memzero_page (dst);
+  for (i = 0; i < PGSIZE; i++)
+    ASSERT (dst[i] == 0);
+
+  for (size = 8; size <= PGSIZE; size *= 2)
+    bench (size, dst, src);
+  palloc_free_page (src);
+  palloc_free_page (dst);
+  printf ("string: PASS\n");
+}
+
+/* Fills BUF with random bytes and copies them to WANT. */
+static void
+randomize (void)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    want[i] = buf[i] = random_ulong ();
+}
+
+/* Checks that BUF matches WANT. */
+static void
+check (void)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    ASSERT (buf[i] == want[i]);
+}
+
+/* Prints the cycles that an average memcpy(), unaligned memcpy()
+   and memset() of SIZE bytes take between DST and SRC, and for
+   a page, copy_page() and memzero_page(). */
+static void
+bench (size_t size, uint8_t *dst, const uint8_t *src)
+{
+  uint64_t start;
+  int i;
+
+  printf ("%4zu bytes:", size);
+  start = rdtsc ();
+  for (i = 0; i < BENCH_REPS; i++)
+    memcpy (dst, src, size);
+  printf (" memcpy %llu", (rdtsc () - start) / BENCH_REPS);
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_REPS; i++)
+    memcpy (dst + 1, src + 2, size - 2);
+  printf (", unaligned %llu", (rdtsc () - start) / BENCH_REPS);
+
+  start = rdtsc ();
+  for (i = 0; i < BENCH_REPS; i++)
+    memset (dst, i, size);
+  printf (", memset %llu", (rdtsc () - start) / BENCH_REPS);
+
+  if (size == PGSIZE)
+    {
+      start = rdtsc ();
+      for (i = 0; i < BENCH_REPS; i++)
+        copy_page (dst, src);
+      printf (", copy_page %llu", (rdtsc () - start) / BENCH_REPS);
+
+      start = rdtsc ();
+      for (i = 0; i < BENCH_REPS; i++)
+        memzero_page (dst);
+      printf (", memzero_page %llu", (rdtsc () - start) / BENCH_REPS);
+    }
+  printf (" cycles\n");
+}
@@ -0,0 +1,64 @@
+/* Checks admission control for EDF threads: a thread is admitted
+   only while the reserved utilizations, runtime / deadline, add
+   up to at most 1, and the reservation is returned when the
+   thread exits. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func holder_thread;
+
+static struct semaphore release;
+static struct semaphore exited;
+
+/* Creates an EDF thread that keeps its reservation until
+   RELEASE is raised, and reports whether it was admitted. */
+static bool
+try_create (int64_t runtime, int64_t period, int64_t deadline)
+{
+  return thread_create_edf ("edf", runtime, period, deadline,
+                            holder_thread, NULL) != TID_ERROR;
+}
+
+void
+test_edf_admission (void)
+{
+  sema_init (&release, 0);
+  sema_init (&exited, 0);
+
+  msg ("runtime > deadline: %s.",
+       try_create (5, 10, 4) ? "admitted" : "rejected");
+  msg ("deadline > period: %s.",
+       try_create (2, 10, 20) ? "admitted" : "rejected");
+
+  msg ("5/10/10, total 0.5: %s.",
+       try_create (5, 10, 10) ? "admitted" : "rejected");
+  msg ("4/20/10, total 0.9: %s.",
+       try_create (4, 20, 10) ? "admitted" : "rejected");
+  msg ("2/10/10, total 1.1: %s.",
+       try_create (2, 10, 10) ? "admitted" : "rejected");
+  msg ("1/10/10, total 1.0: %s.",
+       try_create (1, 10, 10) ? "admitted" : "rejected");
+
+  sema_up (&release);
+  sema_up (&release);
+  sema_up (&release);
+  sema_down (&exited);
+  sema_down (&exited);
+  sema_down (&exited);
+
+  msg ("10/10/10 after the others exit: %s.",
+       try_create (10, 10, 10) ? "admitted" : "rejected");
+  sema_up (&release);
+  sema_down (&exited);
+}
+
+static void
+holder_thread (void *aux UNUSED)
+{
+  sema_down (&release);
+  sema_up (&exited);
+}
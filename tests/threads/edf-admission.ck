@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-admission) begin
+(edf-admission) runtime > deadline: rejected.
+(edf-admission) deadline > period: rejected.
+(edf-admission) 5/10/10, total 0.5: admitted.
+(edf-admission) 4/20/10, total 0.9: admitted.
+(edf-admission) 2/10/10, total 1.1: rejected.
+(edf-admission) 1/10/10, total 1.0: admitted.
+(edf-admission) 10/10/10 after the others exit: admitted.
+(edf-admission) end
+EOF
+pass;
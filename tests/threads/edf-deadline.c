@@ -0,0 +1,99 @@
+/* Runs two periodic EDF threads alongside three normal-class
+   threads that spin for the whole test.  Each EDF job spins for
+   less than its budget; because EDF threads always preempt the
+   normal class and run in deadline order, every job must finish
+   before its deadline despite the background load. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define BACKGROUND_CNT 3
+
+struct edf_job
+  {
+    const char *name;
+    int64_t runtime, period, deadline;
+    int64_t work;               /* Ticks to spin in each period. */
+    int periods;                /* Number of periods to run. */
+    unsigned misses;            /* Deadlines missed. */
+    struct semaphore done;
+  };
+
+static volatile bool stop;
+
+static thread_func edf_thread;
+static thread_func background_thread;
+
+void
+test_edf_deadline (void)
+{
+  struct edf_job jobs[2] =
+    {
+      {.name = "edf-a", .runtime = 3, .period = 10, .deadline = 10,
+       .work = 2, .periods = 20},
+      {.name = "edf-b", .runtime = 4, .period = 20, .deadline = 15,
+       .work = 3, .periods = 10},
+    };
+  struct semaphore background_done;
+  int i;
+
+  sema_init (&background_done, 0);
+  stop = false;
+  for (i = 0; i < BACKGROUND_CNT; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "background %d", i);
+      thread_create (name, PRI_DEFAULT, background_thread, &background_done);
+    }
+
+  for (i = 0; i < 2; i++)
+    {
+      sema_init (&jobs[i].done, 0);
+      if (thread_create_edf (jobs[i].name, jobs[i].runtime, jobs[i].period,
+                             jobs[i].deadline, edf_thread, &jobs[i])
+          == TID_ERROR)
+        fail ("%s not admitted", jobs[i].name);
+    }
+
+  for (i = 0; i < 2; i++)
+    {
+      sema_down (&jobs[i].done);
+      msg ("%s: %d periods, %u deadlines missed.",
+           jobs[i].name, jobs[i].periods, jobs[i].misses);
+    }
+
+  stop = true;
+  for (i = 0; i < BACKGROUND_CNT; i++)
+    sema_down (&background_done);
+}
+
+static void
+edf_thread (void *job_)
+{
+  struct edf_job *job = job_;
+  int i;
+
+  for (i = 0; i < job->periods; i++)
+    {
+      int64_t start = timer_ticks ();
+      while (timer_elapsed (start) < job->work)
+        continue;
+      thread_edf_wait ();
+    }
+  job->misses = thread_edf_misses ();
+  sema_up (&job->done);
+}
+
+static void
+background_thread (void *done_)
+{
+  struct semaphore *done = done_;
+
+  while (!stop)
+    continue;
+  sema_up (done);
+}
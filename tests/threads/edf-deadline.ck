@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-deadline) begin
+(edf-deadline) edf-a: 20 periods, 0 deadlines missed.
+(edf-deadline) edf-b: 10 periods, 0 deadlines missed.
+(edf-deadline) end
+EOF
+pass;
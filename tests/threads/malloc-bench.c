@@ -0,0 +1,101 @@
+/* Measures malloc() and free() throughput with 1, 8, and 64
+   threads, first with the per-thread magazines turned off, so
+   that every call takes its size class's lock, and then with
+   them on.  Each thread allocates a few blocks of mixed small
+   sizes and frees them again, over and over.  Reports the
+   average cycles per malloc()/free() pair.
+
+   The numbers depend on the machine, so the test only checks
+   that every allocation succeeded. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Log2 of malloc()/free() pairs per thread. */
+#define ITER_LOG 10
+
+/* Blocks each thread keeps live at once. */
+#define LIVE_CNT 4
+
+static thread_func bench_thread;
+static uint32_t run (int thread_log);
+
+static struct semaphore start;
+static struct semaphore done;
+static bool failed;
+
+void
+test_malloc_bench (void) 
+{
+  static const int thread_logs[] = {0, 3, 6};
+  size_t i;
+
+  sema_init (&start, 0);
+  sema_init (&done, 0);
+  failed = false;
+
+  for (i = 0; i < sizeof thread_logs / sizeof *thread_logs; i++)
+    {
+      uint32_t locked, cached;
+
+      malloc_use_magazines (false);
+      locked = run (thread_logs[i]);
+      malloc_use_magazines (true);
+      cached = run (thread_logs[i]);
+      msg ("%d threads: %"PRIu32" cycles per pair with locks, "
+           "%"PRIu32" with magazines",
+           1 << thread_logs[i], locked, cached);
+    }
+  if (failed)
+    fail ("malloc() returned a null pointer");
+  msg ("PASS");
+}
+
+/* Runs 2**THREAD_LOG threads at once and returns the average
+   cycles per malloc()/free() pair. */
+static uint32_t
+run (int thread_log) 
+{
+  int thread_cnt = 1 << thread_log;
+  uint64_t begin;
+  int i;
+
+  for (i = 0; i < thread_cnt; i++)
+    thread_create ("bench", PRI_DEFAULT, bench_thread, NULL);
+
+  /* Start them all together. */
+  begin = rdtsc ();
+  for (i = 0; i < thread_cnt; i++)
+    sema_up (&start);
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&done);
+  return (rdtsc () - begin) >> (thread_log + ITER_LOG);
+}
+
+static void
+bench_thread (void *aux UNUSED) 
+{
+  static const size_t sizes[] = {16, 24, 40, 64, 100, 200, 500, 1000};
+  void *live[LIVE_CNT] = {NULL};
+  int i;
+
+  sema_down (&start);
+  for (i = 0; i < 1 << ITER_LOG; i++)
+    {
+      int slot = i % LIVE_CNT;
+
+      free (live[slot]);
+      live[slot] = malloc (sizes[i % (sizeof sizes / sizeof *sizes)]);
+      if (live[slot] == NULL)
+        failed = true;
+    }
+  for (i = 0; i < LIVE_CNT; i++)
+    free (live[i]);
+  sema_up (&done);
+}
@@ -0,0 +1,81 @@
+/* Turns on the heap profiler, sampling every allocation, and
+   checks that ten blocks allocated from one call site show up in
+   its report as that site's live bytes, and that freeing some of
+   them takes them off. */
+
+#include <stdio.h>
+#include <string.h>
+#include <console.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+
+#define BLOCK_CNT 10
+#define BLOCK_SIZE 128
+
+static void hoard (void *blocks[], int cnt) __attribute__ ((noinline));
+static bool report_has (const char *line);
+
+void
+test_malloc_heap_profile (void) 
+{
+  void *blocks[BLOCK_CNT];
+  unsigned old_rate = malloc_sample_rate;
+  int i;
+
+  malloc_sample_rate = 1;
+  hoard (blocks, BLOCK_CNT);
+  malloc_sample_rate = old_rate;
+  if (!report_has ("Heap: 1280 bytes in 10 blocks from "))
+    fail ("allocations not reported");
+  msg ("allocations reported.");
+
+  for (i = 0; i < 4; i++)
+    free (blocks[i]);
+  if (!report_has ("Heap: 768 bytes in 6 blocks from "))
+    fail ("frees not reported");
+  msg ("frees reported.");
+
+  for (; i < BLOCK_CNT; i++)
+    free (blocks[i]);
+}
+
+/* Allocates CNT blocks into BLOCKS, all from the same call
+   site. */
+static void
+hoard (void *blocks[], int cnt) 
+{
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      blocks[i] = malloc (BLOCK_SIZE);
+      if (blocks[i] == NULL)
+        fail ("malloc failed");
+    }
+}
+
+/* Returns true if the heap profile has a line that starts with
+   LINE. */
+static bool
+report_has (const char *line) 
+{
+  static char buf[4096];
+  unsigned old_rate = malloc_sample_rate;
+  char *p;
+
+  /* The report prints only while sampling is on. */
+  malloc_sample_rate = 1;
+  console_capture_begin (buf, sizeof buf);
+  malloc_print_heap_profile ();
+  console_capture_end ();
+  malloc_sample_rate = old_rate;
+
+  for (p = buf; p != NULL && *p != '\0'; p = strchr (p, '\n'))
+    {
+      if (*p == '\n')
+        p++;
+      if (!memcmp (p, line, strlen (line)))
+        return true;
+    }
+  return false;
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-heap-profile) begin
+(malloc-heap-profile) allocations reported.
+(malloc-heap-profile) frees reported.
+(malloc-heap-profile) end
+EOF
+pass;
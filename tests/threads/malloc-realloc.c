@@ -0,0 +1,74 @@
+/* Checks that realloc() keeps a block in place when its size
+   class already fits the new size and when a big block shrinks,
+   and that growing a big block keeps its contents, whether or
+   not it could grow in place. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/vaddr.h"
+
+static void fill (uint8_t *, size_t size);
+static void check (const uint8_t *, size_t size);
+
+void
+test_malloc_realloc (void) 
+{
+  uint8_t *p, *q;
+
+  /* Within a size class. */
+  p = malloc (20);
+  if (p == NULL)
+    fail ("malloc(20) failed");
+  fill (p, 20);
+  q = realloc (p, 24);
+  if (q != p)
+    fail ("realloc to 24 bytes moved the block");
+  check (q, 20);
+  free (q);
+  msg ("small block kept in place.");
+
+  /* Big block shrinking. */
+  p = malloc (3 * PGSIZE);
+  if (p == NULL)
+    fail ("malloc of 3 pages failed");
+  fill (p, 3 * PGSIZE);
+  q = realloc (p, PGSIZE + 100);
+  if (q != p)
+    fail ("shrinking a big block moved it");
+  check (q, PGSIZE + 100);
+  msg ("big block shrunk in place.");
+
+  /* Big block growing. */
+  p = realloc (q, 6 * PGSIZE);
+  if (p == NULL)
+    fail ("growing a big block failed");
+  check (p, PGSIZE + 100);
+  fill (p, 6 * PGSIZE);
+  check (p, 6 * PGSIZE);
+  free (p);
+  msg ("big block grown.");
+}
+
+/* Fills SIZE bytes at P with a pattern. */
+static void
+fill (uint8_t *p, size_t size) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    p[i] = i % 251;
+}
+
+/* Checks that SIZE bytes at P hold the pattern from fill(). */
+static void
+check (const uint8_t *p, size_t size) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (p[i] != i % 251)
+      fail ("byte %zu is %d, expected %d", i, p[i], (int) (i % 251));
+}
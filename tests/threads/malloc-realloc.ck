@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-realloc) begin
+(malloc-realloc) small block kept in place.
+(malloc-realloc) big block shrunk in place.
+(malloc-realloc) big block grown.
+(malloc-realloc) end
+EOF
+pass;
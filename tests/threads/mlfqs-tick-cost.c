@@ -0,0 +1,86 @@
+/* Measures how much of the CPU the timer interrupt handler
+   takes away from a busy thread as the number of threads in the
+   system grows, with the 4.4BSD scheduler enabled.
+
+   Extra threads are created blocked on a semaphore, so they sit
+   in the all-threads list (and are visited by the once-a-second
+   recent_cpu decay) without competing for the CPU.  For each
+   thread count the main thread counts loop iterations for a
+   fixed number of ticks.  With incremental priority
+   recomputation the per-tick cost must not depend on the number
+   of threads, so the loop rate with the most threads must stay
+   within 10% of the rate with none. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define MEASURE_TICKS (2 * TIMER_FREQ)
+
+static thread_func blocked_thread;
+static int64_t measure_loops (void);
+
+void
+test_mlfqs_tick_cost (void) 
+{
+  static const int thread_cnts[] = {0, 16, 64};
+  const size_t n = sizeof thread_cnts / sizeof *thread_cnts;
+  struct semaphore release;
+  int64_t loops[sizeof thread_cnts / sizeof *thread_cnts];
+  int created = 0;
+  size_t i;
+
+  ASSERT (thread_mlfqs);
+
+  sema_init (&release, 0);
+  for (i = 0; i < n; i++) 
+    {
+      for (; created < thread_cnts[i]; created++)
+        {
+          char name[20];
+          snprintf (name, sizeof name, "blocked%d", created);
+          thread_create (name, PRI_DEFAULT, blocked_thread, &release);
+        }
+
+      loops[i] = measure_loops ();
+      msg ("%d extra threads: %lld loops in %d ticks.",
+           thread_cnts[i], loops[i], MEASURE_TICKS);
+    }
+
+  for (i = 0; i < (size_t) created; i++)
+    sema_up (&release);
+  timer_sleep (TIMER_FREQ);
+
+  if (loops[n - 1] * 10 < loops[0] * 9)
+    fail ("tick handler cost grew with the number of threads.");
+  pass ();
+}
+
+/* Blocks until the main thread releases it. */
+static void
+blocked_thread (void *release_) 
+{
+  struct semaphore *release = release_;
+  sema_down (release);
+}
+
+/* Spins for MEASURE_TICKS timer ticks, starting at a tick
+   boundary, and returns the number of iterations completed. */
+static int64_t
+measure_loops (void) 
+{
+  int64_t start, loops = 0;
+
+  start = timer_ticks ();
+  while (timer_ticks () == start)
+    continue;
+
+  start = timer_ticks ();
+  while (timer_elapsed (start) < MEASURE_TICKS)
+    loops++;
+  return loops;
+}
@@ -0,0 +1,104 @@
+/* Measures single-page palloc_get_page() and palloc_free_page()
+   throughput with 1 to 64 threads, first with the per-CPU page
+   lists turned off, so that every call takes its pool's lock,
+   and then with them on.  Each thread keeps a few pages from
+   each pool live and frees and reallocates them over and over.
+   Reports the average cycles per allocation/free pair for each
+   thread count, which shows how the cost scales.
+
+   The numbers depend on the machine, so the test only checks
+   that every allocation succeeded. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Log2 of allocation/free pairs per thread. */
+#define ITER_LOG 9
+
+/* Pages each thread keeps live at once, alternating between the
+   user and kernel pools. */
+#define LIVE_CNT 4
+
+/* Largest log2 of the number of threads. */
+#define MAX_THREAD_LOG 6
+
+static thread_func bench_thread;
+static uint32_t run (int thread_log);
+
+static struct semaphore start;
+static struct semaphore done;
+static bool failed;
+
+void
+test_palloc_bench (void) 
+{
+  int thread_log;
+
+  sema_init (&start, 0);
+  sema_init (&done, 0);
+  failed = false;
+
+  for (thread_log = 0; thread_log <= MAX_THREAD_LOG; thread_log++)
+    {
+      uint32_t locked, local;
+
+      palloc_use_cpu_pages (false);
+      locked = run (thread_log);
+      palloc_use_cpu_pages (true);
+      local = run (thread_log);
+      msg ("%d threads: %"PRIu32" cycles per pair with the pool lock, "
+           "%"PRIu32" with CPU lists",
+           1 << thread_log, locked, local);
+    }
+  if (failed)
+    fail ("palloc_get_page() returned a null pointer");
+  msg ("PASS");
+}
+
+/* Runs 2**THREAD_LOG threads at once and returns the average
+   cycles per allocation/free pair. */
+static uint32_t
+run (int thread_log) 
+{
+  int thread_cnt = 1 << thread_log;
+  uint64_t begin;
+  int i;
+
+  for (i = 0; i < thread_cnt; i++)
+    thread_create ("bench", PRI_DEFAULT, bench_thread, NULL);
+
+  /* Start them all together. */
+  begin = rdtsc ();
+  for (i = 0; i < thread_cnt; i++)
+    sema_up (&start);
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&done);
+  return (rdtsc () - begin) >> (thread_log + ITER_LOG);
+}
+
+static void
+bench_thread (void *aux UNUSED) 
+{
+  void *live[LIVE_CNT] = {NULL};
+  int i;
+
+  sema_down (&start);
+  for (i = 0; i < 1 << ITER_LOG; i++)
+    {
+      int slot = i % LIVE_CNT;
+
+      palloc_free_page (live[slot]);
+      live[slot] = palloc_get_page (slot % 2 ? PAL_USER : 0);
+      if (live[slot] == NULL)
+        failed = true;
+    }
+  for (i = 0; i < LIVE_CNT; i++)
+    palloc_free_page (live[i]);
+  sema_up (&done);
+}
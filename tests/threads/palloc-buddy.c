@@ -0,0 +1,95 @@
+/* Allocates runs of odd sizes and scattered single pages from
+   the user pool, checks that no two allocations overlap, and
+   frees them in an order unrelated to allocation.  Afterward the
+   buddy allocator must have merged every block back, leaving the
+   same free pages and the same largest free block as before.
+   The per-CPU page lists are off meanwhile, since pages left on
+   them would keep their buddies from merging. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define RUN_CNT 6
+#define PAGE_CNT 64
+
+static void fill (uint8_t *, size_t page_cnt, int value);
+static void check (const uint8_t *, size_t page_cnt, int value);
+
+void
+test_palloc_buddy (void) 
+{
+  static const size_t run_sizes[RUN_CNT] = {1, 3, 5, 7, 2, 8};
+  static const int free_order[RUN_CNT] = {2, 5, 0, 3, 1, 4};
+  uint8_t *runs[RUN_CNT];
+  uint8_t *pages[PAGE_CNT];
+  size_t free_before, free_after;
+  int largest_before, largest_after;
+  int i;
+
+  palloc_use_cpu_pages (false);
+  palloc_get_stats (PAL_USER, &free_before, &largest_before);
+  if (free_before < 128)
+    fail ("only %zu pages in user pool", free_before);
+
+  /* Runs of odd sizes. */
+  for (i = 0; i < RUN_CNT; i++)
+    {
+      runs[i] = palloc_get_multiple (PAL_USER, run_sizes[i]);
+      if (runs[i] == NULL)
+        fail ("allocating %zu pages failed", run_sizes[i]);
+      fill (runs[i], run_sizes[i], i);
+    }
+  for (i = 0; i < RUN_CNT; i++)
+    check (runs[i], run_sizes[i], i);
+  msg ("%d runs do not overlap.", RUN_CNT);
+
+  /* Single pages, freed odd ones first so that each free finds
+     its buddy still allocated. */
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      pages[i] = palloc_get_page (PAL_USER);
+      if (pages[i] == NULL)
+        fail ("allocating page %d failed", i);
+      fill (pages[i], 1, RUN_CNT + i);
+    }
+  for (i = 0; i < PAGE_CNT; i++)
+    check (pages[i], 1, RUN_CNT + i);
+  msg ("%d pages do not overlap.", PAGE_CNT);
+  for (i = 1; i < PAGE_CNT; i += 2)
+    palloc_free_page (pages[i]);
+  for (i = 0; i < RUN_CNT; i++)
+    palloc_free_multiple (runs[free_order[i]], run_sizes[free_order[i]]);
+  for (i = 0; i < PAGE_CNT; i += 2)
+    palloc_free_page (pages[i]);
+
+  palloc_get_stats (PAL_USER, &free_after, &largest_after);
+  if (free_after != free_before)
+    fail ("%zu pages free before, %zu after", free_before, free_after);
+  if (largest_after != largest_before)
+    fail ("largest free order %d before, %d after",
+          largest_before, largest_after);
+  palloc_use_cpu_pages (true);
+  msg ("all blocks merged back.");
+}
+
+/* Fills PAGE_CNT pages at PAGES with VALUE. */
+static void
+fill (uint8_t *pages, size_t page_cnt, int value) 
+{
+  memset (pages, value, page_cnt * PGSIZE);
+}
+
+/* Checks that PAGE_CNT pages at PAGES still hold VALUE. */
+static void
+check (const uint8_t *pages, size_t page_cnt, int value) 
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt * PGSIZE; i++)
+    if (pages[i] != value)
+      fail ("byte %zu of block %d is %d", i, value, pages[i]);
+}
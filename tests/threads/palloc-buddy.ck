@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-buddy) begin
+(palloc-buddy) 6 runs do not overlap.
+(palloc-buddy) 64 pages do not overlap.
+(palloc-buddy) all blocks merged back.
+(palloc-buddy) end
+EOF
+pass;
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-rwlock) begin
+(priority-donate-rwlock) This thread should have priority 32.  Actual priority: 32.
+(priority-donate-rwlock) This thread should have priority 33.  Actual priority: 33.
+(priority-donate-rwlock) reader2: got the lock
+(priority-donate-rwlock) reader2: done
+(priority-donate-rwlock) reader1: got the lock
+(priority-donate-rwlock) reader1: done
+(priority-donate-rwlock) reader2, reader1 must already have finished, in that order.
+(priority-donate-rwlock) Main thread releasing the read lock.
+(priority-donate-rwlock) writer: got the lock
+(priority-donate-rwlock) reader: got the lock
+(priority-donate-rwlock) writer, reader must already have got the lock, in that order.
+(priority-donate-rwlock) This should be the last line before finishing this test.
+(priority-donate-rwlock) end
+EOF
+pass;
@@ -0,0 +1,91 @@
+/* Measures scheduler latency under a mix of CPU-bound threads,
+   which use up their time slices, and threads that sleep for a
+   tick or two at a time, which must wait between being woken
+   and running again.  Reports the 50th, 99th and 99.9th
+   percentiles of the wakeup-to-run delay and of the time run
+   per turn, in TSC cycles, over the run.
+
+   The numbers depend on the machine, so the test only checks
+   that samples were collected. */
+
+#include <stdio.h>
+#include <histogram.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define CPU_CNT 4
+#define SLEEPER_CNT 4
+#define RUN_TICKS (3 * TIMER_FREQ)
+
+static thread_func cpu_thread;
+static thread_func sleeper_thread;
+static void report (const char *name, const struct histogram *before,
+                    const struct histogram *after);
+
+static struct semaphore done;
+static int64_t end_time;
+
+void
+test_sched_latency (void) 
+{
+  struct histogram wakeup_before, slice_before;
+  struct histogram wakeup_after, slice_after;
+  int i;
+
+  sema_init (&done, 0);
+  thread_get_latency (-1, &wakeup_before, &slice_before);
+  end_time = timer_ticks () + RUN_TICKS;
+
+  for (i = 0; i < CPU_CNT; i++)
+    thread_create ("cpu", PRI_DEFAULT, cpu_thread, NULL);
+  for (i = 0; i < SLEEPER_CNT; i++)
+    thread_create ("sleeper", PRI_DEFAULT, sleeper_thread,
+                   (void *) (i % 2 + 1));
+
+  for (i = 0; i < CPU_CNT + SLEEPER_CNT; i++)
+    sema_down (&done);
+  thread_get_latency (-1, &wakeup_after, &slice_after);
+
+  report ("wakeup latency", &wakeup_before, &wakeup_after);
+  report ("slice length", &slice_before, &slice_after);
+  if (histogram_count (&wakeup_after) == histogram_count (&wakeup_before))
+    fail ("no wakeups were measured");
+  msg ("PASS");
+}
+
+/* Prints the percentiles of the samples added to a histogram
+   between BEFORE and AFTER. */
+static void
+report (const char *name, const struct histogram *before,
+        const struct histogram *after) 
+{
+  struct histogram run;
+  int i;
+
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    run.buckets[i] = after->buckets[i] - before->buckets[i];
+  msg ("%s: %llu samples, p50 < %llu, p99 < %llu, p99.9 < %llu cycles",
+       name, histogram_count (&run), histogram_percentile (&run, 500),
+       histogram_percentile (&run, 990), histogram_percentile (&run, 999));
+}
+
+static void
+cpu_thread (void *aux UNUSED) 
+{
+  while (timer_ticks () < end_time)
+    continue;
+  sema_up (&done);
+}
+
+static void
+sleeper_thread (void *ticks_) 
+{
+  int64_t ticks = (int) ticks_;
+
+  while (timer_ticks () < end_time)
+    timer_sleep (ticks);
+  sema_up (&done);
+}
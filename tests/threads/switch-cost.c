@@ -0,0 +1,116 @@
+/* Measures the cost of a context switch.  Two threads take turns
+   through a pair of semaphores, so that every turn is one switch.
+   In the first run both threads use the kernel page directory,
+   as kernel threads and the threads of one process do, and the
+   switch need not touch CR3.  In the second run one of them
+   loads a copy of the page directory each time it runs and the
+   other loads the original back, as a switch between processes
+   does.  Reports the average cycles per switch for each.
+
+   The numbers depend on the machine, so the test only checks
+   that both runs complete. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+/* Log2 of the number of round trips in each run. */
+#define ROUND_LOG 12
+
+/* One side of the ping-pong. */
+struct player
+  {
+    struct semaphore turn;      /* Raised when it is this side's turn. */
+    struct player *other;       /* The other side. */
+    uint32_t *pd;               /* Page directory to load, or null. */
+  };
+
+static thread_func partner_thread;
+static uint32_t run (uint32_t *main_pd, uint32_t *partner_pd);
+static void load_pd (uint32_t *);
+
+static struct semaphore done;
+
+void
+test_switch_cost (void) 
+{
+  uint32_t *pd;
+  uint32_t same, cross;
+
+  pd = palloc_get_page (PAL_ASSERT);
+  memcpy (pd, init_page_dir, PGSIZE);
+  sema_init (&done, 0);
+
+  same = run (NULL, NULL);
+  cross = run (init_page_dir, pd);
+
+  /* The partner may have exited with the copy loaded. */
+  load_pd (init_page_dir);
+  msg ("same address space: %"PRIu32" cycles per switch", same);
+  msg ("across address spaces: %"PRIu32" cycles per switch", cross);
+
+  palloc_free_page (pd);
+  msg ("PASS");
+}
+
+/* Plays 2**ROUND_LOG round trips against a partner thread, with
+   this thread loading MAIN_PD and the partner PARTNER_PD each
+   time they get the turn, if nonnull, and returns the average
+   cycles per switch. */
+static uint32_t
+run (uint32_t *main_pd, uint32_t *partner_pd) 
+{
+  struct player me, partner;
+  uint64_t begin;
+  int i;
+
+  sema_init (&me.turn, 0);
+  sema_init (&partner.turn, 0);
+  me.other = &partner;
+  partner.other = &me;
+  me.pd = main_pd;
+  partner.pd = partner_pd;
+
+  thread_create ("partner", thread_get_priority (), partner_thread,
+                 &partner);
+  begin = rdtsc ();
+  for (i = 0; i < 1 << ROUND_LOG; i++)
+    {
+      sema_up (&partner.turn);
+      sema_down (&me.turn);
+      load_pd (me.pd);
+    }
+  sema_down (&done);
+  return (rdtsc () - begin) >> (ROUND_LOG + 1);
+}
+
+/* The partner's side: waits for its turn and hands it back. */
+static void
+partner_thread (void *partner_) 
+{
+  struct player *partner = partner_;
+  int i;
+
+  for (i = 0; i < 1 << ROUND_LOG; i++)
+    {
+      sema_down (&partner->turn);
+      load_pd (partner->pd);
+      sema_up (&partner->other->turn);
+    }
+  sema_up (&done);
+}
+
+/* Loads PD into CR3, if nonnull. */
+static void
+load_pd (uint32_t *pd) 
+{
+  if (pd != NULL)
+    asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+}
@@ -25,10 +25,21 @@ static const struct test tests[] =
     {"priority-donate-sema", test_priority_donate_sema},
     {"priority-donate-lower", test_priority_donate_lower},
     {"priority-donate-chain", test_priority_donate_chain},
+    {"priority-donate-rwlock", test_priority_donate_rwlock},
     {"priority-fifo", test_priority_fifo},
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"edf-deadline", test_edf_deadline},
+    {"edf-admission", test_edf_admission},
+    {"sched-latency", test_sched_latency},
+    {"palloc-buddy", test_palloc_buddy},
+    {"palloc-bench", test_palloc_bench},
+    {"malloc-bench", test_malloc_bench},
+    {"malloc-realloc", test_malloc_realloc},
+    {"malloc-heap-profile", test_malloc_heap_profile},
+    {"switch-cost", test_switch_cost},
+    {"timer-delay", test_timer_delay},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
@@ -38,6 +49,14 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"mlfqs-tick-cost", test_mlfqs_tick_cost},
+
+    /* Benchmarks, in tests/bench/threads. */
+    {"bench-switch", test_bench_switch},
+    {"bench-sema", test_bench_sema},
+    {"bench-lock-donate", test_bench_lock_donate},
+    {"bench-sleep", test_bench_sleep},
+    {"bench-alloc", test_bench_alloc},
   };
 
 static const char *test_name;
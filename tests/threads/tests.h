@@ -19,10 +19,21 @@ extern test_func test_priority_donate_sema;
 extern test_func test_priority_donate_nest;
 extern test_func test_priority_donate_lower;
 extern test_func test_priority_donate_chain;
+extern test_func test_priority_donate_rwlock;
 extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_edf_deadline;
+extern test_func test_edf_admission;
+extern test_func test_sched_latency;
+extern test_func test_palloc_buddy;
+extern test_func test_palloc_bench;
+extern test_func test_malloc_bench;
+extern test_func test_malloc_realloc;
+extern test_func test_malloc_heap_profile;
+extern test_func test_switch_cost;
+extern test_func test_timer_delay;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
@@ -32,6 +43,12 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_mlfqs_tick_cost;
+extern test_func test_bench_switch;
+extern test_func test_bench_sema;
+extern test_func test_bench_lock_donate;
+extern test_func test_bench_sleep;
+extern test_func test_bench_alloc;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -0,0 +1,46 @@
+/* Checks that the busy-wait delays, which count time-stamp
+   counter cycles, last about as long as they should, measured in
+   timer ticks: 500 ms in one timer_mdelay() call, then 200 ms
+   in 20,000 calls to timer_udelay (10), as the IDE driver makes.
+   Allows 20% either way, plus a tick for where in a tick each
+   run starts and ends. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+
+static void check (const char *what, int64_t ticks, int64_t ms);
+
+void
+test_timer_delay (void) 
+{
+  int64_t start;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  start = timer_ticks ();
+  timer_mdelay (500);
+  check ("timer_mdelay (500)", timer_elapsed (start), 500);
+
+  start = timer_ticks ();
+  for (i = 0; i < 20000; i++)
+    timer_udelay (10);
+  check ("20000 x timer_udelay (10)", timer_elapsed (start), 200);
+
+  pass ();
+}
+
+/* Fails unless TICKS is within 20% of MS milliseconds, give or
+   take a tick. */
+static void
+check (const char *what, int64_t ticks, int64_t ms) 
+{
+  int64_t expected = ms * TIMER_FREQ / 1000;
+
+  if (ticks < expected * 4 / 5 - 1 || ticks > expected * 6 / 5 + 1)
+    fail ("%s took %lld ticks, expected about %lld",
+          what, (long long) ticks, (long long) expected);
+  msg ("%s took about the right time", what);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(timer-delay) begin
+(timer-delay) timer_mdelay (500) took about the right time
+(timer-delay) 20000 x timer_udelay (10) took about the right time
+(timer-delay) PASS
+(timer-delay) end
+EOF
+pass;
@@ -0,0 +1,29 @@
+/* Sets and reads this thread's CPU affinity mask.  Checks that
+   a new thread starts out allowed on CPU 0, that pinning to CPU 0
+   sticks, that a mask with no CPU that exists fails without
+   changing anything, and that threads outside this process, like
+   the kernel's main thread, cannot be read or changed. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Tid of the kernel thread that runs the tests. */
+#define MAIN_TID 1
+
+void
+test_main (void) 
+{
+  CHECK ((sched_getaffinity (0) & 1) != 0, "starts allowed on CPU 0");
+  CHECK (sched_setaffinity (0, 1) == 0, "pin to CPU 0");
+  CHECK (sched_getaffinity (0) == 1, "mask reads back");
+  CHECK (sched_getaffinity (gettid ()) == 1, "own tid reads the same");
+  CHECK (sched_setaffinity (0, 0) == -1, "empty mask fails");
+  CHECK (sched_setaffinity (0, 0x80000000) == -1,
+         "mask of missing CPUs fails");
+  CHECK (sched_getaffinity (0) == 1, "mask unchanged");
+
+  CHECK (sched_getaffinity (MAIN_TID) == -1, "kernel thread's mask hidden");
+  CHECK (sched_setaffinity (MAIN_TID, 1) == -1,
+         "kernel thread's mask unchangeable");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(affinity) begin
+(affinity) starts allowed on CPU 0
+(affinity) pin to CPU 0
+(affinity) mask reads back
+(affinity) own tid reads the same
+(affinity) empty mask fails
+(affinity) mask of missing CPUs fails
+(affinity) mask unchanged
+(affinity) kernel thread's mask hidden
+(affinity) kernel thread's mask unchangeable
+(affinity) end
+affinity: exit(0)
+EOF
+pass;
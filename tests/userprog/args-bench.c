@@ -0,0 +1,103 @@
+/* Measures how the cost of exec() grows with the number of
+   command-line arguments, by executing itself with ARG_CNTS[i]
+   arguments a few times each and timing each exec() call with
+   the time-stamp counter.  The largest argument vector spans
+   several pages of the child's stack.  Run with arguments, it
+   is the child: it checks that each argument is its own index
+   and exits with the number of arguments.  The cycle counts
+   depend on the machine, so only that every child got its
+   arguments is checked. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "args-bench";
+
+/* Numbers of arguments to pass. */
+static const int arg_cnts[] = {1, 16, 256, 4096};
+#define ARG_CNTS_CNT (sizeof arg_cnts / sizeof *arg_cnts)
+
+/* Times each exec() is repeated. */
+#define REPEAT 4
+
+static char cmd_line[32768];
+
+/* Returns the time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Fills CMD_LINE with a command line that runs this program with
+   ARG_CNT arguments. */
+static void
+make_cmd_line (int arg_cnt)
+{
+  size_t len;
+  int i;
+
+  len = strlcpy (cmd_line, test_name, sizeof cmd_line);
+  for (i = 1; i <= arg_cnt; i++)
+    {
+      len += snprintf (cmd_line + len, sizeof cmd_line - len, " %d", i);
+      if (len >= sizeof cmd_line)
+        fail ("command line for %d arguments is too long", arg_cnt);
+    }
+}
+
+/* Runs the child with ARG_CNT arguments REPEAT times and reports
+   the fastest exec(). */
+static void
+bench (int arg_cnt)
+{
+  uint64_t fastest = UINT64_MAX;
+  int i;
+
+  make_cmd_line (arg_cnt);
+  for (i = 0; i < REPEAT; i++)
+    {
+      uint64_t start, cycles;
+      pid_t pid;
+
+      start = rdtsc ();
+      pid = exec (cmd_line);
+      cycles = rdtsc () - start;
+      if (pid == PID_ERROR)
+        fail ("exec with %d arguments failed", arg_cnt);
+      if (wait (pid) != arg_cnt)
+        fail ("child with %d arguments got the wrong ones", arg_cnt);
+      if (cycles < fastest)
+        fastest = cycles;
+    }
+  msg ("%d arguments: %"PRIu64" cycles", arg_cnt, fastest);
+}
+
+int
+main (int argc, char *argv[]) 
+{
+  size_t i;
+
+  if (argc > 1)
+    {
+      int j;
+
+      for (j = 1; j < argc; j++)
+        if (atoi (argv[j]) != j)
+          return -1;
+      return argv[argc] == NULL ? argc - 1 : -1;
+    }
+
+  msg ("begin");
+  for (i = 0; i < ARG_CNTS_CNT; i++)
+    bench (arg_cnts[i]);
+  msg ("PASS");
+  msg ("end");
+  return 0;
+}
@@ -0,0 +1,73 @@
+/* Compares the cycles needed to write text to the console one
+   character, one line, and one block at a time.  Writes the
+   same LINE_CNT lines each way, so that the cost per KiB shows
+   how much of it is per call and how much per character.  The
+   cycle counts depend on the machine, so only that every write
+   succeeds is checked. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Each line is LINE_SIZE characters, including its new-line. */
+#define LINE_SIZE 64
+#define LINE_CNT 32
+#define TEXT_SIZE (LINE_SIZE * LINE_CNT)
+
+/* Bytes written per KiB, as a multiplier. */
+#define PER_KIB(X) ((X) * 1024 / TEXT_SIZE)
+
+static char text[TEXT_SIZE];
+
+/* Returns the time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Fills TEXT with LINE_CNT lines of text. */
+static void
+make_text (void)
+{
+  int i, j;
+
+  for (i = 0; i < LINE_CNT; i++)
+    {
+      char *line = text + i * LINE_SIZE;
+      for (j = 0; j < LINE_SIZE - 1; j++)
+        line[j] = 'a' + (i + j) % 26;
+      line[LINE_SIZE - 1] = '\n';
+    }
+}
+
+/* Writes TEXT to the console in calls of SIZE bytes each and
+   reports the cycles taken as WHAT. */
+static void
+write_text (const char *what, size_t size)
+{
+  uint64_t start, cycles;
+  size_t ofs;
+
+  start = rdtsc ();
+  for (ofs = 0; ofs < TEXT_SIZE; ofs += size)
+    if (write (STDOUT_FILENO, text + ofs, size) != (int) size)
+      fail ("console write at offset %zu failed", ofs);
+  cycles = rdtsc () - start;
+  msg ("%s: %"PRIu64" cycles/KiB", what, PER_KIB (cycles));
+}
+
+void
+test_main (void) 
+{
+  make_text ();
+  write_text ("by character", 1);
+  write_text ("by line", LINE_SIZE);
+  write_text ("by block", TEXT_SIZE);
+  msg ("PASS");
+}
@@ -0,0 +1,37 @@
+/* Copies a file with copy_file_range(), in two pieces, and reads
+   the copy back.  Also checks that a bad descriptor is
+   rejected. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  int in_fd, out_fd;
+  int half = (sizeof sample - 1) / 2;
+
+  CHECK (create ("sample.txt", 0), "create \"sample.txt\"");
+  CHECK (create ("copy.txt", 0), "create \"copy.txt\"");
+  CHECK ((in_fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((out_fd = open ("copy.txt")) > 1, "open \"copy.txt\"");
+  CHECK (write (in_fd, sample, sizeof sample - 1) == sizeof sample - 1,
+         "write \"sample.txt\"");
+
+  seek (in_fd, 0);
+  CHECK (copy_file_range (in_fd, out_fd, half) == half, "copy first half");
+  CHECK (copy_file_range (in_fd, out_fd, sizeof sample)
+         == (int) sizeof sample - 1 - half, "copy the rest");
+  CHECK (copy_file_range (in_fd, out_fd, 1) == 0, "copy at end of file");
+  CHECK (copy_file_range (in_fd, 0x20101234, 1) == -1, "copy to bad fd");
+
+  seek (out_fd, 0);
+  CHECK (read (out_fd, buf, sizeof sample - 1) == sizeof sample - 1,
+         "read \"copy.txt\"");
+  if (memcmp (buf, sample, sizeof sample - 1))
+    fail ("copy differs from the original");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(copy-range) begin
+(copy-range) create "sample.txt"
+(copy-range) create "copy.txt"
+(copy-range) open "sample.txt"
+(copy-range) open "copy.txt"
+(copy-range) write "sample.txt"
+(copy-range) copy first half
+(copy-range) copy the rest
+(copy-range) copy at end of file
+(copy-range) copy to bad fd
+(copy-range) read "copy.txt"
+(copy-range) end
+copy-range: exit(0)
+EOF
+pass;
@@ -0,0 +1,44 @@
+/* Checks that open() reuses the lowest free descriptor, that
+   dup() and dup2() share the file and its position, and that
+   the file stays open until its last descriptor is closed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  int a, b, c, d;
+
+  CHECK (create ("sample.txt", 0), "create \"sample.txt\"");
+  CHECK ((a = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((b = open ("sample.txt")) > a, "open \"sample.txt\" again");
+  msg ("close first descriptor");
+  close (a);
+  CHECK (open ("sample.txt") == a, "open reuses the lowest descriptor");
+
+  CHECK ((c = dup (b)) > b, "dup");
+  CHECK (write (b, sample, 10) == 10, "write 10 bytes");
+  CHECK (tell (c) == 10, "duplicate shares the position");
+  msg ("close original");
+  close (b);
+  CHECK (write (c, sample + 10, sizeof sample - 11) == sizeof sample - 11,
+         "write the rest through the duplicate");
+
+  CHECK ((d = open ("sample.txt")) > 1, "open \"sample.txt\" a third time");
+  CHECK (dup2 (c, d) == d, "dup2 onto an open descriptor");
+  seek (d, 0);
+  CHECK (tell (c) == 0, "dup2 shares the position");
+  CHECK (read (c, buf, sizeof sample - 1) == sizeof sample - 1,
+         "read \"sample.txt\"");
+  if (memcmp (buf, sample, sizeof sample - 1))
+    fail ("read differs from what was written");
+
+  CHECK (dup (0) == -1, "dup of the console fails");
+  CHECK (dup (0x20101234) == -1, "dup of a bad fd fails");
+  CHECK (dup2 (c, -1) == -1, "dup2 onto a bad fd fails");
+}
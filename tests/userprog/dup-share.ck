@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(dup-share) begin
+(dup-share) create "sample.txt"
+(dup-share) open "sample.txt"
+(dup-share) open "sample.txt" again
+(dup-share) close first descriptor
+(dup-share) open reuses the lowest descriptor
+(dup-share) dup
+(dup-share) write 10 bytes
+(dup-share) duplicate shares the position
+(dup-share) close original
+(dup-share) write the rest through the duplicate
+(dup-share) open "sample.txt" a third time
+(dup-share) dup2 onto an open descriptor
+(dup-share) dup2 shares the position
+(dup-share) read "sample.txt"
+(dup-share) dup of the console fails
+(dup-share) dup of a bad fd fails
+(dup-share) dup2 onto a bad fd fails
+(dup-share) end
+dup-share: exit(0)
+EOF
+pass;
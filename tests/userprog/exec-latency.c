@@ -0,0 +1,51 @@
+/* Measures how long exec() takes, by starting and waiting for
+   child processes in a loop and timing each exec() call with the
+   time-stamp counter.  Reports the fastest and the average
+   latency in cycles.  The cost depends on the machine, so the
+   test only checks that every child ran. */
+
+#include <inttypes.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Number of children to start. */
+#define CHILD_CNT 32
+
+/* Returns the time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+void
+test_main (void) 
+{
+  uint64_t total = 0, fastest = UINT64_MAX;
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      uint64_t start, cycles;
+      pid_t pid;
+
+      start = rdtsc ();
+      pid = exec ("child-simple");
+      cycles = rdtsc () - start;
+      if (pid == PID_ERROR)
+        fail ("exec #%d failed", i);
+      if (wait (pid) != 81)
+        fail ("child #%d returned the wrong status", i);
+
+      total += cycles;
+      if (cycles < fastest)
+        fastest = cycles;
+    }
+
+  msg ("exec latency: fastest %"PRIu64", average %"PRIu64" cycles",
+       fastest, total / CHILD_CNT);
+  msg ("PASS");
+}
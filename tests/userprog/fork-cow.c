@@ -0,0 +1,58 @@
+/* Forks a child that checks that it sees the parent's memory as
+   it was at the fork, then overwrites it, both directly and by
+   reading a file into it through a descriptor it inherited.  The
+   parent's memory and its own file position must be left as they
+   were. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Two pages of writable data. */
+static char data[8192];
+
+void
+test_main (void) 
+{
+  int stack_value = 123;
+  char buf[sizeof sample - 1];
+  size_t i;
+  pid_t pid;
+  int fd;
+
+  for (i = 0; i < sizeof data; i++)
+    data[i] = i % 251;
+  CHECK ((fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      for (i = 0; i < sizeof data; i++)
+        if (data[i] != (char) (i % 251))
+          fail ("child sees the wrong data at offset %zu", i);
+      if (stack_value != 123)
+        fail ("child sees the wrong stack");
+
+      memset (data, 'x', sizeof data);
+      stack_value = 0;
+      if (read (fd, data, sizeof sample - 1) != (int) sizeof sample - 1
+          || memcmp (data, sample, sizeof sample - 1))
+        fail ("child could not read \"sample.txt\" into its data");
+      exit (42);
+    }
+  if (pid == PID_ERROR)
+    fail ("fork failed");
+  msg ("wait(fork()) = %d", wait (pid));
+
+  for (i = 0; i < sizeof data; i++)
+    if (data[i] != (char) (i % 251))
+      fail ("parent's data changed at offset %zu", i);
+  if (stack_value != 123)
+    fail ("parent's stack changed");
+  if (read (fd, buf, sizeof buf) != (int) sizeof buf
+      || memcmp (buf, sample, sizeof buf))
+    fail ("parent's file position changed");
+  msg ("parent's memory and file position unchanged");
+}
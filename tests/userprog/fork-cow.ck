@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-cow) begin
+(fork-cow) open "sample.txt"
+fork-cow: exit(42)
+(fork-cow) wait(fork()) = 42
+(fork-cow) parent's memory and file position unchanged
+(fork-cow) end
+fork-cow: exit(0)
+EOF
+pass;
@@ -0,0 +1,28 @@
+/* Writes a file, forces it to disk with fsync(), and reads it
+   back.  Also checks that fsync() rejects a bad descriptor. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  int handle;
+
+  CHECK (create ("test.txt", sizeof sample - 1), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+  CHECK (write (handle, sample, sizeof sample - 1) == sizeof sample - 1,
+         "write \"test.txt\"");
+  CHECK (fsync (handle) == 0, "fsync \"test.txt\"");
+  CHECK (fsync (0x20101234) == -1, "fsync bad fd");
+
+  seek (handle, 0);
+  CHECK (read (handle, buf, sizeof sample - 1) == sizeof sample - 1,
+         "read \"test.txt\"");
+  if (memcmp (buf, sample, sizeof sample - 1))
+    fail ("read back data differs from what was written");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fsync-normal) begin
+(fsync-normal) create "test.txt"
+(fsync-normal) open "test.txt"
+(fsync-normal) write "test.txt"
+(fsync-normal) fsync "test.txt"
+(fsync-normal) fsync bad fd
+(fsync-normal) read "test.txt"
+(fsync-normal) end
+fsync-normal: exit(0)
+EOF
+pass;
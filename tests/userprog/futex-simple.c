@@ -0,0 +1,16 @@
+/* Tests futex_wait and futex_wake without contention: waiting on
+   a word that no longer holds the expected value returns at
+   once, and waking a word that nobody sleeps on wakes no one. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int word = 1;
+
+void
+test_main (void) 
+{
+  CHECK (futex_wait (&word, 0) == -1, "futex_wait on a changed word");
+  CHECK (futex_wake (&word, 1) == 0, "futex_wake with no waiters");
+}
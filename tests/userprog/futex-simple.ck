@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(futex-simple) begin
+(futex-simple) futex_wait on a changed word
+(futex-simple) futex_wake with no waiters
+(futex-simple) end
+futex-simple: exit(0)
+EOF
+pass;
@@ -0,0 +1,135 @@
+/* Compares the system calls and cycles needed to move a MiB of
+   file data with the classic calls and with the positional and
+   scatter-gather ones.  Writes records of a small header and a
+   body, first with two write() calls each and then with one
+   writev(), and reads them back in a scattered order, first with
+   seek() and read() and then with one pread() each.  Checks that
+   every record reads back as written.  The cycle counts depend
+   on the machine, so only the data is checked. */
+
+#include <inttypes.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Each record is HEADER_SIZE bytes of header and BODY_SIZE
+   bytes of body. */
+#define HEADER_SIZE 16
+#define BODY_SIZE 496
+#define RECORD_SIZE (HEADER_SIZE + BODY_SIZE)
+#define RECORD_CNT 64
+
+/* Bytes moved per MiB, as a multiplier. */
+#define PER_MIB(X) ((X) * (1024 * 1024 / (RECORD_CNT * RECORD_SIZE)))
+
+static char header[HEADER_SIZE];
+static char body[BODY_SIZE];
+static char record[RECORD_SIZE];
+
+/* Returns the time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Fills in the header and body of record I. */
+static void
+make_record (int i)
+{
+  memset (header, 'a' + i % 26, sizeof header);
+  memset (body, 'A' + i % 26, sizeof body);
+}
+
+/* Checks that RECORD holds record I. */
+static void
+check_record (int i)
+{
+  make_record (i);
+  if (memcmp (record, header, HEADER_SIZE)
+      || memcmp (record + HEADER_SIZE, body, BODY_SIZE))
+    fail ("record %d read back wrong", i);
+}
+
+/* Returns the record read in position I of the scattered order. */
+static int
+scatter (int i)
+{
+  return i * 37 % RECORD_CNT;
+}
+
+/* Reports CALLS system calls and CYCLES cycles for WHAT. */
+static void
+report (const char *what, int calls, uint64_t cycles)
+{
+  msg ("%s: %d syscalls/MiB, %"PRIu64" cycles/MiB",
+       what, PER_MIB (calls), PER_MIB (cycles));
+}
+
+void
+test_main (void) 
+{
+  struct iovec iov[2];
+  uint64_t start;
+  int fd, i, calls;
+
+  CHECK (create ("records", 0), "create \"records\"");
+  CHECK ((fd = open ("records")) > 1, "open \"records\"");
+
+  /* Two write() calls per record. */
+  start = rdtsc ();
+  for (i = calls = 0; i < RECORD_CNT; i++, calls += 2)
+    {
+      make_record (i);
+      if (write (fd, header, HEADER_SIZE) != HEADER_SIZE
+          || write (fd, body, BODY_SIZE) != BODY_SIZE)
+        fail ("write of record %d failed", i);
+    }
+  report ("write", calls, rdtsc () - start);
+
+  /* One writev() per record, over the same records. */
+  seek (fd, 0);
+  iov[0].iov_base = header;
+  iov[0].iov_len = HEADER_SIZE;
+  iov[1].iov_base = body;
+  iov[1].iov_len = BODY_SIZE;
+  start = rdtsc ();
+  for (i = calls = 0; i < RECORD_CNT; i++, calls++)
+    {
+      make_record (i);
+      if (writev (fd, iov, 2) != RECORD_SIZE)
+        fail ("writev of record %d failed", i);
+    }
+  report ("writev", calls, rdtsc () - start);
+  CHECK (tell (fd) == RECORD_CNT * RECORD_SIZE, "tell after writev");
+
+  /* seek() and read() per record. */
+  start = rdtsc ();
+  for (i = calls = 0; i < RECORD_CNT; i++, calls += 2)
+    {
+      int r = scatter (i);
+      seek (fd, r * RECORD_SIZE);
+      if (read (fd, record, RECORD_SIZE) != RECORD_SIZE)
+        fail ("read of record %d failed", r);
+      check_record (r);
+    }
+  report ("seek+read", calls, rdtsc () - start);
+
+  /* One pread() per record, which leaves the position alone. */
+  seek (fd, 0);
+  start = rdtsc ();
+  for (i = calls = 0; i < RECORD_CNT; i++, calls++)
+    {
+      int r = scatter (i);
+      if (pread (fd, record, RECORD_SIZE, r * RECORD_SIZE) != RECORD_SIZE)
+        fail ("pread of record %d failed", r);
+      check_record (r);
+    }
+  report ("pread", calls, rdtsc () - start);
+  CHECK (tell (fd) == 0, "tell after pread");
+  close (fd);
+  msg ("PASS");
+}
@@ -0,0 +1,51 @@
+/* Reads the time and the process ID from the kernel information
+   page.  Checks that the monotonic clock never goes backward and
+   keeps advancing, and that a forked child sees its own process
+   ID. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Nanoseconds in TS. */
+static int64_t
+ns_of (const struct timespec *ts)
+{
+  return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+void
+test_main (void) 
+{
+  struct timespec ts;
+  int64_t start, last, now;
+  pid_t parent, pid;
+  int i;
+
+  CHECK (clock_gettime (CLOCK_MONOTONIC, &ts) == 0, "clock_gettime");
+  start = last = ns_of (&ts);
+  for (i = 0; i < 100000 || last - start < 50000000; i++)
+    {
+      clock_gettime (CLOCK_MONOTONIC, &ts);
+      if (ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000)
+        fail ("tv_nsec out of range: %ld", ts.tv_nsec);
+      now = ns_of (&ts);
+      if (now < last)
+        fail ("clock went back by %lld ns", last - now);
+      last = now;
+    }
+  msg ("clock advances");
+
+  CHECK (clock_gettime (CLOCK_REALTIME, &ts) == 0 && ns_of (&ts) > last,
+         "realtime clock is past boot");
+  CHECK (clock_gettime (12345, &ts) == -1, "bad clock fails");
+
+  parent = getpid ();
+  pid = fork ();
+  if (pid == 0)
+    exit (getpid () != parent ? getpid () : -1);
+  if (pid == PID_ERROR)
+    fail ("fork failed");
+  CHECK (wait (pid) == pid, "child's getpid() matches fork()");
+  CHECK (getpid () == parent, "parent's getpid() is unchanged");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(kinfo-time) begin
+(kinfo-time) clock_gettime
+(kinfo-time) clock advances
+(kinfo-time) realtime clock is past boot
+(kinfo-time) bad clock fails
+(kinfo-time) child's getpid() matches fork()
+(kinfo-time) parent's getpid() is unchanged
+(kinfo-time) end
+kinfo-time: exit(0)
+EOF
+pass;
@@ -0,0 +1,116 @@
+/* Has several threads at once allocate blocks of many sizes,
+   from a few bytes up to several pages, fill each with a pattern
+   of its own, and check and free them in a different order, so
+   that blocks move between the threads' caches, the size
+   classes, and the heap's free pages.  Also checks calloc() and
+   realloc(), and that freeing a big block at the top of the
+   heap shrinks it. */
+
+#include <malloc.h>
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define BLOCK_CNT 64
+#define ROUND_CNT 8
+#define BIG_SIZE (128 * 4096)
+
+struct worker
+  {
+    int id;
+    unsigned char *blocks[BLOCK_CNT];
+    size_t sizes[BLOCK_CNT];
+  };
+
+static struct worker workers[THREAD_CNT];
+
+/* Returns the pattern byte of block I of worker W. */
+static unsigned char
+pattern (const struct worker *w, int i)
+{
+  return w->id * BLOCK_CNT + i;
+}
+
+static void
+work (void *w_)
+{
+  struct worker *w = w_;
+  int round, i;
+  size_t j;
+
+  for (round = 0; round < ROUND_CNT; round++)
+    {
+      for (i = 0; i < BLOCK_CNT; i++)
+        {
+          /* Mostly small blocks, with a big one now and then. */
+          w->sizes[i] = (i % 16 == 0
+                         ? 4096 + random_ulong () % 16384
+                         : 1 + random_ulong () % 1500);
+          w->blocks[i] = malloc (w->sizes[i]);
+          if (w->blocks[i] == NULL)
+            fail ("malloc of %zu bytes failed", w->sizes[i]);
+          memset (w->blocks[i], pattern (w, i), w->sizes[i]);
+        }
+      for (i = BLOCK_CNT - 1; i >= 0; i -= 2)
+        {
+          for (j = 0; j < w->sizes[i]; j++)
+            if (w->blocks[i][j] != pattern (w, i))
+              fail ("thread %d block %d corrupted", w->id, i);
+          free (w->blocks[i]);
+        }
+      for (i = 0; i < BLOCK_CNT; i += 2)
+        {
+          w->blocks[i] = realloc (w->blocks[i], w->sizes[i] * 2);
+          if (w->blocks[i] == NULL)
+            fail ("realloc failed");
+          for (j = 0; j < w->sizes[i]; j++)
+            if (w->blocks[i][j] != pattern (w, i))
+              fail ("thread %d block %d corrupted by realloc", w->id, i);
+          free (w->blocks[i]);
+        }
+    }
+}
+
+void
+test_main (void) 
+{
+  tid_t tids[THREAD_CNT];
+  unsigned char *p;
+  void *end;
+  size_t j;
+  int i;
+
+  random_init (0);
+
+  p = calloc (1000, 10);
+  CHECK (p != NULL, "calloc");
+  for (j = 0; j < 10000; j++)
+    if (p[j] != 0)
+      fail ("calloc returned nonzero byte %zu", j);
+  free (p);
+
+  msg ("starting %d threads", THREAD_CNT);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      workers[i].id = i;
+      tids[i] = thread_spawn (work, &workers[i]);
+      if (tids[i] == TID_ERROR)
+        fail ("thread_spawn failed");
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    if (thread_join (tids[i]) != 0)
+      fail ("thread_join failed");
+  msg ("all threads done");
+
+  /* A block bigger than any free run comes from the top of the
+     heap, and freeing it gives its pages back. */
+  p = malloc (BIG_SIZE);
+  CHECK (p != NULL, "malloc big block");
+  end = sbrk (0);
+  free (p);
+  CHECK ((char *) sbrk (0) <= (char *) end - BIG_SIZE,
+         "heap shrank after freeing it");
+}
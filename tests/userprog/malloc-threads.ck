@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-threads) begin
+(malloc-threads) calloc
+(malloc-threads) starting 4 threads
+(malloc-threads) all threads done
+(malloc-threads) malloc big block
+(malloc-threads) heap shrank after freeing it
+(malloc-threads) end
+malloc-threads: exit(0)
+EOF
+pass;
@@ -0,0 +1,39 @@
+/* Runs child-simple with its standard output connected to a
+   pipe, which the child inherits on exec, and reads what it
+   printed from the pipe until end of file. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static const char expected[] = "(child-simple) run\n";
+  char buf[128];
+  int fds[2], status;
+  size_t size = 0;
+  pid_t pid;
+  int n;
+
+  CHECK (pipe (fds) == 0, "pipe");
+
+  /* Nothing may be printed while fd 1 is the pipe. */
+  dup2 (fds[1], STDOUT_FILENO);
+  pid = exec ("child-simple");
+  close (STDOUT_FILENO);
+  close (fds[1]);
+
+  status = wait (pid);
+  CHECK (pid != PID_ERROR, "exec child-simple with output to the pipe");
+  CHECK (status == 81, "wait(exec()) = %d", status);
+
+  while ((n = read (fds[0], buf + size, sizeof buf - size)) > 0)
+    size += n;
+  CHECK (n == 0, "read to end of file");
+  CHECK (size == strlen (expected) && !memcmp (buf, expected, size),
+         "child's output came through the pipe");
+  close (fds[0]);
+}
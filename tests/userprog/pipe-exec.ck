@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-exec) begin
+(pipe-exec) pipe
+child-simple: exit(81)
+(pipe-exec) exec child-simple with output to the pipe
+(pipe-exec) wait(exec()) = 81
+(pipe-exec) read to end of file
+(pipe-exec) child's output came through the pipe
+(pipe-exec) end
+pipe-exec: exit(0)
+EOF
+pass;
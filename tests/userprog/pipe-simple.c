@@ -0,0 +1,51 @@
+/* Writes to a pipe and reads the data back, more than the pipe
+   holds at once in total, then checks that reading a pipe whose
+   write end is closed returns end of file and that writing one
+   whose read end is closed fails. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[4096];
+
+void
+test_main (void) 
+{
+  int fds[2];
+  size_t i;
+  int round;
+
+  CHECK (pipe (fds) == 0, "pipe");
+  CHECK (fds[0] > 1 && fds[1] > 1 && fds[0] != fds[1], "two new fds");
+
+  for (round = 0; round < 16; round++)
+    {
+      for (i = 0; i < sizeof buf; i++)
+        buf[i] = round + i;
+      if (write (fds[1], buf, sizeof buf) != (int) sizeof buf)
+        fail ("write %d", round);
+      memset (buf, 0, sizeof buf);
+      if (read (fds[0], buf, sizeof buf) != (int) sizeof buf)
+        fail ("read %d", round);
+      for (i = 0; i < sizeof buf; i++)
+        if (buf[i] != (char) (round + i))
+          fail ("byte %zu of round %d differs", i, round);
+    }
+  msg ("16 rounds of 4 kB through the pipe");
+
+  CHECK (write (fds[1], "abc", 3) == 3, "write 3 bytes");
+  CHECK (read (fds[0], buf, sizeof buf) == 3, "read returns only 3");
+  CHECK (read (fds[1], buf, 1) == -1, "read from write end fails");
+  CHECK (write (fds[0], "x", 1) == -1, "write to read end fails");
+
+  close (fds[1]);
+  CHECK (read (fds[0], buf, sizeof buf) == 0, "end of file after close");
+  close (fds[0]);
+
+  CHECK (pipe (fds) == 0, "second pipe");
+  close (fds[0]);
+  CHECK (write (fds[1], "x", 1) == -1, "write with no reader fails");
+  close (fds[1]);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-simple) begin
+(pipe-simple) pipe
+(pipe-simple) two new fds
+(pipe-simple) 16 rounds of 4 kB through the pipe
+(pipe-simple) write 3 bytes
+(pipe-simple) read returns only 3
+(pipe-simple) read from write end fails
+(pipe-simple) write to read end fails
+(pipe-simple) end of file after close
+(pipe-simple) second pipe
+(pipe-simple) write with no reader fails
+(pipe-simple) end
+pipe-simple: exit(0)
+EOF
+pass;
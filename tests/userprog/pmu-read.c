@@ -0,0 +1,39 @@
+/* Reads the process's performance counts, with the kernel
+   counting retired instructions.  Where the CPU has no
+   performance counters, as under most emulators, checks only
+   that pmu_read() says so.  Otherwise, checks that the count
+   grows across a loop, by at least the loop's instructions, and
+   that RDPMC works in user mode. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "threads/tsc.h"
+
+/* Loop iterations, each at least one instruction. */
+#define LOOP_CNT 100000
+
+void
+test_main (void) 
+{
+  uint64_t before, after;
+  volatile int i;
+  int cnt;
+
+  cnt = pmu_read (&before, 1);
+  if (cnt == 0)
+    {
+      msg ("no performance counters");
+      return;
+    }
+  CHECK (cnt == 1, "one counter in use");
+
+  for (i = 0; i < LOOP_CNT; i++)
+    continue;
+  CHECK (pmu_read (&after, 1) == 1, "pmu_read");
+  CHECK (after - before >= LOOP_CNT, "instructions counted");
+
+  before = rdpmc (0);
+  after = rdpmc (0);
+  CHECK (after > before, "rdpmc in user mode");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF']);
+(pmu-read) begin
+(pmu-read) no performance counters
+(pmu-read) end
+pmu-read: exit(0)
+EOF
+(pmu-read) begin
+(pmu-read) one counter in use
+(pmu-read) pmu_read
+(pmu-read) instructions counted
+(pmu-read) rdpmc in user mode
+(pmu-read) end
+pmu-read: exit(0)
+EOF
+pass;
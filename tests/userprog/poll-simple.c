@@ -0,0 +1,59 @@
+/* Waits with poll() on the ends of a pipe and on a child.  Checks
+   that an empty pipe is not readable, that a timeout of 0 and a
+   short timeout both return 0, that a write by another thread
+   wakes a poll that waits forever, that closing the write end
+   reports a hangup, that an fd that is not open is reported
+   invalid, and that a child's exit is reported before wait(). */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int fds[2];
+
+static void
+write_byte (void *aux UNUSED) 
+{
+  write (fds[1], "x", 1);
+}
+
+void
+test_main (void) 
+{
+  struct pollfd p[2];
+  char c;
+  tid_t tid;
+  pid_t pid;
+
+  CHECK (pipe (fds) == 0, "pipe");
+  p[0].fd = fds[0];
+  p[0].events = POLLIN;
+  p[1].fd = fds[1];
+  p[1].events = POLLOUT;
+  CHECK (poll (p, 2, 0) == 1, "only the write end is ready");
+  CHECK (p[0].revents == 0 && p[1].revents == POLLOUT, "POLLOUT");
+  CHECK (poll (p, 1, 30) == 0, "empty pipe times out");
+
+  CHECK ((tid = thread_spawn (write_byte, NULL)) != TID_ERROR,
+         "thread_spawn");
+  CHECK (poll (p, 1, -1) == 1 && p[0].revents == POLLIN,
+         "write wakes poll");
+  CHECK (thread_join (tid) == 0, "thread_join");
+  CHECK (read (fds[0], &c, 1) == 1 && c == 'x', "read the byte");
+
+  close (fds[1]);
+  CHECK (poll (p, 1, -1) == 1 && p[0].revents == (POLLIN | POLLHUP),
+         "POLLHUP after close");
+  close (fds[0]);
+  CHECK (poll (p, 1, -1) == 1 && p[0].revents == POLLNVAL,
+         "POLLNVAL for a closed fd");
+
+  CHECK ((pid = exec ("child-simple")) != PID_ERROR, "exec child-simple");
+  p[0].fd = pid;
+  p[0].events = POLLEXIT;
+  CHECK (poll (p, 1, -1) == 1 && p[0].revents == POLLEXIT,
+         "child's exit wakes poll");
+  CHECK (wait (pid) == 81, "wait for child");
+  CHECK (poll (p, 1, 0) == 1 && p[0].revents == POLLNVAL,
+         "POLLNVAL once waited for");
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(poll-simple) begin
+(poll-simple) pipe
+(poll-simple) only the write end is ready
+(poll-simple) POLLOUT
+(poll-simple) empty pipe times out
+(poll-simple) thread_spawn
+(poll-simple) write wakes poll
+(poll-simple) thread_join
+(poll-simple) read the byte
+(poll-simple) POLLHUP after close
+(poll-simple) POLLNVAL for a closed fd
+(poll-simple) exec child-simple
+(child-simple) run
+child-simple: exit(81)
+(poll-simple) child's exit wakes poll
+(poll-simple) wait for child
+(poll-simple) POLLNVAL once waited for
+(poll-simple) end
+poll-simple: exit(0)
+EOF
+pass;
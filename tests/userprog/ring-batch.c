@@ -0,0 +1,85 @@
+/* Opens, writes, reads back, and closes a file through a ring of
+   submissions, several operations per ring_enter(), letting the
+   rings wrap around.  Checks that ring_enter() stops when the
+   completion ring is full. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ENTRIES 8
+#define CHUNK 16
+
+static struct ring_sqe sqes[ENTRIES];
+static struct ring_cqe cqes[ENTRIES];
+static struct ring ring = {ENTRIES, 0, 0, 0, 0, sqes, cqes};
+
+/* Queues an operation. */
+static void
+submit (unsigned op, int fd, void *buf, unsigned len, unsigned user_data)
+{
+  struct ring_sqe *sqe = &sqes[ring.sq_tail++ % ENTRIES];
+
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->buf = buf;
+  sqe->len = len;
+  sqe->user_data = user_data;
+}
+
+/* Takes the next completion, which must be for USER_DATA, and
+   returns its result. */
+static int
+complete (unsigned user_data)
+{
+  struct ring_cqe *cqe;
+
+  if (ring.cq_head == ring.cq_tail)
+    fail ("no completion for operation %u", user_data);
+  cqe = &cqes[ring.cq_head++ % ENTRIES];
+  if (cqe->user_data != user_data)
+    fail ("completion for %u, expected %u", cqe->user_data, user_data);
+  return cqe->res;
+}
+
+void
+test_main (void) 
+{
+  char buf[CHUNK * 6];
+  int fd;
+  unsigned i;
+
+  CHECK (create ("sample.txt", 0), "create \"sample.txt\"");
+  submit (RING_OP_OPEN, 0, "sample.txt", 0, 100);
+  CHECK (ring_enter (&ring, 1) == 1, "ring_enter open");
+  CHECK ((fd = complete (100)) > 1, "open \"sample.txt\"");
+
+  for (i = 0; i < 6; i++)
+    submit (RING_OP_WRITE, fd, (char *) sample + i * CHUNK, CHUNK, i);
+  CHECK (ring_enter (&ring, 6) == 6, "ring_enter 6 writes");
+  for (i = 0; i < 6; i++)
+    if (complete (i) != CHUNK)
+      fail ("write %u was short", i);
+
+  /* Leaves these 8 completions unread, so that the completion ring
+     is full for the next submission. */
+  seek (fd, 0);
+  for (i = 0; i < 6; i++)
+    submit (RING_OP_READ, fd, buf + i * CHUNK, CHUNK, 10 + i);
+  submit (RING_OP_READ, fd, buf, 0, 20);
+  submit (RING_OP_CLOSE, fd, NULL, 0, 21);
+  CHECK (ring_enter (&ring, 8) == 8, "ring_enter 8 operations");
+  submit (RING_OP_READ, fd, buf, 1, 22);
+  CHECK (ring_enter (&ring, 1) == 0, "ring_enter with completions full");
+  for (i = 0; i < 6; i++)
+    if (complete (10 + i) != CHUNK)
+      fail ("read %u was short", i);
+  CHECK (complete (20) == 0, "empty read");
+  CHECK (complete (21) == 0, "close");
+  CHECK (ring_enter (&ring, 1) == 1, "ring_enter after close");
+  CHECK (complete (22) == -1, "read after close fails");
+  if (memcmp (buf, sample, sizeof buf))
+    fail ("read back differs from what was written");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-batch) begin
+(ring-batch) create "sample.txt"
+(ring-batch) ring_enter open
+(ring-batch) open "sample.txt"
+(ring-batch) ring_enter 6 writes
+(ring-batch) ring_enter 8 operations
+(ring-batch) ring_enter with completions full
+(ring-batch) empty read
+(ring-batch) close
+(ring-batch) ring_enter after close
+(ring-batch) read after close fails
+(ring-batch) end
+ring-batch: exit(0)
+EOF
+pass;
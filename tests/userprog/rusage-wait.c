@@ -0,0 +1,56 @@
+/* Forks children that each make a known number of system calls,
+   and checks that wait_rusage() reports them for the child it
+   waits for, and that getrusage (RUSAGE_CHILDREN) sums them for
+   every child collected so far, with wait() as well. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CALL_CNT 50
+
+/* Forks a child that makes CALL_CNT system calls and exits with
+   STATUS, and returns its pid. */
+static pid_t
+fork_child (int status)
+{
+  pid_t pid = fork ();
+
+  if (pid == 0)
+    {
+      struct cputime c;
+      int i;
+
+      for (i = 0; i < CALL_CNT; i++)
+        cputime (&c);
+      exit (status);
+    }
+  if (pid == PID_ERROR)
+    fail ("fork failed");
+  return pid;
+}
+
+void
+test_main (void) 
+{
+  struct rusage child, children, self;
+
+  CHECK (getrusage (RUSAGE_CHILDREN, &children) == 0
+         && children.syscalls == 0, "no children collected yet");
+
+  msg ("wait_rusage = %d", wait_rusage (fork_child (7), &child));
+  CHECK (child.syscalls >= CALL_CNT, "child's system calls counted");
+  CHECK (child.resident == 0, "child holds no frames");
+  getrusage (RUSAGE_CHILDREN, &children);
+  CHECK (children.syscalls == child.syscalls, "children include it");
+
+  msg ("wait = %d", wait (fork_child (8)));
+  getrusage (RUSAGE_CHILDREN, &children);
+  CHECK (children.syscalls >= child.syscalls + CALL_CNT,
+         "children include the one wait() collected");
+
+  getrusage (RUSAGE_SELF, &self);
+  CHECK (self.syscalls > 0 && self.syscalls < children.syscalls,
+         "own system calls counted apart");
+  CHECK (getrusage (1, &self) == -1, "getrusage of nobody fails");
+}
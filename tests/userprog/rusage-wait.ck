@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rusage-wait) begin
+(rusage-wait) no children collected yet
+rusage-wait: exit(7)
+(rusage-wait) wait_rusage = 7
+(rusage-wait) child's system calls counted
+(rusage-wait) child holds no frames
+(rusage-wait) children include it
+rusage-wait: exit(8)
+(rusage-wait) wait = 8
+(rusage-wait) children include the one wait() collected
+(rusage-wait) own system calls counted apart
+(rusage-wait) getrusage of nobody fails
+(rusage-wait) end
+rusage-wait: exit(0)
+EOF
+pass;
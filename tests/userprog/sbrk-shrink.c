@@ -0,0 +1,32 @@
+/* Grows the heap with sbrk(), uses the new pages, which start
+   out zeroed, and shrinks it again.  Touching a page that the
+   heap gave back must kill the process. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char *start, *p;
+  int i;
+
+  start = sbrk (0);
+  CHECK (start != (void *) -1, "sbrk (0)");
+  CHECK (sbrk (4 * 4096) == start, "grow heap by 4 pages");
+  for (i = 0; i < 4 * 4096; i++)
+    if (start[i] != 0)
+      fail ("new heap byte %d is nonzero", i);
+  for (i = 0; i < 4 * 4096; i++)
+    start[i] = i;
+  CHECK (sbrk (-2 * 4096) == start + 4 * 4096, "shrink heap by 2 pages");
+  CHECK (sbrk (0) == start + 2 * 4096, "break moved down");
+  CHECK (sbrk (-8 * 4096) == (void *) -1, "shrinking below heap start fails");
+  CHECK (brk (start + 4096) == 0, "brk to 1 page");
+
+  p = start + 4096;
+  msg ("touching freed page");
+  *(volatile char *) p = 1;
+  fail ("should have exited with -1");
+}
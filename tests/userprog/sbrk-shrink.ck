@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(sbrk-shrink) begin
+(sbrk-shrink) sbrk (0)
+(sbrk-shrink) grow heap by 4 pages
+(sbrk-shrink) shrink heap by 2 pages
+(sbrk-shrink) break moved down
+(sbrk-shrink) shrinking below heap start fails
+(sbrk-shrink) brk to 1 page
+(sbrk-shrink) touching freed page
+sbrk-shrink: exit(-1)
+EOF
+pass;
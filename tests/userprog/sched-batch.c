@@ -0,0 +1,36 @@
+/* Moves this process into the batch scheduling class and back.
+   Checks that each call returns the class it replaced, that a
+   thread spawned afterward starts out batch too, and that an
+   unknown class fails without changing anything. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int child_policy = -1;
+
+static void
+read_policy (void *aux UNUSED) 
+{
+  child_policy = sched_getscheduler ();
+}
+
+void
+test_main (void) 
+{
+  tid_t tid;
+
+  CHECK (sched_getscheduler () == SCHED_NORMAL, "starts normal");
+  CHECK (sched_setscheduler (SCHED_BATCH) == SCHED_NORMAL, "set batch");
+  CHECK (sched_getscheduler () == SCHED_BATCH, "class reads back");
+
+  CHECK ((tid = thread_spawn (read_policy, NULL)) != TID_ERROR,
+         "thread_spawn");
+  CHECK (thread_join (tid) == 0, "thread_join");
+  CHECK (child_policy == SCHED_BATCH, "new thread is batch too");
+
+  CHECK (sched_setscheduler (7) == -1, "unknown class fails");
+  CHECK (sched_getscheduler () == SCHED_BATCH, "class unchanged");
+  CHECK (sched_setscheduler (SCHED_NORMAL) == SCHED_BATCH, "set normal");
+  CHECK (sched_getscheduler () == SCHED_NORMAL, "normal again");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-batch) begin
+(sched-batch) starts normal
+(sched-batch) set batch
+(sched-batch) class reads back
+(sched-batch) thread_spawn
+(sched-batch) thread_join
+(sched-batch) new thread is batch too
+(sched-batch) unknown class fails
+(sched-batch) class unchanged
+(sched-batch) set normal
+(sched-batch) normal again
+(sched-batch) end
+sched-batch: exit(0)
+EOF
+pass;
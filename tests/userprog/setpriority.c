@@ -0,0 +1,35 @@
+/* Lowers this process's priority with setpriority() and nice(),
+   and checks that neither can raise it back, that out-of-range
+   priorities fail, and that a process outside this one's
+   children, like the kernel's main thread, cannot be read or
+   changed. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Tid of the kernel thread that runs the tests. */
+#define MAIN_TID 1
+
+void
+test_main (void) 
+{
+  int p = getpriority (0);
+
+  CHECK (p > 3, "getpriority");
+  CHECK (getpriority (getpid ()) == p, "own pid reads the same");
+  CHECK (setpriority (0, p - 1) == 0, "lower priority");
+  CHECK (getpriority (0) == p - 1, "priority reads back");
+  CHECK (setpriority (0, p) == -1, "raising fails");
+  CHECK (setpriority (0, -1) == -1, "negative priority fails");
+  CHECK (setpriority (0, 64) == -1, "priority above PRI_MAX fails");
+  CHECK (getpriority (0) == p - 1, "priority unchanged");
+
+  CHECK (nice (-1) == -1, "negative nice fails");
+  CHECK (nice (2) == 2, "nice");
+  CHECK (getpriority (0) == p - 3, "nice lowers priority");
+
+  CHECK (getpriority (MAIN_TID) == -1, "kernel thread's priority hidden");
+  CHECK (setpriority (MAIN_TID, 0) == -1,
+         "kernel thread's priority unchangeable");
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(setpriority) begin
+(setpriority) getpriority
+(setpriority) own pid reads the same
+(setpriority) lower priority
+(setpriority) priority reads back
+(setpriority) raising fails
+(setpriority) negative priority fails
+(setpriority) priority above PRI_MAX fails
+(setpriority) priority unchanged
+(setpriority) negative nice fails
+(setpriority) nice
+(setpriority) nice lowers priority
+(setpriority) kernel thread's priority hidden
+(setpriority) kernel thread's priority unchangeable
+(setpriority) end
+setpriority: exit(0)
+EOF
+pass;
@@ -0,0 +1,61 @@
+/* Sleeps until absolute CLOCK_MONOTONIC times, with and without
+   timer slack.  Checks that the clock has reached each deadline
+   on waking, that a deadline in the past returns at once, that
+   timer_slack() reads back what was set, and that an invalid
+   time fails. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Returns CLOCK_MONOTONIC in nanoseconds. */
+static int64_t
+now_ns (void) 
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Sleeps until NS nanoseconds after boot, and returns false if
+   it woke up early. */
+static bool
+sleep_until_ns (int64_t ns) 
+{
+  struct timespec ts;
+
+  ts.tv_sec = ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+  return sleep_until (&ts) == 0 && now_ns () >= ns;
+}
+
+void
+test_main (void) 
+{
+  struct timespec ts;
+  int64_t deadline = now_ns ();
+  int i;
+
+  /* Periodic deadlines, each computed from the last, not from
+     when the sleep returned. */
+  for (i = 0; i < 5; i++)
+    {
+      deadline += 30 * 1000 * 1000;
+      if (!sleep_until_ns (deadline))
+        fail ("woke up early from period %d", i);
+    }
+  msg ("periodic sleeps reach their deadlines");
+
+  CHECK (sleep_until_ns (now_ns () - 1000), "past deadline returns");
+
+  CHECK (timer_slack (-1) == 0, "no slack at first");
+  CHECK (timer_slack (50) == 0, "set slack");
+  CHECK (timer_slack (-1) == 50, "slack reads back");
+  CHECK (sleep_until_ns (now_ns () + 20 * 1000 * 1000),
+         "sleep with slack reaches deadline");
+
+  ts.tv_sec = 0;
+  ts.tv_nsec = 1000000000;
+  CHECK (sleep_until (&ts) == -1, "invalid time fails");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sleep-until) begin
+(sleep-until) periodic sleeps reach their deadlines
+(sleep-until) past deadline returns
+(sleep-until) no slack at first
+(sleep-until) set slack
+(sleep-until) slack reads back
+(sleep-until) sleep with slack reaches deadline
+(sleep-until) invalid time fails
+(sleep-until) end
+sleep-until: exit(0)
+EOF
+pass;
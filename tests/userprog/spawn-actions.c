@@ -0,0 +1,62 @@
+/* Starts child-simple with spawn_actions(), first with the write
+   end of a pipe as its standard output and then with an open
+   file there, and checks that its message arrives through each
+   one.  Also checks that an action on a descriptor that is not
+   open makes spawn_actions() fail. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char expected[] = "(child-simple) run\n";
+
+void
+test_main (void) 
+{
+  struct spawn_action a[3];
+  char buf[64];
+  int fds[2], fd, n, ofs;
+  pid_t pid;
+
+  CHECK (pipe (fds) == 0, "pipe");
+  a[0].type = SPAWN_DUP2;
+  a[0].fd = fds[1];
+  a[0].newfd = STDOUT_FILENO;
+  a[1].type = SPAWN_CLOSE;
+  a[1].fd = fds[0];
+  a[2].type = SPAWN_CLOSE;
+  a[2].fd = fds[1];
+  pid = spawn_actions ("child-simple", a, 3);
+  close (fds[1]);
+
+  /* The child's output fits in the pipe, so wait first to print
+     nothing while it runs. */
+  CHECK (pid != PID_ERROR && wait (pid) == 81,
+         "spawn child-simple onto the pipe");
+  for (ofs = 0; (n = read (fds[0], buf + ofs, sizeof buf - ofs)) > 0; )
+    ofs += n;
+  CHECK (ofs == sizeof expected - 1 && !memcmp (buf, expected, ofs),
+         "read its output from the pipe");
+  close (fds[0]);
+
+  CHECK (create ("out", 0), "create \"out\"");
+  CHECK ((fd = open ("out")) > 1, "open \"out\"");
+  a[0].fd = fd;
+  pid = spawn_actions ("child-simple", a, 1);
+  CHECK (pid != PID_ERROR && wait (pid) == 81,
+         "spawn child-simple onto \"out\"");
+  CHECK (filesize (fd) == sizeof expected - 1, "\"out\" has its output");
+  CHECK (read (fd, buf, sizeof buf) == sizeof expected - 1
+         && !memcmp (buf, expected, sizeof expected - 1),
+         "read its output from \"out\"");
+  close (fd);
+
+  CHECK (spawn_actions ("child-simple", a, 1) == PID_ERROR,
+         "spawn fails to dup a closed fd");
+  a[0].type = SPAWN_CLOSE;
+  a[0].fd = 100;
+  CHECK (spawn_actions ("child-simple", a, 1) == PID_ERROR,
+         "spawn fails to close what it does not inherit");
+}
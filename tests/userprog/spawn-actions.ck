@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(spawn-actions) begin
+(spawn-actions) pipe
+child-simple: exit(81)
+(spawn-actions) spawn child-simple onto the pipe
+(spawn-actions) read its output from the pipe
+(spawn-actions) create "out"
+(spawn-actions) open "out"
+child-simple: exit(81)
+(spawn-actions) spawn child-simple onto "out"
+(spawn-actions) "out" has its output
+(spawn-actions) read its output from "out"
+(spawn-actions) spawn fails to dup a closed fd
+(spawn-actions) spawn fails to close what it does not inherit
+(spawn-actions) end
+spawn-actions: exit(0)
+EOF
+pass;
@@ -0,0 +1,33 @@
+/* Starts several children with spawn(), without waiting for each
+   to load before starting the next, then waits for them all.
+   Also checks that spawn() rejects a missing program and a file
+   that is not an executable before creating a process. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  int fd;
+  int i;
+
+  CHECK (spawn ("no-such-file") == PID_ERROR, "spawn missing program");
+  CHECK (create ("not-elf", 0), "create \"not-elf\"");
+  CHECK ((fd = open ("not-elf")) > 1, "open \"not-elf\"");
+  CHECK (write (fd, "#!/bin/sh\n", 10) == 10, "write \"not-elf\"");
+  close (fd);
+  CHECK (spawn ("not-elf") == PID_ERROR, "spawn non-executable");
+
+  for (i = 0; i < CHILD_CNT; i++)
+    if ((children[i] = spawn ("child-simple")) == PID_ERROR)
+      fail ("spawn child %d failed", i);
+  for (i = 0; i < CHILD_CNT; i++)
+    if (wait (children[i]) != 81)
+      fail ("child %d did not exit with 81", i);
+  msg ("waited for %d children", CHILD_CNT);
+}
@@ -0,0 +1,35 @@
+/* Reads kernel statistics with stat_read().  Checks that the
+   scheduler's start with the timer's tick count, that a short
+   buffer gets a null-terminated prefix and the full length, that
+   the process statistics include this process, and that an
+   unknown name fails. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[16384];
+
+void
+test_main (void) 
+{
+  char self[32];
+  int len;
+
+  len = stat_read ("sched", buf, sizeof buf);
+  CHECK (len > 0 && (size_t) len == strlen (buf), "read \"sched\"");
+  CHECK (!memcmp (buf, "Timer: ", 7), "\"sched\" starts with the timer");
+
+  CHECK (stat_read ("sched", buf, 8) >= len && strlen (buf) == 7,
+         "short buffer gets a prefix");
+  CHECK (stat_read ("sched", NULL, 0) >= len, "empty buffer gets the length");
+
+  snprintf (self, sizeof self, "Process %d (stat-read):", getpid ());
+  CHECK (stat_read ("process", buf, sizeof buf) > 0
+         && strstr (buf, self) != NULL, "\"process\" lists this process");
+
+  CHECK (stat_read ("no-such-stat", buf, sizeof buf) == -1,
+         "unknown name fails");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(stat-read) begin
+(stat-read) read "sched"
+(stat-read) "sched" starts with the timer
+(stat-read) short buffer gets a prefix
+(stat-read) empty buffer gets the length
+(stat-read) "process" lists this process
+(stat-read) unknown name fails
+(stat-read) end
+stat-read: exit(0)
+EOF
+pass;
@@ -0,0 +1,46 @@
+/* Writes a file through a buffered stream, which holds the
+   output until fflush(), and checks what reaches the file.  Then
+   prints a console line in pieces, which reaches the console
+   whole, in order with msg()'s output. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LINE_CNT 100
+
+void
+test_main (void) 
+{
+  char expected[LINE_CNT * 16], actual[sizeof expected];
+  size_t size = 0;
+  FILE *f;
+  int fd, i;
+
+  for (i = 0; i < LINE_CNT; i++)
+    size += snprintf (expected + size, sizeof expected - size,
+                      "line %d\n", i);
+
+  CHECK (create ("buffered", 0), "create \"buffered\"");
+  CHECK ((fd = open ("buffered")) > 1, "open \"buffered\"");
+  CHECK ((f = fdopen (fd, "w")) != NULL, "fdopen");
+  for (i = 0; i < LINE_CNT; i++)
+    fprintf (f, "line %d\n", i);
+  CHECK (filesize (fd) == 0, "nothing written before fflush");
+  CHECK (fflush (f) == 0, "fflush");
+  CHECK (filesize (fd) == (int) size, "whole file written by fflush");
+  CHECK (fclose (f) == 0, "fclose");
+
+  CHECK ((fd = open ("buffered")) > 1, "open \"buffered\" again");
+  CHECK (read (fd, actual, size) == (int) size, "read \"buffered\"");
+  CHECK (memcmp (actual, expected, size) == 0, "contents match");
+  close (fd);
+
+  printf ("(stdio-buffer) console:");
+  for (i = 0; i < 10; i++)
+    printf (" %d", i);
+  putchar ('\n');
+  msg ("after console line");
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(stdio-buffer) begin
+(stdio-buffer) create "buffered"
+(stdio-buffer) open "buffered"
+(stdio-buffer) fdopen
+(stdio-buffer) nothing written before fflush
+(stdio-buffer) fflush
+(stdio-buffer) whole file written by fflush
+(stdio-buffer) fclose
+(stdio-buffer) open "buffered" again
+(stdio-buffer) read "buffered"
+(stdio-buffer) contents match
+(stdio-buffer) console: 0 1 2 3 4 5 6 7 8 9
+(stdio-buffer) after console line
+(stdio-buffer) end
+stdio-buffer: exit(0)
+EOF
+pass;
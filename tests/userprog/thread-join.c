@@ -0,0 +1,28 @@
+/* Starts a thread with thread_spawn, which writes to a global
+   that the main thread sees after thread_join; a second join
+   on the same thread fails. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int value;
+
+static void
+set_value (void *aux) 
+{
+  value = *(int *) aux;
+}
+
+void
+test_main (void) 
+{
+  int arg = 42;
+  tid_t tid;
+
+  CHECK ((tid = thread_spawn (set_value, &arg)) != TID_ERROR,
+         "thread_spawn");
+  CHECK (thread_join (tid) == 0, "thread_join");
+  CHECK (value == 42, "value set by thread");
+  CHECK (thread_join (tid) == -1, "second thread_join fails");
+}
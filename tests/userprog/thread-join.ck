@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(thread-join) begin
+(thread-join) thread_spawn
+(thread-join) thread_join
+(thread-join) value set by thread
+(thread-join) second thread_join fails
+(thread-join) end
+thread-join: exit(0)
+EOF
+pass;
@@ -0,0 +1,50 @@
+/* Starts several children, waits for the first by pid, and then
+   reaps the rest in whatever order they exit with wait_any().
+   Checks that each child is reaped exactly once, that wait_any()
+   fails once no child is left, and that wait() fails for a child
+   wait_any() already reaped. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 4
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  bool reaped[CHILD_CNT];
+  int i;
+
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      if ((children[i] = spawn ("child-simple")) == PID_ERROR)
+        fail ("spawn child %d failed", i);
+      reaped[i] = false;
+    }
+  CHECK (wait (children[0]) == 81, "wait for first child");
+  reaped[0] = true;
+
+  for (i = 1; i < CHILD_CNT; i++)
+    {
+      int status = -1;
+      pid_t pid = wait_any (&status);
+      int j;
+
+      for (j = 0; j < CHILD_CNT; j++)
+        if (children[j] == pid)
+          break;
+      if (j == CHILD_CNT)
+        fail ("wait_any returned %d, not a child", pid);
+      if (reaped[j])
+        fail ("wait_any returned child %d twice", j);
+      if (status != 81)
+        fail ("child %d exited with %d, not 81", j, status);
+      reaped[j] = true;
+    }
+  msg ("reaped %d children with wait_any", CHILD_CNT - 1);
+
+  CHECK (wait_any (NULL) == PID_ERROR, "wait_any with no children left");
+  CHECK (wait (children[1]) == -1, "wait for reaped child");
+}
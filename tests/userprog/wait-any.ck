@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The children run while the parent goes on, so their output may
+# come between its lines.
+my ($runs) = scalar (grep ($_ eq '(child-simple) run', @output));
+my ($exits) = scalar (grep ($_ eq 'child-simple: exit(81)', @output));
+fail "child-simple ran $runs times and exited $exits times, expected 4\n"
+  if $runs != 4 || $exits != 4;
+@output = grep ($_ ne '(child-simple) run'
+                && $_ ne 'child-simple: exit(81)', @output);
+
+compare_output ("run", \@output, [<<'EOF']);
+(wait-any) begin
+(wait-any) wait for first child
+(wait-any) reaped 3 children with wait_any
+(wait-any) wait_any with no children left
+(wait-any) wait for reaped child
+(wait-any) end
+wait-any: exit(0)
+EOF
+pass;
@@ -0,0 +1,32 @@
+/* Hands the CPU directly to a thread this process just spawned,
+   which sets a global and exits before this thread runs again.
+   Checks that yielding to itself, to a thread that is not ready,
+   and to a tid that does not exist all fail. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static volatile int value;
+
+static void
+set_value (void *aux UNUSED) 
+{
+  value = 42;
+}
+
+void
+test_main (void) 
+{
+  tid_t tid;
+
+  CHECK ((tid = thread_spawn (set_value, NULL)) != TID_ERROR,
+         "thread_spawn");
+  CHECK (yield_to (tid) == 0, "yield_to new thread");
+  CHECK (value == 42, "new thread ran first");
+  CHECK (yield_to (tid) == -1, "yield_to exited thread fails");
+  CHECK (thread_join (tid) == 0, "thread_join");
+
+  CHECK (yield_to (gettid ()) == -1, "yield_to self fails");
+  CHECK (yield_to (12345) == -1, "yield_to missing tid fails");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(yield-to) begin
+(yield-to) thread_spawn
+(yield-to) yield_to new thread
+(yield-to) new thread ran first
+(yield-to) yield_to exited thread fails
+(yield-to) thread_join
+(yield-to) yield_to self fails
+(yield-to) yield_to missing tid fails
+(yield-to) end
+yield-to: exit(0)
+EOF
+pass;
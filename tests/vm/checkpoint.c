@@ -0,0 +1,39 @@
+/* Checkpoints the process to an image, changes its memory and
+   restores the image.  The restored process resumes from
+   checkpoint() with the memory it had then, and with its open
+   file at the same position, while the original's changes stay
+   its own. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int value = 1;
+
+void
+test_main (void)
+{
+  char buf[4];
+  int fd, r;
+
+  CHECK (create ("data", 8), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, "abcdefgh", 8) == 8, "write \"data\"");
+  seek (fd, 4);
+  value = 2;
+
+  r = checkpoint ("image");
+  if (r == 1)
+    {
+      /* Restored, so nothing printed here can race with the
+         original. */
+      exit (value == 2 && read (fd, buf, 4) == 4
+            && !memcmp (buf, "efgh", 4) ? 81 : 1);
+    }
+  CHECK (r == 0, "checkpoint \"image\"");
+
+  value = 3;
+  msg ("wait(restore(\"image\")) = %d", wait (restore ("image")));
+  CHECK (value == 3, "restored process's memory is its own");
+}
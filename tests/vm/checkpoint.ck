@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(checkpoint) begin
+(checkpoint) create "data"
+(checkpoint) open "data"
+(checkpoint) write "data"
+(checkpoint) checkpoint "image"
+checkpoint: exit(81)
+(checkpoint) wait(restore("image")) = 81
+(checkpoint) restored process's memory is its own
+(checkpoint) end
+checkpoint: exit(0)
+EOF
+pass;
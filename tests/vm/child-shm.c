@@ -0,0 +1,37 @@
+/* Child process of shm-exec.
+   Maps the segment that shm-exec opened and doubles each value
+   passed to it, until told to stop.  Exits with the number of
+   values it doubled. */
+
+#include <syscall.h>
+#include "tests/vm/shm.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-shm";
+
+int
+main (void)
+{
+  struct shm_ring *ring = (struct shm_ring *) 0x20000000;
+  int shmid, rounds = 0, turn;
+
+  /* Opening with size 0 finds the segment but cannot create it. */
+  shmid = shm_open (SHM_RING_NAME, 0);
+  if (shmid < 0)
+    fail ("shm_open \"%s\" failed", SHM_RING_NAME);
+  if (shm_map (shmid, ring) != ring)
+    fail ("shm_map failed");
+
+  for (;;)
+    {
+      while ((turn = ring->turn) == SHM_PRODUCER)
+        futex_wait (&ring->turn, turn);
+      if (turn == SHM_DONE)
+        break;
+      ring->value *= 2;
+      rounds++;
+      ring->turn = SHM_PRODUCER;
+      futex_wake (&ring->turn, 1);
+    }
+  return rounds;
+}
@@ -0,0 +1,63 @@
+/* Fills many pages with the same bytes and waits for same-page
+   merging, which the kernel runs with -ksm, to share them, as
+   seen in the frames the process holds.  Then writes to one of
+   them, which must give it a copy of its own and leave the
+   others alone. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 32
+
+static char buf[PAGE_CNT][4096];
+static char stats[16384];
+
+/* Sleeps for MS milliseconds. */
+static void
+sleep_ms (int ms) 
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  ts.tv_nsec += ms * 1000000L;
+  ts.tv_sec += ts.tv_nsec / 1000000000;
+  ts.tv_nsec %= 1000000000;
+  sleep_until (&ts);
+}
+
+void
+test_main (void)
+{
+  struct rusage before, now;
+  size_t i, j;
+  int tries;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    memset (buf[i], 'k', sizeof buf[i]);
+  getrusage (RUSAGE_SELF, &before);
+
+  /* Merging waits for a page to keep its contents for a whole
+     sweep of the frame table, so give it a few sweeps. */
+  for (tries = 0; tries < 300; tries++)
+    {
+      getrusage (RUSAGE_SELF, &now);
+      if (now.resident + PAGE_CNT / 2 <= before.resident)
+        break;
+      sleep_ms (100);
+    }
+  CHECK (now.resident + PAGE_CNT / 2 <= before.resident,
+         "identical pages merged");
+
+  buf[0][0] = 'x';
+  CHECK (buf[0][0] == 'x' && buf[1][0] == 'k', "write breaks sharing");
+  for (i = 0; i < PAGE_CNT; i++)
+    for (j = i == 0 ? 1 : 0; j < sizeof buf[i]; j++)
+      if (buf[i][j] != 'k')
+        fail ("byte %zu of page %zu is %d", j, i, buf[i][j]);
+  msg ("other bytes unchanged");
+
+  CHECK (stat_read ("memory", stats, sizeof stats) > 0
+         && strstr (stats, "KSM: ") != NULL, "memory statistics report KSM");
+}
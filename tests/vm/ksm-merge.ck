@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(ksm-merge) begin
+(ksm-merge) identical pages merged
+(ksm-merge) write breaks sharing
+(ksm-merge) other bytes unchanged
+(ksm-merge) memory statistics report KSM
+(ksm-merge) end
+EOF
+pass;
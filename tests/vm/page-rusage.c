@@ -0,0 +1,32 @@
+/* Touches pages of an uninitialized array from the last to the
+   first, so that each write takes a fault of its own, and checks
+   that getrusage() counts the faults and the frames. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_CNT 64
+
+static char buf[PAGE_CNT * 4096];
+
+void
+test_main (void)
+{
+  struct rusage before, after;
+  int i;
+
+  getrusage (RUSAGE_SELF, &before);
+  for (i = PAGE_CNT - 1; i >= 0; i--)
+    buf[i * 4096] = i;
+  getrusage (RUSAGE_SELF, &after);
+
+  CHECK (after.minor_faults - before.minor_faults >= PAGE_CNT,
+         "minor faults counted");
+  CHECK (after.major_faults == before.major_faults,
+         "no major faults for zero-filled pages");
+  CHECK (after.resident - before.resident >= PAGE_CNT,
+         "resident frames counted");
+  CHECK (after.peak_resident >= after.resident,
+         "peak at least resident");
+}
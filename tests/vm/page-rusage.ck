@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-rusage) begin
+(page-rusage) minor faults counted
+(page-rusage) no major faults for zero-filled pages
+(page-rusage) resident frames counted
+(page-rusage) peak at least resident
+(page-rusage) end
+EOF
+pass;
@@ -0,0 +1,37 @@
+/* Opens a shared memory segment and runs child-shm, which maps
+   the same segment at another address, as a consumer that
+   doubles each value the producer passes it.  The two take turns
+   through a word in the segment, sleeping on it with futexes. */
+
+#include <syscall.h>
+#include "tests/vm/shm.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct shm_ring *ring = (struct shm_ring *) 0x10000000;
+  int shmid, i, turn;
+  pid_t child;
+
+  CHECK ((shmid = shm_open (SHM_RING_NAME, sizeof *ring)) >= 0,
+         "shm_open \"%s\"", SHM_RING_NAME);
+  CHECK (shm_map (shmid, ring) == ring, "shm_map");
+  CHECK ((child = exec ("child-shm")) != -1, "exec \"child-shm\"");
+
+  for (i = 0; i < SHM_ROUNDS; i++)
+    {
+      ring->value = i;
+      ring->turn = SHM_CONSUMER;
+      futex_wake (&ring->turn, 1);
+      while ((turn = ring->turn) != SHM_PRODUCER)
+        futex_wait (&ring->turn, turn);
+      if (ring->value != 2 * i)
+        fail ("round %d: consumer returned %d", i, ring->value);
+    }
+  ring->turn = SHM_DONE;
+  futex_wake (&ring->turn, 1);
+  CHECK (wait (child) == SHM_ROUNDS, "wait for child");
+  CHECK (shm_unmap (ring) == 0, "shm_unmap");
+}
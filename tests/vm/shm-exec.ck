@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-exec) begin
+(shm-exec) shm_open "shm-ring"
+(shm-exec) shm_map
+(shm-exec) exec "child-shm"
+child-shm: exit(100)
+(shm-exec) wait for child
+(shm-exec) shm_unmap
+(shm-exec) end
+shm-exec: exit(0)
+EOF
+pass;
@@ -0,0 +1,37 @@
+/* Maps a shared memory segment and forks.  Unlike private
+   pages, which fork() copies, the segment stays shared, so each
+   process sees what the other writes. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int private = 1;
+
+void
+test_main (void)
+{
+  int *shared = (int *) 0x10000000;
+  int shmid;
+  pid_t pid;
+
+  CHECK ((shmid = shm_open ("fork", sizeof *shared)) >= 0,
+         "shm_open \"fork\"");
+  CHECK (shm_map (shmid, shared) == shared, "shm_map");
+  *shared = 1;
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      if (*shared != 1)
+        fail ("child sees %d", *shared);
+      *shared = 2;
+      private = 2;
+      exit (42);
+    }
+  if (pid == PID_ERROR)
+    fail ("fork failed");
+  msg ("wait(fork()) = %d", wait (pid));
+  CHECK (*shared == 2, "child's write to shared memory is seen");
+  CHECK (private == 1, "child's write to private memory is not");
+}
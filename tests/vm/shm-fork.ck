@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-fork) begin
+(shm-fork) shm_open "fork"
+(shm-fork) shm_map
+shm-fork: exit(42)
+(shm-fork) wait(fork()) = 42
+(shm-fork) child's write to shared memory is seen
+(shm-fork) child's write to private memory is not
+(shm-fork) end
+shm-fork: exit(0)
+EOF
+pass;
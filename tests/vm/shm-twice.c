@@ -0,0 +1,41 @@
+/* Maps one shared memory segment twice, checks that a write
+   through either mapping shows through the other, that the
+   segment cannot be mapped over itself, and that unmapping one
+   mapping leaves the other intact.  Then touches the unmapped
+   one, which must kill the process. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (3 * 4096)
+
+void
+test_main (void)
+{
+  char *a = (char *) 0x10000000;
+  char *b = (char *) 0x20000000;
+  int shmid;
+
+  CHECK ((shmid = shm_open ("twice", SIZE)) >= 0, "shm_open \"twice\"");
+  CHECK (shm_open ("twice", SIZE) == shmid, "shm_open \"twice\" again");
+  CHECK (shm_open ("twice", SIZE + 1) == -1, "shm_open \"twice\" larger");
+  CHECK (shm_map (shmid, a) == a, "shm_map at a");
+  CHECK (shm_map (shmid, b) == b, "shm_map at b");
+  CHECK (shm_map (shmid, a + 4096) == NULL, "shm_map over a");
+
+  memset (a, 'a', SIZE);
+  memset (b + 4096, 'b', 4096);
+  if (a[0] != 'a' || a[4096] != 'b' || b[SIZE - 1] != 'a')
+    fail ("mappings differ");
+
+  CHECK (shm_unmap (a + 4096) == -1, "shm_unmap in the middle of a");
+  CHECK (shm_unmap (a) == 0, "shm_unmap a");
+  if (b[0] != 'a' || b[4096] != 'b')
+    fail ("b changed when a was unmapped");
+
+  msg ("touching a");
+  a[0] = 'x';
+  fail ("wrote to unmapped shared memory");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(shm-twice) begin
+(shm-twice) shm_open "twice"
+(shm-twice) shm_open "twice" again
+(shm-twice) shm_open "twice" larger
+(shm-twice) shm_map at a
+(shm-twice) shm_map at b
+(shm-twice) shm_map over a
+(shm-twice) shm_unmap in the middle of a
+(shm-twice) shm_unmap a
+(shm-twice) touching a
+shm-twice: exit(-1)
+EOF
+pass;
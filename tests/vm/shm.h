@@ -0,0 +1,24 @@
+#ifndef TESTS_VM_SHM_H
+#define TESTS_VM_SHM_H
+
+/* Segment shared by shm-exec and child-shm. */
+#define SHM_RING_NAME "shm-ring"
+
+/* Values passed back and forth. */
+#define SHM_ROUNDS 100
+
+/* Whose turn it is. */
+enum
+  {
+    SHM_PRODUCER,
+    SHM_CONSUMER,
+    SHM_DONE
+  };
+
+struct shm_ring
+  {
+    int turn;
+    int value;
+  };
+
+#endif /* tests/vm/shm.h */
@@ -14,28 +14,52 @@
 #include "devices/shutdown.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "devices/virtio-balloon.h"
+#include "devices/virtio-console.h"
 #include "devices/rtc.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/kexec.h"
+#include "threads/kinfo.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/pmu.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #else
 #include "tests/threads/tests.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/ksm.h"
+#include "vm/page.h"
+#include "vm/share.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+#include "vm/zswap.h"
+#endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/stripe.h"
+#include "devices/virtio-blk.h"
+#include "filesys/checksum.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/initramfs.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -45,6 +69,9 @@ uint32_t *init_page_dir;
 /* -f: Format the file system? */
 static bool format_filesys;
 
+/* -initrd: Load the archive on the scratch device into memory? */
+static bool load_initramfs;
+
 /* -filesys, -scratch, -swap: Names of block devices to use,
    overriding the defaults. */
 static const char *filesys_bdev_name;
@@ -52,11 +79,34 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -stripe: Names of the block devices to stripe together. */
+static char *stripe_bdev_names;
+
+/* -ramdisk: Size of the RAM disk "ram0" in kB, or 0 for none. */
+static size_t ramdisk_kb;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -boot-stats: Print the time spent in each boot phase? */
+static bool boot_stats;
+
+/* Names of the boot phases, indexed by enum boot_phase. */
+static const char *boot_phase_names[BOOT_PHASE_CNT] =
+  {
+    "firmware", "early", "palloc", "malloc", "paging", "devices",
+    "threads", "calibrate", "disks", "partitions", "filesys",
+    "actions", "run",
+  };
+
+/* Cycles spent in each boot phase so far, the current phase,
+   and the time stamp at which it became current. */
+static uint64_t phase_cycles[BOOT_PHASE_CNT];
+static enum boot_phase cur_phase;
+static uint64_t phase_start;
+
 static void bss_init (void);
 static void paging_init (void);
 
@@ -64,10 +114,12 @@ static char **read_command_line (void);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
 static void usage (void);
+static void print_boot_stats (void);
 
 #ifdef FILESYS
 static void locate_block_devices (void);
 static void locate_block_device (enum block_type, const char *name);
+static void create_stripe (char *names);
 #endif
 
 int pintos_init (void) NO_RETURN;
@@ -76,11 +128,19 @@ int pintos_init (void) NO_RETURN;
 int
 pintos_init (void)
 {
+  uint64_t start = rdtsc ();
   char **argv;
 
   /* Clear BSS. */  
   bss_init ();
 
+  /* Every cycle since reset until now belongs to the firmware
+     and the loader, or, after a warm restart, since the kernel
+     that restarted jumped here, to the jump. */
+  phase_cycles[BOOT_FIRMWARE] = start - kexec_init ();
+  phase_start = start;
+  cur_phase = BOOT_EARLY;
+
   /* Break command line into arguments and parse options. */
   argv = read_command_line ();
   argv = parse_options (argv);
@@ -95,9 +155,16 @@ pintos_init (void)
           init_ram_pages * PGSIZE / 1024);
 
   /* Initialize memory system. */
+  boot_phase (BOOT_PALLOC);
   palloc_init (user_page_limit);
+  boot_phase (BOOT_MALLOC);
   malloc_init ();
+  boot_phase (BOOT_PAGING);
   paging_init ();
+  boot_phase (BOOT_DEVICES);
+  kinfo_init ();
+  pmu_init ();
+  profile_init ();
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -107,24 +174,49 @@ pintos_init (void)
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  workqueue_init ();
   timer_init ();
   kbd_init ();
   input_init ();
+  virtio_console_init ();
 #ifdef USERPROG
   exception_init ();
+  pagedir_init ();
+  process_init ();
   syscall_init ();
 #endif
+#ifdef VM
+  frame_init ();
+  page_init ();
+  share_init ();
+  shm_init ();
+#endif
 
   /* Start thread scheduler and enable interrupts. */
+  boot_phase (BOOT_THREADS);
   thread_start ();
+  workqueue_start ();
+  palloc_start_zeroing ();
   serial_init_queue ();
+  boot_phase (BOOT_CALIBRATE);
   timer_calibrate ();
+  virtio_balloon_init ();
 
 #ifdef FILESYS
   /* Initialize file system. */
+  boot_phase (BOOT_DISKS);
   ide_init ();
+  virtio_blk_init ();
+  boot_phase (BOOT_FILESYS);
   locate_block_devices ();
   filesys_init (format_filesys);
+  if (load_initramfs)
+    initramfs_load (block_get_role (BLOCK_SCRATCH));
+#ifdef VM
+  swap_init ();
+  frame_start_reclaim ();
+  ksm_start ();
+#endif
 #endif
 
   printf ("Boot complete.\n");
@@ -137,10 +229,59 @@ pintos_init (void)
   }
 
   /* Finish up. */
+  if (boot_stats)
+    print_boot_stats ();
   shutdown ();
   thread_exit ();
 }
 
+/* Charges the cycles since the last switch to the current boot
+   phase, makes PHASE current, and returns the phase that was
+   current before, so that a phase nested inside another, like
+   partition_scan() inside ide_init(), can switch back when it
+   is done.  Only the initial thread calls this. */
+enum boot_phase
+boot_phase (enum boot_phase phase)
+{
+  enum boot_phase old = cur_phase;
+  uint64_t now = rdtsc ();
+
+  ASSERT (phase < BOOT_PHASE_CNT);
+  phase_cycles[old] += now - phase_start;
+  phase_start = now;
+  cur_phase = phase;
+  TRACE (TRACE_BOOT_PHASE, phase);
+  return old;
+}
+
+/* Prints a "Boot:" line for CYCLES spent in phase NAME. */
+static void
+print_boot_phase (const char *name, uint64_t cycles)
+{
+  uint64_t hz = timer_tsc_hz ();
+
+  printf ("Boot: %-10s %'16"PRIu64" cycles %'12"PRIu64" us\n",
+          name, cycles, hz != 0 ? cycles * 1000000 / hz : 0);
+}
+
+/* Prints the cycles and microseconds spent in each boot phase
+   that took any time, then the total. */
+static void
+print_boot_stats (void)
+{
+  uint64_t total = 0;
+  int i;
+
+  boot_phase (cur_phase);
+  for (i = 0; i < BOOT_PHASE_CNT; i++)
+    if (phase_cycles[i] != 0)
+      {
+        print_boot_phase (boot_phase_names[i], phase_cycles[i]);
+        total += phase_cycles[i];
+      }
+  print_boot_phase ("total", total);
+}
+
 /* Clear the "BSS", a segment that should be initialized to
    zeros.  It isn't actually stored on disk or zeroed by the
    kernel loader, so we have to zero it ourselves.
@@ -154,18 +295,41 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* CR4 bits.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR4_PSE 0x10            /* Page size extensions (4 MB pages). */
+#define CR4_PGE 0x80            /* Global pages. */
+
+/* CPUID leaf 1 feature bits in EDX.  See [IA32-v2a] "CPUID". */
+#define CPUID_PSE 0x008         /* Supports CR4.PSE. */
+#define CPUID_PGE 0x2000        /* Supports CR4.PGE. */
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports them, every 4 MB region of RAM that holds
+   no kernel text, which must stay read-only, is mapped by a
+   single 4 MB PDE, and all kernel mappings are global.  Process
+   page directories share these entries, so the TLB keeps kernel
+   translations when CR3 is reloaded on a switch between
+   processes and only user translations are flushed. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  uint32_t eax, ebx, ecx, edx, cr4;
+  uint32_t global;
+  bool pse;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  pse = (edx & CPUID_PSE) != 0;
+  global = edx & CPUID_PGE ? PTE_G : 0;
 
-  pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  pd = init_page_dir = palloc_get_page_tagged (PAL_ASSERT | PAL_ZERO,
+                                                MEM_PAGEDIR);
   pt = NULL;
   for (page = 0; page < init_ram_pages; page++)
     {
@@ -175,15 +339,33 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (pse && pte_idx == 0
+          && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true) | global;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
-          pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+          pt = palloc_get_page_tagged (PAL_ASSERT | PAL_ZERO, MEM_PAGEDIR);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
+  /* Turn on 4 MB pages and global pages before the new page
+     directory, which uses them, takes effect. */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if (pse)
+    cr4 |= CR4_PSE;
+  if (global)
+    cr4 |= CR4_PGE;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
@@ -247,22 +429,56 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-checksums"))
+        checksum_format = true;
+      else if (!strcmp (name, "-initrd"))
+        load_initramfs = true;
+      else if (!strcmp (name, "-kexec"))
+        shutdown_configure_kexec (value);
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-pio"))
+        ide_use_dma = false;
+      else if (!strcmp (name, "-stripe"))
+        stripe_bdev_names = value;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_kb = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-zswap"))
+        zswap_max_pages = atoi (value);
+      else if (!strcmp (name, "-ksm"))
+        ksm_enabled = true;
 #endif
 #endif
+      else if (!strcmp (name, "-vconsole-mirror"))
+        virtio_console_mirror = true;
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-trace"))
+        trace_enabled = true;
+      else if (!strcmp (name, "-boot-stats"))
+        boot_stats = true;
+      else if (!strcmp (name, "-profile"))
+        profile_enabled = true;
+      else if (!strcmp (name, "-pmu"))
+        pmu_events = value;
+      else if (!strcmp (name, "-heap-profile"))
+        malloc_sample_rate = atoi (value);
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-stack"))
+        process_stack_pages = atoi (value);
+      else if (!strcmp (name, "-rusage"))
+        process_print_rusage = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -319,6 +535,8 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"trace", 2, fsutil_trace},
+      {"defrag", 1, fsutil_defrag},
 #endif
       {NULL, 0, NULL},
     };
@@ -341,6 +559,7 @@ run_actions (char **argv)
           PANIC ("action `%s' requires %d argument(s)", *argv, a->argc - 1);
 
       /* Invoke action and advance. */
+      boot_phase (a->function == run_task ? BOOT_RUN : BOOT_ACTIONS);
       a->function (argv);
       argv += a->argc;
     }
@@ -368,6 +587,8 @@ usage (void)
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
+          "  trace FILE         Save the -trace event ring to FILE.\n"
+          "  defrag             Defragment every fragmented file.\n"
 #endif
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
@@ -375,16 +596,35 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -checksums         Keep block checksums on a disk made by -f.\n"
+          "  -initrd            Run files from scratch device's archive in RAM.\n"
+          "  -kexec=FILE        Restart into kernel FILE after actions, no BIOS.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -pio               Transfer IDE disk data by PIO, not DMA.\n"
+          "  -stripe=BDEV,...   Join BDEVs into striped device \"stripe\".\n"
+          "  -ramdisk=KB        Create RAM disk \"ram0\" of KB kB.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -zswap=PAGES       Cache up to PAGES of compressed swap in RAM.\n"
+          "  -ksm               Merge identical private pages of processes.\n"
 #endif
 #endif
+          "  -vconsole-mirror   Copy virtio console output to the serial port.\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the periodic timer tick while idle.\n"
+          "  -trace             Record scheduler, lock, and interrupt events.\n"
+          "  -boot-stats        Print the time spent in each boot phase.\n"
+          "  -profile           Sample the running code on every timer tick.\n"
+          "  -pmu=EVENT[,EVENT] Count EVENTs in performance counters: cycles,\n"
+          "                     instructions, ref-cycles, llc-refs, llc-misses,\n"
+          "                     branches, branch-misses.\n"
+          "  -heap-profile=N    Sample one in N malloc() calls, by call site.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -stack=COUNT       Let user stacks grow to COUNT pages.\n"
+          "  -rusage            Print each process's memory use at exit.\n"
 #endif
           );
   shutdown_power_off ();
@@ -395,6 +635,10 @@ usage (void)
 static void
 locate_block_devices (void)
 {
+  if (ramdisk_kb > 0)
+    ramdisk_create ("ram0", ramdisk_kb * (1024 / BLOCK_SECTOR_SIZE));
+  if (stripe_bdev_names != NULL)
+    create_stripe (stripe_bdev_names);
   locate_block_device (BLOCK_FILESYS, filesys_bdev_name);
   locate_block_device (BLOCK_SCRATCH, scratch_bdev_name);
 #ifdef VM
@@ -402,6 +646,28 @@ locate_block_devices (void)
 #endif
 }
 
+/* Creates a stripe set named "stripe" from the block devices
+   named in NAMES, separated by commas. */
+static void
+create_stripe (char *names)
+{
+  struct block *members[STRIPE_MAX];
+  size_t cnt = 0;
+  char *name, *save_ptr;
+
+  for (name = strtok_r (names, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      if (cnt >= STRIPE_MAX)
+        PANIC ("Too many devices to stripe (at most %d)", STRIPE_MAX);
+      members[cnt] = block_get_by_name (name);
+      if (members[cnt] == NULL)
+        PANIC ("No such block device \"%s\"", name);
+      cnt++;
+    }
+  stripe_create ("stripe", members, cnt);
+}
+
 /* Figures out what block device to use for the given ROLE: the
    block device with the given NAME, if NAME is non-null,
    otherwise the first block device in probe order of type
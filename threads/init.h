@@ -9,4 +9,28 @@
 /* Page directory with kernel mappings only. */
 extern uint32_t *init_page_dir;
 
+/* Phases of booting and running the kernel.  The cycles spent in
+   each are printed with -boot-stats, and each switch is traced
+   as TRACE_BOOT_PHASE with the new phase as argument.
+   utils/trace-timeline has a copy of the names. */
+enum boot_phase
+  {
+    BOOT_FIRMWARE,              /* BIOS and loader, before the kernel. */
+    BOOT_EARLY,                 /* Command line, threads, console. */
+    BOOT_PALLOC,                /* palloc_init(). */
+    BOOT_MALLOC,                /* malloc_init(). */
+    BOOT_PAGING,                /* paging_init(). */
+    BOOT_DEVICES,               /* Interrupts, timer, other subsystems. */
+    BOOT_THREADS,               /* Starting the scheduler and workers. */
+    BOOT_CALIBRATE,             /* timer_calibrate(). */
+    BOOT_DISKS,                 /* Probing disks, but not partitions. */
+    BOOT_PARTITIONS,            /* partition_scan(). */
+    BOOT_FILESYS,               /* filesys_init(), including -f. */
+    BOOT_ACTIONS,               /* Actions other than `run'. */
+    BOOT_RUN,                   /* `run' actions. */
+    BOOT_PHASE_CNT
+  };
+
+enum boot_phase boot_phase (enum boot_phase);
+
 #endif /* threads/init.h */
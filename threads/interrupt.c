@@ -7,8 +7,13 @@
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
 
 /* Programmable Interrupt Controller (PIC) registers.
    A PC has two PICs, called the master and slave PICs, with the
@@ -33,10 +38,49 @@ static intr_handler_func *intr_handlers[INTR_CNT];
 /* Names for each interrupt, for debugging purposes. */
 static const char *intr_names[INTR_CNT];
 
+/* Handlers of external interrupts that PCI devices share, each
+   called in turn by shared_interrupt(). */
+#define SHARED_MAX 4
+static intr_handler_func *shared_handlers[16][SHARED_MAX];
+static size_t shared_cnt[16];
+
 /* Number of unexpected interrupts for each vector.  An
    unexpected interrupt is one that has no registered handler. */
 static unsigned int unexpected_cnt[INTR_CNT];
 
+/* Number of interrupts for each vector, and the cycles spent in
+   their handlers, in total and the longest.  For interrupts that
+   run with interrupts on, such as system calls, this includes
+   time spent blocked. */
+static uint64_t intr_cnt[INTR_CNT];
+static uint64_t intr_cycles[INTR_CNT];
+static uint64_t intr_max_cycles[INTR_CNT];
+
+#ifdef INTR_PROFILE
+/* Code that turned interrupts off, and how long it kept them
+   off, in total and the longest. */
+struct off_site
+  {
+    void *caller;               /* Return address of intr_disable(). */
+    uint64_t cnt;               /* Times interrupts were turned off. */
+    uint64_t cycles;            /* Total cycles with interrupts off. */
+    uint64_t max_cycles;        /* Longest time with interrupts off. */
+  };
+
+/* Hash table of callers, by address, with linear probing.
+   Sections from callers that do not fit are only counted. */
+#define OFF_SITES 128
+static struct off_site off_sites[OFF_SITES];
+static uint64_t off_dropped;
+
+/* Caller that turned interrupts off, if we are timing it, and
+   when. */
+static void *off_caller;
+static uint64_t off_start;
+
+static void intr_off_end (void);
+#endif
+
 /* External interrupts are those generated by devices outside the
    CPU, such as the timer.  External interrupts run with
    interrupts turned off, so they never nest, nor are they ever
@@ -58,6 +102,7 @@ static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
+static void shared_interrupt (struct intr_frame *);
 static void unexpected_interrupt (const struct intr_frame *);
 
 /* Returns the current interrupt status. */
@@ -80,7 +125,15 @@ intr_get_level (void)
 enum intr_level
 intr_set_level (enum intr_level level) 
 {
-  return level == INTR_ON ? intr_enable () : intr_disable ();
+  enum intr_level old_level;
+
+  old_level = level == INTR_ON ? intr_enable () : intr_disable ();
+#ifdef INTR_PROFILE
+  /* Blame our caller, not us. */
+  if (level == INTR_OFF && old_level == INTR_ON)
+    off_caller = __builtin_return_address (0);
+#endif
+  return old_level;
 }
 
 /* Enables interrupts and returns the previous interrupt status. */
@@ -90,6 +143,11 @@ intr_enable (void)
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+#ifdef INTR_PROFILE
+  if (old_level == INTR_OFF)
+    intr_off_end ();
+#endif
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -110,6 +168,14 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+#ifdef INTR_PROFILE
+  if (old_level == INTR_ON)
+    {
+      off_caller = __builtin_return_address (0);
+      off_start = rdtsc ();
+    }
+#endif
+
   return old_level;
 }
 
@@ -185,6 +251,25 @@ intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
+/* Registers external interrupt VEC_NO, which other devices may
+   also raise, as a PCI interrupt line can be, to invoke HANDLER
+   along with the handlers that they register for it the same
+   way.  Each handler must check whether its own device needs
+   attention.  The interrupt is named NAME after the first. */
+void
+intr_register_ext_shared (uint8_t vec_no, intr_handler_func *handler,
+                          const char *name) 
+{
+  size_t irq = vec_no - 0x20;
+
+  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+  ASSERT (shared_cnt[irq] < SHARED_MAX);
+  if (shared_cnt[irq] == 0)
+    register_handler (vec_no, 0, INTR_OFF, shared_interrupt, name);
+  ASSERT (intr_handlers[vec_no] == shared_interrupt);
+  shared_handlers[irq][shared_cnt[irq]++] = handler;
+}
+
 /* Registers internal interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The interrupt handler
    will be invoked with interrupt status LEVEL.
@@ -346,6 +431,7 @@ intr_handler (struct intr_frame *frame)
 {
   bool external;
   intr_handler_func *handler;
+  uint64_t start, cycles;
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
@@ -359,9 +445,23 @@ intr_handler (struct intr_frame *frame)
 
       in_external_intr = true;
       yield_on_return = false;
+#ifdef INTR_PROFILE
+      /* Interrupts were on, so whoever turned them off last has
+         already turned them back on, perhaps by returning from
+         an interrupt.  We can't time that. */
+      off_caller = NULL;
+#endif
     }
 
+  TRACE (TRACE_INTR_ENTER, frame->vec_no);
+
+  /* Charge the time since the last crossing to user mode if we
+     came from ring 3, which includes every system call. */
+  if ((frame->cs & 3) == 3)
+    thread_account_cycles (true);
+
   /* Invoke the interrupt's handler. */
+  start = rdtsc ();
   handler = intr_handlers[frame->vec_no];
   if (handler != NULL)
     handler (frame);
@@ -373,6 +473,13 @@ intr_handler (struct intr_frame *frame)
     }
   else
     unexpected_interrupt (frame);
+  cycles = rdtsc () - start;
+  intr_cnt[frame->vec_no]++;
+  intr_cycles[frame->vec_no] += cycles;
+  if (cycles > intr_max_cycles[frame->vec_no])
+    intr_max_cycles[frame->vec_no] = cycles;
+
+  TRACE (TRACE_INTR_EXIT, frame->vec_no);
 
   /* Complete the processing of an external interrupt. */
   if (external) 
@@ -386,6 +493,29 @@ intr_handler (struct intr_frame *frame)
       if (yield_on_return) 
         thread_yield (); 
     }
+
+  /* Charge the time spent handling it to kernel mode if we are
+     about to return to ring 3. */
+  if ((frame->cs & 3) == 3)
+    {
+      thread_account_cycles (false);
+#ifdef USERPROG
+      /* Another thread of this process may have called exit(). */
+      process_check_exit ();
+#endif
+    }
+}
+
+/* Calls each handler registered for the shared external interrupt
+   in F. */
+static void
+shared_interrupt (struct intr_frame *f) 
+{
+  size_t irq = f->vec_no - 0x20;
+  size_t i;
+
+  for (i = 0; i < shared_cnt[irq]; i++)
+    shared_handlers[irq][i] (f);
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -436,3 +566,98 @@ intr_name (uint8_t vec)
 {
   return intr_names[vec];
 }
+
+#ifdef INTR_PROFILE
+/* Charges the time since interrupts were turned off to the
+   caller that did it.  Interrupts must still be off. */
+static void
+intr_off_end (void)
+{
+  uint64_t cycles = rdtsc () - off_start;
+  void *caller = off_caller;
+  uintptr_t hash = (uintptr_t) caller;
+  struct off_site *s;
+  size_t i, probes;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (caller == NULL)
+    return;
+  off_caller = NULL;
+
+  hash ^= hash >> 7;
+  for (i = hash % OFF_SITES, probes = 0; probes < OFF_SITES;
+       i = (i + 1) % OFF_SITES, probes++)
+    if (off_sites[i].caller == caller || off_sites[i].caller == NULL)
+      break;
+  if (probes == OFF_SITES)
+    {
+      off_dropped++;
+      return;
+    }
+
+  s = &off_sites[i];
+  s->caller = caller;
+  s->cnt++;
+  s->cycles += cycles;
+  if (cycles > s->max_cycles)
+    s->max_cycles = cycles;
+}
+#endif
+
+/* Number of interrupt vectors and of interrupts-off callers
+   printed by intr_print_stats(). */
+#define TOP_CNT 8
+
+/* Prints the interrupt vectors that took the most time in their
+   handlers, and under INTR_PROFILE the callers that kept
+   interrupts off the longest. */
+void
+intr_print_stats (void) 
+{
+  bool shown[INTR_CNT];
+  int i, j;
+
+  for (i = 0; i < INTR_CNT; i++)
+    shown[i] = intr_cnt[i] == 0;
+  for (j = 0; j < TOP_CNT; j++)
+    {
+      int top = -1;
+
+      for (i = 0; i < INTR_CNT; i++)
+        if (!shown[i] && (top < 0 || intr_cycles[i] > intr_cycles[top]))
+          top = i;
+      if (top < 0)
+        break;
+      shown[top] = true;
+      printf ("Interrupt %#04x (%s): %llu times, %llu cycles (max %llu)\n",
+              top, intr_names[top], intr_cnt[top], intr_cycles[top],
+              intr_max_cycles[top]);
+    }
+
+#ifdef INTR_PROFILE
+  {
+    bool done[OFF_SITES];
+
+    for (i = 0; i < OFF_SITES; i++)
+      done[i] = off_sites[i].caller == NULL;
+    for (j = 0; j < TOP_CNT; j++)
+      {
+        int top = -1;
+
+        for (i = 0; i < OFF_SITES; i++)
+          if (!done[i] && (top < 0 || (off_sites[i].max_cycles
+                                       > off_sites[top].max_cycles)))
+            top = i;
+        if (top < 0)
+          break;
+        done[top] = true;
+        printf ("Interrupts off at %p: %llu times, %llu cycles (max %llu)\n",
+                off_sites[top].caller, off_sites[top].cnt,
+                off_sites[top].cycles, off_sites[top].max_cycles);
+      }
+    if (off_dropped != 0)
+      printf ("Interrupts off: %llu times from callers not tracked\n",
+              off_dropped);
+  }
+#endif
+}
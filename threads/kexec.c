@@ -0,0 +1,173 @@
+#include "threads/kexec.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/pci.h"
+#include "devices/serial.h"
+#include "devices/timer.h"
+#include "devices/virtio-console.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+#ifdef FILESYS
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#endif
+
+/* What a kernel that restarts leaves for the next one at
+   LOADER_KEXEC. */
+struct kexec_handoff
+  {
+    uint32_t magic;             /* KEXEC_MAGIC if valid. */
+    uint32_t ram_pages;         /* init_ram_pages. */
+    uint64_t tsc_hz;            /* TSC cycles per second. */
+    uint64_t jump_tsc;          /* TSC when the new kernel was entered. */
+  };
+
+/* Largest kernel image, as checked by kernel.lds.S. */
+#define IMAGE_MAX (512 * 1024)
+
+/* Kernel virtual address of the first byte of a kernel image. */
+#define IMAGE_BASE (LOADER_PHYS_BASE + LOADER_KERN_BASE)
+
+/* The loader's argument count and arguments, as it left them,
+   saved before parse_options() splits options at "=". */
+static uint8_t cmd_line[LOADER_ARG_CNT_LEN + LOADER_ARGS_LEN];
+
+/* TSC rate handed over by the previous kernel, or 0. */
+static uint64_t handoff_tsc_hz;
+
+/* Copies SIZE bytes from IMAGE to IMAGE_BASE and jumps to ENTRY.
+   Runs from a copy of the code from kexec_jump to
+   kexec_jump_end, in threads/kexec-jump.S, because the code
+   here is about to be overwritten. */
+typedef void kexec_jump_func (const void *image, size_t size,
+                              uintptr_t entry);
+extern const char kexec_jump[], kexec_jump_end[];
+
+/* Takes over what the kernel that started this one handed over,
+   if this is a warm restart.  Must be called before anything
+   reads the command line or the RAM size.  Returns the TSC at
+   which this kernel was entered after a warm restart, or 0
+   after a cold boot, when the TSC started from 0 at reset. */
+uint64_t
+kexec_init (void)
+{
+  struct kexec_handoff *h = ptov (LOADER_KEXEC);
+  uint64_t jump_tsc = 0;
+
+  memcpy (cmd_line, ptov (LOADER_ARG_CNT), sizeof cmd_line);
+  if (h->magic == KEXEC_MAGIC)
+    {
+      init_ram_pages = h->ram_pages;
+      handoff_tsc_hz = h->tsc_hz;
+      jump_tsc = h->jump_tsc;
+      h->magic = 0;
+    }
+  return jump_tsc;
+}
+
+/* Returns the TSC rate handed over by the kernel that started
+   this one, or 0 after a cold boot. */
+uint64_t
+kexec_tsc_hz (void)
+{
+  return handoff_tsc_hz;
+}
+
+#ifdef FILESYS
+/* Returns the kernel virtual address of start32 in the SIZE-byte
+   kernel IMAGE, or 0 if IMAGE isn't a kernel that can be entered
+   there.  The entry point begins with a short jump over
+   KEXEC_MAGIC and that address, word-aligned. */
+static uintptr_t
+find_start32 (const uint8_t *image, size_t size)
+{
+  uint32_t entry, start32;
+  size_t ofs;
+
+  /* The ELF header's e_entry is at offset 0x18. */
+  if (size < 0x1c || memcmp (image, "\177ELF", 4))
+    return 0;
+  memcpy (&entry, image + 0x18, sizeof entry);
+  if (entry < IMAGE_BASE || entry - IMAGE_BASE >= size)
+    return 0;
+
+  entry -= IMAGE_BASE;
+  for (ofs = ROUND_UP (entry, 4); ofs < entry + 8 && ofs + 8 <= size;
+       ofs += 4)
+    if (*(const uint32_t *) (image + ofs) == KEXEC_MAGIC)
+      {
+        start32 = *(const uint32_t *) (image + ofs + 4);
+        return (start32 >= IMAGE_BASE && start32 - IMAGE_BASE < size
+                ? start32 : 0);
+      }
+  return 0;
+}
+#endif
+
+/* Restarts into the kernel image in FILE_NAME, with the same
+   command line.  Returns only if the image can't be read or
+   isn't a kernel, in which case nothing has been shut down. */
+void
+kexec_restart (const char *file_name)
+{
+#ifdef FILESYS
+  struct kexec_handoff *h = ptov (LOADER_KEXEC);
+  struct file *file;
+  size_t size, page_cnt;
+  uint8_t *image;
+  uintptr_t entry;
+  void *jump;
+
+  file = filesys_open (file_name);
+  if (file == NULL)
+    {
+      printf ("kexec: %s: open failed\n", file_name);
+      return;
+    }
+  size = file_length (file);
+  page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  image = size <= IMAGE_MAX ? palloc_get_multiple (0, page_cnt) : NULL;
+  jump = palloc_get_page (0);
+  if (image == NULL || jump == NULL
+      || file_read (file, image, size) != (off_t) size
+      || (entry = find_start32 (image, size)) == 0)
+    {
+      printf ("kexec: %s: not a loadable kernel\n", file_name);
+      file_close (file);
+      if (image != NULL)
+        palloc_free_multiple (image, page_cnt);
+      palloc_free_page (jump);
+      return;
+    }
+  file_close (file);
+  filesys_done ();
+
+  printf ("Restarting into %s...\n", file_name);
+  serial_flush ();
+  virtio_console_flush ();
+
+  intr_disable ();
+  pci_stop_masters ();
+
+  /* From here on, only the staged image, the copy of
+     kexec_jump, and this stack are still needed, and all of them
+     are outside the memory that the new kernel starts in. */
+  h->magic = KEXEC_MAGIC;
+  h->ram_pages = init_ram_pages;
+  h->tsc_hz = timer_tsc_hz ();
+  memcpy (ptov (LOADER_ARG_CNT), cmd_line, sizeof cmd_line);
+  memcpy (jump, kexec_jump, kexec_jump_end - kexec_jump);
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)) : "memory");
+  h->jump_tsc = rdtsc ();
+  ((kexec_jump_func *) jump) (image, size, entry);
+  NOT_REACHED ();
+#else
+  printf ("kexec: %s: no file system to load it from\n", file_name);
+#endif
+}
@@ -0,0 +1,23 @@
+#ifndef THREADS_KEXEC_H
+#define THREADS_KEXEC_H
+
+#include <stdint.h>
+
+/* Warm restart.
+
+   kexec_restart() starts a kernel image from the file system
+   without going back through the BIOS and the loader.  It stops
+   every device that could be doing DMA, copies the image over
+   the running kernel at LOADER_KERN_BASE, and enters it at
+   start32 in threads/start.S, which skips the real-mode setup
+   that a cold boot needs.  The new kernel gets the command line
+   that the loader gave the old one, and the facts that the old
+   one had to find out the slow way: how much RAM there is and
+   how fast the TSC runs.  It still resets and probes its devices
+   itself, so nothing else carries over. */
+
+uint64_t kexec_init (void);
+uint64_t kexec_tsc_hz (void);
+void kexec_restart (const char *file_name);
+
+#endif /* threads/kexec.h */
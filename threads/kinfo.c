@@ -0,0 +1,78 @@
+#include "threads/kinfo.h"
+#include <debug.h>
+#include "devices/rtc.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+
+/* The kernel information page, through its kernel mapping. */
+static struct kinfo *kinfo;
+
+/* Allocates the kernel information page and maps it read-only
+   for user code at KINFO_ADDR in the initial page directory,
+   whose kernel entries every process page directory copies.
+   Must be called after paging_init() and before the first
+   process is created. */
+void
+kinfo_init (void)
+{
+  uint32_t *pt;
+
+  ASSERT (KINFO_ADDR >= (uintptr_t) PHYS_BASE + init_ram_pages * PGSIZE);
+  ASSERT (init_page_dir[pd_no ((void *) KINFO_ADDR)] == 0);
+
+  kinfo = palloc_get_page_tagged (PAL_ASSERT | PAL_ZERO, MEM_PROCESS);
+  pt = palloc_get_page_tagged (PAL_ASSERT | PAL_ZERO, MEM_PAGEDIR);
+  pt[pt_no ((void *) KINFO_ADDR)] = pte_create_user (kinfo, false);
+  init_page_dir[pd_no ((void *) KINFO_ADDR)] = pde_create (pt);
+
+  kinfo->pid = kinfo->tid = -1;
+  kinfo->tick_ns = 1000000000 / TIMER_FREQ;
+  kinfo->boot_time = rtc_get_time ();
+}
+
+/* Records that the time-stamp counter advances TICK_CYCLES
+   cycles per timer tick, which lets readers of the page tell
+   the time between ticks. */
+void
+kinfo_calibrate (uint32_t tick_cycles)
+{
+  enum intr_level old_level = intr_disable ();
+
+  seqlock_write_begin (&kinfo->lock);
+  kinfo->tick_cycles = tick_cycles;
+  kinfo->tsc_mult = tick_cycles > 0
+                    ? ((uint64_t) kinfo->tick_ns << 32) / tick_cycles : 0;
+  seqlock_write_end (&kinfo->lock);
+  intr_set_level (old_level);
+}
+
+/* Updates the time in the page to TICKS.  Called from the timer
+   interrupt. */
+void
+kinfo_tick (int64_t ticks)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  seqlock_write_begin (&kinfo->lock);
+  kinfo->ticks = ticks;
+  kinfo->tick_tsc = rdtsc ();
+  kinfo->load_avg = thread_get_load_avg ();
+  seqlock_write_end (&kinfo->lock);
+}
+
+/* Sets the process and thread IDs in the page to PID and TID,
+   those of the thread about to run. */
+void
+kinfo_set_ids (int pid, int tid)
+{
+  kinfo->pid = pid;
+  kinfo->tid = tid;
+}
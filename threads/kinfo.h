@@ -0,0 +1,12 @@
+#ifndef THREADS_KINFO_H
+#define THREADS_KINFO_H
+
+#include <kinfo.h>
+#include <stdint.h>
+
+void kinfo_init (void);
+void kinfo_calibrate (uint32_t tick_cycles);
+void kinfo_tick (int64_t ticks);
+void kinfo_set_ids (int pid, int tid);
+
+#endif /* threads/kinfo.h */
@@ -0,0 +1,146 @@
+#include "threads/kstat.h"
+#include <console.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/kbd.h"
+#include "devices/timer.h"
+#include "devices/virtio-balloon.h"
+#include "devices/virtio-console.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+#ifdef USERPROG
+#include "userprog/exception.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#endif
+#ifdef FILESYS
+#include "devices/block.h"
+#include "devices/virtio-blk.h"
+#include "filesys/cache.h"
+#include "filesys/checksum.h"
+#include "filesys/journal.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/ksm.h"
+#include "vm/page.h"
+#include "vm/share.h"
+#include "vm/swap.h"
+#include "vm/zswap.h"
+#endif
+
+/* Prints the scheduler's statistics. */
+static void
+sched_stats (void) 
+{
+  timer_print_stats ();
+  thread_print_stats ();
+  intr_print_stats ();
+  lock_print_stats ();
+  trace_print_stats ();
+}
+
+/* Prints the memory allocators' statistics. */
+static void
+memory_stats (void) 
+{
+  palloc_print_stats ();
+  malloc_print_stats ();
+  malloc_print_heap_profile ();
+  kmem_print_stats ();
+  virtio_balloon_print_stats ();
+#ifdef VM
+  frame_print_stats ();
+  page_print_stats ();
+  swap_print_stats ();
+  zswap_print_stats ();
+  share_print_stats ();
+  ksm_print_stats ();
+#endif
+}
+
+/* Prints the console and keyboard statistics. */
+static void
+console_stats (void) 
+{
+  console_print_stats ();
+  virtio_console_print_stats ();
+  kbd_print_stats ();
+}
+
+#ifdef USERPROG
+/* Prints system call and exception statistics. */
+static void
+syscall_stats (void) 
+{
+  syscall_print_stats ();
+  exception_print_stats ();
+}
+#endif
+
+#ifdef FILESYS
+/* Prints each block device's statistics. */
+static void
+block_stats (void) 
+{
+  block_print_stats ();
+  virtio_blk_print_stats ();
+}
+
+/* Prints the buffer cache's, the journal's and the checksums'
+   statistics. */
+static void
+cache_stats (void) 
+{
+  cache_print_stats ();
+  journal_print_stats ();
+  checksum_print_stats ();
+}
+#endif
+
+/* A named group of statistics. */
+struct kstat
+  {
+    const char *name;           /* Name. */
+    void (*print) (void);       /* Prints the group with printf(). */
+  };
+
+static const struct kstat kstats[] =
+  {
+    {"sched", sched_stats},
+    {"memory", memory_stats},
+    {"console", console_stats},
+#ifdef USERPROG
+    {"syscall", syscall_stats},
+    {"process", process_print_stats},
+#endif
+#ifdef FILESYS
+    {"block", block_stats},
+    {"cache", cache_stats},
+#endif
+  };
+#define KSTAT_CNT (sizeof kstats / sizeof *kstats)
+
+/* Prints the statistics named NAME into BUF, which has room for
+   SIZE bytes, as a null-terminated string, cut short if it does
+   not fit.  Returns the length of the whole text, which may be
+   SIZE or more, or -1 if there are no statistics named NAME. */
+int
+kstat_read (const char *name, char *buf, size_t size) 
+{
+  size_t i;
+
+  for (i = 0; i < KSTAT_CNT; i++)
+    if (!strcmp (name, kstats[i].name))
+      {
+        console_capture_begin (buf, size);
+        kstats[i].print ();
+        return console_capture_end ();
+      }
+  return -1;
+}
@@ -0,0 +1,20 @@
+#ifndef THREADS_KSTAT_H
+#define THREADS_KSTAT_H
+
+#include <stddef.h>
+
+/* Kernel statistics by name.
+
+   Each name stands for a group of the statistics that the kernel
+   prints at shutdown, which kstat_read() prints into a buffer
+   instead, at any time: "sched", "memory" and "console", and with
+   USERPROG "syscall" and "process", one line per live process,
+   and with FILESYS "block" and "cache".  The
+   result is the same text as at shutdown, one counter or a few
+   per line.  Each counter is read once, without stopping the
+   rest of the kernel, so a snapshot is cheap, but counters in it
+   may be a few events apart from each other. */
+
+int kstat_read (const char *name, char *buf, size_t size);
+
+#endif /* threads/kstat.h */
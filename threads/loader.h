@@ -30,6 +30,15 @@
 #define SEL_KCSEG       0x08    /* Kernel code selector. */
 #define SEL_KDSEG       0x10    /* Kernel data selector. */
 
+/* Warm restart by kexec_restart() in threads/kexec.c.  The
+   kernel that restarts leaves a struct kexec_handoff at
+   LOADER_KEXEC, over the loader's code, which is dead by then.
+   Every kernel image has KEXEC_MAGIC in the word after the jump
+   at its entry point, followed by the address of its 32-bit
+   entry point, start32 in threads/start.S. */
+#define LOADER_KEXEC LOADER_BASE
+#define KEXEC_MAGIC 0x4358454b  /* "KEXC". */
+
 #ifndef __ASSEMBLER__
 #include <stdint.h>
 
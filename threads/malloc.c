@@ -1,19 +1,26 @@
 #include "threads/malloc.h"
 #include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
 #include <list.h>
 #include <round.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
+   The size of each request, in bytes, is rounded up to the next
+   size class and assigned to the "descriptor" that manages
+   blocks of that size.  The classes are the powers of 2 from 16
+   bytes to 1 kB with a class halfway between each pair, so a
+   request wastes at most a third of its block, plus the largest
+   sizes that fit 3 and 2 blocks in an arena.  The descriptor keeps a list of free blocks.  If
    the free list is nonempty, one of its blocks is used to
    satisfy the request.
 
@@ -24,11 +31,35 @@
    list.  Then we return one of the new blocks.
 
    When we free a block, we add it to its descriptor's free list.
-   But if the arena that the block was in now has no in-use
-   blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
+   If the arena that the block was in now has no in-use blocks,
+   the descriptor keeps it, up to DESC_EMPTY_MAX arenas, so that
+   a loop that allocates and frees one block does not go to the
+   page allocator every time.  Beyond that, and whenever the
+   page allocator runs short and calls our shrinker, we
+   remove all of an empty arena's blocks from the free list and
+   give the arena back to the page allocator.
 
-   We can't handle blocks bigger than 2 kB using this scheme,
+   Each thread keeps a "magazine" of free blocks per descriptor
+   in its struct thread.  malloc() and free() use only the
+   current thread's magazine, which no other thread touches, so
+   they take no lock in the common case.  An empty magazine is
+   refilled with MAGAZINE_BATCH blocks from the descriptor in a
+   single lock acquisition, and a full one gives MAGAZINE_BATCH
+   blocks back the same way.  Blocks in a magazine count as in
+   use as far as their arena is concerned.
+
+   Each block's tag, and under MEM_DEBUG its allocator, is kept
+   in an array between the arena header and the first block, so
+   that free() can charge the right tag.
+
+   With -heap-profile=N, one allocation in every N is sampled: its
+   size and a short backtrace of its caller are charged to a call
+   site, until the block is freed.  A sampled block has
+   TAG_SAMPLED set in its tag, so that free() only looks for the
+   sample when it has one.  malloc_print_heap_profile() prints the
+   call sites with the most live bytes, scaled up by N.
+
+   We can't handle blocks bigger than about 2 kB using this scheme,
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
@@ -39,10 +70,17 @@ struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    size_t blocks_ofs;          /* Offset of the first block in an arena. */
+    size_t arena_cnt;           /* Number of arenas. */
     struct list free_list;      /* List of free blocks. */
+    struct list empty_list;     /* Arenas with no blocks in use. */
+    size_t empty_cnt;           /* Number of arenas in EMPTY_LIST. */
     struct lock lock;           /* Lock. */
   };
 
+/* Empty arenas a descriptor keeps instead of freeing. */
+#define DESC_EMPTY_MAX 2
+
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
@@ -52,62 +90,247 @@ struct arena
     unsigned magic;             /* Always set to ARENA_MAGIC. */
     struct desc *desc;          /* Owning descriptor, null for big block. */
     size_t free_cnt;            /* Free blocks; pages in big block. */
+    struct list_elem empty_elem; /* Element in desc's empty_list. */
+    uint8_t tag;                /* Tag of a big block. */
+#ifdef MEM_DEBUG
+    void *caller;               /* Allocator of a big block. */
+#endif
   };
 
+/* Bytes of per-block metadata in an arena: the tag, and the
+   allocator under MEM_DEBUG. */
+#ifdef MEM_DEBUG
+#define BLOCK_META_SIZE (1 + sizeof (void *))
+#else
+#define BLOCK_META_SIZE 1
+#endif
+
 /* Free block. */
 struct block 
   {
     struct list_elem free_elem; /* Free list element. */
   };
 
+/* Blocks moved between a magazine and its descriptor at a time,
+   and the most a magazine holds. */
+#define MAGAZINE_BATCH 8
+#define MAGAZINE_MAX (2 * MAGAZINE_BATCH)
+
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[MALLOC_CLASSES]; /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Smallest descriptor for a request, indexed by the size in
+   bytes divided by 8, rounded up. */
+#define CLASS_GRAIN 8
+static uint8_t size_class[PGSIZE / 2 / CLASS_GRAIN + 1];
+
+/* Whether malloc() and free() go through magazines. */
+static bool magazines = true;
+
+/* Bytes allocated, by tag. */
+static struct mem_usage malloc_usage[MEM_TAG_CNT];
+
+/* Heap profiler.  Samples one allocation in every
+   malloc_sample_rate, or none if it is 0.  Set by
+   -heap-profile. */
+unsigned malloc_sample_rate;
+static unsigned heap_countdown;
+
+/* Set in a block's tag if the block was sampled. */
+#define TAG_SAMPLED 0x80
+
+/* Return addresses recorded per sample: the caller of malloc(),
+   then its callers. */
+#define HEAP_DEPTH 4
+
+/* A call site, identified by its backtrace, and the sampled
+   blocks it allocated. */
+struct heap_site
+  {
+    uintptr_t pcs[HEAP_DEPTH];  /* Backtrace, then zeros. */
+    size_t live;                /* Sampled bytes still allocated. */
+    size_t cnt;                 /* Sampled blocks still allocated. */
+    size_t samples;             /* Samples ever taken, 0 if unused. */
+  };
+
+/* Call sites, hashed by backtrace.  Once the table is full, new
+   call sites are lumped together in `heap_overflow'.  Allocated
+   by malloc_init(), only with -heap-profile. */
+#define HEAP_SITES 256
+static struct heap_site *heap_sites;
+static struct heap_site heap_overflow;
+
+/* A sampled block still allocated. */
+struct heap_sample
+  {
+    void *block;                /* Block, or null if unused. */
+    size_t size;                /* Bytes charged to SITE. */
+    struct heap_site *site;     /* Call site that allocated it. */
+  };
+
+/* Sampled blocks, open addressed by address with linear probing.
+   Must be a power of 2.  Once it is 3/4 full, allocations are no
+   longer sampled until some sampled blocks are freed.  Allocated
+   by malloc_init(), only with -heap-profile. */
+#define HEAP_SAMPLES 1024
+static struct heap_sample *heap_samples;
+static size_t heap_sample_cnt;
+static unsigned long long heap_dropped;
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *desc_get (struct desc *);
+static void desc_put (struct desc *, struct block *);
+static void arena_release (struct desc *, struct arena *);
+static void desc_init (size_t block_size);
+static void *do_malloc (size_t, enum mem_tag, void *caller);
+static void account_alloc (struct arena *, struct block *, enum mem_tag,
+                           void *caller);
+static enum mem_tag account_free (struct arena *, struct block *,
+                                  void **caller);
+static enum mem_tag block_tag (void *);
+static bool heap_sample (void *block, size_t size, void *caller);
+static void heap_forget (void *block);
+static void magazine_refill (struct desc *, struct malloc_magazine *);
+static void magazine_flush (struct desc *, struct malloc_magazine *,
+                            unsigned cnt);
+
+/* Gives the page allocator back empty arenas. */
+static shrink_func malloc_shrink;
+static struct shrinker malloc_shrinker;
 
-/* Initializes the malloc() descriptors. */
+/* Initializes the malloc() descriptors, and with -heap-profile,
+   the heap profiler's tables. */
 void
 malloc_init (void) 
 {
-  size_t block_size;
+  size_t arena_space = PGSIZE - sizeof (struct arena);
+  size_t block_size, size, i;
 
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
-      struct desc *d = &descs[desc_cnt++];
-      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
-      d->block_size = block_size;
-      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
-      lock_init (&d->lock);
+      desc_init (block_size);
+      if (block_size < PGSIZE / 4)
+        desc_init (block_size + block_size / 2);
+      else if (block_size == PGSIZE / 4)
+        {
+          desc_init (ROUND_DOWN (arena_space / 3 - BLOCK_META_SIZE,
+                                 CLASS_GRAIN));
+          desc_init (ROUND_DOWN (arena_space / 2 - BLOCK_META_SIZE,
+                                 CLASS_GRAIN));
+        }
+    }
+  ASSERT (desc_cnt == MALLOC_CLASSES);
+
+  for (i = 0, size = 0; size < sizeof size_class; size++)
+    {
+      while (i < desc_cnt && descs[i].block_size < size * CLASS_GRAIN)
+        i++;
+      size_class[size] = i;
     }
+  palloc_register_shrinker (&malloc_shrinker, "empty arenas", malloc_shrink,
+                            SHRINK_EMPTY);
+
+  if (malloc_sample_rate != 0)
+    {
+      heap_sites = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                        DIV_ROUND_UP (sizeof *heap_sites
+                                                      * HEAP_SITES, PGSIZE));
+      heap_samples = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                          DIV_ROUND_UP (sizeof *heap_samples
+                                                        * HEAP_SAMPLES,
+                                                        PGSIZE));
+    }
+}
+
+/* Adds a descriptor for blocks of BLOCK_SIZE bytes, which must be
+   larger than those of the previous descriptor. */
+static void
+desc_init (size_t block_size) 
+{
+  struct desc *d = &descs[desc_cnt++];
+
+  ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+  ASSERT (d == descs || block_size > d[-1].block_size);
+
+  d->block_size = block_size;
+  d->blocks_per_arena = ((PGSIZE - sizeof (struct arena))
+                         / (block_size + BLOCK_META_SIZE));
+  d->blocks_ofs = PGSIZE - d->blocks_per_arena * block_size;
+  d->arena_cnt = 0;
+  list_init (&d->free_list);
+  list_init (&d->empty_list);
+  d->empty_cnt = 0;
+  lock_init (&d->lock);
+  lock_set_name (&d->lock, "malloc");
+}
+
+/* Returns the blocks in the running thread's magazines to their
+   descriptors.  Called by thread_exit(). */
+void
+malloc_thread_exit (void) 
+{
+  struct thread *t = thread_current ();
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    magazine_flush (&descs[i], &t->magazines[i], t->magazines[i].cnt);
+}
+
+/* Turns the magazine layer on or off, for measuring what it
+   saves.  Turning it off empties the running thread's
+   magazines; other threads keep theirs until they exit. */
+void
+malloc_use_magazines (bool use) 
+{
+  magazines = use;
+  if (!use)
+    malloc_thread_exit ();
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
-   Returns a null pointer if memory is not available. */
+   Returns a null pointer if memory is not available.
+   The block is accounted to MEM_OTHER. */
 void *
 malloc (size_t size) 
+{
+  return do_malloc (size, MEM_OTHER, __builtin_return_address (0));
+}
+
+/* Like malloc(), but accounts the block to TAG. */
+void *
+malloc_tagged (size_t size, enum mem_tag tag) 
+{
+  return do_malloc (size, tag, __builtin_return_address (0));
+}
+
+/* Does the work of malloc(), accounting the block to TAG and,
+   under MEM_DEBUG, to CALLER. */
+static void *
+do_malloc (size_t size, enum mem_tag tag, void *caller) 
 {
   struct desc *d;
   struct block *b;
   struct arena *a;
 
+  ASSERT (tag < MEM_TAG_CNT);
+
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
     return NULL;
 
   /* Find the smallest descriptor that satisfies a SIZE-byte
      request. */
-  for (d = descs; d < descs + desc_cnt; d++)
-    if (d->block_size >= size)
-      break;
+  d = descs + desc_cnt;
+  if (size <= (sizeof size_class - 1) * CLASS_GRAIN)
+    d = descs + size_class[DIV_ROUND_UP (size, CLASS_GRAIN)];
   if (d == descs + desc_cnt) 
     {
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
+      a = palloc_get_multiple_tagged (0, page_cnt, MEM_MALLOC);
       if (a == NULL)
         return NULL;
 
@@ -116,40 +339,33 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+      account_alloc (a, (struct block *) (a + 1), tag, caller);
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  if (magazines)
     {
-      size_t i;
+      struct malloc_magazine *m = &thread_current ()->magazines[d - descs];
 
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
+      ASSERT (!intr_context ());
+      if (m->cnt == 0)
+        magazine_refill (d, m);
+      if (m->cnt == 0)
+        return NULL;
+      b = m->head;
+      m->head = *(void **) b;
+      m->cnt--;
+    }
+  else
+    {
+      lock_acquire (&d->lock);
+      b = desc_get (d);
+      lock_release (&d->lock);
+      if (b == NULL)
+        return NULL;
     }
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
+  account_alloc (block_to_arena (b), b, tag, caller);
   return b;
 }
 
@@ -167,7 +383,7 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = do_malloc (size, MEM_OTHER, __builtin_return_address (0));
   if (p != NULL)
     memset (p, 0, size);
 
@@ -185,6 +401,37 @@ block_size (void *block)
   return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
+/* Tries to resize OLD_BLOCK to NEW_SIZE bytes without moving
+   it: a block whose size class already fits stays as it is, and
+   a big block gives back the pages it no longer needs or grows
+   into the free pages that follow it.  Returns true if
+   successful. */
+static bool
+resize_in_place (void *old_block, size_t new_size) 
+{
+  struct arena *a = block_to_arena (old_block);
+  size_t page_cnt;
+  enum mem_tag tag;
+  void *caller;
+
+  if (a->desc != NULL)
+    return new_size <= a->desc->block_size;
+
+  page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+  if (page_cnt < a->free_cnt)
+    palloc_free_multiple ((uint8_t *) a + page_cnt * PGSIZE,
+                          a->free_cnt - page_cnt);
+  else if (page_cnt > a->free_cnt
+           && !palloc_extend (a, a->free_cnt, page_cnt))
+    return false;
+
+  /* Charge the new size. */
+  tag = account_free (a, old_block, &caller);
+  a->free_cnt = page_cnt;
+  account_alloc (a, old_block, tag, caller);
+  return true;
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
@@ -199,9 +446,14 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block != NULL && resize_in_place (old_block, new_size))
+    return old_block;
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = do_malloc (new_size,
+                                   (old_block != NULL
+                                    ? block_tag (old_block) : MEM_OTHER),
+                                   __builtin_return_address (0));
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -223,7 +475,9 @@ free (void *p)
       struct block *b = p;
       struct arena *a = block_to_arena (b);
       struct desc *d = a->desc;
-      
+      void *caller;
+
+      account_free (a, b, &caller);
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
@@ -232,26 +486,23 @@ free (void *p)
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
 
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          if (magazines)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
-            }
+              struct malloc_magazine *m
+                = &thread_current ()->magazines[d - descs];
 
+              ASSERT (!intr_context ());
+              if (m->cnt >= MAGAZINE_MAX)
+                magazine_flush (d, m, MAGAZINE_BATCH);
+              *(void **) b = m->head;
+              m->head = b;
+              m->cnt++;
+              return;
+            }
+  
+          lock_acquire (&d->lock);
+          desc_put (d, b);
           lock_release (&d->lock);
         }
       else
@@ -263,6 +514,528 @@ free (void *p)
     }
 }
 
+/* Takes a block from D's free list, creating a new arena if the
+   list is empty, and returns it.  Returns a null pointer if no
+   page is available for the arena.  D's lock must be held. */
+static struct block *
+desc_get (struct desc *d) 
+{
+  struct block *b;
+  struct arena *a;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty (&d->free_list))
+    {
+      size_t i;
+
+      /* Allocate a page. */
+      a = palloc_get_page_tagged (0, MEM_MALLOC);
+      if (a == NULL) 
+        return NULL; 
+      d->arena_cnt++;
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      list_push_back (&d->empty_list, &a->empty_elem);
+      d->empty_cnt++;
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_push_back (&d->free_list, &b->free_elem);
+        }
+    }
+
+  /* Get a block from free list and return it. */
+  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+  a = block_to_arena (b);
+  if (a->free_cnt == d->blocks_per_arena)
+    {
+      /* No longer empty. */
+      list_remove (&a->empty_elem);
+      d->empty_cnt--;
+    }
+  a->free_cnt--;
+  return b;
+}
+
+/* Returns block B to D's free list.  If the arena that holds it
+   is now entirely unused, keeps the arena in D's empty list, or
+   returns it to the page allocator if D already keeps
+   DESC_EMPTY_MAX.  D's lock must be held. */
+static void
+desc_put (struct desc *d, struct block *b) 
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, keep or free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      if (d->empty_cnt < DESC_EMPTY_MAX)
+        {
+          list_push_front (&d->empty_list, &a->empty_elem);
+          d->empty_cnt++;
+        }
+      else
+        arena_release (d, a);
+    }
+}
+
+/* Removes all of empty arena A's blocks from D's free list and
+   gives A back to the page allocator.  A must not be in D's
+   empty list.  D's lock must be held. */
+static void
+arena_release (struct desc *d, struct arena *a) 
+{
+  size_t i;
+
+  ASSERT (a->free_cnt == d->blocks_per_arena);
+  for (i = 0; i < d->blocks_per_arena; i++) 
+    {
+      struct block *b = arena_to_block (a, i);
+      list_remove (&b->free_elem);
+    }
+  d->arena_cnt--;
+  palloc_free_page (a);
+}
+
+/* Returns the empty arenas kept by every descriptor to the page
+   allocator and returns the number of pages freed.  Descriptors
+   whose lock is held, possibly by the caller itself, are
+   skipped, so this may be called from inside the page
+   allocator. */
+size_t
+malloc_reclaim (void) 
+{
+  size_t freed = 0;
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    {
+      struct desc *d = &descs[i];
+
+      if (lock_held_by_current_thread (&d->lock)
+          || !lock_try_acquire (&d->lock))
+        continue;
+      while (!list_empty (&d->empty_list))
+        {
+          struct arena *a = list_entry (list_pop_front (&d->empty_list),
+                                        struct arena, empty_elem);
+          d->empty_cnt--;
+          arena_release (d, a);
+          freed++;
+        }
+      lock_release (&d->lock);
+    }
+  return freed;
+}
+
+/* Page allocator shrinker: frees every empty arena, whatever
+   PAGE_CNT asks for. */
+static size_t
+malloc_shrink (size_t page_cnt UNUSED) 
+{
+  return malloc_reclaim ();
+}
+
+/* Moves up to MAGAZINE_BATCH blocks from D into magazine M.
+   Moves fewer if memory runs out. */
+static void
+magazine_refill (struct desc *d, struct malloc_magazine *m) 
+{
+  int i;
+
+  lock_acquire (&d->lock);
+  for (i = 0; i < MAGAZINE_BATCH; i++)
+    {
+      struct block *b = desc_get (d);
+      if (b == NULL)
+        break;
+      *(void **) b = m->head;
+      m->head = b;
+      m->cnt++;
+    }
+  lock_release (&d->lock);
+}
+
+/* Moves CNT blocks from magazine M back to D. */
+static void
+magazine_flush (struct desc *d, struct malloc_magazine *m, unsigned cnt) 
+{
+  ASSERT (cnt <= m->cnt);
+
+  if (cnt == 0)
+    return;
+
+  lock_acquire (&d->lock);
+  for (; cnt > 0; cnt--)
+    {
+      struct block *b = m->head;
+      m->head = *(void **) b;
+      m->cnt--;
+      desc_put (d, b);
+    }
+  lock_release (&d->lock);
+}
+
+/* Stores in *USAGE the usage counters for blocks tagged TAG. */
+void
+malloc_get_usage (enum mem_tag tag, struct mem_usage *usage) 
+{
+  enum intr_level old_level;
+
+  ASSERT (tag < MEM_TAG_CNT);
+
+  old_level = intr_disable ();
+  *usage = malloc_usage[tag];
+  intr_set_level (old_level);
+}
+
+/* Prints the arenas and blocks of each size class, and the bytes
+   allocated for each tag.  Blocks cached in magazines count as
+   handed out. */
+void
+malloc_print_stats (void) 
+{
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    {
+      struct desc *d = &descs[i];
+      size_t blocks;
+
+      if (d->arena_cnt == 0)
+        continue;
+      lock_acquire (&d->lock);
+      blocks = d->arena_cnt * d->blocks_per_arena;
+      printf ("Malloc %zu-byte blocks: %zu arenas (%zu empty), "
+              "%zu of %zu blocks handed out\n",
+              d->block_size, d->arena_cnt, d->empty_cnt,
+              blocks - list_size (&d->free_list), blocks);
+      lock_release (&d->lock);
+    }
+  mem_usage_print ("Malloc bytes for", malloc_usage);
+}
+
+/* Returns the array of block tags in arena A, which must not be
+   a big block. */
+static uint8_t *
+arena_tags (struct arena *a) 
+{
+#ifdef MEM_DEBUG
+  return (uint8_t *) ((void **) (a + 1) + a->desc->blocks_per_arena);
+#else
+  return (uint8_t *) (a + 1);
+#endif
+}
+
+#ifdef MEM_DEBUG
+/* Returns the array of block allocators in arena A, which must
+   not be a big block. */
+static void **
+arena_callers (struct arena *a) 
+{
+  return (void **) (a + 1);
+}
+#endif
+
+/* Returns the index of block B within arena A, which must not be
+   a big block. */
+static size_t
+block_idx (struct arena *a, struct block *b) 
+{
+  return (pg_ofs (b) - a->desc->blocks_ofs) / a->desc->block_size;
+}
+
+/* Returns the tag of allocated block BLOCK. */
+static enum mem_tag
+block_tag (void *block) 
+{
+  struct block *b = block;
+  struct arena *a = block_to_arena (b);
+
+  return ((a->desc != NULL ? arena_tags (a)[block_idx (a, b)] : a->tag)
+          & ~TAG_SAMPLED);
+}
+
+/* Records that block B in arena A was allocated for TAG by
+   CALLER. */
+static void
+account_alloc (struct arena *a, struct block *b, enum mem_tag tag,
+               void *caller UNUSED) 
+{
+  size_t size = block_size (b);
+  uint8_t *tagp;
+
+  if (a->desc != NULL)
+    {
+      size_t idx = block_idx (a, b);
+      tagp = &arena_tags (a)[idx];
+#ifdef MEM_DEBUG
+      arena_callers (a)[idx] = caller;
+#endif
+    }
+  else
+    {
+      tagp = &a->tag;
+#ifdef MEM_DEBUG
+      a->caller = caller;
+#endif
+    }
+  *tagp = tag;
+  if (malloc_sample_rate != 0 && heap_countdown-- == 0
+      && heap_sample (b, size, caller))
+    *tagp |= TAG_SAMPLED;
+  mem_usage_add (&malloc_usage[tag], size);
+#ifdef MEM_DEBUG
+  memtag_record (caller, tag, size);
+#endif
+}
+
+/* Records that block B in arena A is being freed.  Returns its
+   tag and stores its allocator in *CALLER, or a null pointer
+   without MEM_DEBUG. */
+static enum mem_tag
+account_free (struct arena *a, struct block *b, void **caller) 
+{
+  size_t size = block_size (b);
+  uint8_t *tagp;
+  enum mem_tag tag;
+
+  *caller = NULL;
+  if (a->desc != NULL)
+    {
+      size_t idx = block_idx (a, b);
+      tagp = &arena_tags (a)[idx];
+#ifdef MEM_DEBUG
+      *caller = arena_callers (a)[idx];
+#endif
+    }
+  else
+    {
+      tagp = &a->tag;
+#ifdef MEM_DEBUG
+      *caller = a->caller;
+#endif
+    }
+  if (*tagp & TAG_SAMPLED)
+    {
+      heap_forget (b);
+      *tagp &= ~TAG_SAMPLED;
+    }
+  tag = *tagp;
+  mem_usage_sub (&malloc_usage[tag], size);
+#ifdef MEM_DEBUG
+  memtag_forget (*caller, size);
+#endif
+  return tag;
+}
+
+/* Stores in PCS the backtrace of a sampled allocation: CALLER,
+   which called malloc() or one of its relatives, followed by the
+   return addresses found by following frame pointers up from
+   CALLER's frame, as many as fit in HEAP_DEPTH. */
+static void
+heap_backtrace (void *caller, uintptr_t pcs[HEAP_DEPTH])
+{
+  uint32_t *frame = __builtin_frame_address (0);
+  struct thread *t = running_thread ();
+  uint8_t *stack = t->kstack;
+  bool found = false;
+  int cnt = 0, steps;
+
+  memset (pcs, 0, HEAP_DEPTH * sizeof *pcs);
+  pcs[cnt++] = (uintptr_t) caller;
+
+  /* Skip the allocator's own frames, up to the one that returns
+     to CALLER. */
+  for (steps = 0; steps < 2 * HEAP_DEPTH + 4 && cnt < HEAP_DEPTH; steps++)
+    {
+      uint32_t *next;
+
+      if ((uint8_t *) frame < stack
+          || (uint8_t *) (frame + 2) > stack + t->kstack_size)
+        break;
+      if (found)
+        pcs[cnt++] = frame[1];
+      else if (frame[1] == (uintptr_t) caller)
+        found = true;
+      next = (uint32_t *) frame[0];
+      if (next <= frame)
+        break;
+      frame = next;
+    }
+}
+
+/* Returns the call site with backtrace PCS, creating it if
+   needed.  Interrupts must be off. */
+static struct heap_site *
+heap_find_site (const uintptr_t pcs[HEAP_DEPTH])
+{
+  size_t start = hash_bytes (pcs, HEAP_DEPTH * sizeof *pcs) % HEAP_SITES;
+  size_t i = start;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  do
+    {
+      struct heap_site *s = &heap_sites[i];
+      if (s->samples == 0)
+        {
+          memcpy (s->pcs, pcs, sizeof s->pcs);
+          return s;
+        }
+      if (!memcmp (s->pcs, pcs, sizeof s->pcs))
+        return s;
+      i = (i + 1) % HEAP_SITES;
+    }
+  while (i != start);
+  return &heap_overflow;
+}
+
+/* Returns BLOCK's home slot in heap_samples. */
+static size_t
+heap_slot (const void *block)
+{
+  return hash_int ((uintptr_t) block) % HEAP_SAMPLES;
+}
+
+/* Samples BLOCK, SIZE bytes just allocated by CALLER, and starts
+   the count to the next sample.  Returns true if BLOCK was
+   sampled, false if there was no room. */
+static bool
+heap_sample (void *block, size_t size, void *caller)
+{
+  uintptr_t pcs[HEAP_DEPTH];
+  enum intr_level old_level;
+  struct heap_site *s;
+  size_t i;
+
+  heap_countdown = malloc_sample_rate - 1;
+  if (caller == NULL)
+    return false;
+  heap_backtrace (caller, pcs);
+
+  old_level = intr_disable ();
+  if (heap_sample_cnt >= HEAP_SAMPLES / 4 * 3)
+    {
+      heap_dropped++;
+      intr_set_level (old_level);
+      return false;
+    }
+  s = heap_find_site (pcs);
+  s->live += size;
+  s->cnt++;
+  s->samples++;
+  for (i = heap_slot (block); heap_samples[i].block != NULL;
+       i = (i + 1) % HEAP_SAMPLES)
+    continue;
+  heap_samples[i].block = block;
+  heap_samples[i].size = size;
+  heap_samples[i].site = s;
+  heap_sample_cnt++;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Removes the sample of BLOCK, which is being freed, charging
+   its call site. */
+static void
+heap_forget (void *block)
+{
+  enum intr_level old_level = intr_disable ();
+  struct heap_sample *e;
+  size_t hole, i;
+
+  for (hole = heap_slot (block); heap_samples[hole].block != block;
+       hole = (hole + 1) % HEAP_SAMPLES)
+    ASSERT (heap_samples[hole].block != NULL);
+  e = &heap_samples[hole];
+  ASSERT (e->site->live >= e->size && e->site->cnt > 0);
+  e->site->live -= e->size;
+  e->site->cnt--;
+
+  /* Close the hole by moving back each following entry of the
+     probe sequence whose home slot does not lie between the hole
+     and the entry. */
+  for (i = (hole + 1) % HEAP_SAMPLES; heap_samples[i].block != NULL;
+       i = (i + 1) % HEAP_SAMPLES)
+    {
+      size_t home = heap_slot (heap_samples[i].block);
+      if ((i - home) % HEAP_SAMPLES >= (i - hole) % HEAP_SAMPLES)
+        {
+          heap_samples[hole] = heap_samples[i];
+          hole = i;
+        }
+    }
+  heap_samples[hole].block = NULL;
+  heap_sample_cnt--;
+  intr_set_level (old_level);
+}
+
+/* Call sites that malloc_print_heap_profile() prints. */
+#define HEAP_TOP 16
+
+/* Prints the HEAP_TOP call sites with the most sampled bytes
+   still allocated, most first, each with its backtrace.  Bytes
+   and blocks are multiplied by the sampling rate, to estimate
+   the real ones.  The addresses can be turned into function
+   names with the `backtrace' utility. */
+void
+malloc_print_heap_profile (void)
+{
+  struct heap_site top[HEAP_TOP], overflow;
+  enum intr_level old_level;
+  size_t top_cnt = 0, live, i, j;
+  unsigned long long dropped;
+  unsigned rate = malloc_sample_rate;
+
+  if (rate == 0)
+    return;
+
+  /* Copy the top sites, so that printing does not change them. */
+  old_level = intr_disable ();
+  for (i = 0; i < HEAP_SITES; i++)
+    {
+      const struct heap_site *s = &heap_sites[i];
+
+      if (s->cnt == 0 || (top_cnt == HEAP_TOP
+                          && s->live <= top[HEAP_TOP - 1].live))
+        continue;
+      if (top_cnt < HEAP_TOP)
+        top_cnt++;
+      for (j = top_cnt - 1; j > 0 && top[j - 1].live < s->live; j--)
+        top[j] = top[j - 1];
+      top[j] = *s;
+    }
+  overflow = heap_overflow;
+  live = heap_sample_cnt;
+  dropped = heap_dropped;
+  intr_set_level (old_level);
+
+  printf ("Heap: 1 in %u allocations sampled, %zu samples live, "
+          "%llu dropped\n", rate, live, dropped);
+  for (i = 0; i < top_cnt; i++)
+    {
+      printf ("Heap: %zu bytes in %zu blocks from",
+              top[i].live * rate, top[i].cnt * rate);
+      for (j = 0; j < HEAP_DEPTH && top[i].pcs[j] != 0; j++)
+        printf (" %#"PRIxPTR, top[i].pcs[j]);
+      printf ("\n");
+    }
+  if (overflow.cnt > 0)
+    printf ("Heap: %zu bytes in %zu blocks from other call sites\n",
+            overflow.live * rate, overflow.cnt * rate);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -275,7 +1048,9 @@ block_to_arena (struct block *b)
 
   /* Check that the block is properly aligned for the arena. */
   ASSERT (a->desc == NULL
-          || (pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
+          || (pg_ofs (b) >= a->desc->blocks_ofs
+              && (pg_ofs (b) - a->desc->blocks_ofs)
+                 % a->desc->block_size == 0));
   ASSERT (a->desc != NULL || pg_ofs (b) == sizeof *a);
 
   return a;
@@ -289,6 +1064,6 @@ arena_to_block (struct arena *a, size_t idx)
   ASSERT (a->magic == ARENA_MAGIC);
   ASSERT (idx < a->desc->blocks_per_arena);
   return (struct block *) ((uint8_t *) a
-                           + sizeof *a
+                           + a->desc->blocks_ofs
                            + idx * a->desc->block_size);
 }
@@ -2,10 +2,33 @@
 #define THREADS_MALLOC_H
 
 #include <debug.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include "threads/memtag.h"
+
+/* Number of size classes, 16 bytes through 2 kB. */
+#define MALLOC_CLASSES 15
+
+/* A thread's cache of free blocks of one size class, so that
+   most calls to malloc() and free() need no lock.  The blocks
+   are chained through their first word. */
+struct malloc_magazine
+  {
+    void *head;                 /* First cached block. */
+    unsigned cnt;               /* Number of cached blocks. */
+  };
+
+extern unsigned malloc_sample_rate;
 
 void malloc_init (void);
+void malloc_thread_exit (void);
+void malloc_use_magazines (bool);
+size_t malloc_reclaim (void);
+void malloc_get_usage (enum mem_tag, struct mem_usage *);
+void malloc_print_stats (void);
+void malloc_print_heap_profile (void);
 void *malloc (size_t) __attribute__ ((malloc));
+void *malloc_tagged (size_t, enum mem_tag) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
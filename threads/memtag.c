@@ -0,0 +1,142 @@
+#include "threads/memtag.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+
+/* Names of the tags, for statistics. */
+static const char *tag_names[MEM_TAG_CNT] =
+  {
+    "other", "malloc", "slab", "thread", "pagedir", "user", "process",
+    "filesys", "ramdisk", "zswap", "balloon",
+  };
+
+/* Returns TAG's name. */
+const char *
+mem_tag_name (enum mem_tag tag) 
+{
+  ASSERT (tag < MEM_TAG_CNT);
+  return tag_names[tag];
+}
+
+/* Counts an allocation of BYTES bytes in U. */
+void
+mem_usage_add (struct mem_usage *u, size_t bytes) 
+{
+  enum intr_level old_level = intr_disable ();
+  u->live += bytes;
+  if (u->live > u->peak)
+    u->peak = u->live;
+  u->allocs++;
+  intr_set_level (old_level);
+}
+
+/* Counts the release of BYTES bytes in U. */
+void
+mem_usage_sub (struct mem_usage *u, size_t bytes) 
+{
+  enum intr_level old_level = intr_disable ();
+  ASSERT (u->live >= bytes);
+  u->live -= bytes;
+  intr_set_level (old_level);
+}
+
+/* Prints the tags in USAGE that have been used, labelled WHAT. */
+void
+mem_usage_print (const char *what, const struct mem_usage usage[MEM_TAG_CNT]) 
+{
+  int tag;
+
+  for (tag = 0; tag < MEM_TAG_CNT; tag++)
+    if (usage[tag].allocs > 0)
+      printf ("%s %s: %zu bytes live, %zu peak, %llu allocations\n",
+              what, tag_names[tag], usage[tag].live, usage[tag].peak,
+              usage[tag].allocs);
+}
+
+#ifdef MEM_DEBUG
+/* Live memory allocated from one call site. */
+struct call_site
+  {
+    void *caller;               /* Return address, or null if unused. */
+    enum mem_tag tag;           /* Tag of the first allocation. */
+    size_t live;                /* Bytes still allocated. */
+    size_t cnt;                 /* Allocations still live. */
+  };
+
+/* Call sites, hashed by address.  Once the table is full, new
+   call sites are lumped together in `overflow'. */
+#define CALL_SITE_CNT 256
+static struct call_site sites[CALL_SITE_CNT];
+static struct call_site overflow;
+
+/* Returns the entry for CALLER, creating it with TAG if CREATE
+   is true.  Interrupts must be off. */
+static struct call_site *
+find_site (void *caller, enum mem_tag tag, bool create) 
+{
+  size_t start = ((uintptr_t) caller >> 2) % CALL_SITE_CNT;
+  size_t i = start;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  do
+    {
+      struct call_site *s = &sites[i];
+      if (s->caller == caller)
+        return s;
+      if (s->caller == NULL)
+        {
+          if (!create)
+            break;
+          s->caller = caller;
+          s->tag = tag;
+          return s;
+        }
+      i = (i + 1) % CALL_SITE_CNT;
+    }
+  while (i != start);
+  return &overflow;
+}
+
+/* Records that CALLER allocated BYTES bytes for TAG. */
+void
+memtag_record (void *caller, enum mem_tag tag, size_t bytes) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct call_site *s = find_site (caller, tag, true);
+  s->live += bytes;
+  s->cnt++;
+  intr_set_level (old_level);
+}
+
+/* Records that BYTES bytes allocated by CALLER were freed. */
+void
+memtag_forget (void *caller, size_t bytes) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct call_site *s = find_site (caller, MEM_OTHER, false);
+  ASSERT (s->live >= bytes && s->cnt > 0);
+  s->live -= bytes;
+  s->cnt--;
+  intr_set_level (old_level);
+}
+
+/* Prints every call site that still has memory allocated.  The
+   addresses can be turned into function names with the
+   `backtrace' utility. */
+void
+memtag_print_leaks (void) 
+{
+  size_t i;
+
+  for (i = 0; i < CALL_SITE_CNT; i++)
+    if (sites[i].cnt > 0)
+      printf ("Live memory from %p (%s): %zu bytes in %zu allocations\n",
+              sites[i].caller, tag_names[sites[i].tag],
+              sites[i].live, sites[i].cnt);
+  if (overflow.cnt > 0)
+    printf ("Live memory from other callers: %zu bytes "
+            "in %zu allocations\n", overflow.live, overflow.cnt);
+}
+#endif /* MEM_DEBUG */
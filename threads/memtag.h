@@ -0,0 +1,56 @@
+#ifndef THREADS_MEMTAG_H
+#define THREADS_MEMTAG_H
+
+#include <stddef.h>
+
+/* Kernel memory accounting.
+
+   Every allocation from palloc or malloc carries a tag naming
+   the subsystem it is for, and each allocator keeps per-tag
+   usage counters, so that the statistics printed at shutdown
+   show where kernel memory goes.  Callers that don't pass a tag
+   get MEM_OTHER, or MEM_USER for user pool pages.
+
+   Building with "make MEM_DEBUG=1" also records the return
+   address of the caller of each allocation and prints, at
+   shutdown, the memory still allocated by each call site. */
+
+/* Subsystem an allocation is for. */
+enum mem_tag
+  {
+    MEM_OTHER,                  /* Untagged. */
+    MEM_MALLOC,                 /* Pages for malloc() arenas. */
+    MEM_SLAB,                   /* Pages for slab caches. */
+    MEM_THREAD,                 /* Thread structures and kernel stacks. */
+    MEM_PAGEDIR,                /* Page directories and page tables. */
+    MEM_USER,                   /* User pages. */
+    MEM_PROCESS,                /* Process bookkeeping. */
+    MEM_FILESYS,                /* File system buffers. */
+    MEM_RAMDISK,                /* RAM disk contents. */
+    MEM_ZSWAP,                  /* Compressed swap cache. */
+    MEM_BALLOON,                /* User pages given to the host. */
+    MEM_TAG_CNT                 /* Number of tags. */
+  };
+
+/* Usage counters for one tag, in bytes. */
+struct mem_usage
+  {
+    size_t live;                /* Currently allocated. */
+    size_t peak;                /* Largest value LIVE has had. */
+    unsigned long long allocs;  /* Number of allocations made. */
+  };
+
+const char *mem_tag_name (enum mem_tag);
+void mem_usage_add (struct mem_usage *, size_t bytes);
+void mem_usage_sub (struct mem_usage *, size_t bytes);
+void mem_usage_print (const char *what, const struct mem_usage[MEM_TAG_CNT]);
+
+#ifdef MEM_DEBUG
+void memtag_record (void *caller, enum mem_tag, size_t bytes);
+void memtag_forget (void *caller, size_t bytes);
+void memtag_print_leaks (void);
+#else
+static inline void memtag_print_leaks (void) { }
+#endif
+
+#endif /* threads/memtag.h */
@@ -2,13 +2,16 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/loader.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,22 +26,171 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+   The split is only where the pools start, though: memory is
+   owned in chunks of CHUNK_PAGES aligned pages, and when an
+   allocation leaves a pool below its low watermark of free
+   pages, it takes a whole free chunk from the other pool if that
+   one has a chunk to spare above its high watermark.  The user
+   pool never grows past the limit given to palloc_init(), and
+   the kernel pool only lends chunks from the upper half of its
+   initial range, so that every user page lies in the range
+   that palloc_get_user_range() reports to the frame table.
 
-/* A memory pool. */
+   Caches that live in the kernel pool register shrinkers.  When
+   an allocation leaves fewer than the low watermark of kernel
+   pages free, or fails, the shrinkers run in priority order
+   until the high watermark is free again, so that caches can
+   grow while memory is plentiful and shrink under load. */
+
+/* Number of block orders.  A block of order K is 2**K
+   contiguous pages whose index within its pool is a multiple of
+   2**K, so its buddy, the other half of the order K + 1 block
+   containing it, starts at index ^ 2**K. */
+#define PALLOC_ORDERS 16
+
+/* Pre-zeroed single pages kept in each pool by the zeroing
+   thread, which refills the reserve once it drops below half. */
+#define ZERO_RESERVE 32
+
+/* Free single pages kept by each CPU for each pool, so that most
+   single-page allocations and frees, such as user page faults
+   and thread stacks, touch only the local CPU's list, with
+   interrupts off, instead of the pool's lock.  An empty list is
+   refilled, and a full one drained, CPU_PAGES_BATCH pages at a
+   time under one acquisition of the lock. */
+#define CPU_PAGES_MAX 16
+#define CPU_PAGES_BATCH 8
+
+/* A CPU's free pages from one pool.  They are allocated in the
+   pool's used_map, but not accounted to any tag. */
+struct cpu_pages
+  {
+    void *pages[CPU_PAGES_MAX];         /* Free pages. */
+    size_t cnt;                         /* Pages in PAGES. */
+  };
+
+/* Pool watermarks, in pages per 1024 pages of the pool, and at
+   least WATER_MIN pages.  Below the low watermark, a pool takes
+   a chunk from the other pool, and the kernel pool then runs its
+   shrinkers until the high watermark is free. */
+#define WATER_LOW 16
+#define WATER_HIGH 32
+#define WATER_MIN 8
+
+/* Pools own memory in aligned chunks of 2**CHUNK_ORDER pages.
+   At least 32 pages, so that no word of the used_map bitmap
+   holds bits of both pools. */
+#define CHUNK_ORDER 6
+#define CHUNK_PAGES ((size_t) 1 << CHUNK_ORDER)
+
+/* A memory pool.  Free pages are kept in buddy free lists, one
+   per order; the list element of a free block lives in its first
+   page.  Allocation takes the smallest block that fits, splitting
+   larger ones on the way down, and frees pages left over at its
+   end.  Freeing merges a block with its buddy for as long as the
+   buddy is free too and in the same pool.  Both take O(log n)
+   list operations.  A pool's lock also protects the per-page
+   metadata below for the pages of the chunks it owns. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
-    uint8_t *base;                      /* Base of pool. */
+    struct spinlock lock;               /* Mutual exclusion. */
+    struct list free_lists[PALLOC_ORDERS]; /* Free blocks by order. */
+    size_t free_cnt[PALLOC_ORDERS];     /* Blocks in each free list. */
+    size_t free_pages;                  /* Pages in all free lists. */
+    void *zeroed[ZERO_RESERVE];         /* Pre-zeroed pages, allocated. */
+    size_t zeroed_cnt;                  /* Pages in ZEROED. */
+    size_t zeroing_cnt;                 /* Pages being zeroed. */
+    unsigned long long zero_hits;       /* PAL_ZERO pages pre-zeroed. */
+    unsigned long long zero_sync;       /* PAL_ZERO pages zeroed inline. */
+    struct cpu_pages cpu_pages[NCPU];   /* Each CPU's free pages. */
+    unsigned long long cpu_hits;        /* Pages from a CPU's list. */
+    unsigned long long cpu_refills;     /* Batches moved to a CPU's list. */
+    unsigned long long cpu_drains;      /* Batches moved back. */
+    size_t page_cnt;                    /* Pages in chunks owned. */
+    size_t max_pages;                   /* Most pages it may own. */
+    size_t low_water, high_water;       /* Watermarks, in free pages. */
+    unsigned long long borrowed;        /* Chunks taken from the other. */
+    const char *name;                   /* Name, for statistics. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
-static void init_pool (struct pool *, void *base, size_t page_cnt,
-                       const char *name);
+/* Memory managed by the pools: TOTAL_PAGES pages from POOL_BASE.
+   Page indexes are relative to POOL_BASE, and buddies are
+   aligned to them. */
+static uint8_t *pool_base;
+static size_t total_pages;
+
+/* Per-page metadata, for both pools. */
+static struct bitmap *used_map;         /* Allocated pages. */
+static uint8_t *free_order;             /* 1 + order of the free block
+                                           starting at each page, or 0. */
+static uint8_t *page_tags;              /* Tag of each allocated page. */
+#ifdef MEM_DEBUG
+static void **page_callers;             /* Allocator of each page. */
+#endif
+
+/* The pool that owns each chunk. */
+static struct pool **chunk_owner;
+
+/* First chunk that the user pool can own. */
+static size_t user_floor;
+
+/* Use the per-CPU page lists? */
+static bool use_cpu_pages = true;
+
+/* Pages allocated, by tag. */
+static struct mem_usage page_usage[MEM_TAG_CNT];
+
+/* Shrinkers, in order of priority.  SHRINK_LOCK protects the
+   list and is held while shrinkers run, so that only one thread
+   runs them at a time and none runs them recursively. */
+static struct list shrinkers;
+static struct lock shrink_lock;
+
+/* Shrinker statistics. */
+static unsigned long long shrink_runs;  /* Times shrinkers ran. */
+static unsigned long long shrink_short; /* Times they left too few free. */
+
+/* Bytes of metadata kept per page: a byte each in free_order and
+   page_tags, and the caller under MEM_DEBUG. */
+#ifdef MEM_DEBUG
+#define PAGE_META_SIZE (2 + sizeof (void *))
+#else
+#define PAGE_META_SIZE 2
+#endif
+
+static void init_pool (struct pool *, size_t first_chunk, size_t chunk_cnt,
+                       size_t max_pages, const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static bool owns_range (const struct pool *, size_t start, size_t end);
+static size_t pool_alloc (struct pool *, size_t page_cnt, size_t align);
+static bool borrow_chunk (struct pool *);
+static size_t take_pages (struct pool *, size_t page_cnt);
+static size_t take_aligned (struct pool *, size_t page_cnt, size_t align);
+static size_t shrink (size_t page_cnt);
+static list_less_func shrinker_less;
+static void *take_zeroed (struct pool *);
+static bool drain_zeroed (struct pool *);
+static void *cpu_get (struct pool *);
+static bool cpu_put (struct pool *, void *page);
+static bool drain_cpu_pages (struct pool *);
+static thread_func zero_thread;
+static void put_range (struct pool *, size_t page_idx, size_t page_cnt);
+static void claim_page (struct pool *, size_t page_idx, size_t end);
+static void *get_pages (enum palloc_flags, size_t page_cnt, size_t align,
+                        enum mem_tag, void *caller);
+static void account_alloc (struct pool *, size_t page_idx, size_t page_cnt,
+                           enum mem_tag, void *caller);
+static void account_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void *page_caller (struct pool *, size_t page_idx);
+static void pool_stats (struct pool *, size_t *free_pages, int *largest);
+static void print_pool (struct pool *);
+
+/* Raised when a reserve of pre-zeroed pages runs low. */
+static struct semaphore zero_wanted;
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -50,15 +202,63 @@ palloc_init (size_t user_page_limit)
   uint8_t *free_end = ptov (init_ram_pages * PGSIZE);
   size_t free_pages = (free_end - free_start) / PGSIZE;
   size_t user_pages = free_pages / 2;
-  size_t kernel_pages;
+  size_t chunk_cnt, kernel_chunks, meta_pages;
+  uint8_t *meta;
+
   if (user_pages > user_page_limit)
     user_pages = user_page_limit;
-  kernel_pages = free_pages - user_pages;
 
-  /* Give half of memory to kernel, half to user. */
-  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
-  init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
-             user_pages, "user pool");
+  /* Put the metadata at the start of free memory.  Calculate the
+     space needed for it and subtract it from what the pools
+     manage. */
+  chunk_cnt = DIV_ROUND_UP (free_pages, CHUNK_PAGES);
+  meta_pages = DIV_ROUND_UP (bitmap_buf_size (free_pages)
+                             + free_pages * PAGE_META_SIZE
+                             + chunk_cnt * sizeof *chunk_owner, PGSIZE);
+  if (meta_pages >= free_pages)
+    PANIC ("Not enough memory for page allocator metadata.");
+  total_pages = free_pages - meta_pages;
+  pool_base = free_start + meta_pages * PGSIZE;
+  chunk_cnt = DIV_ROUND_UP (total_pages, CHUNK_PAGES);
+
+  used_map = bitmap_create_in_buf (total_pages, free_start,
+                                   meta_pages * PGSIZE);
+  meta = free_start + bitmap_buf_size (total_pages);
+  chunk_owner = (struct pool **) meta;
+  meta += chunk_cnt * sizeof *chunk_owner;
+#ifdef MEM_DEBUG
+  page_callers = (void **) meta;
+  meta += total_pages * sizeof *page_callers;
+#endif
+  free_order = meta;
+  page_tags = meta + total_pages;
+  memset (free_order, 0, total_pages);
+
+  /* Give half of memory to kernel, half to user, rounding the
+     kernel's share up to whole chunks.  The kernel keeps the
+     lower half of its chunks, and may lend the rest. */
+  if (user_pages > total_pages)
+    user_pages = total_pages;
+  kernel_chunks = DIV_ROUND_UP (total_pages - user_pages, CHUNK_PAGES);
+  user_floor = user_pages < user_page_limit ? kernel_chunks / 2
+                                            : kernel_chunks;
+  init_pool (&kernel_pool, 0, kernel_chunks, total_pages, "kernel pool");
+  init_pool (&user_pool, kernel_chunks, chunk_cnt - kernel_chunks,
+             user_page_limit, "user pool");
+  sema_init (&zero_wanted, 0);
+
+  list_init (&shrinkers);
+  lock_init (&shrink_lock);
+}
+
+/* Starts the thread that keeps the pools' reserves of pre-zeroed
+   pages full.  Until it runs, PAL_ZERO pages are zeroed inline.
+   Must be called after thread_start(). */
+void
+palloc_start_zeroing (void) 
+{
+  thread_create_sized ("zeroer", PRI_MIN, THREAD_STACK_SMALL, zero_thread,
+                       NULL);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -66,30 +266,146 @@ palloc_init (size_t user_page_limit)
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   FLAGS, in which case the kernel panics.
+   The pages are accounted to MEM_USER if PAL_USER is set,
+   otherwise to MEM_OTHER. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  return get_pages (flags, page_cnt, 1,
+                    flags & PAL_USER ? MEM_USER : MEM_OTHER,
+                    __builtin_return_address (0));
+}
+
+/* Obtains a single free page and returns its kernel virtual
+   address.
+   If PAL_USER is set, the page is obtained from the user pool,
+   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   then the page is filled with zeros.  If no pages are
+   available, returns a null pointer, unless PAL_ASSERT is set in
+   FLAGS, in which case the kernel panics.
+   The page is accounted to MEM_USER if PAL_USER is set,
+   otherwise to MEM_OTHER. */
+void *
+palloc_get_page (enum palloc_flags flags) 
+{
+  return get_pages (flags, 1, 1, flags & PAL_USER ? MEM_USER : MEM_OTHER,
+                    __builtin_return_address (0));
+}
+
+/* Like palloc_get_multiple(), but accounts the pages to TAG. */
+void *
+palloc_get_multiple_tagged (enum palloc_flags flags, size_t page_cnt,
+                            enum mem_tag tag) 
+{
+  return get_pages (flags, page_cnt, 1, tag, __builtin_return_address (0));
+}
+
+/* Like palloc_get_page(), but accounts the page to TAG. */
+void *
+palloc_get_page_tagged (enum palloc_flags flags, enum mem_tag tag) 
+{
+  return get_pages (flags, 1, 1, tag, __builtin_return_address (0));
+}
+
+/* Like palloc_get_multiple(), but the pages start at a physical
+   address that is a multiple of ALIGN pages, a power of 2, as a
+   4 MB page needs.  The pages are found among the pool's free
+   blocks, which are aligned to where the pool starts rather than
+   physically, so the run may take parts of several of them. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt, size_t align) 
+{
+  ASSERT (align > 0 && (align & (align - 1)) == 0);
+
+  return get_pages (flags, page_cnt, align,
+                    flags & PAL_USER ? MEM_USER : MEM_OTHER,
+                    __builtin_return_address (0));
+}
+
+/* Does the work of the palloc_get_*() functions, aligning the
+   pages to ALIGN pages and accounting them to TAG and, under
+   MEM_DEBUG, to CALLER. */
+static void *
+get_pages (enum palloc_flags flags, size_t page_cnt, size_t align,
+           enum mem_tag tag, void *caller) 
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
   size_t page_idx;
 
+  ASSERT (tag < MEM_TAG_CNT);
+
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  /* A single zeroed page comes from the reserve when it has one. */
+  if ((flags & PAL_ZERO) && page_cnt == 1 && align == 1)
+    {
+      pages = take_zeroed (pool);
+      if (pages != NULL)
+        {
+          account_alloc (pool, pg_no (pages) - pg_no (pool_base), 1,
+                         tag, caller);
+          return pages;
+        }
+    }
+
+  if (page_cnt == 1 && align == 1 && (pages = cpu_get (pool)) != NULL)
+    page_idx = pg_no (pages) - pg_no (pool_base);
+  else
+    page_idx = pool_alloc (pool, page_cnt, align);
+
+  /* A pool that runs out, or runs low, takes a chunk from the
+     other pool if it has one to spare. */
+  if (page_idx == BITMAP_ERROR)
+    {
+      if (borrow_chunk (pool))
+        page_idx = pool_alloc (pool, page_cnt, align);
+    }
+  else if (pool->free_pages < pool->low_water)
+    borrow_chunk (pool);
+
+  /* Caches in the kernel pool give back pages when it runs out,
+     and before then when it runs low. */
+  if (pool == &kernel_pool)
+    {
+      if (page_idx == BITMAP_ERROR)
+        {
+          if (shrink (page_cnt) > 0)
+            page_idx = pool_alloc (pool, page_cnt, align);
+        }
+      else if (pool->free_pages < pool->low_water)
+        shrink (0);
+    }
+
+  /* Pages held in the reserve and the CPU lists are free memory
+     too. */
+  if (page_idx == BITMAP_ERROR)
+    {
+      bool drained = drain_zeroed (pool);
+      if (drain_cpu_pages (pool) || drained)
+        page_idx = pool_alloc (pool, page_cnt, align);
+    }
 
   if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+    pages = pool_base + PGSIZE * page_idx;
   else
     pages = NULL;
 
   if (pages != NULL) 
     {
+      account_alloc (pool, page_idx, page_cnt, tag, caller);
       if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
+        {
+          size_t i;
+
+          for (i = 0; i < page_cnt; i++)
+            memzero_page ((uint8_t *) pages + PGSIZE * i);
+          spinlock_acquire (&pool->lock);
+          pool->zero_sync += page_cnt;
+          spinlock_release (&pool->lock);
+        }
     }
   else 
     {
@@ -100,20 +416,8 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
-/* Obtains a single free page and returns its kernel virtual
-   address.
-   If PAL_USER is set, the page is obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the page is filled with zeros.  If no pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
-void *
-palloc_get_page (enum palloc_flags flags) 
-{
-  return palloc_get_multiple (flags, 1);
-}
-
-/* Frees the PAGE_CNT pages starting at PAGES. */
+/* Frees the PAGE_CNT pages starting at PAGES.  May be called
+   with interrupts off, as thread_schedule_tail() does. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
@@ -131,14 +435,22 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   else
     NOT_REACHED ();
 
-  page_idx = pg_no (pages) - pg_no (pool->base);
+  page_idx = pg_no (pages) - pg_no (pool_base);
+
+  account_free (pool, page_idx, page_cnt);
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  if (page_cnt == 1 && cpu_put (pool, pages))
+    return;
+
+  spinlock_acquire (&pool->lock);
+  ASSERT (bitmap_all (used_map, page_idx, page_cnt));
+  bitmap_set_multiple (used_map, page_idx, page_cnt, false);
+  put_range (pool, page_idx, page_cnt);
+  spinlock_release (&pool->lock);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +460,306 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
-/* Initializes pool P as starting at START and ending at END,
-   naming it NAME for debugging purposes. */
+/* Frees the PAGE_CNT pages in PAGES, each obtained on its own
+   from either pool, taking each pool's lock once for all of its
+   pages instead of once per page. */
+void
+palloc_free_pages (void *pages[], size_t page_cnt) 
+{
+  struct pool *pools[2] = { &kernel_pool, &user_pool };
+  size_t i, p;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      struct pool *pool = (page_from_pool (&kernel_pool, pages[i])
+                           ? &kernel_pool : &user_pool);
+
+      ASSERT (pg_ofs (pages[i]) == 0);
+      ASSERT (page_from_pool (pool, pages[i]));
+      account_free (pool, pg_no (pages[i]) - pg_no (pool_base), 1);
+#ifndef NDEBUG
+      memset (pages[i], 0xcc, PGSIZE);
+#endif
+    }
+
+  for (p = 0; p < 2; p++)
+    {
+      struct pool *pool = pools[p];
+      bool locked = false;
+
+      for (i = 0; i < page_cnt; i++)
+        if (page_from_pool (pool, pages[i]))
+          {
+            size_t page_idx = pg_no (pages[i]) - pg_no (pool_base);
+
+            if (!locked)
+              {
+                spinlock_acquire (&pool->lock);
+                locked = true;
+              }
+            ASSERT (bitmap_test (used_map, page_idx));
+            bitmap_reset (used_map, page_idx);
+            put_range (pool, page_idx, 1);
+          }
+      if (locked)
+        spinlock_release (&pool->lock);
+    }
+}
+
+/* Tries to grow the PAGE_CNT pages starting at PAGES, obtained
+   from palloc_get_multiple(), to NEW_CNT pages in place.
+   Succeeds, returning true, only if all of the pages that
+   directly follow them are free.  The new pages are not
+   zeroed. */
+bool
+palloc_extend (void *pages, size_t page_cnt, size_t new_cnt) 
+{
+  struct pool *pool;
+  size_t page_idx, end;
+  bool success = false;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (new_cnt >= page_cnt);
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  page_idx = pg_no (pages) - pg_no (pool_base) + page_cnt;
+  end = page_idx + (new_cnt - page_cnt);
+  if (end > total_pages)
+    return false;
+
+  /* The new pages must be in POOL too.  Its lock keeps the owner
+     of its chunks from changing. */
+
+  spinlock_acquire (&pool->lock);
+  ASSERT (bitmap_all (used_map, page_idx - page_cnt, page_cnt));
+  if (owns_range (pool, page_idx, end)
+      && bitmap_none (used_map, page_idx, end - page_idx))
+    {
+      size_t i;
+
+      for (i = page_idx; i < end; i++)
+        claim_page (pool, i, end);
+      bitmap_set_multiple (used_map, page_idx, end - page_idx, true);
+      success = true;
+    }
+  spinlock_release (&pool->lock);
+
+  /* The new pages belong to whoever allocated the old ones. */
+  if (success)
+    account_alloc (pool, page_idx, end - page_idx, page_tags[page_idx - 1],
+                   page_caller (pool, page_idx - 1));
+
+  return success;
+}
+
+/* Stores in *FREE_PAGES the number of free pages in the user
+   pool if PAL_USER is set in FLAGS, otherwise in the kernel pool,
+   and in *LARGEST_ORDER the order of its largest free block: the
+   largest run palloc_get_multiple() can satisfy is 2**order
+   pages.  *LARGEST_ORDER is -1 if the pool has no free pages. */
+void
+palloc_get_stats (enum palloc_flags flags, size_t *free_pages,
+                  int *largest_order) 
+{
+  pool_stats (flags & PAL_USER ? &user_pool : &kernel_pool,
+              free_pages, largest_order);
+}
+
+/* Stores in *HITS the number of PAL_ZERO pages handed out from
+   the pre-zeroed reserve of the pool selected by FLAGS, and in
+   *SYNC the number that palloc_get_multiple() zeroed itself. */
+void
+palloc_get_zero_stats (enum palloc_flags flags, unsigned long long *hits,
+                       unsigned long long *sync) 
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+
+  spinlock_acquire (&pool->lock);
+  *hits = pool->zero_hits;
+  *sync = pool->zero_sync;
+  spinlock_release (&pool->lock);
+}
+
+/* Stores in *USAGE the usage counters for pages tagged TAG. */
+void
+palloc_get_usage (enum mem_tag tag, struct mem_usage *usage) 
+{
+  enum intr_level old_level;
+
+  ASSERT (tag < MEM_TAG_CNT);
+
+  old_level = intr_disable ();
+  *usage = page_usage[tag];
+  intr_set_level (old_level);
+}
+
+/* Turns the per-CPU page lists on or off, for measuring what
+   they save.  Turning them off returns their pages to the
+   pools. */
+void
+palloc_use_cpu_pages (bool use) 
+{
+  use_cpu_pages = use;
+  if (!use)
+    {
+      drain_cpu_pages (&kernel_pool);
+      drain_cpu_pages (&user_pool);
+    }
+}
+
+/* Stores in *BASE the address of the first page that the user
+   pool can own and in *PAGE_CNT the number of pages from there
+   to the end of memory.  Every PAL_USER page lies in that range,
+   though not every page in it belongs to the user pool. */
+void
+palloc_get_user_range (void **base, size_t *page_cnt) 
+{
+  *base = pool_base + user_floor * CHUNK_PAGES * PGSIZE;
+  *page_cnt = total_pages - user_floor * CHUNK_PAGES;
+}
+
+/* Initializes S as shrinker NAME, which calls SHRINK at
+   PRIORITY, and adds it to those that run when the kernel pool
+   runs low.  S stays registered for as long as the kernel runs. */
+void
+palloc_register_shrinker (struct shrinker *s, const char *name,
+                          shrink_func *shrink, int priority) 
+{
+  ASSERT (s != NULL && name != NULL && shrink != NULL);
+
+  s->name = name;
+  s->shrink = shrink;
+  s->priority = priority;
+  s->calls = s->freed = 0;
+  lock_acquire (&shrink_lock);
+  list_insert_ordered (&shrinkers, &s->elem, shrinker_less, NULL);
+  lock_release (&shrink_lock);
+}
+
+/* Returns true if shrinker A runs before shrinker B. */
+static bool
+shrinker_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED) 
+{
+  const struct shrinker *a = list_entry (a_, struct shrinker, elem);
+  const struct shrinker *b = list_entry (b_, struct shrinker, elem);
+
+  return a->priority < b->priority;
+}
+
+/* Runs the shrinkers in priority order until the kernel pool has
+   the high watermark of pages free and PAGE_CNT more has been
+   freed, and returns the number of pages freed.  Does nothing in
+   an interrupt handler, with interrupts off, or if another
+   thread is already running the shrinkers, or this one is. */
+static size_t
+shrink (size_t page_cnt) 
+{
+  struct list_elem *e;
+  size_t freed = 0;
+
+  if (intr_context () || intr_get_level () == INTR_OFF
+      || lock_held_by_current_thread (&shrink_lock)
+      || !lock_try_acquire (&shrink_lock))
+    return 0;
+
+  shrink_runs++;
+  for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+       e = list_next (e))
+    {
+      struct shrinker *s = list_entry (e, struct shrinker, elem);
+      size_t want = 0, got;
+
+      if (freed < page_cnt)
+        want = page_cnt - freed;
+      if (kernel_pool.free_pages + want < kernel_pool.high_water)
+        want = kernel_pool.high_water - kernel_pool.free_pages;
+      if (want == 0)
+        break;
+      got = s->shrink (want);
+      s->calls++;
+      s->freed += got;
+      freed += got;
+    }
+  if (kernel_pool.free_pages < kernel_pool.low_water)
+    shrink_short++;
+  lock_release (&shrink_lock);
+
+  return freed;
+}
+
+/* Prints free memory statistics for both pools, the pages
+   allocated for each tag, and what each shrinker has freed. */
+void
+palloc_print_stats (void) 
+{
+  struct list_elem *e;
+
+  print_pool (&kernel_pool);
+  print_pool (&user_pool);
+  mem_usage_print ("Palloc pages for", page_usage);
+
+  printf ("Palloc shrinkers: ran %llu times, %llu left kernel pool low\n",
+          shrink_runs, shrink_short);
+  for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+       e = list_next (e))
+    {
+      struct shrinker *s = list_entry (e, struct shrinker, elem);
+      printf ("  %s: %llu calls, %llu pages freed\n",
+              s->name, s->calls, s->freed);
+    }
+}
+
+/* Initializes pool P as owning the CHUNK_CNT chunks starting at
+   FIRST_CHUNK, and at most MAX_PAGES pages, naming it NAME for
+   debugging purposes. */
 static void
-init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
+init_pool (struct pool *p, size_t first_chunk, size_t chunk_cnt,
+           size_t max_pages, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  size_t start = first_chunk * CHUNK_PAGES;
+  size_t end = (first_chunk + chunk_cnt) * CHUNK_PAGES;
+  size_t water;
+  int order;
+  size_t i;
+
+  if (end > total_pages)
+    end = total_pages;
 
-  printf ("%zu pages available in %s.\n", page_cnt, name);
+  printf ("%zu pages available in %s.\n", end - start, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  spinlock_init (&p->lock);
+  for (order = 0; order < PALLOC_ORDERS; order++)
+    {
+      list_init (&p->free_lists[order]);
+      p->free_cnt[order] = 0;
+    }
+  p->free_pages = 0;
+  p->zeroed_cnt = p->zeroing_cnt = 0;
+  p->zero_hits = p->zero_sync = 0;
+  for (i = 0; i < NCPU; i++)
+    p->cpu_pages[i].cnt = 0;
+  p->cpu_hits = p->cpu_refills = p->cpu_drains = 0;
+  p->page_cnt = end - start;
+  p->max_pages = max_pages;
+  p->borrowed = 0;
+  p->name = name;
+
+  water = p->page_cnt * WATER_LOW / 1024;
+  p->low_water = water > WATER_MIN ? water : WATER_MIN;
+  water = p->page_cnt * WATER_HIGH / 1024;
+  p->high_water = water > 2 * p->low_water ? water : 2 * p->low_water;
+
+  for (i = first_chunk; i < first_chunk + chunk_cnt; i++)
+    chunk_owner[i] = p;
+  put_range (p, start, end - start);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -175,8 +768,606 @@ static bool
 page_from_pool (const struct pool *pool, void *page) 
 {
   size_t page_no = pg_no (page);
-  size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t start_page = pg_no (pool_base);
+
+  return (page_no >= start_page && page_no < start_page + total_pages
+          && chunk_owner[(page_no - start_page) >> CHUNK_ORDER] == pool);
+}
+
+/* Returns true if POOL owns every page from START up to END. */
+static bool
+owns_range (const struct pool *pool, size_t start, size_t end) 
+{
+  size_t chunk;
+
+  for (chunk = start >> CHUNK_ORDER; chunk << CHUNK_ORDER < end; chunk++)
+    if (chunk_owner[chunk] != pool)
+      return false;
+  return true;
+}
+
+/* Returns the list element kept in the first page of the free
+   block at PAGE_IDX in POOL. */
+static struct list_elem *
+block_elem (struct pool *pool UNUSED, size_t page_idx) 
+{
+  return (struct list_elem *) (pool_base + PGSIZE * page_idx);
+}
+
+/* Returns the index of the first page of the free block whose
+   list element is E. */
+static size_t
+block_idx (struct pool *pool UNUSED, struct list_elem *e) 
+{
+  return pg_no (e) - pg_no (pool_base);
+}
+
+/* Adds the block of order ORDER at PAGE_IDX to POOL's free list. */
+static void
+push_block (struct pool *pool, size_t page_idx, int order) 
+{
+  free_order[page_idx] = order + 1;
+  pool->free_cnt[order]++;
+  pool->free_pages += (size_t) 1 << order;
+  list_push_front (&pool->free_lists[order], block_elem (pool, page_idx));
+}
+
+/* Removes the free block of order ORDER at PAGE_IDX from POOL's
+   free list. */
+static void
+pull_block (struct pool *pool, size_t page_idx, int order) 
+{
+  ASSERT (free_order[page_idx] == order + 1);
+
+  free_order[page_idx] = 0;
+  pool->free_cnt[order]--;
+  pool->free_pages -= (size_t) 1 << order;
+  list_remove (block_elem (pool, page_idx));
+}
+
+/* Frees the block of order ORDER at PAGE_IDX in POOL, merging it
+   with its buddy as long as the buddy is free and whole. */
+static void
+put_block (struct pool *pool, size_t page_idx, int order) 
+{
+  while (order + 1 < PALLOC_ORDERS)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+      if (buddy + ((size_t) 1 << order) > total_pages
+          || free_order[buddy] != order + 1
+          || chunk_owner[buddy >> CHUNK_ORDER] != pool)
+        break;
+      pull_block (pool, buddy, order);
+      page_idx &= ~((size_t) 1 << order);
+      order++;
+    }
+  push_block (pool, page_idx, order);
+}
+
+/* Frees the PAGE_CNT pages starting at PAGE_IDX in POOL, which
+   need not be a power of 2 or aligned, as the largest aligned
+   blocks that cover them. */
+static void
+put_range (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+      while (order + 1 < PALLOC_ORDERS
+             && (page_idx & ((size_t) 1 << order)) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      put_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Returns the recorded allocator of page PAGE_IDX in POOL, or a
+   null pointer without MEM_DEBUG. */
+static void *
+page_caller (struct pool *pool UNUSED, size_t page_idx UNUSED) 
+{
+#ifdef MEM_DEBUG
+  return page_callers[page_idx];
+#else
+  return NULL;
+#endif
+}
+
+/* Records that the PAGE_CNT pages starting at PAGE_IDX in POOL
+   were allocated for TAG by CALLER. */
+static void
+account_alloc (struct pool *pool UNUSED, size_t page_idx, size_t page_cnt,
+               enum mem_tag tag, void *caller UNUSED) 
+{
+  size_t i;
+
+  for (i = page_idx; i < page_idx + page_cnt; i++)
+    {
+      page_tags[i] = tag;
+#ifdef MEM_DEBUG
+      page_callers[i] = caller;
+#endif
+    }
+  mem_usage_add (&page_usage[tag], page_cnt * PGSIZE);
+#ifdef MEM_DEBUG
+  memtag_record (caller, tag, page_cnt * PGSIZE);
+#endif
+}
+
+/* Records that the PAGE_CNT pages starting at PAGE_IDX in POOL
+   are being freed.  The pages need not all have the same tag,
+   since palloc_extend() and partial frees can mix them. */
+static void
+account_free (struct pool *pool UNUSED, size_t page_idx, size_t page_cnt) 
+{
+  size_t i;
+
+  for (i = page_idx; i < page_idx + page_cnt; i++)
+    {
+      mem_usage_sub (&page_usage[page_tags[i]], PGSIZE);
+#ifdef MEM_DEBUG
+      memtag_forget (page_callers[i], PGSIZE);
+#endif
+    }
+}
+
+/* If page PAGE_IDX in POOL is still in a free block, takes the
+   block out of the free lists and frees again the parts of it
+   that lie before PAGE_IDX or at or beyond END, so that pages
+   PAGE_IDX up to END are no longer free.  Every page in that
+   range must be free or already claimed. */
+static void
+claim_page (struct pool *pool, size_t page_idx, size_t end) 
+{
+  int order;
+
+  for (order = 0; order < PALLOC_ORDERS; order++)
+    {
+      size_t head = page_idx & ~(((size_t) 1 << order) - 1);
+      size_t block_end = head + ((size_t) 1 << order);
+
+      if (free_order[head] == order + 1)
+        {
+          pull_block (pool, head, order);
+          put_range (pool, head, page_idx - head);
+          if (block_end > end)
+            put_range (pool, end, block_end - end);
+          return;
+        }
+    }
+}
+
+/* Moves a free chunk from the other pool into POOL, if POOL may
+   grow by a chunk and the other pool has a chunk free beyond its
+   high watermark.  The kernel pool takes the lowest chunk it can
+   and the user pool the highest, to keep each pool's memory
+   together.  Returns true if successful. */
+static bool
+borrow_chunk (struct pool *pool) 
+{
+  struct pool *from = pool == &kernel_pool ? &user_pool : &kernel_pool;
+  size_t best = SIZE_MAX, best_block = 0;
+  int best_order = 0;
+  int order;
+
+  /* Check without the locks first, since usually it won't do. */
+  if (from->free_pages < from->high_water + CHUNK_PAGES
+      || pool->page_cnt + CHUNK_PAGES > pool->max_pages)
+    return false;
+
+  spinlock_acquire (&kernel_pool.lock);
+  spinlock_acquire (&user_pool.lock);
+  if (from->free_pages >= from->high_water + CHUNK_PAGES
+      && pool->page_cnt + CHUNK_PAGES <= pool->max_pages)
+    for (order = CHUNK_ORDER; order < PALLOC_ORDERS; order++)
+      {
+        struct list *list = &from->free_lists[order];
+        struct list_elem *e;
+
+        for (e = list_begin (list); e != list_end (list); e = list_next (e))
+          {
+            size_t block = block_idx (from, e);
+            size_t chunk = block >> CHUNK_ORDER;
+
+            if (pool == &user_pool)
+              {
+                chunk += ((size_t) 1 << (order - CHUNK_ORDER)) - 1;
+                if (chunk < user_floor
+                    || (best != SIZE_MAX && chunk < best))
+                  continue;
+              }
+            else if (chunk > best)
+              continue;
+            best = chunk;
+            best_block = block;
+            best_order = order;
+          }
+      }
+
+  if (best != SIZE_MAX)
+    {
+      size_t start = best << CHUNK_ORDER;
+      size_t end = start + CHUNK_PAGES;
+      size_t block_end = best_block + ((size_t) 1 << best_order);
+
+      /* Take the block out of the lender, give it back what lies
+         on either side of the chunk, and free the chunk in
+         POOL. */
+      pull_block (from, best_block, best_order);
+      chunk_owner[best] = pool;
+      put_range (from, best_block, start - best_block);
+      put_range (from, end, block_end - end);
+      put_range (pool, start, CHUNK_PAGES);
+      from->page_cnt -= CHUNK_PAGES;
+      pool->page_cnt += CHUNK_PAGES;
+      pool->borrowed++;
+    }
+  spinlock_release (&user_pool.lock);
+  spinlock_release (&kernel_pool.lock);
+
+  return best != SIZE_MAX;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL, starting at a
+   physical address that is a multiple of ALIGN pages, and returns
+   the index of the first, or BITMAP_ERROR if no free run is large
+   enough. */
+static size_t
+pool_alloc (struct pool *pool, size_t page_cnt, size_t align) 
+{
+  size_t page_idx;
+
+  spinlock_acquire (&pool->lock);
+  if (align == 1)
+    page_idx = take_pages (pool, page_cnt);
+  else
+    page_idx = take_aligned (pool, page_cnt, align);
+  spinlock_release (&pool->lock);
+
+  return page_idx;
+}
+
+/* Does the work of pool_alloc() with POOL's lock held. */
+static size_t
+take_pages (struct pool *pool, size_t page_cnt) 
+{
+  size_t page_idx = BITMAP_ERROR;
+  int order, k;
+
+  ASSERT (spinlock_held (&pool->lock));
+
+  for (order = 0; ((size_t) 1 << order) < page_cnt; order++)
+    if (order + 1 >= PALLOC_ORDERS)
+      return BITMAP_ERROR;
+
+  for (k = order; k < PALLOC_ORDERS; k++)
+    if (!list_empty (&pool->free_lists[k]))
+      {
+        page_idx = block_idx (pool, list_front (&pool->free_lists[k]));
+        pull_block (pool, page_idx, k);
+
+        /* Split down to ORDER, freeing the upper halves. */
+        while (k > order)
+          {
+            k--;
+            push_block (pool, page_idx + ((size_t) 1 << k), k);
+          }
+
+        /* Give back the pages beyond PAGE_CNT. */
+        put_range (pool, page_idx + page_cnt,
+                   ((size_t) 1 << order) - page_cnt);
+
+        ASSERT (bitmap_none (used_map, page_idx, page_cnt));
+        bitmap_set_multiple (used_map, page_idx, page_cnt, true);
+        break;
+      }
+
+  return page_idx;
+}
+
+/* Like take_pages(), but the run starts at a physical address
+   that is a multiple of ALIGN pages.  Tries each such address in
+   turn, and takes the first run that POOL owns and that is all
+   free, out of whatever free blocks it spans. */
+static size_t
+take_aligned (struct pool *pool, size_t page_cnt, size_t align) 
+{
+  size_t base_no = vtop (pool_base) / PGSIZE;
+  size_t page_idx;
 
-  return page_no >= start_page && page_no < end_page;
+  ASSERT (spinlock_held (&pool->lock));
+
+  if (pool->free_pages < page_cnt)
+    return BITMAP_ERROR;
+  for (page_idx = ROUND_UP (base_no, align) - base_no;
+       page_idx + page_cnt <= total_pages; page_idx += align)
+    if (owns_range (pool, page_idx, page_idx + page_cnt)
+        && bitmap_none (used_map, page_idx, page_cnt))
+      {
+        size_t i;
+
+        for (i = page_idx; i < page_idx + page_cnt; i++)
+          claim_page (pool, i, page_idx + page_cnt);
+        bitmap_set_multiple (used_map, page_idx, page_cnt, true);
+        return page_idx;
+      }
+  return BITMAP_ERROR;
+}
+
+/* Takes a page from POOL's reserve of pre-zeroed pages, waking
+   the zeroing thread if the reserve runs low.  Returns a null
+   pointer if the reserve is empty. */
+static void *
+take_zeroed (struct pool *pool) 
+{
+  void *page = NULL;
+  bool low;
+
+  spinlock_acquire (&pool->lock);
+  if (pool->zeroed_cnt > 0)
+    {
+      page = pool->zeroed[--pool->zeroed_cnt];
+      pool->zero_hits++;
+    }
+  low = pool->zeroed_cnt + pool->zeroing_cnt < ZERO_RESERVE / 2;
+  spinlock_release (&pool->lock);
+
+  if (low)
+    sema_up (&zero_wanted);
+  return page;
+}
+
+/* Returns the running CPU's list of free pages from POOL.
+   Only the boot CPU runs for now, so that is always the first.
+   Interrupts must be off. */
+static struct cpu_pages *
+cpu_pages (struct pool *pool) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return &pool->cpu_pages[0];
+}
+
+/* Moves CNT pages from POOL's free lists to the end of C, or
+   fewer if POOL runs out.  The caller must hold POOL's lock. */
+static void
+cpu_refill (struct pool *pool, struct cpu_pages *c, size_t cnt) 
+{
+  ASSERT (c->cnt + cnt <= CPU_PAGES_MAX);
+
+  for (; cnt > 0; cnt--)
+    {
+      size_t page_idx = take_pages (pool, 1);
+      if (page_idx == BITMAP_ERROR)
+        break;
+      c->pages[c->cnt++] = pool_base + PGSIZE * page_idx;
+    }
+  pool->cpu_refills++;
+}
+
+/* Moves the CNT pages at the end of C back to POOL's free lists.
+   The caller must hold POOL's lock. */
+static void
+cpu_drain (struct pool *pool, struct cpu_pages *c, size_t cnt) 
+{
+  ASSERT (cnt <= c->cnt);
+
+  for (; cnt > 0; cnt--)
+    {
+      size_t page_idx = pg_no (c->pages[--c->cnt]) - pg_no (pool_base);
+
+      bitmap_reset (used_map, page_idx);
+      put_range (pool, page_idx, 1);
+    }
+  pool->cpu_drains++;
+}
+
+/* Takes a free page from the running CPU's list for POOL,
+   refilling the list from POOL first if it is empty.  Returns a
+   null pointer if the lists are off or POOL is exhausted. */
+static void *
+cpu_get (struct pool *pool) 
+{
+  enum intr_level old_level;
+  struct cpu_pages *c;
+  void *page = NULL;
+
+  if (!use_cpu_pages)
+    return NULL;
+
+  old_level = intr_disable ();
+  c = cpu_pages (pool);
+  if (c->cnt == 0)
+    {
+      spinlock_acquire (&pool->lock);
+      cpu_refill (pool, c, CPU_PAGES_BATCH);
+      spinlock_release (&pool->lock);
+    }
+  if (c->cnt > 0)
+    {
+      page = c->pages[--c->cnt];
+      pool->cpu_hits++;
+    }
+  intr_set_level (old_level);
+
+  return page;
+}
+
+/* Puts PAGE, which was allocated from POOL and is no longer in
+   use, on the running CPU's list for POOL, first draining a
+   batch of the list to POOL if it is full.  Returns false if the
+   lists are off. */
+static bool
+cpu_put (struct pool *pool, void *page) 
+{
+  enum intr_level old_level;
+  struct cpu_pages *c;
+
+  if (!use_cpu_pages)
+    return false;
+
+  ASSERT (bitmap_test (used_map, pg_no (page) - pg_no (pool_base)));
+  old_level = intr_disable ();
+  c = cpu_pages (pool);
+  if (c->cnt == CPU_PAGES_MAX)
+    {
+      spinlock_acquire (&pool->lock);
+      cpu_drain (pool, c, CPU_PAGES_BATCH);
+      spinlock_release (&pool->lock);
+    }
+  c->pages[c->cnt++] = page;
+  intr_set_level (old_level);
+
+  return true;
+}
+
+/* Returns every CPU's free pages from POOL to its free lists.
+   Returns true if any pages were returned. */
+static bool
+drain_cpu_pages (struct pool *pool) 
+{
+  bool drained = false;
+  int i;
+
+  spinlock_acquire (&pool->lock);
+  for (i = 0; i < NCPU; i++)
+    {
+      struct cpu_pages *c = &pool->cpu_pages[i];
+      if (c->cnt > 0)
+        {
+          cpu_drain (pool, c, c->cnt);
+          drained = true;
+        }
+    }
+  spinlock_release (&pool->lock);
+
+  return drained;
+}
+
+/* Returns all of POOL's pre-zeroed pages to its free lists, for
+   when an allocation would fail otherwise.  Returns true if any
+   pages were returned. */
+static bool
+drain_zeroed (struct pool *pool) 
+{
+  bool drained;
+
+  spinlock_acquire (&pool->lock);
+  drained = pool->zeroed_cnt > 0;
+  while (pool->zeroed_cnt > 0)
+    {
+      void *page = pool->zeroed[--pool->zeroed_cnt];
+      size_t page_idx = pg_no (page) - pg_no (pool_base);
+
+      bitmap_reset (used_map, page_idx);
+      put_range (pool, page_idx, 1);
+    }
+  spinlock_release (&pool->lock);
+
+  return drained;
+}
+
+/* Fills POOL's reserve of pre-zeroed pages, zeroing each page
+   without holding the lock. */
+static void
+fill_zeroed (struct pool *pool) 
+{
+  for (;;)
+    {
+      size_t page_idx;
+      void *page;
+
+      /* Pages held in the reserve are no use to a pool that is
+         running low. */
+      spinlock_acquire (&pool->lock);
+      if (pool->zeroed_cnt + pool->zeroing_cnt >= ZERO_RESERVE
+          || pool->free_pages < pool->low_water)
+        page_idx = BITMAP_ERROR;
+      else
+        page_idx = take_pages (pool, 1);
+      if (page_idx != BITMAP_ERROR)
+        pool->zeroing_cnt++;
+      spinlock_release (&pool->lock);
+      if (page_idx == BITMAP_ERROR)
+        return;
+
+      page = pool_base + PGSIZE * page_idx;
+      memzero_page (page);
+
+      spinlock_acquire (&pool->lock);
+      pool->zeroing_cnt--;
+      pool->zeroed[pool->zeroed_cnt++] = page;
+      spinlock_release (&pool->lock);
+    }
+}
+
+/* The zeroing thread.  Runs at PRI_MIN, so it only gets the CPU
+   when nothing else wants it, and refills both reserves whenever
+   take_zeroed() finds one running low. */
+static void
+zero_thread (void *aux UNUSED) 
+{
+  /* Keep MLFQS from raising our priority. */
+  thread_set_worker ();
+  for (;;)
+    {
+      fill_zeroed (&kernel_pool);
+      fill_zeroed (&user_pool);
+      sema_down (&zero_wanted);
+    }
+}
+
+/* Stores in *FREE_PAGES the number of free pages in POOL,
+   including those on the CPU lists, and in *LARGEST the largest
+   order with a block in its free lists, or -1 if they are
+   empty. */
+static void
+pool_stats (struct pool *pool, size_t *free_pages, int *largest) 
+{
+  int order;
+
+  *free_pages = 0;
+  *largest = -1;
+  spinlock_acquire (&pool->lock);
+  for (order = 0; order < PALLOC_ORDERS; order++)
+    if (pool->free_cnt[order] > 0)
+      {
+        *free_pages += pool->free_cnt[order] << order;
+        *largest = order;
+      }
+  for (order = 0; order < NCPU; order++)
+    *free_pages += pool->cpu_pages[order].cnt;
+  spinlock_release (&pool->lock);
+}
+
+/* Prints POOL's free pages, the largest order with a free block,
+   and the free pages held at each order, which together show how
+   fragmented the pool is. */
+static void
+print_pool (struct pool *pool) 
+{
+  size_t free_pages;
+  int largest;
+  int order;
+
+  pool_stats (pool, &free_pages, &largest);
+
+  printf ("Palloc %s: %zu of %zu pages free, largest free order %d\n",
+          pool->name, free_pages, pool->page_cnt, largest);
+  printf ("  %zu pages pre-zeroed, %llu zeroed pages from reserve, "
+          "%llu zeroed inline\n",
+          pool->zeroed_cnt, pool->zero_hits, pool->zero_sync);
+  printf ("  watermarks %zu/%zu pages, %llu chunks of %zu pages "
+          "taken from the other pool\n",
+          pool->low_water, pool->high_water, pool->borrowed, CHUNK_PAGES);
+  printf ("  %llu pages from CPU lists, %llu refills, %llu drains\n",
+          pool->cpu_hits, pool->cpu_refills, pool->cpu_drains);
+  if (largest >= 0)
+    {
+      printf ("  free pages by order:");
+      for (order = 0; order <= largest; order++)
+        printf (" %d:%zu", order, pool->free_cnt[order] << order);
+      printf ("\n");
+    }
 }
@@ -1,7 +1,10 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include "threads/memtag.h"
 
 /* How to allocate pages. */
 enum palloc_flags
@@ -11,10 +14,53 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
+/* Frees up to PAGE_CNT pages that a cache holds and returns the
+   number freed.  Called from inside the page allocator by a
+   thread that may hold any lock, so it must take its own locks
+   with lock_try_acquire() and skip what it cannot lock.  Pages
+   it allocates meanwhile are taken without running shrinkers. */
+typedef size_t shrink_func (size_t page_cnt);
+
+/* A cache of kernel pool pages that gives them back when the
+   pool runs low.  Shrinkers run in order of PRIORITY, lowest
+   first, until enough pages are free. */
+struct shrinker
+  {
+    const char *name;           /* For statistics. */
+    shrink_func *shrink;        /* Frees pages. */
+    int priority;               /* SHRINK_* below. */
+    struct list_elem elem;      /* In palloc's list of shrinkers. */
+    unsigned long long calls;   /* Times SHRINK was called. */
+    unsigned long long freed;   /* Pages it freed. */
+  };
+
+/* Shrinker priorities, from cheapest to most expensive to give
+   up. */
+#define SHRINK_EMPTY 0          /* Pages holding nothing. */
+#define SHRINK_CACHE 10         /* Cached data, cheap to get again. */
+#define SHRINK_WRITEBACK 20     /* Data that must be written out first. */
+
 void palloc_init (size_t user_page_limit);
+void palloc_start_zeroing (void);
+void palloc_use_cpu_pages (bool);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_page_tagged (enum palloc_flags, enum mem_tag);
+void *palloc_get_multiple_tagged (enum palloc_flags, size_t page_cnt,
+                                  enum mem_tag);
+void *palloc_get_aligned (enum palloc_flags, size_t page_cnt, size_t align);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void palloc_free_pages (void *pages[], size_t page_cnt);
+bool palloc_extend (void *, size_t page_cnt, size_t new_cnt);
+void palloc_get_stats (enum palloc_flags, size_t *free_pages,
+                       int *largest_order);
+void palloc_get_zero_stats (enum palloc_flags, unsigned long long *hits,
+                            unsigned long long *sync);
+void palloc_get_usage (enum mem_tag, struct mem_usage *);
+void palloc_get_user_range (void **base, size_t *page_cnt);
+void palloc_register_shrinker (struct shrinker *, const char *name,
+                               shrink_func *, int priority);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,171 @@
+#include "threads/pmu.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* Events to count, separated by commas.  Set by -pmu. */
+char *pmu_events;
+
+/* Architectural performance monitoring MSRs and event select
+   bits.  See [IA32-v3b] 18.2 "Architectural Performance
+   Monitoring". */
+#define MSR_PERFEVTSEL0 0x186   /* First event select register. */
+#define MSR_PMC0 0x0c1          /* First counter. */
+#define EVTSEL_USR 0x10000      /* Count in user mode. */
+#define EVTSEL_OS 0x20000       /* Count in kernel mode. */
+#define EVTSEL_EN 0x400000      /* Enable the counter. */
+
+/* CR4 bit that allows RDPMC in user mode. */
+#define CR4_PCE 0x100
+
+/* An architectural event.  CPUID function 0xa reports which are
+   unavailable in EBX, by their order in this table. */
+struct pmu_event
+  {
+    const char *name;           /* Name for -pmu. */
+    uint8_t event;              /* Event select. */
+    uint8_t umask;              /* Unit mask. */
+  };
+
+static const struct pmu_event events[] =
+  {
+    {"cycles", 0x3c, 0x00},
+    {"instructions", 0xc0, 0x00},
+    {"ref-cycles", 0x3c, 0x01},
+    {"llc-refs", 0x2e, 0x4f},
+    {"llc-misses", 0x2e, 0x41},
+    {"branches", 0xc4, 0x00},
+    {"branch-misses", 0xc5, 0x00},
+  };
+#define EVENT_CNT (sizeof events / sizeof *events)
+
+/* Counters in use, starting from counter 0. */
+static int counter_cnt;
+
+/* Mask of the bits that the counters implement. */
+static uint64_t counter_mask;
+
+/* Values of the counters when they were last charged to a
+   thread.  Only the boot CPU runs for now. */
+static uint64_t marks[PMU_COUNTERS];
+
+/* Writes VALUE to model-specific register MSR. */
+static inline void
+wrmsr (uint32_t msr, uint64_t value)
+{
+  asm volatile ("wrmsr"
+                : : "c" (msr), "a" ((uint32_t) value),
+                    "d" ((uint32_t) (value >> 32)));
+}
+
+/* Executes CPUID function FUNC. */
+static void
+cpuid (uint32_t func, uint32_t *eax, uint32_t *ebx, uint32_t *edx)
+{
+  uint32_t ecx;
+  asm ("cpuid" : "=a" (*eax), "=b" (*ebx), "=c" (ecx), "=d" (*edx)
+               : "a" (func), "c" (0));
+}
+
+/* Sets up a counter for each event in pmu_events, if the CPU has
+   architectural performance monitoring, and lets user programs
+   use RDPMC. */
+void
+pmu_init (void)
+{
+  uint32_t eax, ebx, edx, cr4;
+  unsigned version, cnt, width, known;
+  char *name, *save_ptr;
+
+  if (pmu_events == NULL)
+    return;
+
+  cpuid (0, &eax, &ebx, &edx);
+  if (eax >= 0xa)
+    cpuid (0xa, &eax, &ebx, &edx);
+  else
+    eax = 0;
+  version = eax & 0xff;
+  cnt = (eax >> 8) & 0xff;
+  width = (eax >> 16) & 0xff;
+  known = (eax >> 24) & 0xff;
+  if (version == 0 || cnt == 0)
+    {
+      printf ("PMU: no performance counters, -pmu ignored\n");
+      return;
+    }
+  if (cnt > PMU_COUNTERS)
+    cnt = PMU_COUNTERS;
+  counter_mask = width < 64 ? ((uint64_t) 1 << width) - 1 : UINT64_MAX;
+
+  for (name = strtok_r (pmu_events, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      unsigned e;
+
+      for (e = 0; e < EVENT_CNT; e++)
+        if (!strcmp (name, events[e].name))
+          break;
+      if (e >= EVENT_CNT)
+        PANIC ("unknown -pmu event `%s'", name);
+      if (e >= known || (ebx & (1u << e)) != 0)
+        {
+          printf ("PMU: event %s not available\n", name);
+          continue;
+        }
+      if (counter_cnt >= (int) cnt)
+        {
+          printf ("PMU: only %u counters, %s not counted\n", cnt, name);
+          continue;
+        }
+
+      wrmsr (MSR_PERFEVTSEL0 + counter_cnt, 0);
+      wrmsr (MSR_PMC0 + counter_cnt, 0);
+      wrmsr (MSR_PERFEVTSEL0 + counter_cnt,
+             events[e].event | (events[e].umask << 8)
+             | EVTSEL_USR | EVTSEL_OS | EVTSEL_EN);
+      printf ("PMU: counter %d counts %s\n", counter_cnt, name);
+      counter_cnt++;
+    }
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  cr4 |= CR4_PCE;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+}
+
+/* Charges what the counters counted since they were last
+   charged to thread T, which must be the running thread.  Called
+   by the scheduler just before it switches away from T.
+   Interrupts must be off. */
+void
+pmu_switch (struct thread *t)
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < counter_cnt; i++)
+    {
+      uint64_t value = rdpmc (i);
+      t->pmu_counts[i] += (value - marks[i]) & counter_mask;
+      marks[i] = value;
+    }
+}
+
+/* Copies the running thread's counts into COUNTS and returns the
+   number of counters in use, which might be 0. */
+int
+pmu_thread_counts (uint64_t counts[PMU_COUNTERS])
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  pmu_switch (cur);
+  memcpy (counts, cur->pmu_counts, sizeof cur->pmu_counts);
+  intr_set_level (old_level);
+  return counter_cnt;
+}
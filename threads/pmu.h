@@ -0,0 +1,33 @@
+#ifndef THREADS_PMU_H
+#define THREADS_PMU_H
+
+#include <stdint.h>
+
+/* Hardware performance counters.
+
+   When the kernel is started with -pmu=EVENT[,EVENT], each of
+   the first PMU_COUNTERS general-purpose counters of the CPU's
+   architectural performance monitoring unit is set to count one
+   of the named events, in user and kernel mode alike.  The
+   counters run all the time, but the scheduler charges what they
+   counted to the thread that ran, so each thread has its own
+   counts.  User programs read theirs with the pmu_read() system
+   call, and may also read the raw, shared counters with the
+   RDPMC instruction, which is cheaper but counts every thread.
+
+   Without -pmu, or on a CPU without the PMU (as under most
+   emulators), no counter is set up and pmu_switch() does
+   nothing. */
+
+/* Counters that may be in use at once. */
+#define PMU_COUNTERS 2
+
+struct thread;
+
+extern char *pmu_events;
+
+void pmu_init (void);
+void pmu_switch (struct thread *);
+int pmu_thread_counts (uint64_t counts[PMU_COUNTERS]);
+
+#endif /* threads/pmu.h */
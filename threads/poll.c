@@ -0,0 +1,123 @@
+#include "threads/poll.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+static void wake (struct poll_waiter *);
+static timer_event_func poll_timeout;
+
+/* Initializes Q as an empty poll queue. */
+void
+poll_queue_init (struct poll_queue *q)
+{
+  list_init (&q->entries);
+}
+
+/* Wakes every waiter with an entry on Q.  The entries stay on Q
+   until their waiters remove them.  May be called from an
+   interrupt handler. */
+void
+poll_wake (struct poll_queue *q)
+{
+  enum intr_level old_level = intr_disable ();
+  struct list_elem *e;
+
+  for (e = list_begin (&q->entries); e != list_end (&q->entries);
+       e = list_next (e))
+    wake (list_entry (e, struct poll_entry, elem)->waiter);
+  intr_set_level (old_level);
+}
+
+/* Initializes W for the running thread to wait with. */
+void
+poll_waiter_init (struct poll_waiter *w)
+{
+  w->thread = thread_current ();
+  w->woken = false;
+  w->blocked = false;
+  w->timeout.pending = false;
+}
+
+/* Adds E, on behalf of W, to Q, so that poll_wake (Q) wakes W.
+   E must not be on any queue. */
+void
+poll_add (struct poll_waiter *w, struct poll_entry *e, struct poll_queue *q)
+{
+  enum intr_level old_level = intr_disable ();
+
+  e->waiter = w;
+  e->queue = q;
+  list_push_back (&q->entries, &e->elem);
+  intr_set_level (old_level);
+}
+
+/* Removes E from its queue, if it is on one. */
+void
+poll_remove (struct poll_entry *e)
+{
+  enum intr_level old_level;
+
+  if (e->queue == NULL)
+    return;
+  old_level = intr_disable ();
+  list_remove (&e->elem);
+  e->queue = NULL;
+  intr_set_level (old_level);
+}
+
+/* Blocks until one of W's queues is woken, which may already
+   have happened since poll_waiter_init(), or until timer_ticks()
+   reaches DEADLINE, unless DEADLINE is negative.  Returns false
+   if the deadline passed first, true otherwise.  Either way W
+   can be used to wait again, after checking the objects. */
+bool
+poll_block (struct poll_waiter *w, int64_t deadline)
+{
+  enum intr_level old_level;
+  bool woken;
+
+  ASSERT (!intr_context ());
+  ASSERT (w->thread == thread_current ());
+
+  old_level = intr_disable ();
+  if (!w->woken && (deadline < 0 || deadline > timer_ticks ()))
+    {
+      if (deadline >= 0)
+        timer_add (&w->timeout, deadline, poll_timeout, w);
+      w->blocked = true;
+      thread_block ();
+      timer_cancel (&w->timeout);
+    }
+  woken = w->woken;
+  w->woken = false;
+  intr_set_level (old_level);
+
+  return woken;
+}
+
+/* Marks W woken, and unblocks its thread if it is in
+   poll_block().  Interrupts must be off. */
+static void
+wake (struct poll_waiter *w)
+{
+  w->woken = true;
+  if (w->blocked)
+    {
+      w->blocked = false;
+      thread_unblock (w->thread);
+    }
+}
+
+/* Timer callback that ends poll_block() for waiter W_ at its
+   deadline, without marking it woken. */
+static void
+poll_timeout (void *w_)
+{
+  struct poll_waiter *w = w_;
+
+  if (w->blocked)
+    {
+      w->blocked = false;
+      thread_unblock (w->thread);
+    }
+}
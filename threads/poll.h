@@ -0,0 +1,57 @@
+#ifndef THREADS_POLL_H
+#define THREADS_POLL_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+
+/* Readiness notification, for waiting on several objects at once.
+
+   An object that a thread may wait on, such as a pipe, embeds a
+   poll_queue and calls poll_wake() whenever it might have become
+   readable or writable.  A thread that waits on several objects
+   initializes a poll_waiter, adds one poll_entry per object to
+   the object's queue, then checks each object and, only if none
+   is ready, calls poll_block().  Because the entries go on the
+   queues before the checks, a change that comes in between
+   still wakes the waiter, and poll_block() returns at once.
+   Either way the waiter takes its entries off with poll_remove()
+   and checks again.
+
+   Queues are protected by turning off interrupts, so poll_wake()
+   may be called from an interrupt handler or with a lock held. */
+
+/* Objects embed one of these. */
+struct poll_queue
+  {
+    struct list entries;        /* Waiters' poll_entry elements. */
+  };
+
+/* A thread waiting on any of several poll_queues. */
+struct poll_waiter
+  {
+    struct thread *thread;      /* Waiting thread. */
+    bool woken;                 /* Some queue was woken. */
+    bool blocked;               /* In poll_block(). */
+    struct timer_event timeout; /* Wakes the thread at the deadline. */
+  };
+
+/* A poll_waiter's membership in one poll_queue. */
+struct poll_entry
+  {
+    struct list_elem elem;      /* Element in QUEUE's list. */
+    struct poll_waiter *waiter; /* Waiter to wake. */
+    struct poll_queue *queue;   /* Queue, or a null pointer if none. */
+  };
+
+void poll_queue_init (struct poll_queue *);
+void poll_wake (struct poll_queue *);
+
+void poll_waiter_init (struct poll_waiter *);
+void poll_add (struct poll_waiter *, struct poll_entry *,
+               struct poll_queue *);
+void poll_remove (struct poll_entry *);
+bool poll_block (struct poll_waiter *, int64_t deadline);
+
+#endif /* threads/poll.h */
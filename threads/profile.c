@@ -0,0 +1,243 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/pagedir.h"
+#endif
+
+/* If true, timer ticks take samples.  Set by -profile. */
+bool profile_enabled;
+
+/* A distinct stack sampled in one thread, and how many times. */
+struct profile_entry
+  {
+    uint32_t pcs[PROFILE_DEPTH]; /* EIP, callers, then zeros. */
+    uint32_t cnt;               /* Number of samples, 0 if unused. */
+    tid_t tid;                  /* Thread sampled. */
+    bool user;                  /* Sampled in user mode? */
+    char name[16];              /* Thread's name. */
+  };
+
+/* Entries in each CPU's table.  Must be a power of 2.  Samples of
+   new stacks are dropped once 3/4 of the entries are used, so
+   that probe sequences stay short. */
+#define PROFILE_SLOTS 1024
+
+/* A per-CPU table of sampled stacks, open addressed with linear
+   probing. */
+struct profile_table
+  {
+    uint32_t samples;           /* Samples taken. */
+    uint32_t dropped;           /* Samples that found no free entry. */
+    uint32_t used;              /* Entries in use. */
+    struct profile_entry entries[PROFILE_SLOTS];
+  };
+
+/* NCPU tables, from the page allocator so that a kernel run
+   without -profile does not carry them in its image. */
+static struct profile_table *tables;
+
+static int kernel_callers (const struct intr_frame *, uint32_t pcs[], int);
+#ifdef USERPROG
+static int user_callers (const struct intr_frame *, uint32_t pcs[], int);
+#endif
+
+/* Allocates the tables if -profile was given.  Must be called
+   after palloc_init() and before the timer interrupt is
+   enabled. */
+void
+profile_init (void)
+{
+  if (profile_enabled)
+    tables = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                  DIV_ROUND_UP (sizeof *tables * NCPU,
+                                                PGSIZE));
+}
+
+/* Records a sample of the code that interrupt frame F
+   interrupted.  Called by the timer interrupt handler.  Only the
+   boot CPU runs for now, so the table is always tables[0]. */
+void
+profile_sample (const struct intr_frame *f)
+{
+  struct profile_table *t = &tables[0];
+  struct thread *cur = thread_current ();
+  uint32_t pcs[PROFILE_DEPTH];
+  bool user = (f->cs & 3) == 3;
+  unsigned idx;
+  int cnt;
+
+  ASSERT (intr_context ());
+
+  memset (pcs, 0, sizeof pcs);
+  pcs[0] = (uintptr_t) f->eip;
+#ifdef USERPROG
+  if (user)
+    cnt = user_callers (f, pcs + 1, PROFILE_DEPTH - 1);
+  else
+#endif
+    cnt = kernel_callers (f, pcs + 1, PROFILE_DEPTH - 1);
+  t->samples++;
+
+  for (idx = hash_bytes (pcs, (cnt + 1) * sizeof *pcs) ^ hash_mix (cur->tid);
+       ; idx++)
+    {
+      struct profile_entry *e = &t->entries[idx % PROFILE_SLOTS];
+
+      if (e->cnt == 0)
+        {
+          if (t->used >= PROFILE_SLOTS / 4 * 3)
+            {
+              t->dropped++;
+              return;
+            }
+          memcpy (e->pcs, pcs, sizeof pcs);
+          e->tid = cur->tid;
+          e->user = user;
+          strlcpy (e->name, cur->name, sizeof e->name);
+          t->used++;
+        }
+      else if (e->tid != cur->tid || e->user != user
+               || memcmp (e->pcs, pcs, sizeof pcs))
+        continue;
+      e->cnt++;
+      return;
+    }
+}
+
+/* Stores up to MAX return addresses of the kernel code that F
+   interrupted into PCS[], following the chain of saved frame
+   pointers, and returns how many.  Stops at the first frame
+   pointer that leaves the interrupted thread's stack or does not
+   move up it. */
+static int
+kernel_callers (const struct intr_frame *f, uint32_t pcs[], int max)
+{
+  /* An interrupt in kernel mode stays on the same stack. */
+  struct thread *t = running_thread ();
+  uint8_t *stack = t->kstack;
+  uint32_t *frame = (uint32_t *) f->ebp;
+  int cnt;
+
+  for (cnt = 0; cnt < max; cnt++)
+    {
+      uint32_t *next;
+
+      if ((uint8_t *) frame < stack
+          || (uint8_t *) (frame + 2) > stack + t->kstack_size
+          || (uintptr_t) frame % sizeof *frame != 0)
+        break;
+      pcs[cnt] = frame[1];
+      next = (uint32_t *) frame[0];
+      if (next <= frame)
+        {
+          cnt++;
+          break;
+        }
+      frame = next;
+    }
+  return cnt;
+}
+
+#ifdef USERPROG
+/* Reads the word at user address UADDR in page directory PD into
+   *VALUE and returns true, or returns false if UADDR is not
+   aligned or its page is not present.  Never faults. */
+static bool
+read_user_word (uint32_t *pd, uint32_t uaddr, uint32_t *value)
+{
+  uint32_t *kaddr;
+
+  if (uaddr == 0 || uaddr % sizeof *value != 0
+      || !is_user_vaddr ((void *) uaddr))
+    return false;
+  kaddr = pagedir_get_page (pd, (void *) uaddr);
+  if (kaddr == NULL)
+    return false;
+  *value = *kaddr;
+  return true;
+}
+
+/* Stores up to MAX return addresses of the user code that F
+   interrupted into PCS[], as kernel_callers() does, reading the
+   user stack only through the page directory so that a frame
+   that is swapped out or bogus just ends the walk. */
+static int
+user_callers (const struct intr_frame *f, uint32_t pcs[], int max)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  uint32_t frame = f->ebp;
+  int cnt;
+
+  if (pd == NULL)
+    return 0;
+  for (cnt = 0; cnt < max; cnt++)
+    {
+      uint32_t next;
+
+      if (!read_user_word (pd, frame + 4, &pcs[cnt])
+          || !read_user_word (pd, frame, &next))
+        break;
+      if (next <= frame)
+        {
+          cnt++;
+          break;
+        }
+      frame = next;
+    }
+  return cnt;
+}
+#endif
+
+/* Prints every CPU's table to the console, one "P" line per
+   stack giving its count, K or U for kernel or user mode, the
+   thread's tid and name, and the addresses, innermost first, so
+   that utils/profile can pick them out of the log. */
+void
+profile_print_stats (void)
+{
+  int i;
+
+  if (!profile_enabled)
+    return;
+
+  profile_enabled = false;
+  for (i = 0; i < NCPU; i++)
+    {
+      const struct profile_table *t = &tables[i];
+      size_t j;
+
+      printf ("Profile: cpu %d, %"PRIu32" samples, %"PRIu32" dropped, "
+              "%"PRIu32" stacks\n", i, t->samples, t->dropped, t->used);
+      for (j = 0; j < PROFILE_SLOTS; j++)
+        {
+          const struct profile_entry *e = &t->entries[j];
+          char name[sizeof e->name];
+          char *p;
+          int k;
+
+          if (e->cnt == 0)
+            continue;
+
+          /* Keep the name one word. */
+          strlcpy (name, e->name, sizeof name);
+          for (p = name; *p != '\0'; p++)
+            if (*p == ' ')
+              *p = '_';
+
+          printf ("P %"PRIu32" %c %d %s", e->cnt, e->user ? 'U' : 'K',
+                  e->tid, name[0] != '\0' ? name : "-");
+          for (k = 0; k < PROFILE_DEPTH && e->pcs[k] != 0; k++)
+            printf (" %#"PRIx32, e->pcs[k]);
+          printf ("\n");
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Statistical profiler.
+
+   When the kernel is started with -profile, every timer tick
+   samples the interrupted instruction and a few return addresses
+   found by following its frame pointers, in user or kernel mode.
+   Each distinct stack of a thread is counted once in the
+   current CPU's table, which needs no memory allocation and so
+   is safe in the interrupt handler.
+
+   The tables are printed to the console at shutdown, one "P"
+   line per stack, and utils/profile turns them into hit counts
+   per function for the kernel and for each user program, using
+   utils/backtrace to find the functions. */
+
+/* Addresses recorded per sample: the interrupted EIP, then up to
+   PROFILE_DEPTH - 1 return addresses. */
+#define PROFILE_DEPTH 4
+
+struct intr_frame;
+
+extern bool profile_enabled;
+
+void profile_init (void);
+void profile_sample (const struct intr_frame *);
+void profile_print_stats (void);
+
+#endif /* threads/profile.h */
@@ -66,6 +66,9 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=maps a 4 MB page (PDEs only). */
+#define PTE_G 0x100             /* 1=global, survives CR3 reloads. */
+#define PTE_COW 0x200           /* 1=copy-on-write (in PTE_AVL, PTEs only). */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -73,6 +76,22 @@ static inline uint32_t pde_create (uint32_t *pt) {
   return vtop (pt) | PTE_U | PTE_P | PTE_W;
 }
 
+/* Returns a PDE that maps the 4 MB page at PAGE directly,
+   without a page table.  The page is readable, writable as well
+   if WRITABLE is true, and usable only by ring 0 code.  CR4.PSE
+   must be set for the CPU to honor it.  See [IA32-v3a] 3.7.3
+   "Mixing 4-KByte and 4-MByte Pages". */
+static inline uint32_t pde_create_large (void *page, bool writable) {
+  ASSERT (((uintptr_t) page & (PTSPAN - 1)) == 0);
+  return vtop (page) | PTE_PS | PTE_P | (writable ? PTE_W : 0);
+}
+
+/* Like pde_create_large(), but the 4 MB page is usable by user
+   programs as well. */
+static inline uint32_t pde_create_user_large (void *page, bool writable) {
+  return pde_create_large (page, writable) | PTE_U;
+}
+
 /* Returns a pointer to the page table that page directory entry
    PDE, which must "present", points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
@@ -0,0 +1,142 @@
+#include "threads/rcu.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Callbacks waiting for their grace period, oldest first.  Only
+   touched with interrupts off. */
+static struct list callbacks;
+
+/* Grace periods.  GP_CUR is in progress and ends when every CPU
+   has passed a quiescent state in it, that is, when CPU_QS is
+   GP_CUR for all of them; QS_CNT counts those that have.  All
+   grace periods up to GP_DONE have ended. */
+static uint64_t gp_cur;
+static uint64_t gp_done;
+static uint64_t cpu_qs[NCPU];
+static int qs_cnt;
+
+/* Statistics. */
+static long long callbacks_queued;  /* # of rcu_call()s. */
+static long long callbacks_run;     /* # of callbacks run. */
+static size_t callbacks_max;        /* Most waiting at once. */
+static size_t callbacks_cnt;        /* Waiting now. */
+
+/* Initializes RCU.  Must be called before the first rcu_call(). */
+void
+rcu_init (void)
+{
+  list_init (&callbacks);
+  gp_cur = 1;
+  gp_done = 0;
+}
+
+/* Starts a read-side critical section, which may be nested.
+   Until the matching rcu_read_unlock(), the current thread is
+   not preempted, must not sleep, and may follow pointers to
+   elements that writers hand to rcu_call(). */
+void
+rcu_read_lock (void)
+{
+  thread_current ()->rcu_nesting++;
+  barrier ();
+}
+
+/* Ends a read-side critical section.  If a preemption fell due
+   during the outermost one, yields now. */
+void
+rcu_read_unlock (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->rcu_nesting > 0);
+
+  barrier ();
+  if (--t->rcu_nesting == 0 && t->rcu_yield)
+    {
+      t->rcu_yield = false;
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
+}
+
+/* Returns true if the current thread is in a read-side critical
+   section. */
+bool
+rcu_reading (void)
+{
+  return thread_current ()->rcu_nesting > 0;
+}
+
+/* Calls FUNC (HEAD) once every read-side critical section that
+   is running now has ended.  May be called from an interrupt
+   handler. */
+void
+rcu_call (struct rcu_head *head, rcu_func *func)
+{
+  enum intr_level old_level;
+
+  ASSERT (head != NULL);
+  ASSERT (func != NULL);
+
+  old_level = intr_disable ();
+  head->func = func;
+
+  /* If some CPU has already passed its quiescent state in
+     GP_CUR, a reader may have started there since, so wait for
+     the next grace period too. */
+  head->gp = qs_cnt == 0 ? gp_cur : gp_cur + 1;
+  list_push_back (&callbacks, &head->elem);
+  callbacks_queued++;
+  if (++callbacks_cnt > callbacks_max)
+    callbacks_max = callbacks_cnt;
+  intr_set_level (old_level);
+}
+
+/* Records a quiescent state on the current CPU, which is about
+   to run a thread that is not in a read-side critical section,
+   and runs the callbacks whose grace period has ended.  Called
+   by the scheduler on each context switch, with interrupts
+   off. */
+void
+rcu_quiescent (void)
+{
+  int cpu = 0;                  /* Only the boot CPU runs for now. */
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (cpu_qs[cpu] != gp_cur)
+    {
+      cpu_qs[cpu] = gp_cur;
+      if (++qs_cnt == NCPU)
+        {
+          gp_done = gp_cur++;
+          qs_cnt = 0;
+        }
+    }
+
+  while (!list_empty (&callbacks))
+    {
+      struct rcu_head *head = list_entry (list_front (&callbacks),
+                                          struct rcu_head, elem);
+      if (head->gp > gp_done)
+        break;
+      list_pop_front (&callbacks);
+      callbacks_cnt--;
+      callbacks_run++;
+      head->func (head);
+    }
+}
+
+/* Prints RCU statistics. */
+void
+rcu_print_stats (void)
+{
+  printf ("RCU: %llu grace periods, %lld callbacks queued, %lld run, "
+          "%zu waiting at most\n",
+          gp_done, callbacks_queued, callbacks_run, callbacks_max);
+}
@@ -0,0 +1,62 @@
+#ifndef THREADS_RCU_H
+#define THREADS_RCU_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Read-copy update.
+
+   Lets readers walk a shared structure, such as the list of all
+   threads, with no lock and no interrupt disabling, while
+   writers unlink elements from it.  A writer that unlinks an
+   element passes it to rcu_call() instead of freeing it, and the
+   callback runs only once every reader that might still hold a
+   pointer to it is done: after a grace period.
+
+   A reader brackets its traversal with rcu_read_lock() and
+   rcu_read_unlock().  Inside, the thread is not preempted (a
+   preemption that falls due waits for rcu_read_unlock()) and
+   must not sleep, so a context switch on a CPU means that every
+   reader that was running there has finished.  Such a switch is
+   a quiescent state, and a grace period is over once every CPU
+   has passed through one.  Readers pay only for an increment
+   and a decrement of a per-thread counter.
+
+   Writers still need to be serialized among themselves, and
+   must link new elements in so that a reader never sees a
+   half-initialized one.  Callbacks run with interrupts off,
+   from the scheduler, so they must be short and must not
+   sleep. */
+
+struct rcu_head;
+
+/* Function to call after a grace period. */
+typedef void rcu_func (struct rcu_head *);
+
+/* Embed in a structure to be freed after a grace period. */
+struct rcu_head
+  {
+    struct list_elem elem;      /* Element in the callback list. */
+    rcu_func *func;             /* Function to call. */
+    uint64_t gp;                /* Grace period that must end first. */
+  };
+
+/* Converts pointer to rcu_head RCU_HEAD into a pointer to the
+   structure that RCU_HEAD is embedded inside.  Supply the name
+   of the outer structure STRUCT and the member name MEMBER of
+   the rcu_head. */
+#define rcu_entry(RCU_HEAD, STRUCT, MEMBER)             \
+        ((STRUCT *) ((uint8_t *) &(RCU_HEAD)->func      \
+                     - offsetof (STRUCT, MEMBER.func)))
+
+void rcu_init (void);
+void rcu_read_lock (void);
+void rcu_read_unlock (void);
+bool rcu_reading (void);
+void rcu_call (struct rcu_head *, rcu_func *);
+void rcu_quiescent (void);
+void rcu_print_stats (void);
+
+#endif /* threads/rcu.h */
@@ -0,0 +1,122 @@
+#include "threads/scratch.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "threads/palloc.h"
+
+/* Header at the start of each page, or run of pages, of an
+   arena. */
+struct scratch_header
+  {
+    uint8_t *prev;              /* Page allocated before, or null. */
+    size_t page_cnt;            /* Pages in this run. */
+  };
+
+static void *alloc_large (struct scratch *, size_t size);
+
+/* Returns the header of PAGE. */
+static inline struct scratch_header *
+header (uint8_t *page)
+{
+  return (struct scratch_header *) page;
+}
+
+/* Initializes S as an empty arena whose pages are charged to
+   TAG.  No memory is allocated until the first scratch_alloc(). */
+void
+scratch_init (struct scratch *s, enum mem_tag tag)
+{
+  ASSERT (s != NULL);
+  ASSERT (sizeof (struct scratch_header) <= SCRATCH_HEADER);
+
+  s->page = NULL;
+  s->ofs = PGSIZE;
+  s->tag = tag;
+}
+
+/* Returns a block of at least SIZE bytes from S, aligned to
+   SCRATCH_ALIGN, or a null pointer if no memory is available.
+   A block larger than SCRATCH_MAX needs that many contiguous
+   pages.  The block stays valid until scratch_release(). */
+void *
+scratch_alloc (struct scratch *s, size_t size)
+{
+  void *block;
+
+  ASSERT (s != NULL);
+
+  if (size > SCRATCH_MAX)
+    return alloc_large (s, size);
+  size = ROUND_UP (size, SCRATCH_ALIGN);
+
+  if (size > PGSIZE - s->ofs)
+    {
+      uint8_t *page = palloc_get_page_tagged (0, s->tag);
+      if (page == NULL)
+        return NULL;
+      header (page)->prev = s->page;
+      header (page)->page_cnt = 1;
+      s->page = page;
+      s->ofs = SCRATCH_HEADER;
+    }
+
+  block = s->page + s->ofs;
+  s->ofs += size;
+  return block;
+}
+
+/* Returns a block of SIZE bytes, more than SCRATCH_MAX, on a run
+   of pages of its own, linked into S behind its current page so
+   that later small blocks still fill that page. */
+static void *
+alloc_large (struct scratch *s, size_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP (size + SCRATCH_HEADER, PGSIZE);
+  uint8_t *run = palloc_get_multiple_tagged (0, page_cnt, s->tag);
+
+  if (run == NULL)
+    return NULL;
+  header (run)->page_cnt = page_cnt;
+  if (s->page != NULL)
+    {
+      header (run)->prev = header (s->page)->prev;
+      header (s->page)->prev = run;
+    }
+  else
+    {
+      header (run)->prev = NULL;
+      s->page = run;
+      s->ofs = PGSIZE;
+    }
+  return run + SCRATCH_HEADER;
+}
+
+/* Copies STRING into S and returns the copy, truncated to
+   SCRATCH_MAX - 1 characters if it is longer, or a null pointer
+   if no page is available. */
+char *
+scratch_strdup (struct scratch *s, const char *string)
+{
+  size_t size = strnlen (string, SCRATCH_MAX - 1) + 1;
+  char *copy = scratch_alloc (s, size);
+
+  if (copy != NULL)
+    strlcpy (copy, string, size);
+  return copy;
+}
+
+/* Frees every block allocated from S and leaves it empty, ready
+   for reuse. */
+void
+scratch_release (struct scratch *s)
+{
+  ASSERT (s != NULL);
+
+  while (s->page != NULL)
+    {
+      uint8_t *prev = header (s->page)->prev;
+      palloc_free_multiple (s->page, header (s->page)->page_cnt);
+      s->page = prev;
+    }
+  s->ofs = PGSIZE;
+}
@@ -0,0 +1,48 @@
+#ifndef THREADS_SCRATCH_H
+#define THREADS_SCRATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/memtag.h"
+#include "threads/vaddr.h"
+
+/* Scratch arenas for short-lived temporary buffers.
+
+   An operation that needs several temporary buffers, such as
+   exec copying and tokenizing its command line, allocates them
+   from one arena by bumping a pointer through a page, and frees
+   them all at once with scratch_release() when it finishes.  A
+   new page is taken from the page allocator only when the
+   current one fills up, so the common case costs a single
+   palloc call however many buffers are carved from it.  A block
+   too big for a page gets a run of pages of its own, freed along
+   with the rest.
+
+   An arena is not locked.  Its owner must make sure only one
+   thread uses it at a time. */
+
+/* A scratch arena.  Usually lives on its owner's stack. */
+struct scratch
+  {
+    uint8_t *page;              /* Current page, or null. */
+    size_t ofs;                 /* First free byte in PAGE. */
+    enum mem_tag tag;           /* Tag charged for the pages. */
+  };
+
+/* Alignment of every block returned by scratch_alloc(). */
+#define SCRATCH_ALIGN 8
+
+/* Bytes at the start of each page, or run of pages, that link
+   it to the one before it and give its length. */
+#define SCRATCH_HEADER SCRATCH_ALIGN
+
+/* Largest block scratch_alloc() carves from a shared page.
+   Larger blocks take pages of their own. */
+#define SCRATCH_MAX (PGSIZE - SCRATCH_HEADER)
+
+void scratch_init (struct scratch *, enum mem_tag);
+void *scratch_alloc (struct scratch *, size_t size);
+char *scratch_strdup (struct scratch *, const char *);
+void scratch_release (struct scratch *);
+
+#endif /* threads/scratch.h */
@@ -0,0 +1,306 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* A slab: one page, starting with this header, followed by
+   objects_per_slab objects. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in one of the cache's lists. */
+    size_t used_cnt;            /* Objects in use. */
+    void *free;                 /* First free object, or a null pointer. */
+  };
+
+/* Offset of the first object within a slab. */
+#define SLAB_OBJS_OFS ROUND_UP (sizeof (struct slab), 8)
+
+/* All caches, for kmem_cache_reclaim() and statistics. */
+static struct list all_caches = LIST_INITIALIZER (all_caches);
+
+/* Gives the page allocator back empty slabs. */
+static shrink_func slab_shrink;
+static struct shrinker slab_shrinker;
+
+static struct slab *slab_create (struct kmem_cache *);
+static void slab_destroy (struct slab *);
+static struct slab *slab_of (void *);
+static void **link_of (const struct kmem_cache *, void *);
+
+/* Creates and returns a cache for objects of SIZE bytes, named
+   NAME for statistics.  CTOR, if nonnull, is called on each
+   object when its slab is created.  Panics if memory for the
+   cache is not available, since caches are created at
+   initialization time. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, void (*ctor) (void *)) 
+{
+  struct kmem_cache *c;
+  enum intr_level old_level;
+
+  ASSERT (name != NULL);
+  ASSERT (size > 0);
+
+  c = malloc (sizeof *c);
+  if (c == NULL)
+    PANIC ("kmem_cache_create: out of memory for cache %s", name);
+
+  c->name = name;
+  c->obj_size = size;
+  if (ctor != NULL)
+    {
+      c->link_ofs = ROUND_UP (size, sizeof (void *));
+      c->stride = ROUND_UP (c->link_ofs + sizeof (void *), 8);
+    }
+  else
+    {
+      /* A free object holds only the link. */
+      c->link_ofs = 0;
+      c->stride = ROUND_UP (size < sizeof (void *) ? sizeof (void *) : size, 8);
+    }
+  c->objs_per_slab = (PGSIZE - SLAB_OBJS_OFS) / c->stride;
+  ASSERT (c->objs_per_slab > 0);
+  c->ctor = ctor;
+  lock_init (&c->lock);
+  lock_set_name (&c->lock, name);
+  list_init (&c->partial);
+  list_init (&c->full);
+  list_init (&c->empty);
+  c->slab_cnt = 0;
+  c->obj_cnt = 0;
+
+  if (list_empty (&all_caches))
+    palloc_register_shrinker (&slab_shrinker, "empty slabs", slab_shrink,
+                              SHRINK_EMPTY);
+  old_level = intr_disable ();
+  list_push_back (&all_caches, &c->elem);
+  intr_set_level (old_level);
+  return c;
+}
+
+/* Allocates and returns an object from cache C, or a null
+   pointer if no memory is available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) 
+{
+  struct slab *s;
+  void *obj;
+
+  lock_acquire (&c->lock);
+  if (!list_empty (&c->partial))
+    s = list_entry (list_front (&c->partial), struct slab, elem);
+  else if (!list_empty (&c->empty))
+    {
+      s = list_entry (list_pop_front (&c->empty), struct slab, elem);
+      list_push_front (&c->partial, &s->elem);
+    }
+  else
+    {
+      s = slab_create (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+      list_push_front (&c->partial, &s->elem);
+    }
+
+  obj = s->free;
+  s->free = *link_of (c, obj);
+  s->used_cnt++;
+  c->obj_cnt++;
+  if (s->free == NULL)
+    {
+      list_remove (&s->elem);
+      list_push_back (&c->full, &s->elem);
+    }
+  lock_release (&c->lock);
+  return obj;
+}
+
+/* Like kmem_cache_alloc(), but fills the object with zeros.
+   Only for caches without a constructor. */
+void *
+kmem_cache_zalloc (struct kmem_cache *c) 
+{
+  void *obj;
+
+  ASSERT (c->ctor == NULL);
+
+  obj = kmem_cache_alloc (c);
+  if (obj != NULL)
+    memset (obj, 0, c->obj_size);
+  return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to
+   C.  If OBJ is a null pointer, does nothing. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) 
+{
+  struct slab *s;
+
+  if (obj == NULL)
+    return;
+
+  s = slab_of (obj);
+  ASSERT (s->cache == c);
+
+  lock_acquire (&c->lock);
+  ASSERT (s->used_cnt > 0);
+  *link_of (c, obj) = s->free;
+  s->free = obj;
+  c->obj_cnt--;
+  if (--s->used_cnt == 0)
+    {
+      list_remove (&s->elem);
+      list_push_back (&c->empty, &s->elem);
+    }
+  else if (s->used_cnt == c->objs_per_slab - 1)
+    {
+      /* Was full. */
+      list_remove (&s->elem);
+      list_push_front (&c->partial, &s->elem);
+    }
+  lock_release (&c->lock);
+}
+
+/* Returns the empty slabs of cache C to the page allocator and
+   returns the number of pages freed.  Does nothing if C's lock
+   is held, possibly by the caller itself, so this may be called
+   from inside the page allocator. */
+size_t
+kmem_cache_shrink (struct kmem_cache *c) 
+{
+  size_t freed = 0;
+
+  if (lock_held_by_current_thread (&c->lock)
+      || !lock_try_acquire (&c->lock))
+    return 0;
+  while (!list_empty (&c->empty))
+    {
+      slab_destroy (list_entry (list_pop_front (&c->empty),
+                                struct slab, elem));
+      freed++;
+    }
+  lock_release (&c->lock);
+  return freed;
+}
+
+/* Returns the empty slabs of every cache to the page allocator
+   and returns the number of pages freed.  Caches whose lock is
+   held are skipped, as by kmem_cache_shrink(). */
+size_t
+kmem_cache_reclaim (void) 
+{
+  struct list_elem *e;
+  size_t freed = 0;
+
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    freed += kmem_cache_shrink (list_entry (e, struct kmem_cache, elem));
+  return freed;
+}
+
+/* Shrinker for the page allocator.  Empty slabs cost nothing to
+   give back, so frees all of them, however few pages are
+   wanted. */
+static size_t
+slab_shrink (size_t page_cnt UNUSED) 
+{
+  return kmem_cache_reclaim ();
+}
+
+/* Prints the utilization of every cache. */
+void
+kmem_print_stats (void) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+      size_t capacity = c->slab_cnt * c->objs_per_slab;
+
+      printf ("Slab %s: %zu of %zu %zu-byte objects in use (%zu%%), "
+              "%zu slabs\n",
+              c->name, c->obj_cnt, capacity, c->obj_size,
+              capacity > 0 ? c->obj_cnt * 100 / capacity : 0, c->slab_cnt);
+    }
+}
+
+/* Creates a new slab for cache C, with all of its objects free
+   and constructed, and returns it, or a null pointer if no page
+   is available.  C's lock must be held. */
+static struct slab *
+slab_create (struct kmem_cache *c) 
+{
+  struct slab *s;
+  uint8_t *obj;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  s = palloc_get_page_tagged (0, MEM_SLAB);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->used_cnt = 0;
+  s->free = NULL;
+
+  /* Thread the objects onto the free list, lowest address first. */
+  obj = (uint8_t *) s + SLAB_OBJS_OFS + (c->objs_per_slab - 1) * c->stride;
+  for (i = 0; i < c->objs_per_slab; i++, obj -= c->stride)
+    {
+      if (c->ctor != NULL)
+        c->ctor (obj);
+      *link_of (c, obj) = s->free;
+      s->free = obj;
+    }
+
+  c->slab_cnt++;
+  return s;
+}
+
+/* Returns empty slab S to the page allocator.  The owning
+   cache's lock must be held. */
+static void
+slab_destroy (struct slab *s) 
+{
+  ASSERT (s->used_cnt == 0);
+
+  s->cache->slab_cnt--;
+  s->magic = 0;
+  palloc_free_page (s);
+}
+
+/* Returns the free list link of OBJ, an object of cache C. */
+static void **
+link_of (const struct kmem_cache *c, void *obj) 
+{
+  return (void **) ((uint8_t *) obj + c->link_ofs);
+}
+
+/* Returns the slab that contains OBJ. */
+static struct slab *
+slab_of (void *obj) 
+{
+  struct slab *s = pg_round_down (obj);
+
+  ASSERT (s->magic == SLAB_MAGIC);
+  return s;
+}
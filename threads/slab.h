@@ -0,0 +1,54 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Object caches for small, fixed-size kernel structures.
+
+   Each cache hands out objects of one size, carved from pages
+   ("slabs") obtained from the page allocator.  A slab keeps the
+   free objects it contains on a private free list, and the
+   cache keeps its slabs on three lists according to whether
+   they are partly used, full, or empty, so allocation and
+   freeing take constant time.
+
+   If the cache has a constructor, it runs once for each object
+   when its slab is created, not on every allocation, so objects
+   must be freed back in their constructed state.  The free list
+   link of such a cache is kept just past each object, so that
+   it does not overwrite constructed state.
+
+   Empty slabs are kept for reuse until the page allocator runs
+   short, at which point it calls the slab shrinker, which
+   returns them as kmem_cache_reclaim() does. */
+
+/* An object cache. */
+struct kmem_cache
+  {
+    const char *name;           /* For statistics. */
+    size_t obj_size;            /* Bytes per object as requested. */
+    size_t stride;              /* Bytes between objects in a slab. */
+    size_t link_ofs;            /* Offset of the free list link. */
+    size_t objs_per_slab;       /* Objects that fit in one slab. */
+    void (*ctor) (void *);      /* Constructor, or a null pointer. */
+    struct lock lock;           /* Protects everything below. */
+    struct list partial;        /* Slabs with used and free objects. */
+    struct list full;           /* Slabs with no free objects. */
+    struct list empty;          /* Slabs with no used objects. */
+    size_t slab_cnt;            /* Number of slabs. */
+    size_t obj_cnt;             /* Number of objects in use. */
+    struct list_elem elem;      /* Element in list of all caches. */
+  };
+
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+                                      void (*ctor) (void *));
+void *kmem_cache_alloc (struct kmem_cache *);
+void *kmem_cache_zalloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+size_t kmem_cache_shrink (struct kmem_cache *);
+size_t kmem_cache_reclaim (void);
+void kmem_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -0,0 +1,62 @@
+#include "threads/spinlock.h"
+#include <debug.h>
+#include <stddef.h>
+
+/* Atomically stores NEW in *P and returns the previous value. */
+static inline int
+xchg (volatile int *p, int new)
+{
+  asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+  return new;
+}
+
+/* Initializes LOCK as released. */
+void
+spinlock_init (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+
+  lock->locked = 0;
+  lock->old_level = INTR_OFF;
+}
+
+/* Disables interrupts and acquires LOCK, spinning until it is
+   free.  The previous interrupt level is restored by
+   spinlock_release().  Spinlocks do not nest: releasing an outer
+   lock while an inner one is held is a bug. */
+void
+spinlock_acquire (struct spinlock *lock)
+{
+  enum intr_level old_level;
+
+  ASSERT (lock != NULL);
+
+  old_level = intr_disable ();
+  while (xchg (&lock->locked, 1) != 0)
+    asm volatile ("pause");
+  lock->old_level = old_level;
+}
+
+/* Releases LOCK and restores the interrupt level that was in
+   effect when it was acquired. */
+void
+spinlock_release (struct spinlock *lock)
+{
+  enum intr_level old_level;
+
+  ASSERT (spinlock_held (lock));
+
+  old_level = lock->old_level;
+  xchg (&lock->locked, 0);
+  intr_set_level (old_level);
+}
+
+/* Returns true if LOCK is held.  Only meaningful with interrupts
+   off, since that is the only time the answer cannot change. */
+bool
+spinlock_held (const struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+
+  return lock->locked != 0;
+}
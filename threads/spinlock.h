@@ -0,0 +1,24 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <stdbool.h>
+#include "threads/interrupt.h"
+
+/* A spinlock protects a short critical section that must not
+   sleep, such as a run queue.  Acquiring it disables interrupts
+   on the local CPU and then spins on an atomic exchange, so it
+   serializes both interrupt handlers and any other CPU.  With a
+   single CPU the exchange always succeeds on the first try and
+   the lock degenerates to intr_disable()/intr_set_level(). */
+struct spinlock
+  {
+    volatile int locked;        /* 1 while held, 0 otherwise. */
+    enum intr_level old_level;  /* Interrupt level before acquire. */
+  };
+
+void spinlock_init (struct spinlock *);
+void spinlock_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
+bool spinlock_held (const struct spinlock *);
+
+#endif /* threads/spinlock.h */
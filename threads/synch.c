@@ -31,6 +31,40 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
+
+/* Numero de secuencia para los waiters, da orden FIFO entre
+   threads de la misma prioridad. */
+static unsigned wait_seq_next;
+
+static void reacomodar (struct pheap *, struct pheap_elem *, bool subio);
+static void sema_wake (struct semaphore *, bool handoff);
+static bool lock_spin (struct lock *);
+static bool lock_take (struct lock *);
+
+#ifdef LOCK_PROFILE
+/* Locks named with lock_set_name(), which lock_print_stats()
+   reports.  Unnamed locks still count but are not listed, since
+   a lock has no destructor and many live in stack frames. */
+static struct list named_locks = LIST_INITIALIZER (named_locks);
+
+static void lock_profile_acquired (struct lock *, uint64_t start,
+                                   bool contended);
+static void lock_profile_release (struct lock *);
+
+/* Lock profiling hooks for lock_acquire() and friends. */
+#define PROFILE_START(LOCK)                                     \
+        uint64_t profile_start = rdtsc ();                      \
+        bool profile_contended = (LOCK)->holder != NULL
+#define PROFILE_ACQUIRED(LOCK)                                  \
+        lock_profile_acquired (LOCK, profile_start, profile_contended)
+#define PROFILE_RELEASE(LOCK) lock_profile_release (LOCK)
+#else
+#define PROFILE_START(LOCK) ((void) 0)
+#define PROFILE_ACQUIRED(LOCK) ((void) 0)
+#define PROFILE_RELEASE(LOCK) ((void) 0)
+#endif
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -47,7 +81,8 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  pheap_init (&sema->waiters, menorPrioridadThread, NULL);
+  sema->cond = NULL;
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -68,9 +103,13 @@ sema_down (struct semaphore *sema)
   old_level = intr_disable ();
   while (sema->value == 0) 
     {
+      struct thread *cur = thread_current ();
       //list_push_back (&sema->waiters, &thread_current ()->elem);
-      // se ordena descendentemente para qu el thread que se despierte, sea el de mas alta prioridad
-      list_insert_ordered (&sema->waiters, &thread_current()->elem, ordenarMayorMenor, NULL);
+      // el heap deja en la cima al de mas alta prioridad, para que sea el que se despierte;
+      // el numero de secuencia mantiene el orden FIFO entre iguales
+      cur->wait_seq = wait_seq_next++;
+      cur->esperando_sema = sema;
+      pheap_push (&sema->waiters, &cur->wait_elem);
       thread_block ();
     }
   sema->value--;
@@ -105,10 +144,21 @@ sema_try_down (struct semaphore *sema)
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
    and wakes up one thread of those waiting for SEMA, if any.
+   If the woken thread has higher priority than the caller, the
+   caller switches straight to it.
 
    This function may be called from an interrupt handler. */
 void
 sema_up (struct semaphore *sema) 
+{
+  sema_wake (sema, true);
+}
+
+/* Sube SEMA y despierta al waiter de mayor prioridad.  Si HANDOFF
+   es true y ese waiter tiene mayor prioridad que el thread actual,
+   se le cede el CPU directamente con thread_handoff(). */
+static void
+sema_wake (struct semaphore *sema, bool handoff) 
 {
   enum intr_level old_level;
   struct thread *t_unblock = NULL;
@@ -116,26 +166,42 @@ sema_up (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
-  if (!list_empty (&sema->waiters)){
-      // Se ordena la lista para poder desbloquear al de mayor prioridad
-      list_sort(&(sema->waiters), ordenarMayorMenor, NULL);
-      t_unblock = list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem);
+  if (!pheap_empty (&sema->waiters)){
+      // El de mayor prioridad esta en la cima del heap, sacarlo es O(log n)
+      t_unblock = pheap_entry (pheap_pop (&sema->waiters),
+                               struct thread, wait_elem);
+      t_unblock->esperando_sema = NULL;
       thread_unblock (t_unblock);
   } 
 
   // si el thread que se esta desbloqueando tiene prioridad mayor, al current thread, seder procesador
   sema->value++;
-  #ifndef USERPROG
-    if(t_unblock != NULL){
-      if(t_unblock->priority > thread_current()->priority){
-        thread_yield();
-      }
+  if(handoff && t_unblock != NULL){
+    if(t_unblock->priority > thread_current()->priority){
+      // desde un interrupt handler no se puede ceder, se cede al regresar
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_handoff (t_unblock);
     }
-  #endif
+  }
   intr_set_level (old_level);
 }
 
+/* Devuelve la prioridad del waiter de mayor prioridad de SEMA, o
+   PRI_MIN si no hay waiters.  Interrupts must be off. */
+int
+sema_max_waiter_priority (struct semaphore *sema)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  // el waiter de mayor prioridad esta en la cima del heap
+  if (pheap_empty (&sema->waiters))
+    return PRI_MIN;
+  return pheap_entry (pheap_top (&sema->waiters), struct thread,
+                      wait_elem)->priority;
+}
+
 static void sema_test_helper (void *sema_);
 
 /* Self-test for semaphores that makes control "ping-pong"
@@ -195,6 +261,13 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   lock->priority = PRI_MIN; // se inicializa con la prioridad minima
+  lock->spin_acquired = 0;
+  lock->spin_failed = 0;
+#ifdef LOCK_PROFILE
+  lock->name = NULL;
+  lock->acquisitions = lock->contended = 0;
+  lock->wait_cycles = lock->max_wait_cycles = lock->hold_cycles = 0;
+#endif
   sema_init (&lock->semaphore, 1);
 }
 
@@ -212,30 +285,44 @@ lock_acquire (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
+  PROFILE_START (lock);
+
+  /* Con varios CPUs, si el holder esta corriendo en otro lo normal es que
+     suelte el lock pronto, y esperarlo girando sale mas barato que dormir
+     y despertar.  Mientras gira no dona: el holder ya esta corriendo. */
+  if (NCPU > 1 && lock_spin (lock))
+    {
+      PROFILE_ACQUIRED (lock);
+      return;
+    }
+
   // Se verificara la donacion al momento de solicitar el lock
+  enum intr_level old_level = intr_disable ();
   struct thread *threadLock = lock->holder; // thread que tiene el lock
   struct thread *threadActual = thread_current();
 
+  if (threadLock != NULL)
+    TRACE (TRACE_LOCK_CONTEND, threadLock->tid);
+
   // el thread esperara por este lock
   threadActual->waiting_for_lock = lock;
 
-  if(threadLock == NULL){
-    // La prioridad del lock, sera la misma que la de el thread que lo mantiene
-    lock->priority = threadActual->priority;
-  }
-
+  /* Donacion anidada: se sube por la cadena de holders mientras la prioridad
+     del thread actual sea mayor.  En cuanto un holder ya tiene prioridad
+     suficiente, los que siguen en la cadena tambien la tienen, y se termina. */
   struct lock *lockActual = lock;
-  while(!thread_mlfqs && threadLock != NULL && threadActual->priority > threadLock->priority){
-    // mientras la prioridad del thread actual sea mayor que la del thread que tiene el lock, donar
-    threadLock->priority = threadActual->priority;
-
+  while(!thread_mlfqs && threadLock != NULL){
+    // la prioridad del lock es la de su waiter mas alto, se reacomoda en el heap de su holder
     if(threadActual->priority > lockActual->priority){
-
       lockActual->priority = threadActual->priority;
-      // se agrega esta verificacion, para ceder el procesador
-      verificar(lockActual, threadActual->priority);
+      pheap_increase(&threadLock->holding_lock, &lockActual->elem_lock);
+    }
 
+    if(threadLock->priority >= threadActual->priority){
+      break;
     }
+    // si el thread que recibe la donacion esta en la run queue, se mueve de cola
+    thread_update_priority(threadLock, threadActual->priority);
 
     // si el thread que tiene el lock, ya no esta esperando por nadie, salir del ciclo
     lockActual = threadLock->waiting_for_lock;
@@ -252,8 +339,46 @@ lock_acquire (struct lock *lock)
 
   if(!thread_mlfqs){
     lock->holder->waiting_for_lock = NULL;
-    list_insert_ordered(&(lock->holder->holding_lock), &(lock->elem_lock), ordenarMayorMenorLock, NULL);
+    // sus waiters restantes siguen donando a traves de la prioridad del lock
+    lock->priority = sema_max_waiter_priority(&lock->semaphore);
+    pheap_push(&(lock->holder->holding_lock), &(lock->elem_lock));
   }
+  PROFILE_ACQUIRED (lock);
+  intr_set_level (old_level);
+}
+
+/* Gira hasta LOCK_SPIN_LIMIT vueltas esperando a que LOCK quede
+   libre, mientras su holder este corriendo en otro CPU, y lo
+   adquiere con lock_take().  Devuelve false si se agotaron
+   las vueltas o el holder dejo de correr, y entonces hay que
+   dormir en lock_acquire(). */
+static bool
+lock_spin (struct lock *lock)
+{
+  unsigned spins;
+
+  for (spins = 0; spins < LOCK_SPIN_LIMIT; spins++)
+    {
+      /* Se lee sin apagar interrupciones: el holder puede cambiar en
+         cualquier momento, pero la pagina de un thread muerto sigue
+         mapeada, asi que leer su estado no falla. */
+      struct thread *holder = *(struct thread * volatile *) &lock->holder;
+
+      if (holder == NULL)
+        {
+          if (lock_take (lock))
+            {
+              lock->spin_acquired++;
+              TRACE (TRACE_LOCK_SPIN, spins);
+              return true;
+            }
+        }
+      else if (holder->status != THREAD_RUNNING)
+        break;
+      asm volatile ("pause" : : : "memory");
+    }
+  lock->spin_failed++;
+  return false;
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -270,9 +395,33 @@ lock_try_acquire (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  PROFILE_START (lock);
+  success = lock_take (lock);
+  if (success)
+    PROFILE_ACQUIRED (lock);
+  return success;
+}
+
+/* Adquiere LOCK si esta libre, sin dormir, y devuelve true si lo
+   obtuvo.  Es lock_try_acquire() sin el profiling. */
+static bool
+lock_take (struct lock *lock)
+{
+  enum intr_level old_level;
+  bool success;
+
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      // igual que en lock_acquire, el lock entra al heap de su holder
+      if(!thread_mlfqs){
+        lock->priority = sema_max_waiter_priority(&lock->semaphore);
+        pheap_push(&(lock->holder->holding_lock), &(lock->elem_lock));
+      }
+    }
+  intr_set_level (old_level);
   return success;
 }
 
@@ -284,35 +433,123 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+  struct thread *threadActual = thread_current();
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  PROFILE_RELEASE (lock);
   lock->holder = NULL;
-  sema_up (&lock->semaphore);
 
   if(!thread_mlfqs){
-    // Al finalizar el lock, restaurar la prioridad
-    //struct thread *threadActual = thread_current();
-    //threadActual->priority = threadActual->priorityOriginal;
+    // Quitar el lock del heap de locks, O(log n)
+    pheap_remove(&threadActual->holding_lock, &lock->elem_lock);
+
+    // Al liberar el lock, la prioridad vuelve a la original, o a la mayor
+    // donacion que aun reciba por los otros locks que mantiene
+    int prioridad = threadActual->priorityOriginal;
+    if(!pheap_empty(&threadActual->holding_lock)){
+      struct lock *next_lock = pheap_entry(pheap_top(&threadActual->holding_lock), struct lock, elem_lock);
+      if(next_lock->priority > prioridad){
+        prioridad = next_lock->priority;
+      }
+    }
+    threadActual->priority = prioridad;
+  }
+
+  // si hay waiter de mayor prioridad se le cede el CPU dentro de sema_up
+  sema_up (&lock->semaphore);
+  intr_set_level (old_level);
 
-    // Quitar el lock de la lista de locks
-    list_remove(&lock->elem_lock);
+  /* Sin waiter en el lock puede haber un thread listo de mayor prioridad,
+     por ejemplo el que desperto cond_signal o uno al que se le quito la
+     donacion que nos habia hecho. */
+  thread_preempt ();
+}
 
-    struct thread *threadActual = thread_current();
-    if(list_empty(&threadActual->holding_lock)){
-      threadActual->priority = threadActual->priorityOriginal;
-      // se agrega esta verificacion, para ceder el procesador
-      verificar(threadActual, threadActual->priority);
+#ifdef LOCK_PROFILE
+/* Names LOCK as NAME, which must stay valid for as long as LOCK,
+   and adds it to the locks reported by lock_print_stats().
+   Meant for locks that live as long as the kernel. */
+void
+lock_set_name (struct lock *lock, const char *name)
+{
+  enum intr_level old_level;
 
-    } else {
-      // se ordena la lista, para extraer el de mayor prioridad
-      list_sort(&(threadActual->holding_lock), ordenarMayorMenorLock, NULL);
-      struct lock *next_lock = list_entry(list_front(&(threadActual->holding_lock)), struct lock, elem_lock);
-      threadActual->priority = next_lock->priority;
-      // se agrega esta verificacion, para ceder el procesador
-        verificar(threadActual, next_lock->priority);
+  ASSERT (lock != NULL);
+  ASSERT (name != NULL);
+
+  old_level = intr_disable ();
+  if (lock->name == NULL)
+    list_push_back (&named_locks, &lock->profile_elem);
+  lock->name = name;
+  intr_set_level (old_level);
+}
+
+/* Records that the current thread got LOCK after requesting it
+   at TSC START, when it was held by another thread if
+   CONTENDED. */
+static void
+lock_profile_acquired (struct lock *lock, uint64_t start, bool contended)
+{
+  uint64_t now = rdtsc ();
+  uint64_t wait = now - start;
+
+  lock->acquisitions++;
+  if (contended)
+    lock->contended++;
+  lock->wait_cycles += wait;
+  if (wait > lock->max_wait_cycles)
+    lock->max_wait_cycles = wait;
+  lock->acquired_at = now;
+}
+
+/* Records that the current thread is releasing LOCK. */
+static void
+lock_profile_release (struct lock *lock)
+{
+  lock->hold_cycles += rdtsc () - lock->acquired_at;
+}
+
+/* Orders locks by total wait time, longest first. */
+static bool
+more_wait (const struct list_elem *a_, const struct list_elem *b_,
+           void *aux UNUSED)
+{
+  const struct lock *a = list_entry (a_, struct lock, profile_elem);
+  const struct lock *b = list_entry (b_, struct lock, profile_elem);
+
+  return a->wait_cycles > b->wait_cycles;
+}
+
+/* Prints the contention profile of every named lock, the most
+   waited for first. */
+void
+lock_print_stats (void)
+{
+  struct list_elem *e;
+
+  list_sort (&named_locks, more_wait, NULL);
+  for (e = list_begin (&named_locks); e != list_end (&named_locks);
+       e = list_next (e))
+    {
+      struct lock *l = list_entry (e, struct lock, profile_elem);
+      printf ("Lock %s: %llu acquisitions, %llu contended, "
+              "%llu wait cycles (max %llu), %llu hold cycles\n",
+              l->name, l->acquisitions, l->contended,
+              l->wait_cycles, l->max_wait_cycles, l->hold_cycles);
     }
-  }
+}
+#endif /* LOCK_PROFILE */
+
+/* Inicializa H como un heap de locks, con el lock de mayor prioridad
+   en la cima. */
+void
+lock_heap_init (struct pheap *h)
+{
+  pheap_init (h, menorPrioridadLock, NULL);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -329,10 +566,50 @@ lock_held_by_current_thread (const struct lock *lock)
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
-    struct list_elem elem;              /* List element. */
+    struct pheap_elem elem;             /* Heap element. */
     struct semaphore semaphore;         /* This semaphore. */
+    int priority;                       // Prioridad del thread que espera
+    unsigned seq;                       // Orden de llegada, FIFO entre iguales
   };
 
+/* Cambio la prioridad de T, un thread bloqueado en un semaforo,
+   que antes era OLD_PRIORITY: se reacomoda en el heap de waiters
+   del semaforo y, si es el semaforo privado de un cond_wait,
+   tambien en el heap de la condicion.  Interrupts must be off. */
+void
+sema_reposition_waiter (struct thread *t, int old_priority)
+{
+  struct semaphore *sema = t->esperando_sema;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (sema != NULL);
+
+  reacomodar (&sema->waiters, &t->wait_elem, t->priority > old_priority);
+  if (sema->cond != NULL)
+    {
+      struct semaphore_elem *w = (struct semaphore_elem *)
+        ((uint8_t *) sema - offsetof (struct semaphore_elem, semaphore));
+      int old = w->priority;
+
+      w->priority = t->priority;
+      reacomodar (&sema->cond->waiters, &w->elem, w->priority > old);
+    }
+}
+
+/* Restaura el orden del heap H despues de que cambio la llave de E:
+   si SUBIO basta con pheap_increase, si bajo se saca y se vuelve a meter. */
+static void
+reacomodar (struct pheap *h, struct pheap_elem *e, bool subio)
+{
+  if (subio)
+    pheap_increase (h, e);
+  else
+    {
+      pheap_remove (h, e);
+      pheap_push (h, e);
+    }
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -341,7 +618,7 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  pheap_init (&cond->waiters, menorPrioridadSema, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -377,11 +654,15 @@ cond_wait (struct condition *cond, struct lock *lock)
   sema_init (&waiter.semaphore, 0);
 
   //list_push_back (&cond->waiters, &waiter.elem);
-  // ahora se inserta de manera ordenada y se agrega prioridad, como cond_signal
-  // saca del frente, entonces se ordena de tal manera que al sacarlo, obtiene
-  // el de mayor prioridad
-  waiter.semaphore.priority = thread_current()->priority;
-  list_insert_ordered(&cond->waiters, &waiter.elem, ordenarMayorMenorSema, NULL);
+  // ahora se inserta en un heap con la prioridad del thread, como cond_signal
+  // saca de la cima, obtiene el de mayor prioridad; si la prioridad cambia
+  // por donacion, sema_reposition_waiter lo reacomoda
+  enum intr_level old_level = intr_disable ();
+  waiter.priority = thread_current()->priority;
+  waiter.seq = wait_seq_next++;
+  waiter.semaphore.cond = cond;
+  pheap_push(&cond->waiters, &waiter.elem);
+  intr_set_level (old_level);
 
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -403,9 +684,19 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+  enum intr_level old_level = intr_disable ();
+  if (!pheap_empty (&cond->waiters)) 
+    {
+      struct semaphore_elem *w = pheap_entry (pheap_pop (&cond->waiters),
+                                              struct semaphore_elem, elem);
+      // ya no esta en el heap de la condicion, no reacomodarlo ahi
+      w->semaphore.cond = NULL;
+      /* Sin ceder el CPU: el waiter lo primero que hace es pedir LOCK, que
+         tenemos nosotros, y se volveria a bloquear.  Se le cede en
+         lock_release. */
+      sema_wake (&w->semaphore, false);
+    }
+  intr_set_level (old_level);
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -420,57 +711,127 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!pheap_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
 
-static bool ordenarMayorMenor(const struct list_elem *a,
-                             const struct list_elem *b,
-                             void *aux){
-    // Verificar que sea un elemento valido de la lista
+/* Initializes RW, a reader-writer lock.  Any number of readers
+   may hold RW at once, or a single writer.
+
+   The writer keeps RW's internal lock for as long as it holds
+   RW, so threads that block trying to acquire RW while a writer
+   is inside block on that lock and donate their priority to the
+   writer.  If PREFER_WRITERS is true, new readers wait while a
+   writer is waiting for the current readers to drain, so a
+   steady stream of readers cannot starve writers. */
+void
+rw_init (struct rwlock *rw, bool prefer_writers)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  cond_init (&rw->no_readers);
+  cond_init (&rw->writer_done);
+  rw->readers = 0;
+  rw->writers_waiting = 0;
+  rw->prefer_writers = prefer_writers;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it.
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rw_read_acquire (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  while (rw->prefer_writers && rw->writers_waiting > 0)
+    cond_wait (&rw->writer_done, &rw->lock);
+  rw->readers++;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rw_read_release (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0)
+    cond_broadcast (&rw->no_readers, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no reader or writer
+   holds it.  This function may sleep, so it must not be called
+   within an interrupt handler. */
+void
+rw_write_acquire (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  rw->writers_waiting++;
+  while (rw->readers > 0)
+    cond_wait (&rw->no_readers, &rw->lock);
+  rw->writers_waiting--;
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rw_write_release (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (lock_held_by_current_thread (&rw->lock));
+
+  cond_broadcast (&rw->writer_done, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+static bool menorPrioridadThread(const struct pheap_elem *a,
+                             const struct pheap_elem *b,
+                             void *aux UNUSED){
+    // Verificar que sea un elemento valido del heap
     ASSERT(a!=NULL);
     ASSERT(b!=NULL);
-    //Recueperar los thread del elemento de la lista
-    struct thread *thread_a = list_entry(a, struct thread, elem);
-    struct thread *thread_b = list_entry(b, struct thread, elem);
-    //Comparar la prioridad si a > b entonces true
-    if(thread_a->priority > thread_b->priority){
-      return true;
-    } else {
-      return false;
+    //Recueperar los thread del elemento del heap
+    struct thread *thread_a = pheap_entry(a, struct thread, wait_elem);
+    struct thread *thread_b = pheap_entry(b, struct thread, wait_elem);
+    //Comparar la prioridad si a < b entonces true, entre iguales el que llego despues es menor
+    if(thread_a->priority != thread_b->priority){
+      return thread_a->priority < thread_b->priority;
     }
+    return (int) (thread_a->wait_seq - thread_b->wait_seq) > 0;
 }
 
-static bool ordenarMayorMenorLock(const struct list_elem *a,
-                             const struct list_elem *b,
-                             void *aux){
-    // Verificar que sea un elemento valido de la lista
+static bool menorPrioridadLock(const struct pheap_elem *a,
+                             const struct pheap_elem *b,
+                             void *aux UNUSED){
+    // Verificar que sea un elemento valido del heap
     ASSERT(a!=NULL);
     ASSERT(b!=NULL);
-    //Recueperar los locks del elemento de la lista
-    struct lock *lock_a = list_entry(a, struct lock, elem_lock);
-    struct lock *lock_b = list_entry(b, struct lock, elem_lock);
-    //Comparar la prioridad si a > b entonces true
-    if(lock_a->priority > lock_b->priority){
-      return true;
-    } else {
-      return false;
-    }
+    //Recueperar los locks del elemento del heap
+    struct lock *lock_a = pheap_entry(a, struct lock, elem_lock);
+    struct lock *lock_b = pheap_entry(b, struct lock, elem_lock);
+    //Comparar la prioridad, si a < b entonces true; en la cima queda el de mayor prioridad
+    return lock_a->priority < lock_b->priority;
 }
 
-static bool ordenarMayorMenorSema(const struct list_elem *a,
-                             const struct list_elem *b,
-                             void *aux){
-    // Verificar que sea un elemento valido de la lista
+static bool menorPrioridadSema(const struct pheap_elem *a,
+                             const struct pheap_elem *b,
+                             void *aux UNUSED){
+    // Verificar que sea un elemento valido del heap
     ASSERT(a!=NULL);
     ASSERT(b!=NULL);
-    //Recueperar los locks del elemento de la lista
-    struct semaphore_elem *sema_a = list_entry(a, struct semaphore_elem, elem);
-    struct semaphore_elem *sema_b = list_entry(b, struct semaphore_elem, elem);
-    //Comparar la prioridad si a > b entonces true
-    if(sema_a->semaphore.priority > sema_b->semaphore.priority){
-      return true;
-    } else {
-      return false;
+    //Recueperar los waiters del elemento del heap
+    struct semaphore_elem *sema_a = pheap_entry(a, struct semaphore_elem, elem);
+    struct semaphore_elem *sema_b = pheap_entry(b, struct semaphore_elem, elem);
+    //Comparar la prioridad si a < b entonces true, entre iguales el que llego despues es menor
+    if(sema_a->priority != sema_b->priority){
+      return sema_a->priority < sema_b->priority;
     }
-}
\ No newline at end of file
+    return (int) (sema_a->seq - sema_b->seq) > 0;
+}
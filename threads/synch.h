@@ -1,15 +1,21 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <debug.h>
 #include <list.h>
+#include <pheap.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+struct condition;
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
-    int priority;               // Prioridad del semaforo
+    struct pheap waiters;       /* Waiting threads, highest priority on top. */
+    struct condition *cond;     // Si es el semaforo privado de un cond_wait, su condicion
   };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -17,29 +23,60 @@ void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
+int sema_max_waiter_priority (struct semaphore *);
+void sema_reposition_waiter (struct thread *, int old_priority);
 
 /* Lock. */
 struct lock 
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
-    /* Como un thread puede tener una lista de locks, entonces para usar la lista, 
-      debemos establecer list_elem
+    /* Como un thread puede tener varios locks, se guardan en un heap 
+      ordenado por prioridad, entonces debemos establecer pheap_elem
     */
-    struct list_elem elem_lock; 
-    int priority;               // Prioridad de el thread que tiene este el lock
+    struct pheap_elem elem_lock; 
+    int priority;               // Prioridad del waiter mas alto del lock, la que se dona al holder
+    unsigned spin_acquired;     /* Veces que lock_acquire() lo obtuvo girando. */
+    unsigned spin_failed;       /* Veces que giro y aun asi tuvo que dormir. */
+#ifdef LOCK_PROFILE
+    /* Contention profile, all times in TSC cycles.  Updated only
+       by the holder, so no further locking is needed. */
+    const char *name;             /* Set by lock_set_name(), or NULL. */
+    struct list_elem profile_elem; /* Element in the list of named locks. */
+    uint64_t acquisitions;        /* Times acquired. */
+    uint64_t contended;           /* Times it was held when requested. */
+    uint64_t wait_cycles;         /* Total time spent acquiring it. */
+    uint64_t max_wait_cycles;     /* Longest single acquisition. */
+    uint64_t hold_cycles;         /* Total time it was held. */
+    uint64_t acquired_at;         /* TSC when the holder got it. */
+#endif
   };
 
+/* Maximo de vueltas que lock_acquire() espera girando a que el
+   holder, corriendo en otro CPU, suelte el lock.  Con un solo CPU
+   no se gira nunca. */
+#define LOCK_SPIN_LIMIT 1000
+
 void lock_init (struct lock *);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_heap_init (struct pheap *);
+
+#ifdef LOCK_PROFILE
+void lock_set_name (struct lock *, const char *name);
+void lock_print_stats (void);
+#else
+static inline void lock_set_name (struct lock *lock UNUSED,
+                                  const char *name UNUSED) {}
+static inline void lock_print_stats (void) {}
+#endif
 
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct pheap waiters;       /* Waiters, highest priority on top. */
   };
 
 void cond_init (struct condition *);
@@ -47,23 +84,40 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock
+  {
+    struct lock lock;           /* Guards fields, held by the writer. */
+    struct condition no_readers; /* Signaled when readers drops to 0. */
+    struct condition writer_done; /* Signaled when a writer releases. */
+    int readers;                /* Number of threads reading. */
+    int writers_waiting;        /* Writers waiting for readers to drain. */
+    bool prefer_writers;        /* Block new readers while writers wait. */
+  };
+
+void rw_init (struct rwlock *, bool prefer_writers);
+void rw_read_acquire (struct rwlock *);
+void rw_read_release (struct rwlock *);
+void rw_write_acquire (struct rwlock *);
+void rw_write_release (struct rwlock *);
+
 
-/* Funcion auxiliar para ordenar la lista, comparara si la prioridad del thread 
-a es mayor a la de b, mayor prioridad en head */
-static bool ordenarMayorMenor(const struct list_elem *a,
-                             const struct list_elem *b,
+/* Funcion auxiliar para el heap de waiters, comparara si la prioridad del thread 
+a es menor a la de b, mayor prioridad en la cima */
+static bool menorPrioridadThread(const struct pheap_elem *a,
+                             const struct pheap_elem *b,
                              void *aux);
 
-/* Funcion auxiliar para ordenar la lista, comparara si la prioridad del lock 
-a es mayor a la de b, mayor prioridad en head */
-static bool ordenarMayorMenorLock(const struct list_elem *a,
-                             const struct list_elem *b,
+/* Funcion auxiliar para el heap de locks, comparara si la prioridad del lock 
+a es menor a la de b, mayor prioridad en la cima */
+static bool menorPrioridadLock(const struct pheap_elem *a,
+                             const struct pheap_elem *b,
                              void *aux);
 
-/* Funcion auxiliar para ordenar la lista, comparara si la prioridad de la lista 
-del semaforo a es mayor a la de b, mayor prioridad en head */
-static bool ordenarMayorMenorSema(const struct list_elem *a,
-                             const struct list_elem *b,
+/* Funcion auxiliar para el heap de una condicion, comparara si la prioridad del 
+waiter a es menor a la de b, mayor prioridad en la cima */
+static bool menorPrioridadSema(const struct pheap_elem *a,
+                             const struct pheap_elem *b,
                              void *aux);
 
 /* Optimization barrier.
@@ -1,16 +1,29 @@
 #include "threads/thread.h"
+#include <counter.h>
 #include <debug.h>
+#include <histogram.h>
+#include <kinfo.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
+#include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/loader.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/rcu.h"
+#include "threads/slab.h"
+#include "threads/spinlock.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -20,28 +33,137 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
+/* Random value for the lowest word of each kernel stack, which
+   an overflow overwrites first. */
+#define STACK_MAGIC 0x57ac4b1d
 
-static struct list lista_espera;  //lista de los threads que están en espera de que se cumpla su tiempo de estar durmiendo.
 
-static int64_t load_avg = 0;      // para advanced scheduller
+static int load_avg = 0;          // para advanced scheduller, punto fijo 20.12
 
+/* Coeficiente (2*load_avg)/(2*load_avg + 1) en punto fijo, se
+   precalcula una vez por segundo junto con load_avg para que el
+   decaimiento de recent_cpu sea solo una multiplicacion. */
+static int recent_cpu_coef = 0;
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Threads cuyo recent_cpu cambio desde el ultimo recalculo de
+   prioridades, es decir, los que corrieron en los ultimos ticks.
+   Cada cuarto tick solo a estos se les recalcula la prioridad. */
+static struct list dirty_list;
+
+
+/* Run queue of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+
+   Hay una cola FIFO por cada nivel de prioridad (PRI_MIN..PRI_MAX)
+   y un bitmap de 64 bits donde el bit P esta encendido si y solo si
+   la cola de prioridad P no esta vacia.  Asi encolar es O(1) y
+   escoger el siguiente thread es buscar el bit mas alto encendido.
+
+   Cada CPU tiene su propia run queue protegida por un spinlock;
+   si la suya esta vacia, next_thread_to_run() le roba el thread
+   de mayor prioridad a otra CPU. */
+struct cpu
+  {
+    struct spinlock lock;               /* Protege la run queue. */
+    struct list ready_queues[PRI_MAX + 1];
+    uint64_t ready_bitmap;
+    size_t ready_count;                 /* # de threads, sin workers, en las colas. */
+    struct list edf_queue;              /* Threads EDF listos, por plazo absoluto. */
+    struct list batch_queue;            /* Threads batch listos, FIFO. */
+    struct thread *running;             /* Thread que corre en la CPU. */
+    int load_avg;                       /* load_avg de solo esta CPU, 20.12. */
+  };
+
+/* Balanceo de carga.  Cada BALANCE_TICKS ticks, cada CPU compara
+   sus threads listos con los de la CPU mas cargada y, si esta
+   tiene al menos BALANCE_MIN mas, se trae el de mayor prioridad
+   que tenga permitido correr en ella, para que las prioridades
+   altas tambien se repartan.  No se lleva un thread que corrio
+   hace menos de CACHE_HOT_US microsegundos, porque sus datos
+   siguen en la cache de la otra CPU; robar trabajo para no
+   quedarse sin nada que correr si se lo lleva. */
+#define BALANCE_TICKS 4
+#define BALANCE_MIN 2
+#define CACHE_HOT_US 500
+static long long migrations;    /* # de threads que cambiaron de CPU. */
+
+/* Por ahora solo arranca el procesador de booteo (BSP), los APs
+   no se levantan todavia, asi que NCPU es 1 y cpu_current()
+   siempre es cpus[0]. */
+static struct cpu cpus[NCPU];
 
 /* List of all processes.  Processes are added to this list
-   when they are first scheduled and removed when they exit. */
+   when they are first scheduled and removed when they exit.
+   Changed only with interrupts off; read under rcu_read_lock(),
+   since a thread's structure is only reused a grace period after
+   it was unlinked. */
 static struct list all_list;
 
 /* Idle thread. */
 static struct thread *idle_thread;
 
-/* Initial thread, the thread running init.c:main(). */
+/* Initial thread, the thread running init.c:main(), on the
+   stack that loader.S set up. */
 static struct thread *initial_thread;
-
-/* Lock used by allocate_tid(). */
-static struct lock tid_lock;
+static struct thread initial_thread_struct;
+
+/* Threads vivos indexados por tid.  allocate_tid() ocupa una
+   entrada con cmpxchg y thread_exit() la libera, asi que los tids
+   se reciclan y nunca pasan de TID_MAX. */
+static struct thread *tid_table[TID_MAX];
+
+/* Los `struct thread' salen de thread_cache y sus pilas aparte,
+   segun el tamano pedido: las chicas de stack_cache, dos por
+   pagina; las de una pagina de palloc, a traves de page_cache; y
+   las mas grandes del area de pilas, con una pagina de guarda sin
+   mapear debajo.  Un thread muerto no se puede liberar en
+   thread_schedule_tail(), con las interrupciones apagadas, porque
+   los slabs toman un lock, asi que thread_free_rcu() lo deja en
+   dead_list y thread_prepare() lo libera despues.  dead_list se
+   enlaza por `allelem' y solo se toca con interrupciones
+   apagadas. */
+static struct kmem_cache *thread_cache;
+static struct kmem_cache *stack_cache;
+static struct list dead_list;
+static size_t stack_cnt[3];         /* Pilas en uso, chicas, de una pagina y grandes. */
+
+/* Cache de paginas de pilas de threads muertos.  thread_reap()
+   guarda aqui la pagina en vez de devolverla a palloc, y
+   thread_create() la reutiliza sin pasar por el lock del pool: es
+   pila que no se lee antes de escribirse.  Solo se toca con
+   interrupciones apagadas. */
+#define THREAD_PAGE_CACHE 16
+static void *page_cache[THREAD_PAGE_CACHE];
+static size_t page_cache_cnt;
+static long long page_cache_hits;   /* # de thread_create servidos del cache. */
+static long long page_cache_misses; /* # que tuvieron que ir a palloc. */
+
+/* Area de pilas grandes: las direcciones que mapea la tabla de
+   paginas de la entrada del directorio justo antes de la de
+   KINFO_ADDR, que como ella comparten todos los directorios de
+   los procesos.  Se divide en ranuras de STACK_SLOT_PAGES paginas
+   y cada pila ocupa el final de la suya, asi que al menos la
+   primera pagina de cada ranura queda sin mapear y un
+   desbordamiento falla ahi en vez de pisar a la pila vecina.
+   stack_slot_used solo se toca con interrupciones apagadas. */
+#define STACK_AREA 0xff800000
+#define STACK_SLOT_PAGES (THREAD_STACK_MAX / PGSIZE + 1)
+#define STACK_SLOT_CNT (PTSPAN / PGSIZE / STACK_SLOT_PAGES)
+static uint32_t *stack_area_pt;
+static bool stack_slot_used[STACK_SLOT_CNT];
+
+/* Clase EDF (earliest deadline first).  Un thread EDF reserva
+   RUNTIME ticks de CPU en cada PERIOD ticks y debe terminar el
+   trabajo de cada periodo antes de DEADLINE ticks desde que
+   empieza.  Corre antes que cualquier thread de las otras clases,
+   y entre los EDF el de plazo absoluto mas cercano.  Se admite un
+   thread nuevo solo si la suma de RUNTIME / DEADLINE de todos los
+   EDF no pasa de 1, asi que todos cumplen sus plazos con un solo
+   CPU; thread_tick() lo detiene hasta el siguiente periodo si
+   agota el presupuesto, para que no afecte a los demas. */
+#define EDF_UTIL_MAX 1000       /* Utilizacion total, en milesimas. */
+#define EDF_PERIOD_MAX 1000000  /* Periodo maximo, en ticks. */
+static int edf_util_total;      /* Suma de edf_util de los threads EDF. */
 
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
@@ -52,13 +174,31 @@ struct kernel_thread_frame
   };
 
 /* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
+static struct counter idle_ticks;   /* # of timer ticks spent idle. */
+static struct counter kernel_ticks; /* # of timer ticks in kernel threads. */
+static struct counter user_ticks;   /* # of timer ticks in user programs. */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
+#define BATCH_SLICE 40          /* # of timer ticks to give each batch thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+static bool slice_donated;      /* Next thread keeps THREAD_TICKS. */
+static long long yields_to;     /* # of thread_yield_to() handoffs. */
+static long long cond_resched_yields; /* # of thread_cond_resched() yields. */
+
+/* Latencia del scheduler, en ciclos del TSC, por prioridad y en
+   total: desde thread_unblock() hasta que el thread corre, y cuanto
+   corre cada vez que se le da el CPU, a comparar con TIME_SLICE. */
+static struct histogram wakeup_hist[PRI_MAX + 1], wakeup_total;
+static struct histogram slice_hist[PRI_MAX + 1], slice_total;
+static uint64_t slice_start;    /* TSC del ultimo cambio de contexto. */
+static uint64_t slices_expired; /* # de veces que se agoto TIME_SLICE. */
+static uint64_t slices_total;   /* # de veces que se le quito el CPU a alguien. */
+
+/* Ciclos del TSC, sumados sobre todos los threads. */
+static uint64_t idle_cycles;    /* # of cycles spent idle. */
+static uint64_t kernel_cycles;  /* # of cycles in kernel mode. */
+static uint64_t user_cycles;    /* # of cycles in user mode. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
@@ -68,19 +208,53 @@ bool thread_mlfqs;
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
-static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
-static void init_thread (struct thread *, const char *name, int priority);
+static void init_thread (struct thread *, const char *name, int priority,
+                         uint8_t *kstack, size_t kstack_size);
 static bool is_thread (struct thread *) UNUSED;
+static bool mlfqs_exento (struct thread *);
 static void *alloc_frame (struct thread *, size_t size);
+static struct thread *thread_prepare (const char *name, int priority,
+                                      size_t stack_size,
+                                      thread_func *, void *aux);
+static size_t stack_round (size_t size);
+static int stack_class (size_t size);
+static uint8_t *stack_alloc (size_t size);
+static void stack_free (uint8_t *stack, size_t size);
+static uint8_t *stack_area_alloc (size_t size);
+static void stack_area_free (uint8_t *stack, size_t size);
+static void *thread_page_get (void);
+static void thread_page_put (void *);
+static void thread_reap (void);
+static rcu_func thread_free_rcu;
+static bool defer_for_rcu (struct thread *);
 static void schedule (void);
+static void schedule_to (struct thread *next);
 void thread_schedule_tail (struct thread *prev);
-static tid_t allocate_tid (void);
+static tid_t allocate_tid (struct thread *);
+static timer_event_func despertar_thread;
+static void ready_queue_push (struct thread *);
+static void ready_queue_push_front (struct thread *);
+static void ready_queue_remove (struct thread *);
+static int ready_queue_max_priority (struct cpu *);
+static struct thread *ready_queue_steal (struct cpu *);
+static struct cpu *cpu_current (void);
+static struct thread *ready_queue_pull (struct cpu *victim, struct cpu *self,
+                                        bool cold_only);
+static void load_balance (struct cpu *self);
+static bool cache_hot (const struct thread *);
+static struct thread *ready_preempts (struct cpu *, struct thread *);
+static bool en_clase_batch (const struct thread *);
+static unsigned time_slice (const struct thread *);
+static list_less_func plazo_menor;
+static void edf_nuevo_periodo (struct thread *, int64_t release);
+static timer_event_func edf_siguiente_periodo;
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
    general and it is possible in this case only because loader.S
-   was careful to put the bottom of the stack at a page boundary.
+   was careful to put the bottom of the stack at a page boundary,
+   so the stack is a page like that of any other thread.
 
    Also initializes the run queue and the tid lock.
 
@@ -93,30 +267,61 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  uint32_t *esp;
+  int i, c;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
-  lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (c = 0; c < NCPU; c++)
+    {
+      struct cpu *cpu = &cpus[c];
+
+      spinlock_init (&cpu->lock);
+      for (i = PRI_MIN; i <= PRI_MAX; i++)
+        list_init (&cpu->ready_queues[i]);
+      cpu->ready_bitmap = 0;
+      cpu->ready_count = 0;
+      list_init (&cpu->edf_queue);
+      list_init (&cpu->batch_queue);
+    }
   list_init (&all_list);
-  list_init (&lista_espera);  //inicializamos la lista de threads en espera.
+  list_init (&dirty_list);
+  list_init (&dead_list);
+  rcu_init ();
 
   /* Set up a thread structure for the running thread. */
-  initial_thread = running_thread ();
-  init_thread (initial_thread, "main", PRI_DEFAULT);
+  asm ("mov %%esp, %0" : "=g" (esp));
+  initial_thread = cpus[0].running = &initial_thread_struct;
+  init_thread (initial_thread, "main", PRI_DEFAULT, pg_round_down (esp),
+               PGSIZE);
   initial_thread->status = THREAD_RUNNING;
-  initial_thread->tid = allocate_tid ();
+  initial_thread->tid = allocate_tid (initial_thread);
 
   initial_thread->nice = 0;
   initial_thread->recent_cpu = 0;
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
-   Also creates the idle thread. */
+   Also creates the idle thread, along with the caches and the
+   stack area that threads are allocated from, so it must be
+   called after paging_init() and before the first process is
+   created. */
 void
 thread_start (void) 
 {
-  /* Create the idle thread. */
   struct semaphore idle_started;
+
+  thread_cache = kmem_cache_create ("thread", sizeof (struct thread), NULL);
+  stack_cache = kmem_cache_create ("thread stack", THREAD_STACK_SMALL, NULL);
+  ASSERT (stack_cache->objs_per_slab >= 2);
+
+  ASSERT (STACK_AREA >= (uintptr_t) PHYS_BASE + init_ram_pages * PGSIZE);
+  ASSERT (pd_no ((void *) STACK_AREA) != pd_no ((void *) KINFO_ADDR));
+  ASSERT (init_page_dir[pd_no ((void *) STACK_AREA)] == 0);
+  stack_area_pt = palloc_get_page_tagged (PAL_ASSERT | PAL_ZERO, MEM_PAGEDIR);
+  init_page_dir[pd_no ((void *) STACK_AREA)] = pde_create (stack_area_pt);
+
+  /* Create the idle thread. */
   sema_init (&idle_started, 0);
   thread_create ("idle", PRI_MIN, idle, &idle_started);
 
@@ -127,34 +332,166 @@ thread_start (void)
   sema_down (&idle_started);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
+/* Called by the timer interrupt handler at each timer tick, with
+   USER true if the tick interrupted user mode.
    Thus, this function runs in an external interrupt context. */
 void
-thread_tick (void) 
+thread_tick (bool user UNUSED) 
 {
   struct thread *t = thread_current ();
 
   /* Update statistics. */
   if (t == idle_thread)
-    idle_ticks++;
+    counter_inc (&idle_ticks);
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    {
+      counter_inc (&user_ticks);
+      if (user)
+        t->proceso->ticks_usuario++;
+      else
+        t->proceso->ticks_kernel++;
+    }
 #endif
   else
-    kernel_ticks++;
+    counter_inc (&kernel_ticks);
+
+  /* Un thread EDF no tiene time slice: corre hasta que termina su
+     trabajo, agota su presupuesto o llega uno de plazo menor. */
+  if (t->edf)
+    {
+      if (--t->edf_budget <= 0)
+        {
+          t->edf_throttled = true;
+          intr_yield_on_return ();
+        }
+      else if (ready_preempts (cpu_current (), t) != NULL)
+        intr_yield_on_return ();
+      return;
+    }
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (NCPU > 1 && timer_ticks () % BALANCE_TICKS == 0)
+    load_balance (cpu_current ());
+
+  /* Enforce preemption.  Un thread batch le cede el CPU a
+     cualquier thread normal que este listo, aunque no haya
+     agotado su turno. */
+  if (++thread_ticks >= time_slice (t)
+      || !list_empty (&cpu_current ()->edf_queue)
+      || (en_clase_batch (t) && ready_queue_max_priority (cpu_current ()) >= 0))
     intr_yield_on_return ();
 }
 
+/* Adds N ticks, skipped by tickless idle while the idle thread
+   was halted, to the idle statistics. */
+void
+thread_account_idle_ticks (int64_t n)
+{
+  counter_add (&idle_ticks, n);
+}
+
+/* Cobra al thread que esta corriendo los ciclos del TSC que pasaron
+   desde su ultima marca, como tiempo de usuario si USER o de
+   kernel si no, y reinicia la marca.  Se llama en cada cambio de
+   contexto y al cruzar la frontera kernel/usuario en
+   intr_handler(), sea por una interrupcion o por una syscall. */
+void
+thread_account_cycles (bool user)
+{
+  struct thread *t = running_thread ();
+  enum intr_level old_level = intr_disable ();
+  uint64_t now = rdtsc ();
+  uint64_t delta = now - t->cycles_mark;
+
+  t->cycles_mark = now;
+  if (user)
+    {
+      t->user_cycles += delta;
+      user_cycles += delta;
+    }
+  else
+    {
+      t->kernel_cycles += delta;
+      if (t == idle_thread)
+        idle_cycles += delta;
+      else
+        kernel_cycles += delta;
+    }
+  intr_set_level (old_level);
+}
+
+/* Marca al thread actual como worker de threads/workqueue.c: no
+   cuenta para load_avg y MLFQS no le cambia la prioridad, igual
+   que al idle thread. */
+void
+thread_set_worker (void)
+{
+  thread_current ()->worker = true;
+}
+
+/* Devuelve true si MLFQS no debe tomar en cuenta a T. */
+static bool
+mlfqs_exento (struct thread *t)
+{
+  return t == idle_thread || t->worker || t->edf;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
 {
-  printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+  int p;
+
+  printf ("Thread: %llu idle ticks, %llu kernel ticks, %llu user ticks\n",
+          counter_read (&idle_ticks), counter_read (&kernel_ticks),
+          counter_read (&user_ticks));
+  printf ("Thread: %llu idle cycles, %llu kernel cycles, %llu user cycles\n",
+          idle_cycles, kernel_cycles, user_cycles);
+  printf ("Thread: %lld page cache hits, %lld misses\n",
+          page_cache_hits, page_cache_misses);
+  printf ("Thread: %zu small, %zu one-page, %zu guarded stacks in use\n",
+          stack_cnt[0], stack_cnt[1], stack_cnt[2]);
+  printf ("Thread: %lld migrations between CPUs\n", migrations);
+  printf ("Thread: %lld directed yields, %lld voluntary preemptions\n",
+          yields_to, cond_resched_yields);
+  for (p = 0; p < NCPU; p++)
+    printf ("Thread: CPU %d load average %d\n",
+            p, thread_get_cpu_load_avg (p));
+  rcu_print_stats ();
+
+  printf ("Thread: %llu of %llu slices ran the full %d ticks\n",
+          slices_expired, slices_total, TIME_SLICE);
+  histogram_print ("Thread: wakeup latency cycles", &wakeup_total);
+  histogram_print ("Thread: slice cycles", &slice_total);
+  for (p = PRI_MIN; p <= PRI_MAX; p++)
+    {
+      char name[48];
+
+      snprintf (name, sizeof name, "Thread: priority %d wakeup latency", p);
+      histogram_print (name, &wakeup_hist[p]);
+      snprintf (name, sizeof name, "Thread: priority %d slice", p);
+      histogram_print (name, &slice_hist[p]);
+    }
+}
+
+/* Copia en WAKEUP y SLICE los histogramas de latencia de
+   despertar y de duracion de turno de los threads de prioridad
+   PRIORITY, o de todos si PRIORITY es -1.  Devuelve false si
+   PRIORITY no es valida. */
+bool
+thread_get_latency (int priority, struct histogram *wakeup,
+                    struct histogram *slice)
+{
+  enum intr_level old_level;
+
+  if (priority != -1 && (priority < PRI_MIN || priority > PRI_MAX))
+    return false;
+
+  old_level = intr_disable ();
+  *wakeup = priority == -1 ? wakeup_total : wakeup_hist[priority];
+  *slice = priority == -1 ? slice_total : slice_hist[priority];
+  intr_set_level (old_level);
+  return true;
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -175,23 +512,214 @@ thread_print_stats (void)
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
+{
+  return thread_create_sized (name, priority, THREAD_STACK_DEFAULT,
+                              function, aux);
+}
+
+/* Like thread_create(), but gives the new thread a kernel stack
+   of at least STACK_SIZE bytes, at most THREAD_STACK_MAX: a small
+   one for a thread that only waits and hands work on, or a large
+   one, with a guard page below it, for a thread that goes deep
+   into the file system. */
+tid_t
+thread_create_sized (const char *name, int priority, size_t stack_size,
+                     thread_func *function, void *aux) 
 {
   struct thread *t;
-  struct kernel_thread_frame *kf;
-  struct switch_entry_frame *ef;
-  struct switch_threads_frame *sf;
   tid_t tid;
 
   ASSERT (function != NULL);
+  ASSERT (stack_size <= THREAD_STACK_MAX);
 
-  /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_prepare (name, priority, stack_size, function, aux);
   if (t == NULL)
     return TID_ERROR;
+  tid = t->tid;
+
+  /* Add to run queue. */
+  thread_unblock (t);
+
+  /*
+  Si tiene una mayor prioridad que el thread actual en ejecución, este thread en ejecución 
+  debe ceder inmediatamente  el procesador al nuevo thread.
+  */
+  if(priority>thread_current()->priority){
+    thread_yield();
+  }
+
+  return tid;
+}
+
+/* Creates a new kernel thread of the EDF class named NAME,
+   which executes FUNCTION passing AUX as the argument.  In each
+   period of PERIOD timer ticks it may use RUNTIME ticks of CPU
+   time and should finish that period's work, ending it with
+   thread_edf_wait(), within DEADLINE ticks of the start of the
+   period.  The first period starts now.
+
+   Returns the new thread's identifier, or TID_ERROR if creation
+   fails or if admitting the thread could make some EDF thread
+   miss its deadlines: that is, unless 0 < RUNTIME <= DEADLINE
+   <= PERIOD and the reserved utilizations RUNTIME / DEADLINE of
+   all EDF threads add up to at most 1. */
+tid_t
+thread_create_edf (const char *name, int64_t runtime, int64_t period,
+                   int64_t deadline, thread_func *function, void *aux) 
+{
+  enum intr_level old_level;
+  struct thread *t;
+  tid_t tid;
+  int util;
+
+  ASSERT (function != NULL);
+
+  if (runtime <= 0 || runtime > deadline || deadline > period
+      || period > EDF_PERIOD_MAX)
+    return TID_ERROR;
+
+  // redondeado hacia arriba, para no admitir de mas
+  util = DIV_ROUND_UP ((int) runtime * EDF_UTIL_MAX, (int) deadline);
+  old_level = intr_disable ();
+  if (edf_util_total + util > EDF_UTIL_MAX)
+    {
+      intr_set_level (old_level);
+      return TID_ERROR;
+    }
+  edf_util_total += util;
+  intr_set_level (old_level);
+
+  /* Con la prioridad mas alta, para que en los semaforos y en
+     sema_up() pase antes que los threads de las otras clases. */
+  t = thread_prepare (name, PRI_MAX, THREAD_STACK_DEFAULT, function, aux);
+  if (t == NULL)
+    {
+      old_level = intr_disable ();
+      edf_util_total -= util;
+      intr_set_level (old_level);
+      return TID_ERROR;
+    }
+  tid = t->tid;
+  t->edf = true;
+  t->edf_runtime = runtime;
+  t->edf_period = period;
+  t->edf_deadline = deadline;
+  t->edf_util = util;
+  edf_nuevo_periodo (t, timer_ticks ());
+
+  thread_unblock (t);
+  thread_preempt ();
+  return tid;
+}
+
+/* Ends the current EDF period's work for the running thread,
+   which must be of the EDF class, and sleeps until the next
+   period starts, with a fresh budget.  If the work finished
+   after its deadline it counts as a miss; if the next period
+   has already started it begins at once. */
+void
+thread_edf_wait (void) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int64_t now, siguiente;
+
+  ASSERT (cur->edf);
+
+  old_level = intr_disable ();
+  now = timer_ticks ();
+  if (now > cur->edf_abs_deadline)
+    cur->edf_misses++;
+  siguiente = cur->edf_release + cur->edf_period;
+  if (siguiente <= now)
+    edf_nuevo_periodo (cur, now);
+  else
+    {
+      timer_add (&cur->edf_event, siguiente, edf_siguiente_periodo, cur);
+      thread_block ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Returns the number of periods in which the running thread,
+   which must be of the EDF class, finished after its deadline. */
+unsigned
+thread_edf_misses (void) 
+{
+  ASSERT (thread_current ()->edf);
+  return thread_current ()->edf_misses;
+}
+
+/* Empieza un periodo de T en RELEASE: nuevo plazo absoluto y
+   presupuesto completo. */
+static void
+edf_nuevo_periodo (struct thread *t, int64_t release)
+{
+  t->edf_release = release;
+  t->edf_abs_deadline = release + t->edf_deadline;
+  t->edf_budget = t->edf_runtime;
+  t->edf_throttled = false;
+}
+
+/* Callback del timer wheel: empieza el siguiente periodo de un
+   thread EDF que termino su trabajo o agoto su presupuesto. */
+static void
+edf_siguiente_periodo (void *t_)
+{
+  struct thread *t = t_;
+
+  edf_nuevo_periodo (t, t->edf_release + t->edf_period);
+  thread_unblock (t);
+}
+
+/* Allocates and initializes a blocked thread named NAME with the
+   given initial PRIORITY and a kernel stack of at least
+   STACK_SIZE bytes, ready to execute FUNCTION passing AUX once it
+   is unblocked.  Returns a null pointer if no memory or no tid
+   is available. */
+static struct thread *
+thread_prepare (const char *name, int priority, size_t stack_size,
+                thread_func *function, void *aux) 
+{
+  struct thread *t;
+  uint8_t *stack;
+  struct kernel_thread_frame *kf;
+  struct switch_entry_frame *ef;
+  struct switch_threads_frame *sf;
+
+  /* Free the threads that died since, then allocate thread. */
+  thread_reap ();
+  stack_size = stack_round (stack_size);
+  t = kmem_cache_alloc (thread_cache);
+  if (t == NULL)
+    return NULL;
+  stack = stack_alloc (stack_size);
+  if (stack == NULL)
+    {
+      kmem_cache_free (thread_cache, t);
+      return NULL;
+    }
 
   /* Initialize thread. */
-  init_thread (t, name, priority);
-  tid = t->tid = allocate_tid ();
+  init_thread (t, name, priority, stack, stack_size);
+  // hereda la afinidad de quien lo crea, y arranca en una CPU permitida
+  t->cpu_mask = thread_current ()->cpu_mask;
+  if ((t->cpu_mask & (1u << t->cpu)) == 0)
+    t->cpu = __builtin_ctz (t->cpu_mask);
+  // y tambien su nice, su clase batch y su holgura al dormir
+  t->nice = thread_current ()->nice;
+  t->batch = thread_current ()->batch;
+  t->timer_slack = thread_current ()->timer_slack;
+  t->tid = allocate_tid (t);
+  if (t->tid == TID_ERROR)
+    {
+      enum intr_level old_level = intr_disable ();
+      list_remove (&t->allelem);
+      intr_set_level (old_level);
+      stack_free (stack, stack_size);
+      kmem_cache_free (thread_cache, t);
+      return NULL;
+    }
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -208,18 +736,7 @@ thread_create (const char *name, int priority,
   sf->eip = switch_entry;
   sf->ebp = 0;
 
-  /* Add to run queue. */
-  thread_unblock (t);
-
-  /*
-  Si tiene una mayor prioridad que el thread actual en ejecución, este thread en ejecución 
-  debe ceder inmediatamente  el procesador al nuevo thread.
-  */
-  if(priority>thread_current()->priority){
-    thread_yield();
-  }
-
-  return tid;
+  return t;
 }
 
 /* Puts the current thread to sleep.  It will not be scheduled
@@ -234,6 +751,7 @@ thread_block (void)
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
+  TRACE (TRACE_BLOCK, 0);
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
@@ -256,13 +774,13 @@ thread_unblock (struct thread *t)
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
   /*
-   mete el thread desbloquado a la ready list y cambia el estatus a ready, 
-   como queremos ordenar ready list de acuerdo a las prioridades, usaremos
-   list_insert_ordered
+   mete el thread desbloquado al final de la cola de su prioridad y cambia
+   el estatus a ready, el orden entre threads de igual prioridad es FIFO
   */
-  //list_push_back (&ready_list, &t->elem);
-  list_insert_ordered(&ready_list, &t->elem,ordenarMayorMenor,NULL);
+  ready_queue_push (t);
   t->status = THREAD_READY;
+  t->ready_mark = rdtsc ();
+  TRACE (TRACE_UNBLOCK, t->tid);
 
   intr_set_level (old_level);
 }
@@ -284,8 +802,8 @@ thread_current (void)
   
   /* Make sure T is really a thread.
      If either of these assertions fire, then your thread may
-     have overflowed its stack.  Each thread has less than 4 kB
-     of stack, so a few big automatic arrays or moderate
+     have overflowed its stack.  Most threads have 4 kB of stack,
+     some less, so a few big automatic arrays or moderate
      recursion can cause stack overflow. */
   ASSERT (is_thread (t));
   ASSERT (t->status == THREAD_RUNNING);
@@ -313,17 +831,25 @@ thread_exit (void)
 
   struct thread *thread_actual = thread_current();
 
-  struct list_elem *e;
-  for(e = list_begin(&thread_actual->holding_lock); e != list_end(&thread_actual->holding_lock); e = list_next(e)){
-    struct lock *lock = list_entry(e, struct lock, elem_lock);
+  // liberar los locks que aun tenga el thread, lock_release los quita del heap
+  while(!pheap_empty(&thread_actual->holding_lock)){
+    struct lock *lock = pheap_entry(pheap_top(&thread_actual->holding_lock), struct lock, elem_lock);
     lock_release(lock);
   }
 
+  // devolver los bloques que guarda el cache de malloc del thread
+  malloc_thread_exit ();
+
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
+  tid_table[thread_actual->tid] = NULL;
+  if (thread_actual->edf)
+    edf_util_total -= thread_actual->edf_util;
   list_remove (&thread_current()->allelem);
+  if (thread_current ()->recent_cpu_dirty)
+    list_remove (&thread_current ()->dirty_elem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -340,10 +866,23 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
+  if (defer_for_rcu (cur)){
+    intr_set_level (old_level);
+    return;
+  }
+  if (cur->edf_throttled){
+    // agoto su presupuesto, no vuelve a correr hasta su siguiente periodo
+    timer_add (&cur->edf_event, cur->edf_release + cur->edf_period,
+               edf_siguiente_periodo, cur);
+    cur->status = THREAD_BLOCKED;
+    schedule ();
+    intr_set_level (old_level);
+    return;
+  }
+
   // si el thread actual no es un nop
   if (cur != idle_thread){
-    //list_push_back (&ready_list, &cur->elem);
-    list_insert_ordered(&ready_list, &cur->elem, ordenarMayorMenor, NULL);
+    ready_queue_push (cur);
   } 
     
   cur->status = THREAD_READY;
@@ -351,28 +890,154 @@ thread_yield (void)
   intr_set_level (old_level);
 }
 
+/* Cede el CPU directamente a NEXT, que debe estar en la run
+   queue, sin pasar por next_thread_to_run().  El thread actual
+   queda al frente de la cola de su prioridad, asi que entre los
+   de su prioridad es el siguiente en correr cuando NEXT ceda.
+   Es un solo cambio de contexto, en lugar de encolarse al final
+   y volver a escoger.  Interrupts must be off. */
+void
+thread_handoff (struct thread *next) 
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (is_thread (next));
+  ASSERT (next->status == THREAD_READY);
+
+  if (defer_for_rcu (cur))
+    return;
+  ready_queue_remove (next);
+  if (cur != idle_thread)
+    ready_queue_push_front (cur);
+  cur->status = THREAD_READY;
+  schedule_to (next);
+}
+
+/* Cede el resto del turno del thread actual a T, que debe estar
+   listo en la misma CPU: T corre enseguida, sin pasar por
+   next_thread_to_run(), y sigue con los ticks que le quedaban al
+   turno, asi que un par de threads que se pasan el CPU no corre
+   mas que los demas.  El thread actual queda al frente de su
+   cola, como en thread_handoff().
+
+   No se salta a nadie mas importante que T: si hay un EDF listo o
+   un thread de mayor prioridad, o T es batch y hay threads
+   normales listos, devuelve false sin ceder, igual que si T no
+   esta listo.  Devuelve true despues de que T cede el CPU. */
+bool
+thread_yield_to (struct thread *t) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  struct cpu *cpu;
+  bool ok;
+
+  ASSERT (!intr_context ());
+  ASSERT (!rcu_reading ());
+  ASSERT (is_thread (t));
+
+  old_level = intr_disable ();
+  cpu = cpu_current ();
+  ok = (t != cur && t->status == THREAD_READY && &cpus[t->cpu] == cpu
+        && !t->edf && list_empty (&cpu->edf_queue));
+  if (ok)
+    {
+      int p = ready_queue_max_priority (cpu);
+      ok = t->en_cola_batch ? p < 0 : t->priority >= p;
+    }
+  if (ok)
+    {
+      yields_to++;
+      slice_donated = true;
+      thread_handoff (t);
+    }
+  intr_set_level (old_level);
+  return ok;
+}
+
+/* Punto de desalojo voluntario, para los ciclos largos del
+   kernel.  Si hay un thread listo que deba desalojar al actual,
+   le cede el CPU, en lugar de dejarlo esperar a que el ciclo
+   termine o al siguiente tick, asi que acota la latencia con la
+   que corre un thread de mayor prioridad que despierta mientras
+   tanto.  No hace nada con interrupts off, en un interrupt
+   handler o en una seccion RCU, donde no se puede ceder, asi que
+   es seguro llamarla desde codigo que a veces corre asi.  Cuando
+   no hay nadie que ceder cuesta solo unas lecturas, para poder
+   llamarla en cada vuelta. */
+void
+thread_cond_resched (void) 
+{
+  struct cpu *cpu = &cpus[0];   /* Only the boot CPU runs for now. */
+  struct thread *cur;
+  uint64_t higher;
+
+  if (intr_get_level () == INTR_OFF || intr_context ())
+    return;
+  cur = thread_current ();
+  if (cur->rcu_nesting > 0)
+    return;
+
+  /* Sin lock, basta para descartar el caso comun; thread_preempt()
+     lo vuelve a ver con interrupts off. */
+  higher = cpu->ready_bitmap >> cur->priority >> 1;
+  if (higher != 0 || !list_empty (&cpu->edf_queue)
+      || (en_clase_batch (cur) && cpu->ready_bitmap != 0))
+    {
+      cond_resched_yields++;
+      thread_preempt ();
+    }
+}
+
+/* Si hay un thread listo que deba desalojar al actual, le cede
+   el CPU con thread_handoff().  Desde un interrupt handler se
+   cede al regresar. */
+void
+thread_preempt (void) 
+{
+  enum intr_level old_level;
+  struct thread *next;
+
+  old_level = intr_disable ();
+  next = ready_preempts (cpu_current (), thread_current ());
+  if (next != NULL)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_handoff (next);
+    }
+  intr_set_level (old_level);
+}
+
 /* Invoke function 'func' on all threads, passing along 'aux'.
-   This function must be called with interrupts off. */
+   Walks the list in an RCU read-side critical section, so it
+   needs no lock and may be called with interrupts on, but FUNC
+   must not sleep.  A thread that starts or exits meanwhile may
+   or may not be visited. */
 void
 thread_foreach (thread_action_func *func, void *aux)
 {
   struct list_elem *e;
 
-  ASSERT (intr_get_level () == INTR_OFF);
-
+  rcu_read_lock ();
   for (e = list_begin (&all_list); e != list_end (&all_list);
        e = list_next (e))
     {
       struct thread *t = list_entry (e, struct thread, allelem);
       func (t, aux);
     }
+  rcu_read_unlock ();
 }
 
 /* Sets the current thread's priority to NEW_PRIORITY. */
 void
 thread_set_priority (int new_priority) 
 {
-  struct thread* siguienteAEjecutar;
+  enum intr_level old_level;
+  int max_ready;
   //thread_current ()->priority = new_priority;
   
   struct thread *threadActual = thread_current();
@@ -386,20 +1051,16 @@ thread_set_priority (int new_priority)
   }
   
 
-  if(!list_empty(&ready_list)){
-    //el siguiente a ejecutar sera el que este en el principio de la ready_list
-    siguienteAEjecutar = list_entry(list_begin(&ready_list), struct thread, elem);
-
-    //verificamos que la prioridad sea mayor que la nueva prioridad
+  //el siguiente a ejecutar sera el primero de la cola mas alta ocupada
+  old_level = intr_disable ();
+  max_ready = ready_queue_max_priority (cpu_current ());
+  intr_set_level (old_level);
 
-    /* Un thread podrá incrementar o reducir su propia prioridad en cualquier momento,
-    pero si la reduce, de manera que no sea el thread de más alta prioridad, causará 
-    que ceda inmediatamente el procesador.*/
-    if(siguienteAEjecutar != NULL){
-      if ( siguienteAEjecutar->priority > new_priority) {
-        thread_yield();
-      }
-    }
+  /* Un thread podrá incrementar o reducir su propia prioridad en cualquier momento,
+  pero si la reduce, de manera que no sea el thread de más alta prioridad, causará 
+  que ceda inmediatamente el procesador.*/
+  if (max_ready > new_priority) {
+    thread_yield();
   }
   
 }
@@ -411,6 +1072,34 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
+/* Cambia la prioridad base de T, que puede no ser el thread
+   actual, a NEW_PRIORITY.  Como en thread_set_priority(), si T
+   recibe una donacion mayor por alguno de sus locks conserva esa
+   como prioridad efectiva hasta soltarlo.  No cede el CPU: si T
+   es el actual, o despierta a alguien mas importante, el
+   llamador debe usar thread_preempt(). */
+void
+thread_set_priority_of (struct thread *t, int new_priority) 
+{
+  enum intr_level old_level;
+  int priority = new_priority;
+
+  ASSERT (is_thread (t));
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  old_level = intr_disable ();
+  t->priorityOriginal = new_priority;
+  if (!pheap_empty (&t->holding_lock))
+    {
+      struct lock *lock = pheap_entry (pheap_top (&t->holding_lock),
+                                       struct lock, elem_lock);
+      if (lock->priority > priority)
+        priority = lock->priority;
+    }
+  thread_update_priority (t, priority);
+  intr_set_level (old_level);
+}
+
 /* Sets the current thread's nice value to NICE. */
 void
 thread_set_nice (int nice UNUSED) 
@@ -423,6 +1112,24 @@ thread_set_nice (int nice UNUSED)
   intr_set_level (old_level);
 }
 
+/* Cambia el nice de T, que puede no ser el thread actual, a
+   NICE y, con MLFQS, recalcula su prioridad.  No cede el CPU; el
+   llamador debe usar thread_preempt(). */
+void
+thread_set_nice_of (struct thread *t, int nice) 
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  t->nice = nice;
+  if (thread_mlfqs)
+    actualizar_thread_priority (t, NULL);
+  intr_set_level (old_level);
+}
+
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
@@ -443,6 +1150,16 @@ thread_get_load_avg (void)
   return ROUND_X(MUL_X_N(load_avg,100));
 }
 
+/* Returns 100 times the load average of CPU alone, or -1 if
+   there is no such CPU. */
+int
+thread_get_cpu_load_avg (int cpu) 
+{
+  if (cpu < 0 || cpu >= NCPU)
+    return -1;
+  return ROUND_X(MUL_X_N(cpus[cpu].load_avg,100));
+}
+
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
@@ -450,7 +1167,7 @@ thread_get_recent_cpu (void)
   /* 
     Devuelve 100 veces el valor reciente_cpu del hilo actual , redondeado al número entero más cercano.
   */
-  return ROUND_X(MUL_X_N(thread_current()->recent_cpu,100));
+  return ROUND_X(MUL_X_N((int64_t) thread_current()->recent_cpu,100));
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -486,8 +1203,17 @@ idle (void *idle_started_ UNUSED)
          time.
 
          See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
+         7.11.1 "HLT Instruction".
+
+         Antes de detenernos, en modo tickless se programa el PIT
+         para que interrumpa hasta el siguiente evento pendiente. */
+      timer_idle_enter ();
       asm volatile ("sti; hlt" : : : "memory");
+
+      /* Si nos desperto otra interrupcion, corregir ticks y
+         regresar al tick periodico antes de correr otro thread. */
+      intr_disable ();
+      timer_idle_exit ();
     }
 }
 
@@ -502,31 +1228,33 @@ kernel_thread (thread_func *function, void *aux)
   thread_exit ();       /* If function() returns, kill the thread. */
 }
 
-/* Returns the running thread. */
+/* Returns the running thread, which schedule_to() records in
+   its CPU's `running' member just before switching to it.
+   Unlike thread_current(), does no sanity checks, so it may be
+   called from inside the scheduler and from interrupt handlers.
+   Only the boot CPU runs for now; the others would reach their
+   own struct cpu through a per-CPU segment. */
 struct thread *
 running_thread (void) 
 {
-  uint32_t *esp;
-
-  /* Copy the CPU's stack pointer into `esp', and then round that
-     down to the start of a page.  Because `struct thread' is
-     always at the beginning of a page and the stack pointer is
-     somewhere in the middle, this locates the curent thread. */
-  asm ("mov %%esp, %0" : "=g" (esp));
-  return pg_round_down (esp);
+  return cpus[0].running;
 }
 
-/* Returns true if T appears to point to a valid thread. */
+/* Returns true if T appears to point to a valid thread whose
+   kernel stack has not overflowed. */
 static bool
 is_thread (struct thread *t)
 {
-  return t != NULL && t->magic == THREAD_MAGIC;
+  return (t != NULL && t->magic == THREAD_MAGIC
+          && *(uint32_t *) t->kstack == STACK_MAGIC);
 }
 
 /* Does basic initialization of T as a blocked thread named
-   NAME. */
+   NAME, running on the KSTACK_SIZE-byte kernel stack that starts
+   at KSTACK. */
 static void
-init_thread (struct thread *t, const char *name, int priority)
+init_thread (struct thread *t, const char *name, int priority,
+             uint8_t *kstack, size_t kstack_size)
 {
   enum intr_level old_level;
 
@@ -537,16 +1265,32 @@ init_thread (struct thread *t, const char *name, int priority)
   memset (t, 0, sizeof *t);
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
-  t->stack = (uint8_t *) t + PGSIZE;
+  t->kstack = kstack;
+  t->kstack_size = kstack_size;
+  t->stack = kstack + kstack_size;
+  *(uint32_t *) kstack = STACK_MAGIC;
   t->priority = priority;
   t->priorityOriginal = priority;
+  t->cpu = 0; // los threads nuevos arrancan en la run queue del BSP
+  t->cpu_mask = CPU_MASK_ALL;
+  t->cycles_mark = rdtsc ();
   t->waiting_for_lock = NULL; // Al iniciar el thread no espera por un lock
-  list_init(&t->holding_lock); // Se inicializa la lista de los locks que tiene el thread
+  lock_heap_init(&t->holding_lock); // Se inicializa el heap de los locks que tiene el thread
   #ifdef USERPROG
-    list_init(&t->descriptores);
+    t->descriptores = NULL;
+    t->descriptores_cnt = 0;
+    t->fds_usados = NULL;
+    lock_init(&t->lock_descriptores);
     list_init(&t->procesos);
+    list_init(&t->terminados);
+    cond_init(&t->hijo_termino);
+    poll_queue_init(&t->hijos_poll);
     t->pcb = NULL;
     t->ejecutable = NULL;
+    t->heap_inicio = t->heap_fin = NULL;
+    t->directorio = NULL;
+    t->proceso = t;
+    t->hilo = NULL;
   #endif
   t->magic = THREAD_MAGIC;
   
@@ -576,14 +1320,426 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
-}
+  struct cpu *cpu = cpu_current ();
+  struct thread *t;
+  int p = ready_queue_max_priority (cpu);
 
-/* Completes a thread switch by activating the new thread's page
-   tables, and, if the previous thread is dying, destroying it.
+  // los threads EDF van antes que todos los demas
+  if (!list_empty (&cpu->edf_queue))
+    {
+      t = list_entry (list_front (&cpu->edf_queue), struct thread, elem);
+      ready_queue_remove (t);
+      return t;
+    }
+
+  if (p < 0)
+    {
+      // los threads batch solo corren si no hay ningun otro listo
+      if (!list_empty (&cpu->batch_queue))
+        {
+          t = list_entry (list_front (&cpu->batch_queue), struct thread, elem);
+          ready_queue_remove (t);
+          return t;
+        }
+
+      // la cola local esta vacia, intentar robarle trabajo a otra CPU
+      t = ready_queue_steal (cpu);
+      return t != NULL ? t : idle_thread;
+    }
+
+  t = list_entry (list_front (&cpu->ready_queues[p]), struct thread, elem);
+  ready_queue_remove (t);
+  return t;
+}
+
+/* Devuelve la CPU en la que se esta ejecutando.  Interrupts must
+   be off, para no migrar entre la consulta y el uso. */
+static struct cpu *
+cpu_current (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return &cpus[0];
+}
+
+/* Saca de la run queue de otra CPU el thread listo de mayor
+   prioridad y lo asigna a SELF.  Devuelve NULL si no hay ninguno.
+   Interrupts must be off. */
+static struct thread *
+ready_queue_steal (struct cpu *self)
+{
+  struct cpu *victim = NULL;
+  struct thread *t;
+  int best = -1;
+  int c;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (c = 0; c < NCPU; c++)
+    {
+      int p;
+
+      if (&cpus[c] == self)
+        continue;
+      p = ready_queue_max_priority (&cpus[c]);
+      if (p > best)
+        {
+          best = p;
+          victim = &cpus[c];
+        }
+    }
+  if (victim == NULL)
+    return NULL;
+
+  // mejor uno frio, pero si todos estan calientes, igual conviene
+  t = ready_queue_pull (victim, self, true);
+  return t != NULL ? t : ready_queue_pull (victim, self, false);
+}
+
+/* Saca de la run queue de VICTIM el thread listo de mayor
+   prioridad que pueda correr en SELF, y que no tenga los datos en
+   la cache de VICTIM si COLD_ONLY, y lo asigna a SELF sin meterlo
+   en su cola.  Los EDF no se mueven, porque su admision se hizo
+   en su CPU.  Devuelve NULL si no hay ninguno.  Interrupts must
+   be off. */
+static struct thread *
+ready_queue_pull (struct cpu *victim, struct cpu *self, bool cold_only)
+{
+  unsigned bit = 1u << (self - cpus);
+  struct thread *found = NULL;
+  int p;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_acquire (&victim->lock);
+  for (p = PRI_MAX; p >= PRI_MIN && found == NULL; p--)
+    {
+      struct list *q = &victim->ready_queues[p];
+      struct list_elem *e;
+
+      if ((victim->ready_bitmap & ((uint64_t) 1 << p)) == 0)
+        continue;
+      for (e = list_begin (q); e != list_end (q); e = list_next (e))
+        {
+          struct thread *t = list_entry (e, struct thread, elem);
+          if ((t->cpu_mask & bit) != 0 && !(cold_only && cache_hot (t)))
+            {
+              found = t;
+              break;
+            }
+        }
+    }
+  if (found != NULL)
+    {
+      list_remove (&found->elem);
+      if (list_empty (&victim->ready_queues[found->priority]))
+        victim->ready_bitmap &= ~((uint64_t) 1 << found->priority);
+      if (!found->worker)
+        victim->ready_count--;
+      found->cpu = self - cpus;
+      migrations++;
+    }
+  spinlock_release (&victim->lock);
+  return found;
+}
+
+/* Devuelve true si T corrio hace menos de CACHE_HOT_US, asi que
+   probablemente sus datos siguen en la cache de su CPU. */
+static bool
+cache_hot (const struct thread *t)
+{
+  uint64_t hot = timer_tsc_hz () / 1000000 * CACHE_HOT_US;
+  return rdtsc () - t->cycles_mark < hot;
+}
+
+/* Trae a SELF un thread de la CPU con mas threads listos, si
+   tiene al menos BALANCE_MIN mas que SELF.  Se llama desde
+   thread_tick() cada BALANCE_TICKS ticks, en el interrupt
+   handler del timer. */
+static void
+load_balance (struct cpu *self)
+{
+  struct cpu *busiest = NULL;
+  size_t max = self->ready_count;
+  struct thread *t;
+  int c;
+
+  for (c = 0; c < NCPU; c++)
+    if (&cpus[c] != self && cpus[c].ready_count > max)
+      {
+        max = cpus[c].ready_count;
+        busiest = &cpus[c];
+      }
+  if (busiest == NULL || max - self->ready_count < BALANCE_MIN)
+    return;
+
+  t = ready_queue_pull (busiest, self, true);
+  if (t != NULL)
+    {
+      ready_queue_push (t);
+      if (ready_preempts (self, thread_current ()) != NULL)
+        intr_yield_on_return ();
+    }
+}
+
+/* Limita T a correr en las CPUs de MASK, un bit por CPU.  Si la
+   CPU en la que esta ya no es de MASK, lo pasa a la primera que
+   si, y si T es el thread actual, cede el CPU para migrar.
+   Devuelve false, sin cambiar nada, si MASK no tiene ninguna CPU
+   que exista. */
+bool
+thread_set_affinity (struct thread *t, unsigned mask)
+{
+  enum intr_level old_level;
+  bool migrate = false;
+
+  ASSERT (is_thread (t));
+
+  mask &= CPU_MASK_ALL;
+  if (mask == 0)
+    return false;
+
+  old_level = intr_disable ();
+  t->cpu_mask = mask;
+  if ((mask & (1u << t->cpu)) == 0)
+    {
+      if (t->status == THREAD_READY)
+        {
+          ready_queue_remove (t);
+          t->cpu = __builtin_ctz (mask);
+          ready_queue_push (t);
+        }
+      else
+        t->cpu = __builtin_ctz (mask);
+      migrations++;
+      migrate = t == thread_current ();
+    }
+  intr_set_level (old_level);
+
+  if (migrate)
+    thread_yield ();
+  return true;
+}
+
+/* Pone a T en la clase batch si BATCH, o lo regresa a la normal
+   si no.  Un thread batch tiene turnos de BATCH_SLICE ticks en
+   lugar de TIME_SLICE, para aprovechar mejor la cache en trabajos
+   largos, pero solo corre cuando no hay ningun thread normal
+   listo en su CPU, y le cede el CPU a cualquiera que despierte.
+   Entre threads batch no hay desalojo: cada uno corre su turno
+   completo y se forma al final de la cola.  Mientras tiene un
+   lock, T compite como un thread normal de su prioridad, para no
+   retrasar a quien lo espera.
+
+   Si T es el thread actual y deja de poder correr, el llamador
+   debe ceder el CPU con thread_preempt(). */
+void
+thread_set_batch (struct thread *t, bool batch)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+
+  old_level = intr_disable ();
+  if (t->status == THREAD_READY)
+    {
+      ready_queue_remove (t);
+      t->batch = batch;
+      ready_queue_push (t);
+    }
+  else
+    t->batch = batch;
+  intr_set_level (old_level);
+}
+
+/* Devuelve true si T corre como thread batch: es de la clase
+   batch y no tiene ningun lock. */
+static bool
+en_clase_batch (const struct thread *t)
+{
+  return t->batch && !t->edf && pheap_empty (&t->holding_lock);
+}
+
+/* Devuelve el turno de T, en ticks. */
+static unsigned
+time_slice (const struct thread *t)
+{
+  return t->batch ? BATCH_SLICE : TIME_SLICE;
+}
+
+/* Devuelve el thread listo en CPU que deberia correr en lugar de
+   CUR, o NULL si CUR puede seguir: un EDF de plazo menor, o si
+   CUR no es EDF, cualquier EDF o uno de mayor prioridad, o si
+   CUR es batch, cualquier thread normal.  Interrupts must be
+   off. */
+static struct thread *
+ready_preempts (struct cpu *cpu, struct thread *cur)
+{
+  int p;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!list_empty (&cpu->edf_queue))
+    {
+      struct thread *t = list_entry (list_front (&cpu->edf_queue),
+                                     struct thread, elem);
+      if (!cur->edf || t->edf_abs_deadline < cur->edf_abs_deadline)
+        return t;
+    }
+  if (cur->edf)
+    return NULL;
+
+  p = ready_queue_max_priority (cpu);
+  if (p > cur->priority || (p >= 0 && en_clase_batch (cur)))
+    return list_entry (list_front (&cpu->ready_queues[p]),
+                       struct thread, elem);
+  return NULL;
+}
+
+/* Orden de la cola EDF: plazo absoluto mas cercano primero. */
+static bool
+plazo_menor (const struct list_elem *a, const struct list_elem *b,
+             void *aux UNUSED)
+{
+  return list_entry (a, struct thread, elem)->edf_abs_deadline
+         < list_entry (b, struct thread, elem)->edf_abs_deadline;
+}
+
+/* Agrega T al final de la cola de su prioridad actual, en la CPU
+   a la que esta asignado, y marca la cola como ocupada en el
+   bitmap.  Interrupts must be off. */
+static void
+ready_queue_push (struct thread *t)
+{
+  struct cpu *cpu = &cpus[t->cpu];
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+  ASSERT ((t->cpu_mask & (1u << t->cpu)) != 0);
+
+  spinlock_acquire (&cpu->lock);
+  if (t->edf)
+    // entre plazos iguales, FIFO
+    list_insert_ordered (&cpu->edf_queue, &t->elem, plazo_menor, NULL);
+  else if (en_clase_batch (t))
+    {
+      list_push_back (&cpu->batch_queue, &t->elem);
+      t->en_cola_batch = true;
+    }
+  else
+    {
+      list_push_back (&cpu->ready_queues[t->priority], &t->elem);
+      cpu->ready_bitmap |= (uint64_t) 1 << t->priority;
+    }
+  if (!t->worker)
+    cpu->ready_count++;
+  spinlock_release (&cpu->lock);
+}
+
+/* Como ready_queue_push(), pero T queda al frente de la cola,
+   para un thread que fue desalojado sin agotar su turno.
+   Interrupts must be off. */
+static void
+ready_queue_push_front (struct thread *t)
+{
+  struct cpu *cpu = &cpus[t->cpu];
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  spinlock_acquire (&cpu->lock);
+  if (t->edf)
+    list_insert_ordered (&cpu->edf_queue, &t->elem, plazo_menor, NULL);
+  else if (en_clase_batch (t))
+    {
+      list_push_front (&cpu->batch_queue, &t->elem);
+      t->en_cola_batch = true;
+    }
+  else
+    {
+      list_push_front (&cpu->ready_queues[t->priority], &t->elem);
+      cpu->ready_bitmap |= (uint64_t) 1 << t->priority;
+    }
+  if (!t->worker)
+    cpu->ready_count++;
+  spinlock_release (&cpu->lock);
+}
+
+/* Quita T de la cola de su prioridad actual, apagando el bit de
+   la cola si queda vacia, o de la cola batch.  Interrupts must be
+   off. */
+static void
+ready_queue_remove (struct thread *t)
+{
+  struct cpu *cpu = &cpus[t->cpu];
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_acquire (&cpu->lock);
+  list_remove (&t->elem);
+  if (t->en_cola_batch)
+    t->en_cola_batch = false;
+  else if (!t->edf && list_empty (&cpu->ready_queues[t->priority]))
+    cpu->ready_bitmap &= ~((uint64_t) 1 << t->priority);
+  if (!t->worker)
+    cpu->ready_count--;
+  spinlock_release (&cpu->lock);
+}
+
+/* Returns the highest priority that has at least one ready
+   thread on CPU, or -1 if every run queue is empty.  Buscamos el
+   bit mas significativo del bitmap con bsr sobre cada mitad de 32
+   bits, para no depender de las rutinas de 64 bits de libgcc. */
+static int
+ready_queue_max_priority (struct cpu *cpu)
+{
+  uint64_t bitmap = cpu->ready_bitmap;
+  uint32_t high = bitmap >> 32;
+  uint32_t low = bitmap;
+
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  else if (low != 0)
+    return 31 - __builtin_clz (low);
+  else
+    return -1;
+}
+
+/* Cambia la prioridad efectiva de T a PRIORITY.  Si T esta en
+   la run queue se mueve solo ese thread a la cola de su nueva
+   prioridad, en lugar de reordenar toda la lista; si esta en los
+   waiters de un semaforo, se reacomoda en ese heap. */
+void
+thread_update_priority (struct thread *t, int priority)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  old_level = intr_disable ();
+  if (t->priority != priority)
+    {
+      int old_priority = t->priority;
+
+      if (t->status == THREAD_READY)
+        {
+          ready_queue_remove (t);
+          t->priority = priority;
+          ready_queue_push (t);
+        }
+      else
+        {
+          t->priority = priority;
+          // si esta bloqueado en un semaforo, reacomodarlo en su heap de waiters
+          if (t->status == THREAD_BLOCKED && t->esperando_sema != NULL)
+            sema_reposition_waiter (t, old_priority);
+        }
+    }
+  intr_set_level (old_level);
+}
+
+/* Completes a thread switch by activating the new thread's page
+   tables, and, if the previous thread is dying, destroying it.
 
    At this function's invocation, we just switched from thread
    PREV, the new thread is already running, and interrupts are
@@ -608,26 +1764,263 @@ thread_schedule_tail (struct thread *prev)
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
 
-  /* Start new time slice. */
-  thread_ticks = 0;
+  /* Start new time slice, unless the previous thread gave us the
+     rest of its own with thread_yield_to(). */
+  if (slice_donated)
+    slice_donated = false;
+  else
+    thread_ticks = 0;
+  cur->cycles_mark = slice_start = rdtsc ();
+
+  /* Cuanto espero desde que lo desbloquearon. */
+  if (cur->ready_mark != 0)
+    {
+      uint64_t latency = slice_start - cur->ready_mark;
+      histogram_add (&wakeup_hist[cur->priority], latency);
+      histogram_add (&wakeup_total, latency);
+      cur->ready_mark = 0;
+    }
 
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
 #endif
 
+  /* A context switch ends every RCU reader on this CPU. */
+  rcu_quiescent ();
+
   /* If the thread we switched from is dying, destroy its struct
      thread.  This must happen late so that thread_exit() doesn't
-     pull out the rug under itself.  (We don't free
-     initial_thread because its memory was not obtained via
-     palloc().) */
+     pull out the rug under itself, and only after a grace period,
+     since a thread_foreach() may still be looking at it.  (We
+     don't free initial_thread because its memory was not
+     obtained from the thread caches.) */
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      rcu_call (&prev->rcu, thread_free_rcu);
+    }
+}
+
+/* Devuelve STACK_SIZE redondeado al tamano de pila que se le da
+   de verdad: una pila chica, una pagina o varias paginas. */
+static size_t
+stack_round (size_t size)
+{
+  if (size <= THREAD_STACK_SMALL)
+    return THREAD_STACK_SMALL;
+  return ROUND_UP (size, PGSIZE);
+}
+
+/* Devuelve el numero de stack_cnt[] que cuenta las pilas de SIZE
+   bytes, ya redondeado por stack_round(). */
+static int
+stack_class (size_t size)
+{
+  return size == THREAD_STACK_SMALL ? 0 : size == PGSIZE ? 1 : 2;
+}
+
+/* Reserva una pila de SIZE bytes, ya redondeado por stack_round().
+   Returns a null pointer if no memory is available. */
+static uint8_t *
+stack_alloc (size_t size)
+{
+  enum intr_level old_level;
+  uint8_t *stack;
+
+  if (size == THREAD_STACK_SMALL)
+    stack = kmem_cache_alloc (stack_cache);
+  else if (size == PGSIZE)
+    stack = thread_page_get ();
+  else
+    stack = stack_area_alloc (size);
+  if (stack != NULL)
+    {
+      old_level = intr_disable ();
+      stack_cnt[stack_class (size)]++;
+      intr_set_level (old_level);
+    }
+  return stack;
+}
+
+/* Libera STACK, una pila de SIZE bytes de stack_alloc(). */
+static void
+stack_free (uint8_t *stack, size_t size)
+{
+  enum intr_level old_level = intr_disable ();
+  stack_cnt[stack_class (size)]--;
+  intr_set_level (old_level);
+
+  if (size == THREAD_STACK_SMALL)
+    kmem_cache_free (stack_cache, stack);
+  else if (size == PGSIZE)
+    thread_page_put (stack);
+  else
+    stack_area_free (stack, size);
+}
+
+/* Reserva una ranura del area de pilas y mapea al final de ella
+   una pila de SIZE bytes, un multiplo de PGSIZE.  Returns a null
+   pointer if no slot or no memory is available. */
+static uint8_t *
+stack_area_alloc (size_t size)
+{
+  enum intr_level old_level;
+  size_t pages = size / PGSIZE;
+  size_t slot, i;
+  uint8_t *stack;
+
+  ASSERT (pages < STACK_SLOT_PAGES);
+
+  old_level = intr_disable ();
+  for (slot = 0; slot < STACK_SLOT_CNT; slot++)
+    if (!stack_slot_used[slot])
+      {
+        stack_slot_used[slot] = true;
+        break;
+      }
+  intr_set_level (old_level);
+  if (slot == STACK_SLOT_CNT)
+    return NULL;
+
+  stack = ((uint8_t *) STACK_AREA
+           + ((slot + 1) * STACK_SLOT_PAGES - pages) * PGSIZE);
+  for (i = 0; i < pages; i++)
+    {
+      void *kpage = palloc_get_page_tagged (0, MEM_THREAD);
+      if (kpage == NULL)
+        {
+          stack_area_free (stack, i * PGSIZE);
+          return NULL;
+        }
+      stack_area_pt[pt_no (stack + i * PGSIZE)]
+        = pte_create_kernel (kpage, true);
+    }
+  return stack;
+}
+
+/* Desmapea y libera STACK, los primeros SIZE bytes de una pila de
+   stack_area_alloc(), y libera su ranura. */
+static void
+stack_area_free (uint8_t *stack, size_t size)
+{
+  enum intr_level old_level;
+  size_t slot = ((uintptr_t) stack - STACK_AREA) / STACK_SLOT_PAGES / PGSIZE;
+  uint8_t *page;
+
+  for (page = stack; page < stack + size; page += PGSIZE)
+    {
+      uint32_t *pte = &stack_area_pt[pt_no (page)];
+
+      palloc_free_page (pte_get_page (*pte));
+      *pte = 0;
+      asm volatile ("invlpg (%0)" : : "r" (page) : "memory");
+    }
+
+  old_level = intr_disable ();
+  stack_slot_used[slot] = false;
+  intr_set_level (old_level);
+}
+
+/* Returns true if ADDR is in the guard pages of one of the
+   large kernel stacks, which only a stack overflow touches. */
+bool
+thread_stack_guard (const void *addr)
+{
+  uintptr_t a = (uintptr_t) addr;
+
+  return (stack_area_pt != NULL
+          && a >= STACK_AREA && a - STACK_AREA < PTSPAN
+          && (stack_area_pt[pt_no (addr)] & PTE_P) == 0);
+}
+
+/* Devuelve una pagina para la pila de un thread nuevo, del cache
+   si hay una disponible y si no de palloc.  Returns a null
+   pointer if no page is available. */
+static void *
+thread_page_get (void)
+{
+  enum intr_level old_level;
+  void *page = NULL;
+
+  old_level = intr_disable ();
+  if (page_cache_cnt > 0)
+    {
+      page = page_cache[--page_cache_cnt];
+      page_cache_hits++;
+    }
+  else
+    page_cache_misses++;
+  intr_set_level (old_level);
+
+  if (page == NULL)
+    page = palloc_get_page_tagged (0, MEM_THREAD);
+  return page;
+}
+
+/* Deja en dead_list el thread muerto cuyo `rcu' es HEAD, una vez
+   que ningun lector de all_list puede tenerlo, para que
+   thread_reap() lo libere.  Interrupts must be off. */
+static void
+thread_free_rcu (struct rcu_head *head)
+{
+  list_push_back (&dead_list,
+                  &rcu_entry (head, struct thread, rcu)->allelem);
+}
+
+/* Libera la pila y el `struct thread' de cada thread de
+   dead_list. */
+static void
+thread_reap (void)
+{
+  for (;;)
+    {
+      enum intr_level old_level = intr_disable ();
+      struct thread *t = NULL;
+
+      if (!list_empty (&dead_list))
+        t = list_entry (list_pop_front (&dead_list), struct thread, allelem);
+      intr_set_level (old_level);
+      if (t == NULL)
+        break;
+
+      stack_free (t->kstack, t->kstack_size);
+      t->magic = 0;
+      kmem_cache_free (thread_cache, t);
     }
 }
 
+/* Si el thread actual CUR esta en una seccion de lectura de RCU,
+   anota que debe ceder el CPU al salir de ella, en
+   rcu_read_unlock(), y devuelve true.  Interrupts must be off. */
+static bool
+defer_for_rcu (struct thread *cur)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (cur->rcu_nesting == 0)
+    return false;
+  cur->rcu_yield = true;
+  return true;
+}
+
+/* Guarda PAGE, la pila de un thread muerto, en el cache, o la
+   devuelve a palloc si el cache esta lleno. */
+static void
+thread_page_put (void *page)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (page_cache_cnt < THREAD_PAGE_CACHE)
+    {
+      page_cache[page_cache_cnt++] = page;
+      page = NULL;
+    }
+  intr_set_level (old_level);
+  if (page != NULL)
+    palloc_free_page (page);
+}
+
 /* Schedules a new process.  At entry, interrupts must be off and
    the running process's state must have been changed from
    running to some other state.  This function finds another
@@ -637,56 +2030,103 @@ thread_schedule_tail (struct thread *prev)
    has completed. */
 static void
 schedule (void) 
+{
+  schedule_to (next_thread_to_run ());
+}
+
+/* Switches from the running thread to NEXT, which has already
+   been taken off the run queue.  Same requirements as
+   schedule(). */
+static void
+schedule_to (struct thread *next) 
 {
   struct thread *cur = running_thread ();
-  struct thread *next = next_thread_to_run ();
   struct thread *prev = NULL;
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
+  ASSERT (cur->rcu_nesting == 0);
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      if (cur != idle_thread)
+        {
+          uint64_t ran = rdtsc () - slice_start;
+          histogram_add (&slice_hist[cur->priority], ran);
+          histogram_add (&slice_total, ran);
+          slices_total++;
+          if (thread_ticks >= time_slice (cur))
+            slices_expired++;
+        }
+      thread_account_cycles (false);
+      pmu_switch (cur);
+      TRACE (TRACE_SWITCH, next->tid);
+      cpu_current ()->running = next;
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
-/* Returns a tid to use for a new thread. */
+/* Returns a tid to use for new thread T and records T under it
+   in tid_table, or TID_ERROR if every tid is in use.
+
+   Candidates come from a counter advanced with lock xadd, so
+   tids are handed out in order and a freed one is not reused
+   until the counter wraps around to it.  No lock is taken. */
 static tid_t
-allocate_tid (void) 
+allocate_tid (struct thread *t) 
 {
-  static tid_t next_tid = 1;
-  tid_t tid;
+  static unsigned next_tid;
+  int tries;
 
-  lock_acquire (&tid_lock);
-  tid = next_tid++;
-  lock_release (&tid_lock);
+  for (tries = 0; tries < TID_MAX - 1; tries++)
+    {
+      tid_t tid = __sync_fetch_and_add (&next_tid, 1) % (TID_MAX - 1) + 1;
+      if (__sync_bool_compare_and_swap (&tid_table[tid], NULL, t))
+        return tid;
+    }
+  return TID_ERROR;
+}
 
-  return tid;
+/* Returns the live thread whose tid is TID, or a null pointer
+   if there is none.  Takes constant time.  Interrupts should be
+   off, or the thread may exit while the caller uses it. */
+struct thread *
+thread_lookup (tid_t tid)
+{
+  struct thread *t;
+
+  if (tid <= 0 || tid >= TID_MAX)
+    return NULL;
+  t = tid_table[tid];
+  return t != NULL && is_thread (t) && t->tid == tid ? t : NULL;
 }
 
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
 uint32_t thread_stack_ofs = offsetof (struct thread, stack);
 
-
-void insertar_en_lista_espera(int64_t ticks){
+/* Duerme al thread actual hasta que timer_ticks() llegue a HASTA. */
+void insertar_en_lista_espera(int64_t hasta){
 
 	//Deshabilitamos interrupciones
 	enum intr_level old_level;
 	old_level = intr_disable ();
 
-	/* Remover el thread actual de "ready_list" e insertarlo en "lista_espera"
-	Cambiar su estatus a THREAD_BLOCKED, y definir su tiempo de expiracion */
+	/* Cambiar el estatus del thread actual a THREAD_BLOCKED, definir su tiempo
+	de expiracion y programar un evento en el timer wheel que lo despierte */
 	
 	struct thread *thread_actual = thread_current ();
   if(thread_actual != idle_thread){
-    thread_actual->TIEMPO_DORMIDO = timer_ticks() + ticks;
+    thread_actual->TIEMPO_DORMIDO = hasta;
   
     /*Donde TIEMPO_DORMIDO es el atributo de la estructura thread que usted
 	  definió como paso inicial*/
 	
-    list_push_back(&lista_espera, &thread_actual->elem);
+    // con holgura, el timer wheel lo despierta junto con los que expiran cerca
+    timer_add_slack(&thread_actual->sleep_event, thread_actual->TIEMPO_DORMIDO,
+                    thread_actual->timer_slack, despertar_thread, thread_actual);
     thread_block();
   }
   
@@ -694,67 +2134,31 @@ void insertar_en_lista_espera(int64_t ticks){
 	intr_set_level (old_level);
 }
 
-void remover_thread_durmiente(int64_t ticks){
-
-	/*Cuando ocurra un timer_interrupt, si el tiempo del thread ha expirado
-	Se mueve de regreso a ready_list, con la funcion thread_unblock*/
-	
-	//Iterar sobre "lista_espera"
-	struct list_elem *iter = list_begin(&lista_espera);
-	while(iter != list_end(&lista_espera) ){
-		struct thread *thread_lista_espera= list_entry(iter, struct thread, elem);
-		
-		/*Si el tiempo global es mayor al tiempo que el thread permanecía dormido
-		  entonces su tiempo de dormir ha expirado*/
-		
-		if(ticks >= thread_lista_espera->TIEMPO_DORMIDO){
-			//Lo removemos de "lista_espera" y lo regresamos a ready_list
-			iter = list_remove(iter);
-			thread_unblock(thread_lista_espera);
-		}else{
-			//Sino, seguir iterando
-			iter = list_next(iter);
-		}
-	}
-  
-}
-
-static bool ordenarMayorMenor(const struct list_elem *a,
-                             const struct list_elem *b,
-                             void *aux){
-    // Verificar que sea un elemento valido de la lista
-    ASSERT(a!=NULL);
-    ASSERT(b!=NULL);
-    //Recueperar los thread del elemento de la lista
-    struct thread *thread_a = list_entry(a, struct thread, elem);
-    struct thread *thread_b = list_entry(b, struct thread, elem);
-    //Comparar la prioridad si a > b entonces true
-    if(thread_a->priority > thread_b->priority){
-      return true;
-    } else {
-      return false;
-    }
+/* Callback del timer wheel: cuando ocurre el timer_interrupt en el que
+   expira el tiempo del thread, se regresa a la run queue con thread_unblock. */
+static void
+despertar_thread (void *t_)
+{
+  struct thread *t = t_;
+  thread_unblock (t);
 }
 
 void verificar(struct thread *t, int p){
 
-  struct thread* siguienteAEjecutar;
+  enum intr_level old_level;
+  int max_ready;
 
   if(t==thread_current()){
-    if(!list_empty(&ready_list)){
-      //el siguiente a ejecutar sera el que este en el principio de la ready_list
-      siguienteAEjecutar = list_entry(list_begin(&ready_list), struct thread, elem);
-
-      //verificamos que la prioridad sea mayor que la nueva prioridad
-
-      /* Un thread podrá incrementar o reducir su propia prioridad en cualquier momento,
-      pero si la reduce, de manera que no sea el thread de más alta prioridad, causará 
-      que ceda inmediatamente el procesador.*/
-      if(siguienteAEjecutar != NULL){
-        if ( siguienteAEjecutar->priority > p) {
-          thread_yield();
-        }
-      }
+    //el siguiente a ejecutar sera el primero de la cola mas alta ocupada
+    old_level = intr_disable ();
+    max_ready = ready_queue_max_priority (cpu_current ());
+    intr_set_level (old_level);
+
+    /* Un thread podrá incrementar o reducir su propia prioridad en cualquier momento,
+    pero si la reduce, de manera que no sea el thread de más alta prioridad, causará 
+    que ceda inmediatamente el procesador.*/
+    if (max_ready > p) {
+      thread_yield();
     }
   }
   
@@ -764,48 +2168,68 @@ void actualizar_current_recent_cpu(){
   /*
     Add x and n:	x + n * f
   */    
-  if (thread_current () != idle_thread){
-    thread_current()->recent_cpu = ADD_X_N(thread_current()->recent_cpu,1);
+  struct thread *t = thread_current ();
+  if (!mlfqs_exento (t)){
+    t->recent_cpu = ADD_X_N(t->recent_cpu,1);
+    // anotar el thread para recalcular su prioridad en el siguiente cuarto tick
+    if (!t->recent_cpu_dirty){
+      t->recent_cpu_dirty = true;
+      list_push_back (&dirty_list, &t->dirty_elem);
+    }
   }  
-};
+}
 
 void actualizar_load_avg(){
 
   /* load_avg = (59/60)*load_avg + (1/60)*ready_threads */
 
-  int ready_threads = list_size(&ready_list);
-  if(thread_current() != idle_thread){
-    ready_threads = ready_threads + 1;
+  int ready_threads = 0;
+  int c;
+
+  // la de cada CPU cuenta sus threads listos mas el que corre en ella
+  for (c = 0; c < NCPU; c++){
+    struct cpu *cpu = &cpus[c];
+    int n = cpu->ready_count;
+    if (cpu->running != NULL && !mlfqs_exento (cpu->running)){
+      n++;
+    }
+    cpu->load_avg = DIV_X_N(ADD_X_N(MUL_X_N(cpu->load_avg,59),n),60);
+    ready_threads += n;
   }
 
   /*
     Multiply x by n:	x * n
     Add x and n:	x + n * f
     Divide x by n:	x / n
+    Todo en 32 bits, load_avg * 59 no se desborda con miles de threads.
   */
   load_avg = DIV_X_N(ADD_X_N(MUL_X_N(load_avg,59),ready_threads),60);
+
+  /* coef = (2*load_avg)/(2*load_avg + 1) en punto fijo, que es igual a
+     f - f*f/(2*load_avg + f); f*f cabe en 32 bits, asi que no se
+     necesita la division de 64 bits de DIV_X_Y */
+  recent_cpu_coef = CONV_N(1)
+                    - (int) ((unsigned) CONV_N(CONV_N(1))
+                             / (unsigned) ADD_X_N(MUL_X_N(load_avg,2),1));
 }
 
-void actualizar_thread_recent_cpu(struct thread *t, void *aux){
-  if(t != idle_thread) {
-    /* recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice */
-    int64_t recent_cpu = t->recent_cpu;
-    int nice = t->nice;
+void actualizar_thread_recent_cpu(struct thread *t, void *aux UNUSED){
+  if(!mlfqs_exento (t)) {
+    /* recent_cpu = coef * recent_cpu + nice, coef precalculado por segundo */
     /*
-      Multiply x by n:	x * n
-      Add x and n:	x + n * f
-      Divide x by y:	((int64_t) x) * f / y
       Multiply x by y:	((int64_t) x) * y / f
       Add x and n:	x + n * f
     */
-    t->recent_cpu = ADD_X_N(MUL_X_Y(DIV_X_Y(MUL_X_N(load_avg,2),ADD_X_N(MUL_X_N(load_avg,2),1)),recent_cpu),nice);
+    t->recent_cpu = ADD_X_N(MUL_X_Y(recent_cpu_coef,t->recent_cpu),t->nice);
+    // recent_cpu cambio para todos, recalcular su prioridad en la misma pasada
+    actualizar_thread_priority(t, NULL);
   }
 }
 
-void actualizar_thread_priority(struct thread *t, void *aux){
-  if(t != idle_thread) {
+void actualizar_thread_priority(struct thread *t, void *aux UNUSED){
+  if(!mlfqs_exento (t)) {
     /* priority = PRI_MAX - (recent_cpu / 4) - (nice * 2). */
-    int64_t recent_cpu = t->recent_cpu;
+    int recent_cpu = t->recent_cpu;
     int nice = t->nice;
     /*
       Convert n to fixed point:	n * f
@@ -818,11 +2242,25 @@ void actualizar_thread_priority(struct thread *t, void *aux){
     int priority = ROUND_X(SUB_X_Y(CONV_N(PRI_MAX),ADD_X_N(DIV_X_N(recent_cpu,4),(nice*2))));
     if(priority > PRI_MAX) priority = PRI_MAX;
     if(priority < PRI_MIN) priority = PRI_MIN;
-    t->priority = priority;
+    // si cambio de cola y esta en la run queue, se mueve solo este thread
+    thread_update_priority(t, priority);
+
+    if (t->recent_cpu_dirty){
+      t->recent_cpu_dirty = false;
+      list_remove (&t->dirty_elem);
+    }
   }
 }
 
-void ordernar_ready_list ()
-{
-  list_sort(&ready_list, ordenarMayorMenor, NULL);
-}
\ No newline at end of file
+/* Cada cuarto tick (que no sea multiplo de segundo) solo cambio el
+   recent_cpu de los threads que corrieron; se recalcula la prioridad
+   unicamente de esos.  Interrupts must be off. */
+void actualizar_prioridades_sucias(void){
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&dirty_list)){
+    struct thread *t = list_entry (list_front (&dirty_list),
+                                   struct thread, dirty_elem);
+    actualizar_thread_priority (t, NULL);
+  }
+}
@@ -3,7 +3,19 @@
 
 #include <debug.h>
 #include <list.h>
+#include <pheap.h>
 #include <stdint.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/pmu.h"
+#include "threads/rcu.h"
+#ifdef USERPROG
+#include "threads/poll.h"
+#include "threads/synch.h"
+#endif
+#ifdef VM
+#include <hash.h>
+#endif
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -18,12 +30,28 @@ enum thread_status
    You can redefine this to whatever type you like. */
 typedef int tid_t;
 #define TID_ERROR ((tid_t) -1)          /* Error value for tid_t. */
+#define TID_MAX 4096                    /* Tids are between 1 and TID_MAX - 1. */
+
+#ifdef USERPROG
+/* Campos de struct rusage de lib/user/syscall.h, todos unsigned. */
+#define USO_CAMPOS 13
+#endif
 
 /* Thread priorities. */
 #define PRI_MIN 0                       /* Lowest priority. */
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Nice values, for the MLFQS scheduler. */
+#define NICE_MIN -20                    /* Friendliest to others. */
+#define NICE_MAX 20                     /* Least friendly. */
+
+/* Number of CPUs with their own run queue. */
+#define NCPU 1
+
+/* Affinity mask that allows every CPU, one bit per CPU. */
+#define CPU_MASK_ALL ((1u << NCPU) - 1)
+
 #define CORRIMIENTO 12
 #define ADD_X_N(X,N) ((X) + (N<<CORRIMIENTO))          // Add x and n:	x + n * f  
 #define MUL_X_N(X,N) ((X) * N)                         // Multiply x by n:	x * n
@@ -35,62 +63,50 @@ typedef int tid_t;
                            /*  (x + f / 2) / f if x >= 0, (x - f / 2) / f if x <= 0 */
 #define ROUND_X(X) ((X)>=0 ? (((X)+(1<<(CORRIMIENTO-1)))>>CORRIMIENTO): (((X)-(1<<(CORRIMIENTO-1)))>>CORRIMIENTO) )  
 
+/* Kernel stack sizes for thread_create_sized().  A small stack
+   is half a page, less room for the slab header, and suits
+   threads that do little more than wait and hand work on; a
+   stack bigger than a page gets a guard page below it. */
+#define THREAD_STACK_SMALL 1984         /* Two to a page. */
+#define THREAD_STACK_DEFAULT 4096       /* One page. */
+#define THREAD_STACK_LARGE 16384        /* For deep file system paths. */
+#define THREAD_STACK_MAX 28672          /* Largest stack available. */
+
 /* A kernel thread or user process.
 
-   Each thread structure is stored in its own 4 kB page.  The
-   thread structure itself sits at the very bottom of the page
-   (at offset 0).  The rest of the page is reserved for the
-   thread's kernel stack, which grows downward from the top of
-   the page (at offset 4 kB).  Here's an illustration:
-
-        4 kB +---------------------------------+
-             |          kernel stack           |
-             |                |                |
-             |                |                |
-             |                V                |
-             |         grows downward          |
-             |                                 |
-             |                                 |
-             |                                 |
-             |                                 |
-             |                                 |
-             |                                 |
-             |                                 |
-             |                                 |
-             +---------------------------------+
-             |              magic              |
-             |                :                |
-             |                :                |
-             |               name              |
-             |              status             |
-        0 kB +---------------------------------+
-
-   The upshot of this is twofold:
-
-      1. First, `struct thread' must not be allowed to grow too
-         big.  If it does, then there will not be enough room for
-         the kernel stack.  Our base `struct thread' is only a
-         few bytes in size.  It probably should stay well under 1
-         kB.
-
-      2. Second, kernel stacks must not be allowed to grow too
-         large.  If a stack overflows, it will corrupt the thread
-         state.  Thus, kernel functions should not allocate large
-         structures or arrays as non-static local variables.  Use
-         dynamic allocation with malloc() or palloc_get_page()
-         instead.
-
-   The first symptom of either of these problems will probably be
-   an assertion failure in thread_current(), which checks that
-   the `magic' member of the running thread's `struct thread' is
-   set to THREAD_MAGIC.  Stack overflow will normally change this
-   value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   Each thread structure comes from a slab cache of its own, and
+   the thread's kernel stack is allocated separately, in one of
+   the sizes above.  The stack grows downward from its top,
+   kstack + kstack_size, toward kstack:
+
+        kstack + kstack_size +-------------------------+
+                             |      kernel stack       |
+                             |            |            |
+                             |            V            |
+                             |     grows downward      |
+                             |                         |
+                             |                         |
+                             |          canary         |
+                      kstack +-------------------------+
+                             |  guard page, if large   |
+                             +-------------------------+
+
+   Kernel stacks must not be allowed to grow too large.  A stack
+   that overflows runs into whatever lies below it, so kernel
+   functions should not allocate large structures or arrays as
+   non-static local variables.  Use dynamic allocation with
+   malloc() or palloc_get_page() instead, or give a thread that
+   needs a deep stack a large one.
+
+   The lowest word of each stack holds a canary that
+   thread_current() checks, along with the `magic' member of the
+   running thread's `struct thread', so the first symptom of an
+   overflow will probably be an assertion failure there.  An
+   overflow of a large stack faults in its guard page at once. */
+/* The `elem' member is an element in the run queue (thread.c).
+   A thread blocked on a semaphore is instead in the semaphore's
+   waiter heap through `wait_elem' (synch.c), so that its
+   position can be fixed up when its priority changes. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -98,29 +114,114 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
+    uint8_t *kstack;                    /* Bottom of the kernel stack. */
+    size_t kstack_size;                 /* Bytes in the kernel stack. */
     int priority;                       /* Priority. */
     int priorityOriginal;                // Prioridad Original, para Priority Donation
     struct list_elem allelem;           /* List element for all threads list. */
+    int rcu_nesting;                    /* Depth of rcu_read_lock() calls. */
+    bool rcu_yield;                     /* Preemption deferred by RCU reader. */
+    struct rcu_head rcu;                /* Frees the thread after it dies. */
 
     /* Shared between thread.c and synch.c. */
-    struct list_elem elem;              /* List element. */
+    struct list_elem elem;              /* Run queue element. */
+    int cpu;                            /* CPU whose run queue holds it. */
+    unsigned cpu_mask;                  /* CPUs it may run on, one bit each. */
 
+    /* Tiempo de CPU medido con el TSC, en ciclos. */
+    uint64_t kernel_cycles;             /* Ciclos en modo kernel. */
+    uint64_t user_cycles;               /* Ciclos en modo usuario. */
+    uint64_t cycles_mark;               /* TSC de la ultima vez que se cobro. */
+    uint64_t ready_mark;                /* TSC del thread_unblock(), o 0. */
+    uint64_t pmu_counts[PMU_COUNTERS];  /* Eventos contados, ver pmu.h. */
+    bool worker;                        /* Worker de workqueue, sin MLFQS. */
+    struct malloc_magazine magazines[MALLOC_CLASSES]; /* Cache de malloc(). */
+    struct pheap_elem wait_elem;        /* Semaphore waiters element. */
+    unsigned wait_seq;                  /* FIFO order among equal waiters. */
+    struct semaphore *esperando_sema;   // semaforo en el que esta bloqueado, o NULL
 
-   uint64_t TIEMPO_DORMIDO;   //entero que represente el tiempo que un thread debe permanecer dormido
+
+   int64_t TIEMPO_DORMIDO;    //entero que represente el tiempo que un thread debe permanecer dormido
+   struct timer_event sleep_event;    // evento del timer wheel que despierta al thread
+   int64_t timer_slack;               // ticks que se puede retrasar su despertar, para juntarlo con otros
    struct lock *waiting_for_lock;     // El lock por el cual espera este thread
-   struct list holding_lock;          // Los bloqueos que tiene este thread 
+   struct pheap holding_lock;         // Los bloqueos que tiene este thread, max-heap por prioridad del lock
    
-   int64_t recent_cpu;                // Para advanced scheduller
+   int recent_cpu;                    // Para advanced scheduller, punto fijo 20.12
    int nice;                          // Para advanced scheduller
+   bool recent_cpu_dirty;             // recent_cpu cambio desde el ultimo recalculo
+   struct list_elem dirty_elem;       // elemento en la lista de threads por recalcular
+
+   /* Clase de tiempo real EDF, ver thread_create_edf().  Todo en ticks. */
+   bool edf;                          // el thread es de la clase EDF
+   int64_t edf_runtime;               // presupuesto de CPU por periodo
+   int64_t edf_period;                // periodo
+   int64_t edf_deadline;              // plazo, relativo al inicio del periodo
+   int64_t edf_release;               // inicio del periodo actual
+   int64_t edf_abs_deadline;          // plazo absoluto del periodo actual
+   int64_t edf_budget;                // presupuesto que le queda en el periodo
+   int edf_util;                      // utilizacion reservada, en milesimas
+   bool edf_throttled;                // agoto el presupuesto, espera al siguiente periodo
+   unsigned edf_misses;               // trabajos que terminaron despues de su plazo
+   struct timer_event edf_event;      // evento que inicia el siguiente periodo
+
+   /* Clase batch, ver thread_set_batch(). */
+   bool batch;                        // el thread es de la clase batch
+   bool en_cola_batch;                // esta en la cola batch de su CPU y no en la de su prioridad
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
     /*Cada proceso tiene un conjunto independiente de descriptores de archivo.*/
-    struct list descriptores;
+    struct descriptor **descriptores;  // indexada por fd, NULL si el fd esta libre
+    size_t descriptores_cnt;           // entradas de la tabla, que crece al doble cuando se llena
+    struct bitmap *fds_usados;         // fds ocupados, para dar siempre el menor libre
+    struct lock lock_descriptores;     // protege descriptores, directorio y el heap entre los hilos del proceso
+    struct dir *directorio;            // directorio de trabajo, NULL es la raiz
     struct process_control_block *pcb;
-    struct list procesos;
+    struct list procesos;              // pcbs de los hijos
+    struct list terminados;            // hijos que ya terminaron y nadie espera, en ese orden
+    struct condition hijo_termino;     // con el lock de los hijos de process.c
+    struct poll_queue hijos_poll;      // se despierta junto con hijo_termino, para poll
     struct file *ejecutable;           //El archivo ejecutable de asociado
+    uint8_t *heap_inicio;              // el heap empieza justo despues del programa
+    uint8_t *heap_fin;                 // break actual de sbrk, entre heap_inicio y heap_limite
+    struct thread *proceso;            // thread principal del proceso, el mismo si es el principal
+    struct hilo *hilo;                 // registro de thread_spawn, NULL en el principal
+    void *esp_usuario;                 // esp de usuario al entrar a la ultima llamada al sistema
+    /* Uso de recursos del proceso, solo en el thread principal, en el
+       orden de struct rusage de lib/user/syscall.h. */
+    unsigned fallas_menores;           // fallas resueltas sin leer de disco
+    unsigned fallas_mayores;           // fallas que leyeron el archivo o el swap
+    unsigned fallas_cow;               // escrituras que copiaron una pagina de fork
+    unsigned fallas_pila;              // fallas que hicieron crecer la pila
+    unsigned desalojos;                // paginas desalojadas para darle marcos
+    unsigned marcos;                   // marcos que tiene ahora
+    unsigned marcos_pico;              // la mayor cantidad que tuvo a la vez
+    unsigned ticks_usuario;            // ticks del timer que lo encontraron en modo usuario
+    unsigned ticks_kernel;             // ticks en el kernel, en sus llamadas y fallas
+    unsigned llamadas;                 // llamadas al sistema que hizo
+    unsigned sectores_leidos;          // sectores que pidio leer del disco
+    unsigned sectores_escritos;        // sectores que pidio escribir al disco
+    unsigned paginas_grandes;          // regiones de 4 MB que mapeo con una pagina grande
+    unsigned uso_hijos[USO_CAMPOS];    // uso sumado de los hijos que ya recogio
+#endif
+
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal_begin(). */
+#endif
+
+#ifdef VM
+    /* Owned by vm/page.c.  Only used in a process's main thread. */
+    struct hash pages;                  /* Supplemental page table. */
+    struct lock pages_lock;             /* Protects PAGES, MAPPINGS and SHMS. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Id for the next mapping. */
+    struct list shms;                   /* Open shared memory segments. */
+    int next_shmid;                     /* Id for the next segment handle. */
+    void *fault_next;                   /* Page a sequential scan faults on next. */
+    unsigned fault_window;              /* Pages to map around that fault. */
 #endif
 
     /* Owned by thread.c. */
@@ -135,21 +236,40 @@ extern bool thread_mlfqs;
 void thread_init (void);
 void thread_start (void);
 
-void thread_tick (void);
+void thread_tick (bool user);
+void thread_account_idle_ticks (int64_t);
+void thread_account_cycles (bool user);
+void thread_set_worker (void);
 void thread_print_stats (void);
+struct histogram;
+bool thread_get_latency (int priority, struct histogram *wakeup,
+                         struct histogram *slice);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
+tid_t thread_create_sized (const char *name, int priority, size_t stack_size,
+                           thread_func *, void *);
+tid_t thread_create_edf (const char *name, int64_t runtime, int64_t period,
+                         int64_t deadline, thread_func *, void *);
+void thread_edf_wait (void);
+unsigned thread_edf_misses (void);
 
 void thread_block (void);
 void thread_unblock (struct thread *);
 
 struct thread *thread_current (void);
+struct thread *running_thread (void);
+bool thread_stack_guard (const void *);
+struct thread *thread_lookup (tid_t);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_handoff (struct thread *);
+bool thread_yield_to (struct thread *);
+void thread_cond_resched (void);
+void thread_preempt (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -157,26 +277,26 @@ void thread_foreach (thread_action_func *, void *); // Esta funcion aplica threa
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_set_priority_of (struct thread *, int);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
+void thread_set_nice_of (struct thread *, int);
 int thread_get_recent_cpu (void);
 int thread_get_load_avg (void);
+int thread_get_cpu_load_avg (int cpu);
 
-void insertar_en_lista_espera(int64_t ticks);
-void remover_thread_durmiente(int64_t ticks);
+bool thread_set_affinity (struct thread *, unsigned mask);
+void thread_set_batch (struct thread *, bool batch);
 
-/* Funcion auxiliar para ordenar la lista, comparara si la prioridad del thread 
-a es mayor a la de b, mayor prioridad en head */
-static bool ordenarMayorMenor(const struct list_elem *a,
-                             const struct list_elem *b,
-                             void *aux);
+void insertar_en_lista_espera(int64_t hasta);
 
+void thread_update_priority (struct thread *, int priority);
 void verificar(struct thread *t, int p);
 
 void actualizar_current_recent_cpu();
 void actualizar_load_avg();
 void actualizar_thread_recent_cpu(struct thread *t, void *aux);
 void actualizar_thread_priority(struct thread *t, void *aux);
-void ordernar_ready_list();
+void actualizar_prioridades_sucias(void);
 #endif /* threads/thread.h */
@@ -0,0 +1,132 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/thread.h"
+#include "threads/tsc.h"
+
+/* If true, tracepoints record events.  Set by -trace. */
+bool trace_enabled;
+
+/* A per-CPU trace ring.  HEAD counts every record ever reserved,
+   so HEAD % TRACE_RING_SIZE is the next slot to write. */
+struct trace_ring
+  {
+    uint32_t head;
+    struct trace_record records[TRACE_RING_SIZE];
+  };
+
+static struct trace_ring rings[NCPU];
+
+/* Returns the tid of the running thread.  This uses
+   running_thread(), which is also right inside an interrupt
+   handler and in the middle of schedule(), where
+   thread_current() would assert, and returns 0 before
+   thread_init(). */
+static tid_t
+trace_tid (void)
+{
+  struct thread *t = running_thread ();
+
+  return t != NULL ? t->tid : 0;
+}
+
+/* Appends EVENT with argument ARG to the current CPU's ring.
+   Only the boot CPU runs for now, so that is always rings[0]. */
+void
+trace_record (enum trace_event event, uint32_t arg)
+{
+  struct trace_ring *ring = &rings[0];
+  uint32_t slot = __sync_fetch_and_add (&ring->head, 1);
+  struct trace_record *r = &ring->records[slot % TRACE_RING_SIZE];
+
+  r->tsc = rdtsc ();
+  r->arg = arg;
+  r->tid = trace_tid ();
+  r->event = event;
+  r->cpu = ring - rings;
+}
+
+/* Returns the number of valid records in RING. */
+static size_t
+ring_cnt (const struct trace_ring *ring)
+{
+  return ring->head < TRACE_RING_SIZE ? ring->head : TRACE_RING_SIZE;
+}
+
+/* Returns the number of bytes trace_dump() needs. */
+size_t
+trace_dump_size (void)
+{
+  size_t cnt = 0;
+  int i;
+
+  for (i = 0; i < NCPU; i++)
+    cnt += ring_cnt (&rings[i]);
+  return sizeof (struct trace_header) + cnt * sizeof (struct trace_record);
+}
+
+/* Writes a header and every ring's records, oldest first within
+   each CPU, into the SIZE bytes at BUFFER.  Returns the number of
+   bytes written, which is less than trace_dump_size() only if
+   SIZE is too small. */
+size_t
+trace_dump (void *buffer, size_t size)
+{
+  struct trace_header *h = buffer;
+  struct trace_record *out = (struct trace_record *) (h + 1);
+  size_t room, cnt = 0;
+  int i;
+
+  ASSERT (size >= sizeof *h);
+  room = (size - sizeof *h) / sizeof *out;
+
+  for (i = 0; i < NCPU; i++)
+    {
+      const struct trace_ring *ring = &rings[i];
+      size_t n = ring_cnt (ring);
+      uint32_t first = ring->head - n;
+      size_t j;
+
+      for (j = 0; j < n && cnt < room; j++)
+        out[cnt++] = ring->records[(first + j) % TRACE_RING_SIZE];
+    }
+
+  h->magic = TRACE_MAGIC;
+  h->version = 1;
+  h->cnt = cnt;
+  h->ncpu = NCPU;
+  return sizeof *h + cnt * sizeof *out;
+}
+
+/* Prints the trace to the console, one record per line in hex,
+   so that utils/trace-timeline can pick it out of the log. */
+void
+trace_print_stats (void)
+{
+  int i;
+
+  if (!trace_enabled)
+    return;
+
+  trace_enabled = false;
+  for (i = 0; i < NCPU; i++)
+    {
+      const struct trace_ring *ring = &rings[i];
+      size_t n = ring_cnt (ring);
+      uint32_t first = ring->head - n;
+      size_t j;
+
+      printf ("Trace: cpu %d, %zu records, %"PRIu32" dropped\n",
+              i, n, ring->head - (uint32_t) n);
+      for (j = 0; j < n; j++)
+        {
+          const struct trace_record *r
+            = &ring->records[(first + j) % TRACE_RING_SIZE];
+          printf ("T %016llx %02x %02x %04x %08"PRIx32"\n",
+                  (unsigned long long) r->tsc, r->event, r->cpu,
+                  r->tid, r->arg);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Kernel event tracing.
+
+   Each CPU has a fixed-size ring of trace records.  A tracepoint
+   reserves a slot with an atomic increment, so recording never
+   takes a lock and is safe from interrupt handlers; once the
+   ring is full the oldest records are overwritten.  Tracing is
+   off unless the kernel is started with -trace, and a disabled
+   tracepoint costs one well-predicted test and branch.
+
+   The ring is printed to the console at shutdown, and the
+   `trace FILE' action saves it to FILE in the same binary format.
+   utils/trace-timeline turns either one into a timeline. */
+
+/* Traced events. */
+enum trace_event
+  {
+    TRACE_SWITCH,               /* schedule() switching; ARG = next tid. */
+    TRACE_BLOCK,                /* thread_block(). */
+    TRACE_UNBLOCK,              /* thread_unblock(); ARG = woken tid. */
+    TRACE_LOCK_CONTEND,         /* lock_acquire() must wait; ARG = holder. */
+    TRACE_INTR_ENTER,           /* intr_handler() entry; ARG = vector. */
+    TRACE_INTR_EXIT,            /* intr_handler() exit; ARG = vector. */
+    TRACE_PAGE_FAULT,           /* page_fault(); ARG = fault address. */
+    TRACE_LOCK_SPIN,            /* lock_acquire() got it spinning; ARG = spins. */
+    TRACE_BOOT_PHASE            /* boot_phase(); ARG = enum boot_phase. */
+  };
+
+/* One trace record, 16 bytes, little-endian on disk and wire. */
+struct trace_record
+  {
+    uint64_t tsc;               /* Time-stamp counter. */
+    uint32_t arg;               /* Event-specific argument. */
+    uint16_t tid;               /* Running thread's tid. */
+    uint8_t event;              /* An enum trace_event. */
+    uint8_t cpu;                /* CPU that recorded it. */
+  };
+
+/* Header of a trace dump, followed by CNT records ordered from
+   oldest to newest. */
+#define TRACE_MAGIC 0x43525450  /* "PTRC". */
+struct trace_header
+  {
+    uint32_t magic;             /* TRACE_MAGIC. */
+    uint32_t version;           /* Format version, currently 1. */
+    uint32_t cnt;               /* Number of records that follow. */
+    uint32_t ncpu;              /* Number of CPUs traced. */
+  };
+
+/* Records per CPU.  Must be a power of 2. */
+#define TRACE_RING_SIZE 1024
+
+extern bool trace_enabled;
+
+void trace_record (enum trace_event, uint32_t arg);
+size_t trace_dump_size (void);
+size_t trace_dump (void *buffer, size_t size);
+void trace_print_stats (void);
+
+/* Records EVENT with argument ARG if tracing is enabled. */
+#define TRACE(EVENT, ARG)                                       \
+        do                                                      \
+          {                                                     \
+            if (__builtin_expect (trace_enabled, 0))            \
+              trace_record (EVENT, (uint32_t) (ARG));           \
+          }                                                     \
+        while (0)
+
+#endif /* threads/trace.h */
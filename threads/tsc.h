@@ -0,0 +1,27 @@
+#ifndef THREADS_TSC_H
+#define THREADS_TSC_H
+
+#include <stdint.h>
+
+/* Returns the CPU's time-stamp counter, the number of clock
+   cycles since reset.  See [IA32-v2b] "RDTSC". */
+static inline uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Returns performance counter COUNTER, as set up by
+   threads/pmu.c.  Allowed in user mode only while CR4.PCE is set.
+   See [IA32-v2b] "RDPMC". */
+static inline uint64_t
+rdpmc (uint32_t counter)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdpmc" : "=a" (lo), "=d" (hi) : "c" (counter));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+#endif /* threads/tsc.h */
@@ -0,0 +1,99 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Work items waiting for a worker, in FIFO order.  Only touched
+   with interrupts off, since interrupt handlers add to it. */
+static struct list pending;
+
+/* Counts the items in PENDING; workers sleep on it. */
+static struct semaphore pending_cnt;
+
+static thread_func worker;
+
+/* Initializes WORK to run FUNC(AUX) each time it is scheduled. */
+void
+work_init (struct work *work, work_func *func, void *aux)
+{
+  ASSERT (work != NULL);
+  ASSERT (func != NULL);
+
+  work->func = func;
+  work->aux = aux;
+  work->queued = false;
+}
+
+/* Queues WORK to be run by a worker thread.  Returns false,
+   without queuing it again, if WORK is already queued and has
+   not started running yet.  May be called from an interrupt
+   handler, and before workqueue_start(), in which case WORK runs
+   once the workers exist. */
+bool
+work_schedule (struct work *work)
+{
+  enum intr_level old_level;
+  bool queued;
+
+  ASSERT (work != NULL);
+
+  old_level = intr_disable ();
+  queued = !work->queued;
+  if (queued)
+    {
+      work->queued = true;
+      list_push_back (&pending, &work->elem);
+      sema_up (&pending_cnt);
+    }
+  intr_set_level (old_level);
+
+  return queued;
+}
+
+/* Initializes the pending queue.  Must be called before any
+   interrupt handler can schedule work. */
+void
+workqueue_init (void)
+{
+  list_init (&pending);
+  sema_init (&pending_cnt, 0);
+}
+
+/* Starts the worker threads.  Must be called after
+   thread_start(). */
+void
+workqueue_start (void)
+{
+  int i;
+
+  for (i = 0; i < WORKQUEUE_WORKERS; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "worker%d", i);
+      thread_create (name, PRI_MAX, worker, NULL);
+    }
+}
+
+/* A worker thread: runs pending work items forever. */
+static void
+worker (void *aux UNUSED)
+{
+  thread_set_worker ();
+  for (;;)
+    {
+      enum intr_level old_level;
+      struct work *w;
+
+      sema_down (&pending_cnt);
+
+      old_level = intr_disable ();
+      w = list_entry (list_pop_front (&pending), struct work, elem);
+      w->queued = false;
+      intr_set_level (old_level);
+
+      w->func (w->aux);
+    }
+}
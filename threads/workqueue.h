@@ -0,0 +1,36 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+
+/* Deferred work.
+
+   An interrupt handler that has more to do than a few
+   instructions queues a work item instead, and one of a small
+   pool of PRI_MAX kernel worker threads runs it soon after the
+   interrupt returns, with interrupts enabled.  A work item runs
+   in thread context, so it may take locks and sleep. */
+
+/* Function run for a work item. */
+typedef void work_func (void *aux);
+
+/* A work item.  Owned by the caller, who must not free it while
+   it is queued. */
+struct work
+  {
+    struct list_elem elem;      /* Element in the pending queue. */
+    work_func *func;            /* Function to run. */
+    void *aux;                  /* Argument for FUNC. */
+    bool queued;                /* True while in the pending queue. */
+  };
+
+/* Number of worker threads. */
+#define WORKQUEUE_WORKERS 2
+
+void work_init (struct work *, work_func *, void *aux);
+bool work_schedule (struct work *);
+void workqueue_init (void);
+void workqueue_start (void);
+
+#endif /* threads/workqueue.h */
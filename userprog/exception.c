@@ -1,16 +1,26 @@
 #include "userprog/exception.h"
+#include <counter.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
 #include "userprog/syscall.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
-static long long page_fault_cnt;
+static struct counter page_fault_cnt;
 
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
+static bool copy_on_write (const void *fault_addr);
 
 /* Registers handlers for interrupts that can be caused by user
    programs.
@@ -61,11 +71,15 @@ exception_init (void)
   intr_register_int (14, 0, INTR_OFF, page_fault, "#PF Page-Fault Exception");
 }
 
-/* Prints exception statistics. */
+/* Prints exception statistics.  Each process also counts its
+   own faults by kind; see getrusage(). */
 void
 exception_print_stats (void) 
 {
-  printf ("Exception: %lld page faults\n", page_fault_cnt);
+  printf ("Exception: %llu page faults\n", counter_read (&page_fault_cnt));
+#ifdef VM
+  page_print_stats ();
+#endif
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -136,19 +150,57 @@ page_fault (struct intr_frame *f)
      [IA32-v3a] 5.15 "Interrupt 14--Page Fault Exception
      (#PF)". */
   asm ("movl %%cr2, %0" : "=r" (fault_addr));
+  TRACE (TRACE_PAGE_FAULT, fault_addr);
 
   /* Turn interrupts back on (they were only off so that we could
      be assured of reading CR2 before it changed). */
   intr_enable ();
 
   /* Count page faults. */
-  page_fault_cnt++;
+  counter_inc (&page_fault_cnt);
 
   /* Determine cause. */
   not_present = (f->error_code & PF_P) == 0;
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+#ifdef VM
+  /* Bring in pages recorded in the supplemental page table.
+     This also covers the kernel touching such a page on behalf
+     of a system call. */
+  if (not_present && is_user_vaddr (fault_addr) && page_load (fault_addr, write))
+    return;
+#endif
+
+  /* Give the process its own copy of a page that fork() left
+     shared, when it writes to it, or when the kernel does so on
+     its behalf. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && copy_on_write (fault_addr))
+    {
+      thread_current ()->proceso->fallas_cow++;
+      return;
+    }
+
+  /* Grow the stack.  A fault taken by the kernel comes with no
+     user %esp in F, so use the one saved on entry to the system
+     call. */
+  if (not_present
+      && process_in_stack (fault_addr,
+                           user ? f->esp : thread_current ()->esp_usuario)
+      && process_grow_stack (pg_round_down (fault_addr)))
+    {
+      thread_current ()->proceso->fallas_pila++;
+      return;
+    }
+
+  /* A fault in the guard page below a large kernel stack means
+     that the stack overflowed, which is no bad pointer that
+     get_user() could recover from. */
+  if (!user && thread_stack_guard (fault_addr))
+    PANIC ("kernel stack overflow in thread `%s' at %p",
+           running_thread ()->name, fault_addr);
+
    /*
       También asumen que ha modificado page_fault () para que un error de página
       en el kernel simplemente establezca eax en 0xffffffff y copie su valor anterior en eip.
@@ -170,5 +222,32 @@ page_fault (struct intr_frame *f)
   kill (f);
 }
 
-
-
+/* Handles a write to copy-on-write page FAULT_ADDR of the
+   current process.  Returns true if the write may be retried. */
+static bool
+copy_on_write (const void *fault_addr)
+{
+#ifdef VM
+  return page_cow (fault_addr);
+#else
+  uint32_t *pd = thread_current ()->pagedir;
+  const void *upage = pg_round_down (fault_addr);
+  void *kpage, *spare = NULL;
+
+  if (pd == NULL)
+    return false;
+  kpage = pagedir_get_page (pd, upage);
+  if (kpage == NULL)
+    return false;
+  if (pagedir_is_shared (kpage))
+    {
+      spare = palloc_get_page (PAL_USER);
+      if (spare == NULL)
+        return false;
+    }
+  kpage = pagedir_cow (pd, upage, spare);
+  if (spare != NULL && kpage != spare)
+    palloc_free_page (spare);
+  return kpage != NULL;
+#endif
+}
@@ -1,49 +1,151 @@
 #include "userprog/pagedir.h"
+#include <bitmap.h>
+#include <debug.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
-static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void load_pagedir (uint32_t *);
+static unsigned loaded_cpus (uint32_t *);
+static void shootdown (struct tlb_batch *);
+static void invalidate_page (uint32_t *, const void *upage);
+static uint16_t *share_cnt_of (const void *kpage);
+static void unshare (uint16_t *cnt);
+
+/* Page directory that each CPU last loaded into CR3, or a null
+   pointer before its first pagedir_activate().  A CPU keeps TLB
+   entries only for the page directory it has loaded, beyond the
+   global kernel ones, so these tell which CPUs must invalidate
+   entries when a directory's PTEs change.  Only the boot CPU runs
+   for now, so that is always loaded_pd[0]. */
+static uint32_t *loaded_pd[NCPU];
+
+/* Most pages a TLB batch invalidates one at a time before it
+   flushes the whole TLB instead.  A few pages are cheaper to
+   invalidate one by one than to flush everything and take misses
+   on the rest. */
+#define TLB_FLUSH_PAGES 32
+
+/* Most pages pagedir_destroy() frees at once. */
+#define FREE_BATCH 64
+
+/* Pages shared between page directories by fork().
+
+   pagedir_share_page() maps a user page into a second page
+   directory by copying its PTE, so that neither the page nor
+   its contents are copied.  A writable page becomes read-only
+   in both directories and is marked PTE_COW, and the first
+   write to it through either one faults; pagedir_cow() then
+   gives the writer a copy of its own, or, if no other directory
+   maps the page any more, just makes it writable again.
+
+   SHARE_CNT counts, for each page of the user pool, the page
+   directories beyond the first that map it.  pagedir_destroy()
+   frees a page only once its count is back to zero.
+
+   pagedir_merge_page() shares a page the same way between two
+   mappings that merely have the same contents, for same-page
+   merging (see vm/ksm.h), and MERGED marks the pages it shared,
+   until their counts are back to zero. */
+static uint16_t *share_cnt;
+static struct bitmap *merged;
+static uint8_t *user_base;
+static size_t user_cnt;
+static struct lock share_lock;    /* Protects SHARE_CNT, MERGED, PTE_COW. */
+
+/* Initializes the count of page directories sharing each page
+   of the user pool. */
+void
+pagedir_init (void)
+{
+  palloc_get_user_range ((void **) &user_base, &user_cnt);
+  share_cnt = calloc (user_cnt, sizeof *share_cnt);
+  merged = bitmap_create (user_cnt);
+  if ((share_cnt == NULL && user_cnt > 0) || merged == NULL)
+    PANIC ("Not enough memory for the page sharing counts.");
+  lock_init (&share_lock);
+}
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
    Returns the new page directory, or a null pointer if memory
-   allocation fails. */
+   allocation fails.  Only the kernel's quarter of the directory
+   is copied; the page comes pre-zeroed from palloc. */
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
+  uint32_t *pd = palloc_get_page_tagged (PAL_ZERO, MEM_PAGEDIR);
   if (pd != NULL)
-    memcpy (pd, init_page_dir, PGSIZE);
+    memcpy (pd + pd_no (PHYS_BASE), init_page_dir + pd_no (PHYS_BASE),
+            (PGSIZE / sizeof *pd - pd_no (PHYS_BASE)) * sizeof *pd);
   return pd;
 }
 
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references that no other page directory maps, and its 4 MB
+   pages, which are never shared.  Pages are
+   dropped one page table at a time under a single acquisition of
+   the sharing lock, and freed in batches of up to FREE_BATCH, so
+   that a process exits without taking the pool lock for each of
+   its pages. */
 void
 pagedir_destroy (uint32_t *pd) 
 {
+  void *batch[FREE_BATCH];
+  size_t batch_cnt = 0;
   uint32_t *pde;
 
   if (pd == NULL)
     return;
 
   ASSERT (pd != init_page_dir);
+  ASSERT (loaded_cpus (pd) == 0);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if (*pde & PTE_PS)
+      palloc_free_multiple (pte_get_page (*pde), PTSPAN / PGSIZE);
+    else if (*pde & PTE_P) 
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
         
+        lock_acquire (&share_lock);
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
           if (*pte & PTE_P) 
-            palloc_free_page (pte_get_page (*pte));
-        palloc_free_page (pt);
+            {
+              uint16_t *cnt = share_cnt_of (pte_get_page (*pte));
+
+              if (*cnt > 0)
+                unshare (cnt);
+              else
+                {
+                  if (batch_cnt == FREE_BATCH)
+                    {
+                      palloc_free_pages (batch, batch_cnt);
+                      batch_cnt = 0;
+                    }
+                  batch[batch_cnt++] = pte_get_page (*pte);
+                }
+            }
+        lock_release (&share_lock);
+
+        if (batch_cnt == FREE_BATCH)
+          {
+            palloc_free_pages (batch, batch_cnt);
+            batch_cnt = 0;
+          }
+        batch[batch_cnt++] = pt;
+
+        /* A big address space takes a while to tear down. */
+        thread_cond_resched ();
       }
+  palloc_free_pages (batch, batch_cnt);
   palloc_free_page (pd);
 }
 
@@ -52,7 +154,8 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.  A null pointer is also returned if VADDR
+   lies in a 4 MB page, which has no page table entries. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -66,11 +169,13 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
   /* Check for a page table for VADDR.
      If one is missing, create one if requested. */
   pde = pd + pd_no (vaddr);
+  if (*pde & PTE_PS)
+    return NULL;
   if (*pde == 0) 
     {
       if (create)
         {
-          pt = palloc_get_page (PAL_ZERO);
+          pt = palloc_get_page_tagged (PAL_ZERO, MEM_PAGEDIR);
           if (pt == NULL) 
             return NULL; 
       
@@ -125,9 +230,14 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
 void *
 pagedir_get_page (uint32_t *pd, const void *uaddr) 
 {
-  uint32_t *pte;
+  uint32_t pde, *pte;
 
   ASSERT (is_user_vaddr (uaddr));
+
+  pde = pd[pd_no (uaddr)];
+  if (pde & PTE_PS)
+    return ((uint8_t *) pte_get_page (pde)
+            + ((uintptr_t) uaddr & (PTSPAN - 1)));
   
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
@@ -152,8 +262,90 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
+    }
+}
+
+/* Marks user virtual page UPAGE "not present" in page directory
+   PD, like pagedir_clear_page(), and drops PD's share of the
+   page it mapped, if fork() or same-page merging shared it.
+   Returns that page if no other page directory maps it any more,
+   for the caller to free, or a null pointer if another still
+   does or UPAGE was not mapped.  Stores in *DIRTY whether the
+   mapping was dirty, checked atomically with the unmapping. */
+void *
+pagedir_drop_page (uint32_t *pd, void *upage, bool *dirty)
+{
+  uint32_t *pte;
+  void *kpage = NULL;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  *dirty = false;
+  pte = lookup_page (pd, upage, false);
+  if (pte == NULL)
+    return NULL;
+
+  lock_acquire (&share_lock);
+  if ((*pte & PTE_P) != 0)
+    {
+      enum intr_level old_level = intr_disable ();
+      uint16_t *cnt = share_cnt_of (pte_get_page (*pte));
+
+      *dirty = (*pte & PTE_D) != 0;
+      *pte &= ~PTE_P;
+      invalidate_page (pd, upage);
+      intr_set_level (old_level);
+      if (*cnt > 0)
+        unshare (cnt);
+      else
+        kpage = pte_get_page (*pte);
+    }
+  lock_release (&share_lock);
+  return kpage;
+}
+
+/* Marks the PAGE_CNT user virtual pages starting at UPAGE "not
+   present" in page directory PD, as pagedir_clear_page() does for
+   each of them, but looks up each page table only once and
+   invalidates the TLB in a single batch at the end.  The pages
+   need not be mapped.  4 MB pages in the range are left
+   alone. */
+void
+pagedir_clear_range (uint32_t *pd, void *upage, size_t page_cnt)
+{
+  uint8_t *va = upage;
+  uint8_t *end = va + page_cnt * PGSIZE;
+  struct tlb_batch b;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (end <= (uint8_t *) PHYS_BASE && end >= va);
+
+  pagedir_batch_init (&b);
+  while (va < end)
+    {
+      uint32_t pde = pd[pd_no (va)];
+      uint8_t *pt_end = (uint8_t *) (((uintptr_t) va & PDMASK)
+                                     + (1u << PDSHIFT));
+
+      if (pt_end > end || pt_end < va)
+        pt_end = end;
+      if ((pde & (PTE_P | PTE_PS)) == PTE_P)
+        {
+          uint32_t *pte = pde_get_pt (pde) + pt_no (va);
+
+          for (; va < pt_end; va += PGSIZE, pte++)
+            if (*pte & PTE_P)
+              {
+                *pte &= ~PTE_P;
+                pagedir_batch_add (&b, pd, va);
+              }
+        }
+      va = pt_end;
     }
+  pagedir_batch_flush (&b);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
@@ -180,7 +372,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,18 +401,409 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
+        }
+    }
+}
+
+/* Clears the accessed bit in the PTE for virtual page VPAGE in
+   PD, as pagedir_set_accessed (PD, VPAGE, false) does, but adds
+   the TLB entry to B to be invalidated later with others.  Until
+   then the CPU may use the page without setting the bit again,
+   which only makes the page look less recently used than it
+   is. */
+void
+pagedir_clear_accessed (uint32_t *pd, const void *vpage,
+                        struct tlb_batch *b)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL && (*pte & PTE_A))
+    {
+      *pte &= ~(uint32_t) PTE_A;
+      pagedir_batch_add (b, pd, vpage);
+    }
+}
+
+/* Initializes B as an empty TLB batch. */
+void
+pagedir_batch_init (struct tlb_batch *b)
+{
+  b->pd = NULL;
+  b->range_cnt = 0;
+  b->page_cnt = 0;
+}
+
+/* Adds the TLB entry for user virtual page UPAGE of PD, whose
+   PTE the caller has just changed, to those that B invalidates.
+   A page that directly follows the last one added extends its
+   range.  B holds the entries of a single page directory, so if
+   it has some of another's, those are invalidated first. */
+void
+pagedir_batch_add (struct tlb_batch *b, uint32_t *pd, const void *upage)
+{
+  struct tlb_range *r;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  if (b->pd != pd)
+    {
+      pagedir_batch_flush (b);
+      b->pd = pd;
+    }
+  r = &b->ranges[b->range_cnt > 0 ? b->range_cnt - 1 : 0];
+  if (b->range_cnt > 0
+      && (const uint8_t *) upage == r->upage + r->page_cnt * PGSIZE)
+    r->page_cnt++;
+  else if (b->range_cnt < TLB_BATCH_RANGES)
+    {
+      r = &b->ranges[b->range_cnt++];
+      r->upage = upage;
+      r->page_cnt = 1;
+    }
+  else
+    {
+      /* Too scattered to keep track of, so the whole TLB goes. */
+      b->page_cnt = TLB_FLUSH_PAGES;
+    }
+  b->page_cnt++;
+}
+
+/* Invalidates the TLB entries gathered in B on every CPU that has
+   their page directory loaded, and empties B.  The entries must
+   be invalidated before the memory they map is freed or its
+   contents are relied on. */
+void
+pagedir_batch_flush (struct tlb_batch *b)
+{
+  if (b->page_cnt > 0)
+    shootdown (b);
+  b->range_cnt = 0;
+  b->page_cnt = 0;
+}
+
+/* Returns the lowest user virtual page at or above UPAGE that
+   is mapped in PD, or a null pointer if there is none.  Page
+   tables that PD lacks are skipped as a whole. */
+void *
+pagedir_next_page (uint32_t *pd, const void *upage)
+{
+  uintptr_t va = (uintptr_t) pg_round_down (upage);
+
+  while (va < (uintptr_t) PHYS_BASE)
+    {
+      uint32_t pde = pd[pd_no ((void *) va)];
+
+      if (pde & PTE_PS)
+        return (void *) va;
+      if (pde & PTE_P)
+        {
+          uint32_t *pt = pde_get_pt (pde);
+          size_t i;
+
+          for (i = pt_no ((void *) va); i < PGSIZE / sizeof *pt; i++)
+            if (pt[i] & PTE_P)
+              return (void *) (va + (i - pt_no ((void *) va)) * PGSIZE);
+        }
+      va = (va & PDMASK) + (1u << PDSHIFT);
+    }
+  return NULL;
+}
+
+/* Maps user virtual page UPAGE in page directory DST to the page
+   it maps in SRC, with the same permissions, without copying the
+   page.  A writable page becomes copy-on-write in both.  UPAGE
+   must be mapped in SRC and not in DST.  Returns true if
+   successful, false if memory allocation failed. */
+bool
+pagedir_share_page (uint32_t *dst, uint32_t *src, const void *upage)
+{
+  uint32_t *src_pte, *dst_pte;
+  uint16_t *cnt;
+  bool success = false;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (dst != src);
+
+  src_pte = lookup_page (src, upage, false);
+  ASSERT (src_pte != NULL && (*src_pte & PTE_P) != 0);
+  dst_pte = lookup_page (dst, upage, true);
+  if (dst_pte == NULL)
+    return false;
+  ASSERT ((*dst_pte & PTE_P) == 0);
+
+  lock_acquire (&share_lock);
+  cnt = share_cnt_of (pte_get_page (*src_pte));
+  if (*cnt < UINT16_MAX)
+    {
+      ++*cnt;
+      if (*src_pte & PTE_W)
+        {
+          *src_pte = (*src_pte & ~(uint32_t) PTE_W) | PTE_COW;
+          invalidate_page (src, upage);
+        }
+      *dst_pte = *src_pte;
+      success = true;
+    }
+  lock_release (&share_lock);
+  return success;
+}
+
+/* Returns true if user virtual page UPAGE is mapped in PD
+   copy-on-write, that is, read-only until pagedir_cow(). */
+bool
+pagedir_is_cow (uint32_t *pd, const void *upage)
+{
+  uint32_t *pte = lookup_page (pd, upage, false);
+  return (pte != NULL && (*pte & (PTE_P | PTE_W | PTE_COW))
+                         == (PTE_P | PTE_COW));
+}
+
+/* Returns true if page KPAGE of the user pool is mapped by more
+   than one page directory.  A page mapped only by the calling
+   process can only become shared through fork() by that same
+   process, so a false answer stays false until the caller's
+   process forks. */
+bool
+pagedir_is_shared (const void *kpage)
+{
+  return *share_cnt_of (kpage) > 0;
+}
+
+/* Makes user virtual page UPAGE in PD writable, if it is mapped
+   copy-on-write, and returns the page it then maps.  If no other
+   page directory maps the page, this is the same page.
+   Otherwise, the page is copied into SPARE, a page of the user
+   pool, which is mapped instead, with its dirty bit set, and
+   returned.  The caller frees SPARE if it is not returned.
+
+   Also returns the page if UPAGE is already writable, as when
+   another thread of the process got there first.  Returns a null
+   pointer if UPAGE is not mapped, is mapped read-only for good,
+   or needs a copy but SPARE is null. */
+void *
+pagedir_cow (uint32_t *pd, const void *upage, void *spare)
+{
+  uint32_t *pte = lookup_page (pd, upage, false);
+  void *kpage = NULL;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  if (pte == NULL)
+    return NULL;
+
+  lock_acquire (&share_lock);
+  if ((*pte & PTE_P) == 0)
+    kpage = NULL;
+  else if (*pte & PTE_W)
+    kpage = pte_get_page (*pte);
+  else if (*pte & PTE_COW)
+    {
+      uint16_t *cnt = share_cnt_of (pte_get_page (*pte));
+
+      if (*cnt == 0)
+        {
+          *pte = (*pte | PTE_W) & ~(uint32_t) PTE_COW;
+          kpage = pte_get_page (*pte);
+        }
+      else if (spare != NULL)
+        {
+          copy_page (spare, pte_get_page (*pte));
+          unshare (cnt);
+          *pte = pte_create_user (spare, true) | PTE_A | PTE_D;
+          kpage = spare;
+        }
+      invalidate_page (pd, upage);
+    }
+  lock_release (&share_lock);
+  return kpage;
+}
+
+/* Makes user virtual page UPAGE in PD copy-on-write if it is
+   writable, so that the next write to it faults into
+   pagedir_cow(), which makes it writable again if nothing has
+   shared it meanwhile.  Returns the page UPAGE maps, or a null
+   pointer if it is not mapped or is mapped read-only for good. */
+void *
+pagedir_protect_page (uint32_t *pd, const void *upage)
+{
+  uint32_t *pte = lookup_page (pd, upage, false);
+  void *kpage = NULL;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  if (pte == NULL)
+    return NULL;
+
+  lock_acquire (&share_lock);
+  if ((*pte & PTE_P) != 0 && (*pte & (PTE_W | PTE_COW)) != 0)
+    {
+      if (*pte & PTE_W)
+        {
+          *pte = (*pte & ~(uint32_t) PTE_W) | PTE_COW;
+          invalidate_page (pd, upage);
+        }
+      kpage = pte_get_page (*pte);
+    }
+  lock_release (&share_lock);
+  return kpage;
+}
+
+/* Maps user virtual page DST_UPAGE in DST, copy-on-write, to the
+   page that SRC maps at SRC_UPAGE, whose contents the caller has
+   found to be the same as those of the page DST_UPAGE maps now.
+   Both must have been made copy-on-write by
+   pagedir_protect_page(), and the page DST_UPAGE maps must be
+   mapped nowhere else; the caller frees it on success.  The new
+   mapping is dirty, since its contents need not match the swap
+   slot or file of DST_UPAGE, and accessed only if the old one
+   was.  Returns false, changing nothing, if either page has
+   become writable again or the count of mappings is full. */
+bool
+pagedir_merge_page (uint32_t *dst, const void *dst_upage,
+                    uint32_t *src, const void *src_upage)
+{
+  uint32_t *dst_pte = lookup_page (dst, dst_upage, false);
+  uint32_t *src_pte = lookup_page (src, src_upage, false);
+  bool success = false;
+
+  ASSERT (pg_ofs (dst_upage) == 0 && pg_ofs (src_upage) == 0);
+
+  if (dst_pte == NULL || src_pte == NULL)
+    return false;
+
+  lock_acquire (&share_lock);
+  if ((*dst_pte & (PTE_P | PTE_W | PTE_COW)) == (PTE_P | PTE_COW)
+      && (*src_pte & (PTE_P | PTE_W | PTE_COW)) == (PTE_P | PTE_COW)
+      && pte_get_page (*dst_pte) != pte_get_page (*src_pte))
+    {
+      void *kpage = pte_get_page (*src_pte);
+      uint16_t *cnt = share_cnt_of (kpage);
+
+      ASSERT (*share_cnt_of (pte_get_page (*dst_pte)) == 0);
+      if (*cnt < UINT16_MAX)
+        {
+          ++*cnt;
+          bitmap_mark (merged, cnt - share_cnt);
+          *dst_pte = (pte_create_user (kpage, false) | PTE_COW | PTE_D
+                      | (*dst_pte & PTE_A));
+          invalidate_page (dst, dst_upage);
+          success = true;
         }
     }
+  lock_release (&share_lock);
+  return success;
+}
+
+/* Stores in *PAGES the number of pages of the user pool that
+   same-page merging has shared and that are still shared, and in
+   *SAVED the number of mappings of them beyond the first, each of
+   which would otherwise take a page of its own.  Forks of a
+   merged page count too.  Called at shutdown, possibly with
+   interrupts off, so this does not take the lock, and the counts
+   may be slightly off. */
+void
+pagedir_merge_stats (size_t *pages, size_t *saved)
+{
+  size_t idx;
+
+  *pages = *saved = 0;
+  for (idx = bitmap_scan (merged, 0, 1, true); idx != BITMAP_ERROR;
+       idx = bitmap_scan (merged, idx + 1, 1, true))
+    {
+      ++*pages;
+      *saved += share_cnt[idx];
+    }
+}
+
+/* Maps the PTSPAN bytes of user virtual memory at UPAGE in PD
+   to the physically contiguous pages at KPAGE with a single 4 MB
+   PDE, read/write if WRITABLE is true and otherwise read-only, so
+   that the whole range takes one TLB entry.  UPAGE and KPAGE must
+   be multiples of PTSPAN, and CR4.PSE must be set.  A page table
+   left for the range is freed, but no page in the range may be
+   mapped.  Returns true if successful, false if one is. */
+bool
+pagedir_set_large (uint32_t *pd, void *upage, void *kpage, bool writable)
+{
+  uint32_t *pde = pd + pd_no (upage);
+
+  ASSERT (((uintptr_t) upage & (PTSPAN - 1)) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (vtop (kpage) >> PTSHIFT < init_ram_pages);
+  ASSERT (pd != init_page_dir);
+
+  if (*pde & PTE_PS)
+    return false;
+  if (*pde & PTE_P)
+    {
+      uint32_t *pt = pde_get_pt (*pde);
+      uint32_t *pte;
+
+      for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
+        if (*pte & PTE_P)
+          return false;
+      palloc_free_page (pt);
+    }
+  *pde = pde_create_user_large (kpage, writable);
+  invalidate_page (pd, upage);
+  return true;
+}
+
+/* Replaces the 4 MB page that pagedir_set_large() mapped at
+   UPAGE in PD by a page table that maps the same pages one by
+   one, with the same permissions and each with the 4 MB page's
+   accessed and dirty bits, so that they can be shared, evicted
+   and unmapped one at a time.  Returns false if memory
+   allocation fails, leaving the 4 MB page in place. */
+bool
+pagedir_split_large (uint32_t *pd, void *upage)
+{
+  uint32_t *pde = pd + pd_no (upage);
+  enum intr_level old_level;
+  uint32_t *pt;
+  uint8_t *kpage;
+  size_t i;
+
+  ASSERT (((uintptr_t) upage & (PTSPAN - 1)) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (*pde & PTE_PS);
+
+  pt = palloc_get_page_tagged (0, MEM_PAGEDIR);
+  if (pt == NULL)
+    return false;
+
+  /* Copy the bits and switch over atomically, so that a write by
+     another thread of the process cannot set the dirty bit in
+     between. */
+  old_level = intr_disable ();
+  kpage = pte_get_page (*pde);
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    pt[i] = (pte_create_user (kpage + i * PGSIZE, (*pde & PTE_W) != 0)
+             | (*pde & (PTE_A | PTE_D)));
+  *pde = pde_create (pt);
+  invalidate_page (pd, upage);
+  intr_set_level (old_level);
+  return true;
 }
 
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register, unless it is already loaded, as when switching
+   between kernel threads or between threads of one process. */
 void
 pagedir_activate (uint32_t *pd) 
 {
   if (pd == NULL)
     pd = init_page_dir;
+  if (pd != loaded_pd[0])
+    load_pagedir (pd);
+}
+
+/* Loads PD into CR3 even if it is already there, which flushes
+   its non-global TLB entries. */
+static void
+load_pagedir (uint32_t *pd) 
+{
+  loaded_pd[0] = pd;
 
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
@@ -230,34 +813,88 @@ pagedir_activate (uint32_t *pd)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
-/* Returns the currently active page directory. */
-static uint32_t *
-active_pd (void) 
+/* Returns the set of CPUs that have PD loaded, one bit per CPU. */
+static unsigned
+loaded_cpus (uint32_t *pd) 
 {
-  /* Copy CR3, the page directory base register (PDBR), into
-     `pd'.
-     See [IA32-v2a] "MOV--Move to/from Control Registers" and
-     [IA32-v3a] 3.7.5 "Base Address of the Page Directory". */
-  uintptr_t pd;
-  asm volatile ("movl %%cr3, %0" : "=r" (pd));
-  return ptov (pd);
+  unsigned cpus = 0;
+  int i;
+
+  for (i = 0; i < NCPU; i++)
+    if (loaded_pd[i] == pd)
+      cpus |= 1u << i;
+  return cpus;
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Returns the sharing count of page KPAGE of the user pool. */
+static uint16_t *
+share_cnt_of (const void *kpage)
+{
+  size_t idx = ((const uint8_t *) kpage - user_base) / PGSIZE;
+
+  ASSERT (idx < user_cnt);
+  return &share_cnt[idx];
+}
+
+/* Decrements sharing count CNT, which must be nonzero, with
+   SHARE_LOCK held, and forgets that same-page merging shared the
+   page once no other mapping is left. */
+static void
+unshare (uint16_t *cnt)
+{
+  ASSERT (*cnt > 0);
+
+  if (--*cnt == 0)
+    bitmap_reset (merged, cnt - share_cnt);
+}
+
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the stale
+   entries, on every CPU that may hold them.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates the entries gathered in B on the
+   CPUs that have B's page directory loaded.  (If a CPU does not
+   have it loaded then its entries are not in that CPU's TLB, so
+   there is no need to invalidate anything there.)  The running
+   CPU invalidates each page with INVLPG, or reloads CR3 to flush
+   its whole TLB if there are more than TLB_FLUSH_PAGES.  Each
+   other CPU would take a single interprocessor interrupt to do
+   the same for the whole batch, but only the boot CPU runs for
+   now. */
 static void
-invalidate_pagedir (uint32_t *pd) 
+shootdown (struct tlb_batch *b)
 {
-  if (active_pd () == pd) 
+  unsigned cpus = loaded_cpus (b->pd);
+  size_t i, j;
+
+  ASSERT ((cpus & ~1u) == 0);
+
+  if ((cpus & 1) == 0)
+    return;
+  if (b->page_cnt > TLB_FLUSH_PAGES)
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
+      /* Re-loading PD clears the TLB.  See [IA32-v3a] 3.12
          "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+      load_pagedir (b->pd);
+      return;
+    }
+
+  /* See [IA32-v2a] "INVLPG--Invalidate TLB Entry". */
+  for (i = 0; i < b->range_cnt; i++)
+    for (j = 0; j < b->ranges[i].page_cnt; j++)
+      asm volatile ("invlpg (%0)"
+                    : : "r" (b->ranges[i].upage + j * PGSIZE) : "memory");
+}
+
+/* Invalidates the TLB entry for user virtual page UPAGE of PD,
+   leaving the rest of the TLB alone, as a batch of one page. */
+static void
+invalidate_page (uint32_t *pd, const void *upage)
+{
+  struct tlb_batch b;
+
+  pagedir_batch_init (&b);
+  pagedir_batch_add (&b, pd, upage);
+  pagedir_batch_flush (&b);
 }
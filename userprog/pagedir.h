@@ -2,17 +2,59 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* A batch of TLB entries of a single page directory, whose PTEs
+   have changed, to be invalidated together.  Clearing many PTEs
+   then costs one TLB flush, on each CPU that has the page
+   directory loaded, instead of one invalidation per PTE. */
+#define TLB_BATCH_RANGES 8      /* Most runs of pages a batch keeps. */
+
+struct tlb_range
+  {
+    const uint8_t *upage;       /* First user virtual page. */
+    size_t page_cnt;            /* Number of consecutive pages. */
+  };
+
+struct tlb_batch
+  {
+    uint32_t *pd;               /* Page directory of the entries. */
+    struct tlb_range ranges[TLB_BATCH_RANGES];
+    size_t range_cnt;           /* Ranges in use. */
+    size_t page_cnt;            /* Pages added, or more to flush all. */
+  };
+
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
+void pagedir_clear_range (uint32_t *pd, void *upage, size_t page_cnt);
+void *pagedir_drop_page (uint32_t *pd, void *upage, bool *dirty);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
+void pagedir_clear_accessed (uint32_t *pd, const void *upage,
+                             struct tlb_batch *);
 void pagedir_activate (uint32_t *pd);
+void *pagedir_next_page (uint32_t *pd, const void *upage);
+
+void pagedir_init (void);
+bool pagedir_share_page (uint32_t *dst, uint32_t *src, const void *upage);
+bool pagedir_is_cow (uint32_t *pd, const void *upage);
+bool pagedir_is_shared (const void *kpage);
+void *pagedir_cow (uint32_t *pd, const void *upage, void *spare);
+void *pagedir_protect_page (uint32_t *pd, const void *upage);
+bool pagedir_merge_page (uint32_t *dst, const void *dst_upage,
+                         uint32_t *src, const void *src_upage);
+void pagedir_merge_stats (size_t *pages, size_t *saved);
+bool pagedir_set_large (uint32_t *pd, void *upage, void *kpage, bool writable);
+bool pagedir_split_large (uint32_t *pd, void *upage);
+
+void pagedir_batch_init (struct tlb_batch *);
+void pagedir_batch_add (struct tlb_batch *, uint32_t *pd, const void *upage);
+void pagedir_batch_flush (struct tlb_batch *);
 
 #endif /* userprog/pagedir.h */
@@ -0,0 +1,228 @@
+#include "userprog/pipe.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/poll.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Pipes.
+
+   A pipe is a ring buffer of PIPE_PAGES pages with a read end
+   and a write end, each of which may be open any number of
+   times.  A read waits until the ring has data, then takes as
+   much of it as fits, and returns 0 once the ring is empty and
+   the write end is closed.  A write waits for room as often as
+   it needs to and returns once all of its data is in the ring,
+   or early if the read end is closed.  A write of up to
+   PIPE_ATOMIC bytes is never split, so that it does not
+   interleave with other writers'.
+
+   Data moves with at most two memcpy() calls per wait, one for
+   each side of the ring's wraparound, so a large write moves a
+   page or more at a time.  Readers and writers are woken once
+   per such copy, not per byte, and so are threads that wait in
+   poll() for a pipe to become readable or writable. */
+
+/* Pages in a pipe's ring buffer. */
+#define PIPE_PAGES 4
+#define PIPE_SIZE (PIPE_PAGES * PGSIZE)
+
+/* Largest write that is never interleaved with another. */
+#define PIPE_ATOMIC PGSIZE
+
+struct pipe
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition readable;  /* Signaled when data arrives. */
+    struct condition writable;  /* Signaled when room is made. */
+    struct poll_queue poll;     /* Woken along with either. */
+    uint8_t *ring;              /* PIPE_SIZE bytes. */
+    size_t head, tail;          /* Bytes ever read, written. */
+    unsigned readers, writers;  /* Times each end is open. */
+  };
+
+/* Creates and returns a new pipe with each of its ends open
+   once, or a null pointer if memory is not available. */
+struct pipe *
+pipe_create (void)
+{
+  struct pipe *p = malloc_tagged (sizeof *p, MEM_PROCESS);
+
+  if (p == NULL)
+    return NULL;
+  p->ring = palloc_get_multiple_tagged (0, PIPE_PAGES, MEM_PROCESS);
+  if (p->ring == NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  lock_init (&p->lock);
+  lock_set_name (&p->lock, "pipe");
+  cond_init (&p->readable);
+  cond_init (&p->writable);
+  poll_queue_init (&p->poll);
+  p->head = p->tail = 0;
+  p->readers = p->writers = 1;
+  return p;
+}
+
+/* Opens P's write end if WRITER is true, its read end otherwise,
+   once more. */
+void
+pipe_open (struct pipe *p, bool writer)
+{
+  lock_acquire (&p->lock);
+  if (writer)
+    p->writers++;
+  else
+    p->readers++;
+  lock_release (&p->lock);
+}
+
+/* Closes one opening of P's write end if WRITER is true, of its
+   read end otherwise, and frees P once both ends are closed.
+   Closing an end for the last time wakes everyone waiting on the
+   other one. */
+void
+pipe_close (struct pipe *p, bool writer)
+{
+  bool dead;
+
+  lock_acquire (&p->lock);
+  if (writer)
+    {
+      ASSERT (p->writers > 0);
+      if (--p->writers == 0)
+        {
+          cond_broadcast (&p->readable, &p->lock);
+          poll_wake (&p->poll);
+        }
+    }
+  else
+    {
+      ASSERT (p->readers > 0);
+      if (--p->readers == 0)
+        {
+          cond_broadcast (&p->writable, &p->lock);
+          poll_wake (&p->poll);
+        }
+    }
+  dead = p->readers == 0 && p->writers == 0;
+  lock_release (&p->lock);
+
+  if (dead)
+    {
+      palloc_free_multiple (p->ring, PIPE_PAGES);
+      free (p);
+    }
+}
+
+/* Reads up to SIZE bytes from P into BUFFER, waiting until P has
+   data or its write end is closed.  Returns the number of bytes
+   read, 0 at end of file. */
+int
+pipe_read (struct pipe *p, void *buffer_, size_t size)
+{
+  uint8_t *buffer = buffer_;
+  size_t cnt = 0;
+
+  if (size == 0)
+    return 0;
+
+  lock_acquire (&p->lock);
+  while (p->tail == p->head && p->writers > 0)
+    cond_wait (&p->readable, &p->lock);
+  while (cnt < size && p->head != p->tail)
+    {
+      size_t ofs = p->head % PIPE_SIZE;
+      size_t chunk = p->tail - p->head;
+
+      if (chunk > PIPE_SIZE - ofs)
+        chunk = PIPE_SIZE - ofs;
+      if (chunk > size - cnt)
+        chunk = size - cnt;
+      memcpy (buffer + cnt, p->ring + ofs, chunk);
+      p->head += chunk;
+      cnt += chunk;
+    }
+  if (cnt > 0)
+    {
+      cond_broadcast (&p->writable, &p->lock);
+      poll_wake (&p->poll);
+    }
+  lock_release (&p->lock);
+  return cnt;
+}
+
+/* Writes the SIZE bytes in BUFFER to P, waiting for room as
+   needed.  Returns the number of bytes written, which is less
+   than SIZE only if P's read end gets closed, or -1 if it was
+   closed before anything could be written. */
+int
+pipe_write (struct pipe *p, const void *buffer_, size_t size)
+{
+  const uint8_t *buffer = buffer_;
+  size_t need = size <= PIPE_ATOMIC ? size : 1;
+  size_t cnt = 0;
+
+  lock_acquire (&p->lock);
+  while (cnt < size)
+    {
+      while (PIPE_SIZE - (p->tail - p->head) < need && p->readers > 0)
+        cond_wait (&p->writable, &p->lock);
+      if (p->readers == 0)
+        break;
+      while (cnt < size && p->tail - p->head < PIPE_SIZE)
+        {
+          size_t ofs = p->tail % PIPE_SIZE;
+          size_t chunk = PIPE_SIZE - (p->tail - p->head);
+
+          if (chunk > PIPE_SIZE - ofs)
+            chunk = PIPE_SIZE - ofs;
+          if (chunk > size - cnt)
+            chunk = size - cnt;
+          memcpy (p->ring + ofs, buffer + cnt, chunk);
+          p->tail += chunk;
+          cnt += chunk;
+        }
+      cond_broadcast (&p->readable, &p->lock);
+      poll_wake (&p->poll);
+      need = 1;
+    }
+  lock_release (&p->lock);
+  return cnt > 0 || size == 0 ? (int) cnt : -1;
+}
+
+/* Returns the PIPE_* bits that describe P's read end, or its
+   write end if WRITER is true.  If W is not null, first adds E
+   on behalf of W to P's poll queue, so that W is woken when that
+   may change. */
+int
+pipe_poll (struct pipe *p, bool writer, struct poll_waiter *w,
+           struct poll_entry *e)
+{
+  int ready = 0;
+
+  lock_acquire (&p->lock);
+  if (w != NULL)
+    poll_add (w, e, &p->poll);
+  if (writer)
+    {
+      if (p->readers == 0)
+        ready = PIPE_WRITABLE | PIPE_HANGUP;
+      else if (p->tail - p->head < PIPE_SIZE)
+        ready = PIPE_WRITABLE;
+    }
+  else
+    {
+      if (p->writers == 0)
+        ready = PIPE_READABLE | PIPE_HANGUP;
+      else if (p->tail != p->head)
+        ready = PIPE_READABLE;
+    }
+  lock_release (&p->lock);
+  return ready;
+}
@@ -0,0 +1,23 @@
+#ifndef USERPROG_PIPE_H
+#define USERPROG_PIPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Readiness that pipe_poll() reports. */
+#define PIPE_READABLE 1         /* pipe_read() would not wait. */
+#define PIPE_WRITABLE 2         /* pipe_write() would not wait. */
+#define PIPE_HANGUP 4           /* The other end is closed for good. */
+
+struct pipe;
+struct poll_waiter;
+struct poll_entry;
+struct pipe *pipe_create (void);
+void pipe_open (struct pipe *, bool writer);
+void pipe_close (struct pipe *, bool writer);
+int pipe_read (struct pipe *, void *buffer, size_t size);
+int pipe_write (struct pipe *, const void *buffer, size_t size);
+int pipe_poll (struct pipe *, bool writer, struct poll_waiter *,
+               struct poll_entry *);
+
+#endif /* userprog/pipe.h */
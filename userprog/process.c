@@ -7,41 +7,344 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/pipe.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include <bitmap.h>
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/kinfo.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/scratch.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#endif
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/syscall.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
+static thread_func start_thread NO_RETURN;
+static struct process_control_block *pcb_alloc (void);
+static bool heap_add_page (void *upage);
+static bool heredar_descriptores (struct thread *,
+                                  struct process_control_block *,
+                                  const struct accion_spawn *, size_t cnt);
+static bool heredar_dup2 (struct thread *, struct process_control_block *,
+                          int fd, int nuevo);
+static void soltar_heredado (struct process_control_block *, size_t i);
+static bool instalar_heredados (struct process_control_block *);
+static void soltar_heredados (struct process_control_block *, size_t from);
+static void heap_remove_page (void *upage);
+static tid_t iniciar_proceso (const char *file_name, bool esperar,
+                              bool restaurar,
+                              const struct accion_spawn *, size_t cnt);
+static bool ejecutable_valido (const char *cmdline);
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
-static void argumentos(const char *tokens[], int cntArg, void** esp);
+#ifdef VM
+static bool restaurar (const char *file_name, struct intr_frame *);
+#endif
+static bool argumentos(const char *cmdline, void** esp);
+
+/* Caches de los descriptores de archivo y de los pcb, que antes
+   ocupaban una pagina cada uno. */
+static struct kmem_cache *descriptor_cache;
+static struct kmem_cache *pcb_cache;
+
+/* Los pcb registrados de los hijos de todos los procesos, por padre y
+   pid, para que wait encuentre a un hijo sin recorrer la lista de su
+   padre.  Un hijo que ya no tiene padre sale de la tabla.  LOCK_HIJOS
+   protege la tabla, las listas procesos y terminados de cada proceso y
+   los campos de cada pcb que dicen quien lo espera y si ya termino. */
+static struct hash pcbs;
+static struct lock lock_hijos;
+
+static hash_hash_func pcb_hash;
+static hash_less_func pcb_less;
+static void registrar_hijo (struct thread *padre,
+                            struct process_control_block *);
+static void soltar_hijo (struct process_control_block *);
+static int recoger_hijo (struct process_control_block *);
+static void huerfano (struct process_control_block *);
+static void liberar_pcb (struct process_control_block *);
+static void sumar_uso (unsigned total[USO_CAMPOS], const unsigned uso[USO_CAMPOS]);
+
+/* Crea los caches de objetos de los procesos. */
+void
+process_init (void)
+{
+  descriptor_cache = kmem_cache_create ("descriptor", sizeof (struct descriptor), NULL);
+  pcb_cache = kmem_cache_create ("pcb", sizeof (struct process_control_block), NULL);
+  if (!hash_init (&pcbs, pcb_hash, pcb_less, NULL))
+    PANIC ("Not enough memory for the process table.");
+  lock_init (&lock_hijos);
+}
+
+/* Devuelve un descriptor de archivo nuevo, o NULL si no hay memoria. */
+struct descriptor *
+descriptor_alloc (void)
+{
+  struct descriptor *descriptor = kmem_cache_alloc (descriptor_cache);
+  if (descriptor != NULL) {
+    descriptor->refs = 0;
+    descriptor->file = NULL;
+    descriptor->pipe = NULL;
+    descriptor->escribe = false;
+  }
+  return descriptor;
+}
+
+/* Libera un descriptor obtenido con descriptor_alloc(). */
+void
+descriptor_free (struct descriptor *descriptor)
+{
+  kmem_cache_free (descriptor_cache, descriptor);
+}
+
+/* Cierra el archivo o el extremo de pipe de DESCRIPTOR y lo libera. */
+void
+descriptor_close (struct descriptor *descriptor)
+{
+  if (descriptor->pipe != NULL)
+    pipe_close (descriptor->pipe, descriptor->escribe);
+  else
+    file_close (descriptor->file);
+  descriptor_free (descriptor);
+}
+
+/* Entradas con que empieza la tabla de descriptores. */
+#define DESCRIPTORES_MIN 16
+
+/* Hace que la tabla de descriptores del proceso P tenga al menos CNT
+   entradas, duplicandola las veces necesarias. Devuelve false si no hay
+   memoria o CNT pasa de FD_MAX. */
+static bool
+crecer_descriptores (struct thread *p, size_t cnt)
+{
+  struct descriptor **tabla;
+  struct bitmap *usados;
+  size_t nuevo, fd;
+
+  if (cnt <= p->descriptores_cnt)
+    return true;
+  if (cnt > FD_MAX)
+    return false;
+  nuevo = p->descriptores_cnt > 0 ? p->descriptores_cnt : DESCRIPTORES_MIN;
+  while (nuevo < cnt)
+    nuevo *= 2;
+  if (nuevo > FD_MAX)
+    nuevo = FD_MAX;
+
+  tabla = calloc (nuevo, sizeof *tabla);
+  usados = bitmap_create (nuevo);
+  if (tabla == NULL || usados == NULL) {
+    free (tabla);
+    bitmap_destroy (usados);
+    return false;
+  }
+  // los fds de la consola nunca se dan
+  bitmap_set_multiple (usados, 0, FD_PRIMERO, true);
+  for (fd = 0; fd < p->descriptores_cnt; fd++) {
+    tabla[fd] = p->descriptores[fd];
+    if (tabla[fd] != NULL)
+      bitmap_mark (usados, fd);
+  }
+  free (p->descriptores);
+  bitmap_destroy (p->fds_usados);
+  p->descriptores = tabla;
+  p->fds_usados = usados;
+  p->descriptores_cnt = nuevo;
+  return true;
+}
+
+/* Pone DESCRIPTOR en el menor fd libre del proceso actual y lo devuelve,
+   o -1 si la tabla no puede crecer. Hay que tener lock_descriptores. */
+int
+descriptor_install (struct descriptor *descriptor)
+{
+  struct thread *p = thread_current ()->proceso;
+  size_t fd = BITMAP_ERROR;
+
+  ASSERT (lock_held_by_current_thread (&p->lock_descriptores));
+  if (p->fds_usados != NULL)
+    fd = bitmap_scan_and_flip (p->fds_usados, 0, 1, false);
+  if (fd == BITMAP_ERROR) {
+    // la tabla esta llena, el primer fd libre es la primera entrada nueva
+    fd = p->descriptores_cnt > 0 ? p->descriptores_cnt : FD_PRIMERO;
+    if (!crecer_descriptores (p, fd + 1))
+      return -1;
+    bitmap_mark (p->fds_usados, fd);
+  }
+  p->descriptores[fd] = descriptor;
+  descriptor->refs++;
+  return fd;
+}
+
+/* Pone DESCRIPTOR en el fd FD del proceso actual, creciendo la tabla si
+   hace falta. Guarda en *ANTERIOR el descriptor que FD tenia, o NULL, que
+   hay que soltar como uno de descriptor_remove(). Devuelve false si FD no
+   es valido o la tabla no puede crecer. Hay que tener lock_descriptores. */
+bool
+descriptor_install_at (struct descriptor *descriptor, int fd,
+                       struct descriptor **anterior)
+{
+  struct thread *p = thread_current ()->proceso;
+
+  ASSERT (lock_held_by_current_thread (&p->lock_descriptores));
+  if (fd < 0 || !crecer_descriptores (p, (size_t) fd + 1))
+    return false;
+  *anterior = p->descriptores[fd];
+  if (*anterior != NULL && --(*anterior)->refs > 0)
+    *anterior = NULL;
+  p->descriptores[fd] = descriptor;
+  bitmap_mark (p->fds_usados, fd);
+  descriptor->refs++;
+  return true;
+}
+
+/* Devuelve el descriptor del fd FD del proceso actual, o NULL si FD no
+   esta abierto o es de la consola. Hay que tener lock_descriptores. */
+struct descriptor *
+descriptor_get (int fd)
+{
+  struct thread *p = thread_current ()->proceso;
+
+  if (fd < 0 || (size_t) fd >= p->descriptores_cnt)
+    return NULL;
+  return p->descriptores[fd];
+}
+
+/* Libera el fd FD del proceso actual. Si era el ultimo que apuntaba a su
+   descriptor lo devuelve, y quien llama cierra el archivo y lo libera ya
+   sin el lock; si no, devuelve NULL. Hay que tener lock_descriptores. */
+struct descriptor *
+descriptor_remove (int fd)
+{
+  struct thread *p = thread_current ()->proceso;
+  struct descriptor *descriptor = descriptor_get (fd);
+
+  ASSERT (lock_held_by_current_thread (&p->lock_descriptores));
+  if (descriptor == NULL)
+    return NULL;
+  p->descriptores[fd] = NULL;
+  // un fd de la consola vuelve a ser de la consola, y nunca se da
+  if (fd >= FD_PRIMERO)
+    bitmap_reset (p->fds_usados, fd);
+  return --descriptor->refs == 0 ? descriptor : NULL;
+}
+
+/* Toma una referencia a DESCRIPTOR, para usarlo despues de soltar
+   lock_descriptores aunque otro hilo cierre su fd mientras tanto; asi
+   una lectura o escritura larga no deja esperando a seek, tell ni a las
+   demas llamadas del proceso. Hay que tener lock_descriptores. */
+void
+descriptor_ref (struct descriptor *descriptor)
+{
+  ASSERT (lock_held_by_current_thread (
+            &thread_current ()->proceso->lock_descriptores));
+  descriptor->refs++;
+}
+
+/* Suelta una referencia de descriptor_ref(), y si era la ultima cierra el
+   archivo o el extremo de pipe. No hay que tener lock_descriptores. */
+void
+descriptor_unref (struct descriptor *descriptor)
+{
+  struct lock *lock = &thread_current ()->proceso->lock_descriptores;
+  bool ultima;
+
+  lock_acquire (lock);
+  ultima = --descriptor->refs == 0;
+  lock_release (lock);
+  if (ultima)
+    descriptor_close (descriptor);
+}
 
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
    before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
+   thread id, or TID_ERROR if the thread cannot be created or
+   its program cannot be loaded. */
 tid_t
 process_execute (const char *file_name) 
 {
-  char *fn_copy = NULL, *name = NULL;
+  return iniciar_proceso (file_name, true, false, NULL, 0);
+}
+
+/* Like process_execute(), but returns as soon as the new
+   process's thread exists, once its executable's header has been
+   checked, instead of waiting for the program to be loaded.  If
+   loading fails later, the process exits with status
+   PROCESS_LOAD_FAILED. */
+tid_t
+process_spawn (const char *file_name)
+{
+  return iniciar_proceso (file_name, false, false, NULL, 0);
+}
+
+/* Como process_spawn(), pero el hijo empieza con sus descriptores
+   cambiados por las CNT acciones de ACCIONES, una tras otra: SPAWN_DUP2
+   le pasa el fd FD del padre, archivo o pipe, en el fd NUEVO, y
+   SPAWN_CLOSE le quita el fd FD que hasta ahi iba a heredar.  Asi el
+   padre arma de una vez la entrada y salida del hijo, sin que este tenga
+   que abrir nada por nombre.  Devuelve TID_ERROR tambien si una accion
+   no es valida. */
+tid_t
+process_spawn_actions (const char *file_name,
+                       const struct accion_spawn *acciones, size_t cnt)
+{
+  return iniciar_proceso (file_name, false, false, acciones, cnt);
+}
+
+/* Crea el proceso de process_execute(), process_spawn(),
+   process_spawn_actions() o process_restore().  Si ESPERAR es true espera
+   a que el hijo cargue el programa; si no, solo revisa antes el
+   encabezado del ejecutable y el hijo libera su memoria temporal.  Si
+   RESTAURAR es true, FILE_NAME es una imagen de checkpoint en vez de un
+   ejecutable con sus argumentos.  El hijo hereda los pipes del padre,
+   cambiados por las CNT acciones de ACCIONES. */
+static tid_t
+iniciar_proceso (const char *file_name, bool esperar, bool restaurar,
+                 const struct accion_spawn *acciones, size_t cnt)
+{
+  struct thread *cur = thread_current ()->proceso;
+  const char *fn_copy = file_name;
+  char *name;
+  char nombre[16]; // el nombre del thread, se trunca igual que en thread_create
   tid_t tid;
   char *ptr = NULL; // para mantener el contexto del string qu estamos tokenizando
   struct process_control_block *pcb = NULL;
-  
-  /* Make a copy of FILE_NAME.
-     Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL) {
+
+  // aqui es donde asignamos y setamos nuestro pcb
+  pcb = pcb_alloc();
+  if(pcb == NULL){
+    return TID_ERROR;
+  }
+
+  // quien llama a process_execute espera a que el hijo copie los argumentos
+  // a su pila, asi que el hijo los lee de FILE_NAME sin copiarlo antes; solo
+  // process_spawn regresa primero y necesita una copia
+  size_t largo = strnlen(file_name, PROCESS_CMDLINE_MAX);
+  if (largo == PROCESS_CMDLINE_MAX) {
     goto error;
   }
-  strlcpy (fn_copy, file_name, PGSIZE);
+  if (!esperar) {
+    char *copia = scratch_alloc (&pcb->scratch, largo + 1);
+    if (copia == NULL) {
+      goto error;
+    }
+    memcpy (copia, file_name, largo + 1);
+    fn_copy = copia;
+  }
 
   /*
   No desea que el hilo tenga el nombre de archivo sin formato. 
@@ -49,58 +352,658 @@ process_execute (const char *file_name)
   ejecutable. Deberá extraer el nombre del ejecutable de file_name
   y pasarlo en su lugar.
   */
-  name = palloc_get_page(0);
+  strlcpy(nombre, file_name, sizeof nombre);
+  name = strtok_r(nombre, " ", &ptr);
   if(name == NULL){
     goto error;
   }
-  strlcpy(name, file_name, PGSIZE);
-  name = strtok_r(name, " ", &ptr);
-
-  // aqui es donde asignamos y setamos nuestro pcb
-  pcb = palloc_get_page(0);
-  if(pcb == NULL){
+  if(!esperar && !ejecutable_valido(fn_copy)){
     goto error;
   }
-  pcb->pid = -2;
   pcb->cmdline = fn_copy;
-  pcb->esperando = false;
-  pcb->terminado = false;
-  pcb->exit_code = -1;
-  pcb->deboliberar = false;
-
-  sema_init(&pcb->inicializacion,0);
-  sema_init(&pcb->esperar,0);
+  pcb->asincrono = !esperar;
+  pcb->restaurar = restaurar;
+  pcb->proceso_padre = cur;
+
+  // el hijo empieza en el directorio de trabajo del padre, y con sus pipes
+  lock_acquire(&cur->lock_descriptores);
+  if (cur->directorio != NULL) {
+    pcb->directorio = dir_reopen(cur->directorio);
+  }
+  bool heredados = heredar_descriptores(cur, pcb, acciones, cnt);
+  lock_release(&cur->lock_descriptores);
+  if (!heredados) {
+    dir_close(pcb->directorio);
+    goto error;
+  }
 
   /* Create a new thread to execute FILE_NAME. */
   tid = thread_create (name, PRI_DEFAULT, start_process, pcb);
   if (tid == TID_ERROR){
+    dir_close(pcb->directorio);
+    soltar_heredados(pcb, 0);
     goto error;
   }
 
-  sema_down(&pcb->inicializacion);
-  if(fn_copy){
-    palloc_free_page(fn_copy);
+  if(!esperar) {
+    // el hijo ya es del padre aunque aun no cargue, y si falla lo dice al terminar
+    pcb->pid = tid;
+    registrar_hijo(cur, pcb);
+    return tid;
   }
 
-  if(pcb->pid >= 0) {
-    list_push_back(&(thread_current()->procesos), &(pcb->elem));
+  sema_down(&pcb->inicializacion);
+  // el hijo ya copio los argumentos a su pila
+  scratch_release (&pcb->scratch);
+  pcb->cmdline = NULL;
+
+  tid = pcb->pid;
+  if(tid >= 0) {
+    registrar_hijo(cur, pcb);
+  } else {
+    soltar_hijo(pcb);
   }
-  palloc_free_page(name);
   
-  return pcb->pid;
+  return tid;
 
 error:
-  if(fn_copy){
-    palloc_free_page(fn_copy);
+  scratch_release (&pcb->scratch);
+  kmem_cache_free(pcb_cache, pcb);
+  return TID_ERROR;
+}
+
+/* Guarda en PCB, con una referencia propia, cada extremo de pipe abierto del
+   proceso P, que debe tener tomado su lock_descriptores, y luego aplica las
+   CNT acciones de ACCIONES. El hijo los pone en sus fds con
+   instalar_heredados(). Devuelve false si no hay memoria o si una accion no
+   es valida, y entonces ya solto lo que habia guardado. */
+static bool
+heredar_descriptores (struct thread *p, struct process_control_block *pcb,
+                      const struct accion_spawn *acciones, size_t cnt)
+{
+  size_t fd, i, max = cnt;
+
+  for (fd = 0; fd < p->descriptores_cnt; fd++)
+    if (p->descriptores[fd] != NULL && p->descriptores[fd]->pipe != NULL)
+      max++;
+  if (max == 0)
+    return true;
+  // cada SPAWN_DUP2 agrega a lo mas uno
+  pcb->heredados = scratch_alloc (&pcb->scratch, max * sizeof *pcb->heredados);
+  if (pcb->heredados == NULL)
+    return false;
+  for (fd = 0; fd < p->descriptores_cnt; fd++) {
+    struct descriptor *descriptor = p->descriptores[fd];
+    if (descriptor != NULL && descriptor->pipe != NULL) {
+      struct descriptor_heredado *h = &pcb->heredados[pcb->heredados_cnt++];
+      h->fd = fd;
+      h->file = NULL;
+      h->pipe = descriptor->pipe;
+      h->escribe = descriptor->escribe;
+      pipe_open (h->pipe, h->escribe);
+    }
+  }
+
+  for (i = 0; i < cnt; i++) {
+    const struct accion_spawn *accion = &acciones[i];
+    size_t j;
+    if (accion->tipo == SPAWN_DUP2) {
+      if (!heredar_dup2 (p, pcb, accion->fd, accion->nuevo)) {
+        break;
+      }
+    } else if (accion->tipo == SPAWN_CLOSE) {
+      for (j = 0; j < pcb->heredados_cnt; j++)
+        if (pcb->heredados[j].fd == accion->fd)
+          break;
+      if (j == pcb->heredados_cnt) {
+        break;
+      }
+      soltar_heredado (pcb, j);
+    } else {
+      break;
+    }
   }
-  if(name){
-    palloc_free_page(name);
+  if (i < cnt) {
+    soltar_heredados (pcb, 0);
+    return false;
   }
-  if(pcb){
-    palloc_free_page(pcb);
+  return true;
+}
+
+/* Agrega a lo que hereda PCB el fd FD del proceso P en el fd NUEVO, en
+   lugar de lo que ya heredaba ahi. Un archivo se reabre con la misma
+   posicion, como en fork. Devuelve false si FD no esta abierto, si NUEVO
+   no es un fd valido o si no hay memoria. */
+static bool
+heredar_dup2 (struct thread *p, struct process_control_block *pcb,
+              int fd, int nuevo)
+{
+  struct descriptor *descriptor;
+  struct descriptor_heredado h;
+  size_t j;
+
+  if (fd < 0 || (size_t) fd >= p->descriptores_cnt
+      || nuevo < 0 || nuevo >= FD_MAX)
+    return false;
+  descriptor = p->descriptores[fd];
+  if (descriptor == NULL)
+    return false;
+
+  h.fd = nuevo;
+  h.file = NULL;
+  h.pipe = descriptor->pipe;
+  h.escribe = descriptor->escribe;
+  if (h.pipe != NULL) {
+    pipe_open (h.pipe, h.escribe);
+  } else {
+    h.file = file_reopen (descriptor->file);
+    if (h.file == NULL)
+      return false;
+    file_seek (h.file, file_tell (descriptor->file));
   }
-  return TID_ERROR;
+
+  for (j = 0; j < pcb->heredados_cnt; j++)
+    if (pcb->heredados[j].fd == nuevo) {
+      soltar_heredado (pcb, j);
+      break;
+    }
+  pcb->heredados[pcb->heredados_cnt++] = h;
+  return true;
+}
+
+/* Cierra el I-esimo de lo que hereda PCB y lo saca de la lista. */
+static void
+soltar_heredado (struct process_control_block *pcb, size_t i)
+{
+  struct descriptor_heredado *h = &pcb->heredados[i];
+
+  if (h->pipe != NULL)
+    pipe_close (h->pipe, h->escribe);
+  else
+    file_close (h->file);
+  *h = pcb->heredados[--pcb->heredados_cnt];
+}
+
+/* Pone en la tabla del proceso actual, el hijo, los pipes y archivos que
+   heredo de PCB. Devuelve false si no hay memoria; los que no pudo poner
+   los cierra. */
+static bool
+instalar_heredados (struct process_control_block *pcb)
+{
+  struct thread *p = thread_current ()->proceso;
+  size_t i;
+
+  lock_acquire (&p->lock_descriptores);
+  for (i = 0; i < pcb->heredados_cnt; i++) {
+    struct descriptor_heredado *h = &pcb->heredados[i];
+    struct descriptor *descriptor = descriptor_alloc (), *anterior;
+    if (descriptor == NULL) {
+      break;
+    }
+    descriptor->file = h->file;
+    descriptor->pipe = h->pipe;
+    descriptor->escribe = h->escribe;
+    if (!descriptor_install_at (descriptor, h->fd, &anterior)) {
+      descriptor_free (descriptor);
+      break;
+    }
+  }
+  lock_release (&p->lock_descriptores);
+  soltar_heredados (pcb, i);
+  return i == pcb->heredados_cnt;
+}
+
+/* Cierra lo heredado de PCB desde el FROM-esimo. */
+static void
+soltar_heredados (struct process_control_block *pcb, size_t from)
+{
+  size_t i;
+
+  for (i = from; i < pcb->heredados_cnt; i++) {
+    struct descriptor_heredado *h = &pcb->heredados[i];
+    if (h->pipe != NULL)
+      pipe_close (h->pipe, h->escribe);
+    else
+      file_close (h->file);
+  }
+  pcb->heredados = NULL;
+  pcb->heredados_cnt = 0;
+}
+
+/* Devuelve un pcb nuevo, con el proceso aun sin iniciar, o NULL si
+   no hay memoria. */
+static struct process_control_block *
+pcb_alloc (void)
+{
+  struct process_control_block *pcb = kmem_cache_alloc(pcb_cache);
+  if(pcb == NULL){
+    return NULL;
+  }
+  pcb->pid = -2;
+  pcb->cmdline = NULL;
+  scratch_init(&pcb->scratch, MEM_PROCESS);
+  pcb->asincrono = false;
+  pcb->restaurar = false;
+  pcb->directorio = NULL;
+  pcb->heredados = NULL;
+  pcb->heredados_cnt = 0;
+  pcb->registrado = false;
+  pcb->en_tabla = false;
+  pcb->esperando = false;
+  pcb->terminado = false;
+  pcb->proceso_padre = NULL;
+  pcb->exit_code = -1;
+  list_init(&pcb->hilos);
+  pcb->hilos_vivos = 0;
+  pcb->pilas = 0;
+  pcb->muriendo = false;
+  pcb->padre = NULL;
+  pcb->marco = NULL;
+
+  sema_init(&pcb->inicializacion,0);
+  sema_init(&pcb->sin_hilos,0);
+  return pcb;
+}
+
+/* Starts a new process that is a copy of the current one, which
+   resumes from the system call whose registers are in F.  The
+   child gets a copy of the parent's open files, each with its
+   own position, and shares its memory copy-on-write, so only
+   the page tables are copied up front, not the pages.  Only a
+   process with no threads other than the caller's can fork.
+   Returns the child's thread id to the parent, while the child
+   sees 0 in its %eax, or TID_ERROR if the child cannot be
+   created. */
+tid_t
+process_fork (struct intr_frame *f)
+{
+  struct thread *cur = thread_current ();
+  struct process_control_block *pcb;
+  tid_t tid;
+
+  // solo se copia un proceso cuyo unico hilo es el que llama
+  if (cur->proceso != cur || cur->pcb == NULL || cur->pcb->hilos_vivos > 0)
+    return TID_ERROR;
+
+  pcb = pcb_alloc ();
+  if (pcb == NULL)
+    return TID_ERROR;
+  pcb->padre = cur;
+  pcb->marco = f;
+  pcb->proceso_padre = cur;
+
+  tid = thread_create (cur->name, PRI_DEFAULT, start_fork, pcb);
+  if (tid == TID_ERROR)
+    {
+      kmem_cache_free (pcb_cache, pcb);
+      return TID_ERROR;
+    }
+
+  // el hijo copia lo que necesita del padre mientras este espera
+  sema_down (&pcb->inicializacion);
+  pcb->padre = NULL;
+  pcb->marco = NULL;
+
+  tid = pcb->pid;
+  if (tid >= 0)
+    registrar_hijo (cur, pcb);
+  else
+    soltar_hijo (pcb);
+  return tid;
+}
+
+/* A thread function that copies the process that called
+   process_fork() and starts the copy running. */
+static void
+start_fork (void *pcb_)
+{
+  struct process_control_block *pcb = pcb_;
+  struct thread *padre = pcb->padre;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = *pcb->marco;
+  bool success = false;
+  int fd;
+#ifndef VM
+  void *upage;
+#endif
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    goto finalizar;
+#ifdef VM
+  if (!page_table_init (t))
+    {
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+      goto finalizar;
+    }
+#endif
+  process_activate ();
+
+  t->heap_inicio = padre->heap_inicio;
+  t->heap_fin = padre->heap_fin;
+
+  // el ejecutable y los archivos se reabren, cada uno con su posicion
+  if (padre->ejecutable != NULL) {
+    t->ejecutable = file_reopen (padre->ejecutable);
+    if (t->ejecutable == NULL) {
+      goto finalizar;
+    }
+    file_deny_write (t->ejecutable);
+  }
+  if (padre->directorio != NULL) {
+    t->directorio = dir_reopen (padre->directorio);
+    if (t->directorio == NULL) {
+      goto finalizar;
+    }
+  }
+  // los fds quedan en los mismos numeros, y los duplicados siguen compartiendo
+  // archivo; los pipes, incluso en los fds de la consola, se comparten con el padre
+  lock_acquire (&t->lock_descriptores);
+  for (fd = 0; (size_t) fd < padre->descriptores_cnt; fd++) {
+    struct descriptor *original = padre->descriptores[fd];
+    struct descriptor *descriptor = NULL, *anterior;
+    int otro;
+    if (original == NULL) {
+      continue;
+    }
+    for (otro = 0; otro < fd && descriptor == NULL; otro++) {
+      if (padre->descriptores[otro] == original) {
+        descriptor = t->descriptores[otro];
+      }
+    }
+    if (descriptor == NULL) {
+      descriptor = descriptor_alloc ();
+      if (descriptor == NULL) {
+        break;
+      }
+      if (original->pipe != NULL) {
+        descriptor->pipe = original->pipe;
+        descriptor->escribe = original->escribe;
+        pipe_open (descriptor->pipe, descriptor->escribe);
+      } else {
+        descriptor->file = file_reopen (original->file);
+        if (descriptor->file == NULL) {
+          descriptor_free (descriptor);
+          break;
+        }
+        file_seek (descriptor->file, file_tell (original->file));
+      }
+    }
+    if (!descriptor_install_at (descriptor, fd, &anterior)) {
+      if (descriptor->refs == 0) {
+        descriptor_close (descriptor);
+      }
+      break;
+    }
+  }
+  lock_release (&t->lock_descriptores);
+  if ((size_t) fd < padre->descriptores_cnt) {
+    goto finalizar;
+  }
+
+  // la memoria se comparte copy-on-write, sin copiar ninguna pagina
+#ifdef VM
+  success = page_fork (padre);
+#else
+  success = true;
+  for (upage = pagedir_next_page (padre->pagedir, NULL);
+       success && upage != NULL;
+       upage = pagedir_next_page (padre->pagedir, (uint8_t *) upage + PGSIZE))
+    success = pagedir_share_page (t->pagedir, padre->pagedir, upage);
+#endif
+
+finalizar:
+  pcb->pid = success ? (tid_t)(t->tid) : -1;
+  t->pcb = pcb;
+
+  // para que continue process_fork
+  sema_up(&pcb->inicializacion);
+
+  if (!success)
+    sys_exit(-1);
+
+  // el hijo regresa de fork con 0, con los demas registros del padre
+  if_.eax = 0;
+  thread_account_cycles (false);
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+#ifdef VM
+/* Numero magico de las imagenes de checkpoint, "CKPT". */
+#define IMAGEN_MAGIC 0x54504b43
+
+/* Mas descriptores abiertos que guarda una imagen. */
+#define IMAGEN_FDS 128
+
+/* Bits de eflags que el proceso puede tener al restaurarse: CF, PF, AF,
+   ZF, SF, DF y OF.  Los demas, como IOPL, no se toman de la imagen. */
+#define IMAGEN_EFLAGS 0xcd5
+
+/* Descriptor abierto guardado en una imagen. */
+struct imagen_fd {
+  int fd;
+  int igual;                   // fd anterior con el mismo descriptor, o -1
+  block_sector_t inumero;      // inode del archivo, si igual es -1
+  off_t pos;                   // posicion en el archivo
+};
+
+/* Primera pagina de una imagen de checkpoint.  Las paginas del proceso
+   van despues, como las escribe page_save(). */
+struct imagen {
+  uint32_t magic;              // IMAGEN_MAGIC
+  char nombre[16];             // nombre del thread
+  struct intr_frame marco;     // registros al llamar checkpoint
+  uint8_t *heap_inicio;
+  uint8_t *heap_fin;
+  block_sector_t directorio;   // inode del directorio de trabajo, 0 es la raiz
+  size_t paginas_cnt;          // paginas en la tabla de page_save()
+  size_t fds_cnt;
+  struct imagen_fd fds[IMAGEN_FDS];
+};
+
+/* Guarda el proceso actual, que llamo checkpoint con los registros F, en
+   una imagen en ARCHIVO, que se crea de nuevo, para que process_restore()
+   lo continue luego desde esa llamada.  Como en fork, solo se guarda un
+   proceso cuyo unico hilo es el que llama, y sin pipes, archivos mapeados
+   ni memoria compartida, que no se pueden reabrir.  Hay que tener
+   lock_descriptores.  Devuelve 0, o -1 si no se pudo. */
+int
+process_checkpoint (struct intr_frame *f, const char *archivo)
+{
+  struct thread *cur = thread_current ();
+  struct imagen *imagen;
+  struct file *file = NULL;
+  int retorno = -1;
+  int fd;
+
+  ASSERT (sizeof *imagen <= PGSIZE);
+
+  if (cur->proceso != cur || cur->pcb == NULL || cur->pcb->hilos_vivos > 0)
+    return -1;
+  imagen = palloc_get_page (PAL_ZERO);
+  if (imagen == NULL)
+    return -1;
+
+  imagen->magic = IMAGEN_MAGIC;
+  strlcpy (imagen->nombre, cur->name, sizeof imagen->nombre);
+  imagen->marco = *f;
+  imagen->heap_inicio = cur->heap_inicio;
+  imagen->heap_fin = cur->heap_fin;
+  if (cur->directorio != NULL)
+    imagen->directorio = inode_get_inumber (dir_get_inode (cur->directorio));
+
+  // los fds de la consola, sin descriptor, se restauran solos
+  for (fd = 0; (size_t) fd < cur->descriptores_cnt; fd++) {
+    struct descriptor *descriptor = cur->descriptores[fd];
+    struct imagen_fd *e;
+    int otro;
+    if (descriptor == NULL) {
+      continue;
+    }
+    if (descriptor->pipe != NULL || imagen->fds_cnt == IMAGEN_FDS) {
+      goto fin;
+    }
+    e = &imagen->fds[imagen->fds_cnt++];
+    e->fd = fd;
+    e->igual = -1;
+    for (otro = 0; otro < fd && e->igual < 0; otro++) {
+      if (cur->descriptores[otro] == descriptor) {
+        e->igual = otro;
+      }
+    }
+    e->inumero = inode_get_inumber (file_get_inode (descriptor->file));
+    e->pos = file_tell (descriptor->file);
+  }
+
+  // una imagen anterior que alguien restauro sigue viva hasta que la cierre
+  filesys_remove (archivo);
+  if (!filesys_create (archivo, 0)) {
+    goto fin;
+  }
+  file = filesys_open (archivo);
+  if (file == NULL || !page_save (file, PGSIZE, &imagen->paginas_cnt)
+      || file_write_at (file, imagen, PGSIZE, 0) != PGSIZE) {
+    goto fin;
+  }
+  retorno = 0;
+
+fin:
+  file_close (file);
+  palloc_free_page (imagen);
+  return retorno;
+}
+
+/* Como process_execute(), pero el proceso nuevo es el que guardo
+   process_checkpoint() en la imagen ARCHIVO, y continua desde su llamada a
+   checkpoint, que le devuelve 1.  Devuelve su pid, o TID_ERROR si la
+   imagen no se pudo restaurar. */
+tid_t
+process_restore (const char *archivo)
+{
+  return iniciar_proceso (archivo, true, true, NULL, 0);
+}
+
+/* Restaura en el proceso actual, recien creado, la imagen de checkpoint
+   ARCHIVO, y deja en IF_ los registros con que el proceso guardado llamo
+   checkpoint.  Sus paginas solo se registran, y se leen de la imagen la
+   primera vez que se tocan, asi que la imagen queda abierta, sin
+   escrituras, como el ejecutable del proceso.  Los archivos se reabren por
+   su numero de inode, asi que no deben haberse borrado desde el
+   checkpoint.  Devuelve false si ARCHIVO no es una imagen o falta
+   memoria. */
+static bool
+restaurar (const char *archivo, struct intr_frame *if_)
+{
+  struct thread *t = thread_current ();
+  struct imagen *imagen = NULL;
+  struct file *file = NULL;
+  bool success = false;
+  size_t i;
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    goto done;
+  if (!page_table_init (t))
+    {
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+      goto done;
+    }
+  process_activate ();
+
+  file = filesys_open (archivo);
+  if (file == NULL)
+    {
+      printf ("restore: %s: open failed\n", archivo);
+      goto done;
+    }
+  file_deny_write (file);
+  imagen = palloc_get_page (0);
+  if (imagen == NULL)
+    goto done;
+  if (file_read_at (file, imagen, PGSIZE, 0) != PGSIZE
+      || imagen->magic != IMAGEN_MAGIC || imagen->fds_cnt > IMAGEN_FDS)
+    {
+      printf ("restore: %s: not a checkpoint image\n", archivo);
+      goto done;
+    }
+  if (!page_restore (file, PGSIZE, imagen->paginas_cnt))
+    goto done;
+  t->heap_inicio = imagen->heap_inicio;
+  t->heap_fin = imagen->heap_fin;
+
+  if (imagen->directorio != 0) {
+    struct dir *dir = dir_open (inode_open (imagen->directorio));
+    if (dir == NULL) {
+      goto done;
+    }
+    dir_close (t->directorio);
+    t->directorio = dir;
+  }
+
+  // los fds quedan en los mismos numeros, y los duplicados comparten archivo
+  lock_acquire (&t->lock_descriptores);
+  for (i = 0; i < imagen->fds_cnt; i++) {
+    const struct imagen_fd *e = &imagen->fds[i];
+    struct descriptor *descriptor, *anterior;
+    if (e->igual >= 0) {
+      descriptor = descriptor_get (e->igual);
+      if (descriptor == NULL) {
+        break;
+      }
+    } else {
+      descriptor = descriptor_alloc ();
+      if (descriptor == NULL) {
+        break;
+      }
+      descriptor->file = file_open (inode_open (e->inumero));
+      if (descriptor->file == NULL) {
+        descriptor_free (descriptor);
+        break;
+      }
+      file_seek (descriptor->file, e->pos);
+    }
+    if (!descriptor_install_at (descriptor, e->fd, &anterior)) {
+      if (descriptor->refs == 0) {
+        descriptor_close (descriptor);
+      }
+      break;
+    }
+    // un pipe heredado en ese fd se cierra, como con dup2
+    if (anterior != NULL) {
+      descriptor_close (anterior);
+    }
+  }
+  lock_release (&t->lock_descriptores);
+  if (i < imagen->fds_cnt) {
+    goto done;
+  }
+
+  // los registros de segmento y los privilegios no se toman de la imagen
+  if_->edi = imagen->marco.edi;
+  if_->esi = imagen->marco.esi;
+  if_->ebp = imagen->marco.ebp;
+  if_->ebx = imagen->marco.ebx;
+  if_->edx = imagen->marco.edx;
+  if_->ecx = imagen->marco.ecx;
+  if_->eax = 1;
+  if_->eip = imagen->marco.eip;
+  if_->esp = imagen->marco.esp;
+  if_->eflags |= imagen->marco.eflags & IMAGEN_EFLAGS;
+  strlcpy (t->name, imagen->nombre, sizeof t->name);
+  t->ejecutable = file;
+  success = true;
+
+ done:
+  if (imagen != NULL)
+    palloc_free_page (imagen);
+  if (!success)
+    file_close (file);
+  return success;
 }
+#endif
 
 /* A thread function that loads a user process and starts it
    running. */
@@ -109,59 +1012,429 @@ start_process (void *file_name_)
 {
   struct process_control_block *pcb = file_name_;
   /* ahora recibe el pcb */
-  char *file_name = (char*)pcb->cmdline;
+  const char *cmdline = pcb->cmdline;
   struct intr_frame if_;
   bool success = false;
-  const char **tokens = NULL;
+  char *file_name;
   struct thread *thread_actual = thread_current();
 
-  tokens = (const char**)palloc_get_page (0);
-  if (tokens == NULL) {
+  thread_actual->directorio = pcb->directorio;
+  pcb->directorio = NULL;
+  if (!instalar_heredados (pcb)) {
+    printf("[Error] Kernel Error: Not enough memory\n");
+    goto finalizar;
+  }
+
+  // solo el nombre del programa se copia aparte, los argumentos van directo
+  // de la linea a la pila
+  cmdline += strspn (cmdline, " ");
+  size_t largo = strcspn (cmdline, " ");
+  file_name = scratch_alloc (&pcb->scratch, largo + 1);
+  if (file_name == NULL) {
     printf("[Error] Kernel Error: Not enough memory\n");
     goto finalizar;
   }
-  char* token;
-  char* ptr;
+  strlcpy (file_name, cmdline, largo + 1);
+
+  /* Initialize interrupt frame and load executable. */
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+#ifdef VM
+  if (pcb->restaurar) {
+    success = restaurar (file_name, &if_);
+    goto finalizar;
+  }
+#endif
+  success = load (file_name, &if_.eip, &if_.esp);
+  
+  // Despues de cargar el stack, ya tenemos esp saved stack pointer, pushamos argumentos
+  if(success) {
+    success = argumentos(cmdline, &if_.esp);
+  } 
 
-  token = strtok_r(file_name, " ", &ptr);
-  int cntArg = 0;
-  while(token != NULL){
-    tokens[cntArg] = token;
-    cntArg++;
-    token = strtok_r(NULL, " ", &ptr);
+finalizar:
+  thread_actual->pcb = pcb;
+  if (pcb->asincrono) {
+    // nadie espera la carga, asi que la memoria temporal la libera el hijo
+    scratch_release(&pcb->scratch);
+    pcb->cmdline = NULL;
+    if (!success)
+      sys_exit(PROCESS_LOAD_FAILED);
   }
 
-  /* Initialize interrupt frame and load executable. */
-  memset (&if_, 0, sizeof if_);
-  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
-  if_.cs = SEL_UCSEG;
-  if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp);
-  
-  // Despues de cargar el stack, ya tenemos esp saved stack pointer, pushamos argumentos
-  if(success) {
-    argumentos(tokens, cntArg, &if_.esp);
-  } 
+  pcb->pid = success ? (tid_t)(thread_actual->tid) : -1;
+  // para que continue process_execute
+  sema_up(&pcb->inicializacion);
+
+  /* If load failed, quit. */
+  if (!success) 
+    sys_exit(-1);
+
+  /* Start the user process by simulating a return from an
+     interrupt, implemented by intr_exit (in
+     threads/intr-stubs.S).  Because intr_exit takes all of its
+     arguments on the stack in the form of a `struct intr_frame',
+     we just point the stack pointer (%esp) to our stack frame
+     and jump to it. */
+  thread_account_cycles (false);
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+size_t process_stack_pages = 2048;
+bool process_print_rusage;
+
+/* Devuelve la direccion de usuario de la pagina de pila del slot SLOT. */
+static void *
+pila_hilo (int slot)
+{
+  return (uint8_t *) PHYS_BASE - (process_stack_pages + slot + 1) * PGSIZE;
+}
+
+/* Returns true if an access to user address ADDR, with the user
+   stack pointer at ESP, looks like a use of the current
+   process's stack that should grow it: ADDR must be within the
+   stack's maximum size and no more than 32 bytes below ESP,
+   which is as far below as PUSHA writes. */
+bool
+process_in_stack (const void *addr, const void *esp)
+{
+  const uint8_t *bottom = (uint8_t *) PHYS_BASE - process_stack_pages * PGSIZE;
+
+  if (thread_current ()->proceso->pagedir == NULL || esp == NULL)
+    return false;
+  return (is_user_vaddr (addr) && (const uint8_t *) addr >= bottom
+          && (const uint8_t *) addr + 32 >= (const uint8_t *) esp);
+}
+
+/* Grows the current process's stack with a zeroed page at UPAGE.
+   Returns true if UPAGE is mapped on return, false if memory
+   runs out. */
+bool
+process_grow_stack (void *upage)
+{
+#ifdef VM
+  // la pagina nueva es anonima, de modo que puede irse a swap
+  page_record_file (upage, NULL, 0, 0, true, false);
+  return page_load (upage, true);
+#else
+  struct thread *proceso = thread_current ()->proceso;
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  enum intr_level old_level;
+  bool instalada, mapeada;
+
+  if (kpage == NULL)
+    return false;
+  // otro hilo del proceso pudo crecerla primero
+  old_level = intr_disable ();
+  instalada = (pagedir_get_page (proceso->pagedir, upage) == NULL
+               && pagedir_set_page (proceso->pagedir, upage, kpage, true));
+  mapeada = instalada || pagedir_get_page (proceso->pagedir, upage) != NULL;
+  intr_set_level (old_level);
+  if (!instalada)
+    palloc_free_page (kpage);
+  return mapeada;
+#endif
+}
+
+/* Moves the current process's break INCREMENT bytes, up or down,
+   and returns the old break.  The heap runs from the end of the
+   program's segments to just below the lowest thread stack.
+   Pages the heap gains are demand-zero with VM, and mapped zeroed
+   right away without it; pages it loses are freed.  Returns
+   (void *) -1, without moving the break, if it would leave the
+   heap or memory runs out. */
+void *
+process_sbrk (intptr_t increment)
+{
+  struct thread *proceso = thread_current ()->proceso;
+  uintptr_t inicio = (uintptr_t) proceso->heap_inicio;
+  uintptr_t limite = (uintptr_t) pila_hilo (HILOS_MAX - 1);
+  uintptr_t viejo, nuevo, upage;
+  void *retorno = (void *) -1;
+
+  lock_acquire (&proceso->lock_descriptores);
+  viejo = (uintptr_t) proceso->heap_fin;
+  if (viejo == 0
+      || (increment >= 0
+          ? (uintptr_t) increment > limite - viejo
+          : -(uintptr_t) increment > viejo - inicio))
+    goto done;
+  nuevo = viejo + increment;
+
+  for (upage = ROUND_UP (viejo, PGSIZE); upage < ROUND_UP (nuevo, PGSIZE);
+       upage += PGSIZE)
+    if (!heap_add_page ((void *) upage))
+      {
+        // se deshace lo que ya crecio
+        while ((upage -= PGSIZE) >= ROUND_UP (viejo, PGSIZE))
+          heap_remove_page ((void *) upage);
+        goto done;
+      }
+  for (upage = ROUND_UP (nuevo, PGSIZE); upage < ROUND_UP (viejo, PGSIZE);
+       upage += PGSIZE)
+    heap_remove_page ((void *) upage);
+
+  proceso->heap_fin = (uint8_t *) nuevo;
+  retorno = (void *) viejo;
+
+ done:
+  lock_release (&proceso->lock_descriptores);
+  return retorno;
+}
+
+/* Adds page UPAGE to the current process's heap.  Returns true
+   if successful, false if memory runs out or UPAGE is already
+   in use. */
+static bool
+heap_add_page (void *upage)
+{
+#ifdef VM
+  return page_record_file (upage, NULL, 0, 0, true, false);
+#else
+  struct thread *proceso = thread_current ()->proceso;
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  enum intr_level old_level;
+  bool instalada;
+
+  if (kpage == NULL)
+    return false;
+  // otro hilo del proceso pudo estar creciendo su pila en el mismo pagedir
+  old_level = intr_disable ();
+  instalada = (pagedir_get_page (proceso->pagedir, upage) == NULL
+               && pagedir_set_page (proceso->pagedir, upage, kpage, true));
+  intr_set_level (old_level);
+  if (!instalada)
+    palloc_free_page (kpage);
+  return instalada;
+#endif
+}
+
+/* Removes page UPAGE, which heap_add_page() added, from the
+   current process's heap and frees it. */
+static void
+heap_remove_page (void *upage)
+{
+#ifdef VM
+  page_remove (upage);
+#else
+  struct thread *proceso = thread_current ()->proceso;
+  enum intr_level old_level = intr_disable ();
+  void *kpage = pagedir_get_page (proceso->pagedir, upage);
+
+  pagedir_clear_page (proceso->pagedir, upage);
+  intr_set_level (old_level);
+  palloc_free_page (kpage);
+#endif
+}
+
+/* Starts a new thread in the current process that begins
+   running in user mode at ENTRY, as if called as ENTRY (FUNC,
+   AUX).  It shares the page directory, the open files and the
+   executable of the process and gets a stack page of its own.
+   Returns the new thread's id, or TID_ERROR if the thread
+   cannot be created. */
+tid_t
+process_thread_spawn (void *entry, void *func, void *aux)
+{
+  struct thread *proceso = thread_current ()->proceso;
+  struct process_control_block *pcb = proceso->pcb;
+  struct hilo *h;
+  enum intr_level old_level;
+  void *kpage;
+  int slot;
+  tid_t tid;
+
+  if (pcb == NULL)
+    return TID_ERROR;
+
+  h = malloc_tagged (sizeof *h, MEM_PROCESS);
+  if (h == NULL)
+    return TID_ERROR;
+
+  // se busca un slot de pila libre
+  old_level = intr_disable ();
+  for (slot = 0; slot < HILOS_MAX; slot++)
+    if ((pcb->pilas & (1u << slot)) == 0)
+      break;
+  if (slot < HILOS_MAX)
+    pcb->pilas |= 1u << slot;
+  intr_set_level (old_level);
+  if (slot == HILOS_MAX)
+    {
+      free (h);
+      return TID_ERROR;
+    }
+
+  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (kpage == NULL
+      || pagedir_get_page (proceso->pagedir, pila_hilo (slot)) != NULL
+      || !pagedir_set_page (proceso->pagedir, pila_hilo (slot), kpage, true))
+    goto error;
+
+  h->tid = TID_ERROR;
+  h->proceso = proceso;
+  h->slot = slot;
+  h->kpage = kpage;
+  h->entry = entry;
+  h->func = func;
+  h->aux = aux;
+  h->terminado = false;
+  h->esperado = false;
+  sema_init (&h->fin, 0);
+
+  old_level = intr_disable ();
+  list_push_back (&pcb->hilos, &h->elem);
+  pcb->hilos_vivos++;
+  intr_set_level (old_level);
+
+  // el hilo puede correr antes de que regresemos, pero nadie mas conoce su tid
+  tid = thread_create (proceso->name, PRI_DEFAULT, start_thread, h);
+  if (tid == TID_ERROR)
+    {
+      old_level = intr_disable ();
+      list_remove (&h->elem);
+      pcb->hilos_vivos--;
+      intr_set_level (old_level);
+      pagedir_clear_page (proceso->pagedir, pila_hilo (slot));
+      goto error;
+    }
+  h->tid = tid;
+  return tid;
+
+error:
+  if (kpage != NULL)
+    palloc_free_page (kpage);
+  old_level = intr_disable ();
+  pcb->pilas &= ~(1u << slot);
+  intr_set_level (old_level);
+  free (h);
+  return TID_ERROR;
+}
+
+/* A thread function that starts a thread created by
+   process_thread_spawn() running in user mode. */
+static void
+start_thread (void *hilo_)
+{
+  struct hilo *h = hilo_;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_;
+  uint32_t *tope;
+
+  cur->proceso = h->proceso;
+  cur->hilo = h;
+  cur->pagedir = h->proceso->pagedir;
+  process_activate ();
+
+  /* Marco de la llamada ENTRY (FUNC, AUX) en el tope de la pila nueva:
+     direccion de retorno nula y luego los dos argumentos. */
+  tope = (uint32_t *) ((uint8_t *) h->kpage + PGSIZE) - 3;
+  tope[0] = 0;
+  tope[1] = (uint32_t) h->func;
+  tope[2] = (uint32_t) h->aux;
+
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = h->entry;
+  if_.esp = (uint8_t *) pila_hilo (h->slot) + PGSIZE - 3 * sizeof (uint32_t);
+
+  // si el proceso murio mientras se creaba el hilo, no se llega a modo usuario
+  process_check_exit ();
+
+  thread_account_cycles (false);
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Waits for thread TID of the current process to terminate.
+   Returns 0 once it has, or -1 immediately if TID is the
+   calling thread, is not a thread started with
+   process_thread_spawn() in this process, or has already been
+   waited for. */
+int
+process_thread_join (tid_t tid)
+{
+  struct thread *cur = thread_current ();
+  struct process_control_block *pcb = cur->proceso->pcb;
+  struct hilo *h = NULL;
+  struct list_elem *e;
+  enum intr_level old_level;
+
+  if (pcb == NULL || tid == cur->tid)
+    return -1;
+
+  old_level = intr_disable ();
+  for (e = list_begin (&pcb->hilos); e != list_end (&pcb->hilos);
+       e = list_next (e))
+    {
+      struct hilo *candidato = list_entry (e, struct hilo, elem);
+      if (candidato->tid == tid)
+        {
+          h = candidato;
+          break;
+        }
+    }
+  if (h == NULL || h->esperado)
+    {
+      intr_set_level (old_level);
+      return -1;
+    }
+  h->esperado = true;
+  intr_set_level (old_level);
+
+  // el semaforo guarda la subida si el hilo ya termino
+  sema_down (&h->fin);
 
-finalizar:
-  pcb->pid = success ? (tid_t)(thread_actual->tid) : -1;
-  thread_actual->pcb = pcb;
+  old_level = intr_disable ();
+  list_remove (&h->elem);
+  intr_set_level (old_level);
+  free (h);
+  return 0;
+}
 
-  // para que continue process_execute
-  sema_up(&pcb->inicializacion);
+/* Terminates the current thread if its process is exiting.
+   Called before returning to user mode, so that once any
+   thread calls exit() the others never run user code again. */
+void
+process_check_exit (void)
+{
+  struct process_control_block *pcb = thread_current ()->proceso->pcb;
 
-  /* If load failed, quit. */
-  if (!success) 
-    sys_exit(-1);
+  if (pcb != NULL && pcb->muriendo)
+    {
+      intr_set_level (INTR_ON);
+      thread_exit ();
+    }
+}
 
-  /* Start the user process by simulating a return from an
-     interrupt, implemented by intr_exit (in
-     threads/intr-stubs.S).  Because intr_exit takes all of its
-     arguments on the stack in the form of a `struct intr_frame',
-     we just point the stack pointer (%esp) to our stack frame
-     and jump to it. */
-  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
-  NOT_REACHED ();
+/* Libera la pila de un hilo de thread_spawn que termina y avisa a
+   quien lo espere.  El pagedir es del thread principal, que no lo
+   destruye hasta que terminan todos sus hilos. */
+static void
+hilo_exit (struct thread *cur)
+{
+  struct hilo *h = cur->hilo;
+  struct process_control_block *pcb = h->proceso->pcb;
+  enum intr_level old_level;
+
+  pagedir_clear_page (cur->pagedir, pila_hilo (h->slot));
+  palloc_free_page (h->kpage);
+  h->kpage = NULL;
+  cur->pagedir = NULL;
+  pagedir_activate (NULL);
+
+  old_level = intr_disable ();
+  pcb->pilas &= ~(1u << h->slot);
+  h->terminado = true;
+  sema_up (&h->fin);
+  if (--pcb->hilos_vivos == 0 && pcb->muriendo)
+    sema_up (&pcb->sin_hilos);
+  intr_set_level (old_level);
 }
 
 /* Waits for thread TID to die and returns its exit status.  If
@@ -176,46 +1449,351 @@ finalizar:
 int
 process_wait (tid_t child_tid) 
 {
-  struct thread *thread_actual = thread_current();
-  struct list *procesos = &(thread_actual->procesos);
+  return process_wait_uso(child_tid, NULL);
+}
+
+/* Como process_wait, y si USO no es NULL y el hijo se recoge, ademas lo
+   llena con el uso de recursos del hijo, que incluye el de los hijos que
+   el a su vez recogio. */
+int
+process_wait_uso (tid_t child_tid, unsigned uso[USO_CAMPOS])
+{
+  struct thread *proceso = thread_current()->proceso;
+  struct process_control_block *pcb;
+  struct process_control_block clave;
+  struct hash_elem *e;
+  int status = -1;
+
+  clave.pid = child_tid;
+  clave.proceso_padre = proceso;
+  lock_acquire(&lock_hijos);
+  e = hash_find(&pcbs, &clave.hash_elem);
+  pcb = e != NULL ? hash_entry(e, struct process_control_block, hash_elem) : NULL;
+  if (pcb != NULL && !pcb->esperando) {
+    pcb->esperando = true;
+    // si el proceso aun esta vivo, se espera a que termine algun hijo
+    while (!pcb->terminado) {
+      cond_wait(&proceso->hijo_termino, &lock_hijos);
+    }
+    if (uso != NULL) {
+      memcpy(uso, pcb->uso, sizeof pcb->uso);
+    }
+    status = recoger_hijo(pcb);
+  }
+  lock_release(&lock_hijos);
+
+  return status;
+}
 
-  struct process_control_block *child_pcb = NULL;
+/* Espera a que termine cualquier hijo del proceso actual por el que
+   nadie mas espera, guarda su codigo de salida en *STATUS y devuelve su
+   pid.  Recoge primero al que termino antes.  Devuelve -1 de inmediato
+   si no queda ningun hijo asi. */
+tid_t
+process_wait_any (int *status)
+{
+  struct thread *proceso = thread_current()->proceso;
   struct list_elem *e;
-  if(!list_empty(procesos)){
-    for (e = list_front(procesos); e != list_end (&procesos); e = list_next (e))
-    {
-      struct process_control_block *pcb = list_entry(e, struct process_control_block, elem);
-      if(pcb->pid == child_tid){
-        child_pcb = pcb;
+
+  lock_acquire(&lock_hijos);
+  for (;;) {
+    bool alguno = false;
+
+    for (e = list_begin(&proceso->terminados); e != list_end(&proceso->terminados);
+         e = list_next(e)) {
+      struct process_control_block *pcb
+        = list_entry(e, struct process_control_block, elem_terminado);
+      if (!pcb->esperando) {
+        tid_t pid = pcb->pid;
+        *status = recoger_hijo(pcb);
+        lock_release(&lock_hijos);
+        return pid;
+      }
+    }
+
+    // solo hace falta recorrer los hijos vivos cuando no hay que recoger
+    for (e = list_begin(&proceso->procesos); e != list_end(&proceso->procesos);
+         e = list_next(e)) {
+      if (!list_entry(e, struct process_control_block, elem)->esperando) {
+        alguno = true;
         break;
       }
     }
+    if (!alguno) {
+      lock_release(&lock_hijos);
+      return -1;
+    }
+    cond_wait(&proceso->hijo_termino, &lock_hijos);
   }
+}
 
-  if(child_pcb == NULL){
-    return -1;
-  } 
-  
-  if (child_pcb->esperando) {
-    return -1;
+/* Devuelve 1 si el hijo PID del proceso actual, o cualquiera de sus
+   hijos si PID es -1, ya termino y wait lo recogeria sin esperar, 0 si
+   aun no, y -1 si no hay tal hijo por el que nadie espere.  Si W no es
+   NULL, antes mete E en la cola que despierta la muerte de cualquier
+   hijo, a nombre de W. */
+int
+process_poll_child (tid_t pid, struct poll_waiter *w, struct poll_entry *e)
+{
+  struct thread *proceso = thread_current()->proceso;
+  struct list_elem *el;
+  int listo = -1;
+
+  lock_acquire(&lock_hijos);
+  if (w != NULL) {
+    poll_add(w, e, &proceso->hijos_poll);
+  }
+  if (pid != -1) {
+    struct process_control_block clave;
+    struct hash_elem *he;
+
+    clave.pid = pid;
+    clave.proceso_padre = proceso;
+    he = hash_find(&pcbs, &clave.hash_elem);
+    if (he != NULL) {
+      struct process_control_block *pcb
+        = hash_entry(he, struct process_control_block, hash_elem);
+      if (!pcb->esperando) {
+        listo = pcb->terminado;
+      }
+    }
   } else {
-    child_pcb->esperando = true;
+    for (el = list_begin(&proceso->terminados); el != list_end(&proceso->terminados)
+         && listo != 1; el = list_next(el)) {
+      if (!list_entry(el, struct process_control_block, elem_terminado)->esperando) {
+        listo = 1;
+      }
+    }
+    for (el = list_begin(&proceso->procesos); el != list_end(&proceso->procesos)
+         && listo == -1; el = list_next(el)) {
+      if (!list_entry(el, struct process_control_block, elem)->esperando) {
+        listo = 0;
+      }
+    }
+  }
+  lock_release(&lock_hijos);
+
+  return listo;
+}
+
+/* Mete el PCB de un hijo recien creado, cuyo pid ya se conoce, en la
+   tabla de pcbs y en la lista de PADRE.  Si el hijo ya termino, tambien
+   en la de los que terminaron.  Los tids se reciclan, asi que un hijo
+   viejo que termino sin que nadie lo esperara puede tener el mismo pid:
+   ese se descarta, ya que wait no los distinguiria, salvo que alguien
+   ya lo este recogiendo, y entonces al nuevo solo lo recoge wait_any. */
+static void
+registrar_hijo (struct thread *padre, struct process_control_block *pcb)
+{
+  struct hash_elem *viejo;
+
+  lock_acquire(&lock_hijos);
+  pcb->registrado = pcb->en_tabla = true;
+  viejo = hash_insert(&pcbs, &pcb->hash_elem);
+  if (viejo != NULL) {
+    struct process_control_block *otro
+      = hash_entry(viejo, struct process_control_block, hash_elem);
+    if (otro->esperando) {
+      pcb->en_tabla = false;
+    } else {
+      ASSERT(otro->terminado);
+      hash_replace(&pcbs, &pcb->hash_elem);
+      otro->en_tabla = false;
+      recoger_hijo(otro);
+    }
+  }
+  list_push_back(&padre->procesos, &pcb->elem);
+  if (pcb->terminado) {
+    list_push_back(&padre->terminados, &pcb->elem_terminado);
   }
-  // si el proceso aun esta vivo, entonces usamos el semaforo
-  if(!child_pcb->terminado){
-    sema_down(&(child_pcb->esperar));
+  lock_release(&lock_hijos);
+}
+
+/* El padre ya no esperara jamas al hijo de PCB, cuyo programa o fork
+   fallo: libera el pcb si el hijo ya termino, y si no, lo libera el hijo
+   al terminar. */
+static void
+soltar_hijo (struct process_control_block *pcb)
+{
+  lock_acquire(&lock_hijos);
+  if (pcb->terminado) {
+    liberar_pcb(pcb);
+  } else {
+    pcb->proceso_padre = NULL;
   }
-  ASSERT(child_pcb->terminado == true);
-  ASSERT(e != NULL);
-  // una vez regrese se quita el proceso por el que hay que esperar y se regresa el
-  // codigo de salida de dicho proceso
-  list_remove(e);
-  int status = child_pcb->exit_code;
-  palloc_free_page(child_pcb);
+  lock_release(&lock_hijos);
+}
 
+/* Quita PCB, de un hijo que ya termino, de la tabla y de las listas de
+   su padre, suma su uso de recursos al de los hijos del padre, lo libera
+   y devuelve su codigo de salida.  Se debe tener LOCK_HIJOS. */
+static int
+recoger_hijo (struct process_control_block *pcb)
+{
+  int status = pcb->exit_code;
+
+  ASSERT(pcb->terminado && pcb->registrado);
+  sumar_uso(pcb->proceso_padre->uso_hijos, pcb->uso);
+  list_remove(&pcb->elem);
+  list_remove(&pcb->elem_terminado);
+  liberar_pcb(pcb);
   return status;
 }
 
+/* Saca de la tabla y de la lista de su padre, que termina, al hijo
+   de PCB, y lo libera si ya termino; si no, lo libera el hijo al
+   terminar, porque ya nadie lo puede esperar.  Se debe tener
+   LOCK_HIJOS. */
+static void
+huerfano (struct process_control_block *pcb)
+{
+  list_remove(&pcb->elem);
+  if (pcb->en_tabla) {
+    hash_delete(&pcbs, &pcb->hash_elem);
+    pcb->en_tabla = false;
+  }
+  pcb->registrado = false;
+  pcb->proceso_padre = NULL;
+  if (pcb->terminado) {
+    liberar_pcb(pcb);
+  }
+}
+
+/* Libera PCB, que ya no esta en ninguna lista, y lo quita de la tabla
+   si esta en ella.  Se debe tener LOCK_HIJOS. */
+static void
+liberar_pcb (struct process_control_block *pcb)
+{
+  if (pcb->en_tabla) {
+    hash_delete(&pcbs, &pcb->hash_elem);
+  }
+  kmem_cache_free(pcb_cache, pcb);
+}
+
+/* Llena USO, en el orden de struct rusage, con el uso de recursos de
+   PROCESO, el thread principal de un proceso, sin el de sus hijos. */
+void
+process_uso (struct thread *proceso, unsigned uso[USO_CAMPOS])
+{
+  uso[0] = proceso->fallas_menores;
+  uso[1] = proceso->fallas_mayores;
+  uso[2] = proceso->fallas_cow;
+  uso[3] = proceso->fallas_pila;
+  uso[4] = proceso->desalojos;
+  uso[5] = proceso->marcos;
+  uso[6] = proceso->marcos_pico;
+  uso[7] = proceso->ticks_usuario;
+  uso[8] = proceso->ticks_kernel;
+  uso[9] = proceso->llamadas;
+  uso[10] = proceso->sectores_leidos;
+  uso[11] = proceso->sectores_escritos;
+  uso[12] = proceso->paginas_grandes;
+}
+
+/* Suma USO, de un proceso que ya termino, a TOTAL.  De los marcos no
+   queda ninguno, asi que solo cuenta el pico, el mayor de todos. */
+static void
+sumar_uso (unsigned total[USO_CAMPOS], const unsigned uso[USO_CAMPOS])
+{
+  for (int i = 0; i < USO_CAMPOS; i++) {
+    if (i == 6) {
+      total[i] = uso[i] > total[i] ? uso[i] : total[i];
+    } else if (i != 5) {
+      total[i] += uso[i];
+    }
+  }
+}
+
+/* Procesos que muestra process_print_stats como maximo. */
+#define ESTADISTICAS_MAX 128
+
+/* Lo que process_print_stats copia de un proceso. */
+struct estadistica {
+  tid_t pid;
+  char nombre[16];
+  unsigned uso[USO_CAMPOS];
+};
+
+/* Lista de copias que llena copiar_estadistica. */
+struct estadisticas {
+  struct estadistica *copias;
+  int cnt;                      // procesos vistos, aunque no quepan
+};
+
+/* Copia el uso de T a AUX, una struct estadisticas, si T es el thread
+   principal de un proceso de usuario. */
+static void
+copiar_estadistica (struct thread *t, void *aux)
+{
+  struct estadisticas *e = aux;
+  if (t->proceso != t || t->pagedir == NULL) {
+    return;
+  }
+  if (e->cnt < ESTADISTICAS_MAX) {
+    struct estadistica *c = &e->copias[e->cnt];
+    c->pid = t->tid;
+    strlcpy(c->nombre, t->name, sizeof c->nombre);
+    process_uso(t, c->uso);
+  }
+  e->cnt++;
+}
+
+/* Imprime una linea con el uso de recursos de cada proceso vivo, de
+   una copia que se toma antes de imprimir, para que imprimir no la
+   cambie.  thread_foreach() recorre los threads con RCU, asi que no
+   hace falta apagar las interrupciones. */
+void
+process_print_stats (void)
+{
+  struct estadisticas e;
+
+  e.copias = malloc(ESTADISTICAS_MAX * sizeof *e.copias);
+  if (e.copias == NULL) {
+    return;
+  }
+  e.cnt = 0;
+  thread_foreach(copiar_estadistica, &e);
+
+  for (int i = 0; i < e.cnt && i < ESTADISTICAS_MAX; i++) {
+    const struct estadistica *c = &e.copias[i];
+    printf("Process %d (%s): %u minor faults, %u major, %u copy-on-write, "
+           "%u stack, %u evictions, %u frames (%u peak), %u user ticks, "
+           "%u kernel ticks, %u syscalls, %u sectors read, %u written\n",
+           c->pid, c->nombre, c->uso[0], c->uso[1], c->uso[2], c->uso[3],
+           c->uso[4], c->uso[5], c->uso[6], c->uso[7], c->uso[8],
+           c->uso[9], c->uso[10], c->uso[11]);
+  }
+  if (e.cnt > ESTADISTICAS_MAX) {
+    printf("Process: %d more not shown\n", e.cnt - ESTADISTICAS_MAX);
+  }
+  free(e.copias);
+}
+
+/* Devuelve el hash del padre y el pid del pcb E. */
+static unsigned
+pcb_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct process_control_block *pcb
+    = hash_entry(e, struct process_control_block, hash_elem);
+  return hash_int(pcb->pid ^ (int) (uintptr_t) pcb->proceso_padre);
+}
+
+/* Devuelve true si el pcb A va antes que el pcb B, por padre y luego
+   por pid. */
+static bool
+pcb_less (const struct hash_elem *a_, const struct hash_elem *b_,
+          void *aux UNUSED)
+{
+  const struct process_control_block *a
+    = hash_entry(a_, struct process_control_block, hash_elem);
+  const struct process_control_block *b
+    = hash_entry(b_, struct process_control_block, hash_elem);
+
+  if (a->proceso_padre != b->proceso_padre)
+    return a->proceso_padre < b->proceso_padre;
+  return a->pid < b->pid;
+}
+
 /* Free the current process's resources. */
 void
 process_exit (void)
@@ -223,39 +1801,77 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
-  /* Salir o terminar un proceso cierra implícitamente todos sus descriptores de archivos abiertos,
-   como si llamara a la función close para cada uno. */
-  struct list *descriptores = &cur->descriptores;
-  while(!list_empty(descriptores)){
-    struct list_elem *e = list_pop_front(descriptores);
-    struct descriptor *descriptor = list_entry(e, struct descriptor, elem);
-    file_close(descriptor->file);
-    palloc_free_page(descriptor);
+  // un hilo de thread_spawn solo libera su pila, el resto es del thread principal
+  if (cur->hilo != NULL) {
+    hilo_exit(cur);
+    return;
   }
 
-  /* se liberan los recursos de pcb para cad subproceso */
-  struct list *procesos = &cur->procesos;
-  while (!list_empty(procesos)) {
-    struct list_elem *e = list_pop_front (procesos);
-    struct process_control_block *pcb = list_entry(e, struct process_control_block, elem);
-    // si ya esta terminado se liberan los recursos
-    if(pcb->terminado == true){
-      palloc_free_page(pcb);
-    } else {
-    // si no, entonces set a la variable puedo liberar, para que se libere posterior al semaforo
-      pcb->deboliberar = true;
+  /* antes de liberar el proceso tienen que terminar todos sus hilos, que lo
+     hacen la proxima vez que vayan a regresar a modo usuario */
+  if (cur->pcb != NULL) {
+    enum intr_level old_level = intr_disable();
+    cur->pcb->muriendo = true;
+    if (cur->pcb->hilos_vivos > 0) {
+      sema_down(&cur->pcb->sin_hilos);
+    }
+    intr_set_level(old_level);
+    while (!list_empty(&cur->pcb->hilos)) {
+      struct list_elem *e = list_pop_front(&cur->pcb->hilos);
+      free(list_entry(e, struct hilo, elem));
+    }
+  }
+
+  /* Salir o terminar un proceso cierra implícitamente todos sus descriptores de archivos abiertos,
+   como si llamara a la función close para cada uno. */
+  lock_acquire(&cur->lock_descriptores);
+  for (size_t fd = 0; fd < cur->descriptores_cnt; fd++) {
+    struct descriptor *descriptor = descriptor_remove(fd);
+    if (descriptor != NULL) {
+      descriptor_close(descriptor);
     }
   }
+  free(cur->descriptores);
+  bitmap_destroy(cur->fds_usados);
+  cur->descriptores = NULL;
+  cur->descriptores_cnt = 0;
+  cur->fds_usados = NULL;
+  lock_release(&cur->lock_descriptores);
+  dir_close(cur->directorio);
+  cur->directorio = NULL;
 
   if(cur->ejecutable){
     file_allow_write(cur->ejecutable); // al terminar se tiene que volver a permitir escribir en el archivo
     file_close(cur->ejecutable);
   }
 
-  sema_up(&cur->pcb->esperar);
-  if(cur->pcb->deboliberar){
-    palloc_free_page(&cur->pcb);
+  lock_acquire(&lock_hijos);
+  /* se liberan los recursos de pcb para cad subproceso */
+  struct list *procesos = &cur->procesos;
+  while (!list_empty(procesos)) {
+    huerfano(list_entry(list_front(procesos), struct process_control_block, elem));
+  }
+  list_init(&cur->terminados);
+
+  // el padre lo recoge con wait, y si ya no esta se libera aqui mismo
+  struct process_control_block *pcb = cur->pcb;
+  if (pcb != NULL) {
+    struct thread *padre = pcb->proceso_padre;
+    // los marcos que aun tiene se liberan enseguida
+    process_uso(cur, pcb->uso);
+    pcb->uso[5] = 0;
+    sumar_uso(pcb->uso, cur->uso_hijos);
+    pcb->terminado = true;
+    if (padre == NULL) {
+      liberar_pcb(pcb);
+    } else if (pcb->registrado) {
+      list_push_back(&padre->terminados, &pcb->elem_terminado);
+      cond_broadcast(&padre->hijo_termino, &lock_hijos);
+      poll_wake(&padre->hijos_poll);
+    }
+    cur->pcb = NULL;
   }
+  lock_release(&lock_hijos);
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -268,6 +1884,14 @@ process_exit (void)
          directory before destroying the process's page
          directory, or our active page directory will be one
          that's been freed (and cleared). */
+#ifdef VM
+      // los mapeos escriben lo modificado y luego la tabla de paginas se
+      // destruye antes del pagedir, que todavia necesita quien este
+      // desalojando una de sus paginas
+      mmap_unmap_all ();
+      shm_close_all ();
+      page_table_destroy (cur);
+#endif
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
@@ -282,12 +1906,19 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
+  /* Activate thread's page tables.  This does nothing if they
+     are already active. */
   pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
-     interrupts. */
-  tss_update ();
+     interrupts.  Only a thread with user code can trap from
+     ring 3, the one case where the CPU reads it, so kernel
+     threads leave it for the next user thread to set. */
+  if (t->pagedir != NULL)
+    {
+      tss_update ();
+      kinfo_set_ids (t->proceso->tid, t->tid);
+    }
 }
 
 /* We load ELF binaries.  The following definitions are taken
@@ -353,11 +1984,79 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
+/* A loadable segment of an executable, as load_segment() takes it. */
+struct elf_segment
+  {
+    uint32_t file_page;         /* Offset in the file of its first page. */
+    uint32_t mem_page;          /* User address of its first page. */
+    uint32_t read_bytes;        /* Bytes to read from the file. */
+    uint32_t zero_bytes;        /* Bytes to zero after them. */
+    bool writable;              /* Writable by the process? */
+  };
+
+/* The parsed headers of an executable.  load() caches them in the
+   executable's inode, which drops them if the file is written, so
+   loading the same program again reads and checks no headers. */
+struct elf_info
+  {
+    uint32_t entry;             /* Entry point. */
+    size_t segment_cnt;         /* Number of SEGMENTS. */
+    struct elf_segment segments[]; /* Its loadable segments. */
+  };
+
 static bool setup_stack (void **esp);
+static struct elf_info *parse_elf (struct file *, const char *file_name);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
+#ifndef VM
+/* Pages load_segment() reads with one call at most. */
+#define LOAD_PAGES 16
+
+static void free_pages (void *pages[], size_t start, size_t end);
+#endif
+
+/* Reads the executable header of FILE, from its current
+   position, into *EHDR.  Returns true if it is the header of an
+   executable that load() can load, false otherwise. */
+static bool
+read_ehdr (struct file *file, struct Elf32_Ehdr *ehdr)
+{
+  return (file_read (file, ehdr, sizeof *ehdr) == sizeof *ehdr
+          && !memcmp (ehdr->e_ident, "\177ELF\1\1\1", 7)
+          && ehdr->e_type == 2
+          && ehdr->e_machine == 3
+          && ehdr->e_version == 1
+          && ehdr->e_phentsize == sizeof (struct Elf32_Phdr)
+          && ehdr->e_phnum <= 1024);
+}
+
+/* Devuelve true si el programa de la linea de comandos CMDLINE existe y
+   tiene el encabezado de un ejecutable, sin cargarlo. */
+static bool
+ejecutable_valido (const char *cmdline)
+{
+  struct Elf32_Ehdr ehdr;
+  struct file *file;
+  char *nombre;
+  size_t largo;
+  bool valido;
+
+  cmdline += strspn (cmdline, " ");
+  largo = strcspn (cmdline, " ");
+  nombre = malloc (largo + 1);
+  if (nombre == NULL)
+    return false;
+  strlcpy (nombre, cmdline, largo + 1);
+  file = filesys_open (nombre);
+  free (nombre);
+  if (file == NULL)
+    return false;
+  valido = read_ehdr (file, &ehdr);
+  file_close (file);
+  return valido;
+}
 
 /* Loads an ELF executable from FILE_NAME into the current thread.
    Stores the executable's entry point into *EIP
@@ -367,39 +2066,109 @@ bool
 load (const char *file_name, void (**eip) (void), void **esp) 
 {
   struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
+  struct elf_info *elf;
+  struct inode *inode;
   struct file *file = NULL;
-  off_t file_ofs;
   bool success = false;
-  int i;
+  size_t i;
 
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
+#ifdef VM
+  // process_exit destruye la tabla de paginas junto con el pagedir
+  if (!page_table_init (t))
+    {
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+      goto done;
+    }
+#endif
   process_activate ();
 
-  /* Open executable file. */
+  /* Open executable file.  Writes are denied from the start, so
+     that the headers cached in its inode stay valid. */
   file = filesys_open (file_name);
   if (file == NULL) 
     {
       printf ("load: %s: open failed\n", file_name);
       goto done; 
     }
+  file_deny_write (file);
+
+  /* Use the parsed headers of an earlier load of the same
+     executable, or else read, verify, and cache them. */
+  inode = file_get_inode (file);
+  elf = inode_get_aux (inode);
+  if (elf == NULL)
+    {
+      elf = parse_elf (file, file_name);
+      if (elf == NULL)
+        goto done;
+      if (!inode_set_aux (inode, elf))
+        {
+          free (elf);
+          elf = inode_get_aux (inode);
+        }
+    }
+
+  t->heap_inicio = NULL;
+  for (i = 0; i < elf->segment_cnt; i++)
+    {
+      const struct elf_segment *s = &elf->segments[i];
+      uint8_t *end = (uint8_t *) s->mem_page + s->read_bytes + s->zero_bytes;
+
+      if (!load_segment (file, s->file_page, (void *) s->mem_page,
+                         s->read_bytes, s->zero_bytes, s->writable))
+        goto done;
+      if (end > t->heap_inicio)
+        t->heap_inicio = end;
+    }
+  t->heap_fin = t->heap_inicio;
+
+  /* Set up stack. */
+  if (!setup_stack (esp))
+    goto done;
+
+  /* Start address. */
+  *eip = (void (*) (void)) elf->entry;
+
+  thread_current()->ejecutable = file;
+  success = true;
+
+ done:
+  /* We arrive here whether the load is successful or not. */
+  if (!success)
+    file_close (file);
+  return success;
+}
+
+/* Reads and verifies the executable header and program headers of
+   FILE, the executable FILE_NAME, and returns its loadable
+   segments, allocated with malloc(), or a null pointer if FILE is
+   not a valid executable or memory runs out. */
+static struct elf_info *
+parse_elf (struct file *file, const char *file_name)
+{
+  struct Elf32_Ehdr ehdr;
+  struct elf_info *elf;
+  off_t file_ofs;
+  int i;
 
   /* Read and verify executable header. */
-  if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
-      || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
-      || ehdr.e_type != 2
-      || ehdr.e_machine != 3
-      || ehdr.e_version != 1
-      || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
-      || ehdr.e_phnum > 1024) 
+  if (!read_ehdr (file, &ehdr))
     {
       printf ("load: %s: error loading executable\n", file_name);
-      goto done; 
+      return NULL;
     }
 
+  elf = malloc (sizeof *elf + ehdr.e_phnum * sizeof *elf->segments);
+  if (elf == NULL)
+    return NULL;
+  elf->entry = ehdr.e_entry;
+  elf->segment_cnt = 0;
+
   /* Read program headers. */
   file_ofs = ehdr.e_phoff;
   for (i = 0; i < ehdr.e_phnum; i++) 
@@ -407,11 +2176,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
       struct Elf32_Phdr phdr;
 
       if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
+        goto error;
       file_seek (file, file_ofs);
 
       if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
+        goto error;
       file_ofs += sizeof phdr;
       switch (phdr.p_type) 
         {
@@ -425,55 +2194,42 @@ load (const char *file_name, void (**eip) (void), void **esp)
         case PT_DYNAMIC:
         case PT_INTERP:
         case PT_SHLIB:
-          goto done;
+          goto error;
         case PT_LOAD:
           if (validate_segment (&phdr, file)) 
             {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
+              struct elf_segment *s = &elf->segments[elf->segment_cnt++];
               uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
+
+              s->writable = (phdr.p_flags & PF_W) != 0;
+              s->file_page = phdr.p_offset & ~PGMASK;
+              s->mem_page = phdr.p_vaddr & ~PGMASK;
               if (phdr.p_filesz > 0)
                 {
                   /* Normal segment.
                      Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
+                  s->read_bytes = page_offset + phdr.p_filesz;
+                  s->zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
+                                   - s->read_bytes);
                 }
               else 
                 {
                   /* Entirely zero.
                      Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
+                  s->read_bytes = 0;
+                  s->zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
                 }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
             }
           else
-            goto done;
+            goto error;
           break;
         }
     }
+  return elf;
 
-  /* Set up stack. */
-  if (!setup_stack (esp))
-    goto done;
-
-  /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
-
-  file_deny_write(file);
-  thread_current()->ejecutable = file;
-  success = true;
-
- done:
-  /* We arrive here whether the load is successful or not. */
-  //file_close (file);
-  return success;
+ error:
+  free (elf);
+  return NULL;
 }
 
 /* load() helpers. */
@@ -537,6 +2293,13 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   Without VM, the pages are read LOAD_PAGES at a time with
+   file_read_pages(), so that each run of sectors adjacent on disk
+   reaches the pages with a single request, and only what the file
+   does not fill is zeroed.  With VM, the pages are only recorded
+   in the supplemental page table, and the page fault handler
+   reads each one in the first time the process touches it.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -547,7 +2310,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
+#ifdef VM
   while (read_bytes > 0 || zero_bytes > 0) 
     {
       /* Calculate how to fill this page.
@@ -556,34 +2319,89 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
-      /* Get a page of memory. */
-      uint8_t *kpage = palloc_get_page (PAL_USER);
-      if (kpage == NULL)
+      if (!page_record_file (upage, file, ofs, page_read_bytes, writable,
+                             false))
         return false;
 
-      /* Load this page. */
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
+      /* Advance. */
+      read_bytes -= page_read_bytes;
+      zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
+      upage += PGSIZE;
+    }
+#else
+  while (read_bytes > 0 || zero_bytes > 0) 
+    {
+      /* Calculate how to fill the next PAGE_CNT pages.
+         We will read BATCH_READ_BYTES bytes from FILE
+         and zero the rest. */
+      void *kpages[LOAD_PAGES];
+      size_t page_cnt = (read_bytes + zero_bytes) / PGSIZE;
+      size_t batch_read_bytes;
+      size_t i;
+
+      if (page_cnt > LOAD_PAGES)
+        page_cnt = LOAD_PAGES;
+      batch_read_bytes = read_bytes < page_cnt * PGSIZE
+                         ? read_bytes : page_cnt * PGSIZE;
+
+      /* Get the pages of memory. */
+      for (i = 0; i < page_cnt; i++)
         {
-          palloc_free_page (kpage);
-          return false; 
+          kpages[i] = palloc_get_page (PAL_USER);
+          if (kpages[i] == NULL)
+            {
+              free_pages (kpages, 0, i);
+              return false;
+            }
         }
-      memset (kpage + page_read_bytes, 0, page_zero_bytes);
 
-      /* Add the page to the process's address space. */
-      if (!install_page (upage, kpage, writable)) 
+      /* Load them, zeroing only the tail the file does not fill. */
+      if (file_read_pages (file, kpages, batch_read_bytes, ofs)
+          != (off_t) batch_read_bytes)
         {
-          palloc_free_page (kpage);
+          free_pages (kpages, 0, page_cnt);
           return false; 
         }
+      for (i = 0; i < page_cnt; i++)
+        {
+          size_t filled = 0;
+
+          if (batch_read_bytes > i * PGSIZE)
+            filled = batch_read_bytes - i * PGSIZE;
+          if (filled < PGSIZE)
+            memset ((uint8_t *) kpages[i] + filled, 0, PGSIZE - filled);
+        }
+
+      /* Add the pages to the process's address space. */
+      for (i = 0; i < page_cnt; i++)
+        if (!install_page (upage + i * PGSIZE, kpages[i], writable)) 
+          {
+            free_pages (kpages, i, page_cnt);
+            return false; 
+          }
 
       /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
+      read_bytes -= batch_read_bytes;
+      zero_bytes -= page_cnt * PGSIZE - batch_read_bytes;
+      ofs += batch_read_bytes;
+      upage += page_cnt * PGSIZE;
     }
+#endif
   return true;
 }
 
+#ifndef VM
+/* Frees PAGES[START] through PAGES[END - 1], which load_segment()
+   got but did not install. */
+static void
+free_pages (void *pages[], size_t start, size_t end)
+{
+  for (; start < end; start++)
+    palloc_free_page (pages[start]);
+}
+#endif
+
 /* Create a minimal stack by mapping a zeroed page at the top of
    user virtual memory. */
 static bool
@@ -624,10 +2442,13 @@ install_page (void *upage, void *kpage, bool writable)
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
 
-static void argumentos(const char *tokens[], int cntArg, void** esp){
-  
-   
-  ASSERT(cntArg >= 0);
+/* Pone en la pila de usuario, bajo *ESP, los argumentos de CMDLINE separados
+   por espacios, argv, argc y una direccion de retorno falsa, y deja *ESP en
+   esta ultima. Primero solo cuenta los argumentos y lo que miden, para que
+   luego cada uno vaya en una sola pasada directo de CMDLINE a su lugar en la
+   pila, que crece si no cabe en la pagina que dejo load. Devuelve false si
+   no caben en la pila o no hay memoria. */
+static bool argumentos(const char *cmdline, void** esp){
   /*
     Address	Name	Data	Type
     0xbffffffc	argv[3][...]	bar\0	char[4]
@@ -644,44 +2465,56 @@ static void argumentos(const char *tokens[], int cntArg, void** esp){
     0xbfffffd0	argc	4	int
     0xbfffffcc	return address	0	void (*) ()  
   */
-
-  int i = 0;
-  int t = 0;
-  void* direcciones[cntArg];
-  for(i = 0; i < cntArg; i++){
-    t = strlen(tokens[i])+1;
-    *esp -= t; // cada que metemos algo al stack decrementamos
-    memcpy(*esp, tokens[i], t); // lo metemos al stack y memcpy se encarga de agregar \0
-    direcciones[i] = *esp; // guardamos la direccion donde esta cada argumento
+  const char *p;
+  size_t argc = 0, bytes = 0, i = 0;
+  size_t largo;
+
+  // primera pasada: solo cuenta
+  for (p = cmdline + strspn (cmdline, " "); *p != '\0';
+       p += largo, p += strspn (p, " ")) {
+    largo = strcspn (p, " ");
+    argc++;
+    bytes += largo + 1;
   }
 
-  // alineamos en divisivilidad 4 - word, el binario termina en 00
-  // https://www.cs.umd.edu/~meesh/cmsc311/clin-cmsc311/Lectures/lecture6/alignment.pdf
-  // https://web.stanford.edu/~ouster/cgi-bin/cs140-spring20/pintos/pintos_3.html#SEC51
-  *esp = (void*)((unsigned int)(*esp) & 0xfffffffc);
+  // las cadenas van arriba, y abajo, alineados a 4 bytes, argv con su nulo
+  // final y el marco de la llamada a main
+  uint8_t *tope = *esp;
+  char *cadena = (char *) tope - bytes;
+  char **argv = (char **) ((uintptr_t) cadena & ~(uintptr_t) 3) - (argc + 1);
+  uint32_t *marco = (uint32_t *) argv - 3;
 
-  *esp -= 4; //diminuimos luego de la alineacion
-  *((uint32_t*) *esp) = 0; // parseamos y como es doble puntero, para darle valor 0, debemos ** ir a donde apunta
+  if ((size_t) (tope - (uint8_t *) marco) > process_stack_pages * PGSIZE) {
+    return false;
+  }
+  // load solo mapeo la pagina de arriba
+  uint8_t *pagina;
+  for (pagina = pg_round_down (marco); pagina < tope - PGSIZE;
+       pagina += PGSIZE) {
+    if (!process_grow_stack (pagina)) {
+      return false;
+    }
+  }
 
-  // ahora vamos a guardar las direcciones, en orden ascendente como dice la doc
-  for (i = cntArg - 1; i >= 0; i--) {
-    *esp -= 4; // ahora como ya estamos en word align, entonces decrementamos 4 bytes
-    *((void**) *esp) = direcciones[i]; // como queremos apuntar a la memoria **, y parseamos
+  // segunda pasada: cada argumento directo a su lugar
+  for (p = cmdline + strspn (cmdline, " "); *p != '\0';
+       p += largo, p += strspn (p, " ")) {
+    largo = strcspn (p, " ");
+    memcpy (cadena, p, largo);
+    cadena[largo] = '\0';
+    argv[i++] = cadena;
+    cadena += largo + 1;
   }
+  argv[argc] = NULL;
 
   /*
     Luego, push argv (la dirección de argv [0]) y argc, en ese orden. 
     Finalmente, inserte una "dirección de retorno" falsa: aunque la función de entrada nunca regresará, 
     su marco de pila debe tener la misma estructura que cualquier otro.
   */
-  *esp -= 4;
-  *((void**) *esp) = (*esp + 4);
-
-  //argc es la cantidad de argumentos
-  *esp -= 4;
-  *((int*) *esp) = cntArg;
-
-  *esp-=4;
-  *((int*) *esp) = 0;
-
-};
\ No newline at end of file
+  marco[0] = 0;
+  marco[1] = argc;
+  marco[2] = (uint32_t) argv;
+  *esp = marco;
+  return true;
+}
\ No newline at end of file
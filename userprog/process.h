@@ -1,34 +1,158 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include <hash.h>
 #include "threads/thread.h"
+#include "threads/scratch.h"
 #include "threads/synch.h"
 
-/* elemento de descriptores */
+struct intr_frame;
+
+/* archivo abierto, al que apuntan uno o mas fds de la tabla de descriptores
+   del proceso; los fds duplicados con dup comparten el archivo y su posicion */
 struct descriptor {
-  int id;
-  struct list_elem elem;
+  int refs;                 // fds de la tabla que lo apuntan, y hilos que lo usan
   struct file* file;
+  struct pipe* pipe;        // si no es NULL, file es NULL y es un extremo de este pipe
+  bool escribe;             // el extremo de pipe es el de escritura
+};
+
+/* Extremo de pipe, o archivo reabierto, que un hijo de exec o spawn hereda
+   en el fd FD */
+struct descriptor_heredado {
+  int fd;
+  struct file *file;        // si no es NULL, pipe es NULL
+  struct pipe *pipe;
+  bool escribe;
+};
+
+/* Cambio a los descriptores con que empieza un hijo de
+   process_spawn_actions(), con el formato de struct spawn_action de
+   lib/user/syscall.h. */
+struct accion_spawn {
+  int tipo;                 // SPAWN_DUP2 o SPAWN_CLOSE
+  int fd;                   // fd del padre en SPAWN_DUP2, del hijo en SPAWN_CLOSE
+  int nuevo;                // fd del hijo en SPAWN_DUP2
 };
 
+/* Acciones de struct accion_spawn, los mismos valores de
+   lib/user/syscall.h. */
+#define SPAWN_DUP2 0
+#define SPAWN_CLOSE 1
+
+/* fds 0, 1 y 2 son de la consola, salvo que dup2 ponga ahi otro descriptor;
+   el primer archivo abierto es el 3 */
+#define FD_PRIMERO 3
+/* limite de la tabla de descriptores de un proceso */
+#define FD_MAX 4096
+
+/* Estado de salida de un proceso de process_spawn cuyo programa no
+   se pudo cargar, el mismo EXIT_LOAD_FAILED de lib/user/syscall.h. */
+#define PROCESS_LOAD_FAILED 127
+
+/* Largo maximo de la linea de comandos de exec y spawn, con su nulo.
+   Sus argumentos pueden ocupar varias paginas de la pila. */
+#define PROCESS_CMDLINE_MAX (16 * PGSIZE)
+
 /* PCB */
 struct process_control_block {
   tid_t pid;                
   const char* cmdline;
-  struct list_elem elem;
+  struct scratch scratch;  // memoria temporal del exec, vive hasta que termina la carga
+  bool asincrono;          // de process_spawn, el padre no espera la carga
+  bool restaurar;          // de process_restore, cmdline es una imagen de checkpoint
+  struct dir *directorio;  // directorio de trabajo que el padre le pasa al hijo
+  struct descriptor_heredado *heredados; // lo que hereda el hijo, en scratch
+  size_t heredados_cnt;
+  // todo lo que sigue hasta exit_code lo protege el lock de los hijos de process.c
+  struct list_elem elem;           // en la lista procesos del padre
+  struct hash_elem hash_elem;      // en la tabla de pcbs por pid
+  struct list_elem elem_terminado; // en terminados del padre, ya termino y nadie lo espera
+  bool registrado;    // ya esta en procesos del padre
+  bool en_tabla;      // esta en la tabla; solo no si su pid choco con otro hijo
   bool esperando;     // esta bandera, indica si el proceso padre, va ha esperar
   bool terminado;     // indica si el proceso ya esta terminado
+  // proceso que puede esperarlo; si el padre termina antes queda en NULL
+  // y el hijo libera su pcb al terminar
+  struct thread *proceso_padre;
   int exit_code;      // indica el codigo con el termino el proceso
+  unsigned uso[USO_CAMPOS]; // su uso de recursos al terminar, con el de sus hijos
   struct semaphore inicializacion; 
-  struct semaphore esperar; 
-  // en el caso que el padre no tenga que esperar por sus hijos, entonces el padre no 
-  // debe liberar los recursos de los hijos, en este caso el hijo se encargara de liberarlo
-  bool deboliberar;
+
+  // hilos del proceso creados con thread_spawn, todo protegido apagando interrupciones
+  struct list hilos;          // lista de struct hilo
+  int hilos_vivos;            // hilos que aun no terminan
+  uint32_t pilas;             // bitmap de los slots de pila en uso
+  bool muriendo;              // alguien llamo exit, todos los hilos deben terminar
+  struct semaphore sin_hilos; // el thread principal espera aqui a que terminen los hilos
+
+  // solo mientras el hijo copia al padre, que lo espera
+  struct thread *padre;       // proceso que llamo fork
+  struct intr_frame *marco;   // registros del padre al llamar fork, solo en fork
+};
+
+/* Numero maximo de hilos por proceso, ademas del principal.  El hilo
+   del slot N usa la pagina de pila justo debajo de la del slot N - 1,
+   y el slot 0 justo debajo del tamano maximo de la pila principal. */
+#define HILOS_MAX 32
+
+/* -stack: tamano maximo de la pila principal de cada proceso, en
+   paginas.  La pila crece sola hasta ahi a medida que se usa. */
+extern size_t process_stack_pages;
+
+/* -rusage: imprimir el uso de memoria de cada proceso al terminar,
+   junto a la linea de exit. */
+extern bool process_print_rusage;
+
+/* Registro de un hilo creado con thread_spawn.  Vive en la lista del
+   pcb hasta que otro hilo lo espera con thread_join o hasta que
+   termina el proceso, asi que sobrevive al struct thread. */
+struct hilo {
+  tid_t tid;
+  struct list_elem elem;
+  struct thread *proceso;     // thread principal del proceso
+  int slot;                   // slot de pila
+  void *kpage;                // pagina de la pila en el kernel
+  void *entry;                // punto de entrada en modo usuario
+  void *func;                 // funcion del hilo, argumento de ENTRY
+  void *aux;                  // argumento de FUNC
+  bool terminado;             // el hilo ya termino
+  bool esperado;              // alguien ya hizo thread_join sobre el
+  struct semaphore fin;       // se sube cuando el hilo termina
 };
 
 tid_t process_execute (const char *file_name);
+tid_t process_spawn (const char *file_name);
+tid_t process_spawn_actions (const char *file_name,
+                             const struct accion_spawn *, size_t cnt);
+tid_t process_fork (struct intr_frame *);
+#ifdef VM
+int process_checkpoint (struct intr_frame *, const char *file);
+tid_t process_restore (const char *file);
+#endif
 int process_wait (tid_t);
+int process_wait_uso (tid_t, unsigned uso[USO_CAMPOS]);
+tid_t process_wait_any (int *status);
+int process_poll_child (tid_t, struct poll_waiter *, struct poll_entry *);
+void process_uso (struct thread *proceso, unsigned uso[USO_CAMPOS]);
+void process_print_stats (void);
 void process_exit (void);
 void process_activate (void);
+void process_init (void);
+struct descriptor *descriptor_alloc (void);
+void descriptor_free (struct descriptor *);
+void descriptor_close (struct descriptor *);
+int descriptor_install (struct descriptor *);
+bool descriptor_install_at (struct descriptor *, int fd, struct descriptor **anterior);
+struct descriptor *descriptor_get (int fd);
+struct descriptor *descriptor_remove (int fd);
+void descriptor_ref (struct descriptor *);
+void descriptor_unref (struct descriptor *);
+tid_t process_thread_spawn (void *entry, void *func, void *aux);
+bool process_in_stack (const void *addr, const void *esp);
+bool process_grow_stack (void *upage);
+void *process_sbrk (intptr_t increment);
+int process_thread_join (tid_t);
+void process_check_exit (void);
 
 #endif /* userprog/process.h */
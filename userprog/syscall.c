@@ -1,16 +1,35 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
+#include "threads/kstat.h"
+#include "threads/pmu.h"
 #include "threads/thread.h"
+#include "threads/tsc.h"
 #include "threads/vaddr.h"
 #include "userprog/process.h"
+#include "devices/block.h"
 #include "devices/shutdown.h"
 #include "filesys/filesys.h"
 #include "lib/kernel/list.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
+#include "filesys/inode.h"
 #include "threads/synch.h"
 #include "devices/input.h"
+#include "lib/kernel/intmap.h"
+#include "lib/kernel/histogram.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "userprog/pagedir.h"
+#include "userprog/pipe.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#endif
 
 static void syscall_handler (struct intr_frame *);
 
@@ -21,10 +40,46 @@ static void syscall_handler (struct intr_frame *);
 */
 static int get_user (const uint8_t *uaddr);
 /*
-    Lee bytes (bytes) consecutivos, tomando como base la direccion virtual del usuario
-    UADDR y lo pone en dst, devuelve el numero de bytes leidos o -1 en caso exista page fault
+    Copia SIZE bytes desde la direccion del usuario USRC hasta DST en el kernel.
+    Valida cada pagina una sola vez, leyendo su primer byte con get_user, y
+    copia el resto de a palabras. Devuelve false si alguna pagina no es valida.
 */
-static int get_user_bytes (void *uaddr, void *dst, size_t bytes);
+static bool copy_from_user (void *dst, const void *usrc, size_t size);
+/*
+    Copia SIZE bytes desde SRC en el kernel hasta la direccion del usuario UDST,
+    validando cada pagina una sola vez con put_user de su primer byte. Devuelve
+    false si alguna pagina no es valida o no se puede escribir.
+*/
+static bool copy_to_user (void *udst, const void *src, size_t size);
+/*
+    Copia la cadena del usuario USRC, con su nulo, a DST de SIZE bytes. Devuelve
+    su largo sin el nulo, SIZE si no cabe, o -1 si alguna pagina no es valida.
+*/
+static int strncpy_from_user (char *dst, const char *usrc, size_t size);
+/*
+    Copia la cadena del usuario USTR a una pagina nueva del kernel, que quien
+    llama libera con palloc_free_page. Termina el proceso si la cadena no es
+    valida; devuelve NULL si no hay memoria o la cadena no cabe en una pagina.
+*/
+static char *copiar_cadena (const char *ustr);
+/*
+    Como copiar_cadena, pero para la linea de comandos USTR de exec y spawn,
+    que puede medir hasta PROCESS_CMDLINE_MAX: la copia a PAGINAS paginas
+    nuevas y contiguas, que quien llama libera con palloc_free_multiple.
+*/
+static char *copiar_linea (const char *ustr, size_t *paginas);
+/*
+    Trae a memoria cada pagina del buffer de usuario BUFFER de SIZE bytes, y con
+    VM las fija hasta soltar_buffer, para que esten antes de tomar los locks del
+    sistema de archivos y del disco: un page fault con esos locks tomados no
+    podria leer la pagina. Si ESCRIBIR, las paginas deben ser escribibles.
+    Devuelve false si alguna pagina no es valida.
+*/
+static bool traer_buffer (const void *buffer, unsigned size, bool escribir);
+/*
+    Suelta las paginas que fijo traer_buffer con el mismo BUFFER y SIZE.
+*/
+static void soltar_buffer (const void *buffer, unsigned size);
 /*
     Termina Pintos llamando a shutdown_power_off () (declarado en devices / shutdown.h). 
     Esto debería usarse pocas veces, porque pierde información sobre posibles situaciones de interbloqueo, etc.
@@ -69,6 +124,41 @@ void sys_close(int fd);
     Devuelve un descriptor de archivo dado su id, del thread actual
 */
 static struct descriptor* obtener_descriptor(int fd);
+/*
+    Si DESCRIPTOR es el extremo de un pipe, el de escritura si ESCRIBIR, lo
+    abre una vez mas y lo devuelve, para usarlo ya sin el lock de los
+    descriptores, pues puede esperar a otro hilo del proceso; hay que
+    cerrarlo despues con pipe_close. Si no, devuelve NULL.
+*/
+static struct pipe *tomar_pipe(struct descriptor *descriptor, bool escribir);
+/*
+    Toman y sueltan el lock de la tabla de descriptores del proceso actual.
+    Quien use un descriptor de obtener_descriptor debe tenerlo tomado, para
+    que otro hilo del proceso no lo cierre mientras tanto. El sistema de
+    archivos tiene sus propios locks y no necesita ninguno global.
+*/
+static void tomar_descriptores(void);
+static void soltar_descriptores(void);
+/*
+    Revisa que el buffer de usuario BUFFER de SIZE bytes sea valido y lo trae
+    a memoria con traer_buffer. Devuelve false, sin nada fijado, si no es
+    valido. Un buffer vacio siempre es valido y no fija nada.
+*/
+static bool validar_buffer(const void *buffer, unsigned size, bool escribir);
+/*
+    Suelta lo que fijo validar_buffer con el mismo BUFFER y SIZE.
+*/
+static void soltar_validado(const void *buffer, unsigned size);
+/*
+    Devuelve verdadero si DESCRIPTOR es un directorio abierto.
+*/
+static bool es_directorio(struct descriptor *descriptor);
+/*
+    Devuelve el thread TID del proceso actual, o el actual si TID es 0, o
+    NULL si no es de este proceso. Las interrupciones deben estar apagadas,
+    para que no termine mientras se usa.
+*/
+static struct thread *hilo_del_proceso(tid_t tid);
 /*
     Devuelve el tamaño, en bytes, del archivo abierto como fd.
 */
@@ -80,7 +170,8 @@ int sys_wait(tid_t pid);
 /*
     Lee size bytes del archivo abierto fd en el búfer. Devuelve el número de bytes realmente 
     leídos (0 al final del archivo), o -1 si el archivo no se pudo leer (debido a una condición 
-    distinta al final del archivo). Fd 0 lee desde el teclado usando input_getc ().  
+    distinta al final del archivo). Fd 0 lee desde el teclado usando input_read (),
+    que en modo canonico devuelve al fin de cada linea.
 */
 int sys_read(int fd, void *buffer, unsigned size);
 /*
@@ -97,579 +188,2568 @@ unsigned sys_tell(int fd);
    UDST debe estar por debajo de PHYS_BASE.
    Devuelve verdadero si tiene éxito, falso si ocurrió una falla de segmento */
 static bool put_user(uint8_t *udst, uint8_t byte);
+/*
+    Escribe en T los ciclos de CPU que el proceso actual ha usado en modo
+    usuario y en modo kernel, medidos con el TSC. T es un struct cputime
+    del usuario, dos uint64_t: primero usuario y luego kernel.
+*/
+void sys_cputime(void *t);
+/*
+    Si la palabra en ADDR todavia vale EXPECTED, duerme al thread hasta que
+    otro llame a sys_futex_wake sobre la misma palabra. Devuelve 0 si durmio
+    y lo despertaron, -1 si la palabra ya no valia EXPECTED.
+*/
+int sys_futex_wait(int *addr, int expected);
+/*
+    Despierta hasta N threads que duermen en la palabra ADDR, devuelve
+    cuantos desperto.
+*/
+int sys_futex_wake(int *addr, int n);
+/*
+    Crea un hilo nuevo en el proceso actual, que comparte el pagedir, los
+    descriptores y el ejecutable, con su propia pila. El hilo empieza en
+    ENTRY en modo usuario con FUNC y AUX como argumentos. Devuelve su tid
+    o -1 si no se pudo crear.
+*/
+tid_t sys_thread_spawn(void *entry, void *func, void *aux);
+/*
+    Espera a que termine el hilo TID del proceso actual. Devuelve 0, o -1 si
+    TID no es un hilo del proceso o ya alguien lo espero.
+*/
+int sys_thread_join(tid_t tid);
+/*
+    Termina el hilo actual, sin terminar el proceso. En el thread principal
+    es igual que exit(0).
+*/
+void sys_thread_exit(void);
+/*
+    Copia en BUF, un struct sched_latency de usuario, los histogramas de
+    latencia del scheduler de los threads de prioridad PRIORITY, o de todos
+    si PRIORITY es -1. Devuelve 0, o -1 si PRIORITY no es valida.
+*/
+int sys_sched_latency(int priority, void *buf);
+/*
+    Crea un proceso hijo que es una copia del actual y que continua desde
+    esta misma llamada. La memoria se comparte copy-on-write. Devuelve el pid
+    del hijo al padre y 0 al hijo, o -1 si no se pudo crear.
+*/
+tid_t sys_fork(struct intr_frame *f);
+/*
+    Copia en U, un struct rusage de usuario, el uso de recursos del proceso
+    actual si WHO es RUSAGE_SELF: sus fallas de pagina por tipo, las paginas
+    desalojadas para darle marcos, los marcos que tiene ahora y que llego a
+    tener, sus ticks en modo usuario y en el kernel, sus llamadas al sistema
+    y los sectores que leyo y escribio. Si WHO es RUSAGE_CHILDREN, copia la
+    suma del de los hijos que ya recogio con wait. Devuelve 0, o -1 si WHO no
+    es ninguno de los dos.
+*/
+int sys_getrusage(int who, void *u);
+/*
+    Escribe a disco los datos del archivo abierto FD que todavia estan solo
+    en el cache de bloques. Devuelve 0 si tiene exito, -1 si FD no es un
+    archivo abierto.
+*/
+int sys_fsync(int fd);
+/*
+    Cambia el directorio de trabajo del proceso a DIR, que puede ser relativo o
+    absoluto. Devuelve verdadero si tiene exito, falso en caso contrario.
+*/
+bool sys_chdir(const char *dir);
+/*
+    Crea el directorio llamado DIR, que puede ser relativo o absoluto. Devuelve
+    verdadero si tiene exito, falso si DIR ya existe o si algun directorio
+    anterior en la ruta no existe.
+*/
+bool sys_mkdir(const char *dir);
+/*
+    Lee una entrada del directorio abierto como FD y escribe su nombre en NAME,
+    que debe tener espacio para READDIR_MAX_LEN + 1 bytes. Devuelve verdadero
+    si tiene exito, falso si el directorio ya no tiene entradas o FD no es un
+    directorio. "." y ".." no se devuelven.
+*/
+bool sys_readdir(int fd, char *name);
+/*
+    Devuelve verdadero si FD es un directorio, falso si es un archivo comun.
+*/
+bool sys_isdir(int fd);
+/*
+    Devuelve el numero de inodo del archivo o directorio abierto como FD, o -1
+    si FD no es un descriptor abierto.
+*/
+int sys_inumber(int fd);
+/*
+    Lee SIZE bytes del archivo abierto FD en BUFFER, empezando en OFFSET bytes
+    desde el principio del archivo, sin cambiar la posicion del descriptor.
+    Devuelve el numero de bytes leidos, o -1 si FD no es un archivo abierto.
+*/
+int sys_pread(int fd, void *buffer, unsigned size, unsigned offset);
+/*
+    Escribe SIZE bytes de BUFFER en el archivo abierto FD, empezando en OFFSET
+    bytes desde el principio del archivo, sin cambiar la posicion del
+    descriptor. Devuelve el numero de bytes escritos, o -1 si FD no es un
+    archivo abierto.
+*/
+int sys_pwrite(int fd, const void *buffer, unsigned size, unsigned offset);
+/*
+    Lee o escribe, si ESCRIBIR, el archivo abierto FD desde la posicion del
+    descriptor usando los IOVCNT buffers del arreglo de usuario IOV, uno tras
+    otro, como un solo read o write. Devuelve el total de bytes transferidos,
+    que es menor que la suma de los buffers solo al final del archivo, o -1 si
+    FD no es un archivo abierto o IOVCNT no esta entre 0 y IOV_MAX.
+*/
+int sys_readv_writev(int fd, const void *iov, int iovcnt, bool escribir);
+/*
+    Copia hasta LENGTH bytes del archivo abierto IN_FD, desde su posicion, al
+    archivo abierto OUT_FD, desde la suya, y avanza las dos posiciones. Los
+    datos no pasan por la memoria del usuario. Devuelve el numero de bytes
+    copiados, que es menor que LENGTH al final de IN_FD o si el disco se
+    llena, o -1 si alguno no es un archivo abierto.
+*/
+int sys_copy_file_range(int in_fd, int out_fd, unsigned length);
+/*
+    Lee las siguientes entradas del directorio abierto como FD y las escribe
+    en BUF como registros struct dirent, con el numero de inodo, el tipo y el
+    tamano de cada una, tantas como entren en SIZE bytes. Devuelve el numero
+    de bytes escritos, 0 si el directorio ya no tiene entradas, o -1 si FD no
+    es un directorio. "." y ".." no se devuelven.
+*/
+int sys_getdents(int fd, void *buf, unsigned size);
+/*
+    Reserva en el disco los LENGTH bytes del archivo abierto FD que empiezan
+    en OFFSET, sin escribirlos, y agranda el archivo hasta OFFSET + LENGTH si
+    es mas corto. Devuelve 0 si tiene exito, o -1 si FD no es un archivo
+    abierto o el disco se llena.
+*/
+int sys_fallocate(int fd, unsigned offset, unsigned length);
+/*
+    Cambia el largo del archivo abierto FD a LENGTH bytes, descartando lo que
+    quede despues o agregando ceros. La posicion del descriptor no cambia.
+    Devuelve 0 si tiene exito, o -1 si FD no es un archivo abierto.
+*/
+int sys_ftruncate(int fd, unsigned length);
+/*
+    Copia en BUF, un struct blockstat de usuario, las estadisticas del
+    dispositivo de bloques con el rol ROLE. Devuelve 0, o -1 si ROLE no es
+    un rol valido o ningun dispositivo lo tiene.
+*/
+int sys_blockstat(int role, void *buf);
+/*
+    Cambia como se entrega la entrada de la consola: con MODE igual a
+    TTY_CANONICAL, read() de fd 0 espera una linea completa y devuelve hasta
+    su fin; con TTY_RAW, devuelve lo que haya llegado. Devuelve el modo
+    anterior, o -1 si MODE no es valido.
+*/
+int sys_ttymode(int mode);
+/*
+    Crea un fd nuevo, el menor libre, que apunta al mismo archivo abierto que
+    FD y comparte su posicion. Devuelve el fd nuevo, o -1 si FD no esta
+    abierto o no hay fds libres.
+*/
+int sys_dup(int fd);
+/*
+    Como sys_dup, pero el fd nuevo es NEWFD, que se cierra antes si estaba
+    abierto. Devuelve NEWFD, o -1 si OLDFD no esta abierto o NEWFD no es
+    valido. Si OLDFD y NEWFD son iguales no hace nada. NEWFD puede ser uno
+    de la consola, que vuelve a serlo cuando se cierra.
+*/
+int sys_dup2(int oldfd, int newfd);
+/*
+    Crea un pipe y guarda en FDS, un arreglo de usuario de dos ints, el fd
+    de su extremo de lectura y el de escritura. Leer espera a que haya datos
+    y devuelve 0 cuando ya no queda quien escriba; escribir espera a que haya
+    lugar. Los hijos de exec y spawn heredan los pipes en los mismos fds.
+    Devuelve 0, o -1 si no hay memoria o fds libres.
+*/
+int sys_pipe(int *fds);
+/*
+    Ejecuta hasta TO_SUBMIT operaciones de la cola de envio del anillo de
+    usuario RING, en orden, y deja el resultado de cada una en su cola de
+    terminadas, asi muchas lecturas, escrituras, aperturas y cierres cuestan
+    una sola entrada al kernel. No consume operaciones para las que no hay
+    lugar en la cola de terminadas. Devuelve cuantas ejecuto, o -1 si el
+    anillo no es valido.
+*/
+int sys_ring_enter(void *ring, unsigned to_submit);
+/*
+    Como sys_exec, pero regresa en cuanto el hijo existe, revisando solo el
+    encabezado del ejecutable, sin esperar a que cargue el programa. Si la
+    carga falla despues, el hijo termina con EXIT_LOAD_FAILED, que lo dice
+    wait.
+*/
+tid_t sys_spawn(const char* cmd_line);
+/*
+    Espera a que termine cualquier hijo por el que no espere ya otro wait,
+    el primero que termino si hay varios, guarda su codigo de salida en
+    STATUS, si no es NULL, y devuelve su pid. Devuelve -1 si no queda ningun
+    hijo que esperar.
+*/
+tid_t sys_wait_any(int *status);
+/*
+    Como wait, y ademas copia en U, un struct rusage de usuario, el uso de
+    recursos del hijo PID, que incluye el de los hijos que el recogio.
+*/
+int sys_wait_rusage(tid_t pid, void *u);
+/*
+    Mueve el fin del heap del proceso INCREMENT bytes, hacia arriba o hacia
+    abajo, y devuelve el fin anterior, o (void *) -1 si el heap quedaria
+    fuera de su espacio o falta memoria. Las paginas nuevas se llenan de
+    ceros y las que el heap pierde se liberan.
+*/
+void *sys_sbrk(intptr_t increment);
+/*
+    Copia en COUNTS, un arreglo de usuario de CNT enteros de 64 bits, lo que
+    contaron para el thread actual los contadores de rendimiento que puso
+    -pmu, uno por evento en el orden de -pmu. Devuelve cuantos contadores hay
+    en uso, que puede ser mas que CNT, o 0 si no hay ninguno.
+*/
+int sys_pmu_read(uint64_t *counts, int cnt);
+/*
+    Copia en BUF, de SIZE bytes, el texto de las estadisticas del kernel
+    llamadas NAME (ver threads/kstat.h), terminado en nulo y cortado si no
+    cabe. Devuelve el largo del texto completo, o -1 si NAME no existe.
+*/
+int sys_stat_read(const char *name, char *buf, unsigned size);
+/*
+    Limita el thread TID del proceso actual, o el actual si TID es 0, a
+    correr en las CPUs de MASK, un bit por CPU. Devuelve 0, o -1 si no hay
+    tal thread en el proceso o MASK no tiene ninguna CPU que exista.
+*/
+int sys_sched_setaffinity(tid_t tid, unsigned mask);
+/*
+    Devuelve la mascara de CPUs del thread TID del proceso actual, o del
+    actual si TID es 0, o -1 si no hay tal thread en el proceso.
+*/
+int sys_sched_getaffinity(tid_t tid);
+/*
+    Pone todos los threads del proceso actual, y los que cree despues, en
+    la clase POLICY: SCHED_BATCH para turnos largos que solo corren cuando
+    no hay otro thread listo, o SCHED_NORMAL. Devuelve la clase anterior,
+    o -1 si POLICY no es valida.
+*/
+int sys_sched_setscheduler(int policy);
+/*
+    Devuelve la clase del thread actual, SCHED_NORMAL o SCHED_BATCH.
+*/
+int sys_sched_getscheduler(void);
+/*
+    Duerme al thread actual hasta que CLOCK_MONOTONIC llegue al tiempo de
+    TS, o regresa enseguida si ya paso. Devuelve 0, o -1 si TS no es un
+    tiempo valido.
+*/
+int sys_sleep_until(const void *ts);
+/*
+    Si MS no es negativo, deja que el thread actual despierte hasta MS
+    milisegundos tarde, para juntar su despertar con el de otros. Devuelve
+    la holgura anterior, en milisegundos.
+*/
+int sys_timer_slack(int ms);
+/*
+    Cambia a PRIORITY la prioridad base de todos los threads del proceso
+    PID, que debe ser el actual (o 0) o uno de sus hijos. Como no hay
+    usuarios privilegiados, solo se puede bajar. Devuelve 0, o -1 si no hay
+    tal proceso, PRIORITY no es valida o es mayor que la actual, o se usa
+    MLFQS, que calcula las prioridades por su cuenta.
+*/
+int sys_setpriority(tid_t pid, int priority);
+/*
+    Devuelve la prioridad base del proceso PID, el actual si es 0, o -1
+    si no es el actual ni uno de sus hijos.
+*/
+int sys_getpriority(tid_t pid);
+/*
+    Suma INCREMENT, que no puede ser negativo, al nice de todos los threads
+    del proceso actual, hasta NICE_MAX. Sin MLFQS tambien baja su prioridad
+    base lo mismo, hasta PRI_MIN. Devuelve el nuevo nice, o -1 si
+    INCREMENT es negativo.
+*/
+int sys_nice(int increment);
+/*
+    Cede el resto del turno del thread actual al thread TID, de cualquier
+    proceso, o al proceso TID, que corre enseguida si esta listo y no hay
+    otro mas importante que el. Devuelve 0 despues de que TID cede el CPU,
+    o -1 si no se pudo ceder.
+*/
+int sys_yield_to(tid_t tid);
+/*
+    Espera a que alguno de los CNT objetos de FDS, cada uno un fd o un hijo,
+    este listo para lo que pide su events, o a que pasen TIMEOUT_MS
+    milisegundos, salvo que sea negativo. Llena el revents de cada uno y
+    devuelve cuantos estan listos, 0 si se acabo el tiempo, o -1 si CNT es
+    mayor que POLL_MAX.
+*/
+int sys_poll(void *fds, unsigned cnt, int timeout_ms);
+/*
+    Como spawn, pero el hijo empieza con los descriptores que dicen las CNT
+    acciones de ACCIONES, con el formato de struct spawn_action: SPAWN_DUP2
+    le pasa el fd del padre en otro fd, y SPAWN_CLOSE le quita uno que iba a
+    heredar. Devuelve -1 si CNT es mayor que SPAWN_ACTIONS_MAX o si una
+    accion no es valida.
+*/
+tid_t sys_spawn_actions(const char *cmd_line, const void *acciones, int cnt);
+/*
+    Como open, pero con las opciones de FLAGS: O_DIRECT hace que read y write
+    de sectores enteros, con un buffer alineado a sector, no pasen por el
+    cache de bloques, y O_SEQUENTIAL y O_RANDOM son como fadvise. Devuelve
+    -1 si FLAGS tiene alguna opcion desconocida.
+*/
+int sys_open_flags(const char *file, int flags);
+/*
+    Dice como se va a usar el archivo abierto FD, para que solo ocupe del
+    cache de bloques lo que le hace falta: FADV_SEQUENTIAL lee adelantado
+    todo lo posible y suelta lo que ya leyo, FADV_RANDOM no lee adelantado,
+    FADV_NORMAL vuelve a lo de siempre y FADV_DONTNEED suelta ya lo que
+    tenga en el cache. Devuelve 0, o -1 si FD no es un archivo abierto o
+    ADVICE no es valido.
+*/
+int sys_fadvise(int fd, int advice);
+/*
+    Mueve los datos del archivo abierto FD a la menor cantidad de tramos de
+    sectores contiguos que permita el espacio libre, mientras otros procesos
+    lo siguen leyendo. Devuelve cuantos tramos le quedan, o -1 si FD no es
+    un archivo abierto.
+*/
+int sys_defrag(int fd);
+/*
+    Hace que el archivo abierto DST_FD sea una copia del abierto SRC_FD
+    que comparte sus sectores en el disco hasta que alguno de los dos los
+    escriba, sin copiar datos. Devuelve true si pudo, o false si alguno
+    no es un archivo abierto, son el mismo, o no hay lugar.
+*/
+bool sys_clone_file(int src_fd, int dst_fd);
+/*
+    Lee o escribe, segun ESCRIBIR, SIZE bytes entre FILE, abierto con
+    O_DIRECT, y el buffer de usuario BUFFER, ya fijado, de a una pagina y sin
+    pasar por el cache de bloques. Si BUFFER o SIZE no estan alineados a
+    sector se lee o escribe como siempre.
+*/
+static int transferir_directo(struct file *file, void *buffer, unsigned size,
+                              bool escribir);
+#ifdef VM
+/*
+    Mapea el archivo abierto FD en la memoria del proceso a partir de ADDR.
+    Las paginas se leen del archivo cuando se tocan y solo las modificadas se
+    escriben de vuelta, al desmapear o al terminar el proceso. Devuelve el id
+    del mapeo, o -1 si no se pudo.
+*/
+int sys_mmap(int fd, void *addr);
+/*
+    Desmapea el mapeo MAPPING del proceso actual, escribiendo al archivo las
+    paginas modificadas.
+*/
+void sys_munmap(int mapping);
+/*
+    Abre el segmento de memoria compartida de nombre NAME, creandolo con SIZE
+    bytes de ceros si no existe. Devuelve un id para shm_map, o -1 si no se
+    pudo.
+*/
+int sys_shm_open(const char *name, unsigned size);
+/*
+    Mapea todas las paginas del segmento SHMID a partir de ADDR, con escritura.
+    Devuelve ADDR, o NULL si no se pudo.
+*/
+void *sys_shm_map(int shmid, void *addr);
+/*
+    Desmapea el segmento mapeado en ADDR. Devuelve 0, o -1 si no hay un mapeo
+    que empiece ahi.
+*/
+int sys_shm_unmap(void *addr);
+/*
+    Guarda el proceso actual en el archivo FILE, que se crea de nuevo: sus
+    paginas, sus registros y sus archivos abiertos por numero de inode y
+    posicion. Devuelve 0, y 1 en el proceso que restore empieza desde esa
+    imagen, que continua desde esta misma llamada, o -1 si no se pudo, por
+    ejemplo si el proceso tiene otros hilos, pipes, archivos mapeados o
+    memoria compartida.
+*/
+int sys_checkpoint(struct intr_frame *f, const char *file);
+/*
+    Como sys_exec, pero el hijo es el proceso guardado en la imagen FILE por
+    checkpoint, que lee sus paginas de la imagen solo cuando las toca.
+    Devuelve el pid del hijo, o -1 si no se pudo restaurar.
+*/
+tid_t sys_restore(const char *file);
+#endif
 
-struct lock archivos;
+/* Cola de espera de un futex.  Se identifica por la direccion fisica de
+   la palabra (vista desde el kernel), asi dos procesos que compartan la
+   pagina comparten el futex.  Solo existe mientras tiene waiters. */
+struct futex
+  {
+    int *kaddr;                 /* Direccion de la palabra en el kernel. */
+    struct semaphore sema;      /* Aqui duermen los waiters. */
+    unsigned waiters;           /* Registrados y aun no despertados. */
+    unsigned sleepers;          /* Que aun no regresan de sys_futex_wait. */
+  };
+
+/* Tabla de futexes por KADDR, y el lock que la protege junto con los
+   contadores de cada futex. */
+static struct intmap futexes;
+static struct lock futex_lock;
+
+static int *futex_kaddr(const void *uaddr);
 
 void
 syscall_init (void) 
 {
-  lock_init(&archivos);
+  lock_init(&futex_lock);
+  lock_set_name(&futex_lock, "futex");
+  if (!intmap_init(&futexes, 0)) {
+    PANIC("Not enough memory for the futex table.");
+  }
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
-static void
-syscall_handler (struct intr_frame *f UNUSED) 
-{
-  int sys_code;
-  ASSERT( sizeof(sys_code) == 4 );
-  // validar que sea un puntero valido
-  if (get_user_bytes(f->esp, &sys_code, sizeof(sys_code)) == -1) {
-    if (lock_held_by_current_thread(&archivos)){
-      lock_release (&archivos);
-    }    
-    sys_exit(-1);
-  }
+/*
+    Manejadores de la tabla de llamadas: cada uno desempaqueta los ARGS ya
+    copiados de la pila del usuario, llama a la funcion sys_ que corresponde
+    y devuelve lo que queda en eax.
+*/
+static uint32_t llamar_halt(const uint32_t *a UNUSED, struct intr_frame *f UNUSED){
+  sys_halt();
+  return 0;
+}
 
-  switch (sys_code)
-  {
-    case SYS_HALT:
-      {
-        sys_halt();
-        break;
-      }
-    case SYS_EXIT:
-      {
-        int status;
-      
-        // para leer un argumento en la documentacion
-        // int fd = *((int*)f->esp + 1); <--- esto es sin validar y como parsea a int +1 es 
-        // equivalente a +4 sin parsear 4 bytes
-
-        if(get_user_bytes(f->esp + 4, &status, sizeof(status)) == -1){
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        };
-
-        sys_exit(status);
-        
-        break;
-      }
-    case SYS_WRITE:
-      {
-        int fd;
-        const void* buffer;
-        unsigned size;
-
-        if (get_user_bytes(f->esp + 4, &fd, sizeof(fd)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
+static uint32_t llamar_exit(const uint32_t *a, struct intr_frame *f UNUSED){
+  sys_exit(a[0]);
+  return 0;
+}
 
-        if (get_user_bytes(f->esp + 8, &buffer, sizeof(buffer)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
-        
-        if (get_user_bytes(f->esp + 12, &size, sizeof(size)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
+static uint32_t llamar_exec(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_exec((const char *) a[0]);
+}
 
-        int retorno = sys_write(fd, buffer, size);
-        f->eax = (uint32_t)retorno;
-        break; 
-      }
-    case SYS_EXEC:
-      {
-        void* cmd_line;
-
-        int retorno = get_user_bytes(f->esp + 4, &cmd_line, sizeof(cmd_line));
-        if(retorno == -1){
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
+static uint32_t llamar_wait(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_wait(a[0]);
+}
 
-        retorno = sys_exec((const char*)cmd_line);
-        f->eax = (uint32_t)retorno;
-        break;
-      }
-    case SYS_CREATE:
-      {
-        const char* filename;
-        unsigned initial_size;
-        
-        if (get_user_bytes(f->esp + 4, &filename, sizeof(filename)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
+static uint32_t llamar_create(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_create((const char *) a[0], a[1]);
+}
 
-        if (get_user_bytes(f->esp + 8, &initial_size, sizeof(initial_size)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
+static uint32_t llamar_remove(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_remove((const char *) a[0]);
+}
 
-        bool retorno = sys_create(filename, initial_size);
-        f->eax = retorno;
+static uint32_t llamar_open(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_open((const char *) a[0]);
+}
 
-        break;
-      }
-    case SYS_REMOVE:
-      {
-        const char* filename;
-            
-        if (get_user_bytes(f->esp + 4, &filename, sizeof(filename)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
+static uint32_t llamar_filesize(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_filesize(a[0]);
+}
 
-        bool retorno = sys_remove(filename);
-        f->eax = retorno;
-        break;
-      }
-    case SYS_OPEN:
-      {
-        const char* filename;
-            
-        if (get_user_bytes(f->esp + 4, &filename, sizeof(filename)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
+static uint32_t llamar_read(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_read(a[0], (void *) a[1], a[2]);
+}
 
-        int retorno = sys_open(filename);
-        f->eax = retorno;
-        break;
-      }
-    case SYS_CLOSE:
-      {
-        int fd;
-        if (get_user_bytes(f->esp + 4, &fd, sizeof(fd)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
+static uint32_t llamar_write(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_write(a[0], (const void *) a[1], a[2]);
+}
 
-        sys_close(fd);
-        break;
-      }
-    case SYS_FILESIZE:
-      {
-        int fd;
-        if (get_user_bytes(f->esp + 4, &fd, sizeof(fd)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
+static uint32_t llamar_seek(const uint32_t *a, struct intr_frame *f UNUSED){
+  sys_seek(a[0], a[1]);
+  return 0;
+}
 
-        int retorno = sys_filesize(fd);
-        f->eax = retorno;
-        break;
-      }
-    case SYS_WAIT:
-      {
-        tid_t pid;
-        if (get_user_bytes(f->esp + 4, &pid, sizeof(tid_t)) == -1){
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
+static uint32_t llamar_tell(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_tell(a[0]);
+}
 
-        int retorno = sys_wait(pid);
-        f->eax = retorno;
-        break;
-      }
-    case SYS_READ:
-      {
-        int fd;
-        void* buffer;
-        unsigned size;
-
-        if (get_user_bytes(f->esp + 4, &fd, sizeof(fd)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
+static uint32_t llamar_close(const uint32_t *a, struct intr_frame *f UNUSED){
+  sys_close(a[0]);
+  return 0;
+}
 
-        if (get_user_bytes(f->esp + 8, &buffer, sizeof(buffer)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
-        
-        if (get_user_bytes(f->esp + 12, &size, sizeof(size)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
+#ifdef VM
+static uint32_t llamar_mmap(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_mmap(a[0], (void *) a[1]);
+}
+#endif
+#ifdef VM
+static uint32_t llamar_munmap(const uint32_t *a, struct intr_frame *f UNUSED){
+  sys_munmap(a[0]);
+  return 0;
+}
+#endif
+#ifdef VM
+static uint32_t llamar_shm_open(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_shm_open((const char *) a[0], a[1]);
+}
+#endif
+#ifdef VM
+static uint32_t llamar_shm_map(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_shm_map(a[0], (void *) a[1]);
+}
+#endif
+#ifdef VM
+static uint32_t llamar_shm_unmap(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_shm_unmap((void *) a[0]);
+}
+#endif
+#ifdef VM
+static uint32_t llamar_checkpoint(const uint32_t *a, struct intr_frame *f){
+  return (uint32_t) sys_checkpoint(f, (const char *) a[0]);
+}
+#endif
+#ifdef VM
+static uint32_t llamar_restore(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_restore((const char *) a[0]);
+}
+#endif
 
-        int retorno = sys_read(fd, buffer, size);
-        f->eax = (uint32_t)retorno;
-        break; 
-      }
-    case SYS_SEEK:
-      {
-        int fd;
-        unsigned position;
-
-        if (get_user_bytes(f->esp + 4, &fd, sizeof(fd)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
+static uint32_t llamar_chdir(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_chdir((const char *) a[0]);
+}
 
-        if (get_user_bytes(f->esp + 8, &position, sizeof(position)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
-        
-        sys_seek(fd, position);
-        break; 
-      }
-    case SYS_TELL:
-      {
-        int fd;
-
-        if (get_user_bytes(f->esp + 4, &fd, sizeof(fd)) == -1) {
-          if (lock_held_by_current_thread(&archivos)){
-            lock_release (&archivos);
-          }  
-          sys_exit(-1);
-        }
-        
-        unsigned retorno = sys_tell(fd);
-        f->eax = (uint32_t)retorno;
-        break;
-      }
-    default:
-      printf("[ERROR] system call %d is unimplemented!\n", sys_code);
-      sys_exit(-1);
-      break;
-  }
+static uint32_t llamar_mkdir(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_mkdir((const char *) a[0]);
 }
 
-void sys_halt(void){
-  shutdown_power_off();
+static uint32_t llamar_readdir(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_readdir(a[0], (char *) a[1]);
 }
 
-void sys_exit(int status){
-  /*
-    Siempre que un proceso de usuario finaliza, porque llamó a exit o por cualquier otra razón, 
-    imprima el nombre del proceso y el código de salida, formateado como si estuviera impreso
-    por printf ("%s: exit(%d)\n", ...);
-  */
-  printf("%s: exit(%d)\n", thread_current()->name, status);
+static uint32_t llamar_isdir(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_isdir(a[0]);
+}
 
-  struct process_control_block *pcb = thread_current()->pcb;
-  if(pcb != NULL){
-    pcb->terminado = true;
-    pcb->exit_code = status;
-  } 
-  thread_exit();
+static uint32_t llamar_inumber(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_inumber(a[0]);
 }
 
-static int get_user (const uint8_t *uaddr)
-{
-  // obtuvimos esta funcion de https://web.stanford.edu/~ouster/cgi-bin/cs140-spring20/pintos/pintos_3.html#SEC44
-  // Accessing User Memory
-  if(((void*)uaddr < PHYS_BASE)){
-    int result;
-    asm ("movl $1f, %0; movzbl %1, %0; 1:"
-        : "=&a" (result) : "m" (*uaddr));
-    return result;
-  } else {
-    return -1;
-  }  
+static uint32_t llamar_cputime(const uint32_t *a, struct intr_frame *f UNUSED){
+  sys_cputime((void *) a[0]);
+  return 0;
 }
 
-static int get_user_bytes (void *uaddr, void *dst, size_t bytes){
-  int32_t valor;
-  size_t i; // de acuerdo al size de la estrucutra asi nos vamos moviendo en la memoria
-  for( i = 0; i < bytes; i++){
-    valor = get_user(uaddr + i); // usamos get user para leer el byte
-    if(valor == -1){
-      return -1;
-    } else {
-      *(char*)(dst + i) = valor & 0xff; // solo dejamos pasar el byte hacia dst
-    }
-  }
-  return (int)bytes;
-};
- 
-int sys_write(int fd, const void* buffer, unsigned size){
-  // validamos que no este accesando a memoria que no debe
-  if(get_user((const uint8_t*)buffer) == -1){
-    if (lock_held_by_current_thread(&archivos)){
-      lock_release (&archivos);
-    }  
-    sys_exit(-1);
-  }
-  // final del archivo
-  if(get_user((const uint8_t*)(buffer + size -1)) == -1){
-    if (lock_held_by_current_thread(&archivos)){
-      lock_release (&archivos);
-    }  
-    sys_exit(-1);
-  }
-  lock_acquire(&archivos);
-  int retorno = 0;
-  //Todos nuestros programas de prueba escriben en la consola
-  if(fd == 1){
-    putbuf(buffer, size);
-    retorno = size;
-  } else {
-    // para escribir en un archivo
-    struct descriptor* descriptor = obtener_descriptor(fd);
-    if(descriptor && descriptor->file){
-      retorno = file_write(descriptor->file, buffer, size);
-    } else {
-      retorno = -1;
-    }
-  }
-  lock_release(&archivos);
-  return retorno;
+static uint32_t llamar_futex_wait(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_futex_wait((int *) a[0], a[1]);
 }
 
-tid_t sys_exec(const char* cmd_line){
+static uint32_t llamar_futex_wake(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_futex_wake((int *) a[0], a[1]);
+}
+
+static uint32_t llamar_thread_spawn(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_thread_spawn((void *) a[0], (void *) a[1], (void *) a[2]);
+}
+
+static uint32_t llamar_thread_join(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_thread_join(a[0]);
+}
+
+static uint32_t llamar_thread_exit(const uint32_t *a UNUSED, struct intr_frame *f UNUSED){
+  sys_thread_exit();
+  return 0;
+}
+
+static uint32_t llamar_sched_latency(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_sched_latency(a[0], (void *) a[1]);
+}
+
+static uint32_t llamar_fork(const uint32_t *a UNUSED, struct intr_frame *f){
+  return (uint32_t) sys_fork(f);
+}
+
+static uint32_t llamar_getrusage(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_getrusage(a[0], (void *) a[1]);
+}
+
+static uint32_t llamar_fsync(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_fsync(a[0]);
+}
+
+static uint32_t llamar_pread(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_pread(a[0], (void *) a[1], a[2], a[3]);
+}
+
+static uint32_t llamar_pwrite(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_pwrite(a[0], (const void *) a[1], a[2], a[3]);
+}
+
+static uint32_t llamar_readv(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_readv_writev(a[0], (const void *) a[1], a[2], false);
+}
+
+static uint32_t llamar_writev(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_readv_writev(a[0], (const void *) a[1], a[2], true);
+}
+
+static uint32_t llamar_copy_file_range(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_copy_file_range(a[0], a[1], a[2]);
+}
+
+static uint32_t llamar_getdents(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_getdents(a[0], (void *) a[1], a[2]);
+}
+
+static uint32_t llamar_fallocate(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_fallocate(a[0], a[1], a[2]);
+}
+
+static uint32_t llamar_ftruncate(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_ftruncate(a[0], a[1]);
+}
+
+static uint32_t llamar_blockstat(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_blockstat(a[0], (void *) a[1]);
+}
+
+static uint32_t llamar_ttymode(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_ttymode(a[0]);
+}
+
+static uint32_t llamar_dup(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_dup(a[0]);
+}
+
+static uint32_t llamar_dup2(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_dup2(a[0], a[1]);
+}
+
+static uint32_t llamar_ring_enter(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_ring_enter((void *) a[0], a[1]);
+}
+
+static uint32_t llamar_spawn(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_spawn((const char *) a[0]);
+}
+
+static uint32_t llamar_wait_any(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_wait_any((int *) a[0]);
+}
+
+static uint32_t llamar_wait_rusage(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_wait_rusage(a[0], (void *) a[1]);
+}
+
+static uint32_t llamar_pipe(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_pipe((int *) a[0]);
+}
+
+static uint32_t llamar_sbrk(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_sbrk((intptr_t) a[0]);
+}
+
+static uint32_t llamar_pmu_read(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_pmu_read((uint64_t *) a[0], a[1]);
+}
+static uint32_t llamar_sched_setaffinity(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_sched_setaffinity(a[0], a[1]);
+}
+static uint32_t llamar_sched_getaffinity(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_sched_getaffinity(a[0]);
+}
+static uint32_t llamar_sched_setscheduler(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_sched_setscheduler(a[0]);
+}
+static uint32_t llamar_sched_getscheduler(const uint32_t *a UNUSED, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_sched_getscheduler();
+}
+static uint32_t llamar_sleep_until(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_sleep_until((const void *) a[0]);
+}
+static uint32_t llamar_timer_slack(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_timer_slack(a[0]);
+}
+static uint32_t llamar_setpriority(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_setpriority(a[0], a[1]);
+}
+static uint32_t llamar_getpriority(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_getpriority(a[0]);
+}
+static uint32_t llamar_nice(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_nice(a[0]);
+}
+static uint32_t llamar_yield_to(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_yield_to(a[0]);
+}
+static uint32_t llamar_poll(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_poll((void *) a[0], a[1], a[2]);
+}
+static uint32_t llamar_spawn_actions(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_spawn_actions((const char *) a[0], (const void *) a[1], a[2]);
+}
+static uint32_t llamar_open_flags(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_open_flags((const char *) a[0], a[1]);
+}
+static uint32_t llamar_fadvise(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_fadvise(a[0], a[1]);
+}
+static uint32_t llamar_defrag(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_defrag(a[0]);
+}
+static uint32_t llamar_clone_file(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_clone_file(a[0], a[1]);
+}
+
+static uint32_t llamar_stat_read(const uint32_t *a, struct intr_frame *f UNUSED){
+  return (uint32_t) sys_stat_read((const char *) a[0], (char *) a[1], a[2]);
+}
+
+/* No hace nada: mide el costo de entrar y salir del kernel. */
+static uint32_t llamar_null(const uint32_t *a UNUSED, struct intr_frame *f UNUSED){
+  return 0;
+}
+
+/* Manejador de una llamada al sistema en la tabla. */
+typedef uint32_t manejador_func(const uint32_t *args, struct intr_frame *f);
+
+/* Entrada de la tabla de llamadas al sistema. */
+struct llamada
+  {
+    manejador_func *manejador;  /* Null si la llamada no existe. */
+    int argc;                   /* Argumentos de 4 bytes que recibe. */
+    const char *nombre;         /* Nombre para las estadisticas. */
+  };
+
+/* Tabla de llamadas al sistema, indexada por el numero SYS_. */
+static const struct llamada llamadas[] =
+  {
+    [SYS_HALT] = {llamar_halt, 0, "halt"},
+    [SYS_EXIT] = {llamar_exit, 1, "exit"},
+    [SYS_EXEC] = {llamar_exec, 1, "exec"},
+    [SYS_WAIT] = {llamar_wait, 1, "wait"},
+    [SYS_CREATE] = {llamar_create, 2, "create"},
+    [SYS_REMOVE] = {llamar_remove, 1, "remove"},
+    [SYS_OPEN] = {llamar_open, 1, "open"},
+    [SYS_FILESIZE] = {llamar_filesize, 1, "filesize"},
+    [SYS_READ] = {llamar_read, 3, "read"},
+    [SYS_WRITE] = {llamar_write, 3, "write"},
+    [SYS_SEEK] = {llamar_seek, 2, "seek"},
+    [SYS_TELL] = {llamar_tell, 1, "tell"},
+    [SYS_CLOSE] = {llamar_close, 1, "close"},
+#ifdef VM
+    [SYS_MMAP] = {llamar_mmap, 2, "mmap"},
+#endif
+#ifdef VM
+    [SYS_MUNMAP] = {llamar_munmap, 1, "munmap"},
+#endif
+    [SYS_CHDIR] = {llamar_chdir, 1, "chdir"},
+    [SYS_MKDIR] = {llamar_mkdir, 1, "mkdir"},
+    [SYS_READDIR] = {llamar_readdir, 2, "readdir"},
+    [SYS_ISDIR] = {llamar_isdir, 1, "isdir"},
+    [SYS_INUMBER] = {llamar_inumber, 1, "inumber"},
+    [SYS_CPUTIME] = {llamar_cputime, 1, "cputime"},
+    [SYS_FUTEX_WAIT] = {llamar_futex_wait, 2, "futex_wait"},
+    [SYS_FUTEX_WAKE] = {llamar_futex_wake, 2, "futex_wake"},
+    [SYS_THREAD_SPAWN] = {llamar_thread_spawn, 3, "thread_spawn"},
+    [SYS_THREAD_JOIN] = {llamar_thread_join, 1, "thread_join"},
+    [SYS_THREAD_EXIT] = {llamar_thread_exit, 0, "thread_exit"},
+    [SYS_SCHED_LATENCY] = {llamar_sched_latency, 2, "sched_latency"},
+    [SYS_FORK] = {llamar_fork, 0, "fork"},
+    [SYS_GETRUSAGE] = {llamar_getrusage, 2, "getrusage"},
+    [SYS_FSYNC] = {llamar_fsync, 1, "fsync"},
+    [SYS_PREAD] = {llamar_pread, 4, "pread"},
+    [SYS_PWRITE] = {llamar_pwrite, 4, "pwrite"},
+    [SYS_READV] = {llamar_readv, 3, "readv"},
+    [SYS_WRITEV] = {llamar_writev, 3, "writev"},
+    [SYS_COPY_FILE_RANGE] = {llamar_copy_file_range, 3, "copy_file_range"},
+    [SYS_GETDENTS] = {llamar_getdents, 3, "getdents"},
+    [SYS_FALLOCATE] = {llamar_fallocate, 3, "fallocate"},
+    [SYS_FTRUNCATE] = {llamar_ftruncate, 2, "ftruncate"},
+    [SYS_BLOCKSTAT] = {llamar_blockstat, 2, "blockstat"},
+    [SYS_TTYMODE] = {llamar_ttymode, 1, "ttymode"},
+    [SYS_DUP] = {llamar_dup, 1, "dup"},
+    [SYS_DUP2] = {llamar_dup2, 2, "dup2"},
+    [SYS_RING_ENTER] = {llamar_ring_enter, 2, "ring_enter"},
+    [SYS_SPAWN] = {llamar_spawn, 1, "spawn"},
+    [SYS_WAIT_ANY] = {llamar_wait_any, 1, "wait_any"},
+    [SYS_SBRK] = {llamar_sbrk, 1, "sbrk"},
+    [SYS_PIPE] = {llamar_pipe, 1, "pipe"},
+#ifdef VM
+    [SYS_SHM_OPEN] = {llamar_shm_open, 2, "shm_open"},
+    [SYS_SHM_MAP] = {llamar_shm_map, 2, "shm_map"},
+    [SYS_SHM_UNMAP] = {llamar_shm_unmap, 1, "shm_unmap"},
+#endif
+    [SYS_WAIT_RUSAGE] = {llamar_wait_rusage, 2, "wait_rusage"},
+    [SYS_NULL] = {llamar_null, 0, "null"},
+    [SYS_PMU_READ] = {llamar_pmu_read, 2, "pmu_read"},
+    [SYS_STAT_READ] = {llamar_stat_read, 3, "stat_read"},
+#ifdef VM
+    [SYS_CHECKPOINT] = {llamar_checkpoint, 1, "checkpoint"},
+    [SYS_RESTORE] = {llamar_restore, 1, "restore"},
+#endif
+    [SYS_SCHED_SETAFFINITY] = {llamar_sched_setaffinity, 2, "sched_setaffinity"},
+    [SYS_SCHED_GETAFFINITY] = {llamar_sched_getaffinity, 1, "sched_getaffinity"},
+    [SYS_SCHED_SETSCHEDULER] = {llamar_sched_setscheduler, 1, "sched_setscheduler"},
+    [SYS_SCHED_GETSCHEDULER] = {llamar_sched_getscheduler, 0, "sched_getscheduler"},
+    [SYS_SLEEP_UNTIL] = {llamar_sleep_until, 1, "sleep_until"},
+    [SYS_TIMER_SLACK] = {llamar_timer_slack, 1, "timer_slack"},
+    [SYS_SETPRIORITY] = {llamar_setpriority, 2, "setpriority"},
+    [SYS_GETPRIORITY] = {llamar_getpriority, 1, "getpriority"},
+    [SYS_NICE] = {llamar_nice, 1, "nice"},
+    [SYS_YIELD_TO] = {llamar_yield_to, 1, "yield_to"},
+    [SYS_POLL] = {llamar_poll, 3, "poll"},
+    [SYS_SPAWN_ACTIONS] = {llamar_spawn_actions, 3, "spawn_actions"},
+    [SYS_OPEN_FLAGS] = {llamar_open_flags, 2, "open_flags"},
+    [SYS_FADVISE] = {llamar_fadvise, 2, "fadvise"},
+    [SYS_DEFRAG] = {llamar_defrag, 1, "defrag"},
+    [SYS_CLONE_FILE] = {llamar_clone_file, 2, "clone_file"},
+  };
+
+#define LLAMADAS_CNT (sizeof llamadas / sizeof *llamadas)
+
+/* Mas argumentos que recibe una llamada. */
+#define ARGC_MAX 4
+
+/* Veces que se hizo cada llamada y ciclos del TSC que pasaron dentro de
+   ellas, contando lo que durmieron. Los hilos las actualizan sin lock, asi
+   que son aproximadas; las que no regresan, como exit, no suman ciclos. */
+static uint64_t veces[LLAMADAS_CNT];
+static uint64_t ciclos[LLAMADAS_CNT];
+
+static void
+syscall_handler (struct intr_frame *f) 
+{
+  uint32_t sys_code;
+  uint32_t args[ARGC_MAX];
+  const struct llamada *llamada;
+  uint64_t inicio;
+
+  // un page fault dentro de la llamada necesita el esp de usuario para crecer la pila
+  thread_current()->esp_usuario = f->esp;
+  // validar que sea un puntero valido
+  if (!copy_from_user(&sys_code, f->esp, sizeof sys_code)) {
+    sys_exit(-1);
+  }
+  if (sys_code >= LLAMADAS_CNT || llamadas[sys_code].manejador == NULL) {
+    printf("[ERROR] system call %d is unimplemented!\n", (int) sys_code);
+    sys_exit(-1);
+  }
+  llamada = &llamadas[sys_code];
+  ASSERT (llamada->argc <= ARGC_MAX);
+
+  // todos los argumentos de una vez, justo despues del numero
+  if (!copy_from_user(args, (uint32_t *) f->esp + 1,
+                      llamada->argc * sizeof *args)) {
+    sys_exit(-1);
+  }
+
+  veces[sys_code]++;
+  thread_current()->proceso->llamadas++;
+  inicio = rdtsc();
+  f->eax = llamada->manejador(args, f);
+  ciclos[sys_code] += rdtsc() - inicio;
+}
+
+/* Prints how many times each system call was made and the cycles
+   spent in it, for those made at least once. */
+void
+syscall_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < LLAMADAS_CNT; i++)
+    if (veces[i] > 0)
+      printf ("Syscall %s: %llu calls, %llu cycles\n",
+              llamadas[i].nombre, veces[i], ciclos[i]);
+}
+
+void sys_halt(void){
+  shutdown_power_off();
+}
+
+void sys_exit(int status){
+  /*
+    Siempre que un proceso de usuario finaliza, porque llamó a exit o por cualquier otra razón, 
+    imprima el nombre del proceso y el código de salida, formateado como si estuviera impreso
+    por printf ("%s: exit(%d)\n", ...);
+  */
+  printf("%s: exit(%d)\n", thread_current()->name, status);
+  if (process_print_rusage) {
+    struct thread *proceso = thread_current()->proceso;
+    printf("%s: rusage: %u minor, %u major, %u cow, %u stack faults, "
+           "%u evictions, %u frames, %u peak, %u user, %u kernel ticks, "
+           "%u syscalls, %u sectors read, %u written, %u huge pages\n",
+           thread_current()->name,
+           proceso->fallas_menores, proceso->fallas_mayores,
+           proceso->fallas_cow, proceso->fallas_pila, proceso->desalojos,
+           proceso->marcos, proceso->marcos_pico, proceso->ticks_usuario,
+           proceso->ticks_kernel, proceso->llamadas, proceso->sectores_leidos,
+           proceso->sectores_escritos, proceso->paginas_grandes);
+  }
+
+  // si lo llama un hilo termina todo el proceso; process_exit del thread principal
+  // marca el pcb como terminado cuando ya no queda ningun hilo
+  struct process_control_block *pcb = thread_current()->proceso->pcb;
+  if(pcb != NULL){
+    pcb->exit_code = status;
+    pcb->muriendo = true;
+  } 
+  thread_exit();
+}
+
+static int get_user (const uint8_t *uaddr)
+{
+  // obtuvimos esta funcion de https://web.stanford.edu/~ouster/cgi-bin/cs140-spring20/pintos/pintos_3.html#SEC44
+  // Accessing User Memory
+  if(((void*)uaddr < PHYS_BASE)){
+    int result;
+    asm ("movl $1f, %0; movzbl %1, %0; 1:"
+        : "=&a" (result) : "m" (*uaddr));
+    return result;
+  } else {
+    return -1;
+  }  
+}
+
+/* Copia SIZE bytes de SRC a DST de a 4 bytes, que en x86 no necesitan estar
+   alineados, y los ultimos uno por uno. */
+static void copiar_palabras(void *dst_, const void *src_, size_t size){
+  uint8_t *dst = dst_;
+  const uint8_t *src = src_;
+
+  for (; size >= sizeof (uint32_t); size -= sizeof (uint32_t)) {
+    *(uint32_t *) dst = *(const uint32_t *) src;
+    dst += sizeof (uint32_t);
+    src += sizeof (uint32_t);
+  }
+  while (size-- > 0) {
+    *dst++ = *src++;
+  }
+}
+
+/* Devuelve true si los SIZE bytes desde UADDR estan todos por debajo de
+   PHYS_BASE. */
+static bool rango_de_usuario(const void *uaddr, size_t size){
+  return (uintptr_t) uaddr <= (uintptr_t) PHYS_BASE
+         && size <= (uintptr_t) PHYS_BASE - (uintptr_t) uaddr;
+}
+
+/* Devuelve cuantos de los SIZE bytes desde ADDR caen en su pagina. */
+static size_t en_pagina(const void *addr, size_t size){
+  size_t resto = (uint8_t *) pg_round_down(addr) + PGSIZE - (uint8_t *) addr;
+  return size < resto ? size : resto;
+}
+
+static bool copy_from_user (void *dst_, const void *usrc_, size_t size){
+  uint8_t *dst = dst_;
+  const uint8_t *usrc = usrc_;
+
+  if (!rango_de_usuario(usrc, size)) {
+    return false;
+  }
+  while (size > 0) {
+    // con la pagina ya validada, si VM la desaloja antes de copiar el page
+    // fault la vuelve a traer como en cualquier acceso del kernel
+    size_t n = en_pagina(usrc, size);
+    if (get_user(usrc) == -1) {
+      return false;
+    }
+    copiar_palabras(dst, usrc, n);
+    dst += n;
+    usrc += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool copy_to_user (void *udst_, const void *src_, size_t size){
+  uint8_t *udst = udst_;
+  const uint8_t *src = src_;
+
+  if (!rango_de_usuario(udst, size)) {
+    return false;
+  }
+  while (size > 0) {
+    // escribir el primer byte valida la pagina y resuelve copy-on-write
+    size_t n = en_pagina(udst, size);
+    if (!put_user(udst, *src)) {
+      return false;
+    }
+    copiar_palabras(udst + 1, src + 1, n - 1);
+    udst += n;
+    src += n;
+    size -= n;
+  }
+  return true;
+}
+
+static int strncpy_from_user (char *dst, const char *usrc, size_t size){
+  size_t largo = 0;
+
+  while (largo < size) {
+    size_t n = en_pagina(usrc + largo, size - largo);
+    const char *fin;
+    if ((void *) (usrc + largo) >= PHYS_BASE
+        || get_user((const uint8_t *) usrc + largo) == -1) {
+      return -1;
+    }
+    fin = memchr(usrc + largo, '\0', n);
+    if (fin != NULL) {
+      n = fin - (usrc + largo) + 1;
+    }
+    copiar_palabras(dst + largo, usrc + largo, n);
+    largo += n;
+    if (fin != NULL) {
+      return largo - 1;
+    }
+  }
+  return size;
+}
+
+static char *copiar_cadena (const char *ustr){
+  char *cadena = palloc_get_page(0);
+  int largo;
+
+  if (cadena == NULL) {
+    return NULL;
+  }
+  largo = strncpy_from_user(cadena, ustr, PGSIZE);
+  if (largo == -1) {
+    palloc_free_page(cadena);
+    sys_exit(-1);
+  }
+  if (largo == PGSIZE) {
+    palloc_free_page(cadena);
+    return NULL;
+  }
+  return cadena;
+}
+
+static char *copiar_linea (const char *ustr, size_t *paginas){
+  size_t n;
+
+  // casi todas las lineas caben en una pagina; si no, se intenta de nuevo
+  // con el doble
+  for (n = 1; n * PGSIZE <= PROCESS_CMDLINE_MAX; n *= 2) {
+    char *linea = palloc_get_multiple(0, n);
+    int largo;
+
+    if (linea == NULL) {
+      return NULL;
+    }
+    largo = strncpy_from_user(linea, ustr, n * PGSIZE);
+    if (largo == -1) {
+      palloc_free_multiple(linea, n);
+      sys_exit(-1);
+    }
+    if ((size_t) largo < n * PGSIZE) {
+      *paginas = n;
+      return linea;
+    }
+    palloc_free_multiple(linea, n);
+  }
+  return NULL;
+}
+
+static bool traer_buffer (const void *buffer, unsigned size, bool escribir UNUSED){
+#ifdef VM
+  return page_pin(buffer, size, escribir);
+#else
+  const uint8_t *pagina;
+  // la primera y la ultima ya las revisa quien llama, pero tocarlas de nuevo no cuesta
+  for(pagina = pg_round_down(buffer); pagina < (const uint8_t*)buffer + size; pagina += PGSIZE){
+    // dentro de la primera pagina se toca el buffer mismo, por si es pila por crecer
+    if(get_user(pagina < (const uint8_t*)buffer ? buffer : pagina) == -1){
+      return false;
+    }
+  }
+  return true;
+#endif
+}
+
+static void soltar_buffer (const void *buffer UNUSED, unsigned size UNUSED){
+#ifdef VM
+  page_unpin(buffer, size);
+#endif
+}
+ 
+int sys_write(int fd, const void* buffer, unsigned size){
+  // validamos que no este accesando a memoria que no debe
+  if(!validar_buffer(buffer, size, false)){
+    sys_exit(-1);
+  }
+  int retorno = 0;
+  tomar_descriptores();
+  struct descriptor* descriptor = obtener_descriptor(fd);
+  struct pipe *pipe = tomar_pipe(descriptor, true);
+  if(pipe != NULL){
+    soltar_descriptores();
+    retorno = pipe_write(pipe, buffer, size);
+    pipe_close(pipe, true);
+  } else if(descriptor == NULL && (fd == 1 || fd == 2)){
+    // Todos nuestros programas de prueba escriben en la consola. El buffer
+    // ya quedo fijo en validar_buffer, asi que putbuf lo copia de una vez a
+    // la cola del puerto serie sin tocar ningun lock de archivos
+    soltar_descriptores();
+    putbuf(buffer, size);
+    retorno = size;
+  } else {
+    // para escribir en un archivo
+    // un directorio solo se escribe con mkdir, create y remove
+    if(descriptor && descriptor->file && !es_directorio(descriptor)){
+      // se escribe sin el lock, para que otro hilo no espere al disco
+      descriptor_ref(descriptor);
+      soltar_descriptores();
+      if (file_is_direct(descriptor->file)) {
+        retorno = transferir_directo(descriptor->file, (void *) buffer, size, true);
+      } else {
+        retorno = file_write(descriptor->file, buffer, size);
+      }
+      descriptor_unref(descriptor);
+    } else {
+      soltar_descriptores();
+      retorno = -1;
+    }
+  }
+  soltar_buffer(buffer, size);
+  return retorno;
+}
+
+tid_t sys_exec(const char* cmd_line){
   
-  // cmd_line es un puntero a donde esta el argumento, debemos verificar que sea
-  // valida la direccion
-  if(get_user((const uint8_t*)cmd_line) == -1) {
+  // cmd_line se copia al kernel antes de usarla, asi ninguna de sus paginas
+  // puede fallar con locks tomados; el hijo toma sus argumentos de esta copia
+  size_t paginas;
+  char *linea = copiar_linea(cmd_line, &paginas);
+  if(linea == NULL) {
+    return -1;
+  }
+  tid_t pid = process_execute(linea);
+  palloc_free_multiple(linea, paginas);
+
+  return pid;
+}
+
+tid_t sys_spawn(const char* cmd_line){
+  size_t paginas;
+  char *linea = copiar_linea(cmd_line, &paginas);
+  if(linea == NULL) {
+    return -1;
+  }
+  tid_t pid = process_spawn(linea);
+  palloc_free_multiple(linea, paginas);
+
+  return pid;
+}
+
+/* Limite de acciones de spawn_actions, el mismo valor de lib/user/syscall.h. */
+#define SPAWN_ACTIONS_MAX 16
+
+tid_t sys_spawn_actions(const char *cmd_line, const void *uacciones, int cnt){
+  struct accion_spawn acciones[SPAWN_ACTIONS_MAX];
+  size_t paginas;
+
+  if(cnt < 0 || cnt > SPAWN_ACTIONS_MAX){
+    return -1;
+  }
+  if(!copy_from_user(acciones, uacciones, cnt * sizeof *acciones)){
     sys_exit(-1);
   }
-  lock_acquire(&archivos);
-  tid_t pid = process_execute(cmd_line);
-  lock_release(&archivos);
+  char *linea = copiar_linea(cmd_line, &paginas);
+  if(linea == NULL) {
+    return -1;
+  }
+  tid_t pid = process_spawn_actions(linea, acciones, cnt);
+  palloc_free_multiple(linea, paginas);
+
+  return pid;
+}
+
+bool sys_create(const char *file, unsigned initial_size){
+
+  /* Para las llamadas del sistema que requieran manejo de archivos vamos a usar filesys/filesys.h */
+
+  char *nombre = copiar_cadena(file);
+  if(nombre == NULL){
+    return false;
+  }
+  bool retorno = filesys_create(nombre, initial_size);
+  palloc_free_page(nombre);
+  return retorno;
+}
+
+bool sys_remove(const char *file){
+
+  char *nombre = copiar_cadena(file);
+  if(nombre == NULL){
+    return false;
+  }
+  bool retorno = filesys_remove(nombre);
+  palloc_free_page(nombre);
+  return retorno;
+} 
+
+int sys_open(const char* file) {
+  return sys_open_flags(file, 0);
+}
+
+/* Opciones de open_flags, los mismos valores de lib/user/syscall.h. Los
+   consejos de fadvise alli tienen los valores de enum file_advice. */
+#define O_DIRECT 0x01
+#define O_SEQUENTIAL 0x02
+#define O_RANDOM 0x04
+
+int sys_open_flags(const char* file, int flags) {
+  if ((flags & ~(O_DIRECT | O_SEQUENTIAL | O_RANDOM)) != 0) {
+    return -1;
+  }
+  char *nombre = copiar_cadena(file);
+  if (nombre == NULL) {
+    return -1;
+  }
+  struct file* file_opened;
+  struct descriptor* fd = descriptor_alloc();
+  if(!fd){
+    palloc_free_page(nombre);
+    return -1;
+  }
+
+  file_opened = filesys_open(nombre);
+  palloc_free_page(nombre);
+  if (!file_opened) {
+    descriptor_free(fd);
+    return -1;
+  }
+
+  fd->file = file_opened;
+  file_set_direct(file_opened, (flags & O_DIRECT) != 0);
+  if (flags & O_SEQUENTIAL) {
+    file_advise(file_opened, FILE_ADV_SEQUENTIAL);
+  } else if (flags & O_RANDOM) {
+    file_advise(file_opened, FILE_ADV_RANDOM);
+  }
+
+  // se le da el menor fd libre, 3 si no hay otro abierto
+  tomar_descriptores();
+  int id = descriptor_install(fd);
+  soltar_descriptores();
+
+  if (id == -1) {
+    file_close(file_opened);
+    descriptor_free(fd);
+  }
+  return id;
+}
+
+void sys_close(int fd) {
+  // quitamos el fd del proceso; el archivo se cierra con el ultimo fd que lo apunta
+  tomar_descriptores();
+  struct descriptor* descriptor = descriptor_remove(fd);
+  soltar_descriptores();
+
+  if(descriptor) {
+    // cerramos el archivo o el extremo del pipe y liberamos recursos
+    descriptor_close(descriptor);
+  }
+}
+
+static struct pipe *tomar_pipe(struct descriptor *descriptor, bool escribir){
+  if(descriptor == NULL || descriptor->pipe == NULL
+     || descriptor->escribe != escribir){
+    return NULL;
+  }
+  pipe_open(descriptor->pipe, escribir);
+  return descriptor->pipe;
+}
+
+static void tomar_descriptores(void){
+  lock_acquire(&thread_current()->proceso->lock_descriptores);
+}
+
+static void soltar_descriptores(void){
+  lock_release(&thread_current()->proceso->lock_descriptores);
+}
+
+static bool validar_buffer(const void *buffer, unsigned size, bool escribir){
+  return (size == 0
+          || (get_user((const uint8_t*)buffer) != -1
+              && get_user((const uint8_t*)buffer + size - 1) != -1
+              && traer_buffer(buffer, size, escribir)));
+}
+
+static void soltar_validado(const void *buffer, unsigned size){
+  if(size > 0){
+    soltar_buffer(buffer, size);
+  }
+}
+
+static bool es_directorio(struct descriptor *descriptor){
+  return inode_is_dir(file_get_inode(descriptor->file));
+}
+
+static struct descriptor* obtener_descriptor(int fd){
+  return descriptor_get(fd);
+}
+
+int sys_filesize(int fd) {
+  struct descriptor* descriptor;
+
+  tomar_descriptores();
+
+  descriptor = obtener_descriptor(fd);
+
+  if(descriptor == NULL || descriptor->file == NULL) {
+    soltar_descriptores();
+    return -1;
+  }
+
+  int retorno = file_length(descriptor->file);
+
+  soltar_descriptores();
+
+  return retorno;
+}
+
+int sys_wait(tid_t pid){
+  return process_wait(pid);
+}
+
+int sys_wait_rusage(tid_t pid, void *u){
+  unsigned uso[USO_CAMPOS] = {0};
+
+  // U se revisa antes de recoger al hijo, para no perder su uso
+  if (!copy_to_user(u, uso, sizeof uso)) {
+    sys_exit(-1);
+  }
+  int status = process_wait_uso(pid, uso);
+  if (!copy_to_user(u, uso, sizeof uso)) {
+    sys_exit(-1);
+  }
+  return status;
+}
+
+tid_t sys_wait_any(int *status){
+  int codigo = 0;
+
+  // STATUS se revisa antes de recoger al hijo, para no perder su codigo
+  if (status != NULL && !copy_to_user(status, &codigo, sizeof codigo)) {
+    sys_exit(-1);
+  }
+  tid_t pid = process_wait_any(&codigo);
+  if (pid != -1 && status != NULL && !copy_to_user(status, &codigo, sizeof codigo)) {
+    sys_exit(-1);
+  }
+  return pid;
+}
+
+void *sys_sbrk(intptr_t increment){
+  return process_sbrk(increment);
+}
+
+/* Largo maximo que copia stat_read. */
+#define STAT_READ_MAX 16384
+
+int sys_stat_read(const char *name, char *buf, unsigned size){
+  char *nombre = copiar_cadena(name);
+  if (nombre == NULL) {
+    return -1;
+  }
+  // una copia en el kernel, para no fallar paginas con la captura tomada
+  size_t largo = size > STAT_READ_MAX ? STAT_READ_MAX : size;
+  char *texto = malloc(largo > 0 ? largo : 1);
+  if (texto == NULL) {
+    palloc_free_page(nombre);
+    return -1;
+  }
+  int retorno = kstat_read(nombre, texto, largo > 0 ? largo : 1);
+  palloc_free_page(nombre);
+  if (retorno >= 0 && largo > 0 && !copy_to_user(buf, texto, strlen(texto) + 1)) {
+    free(texto);
+    sys_exit(-1);
+  }
+  free(texto);
+  return retorno;
+}
+
+int sys_pmu_read(uint64_t *counts, int cnt){
+  uint64_t cuentas[PMU_COUNTERS];
+  int usados = pmu_thread_counts(cuentas);
+  if (cnt > usados) {
+    cnt = usados;
+  }
+  if (cnt > 0 && !copy_to_user(counts, cuentas, cnt * sizeof *cuentas)) {
+    sys_exit(-1);
+  }
+  return usados;
+}
+
+static struct thread *hilo_del_proceso(tid_t tid){
+  struct thread *actual = thread_current();
+  struct thread *t = tid == 0 ? actual : thread_lookup(tid);
+  return t != NULL && t->proceso == actual->proceso ? t : NULL;
+}
+
+int sys_sched_setaffinity(tid_t tid, unsigned mask){
+  enum intr_level old_level = intr_disable();
+  struct thread *t = hilo_del_proceso(tid);
+  bool ok = t != NULL && thread_set_affinity(t, mask);
+  intr_set_level(old_level);
+  return ok ? 0 : -1;
+}
+
+int sys_sched_getaffinity(tid_t tid){
+  enum intr_level old_level = intr_disable();
+  struct thread *t = hilo_del_proceso(tid);
+  int mask = t != NULL ? (int) t->cpu_mask : -1;
+  intr_set_level(old_level);
+  return mask;
+}
+
+/* Clases de sched_setscheduler, los mismos valores de lib/user/syscall.h. */
+#define SCHED_NORMAL 0
+#define SCHED_BATCH 1
+
+/* Pone a T en la clase batch si es un thread del proceso AUX. */
+static void poner_batch(struct thread *t, void *aux){
+  if (t->proceso == aux) {
+    thread_set_batch(t, true);
+  }
+}
+
+/* Regresa a T a la clase normal si es un thread del proceso AUX. */
+static void quitar_batch(struct thread *t, void *aux){
+  if (t->proceso == aux) {
+    thread_set_batch(t, false);
+  }
+}
+
+int sys_sched_setscheduler(int policy){
+  int anterior = sys_sched_getscheduler();
+  if (policy != SCHED_NORMAL && policy != SCHED_BATCH) {
+    return -1;
+  }
+  thread_foreach(policy == SCHED_BATCH ? poner_batch : quitar_batch,
+                 thread_current()->proceso);
+  // si ahora es batch, le cede el CPU a cualquier thread normal listo
+  thread_preempt();
+  return anterior;
+}
+
+int sys_sched_getscheduler(void){
+  return thread_current()->batch ? SCHED_BATCH : SCHED_NORMAL;
+}
+
+/* El mismo formato que struct timespec de lib/user/syscall.h. */
+struct timespec_usuario {
+  int64_t seg;
+  long nseg;
+};
+
+/* Nanosegundos por tick del timer. */
+#define NS_POR_TICK (1000000000 / TIMER_FREQ)
+
+int sys_sleep_until(const void *ts){
+  struct timespec_usuario tiempo;
+  if (!copy_from_user(&tiempo, ts, sizeof tiempo)) {
+    sys_exit(-1);
+  }
+  if (tiempo.seg < 0 || tiempo.nseg < 0 || tiempo.nseg >= 1000000000) {
+    return -1;
+  }
+  // el tick N empieza en el nanosegundo N * NS_POR_TICK de CLOCK_MONOTONIC
+  uint64_t ns = (uint64_t) tiempo.seg * 1000000000 + tiempo.nseg;
+  timer_sleep_until(DIV_ROUND_UP(ns, NS_POR_TICK));
+  return 0;
+}
+
+int sys_timer_slack(int ms){
+  struct thread *actual = thread_current();
+  int anterior = actual->timer_slack * 1000 / TIMER_FREQ;
+  if (ms >= 0) {
+    actual->timer_slack = DIV_ROUND_UP((int64_t) ms * TIMER_FREQ, 1000);
+  }
+  return anterior;
+}
+
+/* Devuelve el thread principal del proceso PID si es el actual, o el
+   actual si PID es 0, o uno de sus hijos; si no, NULL. Interrupts must
+   be off. */
+static struct thread *proceso_objetivo(tid_t pid){
+  struct thread *actual = thread_current()->proceso;
+  if (pid == 0) {
+    return actual;
+  }
+  struct thread *t = thread_lookup(pid);
+  if (t == NULL || t->proceso != t) {
+    return NULL;
+  }
+  return t == actual || (t->pcb != NULL && t->pcb->proceso_padre == actual)
+         ? t : NULL;
+}
+
+/* Cambio que se aplica a cada thread de un proceso. */
+struct cambio_prioridad {
+  struct thread *proceso;
+  int prioridad;      // nueva prioridad base, o -1 para no cambiarla
+  int incremento;     // que se suma al nice y se resta a la prioridad
+};
+
+/* Aplica el cambio AUX a T si es un thread de su proceso. */
+static void cambiar_prioridad(struct thread *t, void *aux){
+  struct cambio_prioridad *cambio = aux;
+  if (t->proceso != cambio->proceso) {
+    return;
+  }
+  if (cambio->prioridad >= 0) {
+    thread_set_priority_of(t, cambio->prioridad);
+  }
+  if (cambio->incremento > 0) {
+    int nice = t->nice + cambio->incremento;
+    thread_set_nice_of(t, nice < NICE_MAX ? nice : NICE_MAX);
+    if (!thread_mlfqs) {
+      int prioridad = t->priorityOriginal - cambio->incremento;
+      thread_set_priority_of(t, prioridad > PRI_MIN ? prioridad : PRI_MIN);
+    }
+  }
+}
+
+int sys_setpriority(tid_t pid, int priority){
+  if (thread_mlfqs || priority < PRI_MIN || priority > PRI_MAX) {
+    return -1;
+  }
+  enum intr_level old_level = intr_disable();
+  struct thread *t = proceso_objetivo(pid);
+  bool ok = t != NULL && priority <= t->priorityOriginal;
+  struct cambio_prioridad cambio = {t, priority, 0};
+  intr_set_level(old_level);
+  if (!ok) {
+    return -1;
+  }
+  thread_foreach(cambiar_prioridad, &cambio);
+  thread_preempt();
+  return 0;
+}
+
+int sys_getpriority(tid_t pid){
+  enum intr_level old_level = intr_disable();
+  struct thread *t = proceso_objetivo(pid);
+  int prioridad = -1;
+  if (t != NULL) {
+    prioridad = thread_mlfqs ? t->priority : t->priorityOriginal;
+  }
+  intr_set_level(old_level);
+  return prioridad;
+}
+
+int sys_nice(int increment){
+  if (increment < 0) {
+    return -1;
+  }
+  struct cambio_prioridad cambio = {thread_current()->proceso, -1, increment};
+  thread_foreach(cambiar_prioridad, &cambio);
+  thread_preempt();
+  return thread_current()->nice;
+}
+
+int sys_yield_to(tid_t tid){
+  // con interrupciones apagadas el thread no puede terminar antes de cederle el CPU
+  enum intr_level old_level = intr_disable();
+  struct thread *t = thread_lookup(tid);
+  bool ok = t != NULL && thread_yield_to(t);
+  intr_set_level(old_level);
+  return ok ? 0 : -1;
+}
+
+/* El mismo formato que struct pollfd de lib/user/syscall.h. */
+struct pollfd_usuario {
+  int fd;
+  short events;
+  short revents;
+};
+
+/* Eventos y limite de poll, los mismos valores de lib/user/syscall.h. */
+#define POLLIN 0x01
+#define POLLOUT 0x02
+#define POLLHUP 0x04
+#define POLLNVAL 0x08
+#define POLLEXIT 0x10
+#define POLL_MAX 16
+
+/* Lo que vigila una entrada de poll. */
+enum vigilado {
+  VIGILA_NADA,        // fd que no esta abierto
+  VIGILA_PIPE,        // extremo de pipe, que se toma durante todo el poll
+  VIGILA_TECLADO,     // fd 0 de la consola
+  VIGILA_PANTALLA,    // fd 1 o 2 de la consola
+  VIGILA_ARCHIVO,     // archivo o directorio, que nunca hace esperar
+  VIGILA_HIJO         // hijo, con POLLEXIT
+};
+
+/* Devuelve los eventos de la entrada FD, que es de tipo TIPO y, si es un
+   pipe, PIPE. Si W no es NULL, antes mete E en la cola del objeto para que
+   W despierte cuando cambie. */
+static short revisar_poll(const struct pollfd_usuario *fd, enum vigilado tipo,
+                          struct pipe *pipe, bool escribe,
+                          struct poll_waiter *w, struct poll_entry *e){
+  short listo = 0;
+  switch (tipo) {
+    case VIGILA_NADA:
+      return POLLNVAL;
+    case VIGILA_PIPE: {
+      int estado = pipe_poll(pipe, escribe, w, e);
+      if (estado & PIPE_READABLE) listo |= POLLIN;
+      if (estado & PIPE_WRITABLE) listo |= POLLOUT;
+      if (estado & PIPE_HANGUP) listo |= POLLHUP;
+      break;
+    }
+    case VIGILA_TECLADO:
+      listo = input_poll(w, e) ? POLLIN : 0;
+      break;
+    case VIGILA_PANTALLA:
+      listo = POLLOUT;
+      break;
+    case VIGILA_ARCHIVO:
+      listo = POLLIN | POLLOUT;
+      break;
+    case VIGILA_HIJO: {
+      int hijo = process_poll_child(fd->fd, w, e);
+      if (hijo < 0) return POLLNVAL;
+      listo = hijo ? POLLEXIT : 0;
+      break;
+    }
+  }
+  return listo & (fd->events | POLLHUP);
+}
+
+int sys_poll(void *ufds, unsigned cnt, int timeout_ms){
+  struct pollfd_usuario fds[POLL_MAX];
+  enum vigilado tipos[POLL_MAX];
+  struct pipe *pipes[POLL_MAX];
+  bool escribe[POLL_MAX];
+  struct poll_entry entradas[POLL_MAX];
+  struct poll_waiter waiter;
+  bool expirado = timeout_ms == 0;
+  int64_t plazo = -1;
+  unsigned i;
+  int listos;
+
+  if (cnt > POLL_MAX) {
+    return -1;
+  }
+  if (cnt > 0 && !copy_from_user(fds, ufds, cnt * sizeof *fds)) {
+    sys_exit(-1);
+  }
+  if (timeout_ms > 0) {
+    plazo = timer_ticks() + DIV_ROUND_UP((int64_t) timeout_ms * TIMER_FREQ, 1000);
+  }
+
+  // los pipes se toman una vez, asi que siguen vivos aunque otro hilo cierre el fd
+  tomar_descriptores();
+  for (i = 0; i < cnt; i++) {
+    struct descriptor *descriptor = NULL;
+    pipes[i] = NULL;
+    escribe[i] = false;
+    if (fds[i].events & POLLEXIT) {
+      tipos[i] = VIGILA_HIJO;
+      continue;
+    }
+    descriptor = obtener_descriptor(fds[i].fd);
+    if (descriptor != NULL && descriptor->pipe != NULL) {
+      escribe[i] = descriptor->escribe;
+      pipes[i] = tomar_pipe(descriptor, escribe[i]);
+      tipos[i] = VIGILA_PIPE;
+    } else if (descriptor != NULL) {
+      tipos[i] = VIGILA_ARCHIVO;
+    } else if (fds[i].fd == 0) {
+      tipos[i] = VIGILA_TECLADO;
+    } else if (fds[i].fd == 1 || fds[i].fd == 2) {
+      tipos[i] = VIGILA_PANTALLA;
+    } else {
+      tipos[i] = VIGILA_NADA;
+    }
+  }
+  soltar_descriptores();
+
+  /* Se meten en las colas antes de revisar, asi que un cambio entre la
+     revision y poll_block lo despierta igual. */
+  poll_waiter_init(&waiter);
+  for (;;) {
+    listos = 0;
+    for (i = 0; i < cnt; i++) {
+      entradas[i].queue = NULL;
+      fds[i].revents = revisar_poll(&fds[i], tipos[i], pipes[i], escribe[i],
+                                    &waiter, &entradas[i]);
+      if (fds[i].revents != 0) {
+        listos++;
+      }
+    }
+    if (listos == 0 && !expirado) {
+      expirado = !poll_block(&waiter, plazo);
+    }
+    for (i = 0; i < cnt; i++) {
+      poll_remove(&entradas[i]);
+    }
+    if (listos > 0 || expirado) {
+      break;
+    }
+  }
+
+  for (i = 0; i < cnt; i++) {
+    if (pipes[i] != NULL) {
+      pipe_close(pipes[i], escribe[i]);
+    }
+  }
+  if (cnt > 0 && !copy_to_user(ufds, fds, cnt * sizeof *fds)) {
+    sys_exit(-1);
+  }
+  return listos;
+}
+
+int sys_read(int fd, void *buffer, unsigned size) {
+
+  if(!validar_buffer(buffer, size, true)){
+    sys_exit(-1);
+  }
+
+  int retorno = 0;
+  tomar_descriptores();
+  struct descriptor* descriptor = obtener_descriptor(fd);
+  struct pipe *pipe = tomar_pipe(descriptor, false);
+  if(pipe != NULL){
+    soltar_descriptores();
+    retorno = pipe_read(pipe, buffer, size);
+    pipe_close(pipe, false);
+  } else if(descriptor == NULL && fd == 1){
+    soltar_descriptores();
+    retorno -1;
+  } else if(descriptor == NULL && fd == 0) { 
+    soltar_descriptores();
+    // fd 0 lee desde el teclado de una vez, hasta el fin de la linea en
+    // modo canonico
+    retorno = input_read(buffer, size);
+  } else {
+    // leer desde un archivo, sin el lock como en sys_write
+    if(descriptor && descriptor->file && !es_directorio(descriptor)) {
+      descriptor_ref(descriptor);
+      soltar_descriptores();
+      if (file_is_direct(descriptor->file)) {
+        retorno = transferir_directo(descriptor->file, buffer, size, false);
+      } else {
+        retorno = file_read(descriptor->file, buffer, size);
+      }
+      descriptor_unref(descriptor);
+    } else {
+      soltar_descriptores();
+      retorno = -1;
+    }
+  }
+  soltar_buffer(buffer, size);
+  return retorno;
+}
+
+static int transferir_directo(struct file *file, void *buffer, unsigned size,
+                              bool escribir){
+  uint8_t *usuario = buffer;
+  int hecho = 0;
+
+  if ((uintptr_t) buffer % BLOCK_SECTOR_SIZE != 0 || size % BLOCK_SECTOR_SIZE != 0) {
+    return escribir ? file_write(file, buffer, size) : file_read(file, buffer, size);
+  }
+  // el buffer ya esta fijo, asi que cada pagina tiene su marco; el disco
+  // escribe o lee en el marco mismo, que ocupa memoria fisica contigua
+  while (size > 0) {
+    unsigned trozo = PGSIZE - pg_ofs(usuario);
+    void *kpage = pagedir_get_page(thread_current()->pagedir, usuario);
+    int n;
+
+    if (trozo > size) {
+      trozo = size;
+    }
+    n = escribir ? file_write_direct(file, kpage, trozo)
+                 : file_read_direct(file, kpage, trozo);
+    hecho += n;
+    usuario += n;
+    size -= n;
+    if (n < (int) trozo) {
+      break;
+    }
+  }
+  return hecho;
+}
+
+int sys_fadvise(int fd, int advice){
+  int retorno = -1;
+
+  if (advice < FILE_ADV_NORMAL || advice > FILE_ADV_DONTNEED) {
+    return -1;
+  }
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  if (descriptor && descriptor->file && !es_directorio(descriptor)) {
+    // como read, sin el lock de la tabla, que file_advise puede esperar
+    descriptor_ref(descriptor);
+    soltar_descriptores();
+    file_advise(descriptor->file, advice);
+    descriptor_unref(descriptor);
+    retorno = 0;
+  } else {
+    soltar_descriptores();
+  }
+  return retorno;
+}
+
+int sys_defrag(int fd){
+  int retorno = -1;
+
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  if (descriptor && descriptor->file && !es_directorio(descriptor)) {
+    // mover los datos lleva tiempo y espera al disco, asi que sin el lock
+    descriptor_ref(descriptor);
+    soltar_descriptores();
+    file_defrag(descriptor->file);
+    retorno = file_extents(descriptor->file);
+    descriptor_unref(descriptor);
+  } else {
+    soltar_descriptores();
+  }
+  return retorno;
+}
+
+bool sys_clone_file(int src_fd, int dst_fd){
+  bool retorno = false;
+
+  tomar_descriptores();
+  struct descriptor *origen = obtener_descriptor(src_fd);
+  struct descriptor *destino = obtener_descriptor(dst_fd);
+  if (origen && origen->file && !es_directorio(origen)
+      && destino && destino->file && !es_directorio(destino)) {
+    // clonar escribe varias transacciones, asi que sin el lock de la tabla
+    descriptor_ref(origen);
+    descriptor_ref(destino);
+    soltar_descriptores();
+    retorno = file_clone(destino->file, origen->file);
+    descriptor_unref(destino);
+    descriptor_unref(origen);
+  } else {
+    soltar_descriptores();
+  }
+  return retorno;
+}
+
+/* seek y tell solo toman el lock de la tabla, que nadie tiene mientras
+   espera al disco, y la posicion del archivo no necesita ninguno. */
+void sys_seek (int fd, unsigned position){
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+
+  if(descriptor && descriptor->file){
+    file_seek(descriptor->file, position);
+  }
+  soltar_descriptores();
+}
+
+unsigned sys_tell(int fd){
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  int retorno;
+  if(descriptor && descriptor->file) {
+    retorno = file_tell(descriptor->file);
+  } else {
+    retorno = -1;
+  }
+  soltar_descriptores();
+  return retorno;
+}
+
+void sys_cputime(void *t){
+  struct thread *actual = thread_current();
+  uint64_t ciclos[2];
+
+  // cobrar lo que va de esta syscall para que el numero este al dia
+  thread_account_cycles(false);
+  ciclos[0] = actual->user_cycles;
+  ciclos[1] = actual->kernel_cycles;
+  if (!copy_to_user(t, ciclos, sizeof ciclos)) {
+    sys_exit(-1);
+  }
+}
+
+int sys_sched_latency(int priority, void *buf){
+  // el mismo formato que struct sched_latency: wakeup y luego slice
+  struct histogram h[2];
+
+  if (!thread_get_latency(priority, &h[0], &h[1])) {
+    return -1;
+  }
+  if (!copy_to_user(buf, h, sizeof h)) {
+    sys_exit(-1);
+  }
+  return 0;
+}
+
+/* Procesos que cuenta getrusage, los mismos valores de lib/user/syscall.h. */
+#define RUSAGE_SELF 0
+#define RUSAGE_CHILDREN -1
+
+int sys_getrusage(int who, void *u){
+  struct thread *proceso = thread_current()->proceso;
+  // el mismo formato que struct rusage
+  unsigned uso[USO_CAMPOS];
+
+  if (who == RUSAGE_SELF) {
+    process_uso(proceso, uso);
+  } else if (who == RUSAGE_CHILDREN) {
+    memcpy(uso, proceso->uso_hijos, sizeof uso);
+  } else {
+    return -1;
+  }
+  if (!copy_to_user(u, uso, sizeof uso)) {
+    sys_exit(-1);
+  }
+  return 0;
+}
+
+int sys_fsync(int fd){
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  int retorno;
+  if(descriptor && descriptor->file) {
+    descriptor_ref(descriptor);
+    soltar_descriptores();
+    file_sync(descriptor->file);
+    descriptor_unref(descriptor);
+    retorno = 0;
+  } else {
+    soltar_descriptores();
+    retorno = -1;
+  }
+  return retorno;
+}
 
-  return pid;
+bool sys_chdir(const char *dir){
+  char *nombre = copiar_cadena(dir);
+  if(nombre == NULL){
+    return false;
+  }
+  struct dir *nuevo = filesys_open_dir(nombre);
+  palloc_free_page(nombre);
+  if(nuevo == NULL){
+    return false;
+  }
+
+  // el directorio anterior se cierra fuera del lock
+  tomar_descriptores();
+  struct thread *proceso = thread_current()->proceso;
+  struct dir *anterior = proceso->directorio;
+  proceso->directorio = nuevo;
+  soltar_descriptores();
+  dir_close(anterior);
+  return true;
 }
 
-bool sys_create(const char *file, unsigned initial_size){
+bool sys_mkdir(const char *dir){
+  char *nombre = copiar_cadena(dir);
+  if(nombre == NULL){
+    return false;
+  }
+  bool retorno = filesys_mkdir(nombre);
+  palloc_free_page(nombre);
+  return retorno;
+}
 
-  /* Para las llamadas del sistema que requieran manejo de archivos vamos a usar filesys/filesys.h */
+bool sys_readdir(int fd, char *name){
+  char nombre[NAME_MAX + 1];
+  bool retorno = false;
+
+  // la posicion en el directorio es la del archivo, asi fork la copia igual
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  if(descriptor && descriptor->file && es_directorio(descriptor)) {
+    struct dir *dir = dir_open(inode_reopen(file_get_inode(descriptor->file)));
+    if(dir != NULL) {
+      dir_seek(dir, file_tell(descriptor->file));
+      retorno = dir_readdir(dir, nombre);
+      file_seek(descriptor->file, dir_tell(dir));
+      dir_close(dir);
+    }
+  }
+  soltar_descriptores();
 
-  if(get_user((const uint8_t*)file) == -1){
-    if (lock_held_by_current_thread(&archivos)){
-      lock_release (&archivos);
-    }  
+  // se copia al usuario sin locks tomados, por si hay page fault
+  if(retorno && !copy_to_user(name, nombre, strlen(nombre) + 1)) {
     sys_exit(-1);
   }
-  lock_acquire(&archivos);
-  bool retorno = filesys_create(file, initial_size);
-  lock_release(&archivos);
   return retorno;
 }
 
-bool sys_remove(const char *file){
+bool sys_isdir(int fd){
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  bool retorno = descriptor && descriptor->file && es_directorio(descriptor);
+  soltar_descriptores();
+  return retorno;
+}
+
+int sys_inumber(int fd){
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  int retorno;
+  if(descriptor && descriptor->file) {
+    retorno = inode_get_inumber(file_get_inode(descriptor->file));
+  } else {
+    retorno = -1;
+  }
+  soltar_descriptores();
+  return retorno;
+}
 
-  if(get_user((const uint8_t*)file) == -1){
-    if (lock_held_by_current_thread(&archivos)){
-      lock_release (&archivos);
-    }  
+int sys_pread(int fd, void *buffer, unsigned size, unsigned offset){
+  int retorno = -1;
+
+  if(!validar_buffer(buffer, size, true)){
     sys_exit(-1);
   }
-  lock_acquire(&archivos);
-  bool retorno = filesys_remove(file);
-  lock_release(&archivos);
+  // file_read_at no usa ni cambia la posicion del descriptor
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  if(descriptor && descriptor->file && !es_directorio(descriptor)
+     && (off_t) offset >= 0) {
+    retorno = file_read_at(descriptor->file, buffer, size, offset);
+  }
+  soltar_descriptores();
+  soltar_validado(buffer, size);
   return retorno;
-} 
+}
 
-int sys_open(const char* file) {
-  if (get_user((const uint8_t*)file) == -1) {
-    if (lock_held_by_current_thread(&archivos)){
-      lock_release (&archivos);
-    }  
+int sys_pwrite(int fd, const void *buffer, unsigned size, unsigned offset){
+  int retorno = -1;
+
+  if(!validar_buffer(buffer, size, false)){
     sys_exit(-1);
   }
-  struct file* file_opened;
-  struct descriptor* fd = palloc_get_page(0);
-  if(!fd){
-    return -1;
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  if(descriptor && descriptor->file && !es_directorio(descriptor)
+     && (off_t) offset >= 0) {
+    retorno = file_write_at(descriptor->file, buffer, size, offset);
   }
+  soltar_descriptores();
+  soltar_validado(buffer, size);
+  return retorno;
+}
 
-  lock_acquire(&archivos);
-  file_opened = filesys_open(file);
-  if (!file_opened) {
-    palloc_free_page(fd);
-    lock_release(&archivos);
+/* Numero maximo de buffers de readv y writev, el mismo IOV_MAX de
+   lib/user/syscall.h. */
+#define IOV_MAX 16
+
+/* El mismo formato que struct iovec de lib/user/syscall.h. */
+struct iovec_usuario {
+  void *base;
+  size_t len;
+};
+
+int sys_readv_writev(int fd, const void *iov, int iovcnt, bool escribir){
+  struct iovec_usuario vec[IOV_MAX];
+  size_t total = 0;
+  int retorno = 0;
+  int i;
+
+  if(iovcnt < 0 || iovcnt > IOV_MAX){
     return -1;
   }
+  // el arreglo se copia una sola vez y cada buffer se valida antes de
+  // tomar ningun lock, igual que en read y write
+  if(!copy_from_user(vec, iov, iovcnt * sizeof *vec)){
+    sys_exit(-1);
+  }
+  for(i = 0; i < iovcnt; i++){
+    total += vec[i].len;
+    if(total > INT32_MAX){
+      return -1;
+    }
+  }
+  for(i = 0; i < iovcnt; i++){
+    if(!validar_buffer(vec[i].base, vec[i].len, !escribir)){
+      while(i-- > 0){
+        soltar_validado(vec[i].base, vec[i].len);
+      }
+      sys_exit(-1);
+    }
+  }
 
-  fd->file = file_opened;
-
-  // asignar id
-  // si la lista de descriptores esta vacia, el pimer id debe ser 3, pues 0,1 y 2 estan reservados
-  struct list* descriptores = &thread_current()->descriptores;
-  if (list_empty(descriptores)) {
-    fd->id = 3;
+  if((fd == 1 || fd == 2) && escribir){
+    for(i = 0; i < iovcnt; i++){
+      putbuf(vec[i].base, vec[i].len);
+    }
+    retorno = total;
   } else {
-    fd->id = (list_entry(list_back(descriptores), struct descriptor, elem)->id) + 1;
+    tomar_descriptores();
+    struct descriptor *descriptor = obtener_descriptor(fd);
+    if(descriptor && descriptor->file && !es_directorio(descriptor)){
+      for(i = 0; i < iovcnt; i++){
+        off_t n = escribir ? file_write(descriptor->file, vec[i].base, vec[i].len)
+                           : file_read(descriptor->file, vec[i].base, vec[i].len);
+        retorno += n;
+        // una transferencia corta es el final del archivo, no se sigue
+        if((size_t) n < vec[i].len){
+          break;
+        }
+      }
+    } else {
+      retorno = -1;
+    }
+    soltar_descriptores();
   }
-  // insertar en la lista de descriptores
-  list_push_back(descriptores, &(fd->elem));
 
-  // regresar el id del descriptor
-  lock_release(&archivos);
-  return fd->id;
+  for(i = 0; i < iovcnt; i++){
+    soltar_validado(vec[i].base, vec[i].len);
+  }
+  return retorno;
 }
 
-void sys_close(int fd) {
-  lock_acquire(&archivos);
+int sys_copy_file_range(int in_fd, int out_fd, unsigned length){
+  int retorno = -1;
 
-  struct descriptor* descriptor = obtener_descriptor(fd);
+  if((off_t) length < 0){
+    return -1;
+  }
+  tomar_descriptores();
+  struct descriptor *entrada = obtener_descriptor(in_fd);
+  struct descriptor *salida = obtener_descriptor(out_fd);
+  if(entrada && entrada->file && !es_directorio(entrada)
+     && salida && salida->file && !es_directorio(salida)) {
+    retorno = file_copy(salida->file, entrada->file, length);
+  }
+  soltar_descriptores();
+  return retorno;
+}
 
-  if(descriptor && descriptor->file) {
-    // llamamos a la funcion del file system
-    file_close(descriptor->file);
-    // quitamos el archivo del proceso
-    list_remove(&(descriptor->elem));
-    // liberamos recursos
-    palloc_free_page(descriptor);
+/* El mismo formato que struct dirent de lib/user/syscall.h. */
+struct dirent_usuario {
+  int ino;
+  unsigned size;
+  uint8_t type;
+  char name[NAME_MAX + 1];
+};
+
+/* Entradas que getdents lee por llamada. Con nombres largos no entran en la
+   pila del kernel, asi que se piden con malloc. */
+#define GETDENTS_LOTE 16
+
+int sys_getdents(int fd, void *buf, unsigned size){
+  struct dir_info *entradas;
+  struct dirent_usuario d;
+  size_t cnt = size / sizeof d;
+  size_t leidas = 0;
+  size_t i;
+  int retorno = -1;
+
+  if(cnt > GETDENTS_LOTE){
+    cnt = GETDENTS_LOTE;
+  }
+  entradas = malloc(GETDENTS_LOTE * sizeof *entradas);
+  if(entradas == NULL){
+    return -1;
+  }
+  // igual que readdir, la posicion en el directorio es la del archivo
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  if(descriptor && descriptor->file && es_directorio(descriptor)) {
+    struct dir *dir = dir_open(inode_reopen(file_get_inode(descriptor->file)));
+    if(dir != NULL) {
+      dir_seek(dir, file_tell(descriptor->file));
+      leidas = dir_readdir_many(dir, entradas, cnt);
+      file_seek(descriptor->file, dir_tell(dir));
+      dir_close(dir);
+      retorno = leidas * sizeof d;
+    }
+  }
+  soltar_descriptores();
+
+  // se copia al usuario sin locks tomados, por si hay page fault
+  for (i = 0; i < leidas; i++) {
+    memset(&d, 0, sizeof d);
+    d.ino = entradas[i].inode_sector;
+    d.size = entradas[i].length;
+    d.type = entradas[i].is_dir ? 2 : 1;    // DT_DIR o DT_REG
+    strlcpy(d.name, entradas[i].name, sizeof d.name);
+    if (!copy_to_user((uint8_t *) buf + i * sizeof d, &d, sizeof d)) {
+      free(entradas);
+      sys_exit(-1);
+    }
   }
-  lock_release(&archivos);
+  free(entradas);
+  return retorno;
 }
 
-static struct descriptor* obtener_descriptor(int fd){
-  
-  struct thread *t = thread_current();
+int sys_fallocate(int fd, unsigned offset, unsigned length){
+  int retorno = -1;
+
+  if((off_t) offset < 0 || (off_t) length < 0){
+    return -1;
+  }
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  if(descriptor && descriptor->file && !es_directorio(descriptor)
+     && file_allocate(descriptor->file, offset, length)) {
+    retorno = 0;
+  }
+  soltar_descriptores();
+  return retorno;
+}
 
-  ASSERT(t!=NULL);
+int sys_ftruncate(int fd, unsigned length){
+  int retorno = -1;
 
-  if(fd<3){
-    return NULL;
+  if((off_t) length < 0){
+    return -1;
+  }
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  if(descriptor && descriptor->file && !es_directorio(descriptor)
+     && file_truncate(descriptor->file, length)) {
+    retorno = 0;
   }
+  soltar_descriptores();
+  return retorno;
+}
 
-  struct list *descriptores = &t->descriptores;
-  struct list_elem *e;
-  if(!list_empty(descriptores)){
-    for (e = list_begin (descriptores); e != list_end (descriptores); e = list_next (e))
+int sys_blockstat(int role, void *buf){
+  // el mismo formato que struct blockstat de lib/user/syscall.h
+  struct
     {
-      struct descriptor *descriptor = list_entry(e,struct descriptor, elem);
-      if(descriptor->id == fd){
-        return descriptor;
-      }
-    }
-  }  
-  
-  // si llega hasta aqui entonces no hay un elemento relacionado
-  return NULL;
+      unsigned contadores[4];
+      uint32_t lectura[HISTOGRAM_BUCKETS];
+      uint32_t escritura[HISTOGRAM_BUCKETS];
+    } stat;
+  struct block_stats s;
+  struct block *block;
+
+  if (role < 0 || role >= BLOCK_ROLE_CNT) {
+    return -1;
+  }
+  block = block_get_role(role);
+  if (block == NULL) {
+    return -1;
+  }
+  block_get_stats(block, &s);
+  stat.contadores[0] = s.read_cnt;
+  stat.contadores[1] = s.write_cnt;
+  stat.contadores[2] = s.requests;
+  stat.contadores[3] = s.sequential;
+  memcpy(stat.lectura, s.read_latency.buckets, sizeof stat.lectura);
+  memcpy(stat.escritura, s.write_latency.buckets, sizeof stat.escritura);
+  if (!copy_to_user(buf, &stat, sizeof stat)) {
+    sys_exit(-1);
+  }
+  return 0;
 }
 
-int sys_filesize(int fd) {
-  struct descriptor* descriptor;
+int sys_ttymode(int mode){
+  // los valores de TTY_CANONICAL y TTY_RAW de lib/user/syscall.h
+  if (mode == 0) {
+    return input_set_mode(INPUT_CANONICAL) == INPUT_RAW;
+  } else if (mode == 1) {
+    return input_set_mode(INPUT_RAW) == INPUT_RAW;
+  }
+  return -1;
+}
 
-  if (get_user((const uint8_t*)fd) == -1) {
-    if (lock_held_by_current_thread(&archivos)){
-      lock_release (&archivos);
-    }  
-    sys_exit(-1);
+int sys_dup(int fd){
+  int retorno = -1;
+
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  if(descriptor) {
+    retorno = descriptor_install(descriptor);
   }
+  soltar_descriptores();
 
-  lock_acquire(&archivos);
+  return retorno;
+}
 
-  descriptor = obtener_descriptor(fd);
+int sys_dup2(int oldfd, int newfd){
+  struct descriptor *anterior = NULL;
+  int retorno = -1;
+
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(oldfd);
+  if(descriptor && (oldfd == newfd
+                    || descriptor_install_at(descriptor, newfd, &anterior))) {
+    retorno = newfd;
+  }
+  soltar_descriptores();
+
+  // el archivo que tenia NEWFD se cierra, como en sys_close, ya sin el lock
+  if(anterior) {
+    descriptor_close(anterior);
+  }
+  return retorno;
+}
+
+int sys_pipe(int *fds){
+  int par[2] = {-1, -1};
 
-  if(descriptor == NULL) {
-    lock_release(&archivos);
+  // FDS se revisa antes, para no dejar el pipe sin que nadie lo sepa
+  if(!copy_to_user(fds, par, sizeof par)){
+    sys_exit(-1);
+  }
+  struct pipe *pipe = pipe_create();
+  struct descriptor *lectura = descriptor_alloc();
+  struct descriptor *escritura = descriptor_alloc();
+  if(pipe == NULL || lectura == NULL || escritura == NULL){
+    if(pipe != NULL){
+      pipe_close(pipe, false);
+      pipe_close(pipe, true);
+    }
+    if(lectura != NULL){
+      descriptor_free(lectura);
+    }
+    if(escritura != NULL){
+      descriptor_free(escritura);
+    }
+    return -1;
+  }
+  lectura->pipe = escritura->pipe = pipe;
+  escritura->escribe = true;
+
+  tomar_descriptores();
+  par[0] = descriptor_install(lectura);
+  par[1] = par[0] >= 0 ? descriptor_install(escritura) : -1;
+  if(par[1] < 0 && par[0] >= 0){
+    descriptor_remove(par[0]);
+  }
+  soltar_descriptores();
+  if(par[1] < 0){
+    descriptor_close(lectura);
+    descriptor_close(escritura);
     return -1;
   }
+  if(!copy_to_user(fds, par, sizeof par)){
+    sys_exit(-1);
+  }
+  return 0;
+}
 
-  int retorno = file_length(descriptor->file);
+/* El mismo formato que struct ring, struct ring_sqe y struct ring_cqe de
+   lib/user/syscall.h, con los mismos valores de RING_OP_*. */
+struct anillo_usuario {
+  unsigned entradas;
+  unsigned envio_inicio;
+  unsigned envio_fin;
+  unsigned terminadas_inicio;
+  unsigned terminadas_fin;
+  void *envios;
+  void *terminadas;
+};
+
+struct envio_usuario {
+  unsigned op;
+  int fd;
+  void *buf;
+  unsigned len;
+  unsigned dato;
+};
+
+struct terminada_usuario {
+  unsigned dato;
+  int resultado;
+};
 
-  lock_release(&archivos);
+enum { ANILLO_READ, ANILLO_WRITE, ANILLO_OPEN, ANILLO_CLOSE };
 
-  return retorno;
+/* Operaciones que sys_ring_enter copia del anillo de una vez. */
+#define ANILLO_LOTE 16
+
+/* Copia CNT entradas de SIZE bytes entre BUF en el kernel y el anillo de
+   usuario UANILLO de MASK + 1 entradas, desde la posicion POS, que puede dar
+   la vuelta al final. Devuelve false si el anillo no es valido. */
+static bool copiar_anillo(void *buf, void *uanillo, unsigned pos, unsigned mask,
+                          unsigned cnt, size_t size, bool al_usuario){
+  unsigned primero = mask + 1 - (pos & mask);
+  uint8_t *entrada = (uint8_t *) uanillo + (pos & mask) * size;
+  bool ok;
+
+  if(primero > cnt){
+    primero = cnt;
+  }
+  ok = al_usuario ? copy_to_user(entrada, buf, primero * size)
+                  : copy_from_user(buf, entrada, primero * size);
+  if(ok && primero < cnt){
+    buf = (uint8_t *) buf + primero * size;
+    ok = al_usuario ? copy_to_user(uanillo, buf, (cnt - primero) * size)
+                    : copy_from_user(buf, uanillo, (cnt - primero) * size);
+  }
+  return ok;
 }
 
-int sys_wait(tid_t pid){
-  return process_wait(pid);
+/* Ejecuta la operacion E de un anillo y devuelve su resultado. */
+static int ejecutar_envio(const struct envio_usuario *e){
+  switch(e->op){
+    case ANILLO_READ:
+      return sys_read(e->fd, e->buf, e->len);
+    case ANILLO_WRITE:
+      return sys_write(e->fd, e->buf, e->len);
+    case ANILLO_OPEN:
+      return sys_open(e->buf);
+    case ANILLO_CLOSE:
+      sys_close(e->fd);
+      return 0;
+    default:
+      return -1;
+  }
 }
 
-int sys_read(int fd, void *buffer, unsigned size) {
+int sys_ring_enter(void *ring, unsigned to_submit){
+  struct anillo_usuario *uanillo = ring;
+  struct anillo_usuario anillo;
+  struct envio_usuario envios[ANILLO_LOTE];
+  struct terminada_usuario terminadas[ANILLO_LOTE];
+  unsigned mask, pendientes, libres, hechas, n, i;
 
-  if (get_user((const uint8_t*) buffer) == -1) {
-    if (lock_held_by_current_thread(&archivos)){
-      lock_release (&archivos);
-    }  
+  if(!copy_from_user(&anillo, uanillo, sizeof anillo)){
     sys_exit(-1);
   }
+  if(anillo.entradas == 0 || (anillo.entradas & (anillo.entradas - 1)) != 0){
+    return -1;
+  }
+  mask = anillo.entradas - 1;
+  pendientes = anillo.envio_fin - anillo.envio_inicio;
+  libres = anillo.entradas - (anillo.terminadas_fin - anillo.terminadas_inicio);
+  if(pendientes > anillo.entradas || libres > anillo.entradas){
+    return -1;
+  }
+  if(to_submit > pendientes){
+    to_submit = pendientes;
+  }
+  if(to_submit > libres){
+    to_submit = libres;
+  }
+
+  // cada lote se copia de una vez y sus resultados se publican juntos, asi
+  // el programa los ve sin esperar al resto
+  for(hechas = 0; hechas < to_submit; hechas += n){
+    n = to_submit - hechas;
+    if(n > ANILLO_LOTE){
+      n = ANILLO_LOTE;
+    }
+    if(!copiar_anillo(envios, anillo.envios, anillo.envio_inicio, mask, n,
+                      sizeof *envios, false)){
+      sys_exit(-1);
+    }
+    for(i = 0; i < n; i++){
+      terminadas[i].dato = envios[i].dato;
+      terminadas[i].resultado = ejecutar_envio(&envios[i]);
+    }
+    anillo.envio_inicio += n;
+    anillo.terminadas_fin += n;
+    if(!copiar_anillo(terminadas, anillo.terminadas, anillo.terminadas_fin - n,
+                      mask, n, sizeof *terminadas, true)
+       || !copy_to_user(&uanillo->envio_inicio, &anillo.envio_inicio,
+                        sizeof anillo.envio_inicio)
+       || !copy_to_user(&uanillo->terminadas_fin, &anillo.terminadas_fin,
+                        sizeof anillo.terminadas_fin)){
+      sys_exit(-1);
+    }
+  }
+  return hechas;
+}
+
+tid_t sys_fork(struct intr_frame *f){
+  // el hijo copia los descriptores del padre mientras este lo espera con el
+  // lock tomado, asi ningun otro hilo del padre los cambia a medias
+  tomar_descriptores();
+  tid_t pid = process_fork(f);
+  soltar_descriptores();
+
+  return pid;
+}
+
+int sys_futex_wait(int *addr, int expected){
+  int *kaddr = futex_kaddr(addr);
+  struct futex *futex;
 
-  if (get_user((const uint8_t*) (buffer + size -1)) == -1) {
-    if (lock_held_by_current_thread(&archivos)){
-      lock_release (&archivos);
-    }  
+  if (kaddr == NULL) {
     sys_exit(-1);
-  } 
+  }
 
-  lock_acquire(&archivos);
-  int retorno = 0;
-  if(fd == 1){
-    retorno -1;
-  } else if(fd == 0) { 
-    // fd 0 lee desde el teclado usando input_getc ()
-    uint8_t c;
-    unsigned counter = size;
-    uint8_t *buf = buffer;
-    while (counter > 1 && (c = input_getc()) != 0)
-      {
-        *buf = c;
-        buffer++;
-        counter--; 
-      }
-    *buf = 0;
-    retorno = size - counter;
-  } else {
-    // leer desde un archivo 
-    struct descriptor* descriptor = obtener_descriptor(fd);
+  lock_acquire(&futex_lock);
+  // si la palabra ya cambio, el que la cambio ya no va a despertar a nadie
+  if (*kaddr != expected) {
+    lock_release(&futex_lock);
+    return -1;
+  }
 
-    if(descriptor && descriptor->file) {
-      retorno = file_read(descriptor->file, buffer, size);
-    } else {
-      retorno = -1;
+  futex = intmap_find(&futexes, (uintptr_t) kaddr);
+  if (futex == NULL) {
+    futex = malloc(sizeof *futex);
+    if (futex == NULL || !intmap_insert(&futexes, (uintptr_t) kaddr, futex)) {
+      free(futex);
+      lock_release(&futex_lock);
+      return -1;
     }
+    futex->kaddr = kaddr;
+    sema_init(&futex->sema, 0);
+    futex->waiters = 0;
+    futex->sleepers = 0;
   }
-  lock_release(&archivos);
-  return retorno;
+  futex->waiters++;
+  futex->sleepers++;
+  lock_release(&futex_lock);
+
+  // un wake entre soltar el lock y dormir deja el semaforo arriba, no se pierde
+  sema_down(&futex->sema);
+
+  lock_acquire(&futex_lock);
+  if (--futex->sleepers == 0) {
+    intmap_remove(&futexes, (uintptr_t) futex->kaddr);
+    free(futex);
+  }
+  lock_release(&futex_lock);
+  return 0;
 }
 
-void sys_seek (int fd, unsigned position){
-  lock_acquire(&archivos);
-  struct descriptor *descriptor = obtener_descriptor(fd);
+int sys_futex_wake(int *addr, int n){
+  int *kaddr = futex_kaddr(addr);
+  struct futex *futex;
+  int despertados = 0;
 
-  if(descriptor && descriptor->file){
-    file_seek(descriptor->file, position);
-  } else {
-    return;
+  if (kaddr == NULL) {
+    sys_exit(-1);
   }
-  lock_release(&archivos);
+
+  lock_acquire(&futex_lock);
+  futex = intmap_find(&futexes, (uintptr_t) kaddr);
+  if (futex != NULL) {
+    while (futex->waiters > 0 && despertados < n) {
+      futex->waiters--;
+      sema_up(&futex->sema);
+      despertados++;
+    }
+  }
+  lock_release(&futex_lock);
+  return despertados;
 }
 
-unsigned sys_tell(int fd){
-  lock_acquire(&archivos);
-  struct descriptor *descriptor = obtener_descriptor(fd);
-  int retorno;
-  if(descriptor && descriptor->file) {
-    retorno = file_tell(descriptor->file);
-  } else {
-    retorno = -1;
+tid_t sys_thread_spawn(void *entry, void *func, void *aux){
+  // el punto de entrada tiene que estar en el espacio de usuario
+  if (!is_user_vaddr(entry)) {
+    sys_exit(-1);
   }
-  lock_release(&archivos);
-  return retorno;
+  return process_thread_spawn(entry, func, aux);
+}
+
+int sys_thread_join(tid_t tid){
+  return process_thread_join(tid);
+}
+
+void sys_thread_exit(void){
+  struct thread *actual = thread_current();
+
+  if (actual->proceso == actual) {
+    sys_exit(0);
+  }
+  thread_exit();
+}
+
+/* Devuelve la direccion en el kernel de la palabra de usuario UADDR, o
+   NULL si no esta alineada a 4 bytes o no esta mapeada. */
+static int *futex_kaddr(const void *uaddr){
+  if (uaddr == NULL || (uintptr_t) uaddr % sizeof (int) != 0
+      || !is_user_vaddr(uaddr)) {
+    return NULL;
+  }
+#ifdef VM
+  // con paginacion por demanda la pagina puede no estar cargada todavia
+  if (get_user(uaddr) == -1) {
+    return NULL;
+  }
+#endif
+  return pagedir_get_page(thread_current()->pagedir, uaddr);
 }
 
 static bool put_user(uint8_t *udst, uint8_t byte)
@@ -682,4 +2762,63 @@ static bool put_user(uint8_t *udst, uint8_t byte)
   } else {
     return false;
   }  
-}
\ No newline at end of file
+}
+
+#ifdef VM
+int sys_mmap(int fd, void *addr){
+  tomar_descriptores();
+  struct descriptor *descriptor = obtener_descriptor(fd);
+  int retorno = -1;
+  // obtener_descriptor ya descarta la consola
+  if(descriptor && descriptor->file && !es_directorio(descriptor)){
+    retorno = mmap_map(descriptor->file, addr);
+  }
+  soltar_descriptores();
+  return retorno;
+}
+
+void sys_munmap(int mapping){
+  mmap_unmap(mapping);
+}
+
+int sys_shm_open(const char *name, unsigned size){
+  char *nombre = copiar_cadena(name);
+  if(nombre == NULL){
+    return -1;
+  }
+  int retorno = shm_open(nombre, size);
+  palloc_free_page(nombre);
+  return retorno;
+}
+
+void *sys_shm_map(int shmid, void *addr){
+  return shm_map(shmid, addr);
+}
+
+int sys_shm_unmap(void *addr){
+  return shm_unmap(addr) ? 0 : -1;
+}
+
+int sys_checkpoint(struct intr_frame *f, const char *file){
+  char *nombre = copiar_cadena(file);
+  if(nombre == NULL){
+    return -1;
+  }
+  // como en fork, los descriptores no cambian mientras se guardan
+  tomar_descriptores();
+  int retorno = process_checkpoint(f, nombre);
+  soltar_descriptores();
+  palloc_free_page(nombre);
+  return retorno;
+}
+
+tid_t sys_restore(const char *file){
+  char *nombre = copiar_cadena(file);
+  if(nombre == NULL){
+    return -1;
+  }
+  tid_t pid = process_restore(nombre);
+  palloc_free_page(nombre);
+  return pid;
+}
+#endif
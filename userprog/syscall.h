@@ -2,6 +2,7 @@
 #define USERPROG_SYSCALL_H
 
 void syscall_init (void);
+void syscall_print_stats (void);
 /*
     Termina el programa de usuario actual, devolviendo el estado al kernel. Si el padre del proceso 
     lo espera (ver más abajo), este es el estado que se devolverá. Convencionalmente, un estado de 0
@@ -75,6 +75,25 @@ struct tss
 /* Kernel TSS. */
 static struct tss *tss;
 
+/* Model-specific registers that set up SYSENTER.
+   See [IA32-v3a] 4.8.7 "Fast System Calls in 32-Bit Mode". */
+#define MSR_SYSENTER_CS 0x174   /* Ring 0 code selector. */
+#define MSR_SYSENTER_ESP 0x175  /* Ring 0 stack pointer. */
+#define MSR_SYSENTER_EIP 0x176  /* Ring 0 entry point. */
+
+/* CPUID function 1 EDX bit for SYSENTER and SYSEXIT. */
+#define CPUID_SEP 0x800
+
+void syscall_sysenter (void);
+static bool sysenter_supported (void);
+
+/* Writes VALUE to model-specific register MSR. */
+static inline void
+wrmsr (uint32_t msr, uint32_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
+
 /* Initializes the kernel TSS. */
 void
 tss_init (void) 
@@ -86,6 +105,39 @@ tss_init (void)
   tss->ss0 = SEL_KDSEG;
   tss->bitmap = 0xdfff;
   tss_update ();
+
+  /* Let user programs enter the kernel with SYSENTER, if the CPU
+     has it.  The entry point loads its stack pointer from the
+     esp0 member of the TSS, which tss_update() keeps current, so
+     MSR_SYSENTER_ESP never has to change.  SYSEXIT returns to
+     the user code and data selectors, which must follow the
+     kernel ones in the GDT in the order SYSENTER requires. */
+  if (sysenter_supported ())
+    {
+      ASSERT (SEL_KDSEG == SEL_KCSEG + 8);
+      ASSERT (SEL_UCSEG == (SEL_KCSEG + 16) + 3);
+      ASSERT (SEL_UDSEG == (SEL_KCSEG + 24) + 3);
+      wrmsr (MSR_SYSENTER_CS, SEL_KCSEG);
+      wrmsr (MSR_SYSENTER_ESP, (uint32_t) &tss->esp0);
+      wrmsr (MSR_SYSENTER_EIP, (uint32_t) syscall_sysenter);
+    }
+}
+
+/* Returns true if the CPU supports SYSENTER and SYSEXIT.  The
+   earliest Pentium Pro models report support that they lack.
+   lib/user/syscall.c makes the same test. */
+static bool
+sysenter_supported (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+  unsigned family, model, stepping;
+
+  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx) : "a" (1));
+  family = (eax >> 8) & 0xf;
+  model = (eax >> 4) & 0xf;
+  stepping = eax & 0xf;
+  return ((edx & CPUID_SEP) != 0
+          && !(family == 6 && model < 3 && stepping < 3));
 }
 
 /* Returns the kernel TSS. */
@@ -102,5 +154,5 @@ void
 tss_update (void) 
 {
   ASSERT (tss != NULL);
-  tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
+  tss->esp0 = thread_current ()->kstack + thread_current ()->kstack_size;
 }
@@ -0,0 +1,444 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "devices/timer.h"
+#include "devices/virtio-balloon.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/share.h"
+
+/* One frame per page that the user pool can own, in address
+   order.  Frames of pages the kernel pool owns stay empty. */
+static struct frame *frames;
+static size_t frame_cnt;
+static uint8_t *user_base;
+
+/* Clock hand, an index into FRAMES. */
+static size_t hand;
+static struct lock hand_lock;
+
+/* A page accessed in each of the last AGE_BITS samples has the
+   top bit of its age set by the latest one.  A page whose age has
+   decayed below AGE_COLD is a candidate for cleaning. */
+#define AGE_BITS 8
+#define AGE_TOP (1u << (AGE_BITS - 1))
+#define AGE_COLD (AGE_TOP >> 2)
+
+/* The page daemon wakes every RECLAIM_TICKS, or when fewer than
+   the low watermark of user frames are free, and evicts pages
+   until the high watermark is free again.  It cleans at most
+   CLEAN_MAX cold dirty pages each time it runs. */
+#define RECLAIM_TICKS (TIMER_FREQ / 4)
+#define CLEAN_MAX 32
+static size_t low_water, high_water;
+
+/* Wakes the page daemon, once while RECLAIM_PENDING. */
+static struct semaphore reclaim_wanted;
+static struct timer_event reclaim_event;
+static bool reclaim_started, reclaim_pending;
+
+/* Frame statistics. */
+static struct
+  {
+    unsigned long long reclaimed;       /* Evicted by the page daemon. */
+    unsigned long long evicted;         /* Evicted by frame_alloc(). */
+    unsigned long long cleaned;         /* Written back ahead of eviction. */
+  }
+stats;
+
+static struct frame *frame_of (void *kpage);
+static struct frame *next_victim (void);
+static struct frame *evict (void);
+static void set_owner (struct frame *, struct thread *);
+static void age_frame (struct frame *, bool accessed, struct tlb_batch *);
+static size_t free_frames (void);
+static thread_func reclaim_thread;
+static timer_event_func wake_reclaim;
+
+/* Initializes the frame table, with one frame for each page the
+   user pool can own. */
+void
+frame_init (void)
+{
+  size_t i;
+
+  palloc_get_user_range ((void **) &user_base, &frame_cnt);
+  frames = calloc (frame_cnt, sizeof *frames);
+  if (frames == NULL && frame_cnt > 0)
+    PANIC ("Not enough memory for the frame table.");
+  for (i = 0; i < frame_cnt; i++)
+    {
+      lock_init (&frames[i].lock);
+      frames[i].kpage = user_base + i * PGSIZE;
+    }
+  lock_init (&hand_lock);
+  sema_init (&reclaim_wanted, 0);
+  low_water = frame_cnt / 32 > 4 ? frame_cnt / 32 : 4;
+  high_water = 2 * low_water;
+}
+
+/* Starts the page daemon, which ages pages by their accessed
+   bits, cleans cold dirty pages and keeps some frames free, so
+   that frame_alloc() rarely has to evict.  Must be called after
+   thread_start() and swap_init(). */
+void
+frame_start_reclaim (void)
+{
+  if (frame_cnt > high_water)
+    {
+      reclaim_started = true;
+      thread_create ("pagedaemon", PRI_MIN, reclaim_thread, NULL);
+    }
+}
+
+/* Prints frame statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frame: %llu pages reclaimed in the background, %llu evicted "
+          "on demand, %llu cleaned ahead of eviction\n",
+          stats.reclaimed, stats.evicted, stats.cleaned);
+}
+
+/* Returns the number of frames in the table. */
+size_t
+frame_count (void)
+{
+  return frame_cnt;
+}
+
+/* Returns frame IDX of the table, which must be less than
+   frame_count(), for code that sweeps the table as the clock
+   does.  The frame must be locked before its page is looked
+   at. */
+struct frame *
+frame_at (size_t idx)
+{
+  ASSERT (idx < frame_cnt);
+  return &frames[idx];
+}
+
+/* Obtains a frame to hold PAGE of OWNER and returns it locked.
+   Its contents are undefined.  If the user pool is exhausted,
+   frees an idle shared file page, or takes a page back from the
+   memory balloon, or else evicts another page if MAY_EVICT is
+   true.  Returns a null pointer if there is no free
+   frame and none can be evicted. */
+struct frame *
+frame_alloc (struct thread *owner, struct page *page, bool may_evict)
+{
+  void *kpage = palloc_get_page (PAL_USER);
+  struct frame *f;
+
+  if (kpage == NULL && share_shrink (1) > 0)
+    kpage = palloc_get_page (PAL_USER);
+  if (kpage == NULL && virtio_balloon_shrink (1) > 0)
+    kpage = palloc_get_page (PAL_USER);
+
+  if (kpage != NULL)
+    {
+      f = frame_of (kpage);
+      lock_acquire (&f->lock);
+    }
+  else
+    {
+      f = may_evict ? evict () : NULL;
+      if (f == NULL)
+        return NULL;
+      thread_current ()->proceso->desalojos++;
+      stats.evicted++;
+    }
+  set_owner (f, owner);
+  f->page = page;
+  f->pin_cnt = 0;
+  f->age = AGE_TOP;
+
+  if (reclaim_started && !reclaim_pending && free_frames () < low_water)
+    {
+      reclaim_pending = true;
+      sema_up (&reclaim_wanted);
+    }
+  return f;
+}
+
+/* Obtains a page of the user pool that the caller manages
+   itself, outside the clock, evicting another page if the pool
+   is exhausted.  Returns a null pointer if no page can be
+   evicted.  Free the page with palloc_free_page(). */
+void *
+frame_alloc_page (void)
+{
+  struct frame *f = frame_alloc (NULL, NULL, true);
+  void *kpage;
+
+  if (f == NULL)
+    return NULL;
+  kpage = f->kpage;
+  frame_unlock (f);
+  return kpage;
+}
+
+/* Puts PAGE of OWNER, which already maps user pool page KPAGE
+   and is its only user, in the frame of KPAGE, which must hold
+   no page.  Returns the frame, unlocked. */
+struct frame *
+frame_adopt (void *kpage, struct thread *owner, struct page *page)
+{
+  struct frame *f = frame_of (kpage);
+
+  lock_acquire (&f->lock);
+  ASSERT (f->page == NULL);
+  set_owner (f, owner);
+  f->page = page;
+  f->pin_cnt = 0;
+  f->age = AGE_TOP;
+  lock_release (&f->lock);
+  return f;
+}
+
+/* Frees locked frame F, which must not be mapped, and its page. */
+void
+frame_free (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  f->page = NULL;
+  set_owner (f, NULL);
+  palloc_free_page (f->kpage);
+  lock_release (&f->lock);
+}
+
+/* Unlocks frame F after its page has been filled and mapped,
+   making it a candidate for eviction. */
+void
+frame_unlock (struct frame *f)
+{
+  lock_release (&f->lock);
+}
+
+/* Called when the process that owns PAGE exits, to take PAGE out
+   of frame F unless F was already evicted and given to another
+   page.  Waits for an eviction of F in progress.  The memory
+   itself is still mapped, and is freed with the page directory. */
+void
+frame_release (struct frame *f, struct page *page)
+{
+  lock_acquire (&f->lock);
+  if (f->page == page)
+    {
+      f->page = NULL;
+      set_owner (f, NULL);
+    }
+  lock_release (&f->lock);
+}
+
+/* Takes the page out of locked frame F, whose memory goes on
+   being mapped by the processes that still share it, outside the
+   clock, until the last of them frees it with its page
+   directory. */
+void
+frame_detach (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  f->page = NULL;
+  f->pin_cnt = 0;
+  set_owner (f, NULL);
+}
+
+/* Takes a sample of the accessed bit of the page in locked frame
+   F, which was ACCESSED since the last sample, into the frame's
+   age, and clears the bit for the next sample.  The age is a
+   shift register of the samples, newest in the top bit, so that
+   pages used more recently have larger ages, as in LRU.
+
+   The TLB entry is only added to B, to be invalidated with those
+   of the other frames aged in the same sweep.  Until then the
+   page may be used without the bit being set again, which makes
+   it look at worst a sample older than it is. */
+static void
+age_frame (struct frame *f, bool accessed, struct tlb_batch *b)
+{
+  f->age = (f->age >> 1) | (accessed ? AGE_TOP : 0);
+  if (accessed)
+    pagedir_clear_accessed (f->owner->pagedir, f->page->upage, b);
+}
+
+/* Returns the number of free pages in the user pool. */
+static size_t
+free_frames (void)
+{
+  size_t free_pages;
+  int largest;
+
+  palloc_get_stats (PAL_USER, &free_pages, &largest);
+  return free_pages;
+}
+
+/* Page daemon.  Each time it wakes, it samples the accessed bit
+   of every page in a frame, frees idle shared file pages (see
+   vm/share.h) and then evicts the pages that have gone the
+   longest without use until HIGH_WATER frames are free, if fewer
+   than LOW_WATER are, and then writes back some cold dirty pages,
+   so that the next evictions need no write. */
+static void
+reclaim_thread (void *aux UNUSED)
+{
+  /* Keep MLFQS from raising our priority. */
+  thread_set_worker ();
+  for (;;)
+    {
+      struct tlb_batch b;
+      size_t i, cleaned = 0;
+
+      pagedir_batch_init (&b);
+      for (i = 0; i < frame_cnt; i++)
+        {
+          struct frame *f = &frames[i];
+
+          if (f->page == NULL || !lock_try_acquire (&f->lock))
+            continue;
+          if (f->page != NULL)
+            age_frame (f, pagedir_is_accessed (f->owner->pagedir,
+                                               f->page->upage), &b);
+          lock_release (&f->lock);
+        }
+      pagedir_batch_flush (&b);
+
+      if (free_frames () < low_water)
+        share_shrink (high_water - free_frames ());
+      if (free_frames () < low_water)
+        while (free_frames () < high_water)
+          {
+            struct frame *f = evict ();
+            if (f == NULL)
+              break;
+            frame_free (f);
+            stats.reclaimed++;
+          }
+
+      for (i = 0; i < frame_cnt && cleaned < CLEAN_MAX; i++)
+        {
+          struct frame *f = &frames[i];
+
+          if (f->page == NULL || f->age >= AGE_COLD
+              || !lock_try_acquire (&f->lock))
+            continue;
+          if (f->page != NULL && f->pin_cnt == 0
+              && !pagedir_is_shared (f->kpage)
+              && pagedir_is_dirty (f->owner->pagedir, f->page->upage)
+              && page_clean (f->page, f->owner))
+            {
+              cleaned++;
+              stats.cleaned++;
+            }
+          lock_release (&f->lock);
+        }
+
+      timer_add (&reclaim_event, timer_ticks () + RECLAIM_TICKS,
+                 wake_reclaim, NULL);
+      sema_down (&reclaim_wanted);
+      timer_cancel (&reclaim_event);
+      reclaim_pending = false;
+    }
+}
+
+/* Wakes the page daemon from the timer interrupt. */
+static void
+wake_reclaim (void *aux UNUSED)
+{
+  if (!reclaim_pending)
+    {
+      reclaim_pending = true;
+      sema_up (&reclaim_wanted);
+    }
+}
+
+/* Makes OWNER, which may be null, the owner of locked frame F,
+   keeping count of the frames each process holds. */
+static void
+set_owner (struct frame *f, struct thread *owner)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (f->owner != NULL)
+    f->owner->marcos--;
+  f->owner = owner;
+  if (owner != NULL && ++owner->marcos > owner->marcos_pico)
+    owner->marcos_pico = owner->marcos;
+  intr_set_level (old_level);
+}
+
+/* Returns the frame that holds user pool page KPAGE. */
+static struct frame *
+frame_of (void *kpage)
+{
+  size_t idx = ((uint8_t *) kpage - user_base) / PGSIZE;
+
+  ASSERT (idx < frame_cnt);
+  return &frames[idx];
+}
+
+/* Advances the clock hand to the next page whose accessed bit is
+   clear and whose age has decayed to zero, aging the pages it
+   passes, and returns its frame locked.  Returns a null pointer
+   if AGE_BITS + 2 full sweeps find none, meaning every frame is
+   locked or free. */
+static struct frame *
+next_victim (void)
+{
+  struct frame *victim = NULL;
+  struct tlb_batch b;
+  size_t i;
+
+  pagedir_batch_init (&b);
+  lock_acquire (&hand_lock);
+  for (i = 0; victim == NULL && i < (AGE_BITS + 2) * frame_cnt; i++)
+    {
+      struct frame *f = &frames[hand];
+      hand = hand + 1 < frame_cnt ? hand + 1 : 0;
+
+      if (f->page == NULL || !lock_try_acquire (&f->lock))
+        continue;
+      if (f->page == NULL || f->pin_cnt > 0 || pagedir_is_shared (f->kpage))
+        lock_release (&f->lock);
+      else if (pagedir_is_accessed (f->owner->pagedir, f->page->upage)
+               || f->age > 0)
+        {
+          age_frame (f, pagedir_is_accessed (f->owner->pagedir,
+                                             f->page->upage), &b);
+          lock_release (&f->lock);
+        }
+      else
+        victim = f;
+    }
+  lock_release (&hand_lock);
+  pagedir_batch_flush (&b);
+  return victim;
+}
+
+/* Evicts a page chosen by the clock algorithm and returns its
+   frame, locked.  Returns a null pointer if no page can be
+   evicted. */
+static struct frame *
+evict (void)
+{
+  size_t tries;
+
+  for (tries = 0; tries < frame_cnt; tries++)
+    {
+      struct frame *f = next_victim ();
+      if (f == NULL)
+        break;
+      if (page_evict (f->page, f->owner))
+        return f;
+      lock_release (&f->lock);
+    }
+  return NULL;
+}
@@ -0,0 +1,62 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/synch.h"
+
+struct page;
+struct thread;
+
+/* Frame table.
+
+   There is one frame for each page of the user pool, which holds
+   at most one demand-paged user page.  When the user pool runs
+   out, frame_alloc() takes a frame from another page, possibly of
+   another process, chosen by the clock algorithm: the clock hand
+   sweeps the table, aging each page it passes, and evicts the
+   first page that has not been accessed for AGE_BITS sweeps.  A
+   page's age shifts in its accessed bit at each sample, so pages
+   used recently survive more sweeps, approximating LRU.
+
+   To keep eviction off the fault path, a low-priority page
+   daemon also samples the accessed bits periodically, evicts
+   pages ahead of demand when few frames are free, and writes
+   back cold dirty pages, so that evicting them later is cheap.
+
+   Each frame has its own lock, held while the frame is filled or
+   its page is evicted, so slow work on one frame does not hold
+   up faults that use other frames.  The clock hand has a lock of
+   its own that is held only while choosing a victim.  The clock
+   skips frames that are locked, frames pinned by page_pin()
+   while the kernel works on their pages for a system call, and
+   frames whose pages fork() left mapped by more than one
+   process (see userprog/pagedir.c). */
+
+/* A physical frame in the user pool. */
+struct frame
+  {
+    struct lock lock;           /* Held while filling or evicting. */
+    void *kpage;                /* Kernel virtual address. */
+    struct thread *owner;       /* Process whose page this holds. */
+    struct page *page;          /* Page held, or null if free. */
+    unsigned pin_cnt;           /* Nonzero keeps the clock away. */
+    uint8_t age;                /* Recent use, more recent is larger. */
+  };
+
+void frame_init (void);
+void frame_start_reclaim (void);
+void frame_print_stats (void);
+struct frame *frame_alloc (struct thread *owner, struct page *,
+                           bool may_evict);
+void *frame_alloc_page (void);
+struct frame *frame_adopt (void *kpage, struct thread *owner, struct page *);
+void frame_free (struct frame *);
+void frame_unlock (struct frame *);
+void frame_release (struct frame *, struct page *);
+void frame_detach (struct frame *);
+size_t frame_count (void);
+struct frame *frame_at (size_t idx);
+
+#endif /* vm/frame.h */
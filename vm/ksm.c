@@ -0,0 +1,201 @@
+#include "vm/ksm.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "devices/timer.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+bool ksm_enabled;
+
+/* The daemon looks at KSM_BATCH frames every KSM_TICKS, so it
+   sweeps a table of 4096 frames in about 6 seconds. */
+#define KSM_TICKS (TIMER_FREQ / 10)
+#define KSM_BATCH 64
+
+/* What the daemon knows about the page in one frame.  NODES has
+   one for each frame of the table, in the same order. */
+struct ksm_node
+  {
+    struct hash_elem elem;      /* In CANDIDATES, for this sweep. */
+    struct page *page;          /* Page hashed last sweep, or null. */
+    unsigned sum;               /* Its hash. */
+  };
+
+static struct ksm_node *nodes;
+static size_t node_cnt;
+
+/* Pages that may be merged into, by hash.  Only the daemon
+   touches it, so it needs no lock. */
+static struct hash candidates;
+
+/* Next frame to look at. */
+static size_t cursor;
+
+/* Statistics.  Updated only by the daemon. */
+static struct
+  {
+    unsigned long long sweeps;          /* Sweeps of the frame table. */
+    unsigned long long scanned;         /* Pages hashed. */
+    unsigned long long changed;         /* Skipped, changed since last sweep. */
+    unsigned long long merged;          /* Pages merged into another. */
+  }
+stats;
+
+static hash_hash_func node_hash;
+static hash_less_func node_less;
+static thread_func ksm_thread NO_RETURN;
+static void scan_frame (size_t idx);
+
+/* Starts the same-page merging daemon if -ksm was given.  Must
+   be called after frame_init() and thread_start(). */
+void
+ksm_start (void)
+{
+  if (!ksm_enabled)
+    return;
+
+  node_cnt = frame_count ();
+  nodes = calloc (node_cnt, sizeof *nodes);
+  if ((nodes == NULL && node_cnt > 0)
+      || !hash_init (&candidates, node_hash, node_less, NULL))
+    {
+      printf ("ksm: not enough memory, same-page merging disabled\n");
+      free (nodes);
+      ksm_enabled = false;
+      return;
+    }
+  if (node_cnt > 0)
+    thread_create ("ksmd", PRI_MIN, ksm_thread, NULL);
+}
+
+/* Prints same-page merging statistics, with the pages that
+   merging saves now. */
+void
+ksm_print_stats (void)
+{
+  size_t pages, saved;
+
+  if (!ksm_enabled)
+    return;
+
+  pagedir_merge_stats (&pages, &saved);
+  printf ("KSM: %llu sweeps, %llu pages hashed, %llu changed, "
+          "%llu merged, %zu pages shared by %zu more mappings "
+          "(%zu kB saved)\n",
+          stats.sweeps, stats.scanned, stats.changed, stats.merged,
+          pages, saved, saved * (PGSIZE / 1024));
+}
+
+/* Same-page merging daemon. */
+static void
+ksm_thread (void *aux UNUSED)
+{
+  /* Keep MLFQS from raising our priority. */
+  thread_set_worker ();
+  for (;;)
+    {
+      size_t i;
+
+      for (i = 0; i < KSM_BATCH; i++)
+        {
+          if (cursor == 0)
+            {
+              hash_clear (&candidates, NULL);
+              stats.sweeps++;
+            }
+          scan_frame (cursor);
+          cursor = cursor + 1 < node_cnt ? cursor + 1 : 0;
+        }
+      timer_sleep (KSM_TICKS);
+    }
+}
+
+/* Hashes the page in frame IDX, if it is one that may be merged,
+   and merges it into a candidate with the same contents, or else
+   makes it a candidate itself. */
+static void
+scan_frame (size_t idx)
+{
+  struct frame *f = frame_at (idx);
+  struct ksm_node *n = &nodes[idx];
+  struct hash_elem *e;
+  bool shared, merged = false;
+  unsigned sum;
+
+  if (f->page == NULL || !lock_try_acquire (&f->lock))
+    return;
+  if (f->page == NULL || !page_mergeable (f->page, f->owner))
+    {
+      lock_release (&f->lock);
+      return;
+    }
+
+  sum = hash_words (f->kpage, PGSIZE / sizeof (uint32_t));
+  stats.scanned++;
+  shared = pagedir_is_shared (f->kpage);
+  if (!shared && (n->page != f->page || n->sum != sum))
+    {
+      /* Changed since the last sweep, so likely to be written
+         again soon. */
+      n->page = f->page;
+      n->sum = sum;
+      stats.changed++;
+      lock_release (&f->lock);
+      return;
+    }
+  n->page = f->page;
+  n->sum = sum;
+
+  /* A shared page can only be merged into, and it is the best
+     page to merge others into, since it cannot change. */
+  e = shared ? NULL : hash_find (&candidates, &n->elem);
+  if (e != NULL)
+    {
+      struct ksm_node *into = hash_entry (e, struct ksm_node, elem);
+      struct frame *g = frame_at (into - nodes);
+
+      if (lock_try_acquire (&g->lock))
+        {
+          if (g->page != NULL && g->page == into->page
+              && page_mergeable (g->page, g->owner))
+            merged = page_merge (f->page, f->owner, g->page, g->owner);
+          lock_release (&g->lock);
+        }
+    }
+
+  if (merged)
+    {
+      n->page = NULL;
+      stats.merged++;
+    }
+  else
+    {
+      /* Take the place of a candidate that is gone or differs. */
+      hash_replace (&candidates, &n->elem);
+      lock_release (&f->lock);
+    }
+}
+
+/* Returns a hash value for node E, its page's hash. */
+static unsigned
+node_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_entry (e, struct ksm_node, elem)->sum;
+}
+
+/* Returns true if node A's page hashes lower than node B's. */
+static bool
+node_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct ksm_node *a = hash_entry (a_, struct ksm_node, elem);
+  const struct ksm_node *b = hash_entry (b_, struct ksm_node, elem);
+
+  return a->sum < b->sum;
+}
@@ -0,0 +1,33 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+
+#include <stdbool.h>
+
+/* Same-page merging.
+
+   Many processes running the same program end up with private
+   pages that hold the same bytes: heaps and data segments
+   initialized the same way, and pages of zeros that were only
+   written with zeros.  A low-priority daemon sweeps the frame
+   table a few pages at a time, hashes each private page it
+   finds, and when two pages hash alike and compare equal in
+   full, maps the second one copy-on-write to the memory of the
+   first and frees its frame, just as fork() would have shared
+   it.  The first write to a merged page by any process gives
+   that process a copy of its own again (see vm/page.h).
+
+   Only pages that kept the same hash for a whole sweep are
+   merged, since a page that is being written would just be
+   copied again on the next write.  Candidates are kept in a hash
+   table by their hash, which is emptied at the start of every
+   sweep, so that it never refers to pages that have long since
+   changed.  A merged page stays in the table as the page that
+   later ones with its contents are merged into. */
+
+/* -ksm: run the same-page merging daemon.  Off by default. */
+extern bool ksm_enabled;
+
+void ksm_start (void);
+void ksm_print_stats (void);
+
+#endif /* vm/ksm.h */
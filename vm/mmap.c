@@ -0,0 +1,130 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+
+static void unmap (struct mapping *);
+
+/* Maps FILE, which the caller keeps open, into the current
+   process starting at user page ADDR, and returns the mapping's
+   id.  The mapping reads and writes a separate reopening of FILE,
+   so closing or removing FILE leaves it intact.  Returns -1 if
+   FILE is empty, ADDR is null or not page-aligned, or the pages
+   would overlap pages already in the address space or the
+   kernel. */
+int
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ()->proceso;
+  struct mapping *m;
+  off_t length = file_length (file);
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0 || length == 0)
+    return -1;
+
+  m = malloc_tagged (sizeof *m, MEM_PROCESS);
+  if (m == NULL)
+    return -1;
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return -1;
+    }
+  m->addr = addr;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  if ((uintptr_t) addr + m->page_cnt * PGSIZE > (uintptr_t) PHYS_BASE
+      || (uintptr_t) addr + m->page_cnt * PGSIZE < (uintptr_t) addr)
+    goto fail;
+
+  /* Recording a page fails if another page is already there.
+     The stack is mapped without being recorded. */
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      uint8_t *upage = (uint8_t *) addr + i * PGSIZE;
+      off_t ofs = i * PGSIZE;
+      uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (pagedir_get_page (t->pagedir, upage) != NULL
+          || !page_record_file (upage, m->file, ofs, read_bytes, true, true))
+        {
+          while (i-- > 0)
+            page_remove ((uint8_t *) addr + i * PGSIZE);
+          goto fail;
+        }
+    }
+
+  lock_acquire (&t->pages_lock);
+  m->id = t->next_mapid++;
+  list_push_back (&t->mappings, &m->elem);
+  lock_release (&t->pages_lock);
+  return m->id;
+
+ fail:
+  file_close (m->file);
+  free (m);
+  return -1;
+}
+
+/* Unmaps mapping ID of the current process, writing its modified
+   pages back to the file.  Returns false if there is no such
+   mapping. */
+bool
+mmap_unmap (int id)
+{
+  struct thread *t = thread_current ()->proceso;
+  struct mapping *m = NULL;
+  struct list_elem *e;
+
+  lock_acquire (&t->pages_lock);
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    if (list_entry (e, struct mapping, elem)->id == id)
+      {
+        m = list_entry (e, struct mapping, elem);
+        list_remove (&m->elem);
+        break;
+      }
+  lock_release (&t->pages_lock);
+
+  if (m == NULL)
+    return false;
+  unmap (m);
+  return true;
+}
+
+/* Unmaps every mapping of the current process, which is
+   exiting. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ()->proceso;
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_pop_front (&t->mappings), struct mapping, elem));
+}
+
+/* Removes the pages of mapping M, which is no longer in its
+   process's list, and frees it. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  /* Unmap the whole range with one TLB flush first.  The dirty
+     bits stay put for page_remove() to write back. */
+  pagedir_clear_range (thread_current ()->proceso->pagedir, m->addr,
+                       m->page_cnt);
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove ((uint8_t *) m->addr + i * PGSIZE);
+  file_close (m->file);
+  free (m);
+}
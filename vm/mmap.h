@@ -0,0 +1,31 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct file;
+
+/* Memory-mapped files.
+
+   mmap_map() records each page of a file as a WRITEBACK page in
+   the supplemental page table, so the pages fault in from the
+   file on first touch and go back to it, only if modified, when
+   they are evicted, unmapped, or the process exits. */
+
+/* A mapping of a file into a process's address space. */
+struct mapping
+  {
+    struct list_elem elem;      /* Element in the process's list. */
+    int id;                     /* Mapping id. */
+    struct file *file;          /* Private reopening of the file. */
+    void *addr;                 /* First user page. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+int mmap_map (struct file *, void *addr);
+bool mmap_unmap (int id);
+void mmap_unmap_all (void);
+
+#endif /* vm/mmap.h */
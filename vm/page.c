@@ -0,0 +1,1485 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/frame.h"
+#include "vm/share.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
+
+/* Cache of supplemental page table entries. */
+static struct kmem_cache *page_cache;
+
+/* A page of zeros, mapped read-only for zero-filled pages that
+   have only been read. */
+static void *zero_page;
+
+/* Maximum number of pages mapped around a fault. */
+#define FAULT_AROUND_MAX 16
+
+/* Pages in a huge page, which a single 4 MB PDE maps. */
+#define HUGE_PAGES (PTSPAN / PGSIZE)
+
+/* CR4 bit that enables 4 MB pages.  See [IA32-v3a] 2.5 "Control
+   Registers". */
+#define CR4_PSE 0x10
+
+/* Can user pages be mapped 4 MB at a time? */
+static bool huge_ok;
+
+/* Flags in the low bits of an entry of a checkpoint image's page
+   table, whose other bits are the page's user virtual address. */
+#define IMAGE_WRITABLE 0x1      /* Map read/write. */
+#define IMAGE_ZERO 0x2          /* All zeros, not stored in the image. */
+
+/* Faults that brought pages in, by where the page came from, and
+   pages mapped around them.  Updated without a lock, so counts
+   may be slightly off. */
+static struct
+  {
+    unsigned long long file;    /* Executable segments. */
+    unsigned long long mmap;    /* Memory-mapped files. */
+    unsigned long long anon;    /* Zero-filled pages. */
+    unsigned long long swap;    /* Swap. */
+    unsigned long long around;  /* Pages mapped by fault-around. */
+    unsigned long long zero;    /* Mappings of the zero page. */
+    unsigned long long huge;    /* Regions mapped with a huge page. */
+    unsigned long long split;   /* Huge pages split again. */
+  }
+stats;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destroy;
+static struct page *page_lookup (struct thread *, const void *upage);
+static bool fill_from_swap (struct thread *, struct page *, struct frame *);
+static bool swap_out_run (struct page *, struct thread *owner);
+static bool load_page (struct thread *, struct page *, bool write);
+static bool map_zero (struct thread *, struct page *);
+static bool map_huge (struct thread *, struct page *, bool write);
+static bool split_huge (struct thread *, struct page *);
+static bool break_zero (struct thread *, struct page *);
+static bool fill_page (struct thread *, struct page *, struct frame *);
+static size_t fault_around (struct thread *, struct page *, size_t window);
+static bool fork_page (struct thread *parent, struct page *);
+static bool fork_shm (struct page *);
+static bool map_shared (struct thread *, struct page *, bool *read);
+static void unmap_shared (struct thread *, struct page *);
+
+/* Initializes the supplemental page table module. */
+void
+page_init (void)
+{
+  uint32_t cr4;
+
+  page_cache = kmem_cache_create ("page", sizeof (struct page), NULL);
+  zero_page = palloc_get_page_tagged (PAL_ASSERT | PAL_ZERO, MEM_USER);
+
+  /* paging_init() turned on 4 MB pages if the CPU has them. */
+  asm ("movl %%cr4, %0" : "=r" (cr4));
+  huge_ok = (cr4 & CR4_PSE) != 0;
+}
+
+/* Initializes T's supplemental page table, which must be empty.
+   Returns true if successful, false on memory allocation
+   failure. */
+bool
+page_table_init (struct thread *t)
+{
+  lock_init (&t->pages_lock);
+  list_init (&t->mappings);
+  t->next_mapid = 0;
+  list_init (&t->shms);
+  t->next_shmid = 0;
+  t->fault_next = NULL;
+  t->fault_window = 0;
+  return hash_init (&t->pages, page_hash, page_less, NULL);
+}
+
+/* Frees every entry in T's supplemental page table, which must
+   have been initialized, and the table itself, taking its pages
+   out of the frame table and freeing their swap slots.  The
+   memory of the pages that are in is still mapped in T's page
+   directory and is freed with it, so this must be called before
+   pagedir_destroy().  Shared pages are unmapped here instead. */
+void
+page_table_destroy (struct thread *t)
+{
+  lock_acquire (&t->pages_lock);
+  hash_destroy (&t->pages, page_destroy);
+  lock_release (&t->pages_lock);
+}
+
+/* Records that user page UPAGE of the current process is to be
+   filled, on first touch, with READ_BYTES bytes read from FILE
+   at offset OFS followed by zeros, and mapped writable if
+   WRITABLE is true.  If WRITEBACK is true, modifications are
+   written back to those bytes of FILE, otherwise the page goes
+   to swap.  FILE must stay open until the page is removed or the
+   process exits.  Returns false if UPAGE is already recorded or
+   on memory allocation failure. */
+bool
+page_record_file (void *upage, struct file *file, off_t ofs,
+                  uint32_t read_bytes, bool writable, bool writeback)
+{
+  struct thread *t = thread_current ()->proceso;
+  struct page *p;
+  bool success;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = kmem_cache_alloc (page_cache);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->file = read_bytes > 0 ? file : NULL;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->writable = writable;
+  p->frame = NULL;
+  p->swap_slot = SWAP_NONE;
+  p->writeback = writeback;
+  p->share = NULL;
+  p->zero = false;
+  p->shm = NULL;
+  p->huge = false;
+
+  lock_acquire (&t->pages_lock);
+  success = hash_insert (&t->pages, &p->elem) == NULL;
+  lock_release (&t->pages_lock);
+
+  if (!success)
+    kmem_cache_free (page_cache, p);
+  return success;
+}
+
+/* Records user page UPAGE of the current process as page PAGE of
+   shared memory segment S, and maps it writable from S's frame
+   at once, taking a reference to S.  Returns false if UPAGE is
+   already recorded, or on memory allocation failure. */
+bool
+page_record_shm (void *upage, struct shm *s, size_t page)
+{
+  struct thread *t = thread_current ()->proceso;
+  struct page *p;
+  bool success = false;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  p = kmem_cache_alloc (page_cache);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->file = NULL;
+  p->ofs = page * PGSIZE;
+  p->read_bytes = 0;
+  p->writable = true;
+  p->frame = NULL;
+  p->swap_slot = SWAP_NONE;
+  p->writeback = false;
+  p->share = NULL;
+  p->zero = false;
+  p->shm = s;
+  p->huge = false;
+
+  lock_acquire (&t->pages_lock);
+  if (hash_insert (&t->pages, &p->elem) == NULL)
+    {
+      success = pagedir_set_page (t->pagedir, upage, shm_kpage (s, page),
+                                  true);
+      if (success)
+        shm_ref (s);
+      else
+        hash_delete (&t->pages, &p->elem);
+    }
+  lock_release (&t->pages_lock);
+
+  if (!success)
+    kmem_cache_free (page_cache, p);
+  return success;
+}
+
+/* Removes the pages of the shared memory segment mapped at user
+   page UPAGE of the current process.  Returns false if no mapping
+   of a segment starts at UPAGE. */
+bool
+page_remove_shm (void *upage)
+{
+  struct thread *t = thread_current ()->proceso;
+  struct page *p;
+  struct shm *s;
+  uint8_t *next;
+  off_t ofs;
+
+  if (pg_ofs (upage) != 0 || !is_user_vaddr (upage))
+    return false;
+
+  lock_acquire (&t->pages_lock);
+  p = page_lookup (t, upage);
+  if (p == NULL || p->shm == NULL || p->ofs != 0)
+    {
+      lock_release (&t->pages_lock);
+      return false;
+    }
+
+  /* A mapping's pages follow each other in order.  The next
+     mapping of the same segment, if right behind, starts over at
+     offset 0. */
+  s = p->shm;
+  for (next = upage, ofs = 0; p != NULL && p->shm == s && p->ofs == ofs;
+       ofs += PGSIZE)
+    {
+      unmap_shared (t, p);
+      hash_delete (&t->pages, &p->elem);
+      kmem_cache_free (page_cache, p);
+      next += PGSIZE;
+      p = is_user_vaddr (next) ? page_lookup (t, next) : NULL;
+    }
+  lock_release (&t->pages_lock);
+  return true;
+}
+
+/* Removes user page UPAGE, which must be recorded, from the
+   current process, writing it back to its file first if it is a
+   WRITEBACK page and has been modified. */
+void
+page_remove (void *upage)
+{
+  struct thread *t = thread_current ()->proceso;
+  struct page *p;
+  struct frame *f;
+  void *kpage;
+  bool dirty;
+
+  lock_acquire (&t->pages_lock);
+  p = page_lookup (t, upage);
+  ASSERT (p != NULL);
+
+  /* A huge page cannot lose one of its pages, so it is split
+     first.  If that runs out of memory, the page's memory stays
+     mapped in the huge page, outside the table, until the process
+     exits. */
+  if (p->huge)
+    split_huge (t, p);
+
+  if (p->share != NULL || p->zero || p->shm != NULL)
+    unmap_shared (t, p);
+
+  /* Waits for an eviction in progress, which writes the page back
+     itself. */
+  f = p->frame;
+  if (f != NULL)
+    {
+      lock_acquire (&f->lock);
+      if (p->frame != f)
+        {
+          lock_release (&f->lock);
+          f = NULL;
+        }
+    }
+
+  /* A page that fork() or same-page merging shared, in a frame or
+     outside any, stays in memory for the processes that still map
+     it.  Pages written back to a file are never shared. */
+  kpage = pagedir_drop_page (t->pagedir, upage, &dirty);
+  if (f != NULL)
+    {
+      if (dirty && p->writeback)
+        file_write_at (p->file, f->kpage, p->read_bytes, p->ofs);
+      p->frame = NULL;
+      if (kpage != NULL)
+        frame_free (f);
+      else
+        {
+          frame_detach (f);
+          lock_release (&f->lock);
+        }
+    }
+  else if (kpage != NULL)
+    palloc_free_page (kpage);
+
+  hash_delete (&t->pages, &p->elem);
+  lock_release (&t->pages_lock);
+  swap_free (p->swap_slot);
+  kmem_cache_free (page_cache, p);
+}
+
+/* Brings in the user page of the current process that contains
+   ADDR, if the supplemental page table has it, for writing if
+   WRITE is true and otherwise for reading.  Returns true if
+   the page is mapped on return, false if ADDR is not a page the
+   process may touch, or if memory or the read fails. */
+bool
+page_load (const void *addr, bool write)
+{
+  struct thread *t = thread_current ()->proceso;
+  struct page *p;
+  void *upage;
+  bool success = false;
+
+  if (t->pagedir == NULL)
+    return false;
+
+  lock_acquire (&t->pages_lock);
+  upage = pg_round_down (addr);
+  p = page_lookup (t, upage);
+  if (p == NULL)
+    goto done;
+  if (p->frame != NULL || p->share != NULL || p->shm != NULL
+      || pagedir_get_page (t->pagedir, upage) != NULL)
+    {
+      /* In already, or being evicted. */
+      success = load_page (t, p, write);
+      goto done;
+    }
+
+  if (p->swap_slot != SWAP_NONE)
+    stats.swap++;
+  else if (p->writeback)
+    stats.mmap++;
+  else if (p->file != NULL)
+    stats.file++;
+  else
+    stats.anon++;
+
+  /* A fault on the page just past the previous one, or past the
+     pages mapped around it, continues a sequential scan, which
+     doubles the number of pages mapped around the next fault.
+     Any other fault starts over. */
+  if (upage == t->fault_next)
+    t->fault_window = (t->fault_window == 0 ? 1
+                       : t->fault_window * 2 < FAULT_AROUND_MAX
+                       ? t->fault_window * 2 : FAULT_AROUND_MAX);
+  else
+    t->fault_window = 0;
+
+  if (map_huge (t, p, write))
+    {
+      success = true;
+      goto done;
+    }
+
+  success = load_page (t, p, write);
+  if (success)
+    t->fault_next = (uint8_t *) upage
+                    + (p->swap_slot == SWAP_NONE
+                       ? fault_around (t, p, t->fault_window) + 1 : 1) * PGSIZE;
+
+ done:
+  lock_release (&t->pages_lock);
+  return success;
+}
+
+/* Prints statistics about demand paging. */
+void
+page_print_stats (void)
+{
+  printf ("Paging: %llu faults on executables, %llu on mappings, "
+          "%llu anonymous, %llu from swap, %llu pages mapped around, "
+          "%llu zero page mappings, %llu huge pages, %llu split\n",
+          stats.file, stats.mmap, stats.anon, stats.swap, stats.around,
+          stats.zero, stats.huge, stats.split);
+}
+
+/* Handles a write to the copy-on-write page of the current
+   process that contains ADDR, left by fork(), by giving the
+   process a copy of its own, or by making the page writable if no
+   other process maps it any more.  Returns true if the write may
+   be retried, false if the page is not copy-on-write or memory
+   runs out. */
+bool
+page_cow (const void *addr)
+{
+  struct thread *t = thread_current ()->proceso;
+  void *upage = pg_round_down (addr);
+  struct page *p;
+  struct frame *f = NULL, *copy = NULL;
+  void *kpage, *spare = NULL, *mapped = NULL;
+
+  if (t->pagedir == NULL || !is_user_vaddr (addr))
+    return false;
+
+  lock_acquire (&t->pages_lock);
+  p = page_lookup (t, upage);
+
+  /* The zero page is replaced by a zeroed frame of its own. */
+  if (p != NULL && p->zero)
+    {
+      bool success = break_zero (t, p);
+      lock_release (&t->pages_lock);
+      return success;
+    }
+
+  /* Keep the page in its frame while we work. */
+  if (p != NULL && p->frame != NULL)
+    {
+      f = p->frame;
+      lock_acquire (&f->lock);
+      if (p->frame != f)
+        {
+          /* Evicted while we waited, so the write will fault the
+             page back in instead. */
+          lock_release (&f->lock);
+          lock_release (&t->pages_lock);
+          return true;
+        }
+    }
+
+  kpage = pagedir_get_page (t->pagedir, upage);
+  if (kpage == NULL)
+    goto done;
+  if (pagedir_is_shared (kpage))
+    {
+      if (p != NULL)
+        {
+          copy = frame_alloc (t, p, true);
+          if (copy != NULL)
+            spare = copy->kpage;
+        }
+      else
+        spare = frame_alloc_page ();
+      if (spare == NULL)
+        goto done;
+    }
+
+  mapped = pagedir_cow (t->pagedir, upage, spare);
+  if (mapped != NULL && mapped == spare)
+    {
+      /* The old frame goes on holding the page for the processes
+         that still share it, outside the clock. */
+      if (f != NULL)
+        {
+          copy->pin_cnt = f->pin_cnt;
+          frame_detach (f);
+        }
+      if (p != NULL)
+        p->frame = copy;
+      spare = NULL;
+    }
+  else if (mapped != NULL && p != NULL && f == NULL)
+    p->frame = frame_adopt (mapped, t, p);
+
+ done:
+  if (spare != NULL && copy != NULL)
+    frame_free (copy);
+  else if (spare != NULL)
+    palloc_free_page (spare);
+  else if (copy != NULL)
+    frame_unlock (copy);
+  if (f != NULL)
+    lock_release (&f->lock);
+  lock_release (&t->pages_lock);
+  return mapped != NULL;
+}
+
+/* Copies the address space of PARENT, which has forked and waits
+   for the copy, into the current process, whose page directory
+   and supplemental page table must be empty and whose executable
+   must already be open.  Pages that are in memory are shared
+   copy-on-write (see userprog/pagedir.c) and pages in swap are
+   brought in to be shared, while the rest are only recorded and
+   read in again on demand.  Huge pages are split first, so that
+   their pages can be shared one by one.  Memory mappings are not
+   inherited, while shared memory segments are mapped in both.
+   Returns true if successful, false if memory runs out, in which
+   case the current process must exit. */
+bool
+page_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct hash_iterator i;
+  void *upage;
+  bool success = true;
+
+  lock_acquire (&parent->pages_lock);
+  lock_acquire (&t->pages_lock);
+  hash_first (&i, &parent->pages);
+  while (success && hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, elem);
+      if (p->huge)
+        success = split_huge (parent, p);
+    }
+  hash_first (&i, &parent->pages);
+  while (success && hash_next (&i))
+    success = fork_page (parent, hash_entry (hash_cur (&i), struct page, elem));
+
+  /* Pages outside the table, such as the stack. */
+  for (upage = pagedir_next_page (parent->pagedir, NULL);
+       success && upage != NULL;
+       upage = pagedir_next_page (parent->pagedir, (uint8_t *) upage + PGSIZE))
+    if (page_lookup (parent, upage) == NULL)
+      success = pagedir_share_page (t->pagedir, parent->pagedir, upage);
+  lock_release (&t->pages_lock);
+  lock_release (&parent->pages_lock);
+  return success;
+}
+
+/* Writes the address space of the current process, which must
+   have no threads besides the caller's, to FILE at offset OFS, a
+   multiple of PGSIZE, as part of a checkpoint image: a table of
+   one entry per user page, padded to a whole number of pages,
+   followed by the contents of each page that is not all zeros,
+   one page each, in the order of the table.  Untouched anonymous
+   pages are known to be zeros without being brought in; the
+   others are brought in and pinned one at a time while they are
+   written.  Stores the number of pages in *PAGE_CNT.  Returns
+   false if the process has memory-mapped files or shared memory
+   segments, which an image cannot hold, or if memory runs out or
+   a write fails. */
+bool
+page_save (struct file *file, off_t ofs, size_t *page_cnt)
+{
+  struct thread *t = thread_current ()->proceso;
+  struct hash_iterator i;
+  uint32_t *table;
+  size_t max, cnt = 0, j;
+  off_t data_ofs;
+  void *upage;
+  bool success = true;
+
+  ASSERT (ofs % PGSIZE == 0);
+
+  lock_acquire (&t->pages_lock);
+  max = hash_size (&t->pages);
+  for (upage = pagedir_next_page (t->pagedir, NULL); upage != NULL;
+       upage = pagedir_next_page (t->pagedir, (uint8_t *) upage + PGSIZE))
+    if (page_lookup (t, upage) == NULL)
+      max++;
+  table = malloc (max * sizeof *table);
+  if (table == NULL)
+    {
+      lock_release (&t->pages_lock);
+      return false;
+    }
+
+  hash_first (&i, &t->pages);
+  while (success && hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, elem);
+
+      /* A page evicted after it was modified has a slot before it
+         leaves its frame, so one with neither holds zeros. */
+      bool zero = (p->zero
+                   || (p->file == NULL && p->frame == NULL
+                       && p->swap_slot == SWAP_NONE && !p->huge
+                       && pagedir_get_page (t->pagedir, p->upage) == NULL));
+      if (p->writeback || p->shm != NULL)
+        success = false;
+      table[cnt++] = ((uintptr_t) p->upage
+                      | (p->writable ? IMAGE_WRITABLE : 0)
+                      | (zero ? IMAGE_ZERO : 0));
+    }
+
+  /* Pages outside the table, such as the stack, are writable. */
+  for (upage = pagedir_next_page (t->pagedir, NULL);
+       success && upage != NULL;
+       upage = pagedir_next_page (t->pagedir, (uint8_t *) upage + PGSIZE))
+    if (page_lookup (t, upage) == NULL)
+      table[cnt++] = (uintptr_t) upage | IMAGE_WRITABLE;
+  lock_release (&t->pages_lock);
+
+  /* The contents, which also tell which pages hold only zeros. */
+  data_ofs = ofs + ROUND_UP (cnt * sizeof *table, PGSIZE);
+  for (j = 0; success && j < cnt; j++)
+    {
+      const uint8_t *page = (const uint8_t *) pg_round_down ((void *) table[j]);
+      size_t k;
+
+      if (table[j] & IMAGE_ZERO)
+        continue;
+      if (!page_pin (page, PGSIZE, false))
+        {
+          success = false;
+          break;
+        }
+      for (k = 0; k < PGSIZE && page[k] == 0; k++)
+        continue;
+      if (k == PGSIZE)
+        table[j] |= IMAGE_ZERO;
+      else if (file_write_at (file, page, PGSIZE, data_ofs) == PGSIZE)
+        data_ofs += PGSIZE;
+      else
+        success = false;
+      page_unpin (page, PGSIZE);
+    }
+
+  if (success && file_write_at (file, table, cnt * sizeof *table, ofs)
+                 != (off_t) (cnt * sizeof *table))
+    success = false;
+  free (table);
+  *page_cnt = cnt;
+  return success;
+}
+
+/* Records in the current process, whose address space must be
+   empty, the PAGE_CNT pages of the checkpoint image in FILE whose
+   table page_save() wrote at offset OFS.  Each page is read in
+   from FILE the first time it is touched, so FILE must stay open
+   until the process exits.  Returns false if the image is
+   malformed, a read fails, or memory runs out. */
+bool
+page_restore (struct file *file, off_t ofs, size_t page_cnt)
+{
+  uint32_t *table;
+  size_t size = page_cnt * sizeof *table;
+  off_t data_ofs;
+  size_t i, data_cnt = 0;
+  bool success = true;
+
+  if (page_cnt > (uintptr_t) PHYS_BASE / PGSIZE)
+    return false;
+  table = malloc (size);
+  if (table == NULL)
+    return false;
+  if (file_read_at (file, table, size, ofs) != (off_t) size)
+    success = false;
+  for (i = 0; success && i < page_cnt; i++)
+    if (!(table[i] & IMAGE_ZERO))
+      data_cnt++;
+  data_ofs = ofs + ROUND_UP (size, PGSIZE);
+  if (file_length (file) < data_ofs + (off_t) (data_cnt * PGSIZE))
+    success = false;
+
+  for (i = 0; success && i < page_cnt; i++)
+    {
+      void *upage = pg_round_down ((void *) table[i]);
+      bool writable = (table[i] & IMAGE_WRITABLE) != 0;
+
+      if (!is_user_vaddr (upage))
+        success = false;
+      else if (table[i] & IMAGE_ZERO)
+        success = page_record_file (upage, NULL, 0, 0, writable, false);
+      else
+        {
+          success = page_record_file (upage, file, data_ofs, PGSIZE,
+                                      writable, false);
+          data_ofs += PGSIZE;
+        }
+    }
+  free (table);
+  return success;
+}
+
+/* Makes sure that the SIZE bytes of user memory at BUFFER are
+   in memory, and keeps them there until page_unpin() on the same
+   range, so that the kernel can access them while holding locks
+   that a page fault would need.  If WRITE is true, the pages must
+   be writable.  Returns false, with nothing pinned, if some page
+   is not valid for the access. */
+bool
+page_pin (const void *buffer, size_t size, bool write)
+{
+  struct thread *t = thread_current ()->proceso;
+  const uint8_t *end = (const uint8_t *) buffer + size;
+  const uint8_t *upage;
+
+  for (upage = pg_round_down (buffer); upage < end; upage += PGSIZE)
+    for (;;)
+      {
+        struct page *p;
+        struct frame *f;
+        bool pinned = false, cow;
+
+        if (!is_user_vaddr (upage))
+          goto fail;
+
+        /* A write through the kernel must not fault on a page
+           shared by fork(), so the page is copied first. */
+        lock_acquire (&t->pages_lock);
+        cow = write && pagedir_is_cow (t->pagedir, upage);
+        p = page_lookup (t, upage);
+        if (p == NULL)
+          {
+            /* Not demand paged, so never evicted, like the stack. */
+            bool mapped = pagedir_get_page (t->pagedir, upage) != NULL;
+            const void *addr = upage < (const uint8_t *) buffer ? buffer : upage;
+            lock_release (&t->pages_lock);
+            if (!mapped && process_in_stack (addr, thread_current ()->esp_usuario)
+                && process_grow_stack ((void *) upage))
+              continue;
+            if (!mapped || (cow && !page_cow (upage)))
+              goto fail;
+            if (!cow)
+              break;
+            continue;
+          }
+        if (write && !p->writable)
+          {
+            lock_release (&t->pages_lock);
+            goto fail;
+          }
+        if (p->share != NULL || p->shm != NULL || p->huge)
+          {
+            /* Shared and huge pages are never evicted. */
+            lock_release (&t->pages_lock);
+            break;
+          }
+        f = p->frame;
+        if (f != NULL && !cow)
+          {
+            lock_acquire (&f->lock);
+            /* Same-page merging may have made the page
+               copy-on-write while we waited. */
+            if (p->frame == f && write
+                && pagedir_is_cow (t->pagedir, upage))
+              cow = true;
+            else if (p->frame == f)
+              {
+                f->pin_cnt++;
+                pinned = true;
+              }
+            lock_release (&f->lock);
+          }
+        else if (f == NULL && pagedir_get_page (t->pagedir, upage) != NULL)
+          {
+            /* Shared by fork() outside any frame, or the zero
+               page, so it needs a frame of its own to be pinned. */
+            cow = true;
+          }
+        lock_release (&t->pages_lock);
+
+        if (pinned)
+          break;
+        /* Loaded as if for writing, since a pinned page needs a
+           frame of its own rather than the zero page. */
+        if (cow ? !page_cow (upage) : !page_load (upage, true))
+          goto fail;
+      }
+  return true;
+
+ fail:
+  page_unpin (pg_round_down (buffer),
+              upage - (const uint8_t *) pg_round_down (buffer));
+  return false;
+}
+
+/* Releases the pages pinned by page_pin (BUFFER, SIZE). */
+void
+page_unpin (const void *buffer, size_t size)
+{
+  struct thread *t = thread_current ()->proceso;
+  const uint8_t *end = (const uint8_t *) buffer + size;
+  const uint8_t *upage;
+
+  lock_acquire (&t->pages_lock);
+  for (upage = pg_round_down (buffer); upage < end; upage += PGSIZE)
+    {
+      struct page *p = page_lookup (t, upage);
+      if (p != NULL && p->share == NULL && p->shm == NULL && !p->huge)
+        {
+          ASSERT (p->frame != NULL && p->frame->pin_cnt > 0);
+          lock_acquire (&p->frame->lock);
+          p->frame->pin_cnt--;
+          lock_release (&p->frame->lock);
+        }
+    }
+  lock_release (&t->pages_lock);
+}
+
+/* Evicts PAGE, owned by OWNER, from the frame that holds it,
+   whose lock the caller holds.  If the page has been modified
+   since it was brought in, writes it back to its file if it is a
+   WRITEBACK page, or else to swap.  Then unmaps it, so that
+   OWNER faults it back in the next time it is touched, and
+   returns true.  Returns false, leaving the page in place, if it
+   must go to swap but swap is full. */
+bool
+page_evict (struct page *p, struct thread *owner)
+{
+  uint32_t *pd = owner->pagedir;
+  enum intr_level old_level;
+  bool dirty;
+
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  /* A page modified for the first time needs a slot, and its
+     dirty neighbours go to swap with it while we're at it. */
+  if (!p->writeback && p->swap_slot == SWAP_NONE
+      && pagedir_is_dirty (pd, p->upage) && !swap_out_run (p, owner))
+    return false;
+
+  /* Check and unmap atomically, so that OWNER cannot dirty the
+     page after we look. */
+  old_level = intr_disable ();
+  dirty = pagedir_is_dirty (pd, p->upage);
+  pagedir_clear_page (pd, p->upage);
+  intr_set_level (old_level);
+
+  if (dirty && p->writeback)
+    file_write_at (p->file, p->frame->kpage, p->read_bytes, p->ofs);
+  else if (dirty)
+    swap_write (p->swap_slot, &p->frame->kpage, 1);
+  p->frame = NULL;
+  return true;
+}
+
+/* Writes PAGE, owned by OWNER, back to its file if it is a
+   WRITEBACK page, or else to swap, if it has been modified since
+   it was brought in, and leaves it mapped, so that evicting it
+   later needs no write unless it is modified again.  The caller
+   holds the lock on the page's frame.  Returns false if the page
+   needs a swap slot but swap is full. */
+bool
+page_clean (struct page *p, struct thread *owner)
+{
+  uint32_t *pd = owner->pagedir;
+
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  if (!pagedir_is_dirty (pd, p->upage))
+    return true;
+  if (!p->writeback && p->swap_slot == SWAP_NONE)
+    return swap_out_run (p, owner);
+
+  /* Clear the dirty bit before copying, so that a write that
+     races with the copy leaves the page dirty again. */
+  pagedir_set_dirty (pd, p->upage, false);
+  if (p->writeback)
+    file_write_at (p->file, p->frame->kpage, p->read_bytes, p->ofs);
+  else
+    swap_write (p->swap_slot, &p->frame->kpage, 1);
+  return true;
+}
+
+/* Returns true if page P of OWNER, whose frame the caller holds
+   locked, is private memory that same-page merging may share with
+   a page of the same contents: a writable page of its own, not
+   written back to a file, not pinned, and mapped from its frame. */
+bool
+page_mergeable (const struct page *p, struct thread *owner)
+{
+  struct frame *f = p->frame;
+
+  ASSERT (f != NULL);
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  return (p->writable && !p->writeback && p->shm == NULL && !p->huge
+          && f->pin_cnt == 0
+          && pagedir_get_page (owner->pagedir, p->upage) == f->kpage);
+}
+
+/* Merges page P of OWNER into page INTO of INTO_OWNER if their
+   contents are the same, so that P maps INTO's memory
+   copy-on-write, as fork() would have left it, and P's frame is
+   freed.  Both pages must be page_mergeable(), with their frames
+   locked by the caller, and P's memory mapped nowhere else.
+   Returns true if the pages were merged, in which case P's frame
+   lock has been released. */
+bool
+page_merge (struct page *p, struct thread *owner,
+            struct page *into, struct thread *into_owner)
+{
+  struct frame *f = p->frame;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (lock_held_by_current_thread (&into->frame->lock));
+
+  if (pagedir_is_shared (f->kpage))
+    return false;
+
+  /* Both become copy-on-write before they are compared, so that
+     neither can change until we are done.  A write meanwhile
+     faults and waits in page_cow() for the frame locks we hold,
+     and then finds the page writable again if we did not merge. */
+  if (pagedir_protect_page (owner->pagedir, p->upage) != f->kpage
+      || (pagedir_protect_page (into_owner->pagedir, into->upage)
+          != into->frame->kpage)
+      || memcmp (f->kpage, into->frame->kpage, PGSIZE)
+      || !pagedir_merge_page (owner->pagedir, p->upage,
+                              into_owner->pagedir, into->upage))
+    return false;
+
+  p->frame = NULL;
+  frame_free (f);
+  return true;
+}
+
+/* Fills frame F, locked, with page P of T from swap, maps it, and
+   reads ahead the pages that follow P in T's address space if
+   they were written to the slots that follow P's, as happens
+   when they were swapped out together.  Pages read ahead are
+   mapped with their accessed bits clear, so the clock takes them
+   again first if they are not used.  Read-ahead only uses free
+   frames.  Returns true if P itself was mapped. */
+static bool
+fill_from_swap (struct thread *t, struct page *p, struct frame *f)
+{
+  struct page *run[SWAP_CLUSTER];
+  struct frame *frames[SWAP_CLUSTER];
+  void *kpages[SWAP_CLUSTER];
+  size_t cnt, i;
+  bool success = true;
+
+  run[0] = p;
+  frames[0] = f;
+  kpages[0] = f->kpage;
+  for (cnt = 1; cnt < SWAP_CLUSTER; cnt++)
+    {
+      struct page *q = page_lookup (t, (uint8_t *) p->upage + cnt * PGSIZE);
+      if (q == NULL || q->frame != NULL || q->swap_slot != p->swap_slot + cnt)
+        break;
+      frames[cnt] = frame_alloc (t, q, false);
+      if (frames[cnt] == NULL)
+        break;
+      run[cnt] = q;
+      kpages[cnt] = frames[cnt]->kpage;
+    }
+
+  swap_read (p->swap_slot, kpages, cnt);
+  for (i = 0; i < cnt; i++)
+    if (pagedir_set_page (t->pagedir, run[i]->upage, kpages[i],
+                          run[i]->writable))
+      {
+        run[i]->frame = frames[i];
+        frame_unlock (frames[i]);
+      }
+    else
+      {
+        frame_free (frames[i]);
+        if (i == 0)
+          success = false;
+      }
+  return success;
+}
+
+/* Writes out page P, owned by OWNER, which has no slot yet,
+   along with the dirty, slotless pages that follow it in OWNER's
+   address space, into a run of adjacent new slots.  P's frame is
+   locked by the caller.  The neighbours stay mapped, with their
+   dirty bits cleared, so they can later be evicted without
+   another write unless they are modified again.  Returns false
+   if swap is full. */
+static bool
+swap_out_run (struct page *p, struct thread *owner)
+{
+  struct page *run[SWAP_CLUSTER];
+  void *kpages[SWAP_CLUSTER];
+  bool locked = false;
+  size_t cnt = 1, got, slot, i;
+
+  /* Neighbours may only be looked up under OWNER's table lock.
+     Don't wait for it, because its holder may be waiting for
+     P's frame. */
+  run[0] = p;
+  if (lock_held_by_current_thread (&owner->pages_lock)
+      || (locked = lock_try_acquire (&owner->pages_lock)))
+    for (; cnt < SWAP_CLUSTER; cnt++)
+      {
+        struct page *q = page_lookup (owner,
+                                      (uint8_t *) p->upage + cnt * PGSIZE);
+        if (q == NULL || q->frame == NULL || q->writeback
+            || q->swap_slot != SWAP_NONE
+            || !lock_try_acquire (&q->frame->lock))
+          break;
+        if (!pagedir_is_dirty (owner->pagedir, q->upage))
+          {
+            lock_release (&q->frame->lock);
+            break;
+          }
+        run[cnt] = q;
+      }
+
+  got = cnt;
+  slot = swap_alloc (&got);
+  for (i = slot != SWAP_NONE ? got : 1; i < cnt; i++)
+    lock_release (&run[i]->frame->lock);
+  if (slot == SWAP_NONE)
+    {
+      if (locked)
+        lock_release (&owner->pages_lock);
+      return false;
+    }
+
+  /* Clear the dirty bits before copying, so that a write that
+     races with the copy leaves the page dirty again. */
+  for (i = 0; i < got; i++)
+    {
+      run[i]->swap_slot = slot + i;
+      pagedir_set_dirty (owner->pagedir, run[i]->upage, false);
+      kpages[i] = run[i]->frame->kpage;
+    }
+  if (locked)
+    lock_release (&owner->pages_lock);
+
+  /* The neighbours' frame locks keep them in place meanwhile. */
+  swap_write (slot, kpages, got);
+  for (i = 1; i < got; i++)
+    lock_release (&run[i]->frame->lock);
+  return true;
+}
+
+/* Brings in page P of T, whose PAGES_LOCK the caller holds, for
+   writing if WRITE is true, and counts a minor or major fault
+   for T.  Returns true if the page is mapped on return. */
+static bool
+load_page (struct thread *t, struct page *p, bool write)
+{
+  struct frame *f;
+  bool in = (p->frame != NULL
+             || pagedir_get_page (t->pagedir, p->upage) != NULL);
+  bool read = false;
+  bool success;
+
+  /* Pages that were in a huge page have frames of their own once
+     it is split, so a page that is in, even one that could map a
+     shared copy or the zero page, is handled as any other. */
+  if (p->share != NULL || p->zero || p->shm != NULL || p->huge)
+    success = true;
+  else if (!in && !p->writable && !p->writeback && p->file != NULL
+           && p->swap_slot == SWAP_NONE)
+    success = map_shared (t, p, &read);
+  else if (!in && !write && p->file == NULL && !p->writeback
+           && p->swap_slot == SWAP_NONE)
+    success = map_zero (t, p);
+  else
+    {
+      /* Another thread of the process may have brought the page
+         in while we waited for the lock.  Or the page may be being
+         evicted, in which case we wait for that to finish.  Only
+         eviction, under the frame's lock, takes a page out of its
+         frame, and only we, under PAGES_LOCK, put it in one. */
+      f = p->frame;
+      if (f != NULL)
+        {
+          lock_acquire (&f->lock);
+          success = p->frame == f;
+          lock_release (&f->lock);
+        }
+      else
+        {
+          /* Shared copy-on-write by fork(), outside any frame. */
+          success = pagedir_get_page (t->pagedir, p->upage) != NULL;
+        }
+
+      if (!success)
+        {
+          f = frame_alloc (t, p, true);
+          if (f == NULL)
+            return false;
+          read = p->swap_slot != SWAP_NONE || p->read_bytes > 0;
+          success = (p->swap_slot != SWAP_NONE
+                     ? fill_from_swap (t, p, f) : fill_page (t, p, f));
+        }
+    }
+
+  if (success && read)
+    t->fallas_mayores++;
+  else if (success)
+    t->fallas_menores++;
+  return success;
+}
+
+/* Fills frame F, locked, with page P of T from its file or with
+   zeros, maps it, and unlocks F.  Returns true if successful.
+   On failure, frees F. */
+static bool
+fill_page (struct thread *t, struct page *p, struct frame *f)
+{
+  if (p->file != NULL
+      && file_read_at (p->file, f->kpage, p->read_bytes, p->ofs)
+         != (off_t) p->read_bytes)
+    {
+      frame_free (f);
+      return false;
+    }
+  memset ((uint8_t *) f->kpage + p->read_bytes, 0, PGSIZE - p->read_bytes);
+  if (!pagedir_set_page (t->pagedir, p->upage, f->kpage, p->writable))
+    {
+      frame_free (f);
+      return false;
+    }
+  p->frame = f;
+  frame_unlock (f);
+  return true;
+}
+
+/* Maps up to WINDOW pages of T that follow page P in T's address
+   space and would each take a fault of their own, stopping at the
+   first one that is already in, is in swap, or for which no free
+   frame is left.  Pages mapped this way have their accessed bits
+   clear, so the clock takes them again first if they are not
+   used.  Returns the number of pages mapped. */
+static size_t
+fault_around (struct thread *t, struct page *p, size_t window)
+{
+  size_t cnt;
+
+  for (cnt = 0; cnt < window; cnt++)
+    {
+      uint8_t *upage = (uint8_t *) p->upage + (cnt + 1) * PGSIZE;
+      struct page *q = page_lookup (t, upage);
+      struct frame *f;
+
+      if (q == NULL || q->frame != NULL || q->share != NULL
+          || q->swap_slot != SWAP_NONE
+          || pagedir_get_page (t->pagedir, upage) != NULL)
+        break;
+      if (!q->writable && !q->writeback && q->file != NULL)
+        {
+          if (!map_shared (t, q, NULL))
+            break;
+        }
+      else if (q->file == NULL && !q->writeback)
+        {
+          if (!map_zero (t, q))
+            break;
+        }
+      else
+        {
+          f = frame_alloc (t, q, false);
+          if (f == NULL || !fill_page (t, q, f))
+            break;
+        }
+      pagedir_set_accessed (t->pagedir, upage, false);
+    }
+  stats.around += cnt;
+  return cnt;
+}
+
+/* Copies page P of PARENT into the current process for
+   page_fork(), with both processes' PAGES_LOCKs held. */
+static bool
+fork_page (struct thread *parent, struct page *p)
+{
+  struct thread *t = thread_current ();
+  struct page *c;
+  bool mapped = false;
+
+  if (p->writeback)
+    return true;
+  if (p->shm != NULL)
+    return fork_shm (p);
+
+  /* A page in memory may hold the only copy of its contents, so
+     it is shared.  Its slot, if it has one, stays with PARENT,
+     so a page in swap is brought in to be shared. */
+  for (;;)
+    {
+      struct frame *f = p->frame;
+
+      if (f != NULL)
+        {
+          lock_acquire (&f->lock);
+          if (p->frame == f)
+            mapped = true;
+          if (mapped && !pagedir_share_page (t->pagedir, parent->pagedir,
+                                             p->upage))
+            {
+              lock_release (&f->lock);
+              return false;
+            }
+          lock_release (&f->lock);
+          if (mapped)
+            break;
+        }
+      else if (p->share == NULL && !p->zero
+               && pagedir_get_page (parent->pagedir, p->upage) != NULL)
+        {
+          /* Shared by an earlier fork(), outside any frame. */
+          if (!pagedir_share_page (t->pagedir, parent->pagedir, p->upage))
+            return false;
+          mapped = true;
+          break;
+        }
+      else if (p->swap_slot == SWAP_NONE)
+        break;
+      else if (!load_page (parent, p, false))
+        return false;
+    }
+
+  c = kmem_cache_alloc (page_cache);
+  if (c == NULL)
+    return false;
+  *c = *p;
+  c->file = p->file != NULL ? t->ejecutable : NULL;
+  c->frame = NULL;
+  c->swap_slot = SWAP_NONE;
+  c->share = NULL;
+  c->zero = false;
+  hash_insert (&t->pages, &c->elem);
+
+  /* The contents may differ from the file, so eviction must not
+     drop them once the page has a frame of its own. */
+  if (mapped)
+    pagedir_set_dirty (t->pagedir, c->upage, true);
+  return true;
+}
+
+/* Maps page P of a shared memory segment, from PARENT, into the
+   current process for fork_page(). */
+static bool
+fork_shm (struct page *p)
+{
+  struct thread *t = thread_current ();
+  struct page *c = kmem_cache_alloc (page_cache);
+
+  if (c == NULL)
+    return false;
+  if (!pagedir_set_page (t->pagedir, p->upage,
+                         shm_kpage (p->shm, p->ofs / PGSIZE), true))
+    {
+      kmem_cache_free (page_cache, c);
+      return false;
+    }
+  *c = *p;
+  shm_ref (c->shm);
+  hash_insert (&t->pages, &c->elem);
+  return true;
+}
+
+/* Maps page P of T, which T's PAGES_LOCK protects, read-only
+   from the shared copy of its file page, reading the copy in if
+   no other process has it, in which case *READ is set to true,
+   or else to false, if READ is nonnull.  Returns true if
+   successful. */
+static bool
+map_shared (struct thread *t, struct page *p, bool *read)
+{
+  struct share *s = share_get (p->file, p->ofs, p->read_bytes, read);
+
+  if (s == NULL)
+    return false;
+  if (!pagedir_set_page (t->pagedir, p->upage, s->kpage, false))
+    {
+      share_put (s);
+      return false;
+    }
+  p->share = s;
+  return true;
+}
+
+/* Unmaps page P of T from its shared copy or shared memory
+   segment, dropping T's reference to it, or from the zero page.
+   None must be freed with T's page directory. */
+static void
+unmap_shared (struct thread *t, struct page *p)
+{
+  pagedir_clear_page (t->pagedir, p->upage);
+  if (p->share != NULL)
+    share_put (p->share);
+  if (p->shm != NULL)
+    shm_put (p->shm);
+  p->share = NULL;
+  p->zero = false;
+  p->shm = NULL;
+}
+
+/* Maps page P of T, which T's PAGES_LOCK protects, read-only to
+   the zero page.  Returns true if successful. */
+static bool
+map_zero (struct thread *t, struct page *p)
+{
+  if (!pagedir_set_page (t->pagedir, p->upage, zero_page, false))
+    return false;
+  p->zero = true;
+  stats.zero++;
+  return true;
+}
+
+/* Replaces the zero page mapped for page P of T, which T's
+   PAGES_LOCK protects, by a zeroed frame of P's own.  Returns
+   true if successful. */
+static bool
+break_zero (struct thread *t, struct page *p)
+{
+  struct frame *f = frame_alloc (t, p, true);
+
+  if (f == NULL)
+    return false;
+  memzero_page (f->kpage);
+  pagedir_clear_page (t->pagedir, p->upage);
+  p->zero = false;
+  if (!pagedir_set_page (t->pagedir, p->upage, f->kpage, p->writable))
+    {
+      frame_free (f);
+      return false;
+    }
+  pagedir_set_dirty (t->pagedir, p->upage, true);
+  p->frame = f;
+  frame_unlock (f);
+  return true;
+}
+
+/* Returns true if page Q of a process, which may be null, can be
+   part of a huge page that is writable if WRITABLE is true: it
+   is recorded, has never been brought in or written to swap, and
+   is anonymous if WRITABLE, or else read-only and not written
+   back to a file. */
+static bool
+huge_candidate (const struct page *q, bool writable)
+{
+  return (q != NULL && q->writable == writable
+          && (!writable || q->file == NULL)
+          && !q->writeback && q->frame == NULL && q->swap_slot == SWAP_NONE
+          && q->share == NULL && !q->zero && q->shm == NULL && !q->huge);
+}
+
+/* Tries to map the whole aligned 4 MB region of T's address space
+   that holds page P, on a fault on P for writing if WRITE is
+   true, with a single huge page, which takes one TLB entry
+   instead of 1024.  T's PAGES_LOCK protects P.  The region
+   qualifies if every page in it is a huge_candidate() like P and
+   none is mapped: an anonymous region such as a large array or
+   heap, on its first write, or a read-only one such as the text
+   of a large program.  Its memory is a physically aligned run of
+   the user pool, zeroed or read in from the file as a whole.
+   Returns true if the region is mapped, or false if the fault is
+   to be handled page by page, which is also what happens when the
+   user pool has no such run free.
+
+   Huge pages stay outside the frame table, so the clock never
+   evicts them, and are freed with the page directory.  They are
+   split back into pages of their own when a page is removed or
+   the process forks. */
+static bool
+map_huge (struct thread *t, struct page *p, bool write)
+{
+  uint8_t *base = (uint8_t *) ((uintptr_t) p->upage & ~(PTSPAN - 1));
+  uint8_t *kpage, *next;
+  bool read = false;
+  size_t i;
+
+  if (!huge_ok || (p->writable && !write)
+      || !huge_candidate (p, p->writable))
+    return false;
+  next = pagedir_next_page (t->pagedir, base);
+  if (next != NULL && next < base + PTSPAN)
+    return false;
+  for (i = 0; i < HUGE_PAGES; i++)
+    if (!huge_candidate (page_lookup (t, base + i * PGSIZE), p->writable))
+      return false;
+
+  kpage = palloc_get_aligned (PAL_USER | (p->writable ? PAL_ZERO : 0),
+                              HUGE_PAGES, HUGE_PAGES);
+  if (kpage == NULL)
+    return false;
+  if (!p->writable)
+    for (i = 0; i < HUGE_PAGES; i++)
+      {
+        struct page *q = page_lookup (t, base + i * PGSIZE);
+        uint8_t *dst = kpage + i * PGSIZE;
+
+        if (q->file != NULL)
+          {
+            if (file_read_at (q->file, dst, q->read_bytes, q->ofs)
+                != (off_t) q->read_bytes)
+              {
+                palloc_free_multiple (kpage, HUGE_PAGES);
+                return false;
+              }
+            read = true;
+          }
+        memset (dst + q->read_bytes, 0, PGSIZE - q->read_bytes);
+      }
+  if (!pagedir_set_large (t->pagedir, base, kpage, p->writable))
+    {
+      palloc_free_multiple (kpage, HUGE_PAGES);
+      return false;
+    }
+
+  for (i = 0; i < HUGE_PAGES; i++)
+    page_lookup (t, base + i * PGSIZE)->huge = true;
+  stats.huge++;
+  t->paginas_grandes++;
+  if (read)
+    t->fallas_mayores++;
+  else
+    t->fallas_menores++;
+  return true;
+}
+
+/* Splits the huge page that holds page P of T, which T's
+   PAGES_LOCK protects, into pages mapped one by one, each put in
+   the frame of its memory as if it had been brought in on its
+   own, so that from then on they are shared, evicted and removed
+   like any other page.  Returns false, leaving the huge page in
+   place, if memory runs out. */
+static bool
+split_huge (struct thread *t, struct page *p)
+{
+  uint8_t *base = (uint8_t *) ((uintptr_t) p->upage & ~(PTSPAN - 1));
+  uint8_t *kpage = pagedir_get_page (t->pagedir, base);
+  size_t i;
+
+  ASSERT (p->huge);
+
+  if (!pagedir_split_large (t->pagedir, base))
+    return false;
+
+  /* A page removed while the huge page could not be split stays
+     mapped outside the table. */
+  for (i = 0; i < HUGE_PAGES; i++)
+    {
+      struct page *q = page_lookup (t, base + i * PGSIZE);
+      if (q != NULL)
+        {
+          q->huge = false;
+          q->frame = frame_adopt (kpage + i * PGSIZE, t, q);
+        }
+    }
+  stats.split++;
+  return true;
+}
+
+/* Returns the page at UPAGE in T's table, or a null pointer. */
+static struct page *
+page_lookup (struct thread *t, const void *upage)
+{
+  struct page key;
+  struct hash_elem *e;
+
+  key.upage = (void *) upage;
+  e = hash_find (&t->pages, &key.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Returns a hash value for page E. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, elem);
+  const struct page *b = hash_entry (b_, struct page, elem);
+  return a->upage < b->upage;
+}
+
+/* Takes page E, of the current process, out of its frame or its
+   shared copy, if any, frees its swap slot, and frees it. */
+static void
+page_destroy (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, elem);
+
+  if (p->share != NULL || p->zero || p->shm != NULL)
+    unmap_shared (thread_current ()->proceso, p);
+  if (p->frame != NULL)
+    frame_release (p->frame, p);
+  swap_free (p->swap_slot);
+  kmem_cache_free (page_cache, p);
+}
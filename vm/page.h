@@ -0,0 +1,123 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct frame;
+struct share;
+struct shm;
+struct thread;
+
+/* Supplemental page table.
+
+   Each process keeps, in its main thread, a hash table of the
+   user pages it may touch but that need not be in memory yet,
+   keyed by user virtual address.  load() records the pages of
+   each executable segment here instead of reading them, and the
+   page fault handler calls page_load() to bring a page in the
+   first time it is touched.  Threads created with thread_spawn
+   share the table of their process.
+
+   A page that is in memory sits in a frame of the frame table
+   (see vm/frame.h), from which it may be evicted to make room
+   for another page.  A page that has never been modified is
+   brought back from its file or as zeros.  Once modified, it is
+   written to a swap slot (see vm/swap.h) when evicted, and read
+   back from there.  The page keeps its slot until the process
+   exits, so evicting it again costs no write unless it has been
+   modified since.  Pages of memory-mapped files (see vm/mmap.h)
+   are instead written back to their file, and never to swap.
+
+   Read-only pages of a file that are never written back, such as
+   the text of an executable, are not put in frames of their own.
+   They are mapped from a copy shared by every process that maps
+   the same page of the same file (see vm/share.h).
+
+   Likewise, a zero-filled page that is read before it is written
+   is mapped read-only to a single page of zeros shared by every
+   process, and only gets a frame of its own on the first write.
+
+   The pages of a shared memory segment (see vm/shm.h) are mapped
+   as soon as they are recorded, writable, from the segment's own
+   frames, and fork() maps them in the child too instead of
+   copying them.
+
+   fork() shares the pages that are in memory between parent and
+   child copy-on-write.  Each such page stays in the frame of the
+   process that brought it in, and the clock leaves the frame
+   alone while the page is shared.  The first write by either
+   process gives the writer a frame of its own, and the copy left
+   behind becomes the frame of the other process when it writes
+   to the page in turn.
+
+   Same-page merging (see vm/ksm.h) shares private pages that
+   merely have the same contents in the same way: the merged page
+   gives up its frame and maps the memory of the other one
+   copy-on-write, as if it had been forked from it.
+
+   When faults hit consecutive pages, as in a sequential scan of a
+   file or an array, page_load() also maps some of the pages that
+   follow the faulting one, from free frames only, doubling their
+   number with each fault that continues the scan up to a limit,
+   so that a long scan takes far fewer faults.
+
+   A fault in an aligned 4 MB region whose pages are all recorded
+   and untouched, and either all anonymous, on a write, or all
+   read-only, maps the whole region at once with a single 4 MB
+   huge page, if the user pool has a physically aligned run free,
+   so that large arrays and programs take far fewer TLB misses.
+   Huge pages are never evicted; removing one of their pages or
+   forking splits them back into pages with frames of their
+   own.
+
+   page_save() writes the whole address space to a checkpoint
+   image, and page_restore() records it again in a new process,
+   whose pages are then read in from the image on demand, like an
+   executable's. */
+
+/* A user page that can be brought in on demand. */
+struct page
+  {
+    struct hash_elem elem;      /* Element in the process's table. */
+    void *upage;                /* User virtual address. */
+    struct file *file;          /* File to read from, or null. */
+    off_t ofs;                  /* Offset in FILE or SHM. */
+    uint32_t read_bytes;        /* Bytes to read; the rest are zeroed. */
+    bool writable;              /* Map read/write or read-only? */
+    struct frame *frame;        /* Frame holding the page, or null. */
+    size_t swap_slot;           /* Swap slot, or SWAP_NONE. */
+    bool writeback;             /* Write back to FILE, not to swap? */
+    struct share *share;        /* Shared copy mapped, or null. */
+    bool zero;                  /* Zero page mapped? */
+    struct shm *shm;            /* Shared memory segment mapped, or null. */
+    bool huge;                  /* Mapped as part of a huge page? */
+  };
+
+void page_init (void);
+void page_print_stats (void);
+bool page_table_init (struct thread *);
+void page_table_destroy (struct thread *);
+bool page_record_file (void *upage, struct file *, off_t ofs,
+                       uint32_t read_bytes, bool writable, bool writeback);
+void page_remove (void *upage);
+bool page_record_shm (void *upage, struct shm *, size_t page);
+bool page_remove_shm (void *upage);
+bool page_load (const void *addr, bool write);
+bool page_cow (const void *addr);
+bool page_fork (struct thread *parent);
+bool page_save (struct file *, off_t ofs, size_t *page_cnt);
+bool page_restore (struct file *, off_t ofs, size_t page_cnt);
+bool page_pin (const void *buffer, size_t size, bool write);
+void page_unpin (const void *buffer, size_t size);
+bool page_evict (struct page *, struct thread *owner);
+bool page_clean (struct page *, struct thread *owner);
+bool page_mergeable (const struct page *, struct thread *owner);
+bool page_merge (struct page *, struct thread *owner,
+                 struct page *into, struct thread *into_owner);
+
+#endif /* vm/page.h */
@@ -0,0 +1,311 @@
+#include "vm/share.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+
+/* Shared pages, keyed by inode and offset. */
+static struct hash shares;
+
+/* Shared pages that no process maps, least recently used
+   first. */
+static struct list idle;
+
+/* Protects SHARES, IDLE, every share's REF_CNT, and the
+   statistics. */
+static struct lock share_lock;
+
+/* Statistics. */
+static unsigned long long share_hits;   /* Found already in. */
+static unsigned long long share_misses; /* Read in. */
+static unsigned long long share_reads;  /* File reads served. */
+static unsigned long long share_freed;  /* Idle pages freed. */
+static unsigned long long share_broken; /* Mapped pages detached. */
+
+static void detach (struct share *);
+
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+
+/* Initializes the table of shared pages. */
+void
+share_init (void)
+{
+  lock_init (&share_lock);
+  list_init (&idle);
+  if (!hash_init (&shares, share_hash, share_less, NULL))
+    PANIC ("Not enough memory for the shared page table.");
+}
+
+/* Returns a reference to the shared copy of the page of FILE
+   that starts at offset OFS, whose first READ_BYTES bytes come
+   from FILE and the rest are zeros, reading it in if no other
+   process has it, in which case *READ is set to true, or else to
+   false, if READ is nonnull.  Returns a null pointer if memory
+   runs out or the read fails.  Release the reference with
+   share_put(). */
+struct share *
+share_get (struct file *file, off_t ofs, uint32_t read_bytes, bool *read)
+{
+  struct share key, *s;
+  struct hash_elem *e;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  key.inode = file_get_inode (file);
+  key.ofs = ofs;
+
+  lock_acquire (&share_lock);
+  e = hash_find (&shares, &key.elem);
+  if (e != NULL)
+    {
+      s = hash_entry (e, struct share, elem);
+      if (s->ref_cnt++ == 0)
+        list_remove (&s->idle_elem);
+      share_hits++;
+      lock_release (&share_lock);
+      if (read != NULL)
+        *read = false;
+
+      /* Wait for the process reading it in. */
+      lock_acquire (&s->lock);
+      lock_release (&s->lock);
+      if (s->kpage == NULL)
+        {
+          share_put (s);
+          return NULL;
+        }
+      return s;
+    }
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    {
+      lock_release (&share_lock);
+      return NULL;
+    }
+  s->inode = key.inode;
+  s->ofs = ofs;
+  s->kpage = NULL;
+  s->read_bytes = read_bytes;
+  s->ref_cnt = 1;
+  s->detached = false;
+  lock_init (&s->lock);
+  lock_acquire (&s->lock);
+  hash_insert (&shares, &s->elem);
+  share_misses++;
+  lock_release (&share_lock);
+  if (read != NULL)
+    *read = true;
+
+  s->kpage = frame_alloc_page ();
+  if (s->kpage != NULL)
+    {
+      if (file_read_pages (file, &s->kpage, read_bytes, ofs)
+          == (off_t) read_bytes)
+        memset ((uint8_t *) s->kpage + read_bytes, 0, PGSIZE - read_bytes);
+      else
+        {
+          palloc_free_page (s->kpage);
+          s->kpage = NULL;
+        }
+    }
+  lock_release (&s->lock);
+
+  if (s->kpage == NULL)
+    {
+      share_put (s);
+      return NULL;
+    }
+  return s;
+}
+
+/* Releases a reference to S, obtained from share_get(), which
+   must no longer be mapped by the caller.  With the last
+   reference, S becomes idle, or is freed if it was never read
+   in or a write has detached it. */
+void
+share_put (struct share *s)
+{
+  bool last;
+
+  lock_acquire (&share_lock);
+  last = --s->ref_cnt == 0;
+  if (last && s->kpage != NULL && !s->detached)
+    {
+      list_push_back (&idle, &s->idle_elem);
+      last = false;
+    }
+  else if (last && !s->detached)
+    hash_delete (&shares, &s->elem);
+  lock_release (&share_lock);
+
+  if (last)
+    {
+      if (s->kpage != NULL)
+        palloc_free_page (s->kpage);
+      free (s);
+    }
+}
+
+/* Copies to BUFFER up to SIZE bytes of INODE starting at offset
+   OFS, stopping at the end of the page, from the shared copy of
+   that page, if there is one, and returns the number of bytes
+   copied.  Returns 0 if there is no copy, it does not hold the
+   byte at OFS, or it is still being read in. */
+off_t
+share_read (struct inode *inode, void *buffer, off_t ofs, off_t size)
+{
+  struct share key, *s;
+  struct hash_elem *e;
+  off_t page_ofs = ofs % PGSIZE;
+  off_t copied = 0;
+
+  key.inode = inode;
+  key.ofs = ofs - page_ofs;
+
+  lock_acquire (&share_lock);
+  e = hash_find (&shares, &key.elem);
+  if (e != NULL)
+    {
+      s = hash_entry (e, struct share, elem);
+      if ((uint32_t) page_ofs < s->read_bytes && lock_try_acquire (&s->lock))
+        {
+          if (s->kpage != NULL)
+            {
+              copied = s->read_bytes - page_ofs;
+              if (copied > size)
+                copied = size;
+              memcpy (buffer, (uint8_t *) s->kpage + page_ofs, copied);
+              share_reads++;
+              if (s->ref_cnt == 0)
+                {
+                  list_remove (&s->idle_elem);
+                  list_push_back (&idle, &s->idle_elem);
+                }
+            }
+          lock_release (&s->lock);
+        }
+    }
+  lock_release (&share_lock);
+  return copied;
+}
+
+/* Detaches the shared copies of the pages of INODE that overlap
+   the SIZE bytes starting at OFS, which are about to change.
+   Idle copies are freed, and mapped ones are left to the
+   processes mapping them. */
+void
+share_invalidate (struct inode *inode, off_t ofs, off_t size)
+{
+  struct share key;
+  off_t end = ofs + size;
+
+  if (size <= 0)
+    return;
+
+  key.inode = inode;
+  lock_acquire (&share_lock);
+  if (!hash_empty (&shares))
+    for (key.ofs = ofs - ofs % PGSIZE; key.ofs < end; key.ofs += PGSIZE)
+      {
+        struct hash_elem *e = hash_find (&shares, &key.elem);
+        if (e != NULL)
+          detach (hash_entry (e, struct share, elem));
+      }
+  lock_release (&share_lock);
+}
+
+/* Frees the idle shared pages of INODE, which is about to be
+   freed.  An inode is kept open while its pages are mapped, so
+   none of them can be. */
+void
+share_drop (struct inode *inode)
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&share_lock);
+  for (e = list_begin (&idle); e != list_end (&idle); e = next)
+    {
+      struct share *s = list_entry (e, struct share, idle_elem);
+
+      next = list_next (e);
+      if (s->inode == inode)
+        detach (s);
+    }
+  lock_release (&share_lock);
+}
+
+/* Frees up to PAGE_CNT idle shared pages, least recently used
+   first, for a user pool that has run out, and returns the
+   number freed.  May be called with any lock held. */
+size_t
+share_shrink (size_t page_cnt)
+{
+  size_t freed = 0;
+
+  if (lock_held_by_current_thread (&share_lock)
+      || !lock_try_acquire (&share_lock))
+    return 0;
+  for (; freed < page_cnt && !list_empty (&idle); freed++)
+    detach (list_entry (list_front (&idle), struct share, idle_elem));
+  lock_release (&share_lock);
+  return freed;
+}
+
+/* Takes shared page S out of the table.  Frees it now if it is
+   idle, or else with its last reference.  The caller must hold
+   SHARE_LOCK. */
+static void
+detach (struct share *s)
+{
+  hash_delete (&shares, &s->elem);
+  if (s->ref_cnt == 0)
+    {
+      list_remove (&s->idle_elem);
+      palloc_free_page (s->kpage);
+      free (s);
+      share_freed++;
+    }
+  else
+    {
+      s->detached = true;
+      share_broken++;
+    }
+}
+
+/* Prints statistics about shared pages. */
+void
+share_print_stats (void)
+{
+  printf ("Share: %zu pages shared, %zu idle, %llu hits, %llu misses, "
+          "%llu file reads served, %llu idle pages freed, "
+          "%llu detached by writes\n",
+          hash_size (&shares), list_size (&idle), share_hits, share_misses,
+          share_reads, share_freed, share_broken);
+}
+
+/* Returns a hash value for shared page E. */
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct share *s = hash_entry (e, struct share, elem);
+  return hash_bytes (&s->inode, sizeof s->inode) ^ hash_int (s->ofs);
+}
+
+/* Returns true if shared page A precedes shared page B. */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct share *a = hash_entry (a_, struct share, elem);
+  const struct share *b = hash_entry (b_, struct share, elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->ofs < b->ofs;
+}
@@ -0,0 +1,67 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct file;
+struct inode;
+
+/* Shared read-only file pages.
+
+   Processes that run the same executable map the read-only pages
+   of its segments from one copy, kept here under the file's
+   inode and the page's offset in it.  The first process to touch
+   a page reads it in, and later ones only take a reference, with
+   no disk read and no new frame.
+
+   The copies also serve as a page cache for reads: inode_read_at()
+   copies the bytes of a page that has one from here instead of
+   going through the buffer cache, so that an executable's text is
+   in memory once whether it is being run or read.  A copy stays
+   cached once the last process mapping it exits, idle, so that
+   running the program again or reading it needs no disk access
+   either.  Idle copies are freed, least recently used first, when
+   the user pool runs out, and when their inode is freed, since a
+   copy is found by the inode's address.
+
+   A write to a page of the file that has a copy, or a truncation
+   past it, takes the copy out of the table, so later mappings and
+   reads see the new contents, while processes still mapping the
+   old copy keep it privately until they unmap it, as if it had
+   been copied on write.  Pintos still denies writes to a running
+   executable, as the rox tests expect, so this matters only for
+   the copies that have become idle, but it keeps the sharing safe
+   on its own.
+
+   Shared pages are not in the frame table's clock, so they stay
+   in memory while mapped. */
+
+/* A shared page. */
+struct share
+  {
+    struct hash_elem elem;      /* Element in the table of shared pages. */
+    struct inode *inode;        /* File the page comes from. */
+    off_t ofs;                  /* Offset of the page in the file. */
+    void *kpage;                /* Contents, or null if reading failed. */
+    uint32_t read_bytes;        /* Bytes from the file; the rest are zeros. */
+    unsigned ref_cnt;           /* Number of mappings. */
+    struct lock lock;           /* Held while the page is read in. */
+    struct list_elem idle_elem; /* In the idle list if REF_CNT is 0. */
+    bool detached;              /* Taken out of the table by a write? */
+  };
+
+void share_init (void);
+struct share *share_get (struct file *, off_t ofs, uint32_t read_bytes,
+                         bool *read);
+void share_put (struct share *);
+off_t share_read (struct inode *, void *buffer, off_t ofs, off_t size);
+void share_invalidate (struct inode *, off_t ofs, off_t size);
+void share_drop (struct inode *);
+size_t share_shrink (size_t page_cnt);
+void share_print_stats (void);
+
+#endif /* vm/share.h */
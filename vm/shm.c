@@ -0,0 +1,300 @@
+#include "vm/shm.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* A shared memory segment. */
+struct shm
+  {
+    struct hash_elem elem;      /* Element in the table of segments. */
+    char name[SHM_NAME_MAX + 1]; /* Name. */
+    unsigned ref_cnt;           /* Handles and mapped pages. */
+    size_t page_cnt;            /* Number of pages. */
+    void *kpages[];             /* Frames holding the pages. */
+  };
+
+/* Segments, keyed by name. */
+static struct hash segments;
+
+/* Protects SEGMENTS and every segment's REF_CNT. */
+static struct lock shm_lock;
+
+static hash_hash_func shm_hash;
+static hash_less_func shm_less;
+static struct shm *lookup (const char *name);
+static struct shm *create (const char *name, size_t page_cnt);
+static void destroy (struct shm *);
+
+/* Initializes the table of shared memory segments. */
+void
+shm_init (void)
+{
+  lock_init (&shm_lock);
+  if (!hash_init (&segments, shm_hash, shm_less, NULL))
+    PANIC ("Not enough memory for the shared memory table.");
+}
+
+/* Opens the segment named NAME for the current process, creating
+   it with SIZE bytes, rounded up to whole pages of zeros, if no
+   segment has that name, and returns a handle for shm_map().  A
+   process that opens the same segment twice gets the same handle.
+   Returns -1 if NAME is empty or too long, if the segment exists
+   but has fewer than SIZE bytes, or if it does not exist and SIZE
+   is 0 or too big, or on memory allocation failure. */
+int
+shm_open (const char *name, size_t size)
+{
+  struct thread *t = thread_current ()->proceso;
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  struct shm_handle *h;
+  struct list_elem *e;
+  struct shm *s;
+  int id = -1;
+
+  if (name[0] == '\0' || strnlen (name, SHM_NAME_MAX + 1) > SHM_NAME_MAX)
+    return -1;
+
+  lock_acquire (&shm_lock);
+  s = lookup (name);
+  if (s != NULL)
+    s->ref_cnt++;
+  lock_release (&shm_lock);
+  if (s == NULL)
+    {
+      /* The frames are allocated without the lock, since that may
+         wait for an eviction. */
+      if (page_cnt == 0 || page_cnt > SHM_PAGES_MAX)
+        return -1;
+      s = create (name, page_cnt);
+      if (s == NULL)
+        return -1;
+    }
+  if (page_cnt > s->page_cnt)
+    {
+      shm_put (s);
+      return -1;
+    }
+
+  h = malloc_tagged (sizeof *h, MEM_PROCESS);
+  lock_acquire (&t->pages_lock);
+  for (e = list_begin (&t->shms); e != list_end (&t->shms); e = list_next (e))
+    if (list_entry (e, struct shm_handle, elem)->shm == s)
+      {
+        id = list_entry (e, struct shm_handle, elem)->id;
+        break;
+      }
+  if (id == -1 && h != NULL)
+    {
+      h->id = id = t->next_shmid++;
+      h->shm = s;
+      list_push_back (&t->shms, &h->elem);
+      h = NULL;
+      s = NULL;
+    }
+  lock_release (&t->pages_lock);
+
+  /* Already open, or out of memory. */
+  free (h);
+  if (s != NULL)
+    shm_put (s);
+  return id;
+}
+
+/* Maps every page of the segment that handle ID of the current
+   process refers to, writable, starting at user page ADDR, and
+   returns ADDR.  Returns a null pointer if there is no such
+   handle, ADDR is null or not page-aligned, or the pages would
+   overlap pages already in the address space or the kernel. */
+void *
+shm_map (int id, void *addr)
+{
+  struct thread *t = thread_current ()->proceso;
+  struct shm *s = NULL;
+  struct list_elem *e;
+  size_t i;
+
+  lock_acquire (&t->pages_lock);
+  for (e = list_begin (&t->shms); e != list_end (&t->shms); e = list_next (e))
+    if (list_entry (e, struct shm_handle, elem)->id == id)
+      {
+        s = list_entry (e, struct shm_handle, elem)->shm;
+        break;
+      }
+  lock_release (&t->pages_lock);
+
+  if (s == NULL || addr == NULL || pg_ofs (addr) != 0
+      || (uintptr_t) addr + s->page_cnt * PGSIZE > (uintptr_t) PHYS_BASE
+      || (uintptr_t) addr + s->page_cnt * PGSIZE < (uintptr_t) addr)
+    return NULL;
+
+  /* Recording a page fails if another page is already there.
+     The stack is mapped without being recorded. */
+  for (i = 0; i < s->page_cnt; i++)
+    {
+      uint8_t *upage = (uint8_t *) addr + i * PGSIZE;
+
+      if (pagedir_get_page (t->pagedir, upage) != NULL
+          || !page_record_shm (upage, s, i))
+        {
+          while (i-- > 0)
+            page_remove ((uint8_t *) addr + i * PGSIZE);
+          return NULL;
+        }
+    }
+  return addr;
+}
+
+/* Unmaps the segment mapped at ADDR in the current process.
+   Returns false if no mapping starts there. */
+bool
+shm_unmap (void *addr)
+{
+  return page_remove_shm (addr);
+}
+
+/* Closes every handle of the current process, which is
+   exiting.  The pages it still maps go with its supplemental page
+   table. */
+void
+shm_close_all (void)
+{
+  struct thread *t = thread_current ()->proceso;
+
+  while (!list_empty (&t->shms))
+    {
+      struct shm_handle *h = list_entry (list_pop_front (&t->shms),
+                                         struct shm_handle, elem);
+      shm_put (h->shm);
+      free (h);
+    }
+}
+
+/* Returns the frame that holds page PAGE of S. */
+void *
+shm_kpage (struct shm *s, size_t page)
+{
+  ASSERT (page < s->page_cnt);
+  return s->kpages[page];
+}
+
+/* Takes another reference to S, for a page mapped from it. */
+void
+shm_ref (struct shm *s)
+{
+  lock_acquire (&shm_lock);
+  ASSERT (s->ref_cnt > 0);
+  s->ref_cnt++;
+  lock_release (&shm_lock);
+}
+
+/* Releases a reference to S, which the caller no longer maps a
+   page of or holds a handle for.  Frees S with the last
+   reference. */
+void
+shm_put (struct shm *s)
+{
+  bool last;
+
+  lock_acquire (&shm_lock);
+  last = --s->ref_cnt == 0;
+  if (last)
+    hash_delete (&segments, &s->elem);
+  lock_release (&shm_lock);
+
+  if (last)
+    destroy (s);
+}
+
+/* Returns the segment named NAME, or a null pointer.  The caller
+   must hold SHM_LOCK. */
+static struct shm *
+lookup (const char *name)
+{
+  struct shm key;
+  struct hash_elem *e;
+
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&segments, &key.elem);
+  return e != NULL ? hash_entry (e, struct shm, elem) : NULL;
+}
+
+/* Creates a segment named NAME of PAGE_CNT zeroed pages, with one
+   reference, and adds it to the table, or takes a reference to
+   the segment that another process added under NAME meanwhile.
+   Returns a null pointer if memory runs out. */
+static struct shm *
+create (const char *name, size_t page_cnt)
+{
+  struct shm *s, *old;
+  size_t i;
+
+  s = malloc_tagged (sizeof *s + page_cnt * sizeof *s->kpages, MEM_PROCESS);
+  if (s == NULL)
+    return NULL;
+  strlcpy (s->name, name, sizeof s->name);
+  s->ref_cnt = 1;
+  s->page_cnt = 0;
+  for (i = 0; i < page_cnt; i++)
+    {
+      s->kpages[i] = frame_alloc_page ();
+      if (s->kpages[i] == NULL)
+        {
+          destroy (s);
+          return NULL;
+        }
+      memzero_page (s->kpages[i]);
+      s->page_cnt++;
+    }
+
+  lock_acquire (&shm_lock);
+  old = lookup (name);
+  if (old != NULL)
+    old->ref_cnt++;
+  else
+    hash_insert (&segments, &s->elem);
+  lock_release (&shm_lock);
+
+  if (old != NULL)
+    {
+      destroy (s);
+      return old;
+    }
+  return s;
+}
+
+/* Frees segment S, which is not in the table. */
+static void
+destroy (struct shm *s)
+{
+  size_t i;
+
+  for (i = 0; i < s->page_cnt; i++)
+    palloc_free_page (s->kpages[i]);
+  free (s);
+}
+
+/* Returns a hash value for segment E. */
+static unsigned
+shm_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_string (hash_entry (e, struct shm, elem)->name);
+}
+
+/* Returns true if segment A precedes segment B. */
+static bool
+shm_less (const struct hash_elem *a, const struct hash_elem *b,
+          void *aux UNUSED)
+{
+  return strcmp (hash_entry (a, struct shm, elem)->name,
+                 hash_entry (b, struct shm, elem)->name) < 0;
+}
@@ -0,0 +1,51 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Named shared memory.
+
+   shm_open() finds or creates a segment of zeroed pages under a
+   name that any process may use, and shm_map() maps all of them,
+   writable, into the calling process, so that processes that map
+   the same segment see each other's writes at once.  A futex on
+   a word in a segment works across processes, since futexes are
+   keyed by physical address.
+
+   Each page of a segment is a frame taken from the frame table
+   when the segment is created.  Like shared file pages (see
+   vm/share.h), the frames stay out of the clock, so they are
+   never evicted.  The segment counts a reference for every
+   process that has opened it and for every page mapped from it,
+   and it is freed, name and all, with the last one.  Mappings
+   are recorded in the supplemental page table, so they keep
+   other pages from being recorded over them, and fork() shares
+   them with the child.  Handles from shm_open() are not
+   inherited. */
+
+#define SHM_NAME_MAX 14         /* Longest segment name. */
+#define SHM_PAGES_MAX 1024      /* Most pages in a segment. */
+
+struct shm;
+
+/* A process's handle for a segment it has opened. */
+struct shm_handle
+  {
+    struct list_elem elem;      /* Element in the process's list. */
+    int id;                     /* Handle id. */
+    struct shm *shm;            /* Segment. */
+  };
+
+void shm_init (void);
+int shm_open (const char *name, size_t size);
+void *shm_map (int id, void *addr);
+bool shm_unmap (void *addr);
+void shm_close_all (void);
+
+void *shm_kpage (struct shm *, size_t page);
+void shm_ref (struct shm *);
+void shm_put (struct shm *);
+
+#endif /* vm/shm.h */
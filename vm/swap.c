@@ -0,0 +1,206 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+#include "vm/zswap.h"
+
+/* Sectors per slot. */
+#define SLOT_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* The swap device, or a null pointer if there is none. */
+static struct block *swap_device;
+
+/* Slots in use.  Null if there is no swap device. */
+static struct bitmap *used_slots;
+
+/* Protects USED_SLOTS and STATS. */
+static struct lock swap_lock;
+static struct swap_stats stats;
+
+/* Initializes swap space on the BLOCK_SWAP device, if there is
+   one.  Without one, swap_alloc() always fails. */
+void
+swap_init (void)
+{
+  lock_init (&swap_lock);
+  histogram_init (&stats.out_cycles);
+  histogram_init (&stats.in_cycles);
+
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    return;
+  used_slots = bitmap_create (block_size (swap_device) / SLOT_SECTORS);
+  if (used_slots == NULL)
+    PANIC ("Not enough memory for the swap slot map.");
+  zswap_init ();
+}
+
+/* Allocates a run of adjacent slots, up to *CNT long, and
+   returns the first one.  If no run of *CNT slots is free, takes
+   the longest run there is and stores its length in *CNT.
+   Returns SWAP_NONE if swap is full or there is no swap device. */
+size_t
+swap_alloc (size_t *cnt)
+{
+  size_t slot;
+
+  ASSERT (*cnt > 0);
+
+  if (used_slots == NULL)
+    return SWAP_NONE;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_longest (used_slots, 0, false, cnt);
+  if (slot != BITMAP_ERROR)
+    bitmap_set_multiple (used_slots, slot, *cnt, true);
+  lock_release (&swap_lock);
+
+  return slot != BITMAP_ERROR ? slot : SWAP_NONE;
+}
+
+/* Frees SLOT.  Does nothing if SLOT is SWAP_NONE. */
+void
+swap_free (size_t slot)
+{
+  if (slot == SWAP_NONE)
+    return;
+
+  zswap_invalidate (slot);
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (used_slots, slot));
+  bitmap_reset (used_slots, slot);
+  lock_release (&swap_lock);
+}
+
+/* Writes the CNT pages in PAGES to the swap device, in the
+   adjacent slots starting at SLOT, in one sequential pass. */
+static void
+device_write (size_t slot, void *pages[], size_t cnt)
+{
+  uint64_t start = rdtsc ();
+  const void *sectors[SWAP_CLUSTER * SLOT_SECTORS];
+  size_t i;
+
+  for (i = 0; i < cnt * SLOT_SECTORS; i++)
+    sectors[i] = ((uint8_t *) pages[i / SLOT_SECTORS]
+                  + i % SLOT_SECTORS * BLOCK_SECTOR_SIZE);
+  block_write_multi (swap_device, slot * SLOT_SECTORS, sectors,
+                     cnt * SLOT_SECTORS);
+
+  lock_acquire (&swap_lock);
+  stats.outs += cnt;
+  stats.out_runs++;
+  histogram_add (&stats.out_cycles, rdtsc () - start);
+  lock_release (&swap_lock);
+}
+
+/* Writes the CNT pages in PAGES to the adjacent slots starting
+   at SLOT.  Pages that the compressed cache takes stay in memory;
+   each run of the rest goes to disk in one sequential pass. */
+void
+swap_write (size_t slot, void *pages[], size_t cnt)
+{
+  bool cached[SWAP_CLUSTER];
+  size_t i, j;
+
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+  for (i = 0; i < cnt; i++)
+    cached[i] = zswap_store (slot + i, pages[i]);
+  for (i = 0; i < cnt; i = j)
+    {
+      for (j = i + 1; j < cnt && cached[j] == cached[i]; j++)
+        continue;
+      if (!cached[i])
+        device_write (slot + i, pages + i, j - i);
+    }
+}
+
+/* Writes PAGE to SLOT on the swap device, bypassing the
+   compressed cache, which uses it to write back pages it can no
+   longer hold. */
+void
+swap_write_device (size_t slot, void *page)
+{
+  device_write (slot, &page, 1);
+}
+
+/* Reads the CNT pages in PAGES from the swap device, from the
+   adjacent slots starting at SLOT, in one sequential pass. */
+static void
+device_read (size_t slot, void *pages[], size_t cnt)
+{
+  uint64_t start = rdtsc ();
+  void *sectors[SWAP_CLUSTER * SLOT_SECTORS];
+  size_t i;
+
+  for (i = 0; i < cnt * SLOT_SECTORS; i++)
+    sectors[i] = ((uint8_t *) pages[i / SLOT_SECTORS]
+                  + i % SLOT_SECTORS * BLOCK_SECTOR_SIZE);
+  block_read_multi (swap_device, slot * SLOT_SECTORS, sectors,
+                    cnt * SLOT_SECTORS);
+
+  lock_acquire (&swap_lock);
+  stats.ins += cnt;
+  stats.in_runs++;
+  histogram_add (&stats.in_cycles, rdtsc () - start);
+  lock_release (&swap_lock);
+}
+
+/* Reads the CNT adjacent slots starting at SLOT into the pages
+   in PAGES.  Slots that the compressed cache holds are
+   decompressed; each run of the rest is read from disk in one
+   sequential pass.  The slots stay allocated. */
+void
+swap_read (size_t slot, void *pages[], size_t cnt)
+{
+  bool cached[SWAP_CLUSTER];
+  size_t i, j;
+
+  ASSERT (cnt > 0 && cnt <= SWAP_CLUSTER);
+
+  for (i = 0; i < cnt; i++)
+    cached[i] = zswap_load (slot + i, pages[i]);
+  for (i = 0; i < cnt; i = j)
+    {
+      for (j = i + 1; j < cnt && cached[j] == cached[i]; j++)
+        continue;
+      if (!cached[i])
+        device_read (slot + i, pages + i, j - i);
+    }
+}
+
+/* Copies the swap statistics into *S. */
+void
+swap_get_stats (struct swap_stats *s)
+{
+  lock_acquire (&swap_lock);
+  *s = stats;
+  lock_release (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  struct swap_stats s;
+  size_t used = 0, total = 0;
+
+  /* Called at shutdown, possibly with interrupts off, so don't
+     take the lock. */
+  s = stats;
+  if (used_slots != NULL)
+    {
+      total = bitmap_size (used_slots);
+      used = bitmap_count (used_slots, 0, total, true);
+    }
+  printf ("Swap: %zu of %zu slots used, %llu pages out in %llu writes, "
+          "%llu pages in in %llu reads\n",
+          used, total, s.outs, s.out_runs, s.ins, s.in_runs);
+  histogram_print ("Swap: cycles per write", &s.out_cycles);
+  histogram_print ("Swap: cycles per read", &s.in_cycles);
+}
@@ -0,0 +1,51 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <histogram.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Swap space.
+
+   The swap device, the block device in the BLOCK_SWAP role, is
+   divided into page-sized slots, tracked by a bitmap.  Pages
+   that have been modified since they were brought in are written
+   to swap slots when they are evicted.
+
+   Writes are clustered: swap_alloc() hands out runs of adjacent
+   slots, so that a page evicted together with its dirty
+   neighbours in the address space goes to disk as one sequential
+   transfer, and reading the page back can read ahead its
+   neighbours from the slots that follow it.
+
+   With -zswap, a compressed cache in memory sits in front of the
+   device; see vm/zswap.h. */
+
+/* Identifies no slot. */
+#define SWAP_NONE SIZE_MAX
+
+/* Most pages written or read in one transfer. */
+#define SWAP_CLUSTER 8
+
+/* Swap statistics. */
+struct swap_stats
+  {
+    unsigned long long outs;            /* Pages written to disk. */
+    unsigned long long out_runs;        /* Sequential writes. */
+    unsigned long long ins;             /* Pages read from disk. */
+    unsigned long long in_runs;         /* Sequential reads. */
+    struct histogram out_cycles;        /* Cycles per write. */
+    struct histogram in_cycles;         /* Cycles per read. */
+  };
+
+void swap_init (void);
+size_t swap_alloc (size_t *cnt);
+void swap_free (size_t slot);
+void swap_write (size_t slot, void *pages[], size_t cnt);
+void swap_write_device (size_t slot, void *page);
+void swap_read (size_t slot, void *pages[], size_t cnt);
+void swap_get_stats (struct swap_stats *);
+void swap_print_stats (void);
+
+#endif /* vm/swap.h */
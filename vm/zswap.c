@@ -0,0 +1,536 @@
+#include "vm/zswap.h"
+#include <debug.h>
+#include <intmap.h>
+#include <list.h>
+#include <packed.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/swap.h"
+
+size_t zswap_max_pages;
+
+/* True if the cache is in use. */
+static bool enabled;
+
+/* Largest compressed page kept.  Pages that compress worse go
+   straight to disk. */
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)
+
+/* Pool pages are divided into chunks of this many bytes. */
+#define CHUNK_SIZE 64
+#define CHUNK_CNT (PGSIZE / CHUNK_SIZE)
+
+/* A pool page, which holds one or two compressed pages. */
+struct zpage
+  {
+    uint8_t *kpage;             /* The page. */
+    struct zentry *ends[2];     /* Entries at its start and end. */
+    struct list_elem elem;      /* In unbuddied[] if one end is free. */
+  };
+
+/* A compressed page. */
+struct zentry
+  {
+    size_t slot;                /* Swap slot it belongs to. */
+    struct zpage *zpage;        /* Pool page that holds it. */
+    int end;                    /* 0 at the start of ZPAGE, 1 at its end. */
+    size_t size;                /* Compressed size in bytes. */
+    struct list_elem lru_elem;  /* In lru, oldest first. */
+  };
+
+/* Protects everything below.  It is held while writing back to
+   disk, so that a slot being written back is not freed and
+   reused until the write is done. */
+static struct lock zswap_lock;
+
+/* Compressed pages by swap slot. */
+static struct intmap entries;
+
+/* Compressed pages, the oldest stored first. */
+static struct list lru;
+
+/* The pool pages with one compressed page, by how many chunks
+   they have free. */
+static struct list unbuddied[CHUNK_CNT];
+
+/* Pool pages in use. */
+static size_t pool_pages;
+
+/* Compression output, and a page to decompress into for writing
+   back. */
+static uint8_t cbuf[ZSWAP_MAX_SIZE];
+static void *wb_page;
+
+/* Statistics. */
+static unsigned long long stores;       /* Pages compressed and kept. */
+static unsigned long long rejects;      /* Pages that did not compress. */
+static unsigned long long no_room;      /* Pages with no memory to keep. */
+static unsigned long long writebacks;   /* Pages written back to disk. */
+static unsigned long long lookups;      /* Slots read. */
+static unsigned long long hits;         /* Slots read from the pool. */
+static size_t stored_bytes;             /* Bytes of compressed pages kept. */
+
+/* Writes back compressed pages when the kernel pool runs low. */
+static shrink_func zswap_shrink;
+static struct shrinker zswap_shrinker;
+
+static size_t lz_compress (const uint8_t *src, uint8_t *dst, size_t cap);
+static bool lz_decompress (const uint8_t *src, size_t size, uint8_t *dst);
+
+/* Initializes the compressed swap cache, unless -zswap turned it
+   off.  Called by swap_init() once it has found a swap device. */
+void
+zswap_init (void)
+{
+  size_t i;
+
+  if (zswap_max_pages == 0)
+    return;
+
+  lock_init (&zswap_lock);
+  list_init (&lru);
+  for (i = 0; i < CHUNK_CNT; i++)
+    list_init (&unbuddied[i]);
+  wb_page = palloc_get_page_tagged (0, MEM_ZSWAP);
+  if (wb_page == NULL || !intmap_init (&entries, 0))
+    PANIC ("Not enough memory for the compressed swap cache.");
+  enabled = true;
+  palloc_register_shrinker (&zswap_shrinker, "zswap", zswap_shrink,
+                            SHRINK_WRITEBACK);
+}
+
+/* Returns the number of chunks needed for SIZE bytes. */
+static size_t
+chunks (size_t size)
+{
+  return DIV_ROUND_UP (size, CHUNK_SIZE);
+}
+
+/* Returns the address of entry E's data. */
+static uint8_t *
+entry_data (const struct zentry *e)
+{
+  uint8_t *kpage = e->zpage->kpage;
+  return e->end == 0 ? kpage : kpage + PGSIZE - chunks (e->size) * CHUNK_SIZE;
+}
+
+/* Frees entry E, and its pool page if that leaves the page
+   empty.  The caller must hold zswap_lock and must already have
+   removed E from ENTRIES. */
+static void
+entry_free (struct zentry *e)
+{
+  struct zpage *z = e->zpage;
+  struct zentry *other = z->ends[!e->end];
+
+  list_remove (&e->lru_elem);
+  stored_bytes -= e->size;
+  z->ends[e->end] = NULL;
+  if (other == NULL)
+    {
+      list_remove (&z->elem);
+      palloc_free_page (z->kpage);
+      free (z);
+      pool_pages--;
+    }
+  else
+    list_push_back (&unbuddied[CHUNK_CNT - chunks (other->size)], &z->elem);
+  free (e);
+}
+
+/* Writes the oldest compressed page back to its slot on disk and
+   frees it.  Returns false if the pool is empty.  The caller
+   must hold zswap_lock. */
+static bool
+write_back_oldest (void)
+{
+  struct zentry *e;
+
+  if (list_empty (&lru))
+    return false;
+  e = list_entry (list_front (&lru), struct zentry, lru_elem);
+  if (!lz_decompress (entry_data (e), e->size, wb_page))
+    PANIC ("compressed swap page for slot %zu is corrupt", e->slot);
+  swap_write_device (e->slot, wb_page);
+  intmap_remove (&entries, e->slot);
+  entry_free (e);
+  writebacks++;
+  return true;
+}
+
+/* Finds room for SIZE compressed bytes for entry E, in a pool
+   page that has one free end or in a new one, writing back the
+   oldest compressed pages if the pool is full.  Returns false if
+   there is no memory.  The caller must hold zswap_lock. */
+static bool
+place (struct zentry *e, size_t size)
+{
+  for (;;)
+    {
+      struct zpage *z;
+      size_t i;
+
+      /* A pool page with enough chunks free at one end. */
+      for (i = chunks (size); i < CHUNK_CNT; i++)
+        if (!list_empty (&unbuddied[i]))
+          {
+            z = list_entry (list_pop_front (&unbuddied[i]),
+                            struct zpage, elem);
+            e->end = z->ends[0] == NULL ? 0 : 1;
+            e->zpage = z;
+            z->ends[e->end] = e;
+            return true;
+          }
+
+      /* A new pool page. */
+      if (pool_pages < zswap_max_pages)
+        {
+          z = malloc_tagged (sizeof *z, MEM_ZSWAP);
+          if (z != NULL)
+            z->kpage = palloc_get_page_tagged (0, MEM_ZSWAP);
+          if (z != NULL && z->kpage != NULL)
+            {
+              pool_pages++;
+              z->ends[0] = e;
+              z->ends[1] = NULL;
+              e->end = 0;
+              e->zpage = z;
+              list_push_back (&unbuddied[CHUNK_CNT - chunks (size)],
+                              &z->elem);
+              return true;
+            }
+          free (z);
+        }
+
+      /* Make room, or give up if there is nothing left to free. */
+      if (!write_back_oldest ())
+        return false;
+    }
+}
+
+/* Compresses PAGE and keeps it in the pool as the contents of
+   swap SLOT, replacing whatever the pool held for SLOT.  Returns
+   true if successful, false if PAGE does not compress well, the
+   cache is off, or there is no memory, in which case the caller
+   must write PAGE to SLOT on disk. */
+bool
+zswap_store (size_t slot, const void *page)
+{
+  struct zentry *e;
+  size_t size;
+  bool ok = false;
+
+  if (!enabled)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  e = intmap_remove (&entries, slot);
+  if (e != NULL)
+    entry_free (e);
+
+  size = lz_compress (page, cbuf, sizeof cbuf);
+  if (size == 0)
+    rejects++;
+  else if ((e = malloc_tagged (sizeof *e, MEM_ZSWAP)) == NULL)
+    no_room++;
+  else if (!place (e, size))
+    {
+      free (e);
+      no_room++;
+    }
+  else
+    {
+      e->slot = slot;
+      e->size = size;
+      memcpy (entry_data (e), cbuf, size);
+      list_push_back (&lru, &e->lru_elem);
+      stored_bytes += size;
+      if (intmap_insert (&entries, slot, e))
+        {
+          stores++;
+          ok = true;
+        }
+      else
+        {
+          entry_free (e);
+          no_room++;
+        }
+    }
+  lock_release (&zswap_lock);
+  return ok;
+}
+
+/* Decompresses the pool's copy of swap SLOT into PAGE and returns
+   true, or returns false if the pool does not have one, in which
+   case SLOT is on disk.  The pool keeps its copy until SLOT is
+   written or freed, as the disk would. */
+bool
+zswap_load (size_t slot, void *page)
+{
+  struct zentry *e;
+
+  if (!enabled)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  lookups++;
+  e = intmap_find (&entries, slot);
+  if (e != NULL)
+    {
+      if (!lz_decompress (entry_data (e), e->size, page))
+        PANIC ("compressed swap page for slot %zu is corrupt", slot);
+      hits++;
+    }
+  lock_release (&zswap_lock);
+  return e != NULL;
+}
+
+/* Drops the pool's copy of swap SLOT, if it has one. */
+void
+zswap_invalidate (size_t slot)
+{
+  struct zentry *e;
+
+  if (!enabled)
+    return;
+
+  lock_acquire (&zswap_lock);
+  e = intmap_remove (&entries, slot);
+  if (e != NULL)
+    entry_free (e);
+  lock_release (&zswap_lock);
+}
+
+/* Writes back the oldest compressed pages until PAGE_CNT pool
+   pages have been freed or the pool is empty, and returns the
+   number freed. */
+static size_t
+zswap_shrink (size_t page_cnt)
+{
+  size_t start;
+
+  if (lock_held_by_current_thread (&zswap_lock)
+      || !lock_try_acquire (&zswap_lock))
+    return 0;
+  start = pool_pages;
+  while (start - pool_pages < page_cnt && write_back_oldest ())
+    continue;
+  lock_release (&zswap_lock);
+  return start - pool_pages;
+}
+
+/* Prints the compressed swap cache's statistics. */
+void
+zswap_print_stats (void)
+{
+  size_t cnt;
+  unsigned long long ratio;
+
+  if (!enabled)
+    return;
+
+  /* Called at shutdown, possibly with interrupts off, so don't
+     take the lock. */
+  cnt = intmap_size (&entries);
+  ratio = stored_bytes > 0 ? (unsigned long long) cnt * PGSIZE * 100
+                             / stored_bytes : 0;
+  printf ("Zswap: %zu pages in %zu of %zu pool pages, %llu.%02llu:1 "
+          "compression\n",
+          cnt, pool_pages, zswap_max_pages, ratio / 100, ratio % 100);
+  printf ("Zswap: %llu stored, %llu incompressible, %llu without room, "
+          "%llu written back, %llu of %llu reads hit (%llu%%)\n",
+          stores, rejects, no_room, writebacks, hits, lookups,
+          lookups > 0 ? hits * 100 / lookups : 0);
+}
+
+/* Compression.
+
+   A compressed page is a sequence of runs, each a token byte, a
+   literal length, that many literal bytes, and then, except in
+   the last run, a back-reference: a 2-byte little-endian offset
+   and a match length.  The token's high nibble is the literal
+   length and its low nibble the match length minus LZ_MIN_MATCH;
+   a nibble of 15 is followed by more length bytes, added up
+   until one is less than 255. */
+
+/* Shortest match encoded. */
+#define LZ_MIN_MATCH 4
+
+/* Hash table of positions in the page being compressed, by the 4
+   bytes there.  Entries left over from earlier pages are
+   harmless, since every candidate is checked. */
+#define LZ_HASH_BITS 12
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+
+/* Unaligned 32-bit word. */
+struct lz_word
+  {
+    uint32_t v;
+  }
+PACKED;
+
+/* Returns the 4 bytes at P. */
+static inline uint32_t
+lz_read32 (const uint8_t *p)
+{
+  return ((const struct lz_word *) p)->v;
+}
+
+/* Returns the hash table index for the 4 bytes V. */
+static inline unsigned
+lz_hash (uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Writes the length bytes for LEN at OP and returns the end. */
+static uint8_t *
+lz_put_length (uint8_t *op, size_t len)
+{
+  for (; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+/* Writes a run of the LIT_CNT literals at LIT and, if MATCH_LEN
+   is nonzero, a back-reference to MATCH_LEN bytes OFFSET bytes
+   back, at OP, which must stay short of END.  Returns the end of
+   the run, or a null pointer if it does not fit. */
+static uint8_t *
+lz_emit (uint8_t *op, uint8_t *end, const uint8_t *lit, size_t lit_cnt,
+         size_t offset, size_t match_len)
+{
+  size_t need = 1 + (lit_cnt / 255 + 1) + lit_cnt;
+  uint8_t *token;
+
+  if (match_len > 0)
+    need += 2 + (match_len / 255 + 1);
+  if (need > (size_t) (end - op))
+    return NULL;
+
+  token = op++;
+  *token = (lit_cnt < 15 ? lit_cnt : 15) << 4;
+  if (lit_cnt >= 15)
+    op = lz_put_length (op, lit_cnt - 15);
+  memcpy (op, lit, lit_cnt);
+  op += lit_cnt;
+
+  if (match_len > 0)
+    {
+      size_t m = match_len - LZ_MIN_MATCH;
+
+      *op++ = offset & 0xff;
+      *op++ = offset >> 8;
+      *token |= m < 15 ? m : 15;
+      if (m >= 15)
+        op = lz_put_length (op, m - 15);
+    }
+  return op;
+}
+
+/* Compresses the page at SRC into DST, which has room for CAP
+   bytes.  Returns the compressed size, or 0 if it would exceed
+   CAP.  The caller must hold zswap_lock, which protects the hash
+   table. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t cap)
+{
+  const uint8_t *ip = src, *anchor = src, *iend = src + PGSIZE;
+  uint8_t *op = dst, *oend = dst + cap;
+
+  while (ip + LZ_MIN_MATCH <= iend)
+    {
+      uint32_t v = lz_read32 (ip);
+      unsigned h = lz_hash (v);
+      const uint8_t *cand = src + lz_table[h];
+
+      lz_table[h] = ip - src;
+      if (cand < ip && lz_read32 (cand) == v)
+        {
+          const uint8_t *m = ip + LZ_MIN_MATCH;
+
+          while (m < iend && *m == cand[m - ip])
+            m++;
+          op = lz_emit (op, oend, anchor, ip - anchor, ip - cand, m - ip);
+          if (op == NULL)
+            return 0;
+          ip = anchor = m;
+        }
+      else
+        {
+          /* Step faster through data that isn't matching, which
+             is likely not to compress at all. */
+          ip += 1 + (ip - anchor) / 64;
+        }
+    }
+  op = lz_emit (op, oend, anchor, iend - anchor, 0, 0);
+  return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Reads length bytes at *IP, before IEND, adding them to *LEN.
+   Returns false if they run past IEND. */
+static bool
+lz_get_length (const uint8_t **ip, const uint8_t *iend, size_t *len)
+{
+  uint8_t b;
+
+  do
+    {
+      if (*ip >= iend)
+        return false;
+      b = *(*ip)++;
+      *len += b;
+    }
+  while (b == 255);
+  return true;
+}
+
+/* Decompresses the SIZE bytes at SRC into the page at DST.
+   Returns true if they decompress to exactly one page. */
+static bool
+lz_decompress (const uint8_t *src, size_t size, uint8_t *dst)
+{
+  const uint8_t *ip = src, *iend = src + size;
+  uint8_t *op = dst, *oend = dst + PGSIZE;
+
+  while (ip < iend)
+    {
+      unsigned token = *ip++;
+      size_t len = token >> 4, offset;
+      const uint8_t *match;
+
+      if (len == 15 && !lz_get_length (&ip, iend, &len))
+        return false;
+      if (len > (size_t) (iend - ip) || len > (size_t) (oend - op))
+        return false;
+      memcpy (op, ip, len);
+      op += len;
+      ip += len;
+      if (ip == iend)
+        break;
+
+      if (iend - ip < 2)
+        return false;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      len = token & 15;
+      if (len == 15 && !lz_get_length (&ip, iend, &len))
+        return false;
+      len += LZ_MIN_MATCH;
+      if (offset == 0 || offset > (size_t) (op - dst)
+          || len > (size_t) (oend - op))
+        return false;
+
+      /* The match may overlap what it produces. */
+      for (match = op - offset; len > 0; len--)
+        *op++ = *match++;
+    }
+  return op == oend;
+}
@@ -0,0 +1,32 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Compressed swap cache.
+
+   Sits in front of the swap device.  A page written to a swap
+   slot is compressed and kept in a pool of kernel pages instead,
+   if it compresses to at most 3/4 of a page, and reading the
+   slot back decompresses it without touching the disk.  Each
+   slot keeps its place on the swap device, so when the pool is
+   full the oldest compressed pages are written back to their
+   slots to make room.
+
+   Each pool page holds at most two compressed pages, one at each
+   end, which keeps allocation and reclaim simple at the cost of
+   at most a 2:1 ratio.  The compressor is a small LZ77 in the
+   style of LZ4. */
+
+/* -zswap: most kernel pages the compressed cache may use.  0,
+   the default, turns it off. */
+extern size_t zswap_max_pages;
+
+void zswap_init (void);
+bool zswap_store (size_t slot, const void *page);
+bool zswap_load (size_t slot, void *page);
+void zswap_invalidate (size_t slot);
+void zswap_print_stats (void);
+
+#endif /* vm/zswap.h */